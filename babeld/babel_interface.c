@@ -155,7 +155,7 @@ babel_interface_delete (int cmd, struct zclient *client, zebra_size_t length)
 
     /* To support pseudo interface do not free interface structure.  */
     /* if_delete(ifp); */
-    ifp->ifindex = IFINDEX_INTERNAL;
+    if_set_index (ifp, IFINDEX_INTERNAL);
 
     return 0;
 }
@@ -868,6 +868,7 @@ DEFUN (show_babel_parameters,
 {
     vty_out(vty, "    -- Babel running configuration --%s", VTY_NEWLINE);
     show_babel_main_configuration(vty);
+    show_babel_socket_statistics(vty);
     vty_out(vty, "    -- distribution lists --%s", VTY_NEWLINE);
     config_show_distribute(vty);
 
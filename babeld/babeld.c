@@ -69,12 +69,13 @@ static int babel_read_protocol (struct thread *thread);
 static int babel_main_loop(struct thread *thread);
 static void babel_set_timer(struct timeval *timeout);
 static void babel_fill_with_next_timeout(struct timeval *tv);
+static void babel_create_batches(void);
 
 
 /* Informations relative to the babel running daemon. */
 static struct babel *babel_routing_process = NULL;
-static unsigned char *receive_buffer = NULL;
 static int receive_buffer_size = 0;
+struct msg_batch *protocol_send_batch = NULL;
 
 /* timeouts */
 struct timeval check_neighbours_timeout;
@@ -140,6 +141,10 @@ babel_create_routing_process (void)
         zlog_err("Couldn't create link local socket: %s", safe_strerror(errno));
         goto fail;
     }
+    /* When reading the configuration, the buffer size is not known
+       yet; resize_receive_buffer() creates the batches then. */
+    if(receive_buffer_size > 0)
+        babel_create_batches();
 
     /* Threads. */
     babel_routing_process->t_read =
@@ -159,28 +164,34 @@ fail:
 static int
 babel_read_protocol (struct thread *thread)
 {
-    int rc;
+    int rc, i;
     struct interface *ifp = NULL;
-    struct sockaddr_in6 sin6;
+    struct sockaddr_in6 *sin6;
     struct listnode *linklist_node = NULL;
+    struct msg_batch *batch;
 
     assert(babel_routing_process != NULL);
     assert(protocol_socket >= 0);
 
-    rc = babel_recv(protocol_socket,
-                    receive_buffer, receive_buffer_size,
-                    (struct sockaddr*)&sin6, sizeof(sin6));
+    babel_routing_process->t_read = NULL;
+
+    /* Everything waiting is read at once. */
+    batch = babel_routing_process->recv_batch;
+    rc = msg_batch_recv(batch);
     if(rc < 0) {
         if(errno != EAGAIN && errno != EINTR) {
             zlog_err("recv: %s", safe_strerror(errno));
         }
-    } else {
+    }
+    for(i = 0; i < rc; i++) {
+        sin6 = &MSG_BATCH_ADDR(batch, i)->sin6;
         FOR_ALL_INTERFACES(ifp, linklist_node) {
             if(!if_up(ifp))
                 continue;
-            if(ifp->ifindex == sin6.sin6_scope_id) {
-                parse_packet((unsigned char*)&sin6.sin6_addr, ifp,
-                             receive_buffer, rc);
+            if(ifp->ifindex == sin6->sin6_scope_id) {
+                parse_packet((unsigned char*)&sin6->sin6_addr, ifp,
+                             (unsigned char*)MSG_BATCH_DATA(batch, i),
+                             MSG_BATCH_LEN(batch, i));
                 break;
             }
         }
@@ -307,6 +318,13 @@ babel_clean_routing_process()
         thread_cancel(babel_routing_process->t_update);
     }
 
+    if (protocol_send_batch != NULL) {
+        msg_batch_flush(protocol_send_batch);
+        msg_batch_free(protocol_send_batch);
+        protocol_send_batch = NULL;
+    }
+    msg_batch_free(babel_routing_process->recv_batch);
+
     XFREE(MTYPE_BABEL, babel_routing_process);
     babel_routing_process = NULL;
 }
@@ -319,6 +337,10 @@ babel_main_loop(struct thread *thread)
     struct interface *ifp = NULL;
     struct listnode *linklist_node = NULL;
 
+    /* This runs as the t_update thread, which is over now; don't let
+       babel_set_timer() cancel it once its memory is reused. */
+    babel_routing_process->t_update = NULL;
+
     while(1) {
         gettime(&babel_now);
 
@@ -503,32 +525,49 @@ schedule_neighbours_check(int msecs, int override)
         timeval_min(&check_neighbours_timeout, &timeout);
 }
 
+/* (Re)create the send and receive batches of the Babel socket, with
+   room for datagrams of receive_buffer_size bytes.  Whatever is still
+   queued for sending goes out first. */
+static void
+babel_create_batches(void)
+{
+    if(protocol_send_batch != NULL) {
+        msg_batch_flush(protocol_send_batch);
+        msg_batch_free(protocol_send_batch);
+    }
+    if(babel_routing_process->recv_batch != NULL)
+        msg_batch_free(babel_routing_process->recv_batch);
+
+    protocol_send_batch = msg_batch_new(master, protocol_socket,
+                                        BABEL_BATCH_SIZE, receive_buffer_size);
+    babel_routing_process->recv_batch =
+        msg_batch_new(master, protocol_socket,
+                      BABEL_BATCH_SIZE, receive_buffer_size);
+}
+
 int
 resize_receive_buffer(int size)
 {
     if(size <= receive_buffer_size)
         return 0;
 
-    if(receive_buffer == NULL) {
-        receive_buffer = malloc(size);
-        if(receive_buffer == NULL) {
-            zlog_err("malloc(receive_buffer): %s", safe_strerror(errno));
-            return -1;
-        }
-        receive_buffer_size = size;
-    } else {
-        unsigned char *new;
-        new = realloc(receive_buffer, size);
-        if(new == NULL) {
-            zlog_err("realloc(receive_buffer): %s", safe_strerror(errno));
-            return -1;
-        }
-        receive_buffer = new;
-        receive_buffer_size = size;
-    }
+    receive_buffer_size = size;
+    if(babel_routing_process != NULL && protocol_socket >= 0)
+        babel_create_batches();
     return 1;
 }
 
+void
+show_babel_socket_statistics(struct vty *vty)
+{
+    if(babel_routing_process == NULL || protocol_send_batch == NULL)
+        return;
+
+    vty_out(vty, "    -- socket --%s", VTY_NEWLINE);
+    msg_batch_show(vty, "sent", protocol_send_batch);
+    msg_batch_show(vty, "received", babel_routing_process->recv_batch);
+}
+
 static void
 babel_distribute_update (struct distribute *dist)
 {
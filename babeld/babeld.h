@@ -42,6 +42,7 @@ THE SOFTWARE.
 
 #include <zebra.h>
 #include "vty.h"
+#include "msgbatch.h"
 
 #define INFINITY ((unsigned short)(~0))
 
@@ -114,8 +115,13 @@ THE SOFTWARE.
 #define BABEL_DEFAULT_RESEND_DELAY 2000
 
 
+/* Datagrams read or sent per system call on the Babel socket. */
+#define BABEL_BATCH_SIZE 32
+
 /* Babel socket. */
 extern int protocol_socket;
+/* Datagrams waiting to be sent on it. */
+extern struct msg_batch *protocol_send_batch;
 
 /* Babel structure. */
 struct babel
@@ -123,6 +129,8 @@ struct babel
     /* Babel threads. */
     struct thread *t_read;    /* on Babel protocol's socket */
     struct thread *t_update;  /* timers */
+
+    struct msg_batch *recv_batch;
 };
 
 
@@ -135,6 +143,7 @@ extern int output_filter(const unsigned char *id, const unsigned char *prefix,
 extern int redistribute_filter(const unsigned char *prefix, unsigned short plen,
                                unsigned int ifindex, int proto);
 extern int resize_receive_buffer(int size);
+extern void show_babel_socket_statistics(struct vty *vty);
 extern void schedule_neighbours_check(int msecs, int override);
 
 
@@ -529,6 +529,22 @@ check_bucket(struct interface *ifp)
     }
 }
 
+/* Queue a packet on the Babel socket; the whole batch goes out once
+   the current thread is done. */
+static int
+babel_send_packet(unsigned char *buf, int buflen, struct sockaddr_in6 *sin6)
+{
+    struct iovec iov[2];
+
+    DO_HTONS(packet_header + 2, buflen);
+    iov[0].iov_base = packet_header;
+    iov[0].iov_len = sizeof(packet_header);
+    iov[1].iov_base = buf;
+    iov[1].iov_len = buflen;
+    return msg_batch_add(protocol_send_batch, (struct sockaddr*)sin6,
+                         sizeof(*sin6), iov, 2);
+}
+
 void
 flushbuf(struct interface *ifp)
 {
@@ -549,11 +565,8 @@ flushbuf(struct interface *ifp)
             memcpy(&sin6.sin6_addr, protocol_group, 16);
             sin6.sin6_port = htons(protocol_port);
             sin6.sin6_scope_id = ifp->ifindex;
-            DO_HTONS(packet_header + 2, babel_ifp->buffered);
-            rc = babel_send(protocol_socket,
-                            packet_header, sizeof(packet_header),
-                            babel_ifp->sendbuf, babel_ifp->buffered,
-                            (struct sockaddr*)&sin6, sizeof(sin6));
+            rc = babel_send_packet(babel_ifp->sendbuf, babel_ifp->buffered,
+                                   &sin6);
             if(rc < 0)
                 zlog_err("send: %s", safe_strerror(errno));
         } else {
@@ -784,11 +797,7 @@ flush_unicast(int dofree)
         memcpy(&sin6.sin6_addr, unicast_neighbour->address, 16);
         sin6.sin6_port = htons(protocol_port);
         sin6.sin6_scope_id = unicast_neighbour->ifp->ifindex;
-        DO_HTONS(packet_header + 2, unicast_buffered);
-        rc = babel_send(protocol_socket,
-                        packet_header, sizeof(packet_header),
-                        unicast_buffer, unicast_buffered,
-                        (struct sockaddr*)&sin6, sizeof(sin6));
+        rc = babel_send_packet(unicast_buffer, unicast_buffered, &sin6);
         if(rc < 0)
             zlog_err("send(unicast): %s", safe_strerror(errno));
     } else {
@@ -39,6 +39,7 @@ THE SOFTWARE.
 
 #include <zebra.h>
 #include "if.h"
+#include "jhash.h"
 
 #include "babeld.h"
 #include "util.h"
@@ -61,9 +62,14 @@ int diversity_kind = DIVERSITY_NONE;
 int diversity_factor = 256;     /* in units of 1/256 */
 int keep_unfeasible = 0;
 
-/* We maintain a list of "slots", ordered by prefix.  Every slot
+/* We maintain a list of "slots", in no particular order.  Every slot
    contains a linked list of the routes to this prefix, with the
-   installed route, if any, at the head of the list. */
+   installed route, if any, at the head of the list.  Slots are found
+   through a hash index keyed on (prefix, plen); removing a slot moves
+   the last one into its place, so nothing is ever shifted. */
+
+static int *route_index = NULL;
+static int route_index_size = 0;
 
 static int
 route_compare(const unsigned char *prefix, unsigned char plen,
@@ -81,38 +87,83 @@ route_compare(const unsigned char *prefix, unsigned char plen,
         return 0;
 }
 
-/* Performs binary search, returns -1 in case of failure.  In the latter
-   case, new_return is the place where to insert the new element. */
+static unsigned int
+route_hash(const unsigned char *prefix, unsigned char plen)
+{
+    return jhash((void *)prefix, 16, plen);
+}
+
+/* Open addressing with linear probing.  Returns the index entry for
+   (prefix, plen), or the free entry where it would go. */
+
+static int
+route_index_pos(const unsigned char *prefix, unsigned char plen)
+{
+    int mask = route_index_size - 1;
+    int h = route_hash(prefix, plen) & mask;
+
+    while(route_index[h] >= 0 &&
+          route_compare(prefix, plen, routes[route_index[h]]) != 0)
+        h = (h + 1) & mask;
+
+    return h;
+}
 
 static int
-find_route_slot(const unsigned char *prefix, unsigned char plen,
-                int *new_return)
+resize_route_index(int new_size)
 {
-    int p, m, g, c;
+    int *new_index;
+    int i;
 
-    if(route_slots < 1) {
-        if(new_return)
-            *new_return = 0;
+    new_index = malloc(new_size * sizeof(int));
+    if(new_index == NULL)
         return -1;
-    }
 
-    p = 0; g = route_slots - 1;
+    free(route_index);
+    route_index = new_index;
+    route_index_size = new_size;
+    for(i = 0; i < new_size; i++)
+        route_index[i] = -1;
 
-    do {
-        m = (p + g) / 2;
-        c = route_compare(prefix, plen, routes[m]);
-        if(c == 0)
-            return m;
-        else if(c < 0)
-            g = m - 1;
-        else
-            p = m + 1;
-    } while(p <= g);
+    for(i = 0; i < route_slots; i++)
+        route_index[route_index_pos(routes[i]->src->prefix,
+                                    routes[i]->src->plen)] = i;
+    return 1;
+}
+
+/* Free an index entry, shifting back the entries of the same probe
+   sequence so that lookups need no tombstones. */
+
+static void
+route_index_delete(int pos)
+{
+    int mask = route_index_size - 1;
+    int i = pos, j = pos, k;
+
+    route_index[i] = -1;
+    while(1) {
+        j = (j + 1) & mask;
+        if(route_index[j] < 0)
+            break;
+        k = route_hash(routes[route_index[j]]->src->prefix,
+                       routes[route_index[j]]->src->plen) & mask;
+        if(i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        route_index[i] = route_index[j];
+        route_index[j] = -1;
+        i = j;
+    }
+}
 
-    if(new_return)
-        *new_return = p;
+/* Returns the slot for (prefix, plen), -1 in case of failure. */
 
-    return -1;
+static int
+find_route_slot(const unsigned char *prefix, unsigned char plen)
+{
+    if(route_slots < 1)
+        return -1;
+
+    return route_index[route_index_pos(prefix, plen)];
 }
 
 struct babel_route *
@@ -120,7 +171,7 @@ find_route(const unsigned char *prefix, unsigned char plen,
            struct neighbour *neigh, const unsigned char *nexthop)
 {
     struct babel_route *route;
-    int i = find_route_slot(prefix, plen, NULL);
+    int i = find_route_slot(prefix, plen);
 
     if(i < 0)
         return NULL;
@@ -139,7 +190,7 @@ find_route(const unsigned char *prefix, unsigned char plen,
 struct babel_route *
 find_installed_route(const unsigned char *prefix, unsigned char plen)
 {
-    int i = find_route_slot(prefix, plen, NULL);
+    int i = find_route_slot(prefix, plen);
 
     if(i >= 0 && routes[i]->installed)
         return routes[i];
@@ -163,6 +214,9 @@ resize_route_table(int new_slots)
     if(new_slots == 0) {
         new_routes = NULL;
         free(routes);
+        free(route_index);
+        route_index = NULL;
+        route_index_size = 0;
     } else {
         new_routes = realloc(routes, new_slots * sizeof(struct babel_route*));
         if(new_routes == NULL)
@@ -179,23 +233,27 @@ resize_route_table(int new_slots)
 static struct babel_route *
 insert_route(struct babel_route *route)
 {
-    int i, n;
+    int i;
 
     assert(!route->installed);
 
-    i = find_route_slot(route->src->prefix, route->src->plen, &n);
+    i = find_route_slot(route->src->prefix, route->src->plen);
 
     if(i < 0) {
         if(route_slots >= max_route_slots)
             resize_route_table(max_route_slots < 1 ? 8 : 2 * max_route_slots);
         if(route_slots >= max_route_slots)
             return NULL;
+        /* Keep the index at most half full. */
+        if(2 * (route_slots + 1) > route_index_size &&
+           resize_route_index(route_index_size < 1 ?
+                              16 : 2 * route_index_size) < 0)
+            return NULL;
         route->next = NULL;
-        if(n < route_slots)
-            memmove(routes + n + 1, routes + n,
-                    (route_slots - n) * sizeof(struct babel_route*));
+        routes[route_slots] = route;
+        route_index[route_index_pos(route->src->prefix,
+                                    route->src->plen)] = route_slots;
         route_slots++;
-        routes[n] = route;
     } else {
         struct babel_route *r;
         r = routes[i];
@@ -208,6 +266,26 @@ insert_route(struct babel_route *route)
     return route;
 }
 
+/* Remove an emptied slot; the last slot takes its place. */
+static void
+delete_route_slot(int i)
+{
+    int pos;
+
+    pos = route_index_pos(routes[i]->src->prefix, routes[i]->src->plen);
+    assert(route_index[pos] == i);
+    route_index_delete(pos);
+
+    route_slots--;
+    if(i < route_slots) {
+        routes[i] = routes[route_slots];
+        pos = route_index_pos(routes[i]->src->prefix, routes[i]->src->plen);
+        assert(route_index[pos] == route_slots);
+        route_index[pos] = i;
+    }
+    routes[route_slots] = NULL;
+}
+
 void
 flush_route(struct babel_route *route)
 {
@@ -224,26 +302,24 @@ flush_route(struct babel_route *route)
         lost = 1;
     }
 
-    i = find_route_slot(route->src->prefix, route->src->plen, NULL);
+    i = find_route_slot(route->src->prefix, route->src->plen);
     assert(i >= 0 && i < route_slots);
 
     if(route == routes[i]) {
-        routes[i] = route->next;
+        if(route->next == NULL)
+            delete_route_slot(i);
+        else
+            routes[i] = route->next;
         route->next = NULL;
         free(route);
 
-        if(routes[i] == NULL) {
-            if(i < route_slots - 1)
-                memmove(routes + i, routes + i + 1,
-                        (route_slots - i - 1) * sizeof(struct babel_route*));
-            routes[route_slots - 1] = NULL;
-            route_slots--;
-        }
-
         if(route_slots == 0)
             resize_route_table(0);
-        else if(max_route_slots > 8 && route_slots < max_route_slots / 4)
+        else if(max_route_slots > 8 && route_slots < max_route_slots / 4) {
             resize_route_table(max_route_slots / 2);
+            if(route_index_size > 16 && route_slots < route_index_size / 8)
+                resize_route_index(route_index_size / 2);
+        }
     } else {
         struct babel_route *r = routes[i];
         while(r->next != route)
@@ -386,7 +462,7 @@ install_route(struct babel_route *route)
         zlog_err("WARNING: installing unfeasible route "
                  "(this shouldn't happen).");
 
-    i = find_route_slot(route->src->prefix, route->src->plen, NULL);
+    i = find_route_slot(route->src->prefix, route->src->plen);
     assert(i >= 0 && i < route_slots);
 
     if(routes[i] != route && routes[i]->installed) {
@@ -461,8 +537,8 @@ switch_routes(struct babel_route *old, struct babel_route *new)
 
     old->installed = 0;
     new->installed = 1;
-    move_installed_route(new, find_route_slot(new->src->prefix, new->src->plen,
-                                              NULL));
+    move_installed_route(new, find_route_slot(new->src->prefix,
+                                              new->src->plen));
 }
 
 static void
@@ -587,7 +663,7 @@ find_best_route(const unsigned char *prefix, unsigned char plen, int feasible,
                 struct neighbour *exclude)
 {
     struct babel_route *route = NULL, *r = NULL;
-    int i = find_route_slot(prefix, plen, NULL);
+    int i = find_route_slot(prefix, plen);
 
     if(i < 0)
         return NULL;
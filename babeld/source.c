@@ -47,31 +47,74 @@ THE SOFTWARE.
 #include "source.h"
 #include "babel_interface.h"
 #include "route.h"
+#include "jhash.h"
 
 struct source *srcs = NULL;
 
+/* Sources are also chained in a hash table keyed on (id, prefix, plen),
+   which grows to keep about one source per bucket. */
+static struct source **source_hash = NULL;
+static unsigned int source_hash_size = 0;
+static unsigned int source_count = 0;
+
+static unsigned int
+source_key(const unsigned char *id, const unsigned char *p,
+           unsigned char plen)
+{
+    return jhash((void *)p, 16, jhash((void *)id, 8, plen));
+}
+
+static int
+resize_source_hash(unsigned int new_size)
+{
+    struct source **new_hash;
+    struct source *src;
+    unsigned int h;
+
+    new_hash = calloc(new_size, sizeof(struct source *));
+    if(new_hash == NULL)
+        return -1;
+
+    for(src = srcs; src; src = src->next) {
+        h = source_key(src->id, src->prefix, src->plen) & (new_size - 1);
+        src->hash_next = new_hash[h];
+        new_hash[h] = src;
+    }
+
+    free(source_hash);
+    source_hash = new_hash;
+    source_hash_size = new_size;
+    return 1;
+}
+
 struct source*
 find_source(const unsigned char *id, const unsigned char *p, unsigned char plen,
             int create, unsigned short seqno)
 {
     struct source *src;
-
-    for(src = srcs; src; src = src->next) {
-        /* This should really be a hash table.  For now, check the
-           last byte first. */
-        if(src->id[7] != id[7])
-            continue;
-        if(memcmp(src->id, id, 8) != 0)
-            continue;
-        if(src->plen != plen)
-            continue;
-        if(memcmp(src->prefix, p, 16) == 0)
-            return src;
+    unsigned int h;
+
+    if(source_hash_size > 0) {
+        h = source_key(id, p, plen) & (source_hash_size - 1);
+        for(src = source_hash[h]; src; src = src->hash_next) {
+            if(src->plen != plen)
+                continue;
+            if(memcmp(src->id, id, 8) != 0)
+                continue;
+            if(memcmp(src->prefix, p, 16) == 0)
+                return src;
+        }
     }
 
     if(!create)
         return NULL;
 
+    if(source_count >= source_hash_size &&
+       resize_source_hash(source_hash_size < 1 ?
+                          64 : 2 * source_hash_size) < 0 &&
+       source_hash_size < 1)
+        return NULL;
+
     src = malloc(sizeof(struct source));
     if(src == NULL) {
         zlog_err("malloc(source): %s", safe_strerror(errno));
@@ -85,8 +128,16 @@ find_source(const unsigned char *id, const unsigned char *p, unsigned char plen,
     src->metric = INFINITY;
     src->time = babel_now.tv_sec;
     src->route_count = 0;
+    src->prev = NULL;
     src->next = srcs;
+    if(srcs)
+        srcs->prev = src;
     srcs = src;
+
+    h = source_key(id, p, plen) & (source_hash_size - 1);
+    src->hash_next = source_hash[h];
+    source_hash[h] = src;
+    source_count++;
     return src;
 }
 
@@ -108,18 +159,25 @@ release_source(struct source *src)
 int
 flush_source(struct source *src)
 {
+    struct source **hp;
+
     if(src->route_count > 0)
         /* The source is in use by a route. */
         return 0;
 
-    if(srcs == src) {
+    if(src->prev)
+        src->prev->next = src->next;
+    else
         srcs = src->next;
-    } else {
-        struct source *previous = srcs;
-        while(previous->next != src)
-            previous = previous->next;
-        previous->next = src->next;
-    }
+    if(src->next)
+        src->next->prev = src->prev;
+
+    hp = &source_hash[source_key(src->id, src->prefix, src->plen) &
+                      (source_hash_size - 1)];
+    while(*hp != src)
+        hp = &(*hp)->hash_next;
+    *hp = src->hash_next;
+    source_count--;
 
     free(src);
     return 1;
@@ -43,6 +43,8 @@ THE SOFTWARE.
 
 struct source {
     struct source *next;
+    struct source *prev;
+    struct source *hash_next;
     unsigned char id[8];
     unsigned char prefix[16];
     unsigned char plen;
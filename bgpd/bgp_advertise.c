@@ -25,6 +25,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "prefix.h"
 #include "hash.h"
 #include "thread.h"
+#include "jhash.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_table.h"
@@ -152,41 +153,235 @@ bgp_advertise_unintern (struct hash *hash, struct bgp_advertise_attr *baa)
     }
 }
 
-/* BGP adjacency keeps minimal advertisement information.  */
+/* Prefixes sent and bytes held by all adjacencies out, for "show bgp
+   memory".  */
+static unsigned long bgp_adj_out_routes;
+static unsigned long bgp_adj_out_bytes;
+
+static struct bgp_adj_out *
+bgp_adj_out_get (struct bgp_node *rn)
+{
+  if (! rn->adj_out)
+    {
+      rn->adj_out = XCALLOC (MTYPE_BGP_ADJ_OUT, sizeof (struct bgp_adj_out));
+      bgp_adj_out_bytes += sizeof (struct bgp_adj_out);
+    }
+  return rn->adj_out;
+}
+
+static int
+bgp_adj_out_is_sent (struct bgp_adj_out *adj, int slot)
+{
+  return (slot < adj->words * 32
+	  && (adj->sent[slot / 32] & (1U << (slot % 32))));
+}
+
+/* Pending advertisement of the prefix of ADJ to PEER.  */
+static struct bgp_advertise *
+bgp_adj_out_adv (struct bgp_adj_out *adj, struct peer *peer)
+{
+  struct bgp_advertise *adv;
+
+  for (adv = adj->adv; adv; adv = adv->adj_next)
+    if (adv->peer == peer)
+      break;
+  return adv;
+}
+
+/* Attribute sent to the peer in SLOT, which the prefix was sent to.  */
+static struct attr *
+bgp_adj_out_slot_attr (struct bgp_adj_out *adj, int slot)
+{
+  int i;
+
+  for (i = 0; i < adj->other_count; i++)
+    if (adj->other[i].slot == slot)
+      return adj->other[i].attr;
+  return adj->attr;
+}
+
+static void
+bgp_adj_out_other_add (struct bgp_adj_out *adj, int slot, struct attr *attr)
+{
+  adj->other = XREALLOC (MTYPE_BGP_ADJ_OUT_ATTR, adj->other,
+			 (adj->other_count + 1)
+			 * sizeof (struct bgp_adj_out_attr));
+  adj->other[adj->other_count].slot = slot;
+  adj->other[adj->other_count].attr = attr;
+  adj->other_count++;
+  bgp_adj_out_bytes += sizeof (struct bgp_adj_out_attr);
+}
+
+/* Take entry I out of the peers sent another attribute, dropping its
+   reference to the attribute.  */
+static void
+bgp_adj_out_other_del (struct bgp_adj_out *adj, int i)
+{
+  bgp_attr_unintern (&adj->other[i].attr);
+  adj->other[i] = adj->other[--adj->other_count];
+  bgp_adj_out_bytes -= sizeof (struct bgp_adj_out_attr);
+
+  if (adj->other_count)
+    adj->other = XREALLOC (MTYPE_BGP_ADJ_OUT_ATTR, adj->other,
+			   adj->other_count
+			   * sizeof (struct bgp_adj_out_attr));
+  else
+    {
+      XFREE (MTYPE_BGP_ADJ_OUT_ATTR, adj->other);
+      adj->other = NULL;
+    }
+}
+
+/* Forget the attribute sent to the peer in SLOT.  */
+static void
+bgp_adj_out_slot_forget (struct bgp_adj_out *adj, int slot)
+{
+  int i;
+
+  for (i = 0; i < adj->other_count; i++)
+    if (adj->other[i].slot == slot)
+      {
+	bgp_adj_out_other_del (adj, i);
+	break;
+      }
+}
+
+/* Once no peer is left with the attribute most were sent, make that
+   of the first of the others the one kept once.  */
+static void
+bgp_adj_out_balance (struct bgp_adj_out *adj)
+{
+  int i;
+
+  if (adj->count > adj->other_count || ! adj->attr)
+    return;
+
+  bgp_attr_unintern (&adj->attr);
+  if (! adj->other_count)
+    return;
+
+  adj->attr = bgp_attr_intern (adj->other[0].attr);
+  for (i = adj->other_count - 1; i >= 0; i--)
+    if (adj->other[i].attr == adj->attr)
+      bgp_adj_out_other_del (adj, i);
+}
+
+/* Record that the prefix of RN was sent to PEER with ATTR, interned.
+   Return whether it had not been sent to PEER before.  */
+int
+bgp_adj_out_sent (struct bgp_node *rn, struct peer *peer, struct attr *attr)
+{
+  struct bgp_adj_out *adj = rn->adj_out;
+  int slot = peer->slot;
+  int words;
+  int new;
+
+  if (slot >= adj->words * 32)
+    {
+      words = slot / 32 + 1;
+      adj = XREALLOC (MTYPE_BGP_ADJ_OUT, adj, sizeof (struct bgp_adj_out)
+		      + words * sizeof (u_int32_t));
+      memset (adj->sent + adj->words, 0,
+	      (words - adj->words) * sizeof (u_int32_t));
+      bgp_adj_out_bytes += (words - adj->words) * sizeof (u_int32_t);
+      adj->words = words;
+      rn->adj_out = adj;
+    }
+
+  new = ! bgp_adj_out_is_sent (adj, slot);
+  if (new)
+    {
+      adj->sent[slot / 32] |= 1U << (slot % 32);
+      adj->count++;
+      bgp_adj_out_routes++;
+    }
+  else
+    bgp_adj_out_slot_forget (adj, slot);
+
+  attr = bgp_attr_intern (attr);
+  if (! adj->attr)
+    adj->attr = attr;
+  else if (attr == adj->attr)
+    bgp_attr_unintern (&attr);
+  else
+    bgp_adj_out_other_add (adj, slot, attr);
+
+  bgp_adj_out_balance (adj);
+  return new;
+}
+
+/* Forget that the prefix of ADJ was sent to the peer in SLOT.  */
 static void
-bgp_adj_out_free (struct bgp_adj_out *adj)
+bgp_adj_out_unsent (struct bgp_adj_out *adj, int slot)
 {
-  peer_unlock (adj->peer); /* adj_out peer reference */
-  XFREE (MTYPE_BGP_ADJ_OUT, adj);
+  bgp_adj_out_slot_forget (adj, slot);
+  adj->sent[slot / 32] &= ~(1U << (slot % 32));
+  adj->count--;
+  bgp_adj_out_routes--;
+  bgp_adj_out_balance (adj);
+}
+
+/* Drop the adjacency of PEER at RN, with neither the prefix sent nor
+   an advertisement pending any more.  */
+static void
+bgp_adj_out_release (struct bgp_node *rn, struct peer *peer)
+{
+  struct bgp_adj_out *adj = rn->adj_out;
+
+  if (! adj->count && ! adj->adv)
+    {
+      bgp_adj_out_bytes -= sizeof (struct bgp_adj_out)
+	+ adj->words * sizeof (u_int32_t);
+      XFREE (MTYPE_BGP_ADJ_OUT, adj);
+      rn->adj_out = NULL;
+    }
+
+  peer_unlock (peer); /* adj_out peer reference */
 }
 
 int
 bgp_adj_out_lookup (struct peer *peer, struct prefix *p,
 		    afi_t afi, safi_t safi, struct bgp_node *rn)
 {
-  struct bgp_adj_out *adj;
-
-  for (adj = rn->adj_out; adj; adj = adj->next)
-    if (adj->peer == peer)
-      break;
+  struct bgp_adj_out *adj = rn->adj_out;
+  struct bgp_advertise *adv;
 
   if (! adj)
     return 0;
 
-  return (adj->adv 
-	  ? (adj->adv->baa ? 1 : 0)
-	  : (adj->attr ? 1 : 0));
+  if ((adv = bgp_adj_out_adv (adj, peer)) != NULL)
+    return adv->baa ? 1 : 0;
+
+  return bgp_adj_out_is_sent (adj, peer->slot);
+}
+
+/* Attribute the prefix of RN was last sent to PEER with, if any.  */
+struct attr *
+bgp_adj_out_attr (struct bgp_node *rn, struct peer *peer)
+{
+  struct bgp_adj_out *adj = rn->adj_out;
+
+  if (! adj || ! bgp_adj_out_is_sent (adj, peer->slot))
+    return NULL;
+
+  return bgp_adj_out_slot_attr (adj, peer->slot);
+}
+
+/* Whether an advertisement of the prefix of RN to PEER is pending.  */
+int
+bgp_adj_out_pending (struct bgp_node *rn, struct peer *peer)
+{
+  return rn->adj_out && bgp_adj_out_adv (rn->adj_out, peer);
 }
 
 struct bgp_advertise *
-bgp_advertise_clean (struct peer *peer, struct bgp_adj_out *adj,
+bgp_advertise_clean (struct peer *peer, struct bgp_advertise *adv,
 		     afi_t afi, safi_t safi)
 {
-  struct bgp_advertise *adv;
   struct bgp_advertise_attr *baa;
   struct bgp_advertise *next;
+  struct bgp_advertise **prev;
 
-  adv = adj->adv;
   baa = adv->baa;
   next = NULL;
 
@@ -204,10 +399,15 @@ bgp_advertise_clean (struct peer *peer, struct bgp_adj_out *adj,
 
   /* Unlink myself from advertisement FIFO.  */
   FIFO_DEL (adv);
+  peer->sync[afi][safi]->count--;
+
+  /* Unlink myself from the advertisements of the prefix.  */
+  for (prev = &adv->rn->adj_out->adv; *prev != adv; prev = &(*prev)->adj_next)
+    ;
+  *prev = adv->adj_next;
 
   /* Free memory.  */
-  bgp_advertise_free (adj->adv);
-  adj->adv = NULL;
+  bgp_advertise_free (adv);
 
   return next;
 }
@@ -217,39 +417,29 @@ bgp_adj_out_set (struct bgp_node *rn, struct peer *peer, struct prefix *p,
 		 struct attr *attr, afi_t afi, safi_t safi,
 		 struct bgp_info *binfo)
 {
-  struct bgp_adj_out *adj = NULL;
+  struct bgp_adj_out *adj;
   struct bgp_advertise *adv;
 
   if (DISABLE_BGP_ANNOUNCE)
     return;
 
   /* Look for adjacency information. */
-  if (rn)
-    {
-      for (adj = rn->adj_out; adj; adj = adj->next)
-	if (adj->peer == peer)
-	  break;
-    }
+  adj = bgp_adj_out_get (rn);
+  adv = bgp_adj_out_adv (adj, peer);
 
-  if (! adj)
+  if (adv)
+    bgp_advertise_clean (peer, adv, afi, safi);
+  else if (! bgp_adj_out_is_sent (adj, peer->slot))
     {
-      adj = XCALLOC (MTYPE_BGP_ADJ_OUT, sizeof (struct bgp_adj_out));
-      adj->peer = peer_lock (peer); /* adj_out peer reference */
-      
-      if (rn)
-        {
-          BGP_ADJ_OUT_ADD (rn, adj);
-          bgp_lock_node (rn);
-        }
+      peer_lock (peer); /* adj_out peer reference */
+      bgp_lock_node (rn);
     }
 
-  if (adj->adv)
-    bgp_advertise_clean (peer, adj, afi, safi);
-  
-  adj->adv = bgp_advertise_new ();
-
-  adv = adj->adv;
+  adv = bgp_advertise_new ();
   adv->rn = rn;
+  adv->peer = peer;
+  adv->adj_next = adj->adv;
+  adj->adv = adv;
   
   assert (adv->binfo == NULL);
   adv->binfo = bgp_info_lock (binfo); /* bgp_info adj_out reference */
@@ -258,12 +448,12 @@ bgp_adj_out_set (struct bgp_node *rn, struct peer *peer, struct prefix *p,
     adv->baa = bgp_advertise_intern (peer->hash[afi][safi], attr);
   else
     adv->baa = baa_new ();
-  adv->adj = adj;
 
   /* Add new advertisement to advertisement attribute list. */
   bgp_advertise_add (adv->baa, adv);
 
   FIFO_ADD (&peer->sync[afi][safi]->update, &adv->fifo);
+  peer->sync[afi][safi]->count++;
 }
 
 void
@@ -277,27 +467,29 @@ bgp_adj_out_unset (struct bgp_node *rn, struct peer *peer, struct prefix *p,
     return;
 
   /* Lookup existing adjacency, if it is not there return immediately.  */
-  for (adj = rn->adj_out; adj; adj = adj->next)
-    if (adj->peer == peer)
-      break;
+  if ((adj = rn->adj_out) == NULL)
+    return;
 
-  if (! adj)
+  adv = bgp_adj_out_adv (adj, peer);
+  if (! adv && ! bgp_adj_out_is_sent (adj, peer->slot))
     return;
 
   /* Clearn up previous advertisement.  */
-  if (adj->adv)
-    bgp_advertise_clean (peer, adj, afi, safi);
+  if (adv)
+    bgp_advertise_clean (peer, adv, afi, safi);
 
-  if (adj->attr)
+  if (bgp_adj_out_is_sent (adj, peer->slot))
     {
       /* We need advertisement structure.  */
-      adj->adv = bgp_advertise_new ();
-      adv = adj->adv;
+      adv = bgp_advertise_new ();
       adv->rn = rn;
-      adv->adj = adj;
+      adv->peer = peer;
+      adv->adj_next = adj->adv;
+      adj->adv = adv;
 
       /* Add to synchronization entry for withdraw announcement.  */
       FIFO_ADD (&peer->sync[afi][safi]->withdraw, &adv->fifo);
+      peer->sync[afi][safi]->count++;
 
       /* Schedule packet write. */
       BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
@@ -305,78 +497,414 @@ bgp_adj_out_unset (struct bgp_node *rn, struct peer *peer, struct prefix *p,
   else
     {
       /* Remove myself from adjacency. */
-      BGP_ADJ_OUT_DEL (rn, adj);
-      
-      /* Free allocated information.  */
-      bgp_adj_out_free (adj);
+      bgp_adj_out_release (rn, peer);
 
       bgp_unlock_node (rn);
     }
 }
 
-void
-bgp_adj_out_remove (struct bgp_node *rn, struct bgp_adj_out *adj, 
-		    struct peer *peer, afi_t afi, safi_t safi)
+/* Forget all about the prefix of RN for PEER.  Return whether there
+   was anything, for the caller to unlock RN.  */
+int
+bgp_adj_out_remove (struct bgp_node *rn, struct peer *peer,
+		    afi_t afi, safi_t safi)
 {
-  if (adj->attr)
-    bgp_attr_unintern (&adj->attr);
+  struct bgp_adj_out *adj;
+  struct bgp_advertise *adv;
+  int sent;
+
+  if ((adj = rn->adj_out) == NULL)
+    return 0;
+
+  adv = bgp_adj_out_adv (adj, peer);
+  sent = bgp_adj_out_is_sent (adj, peer->slot);
+  if (! adv && ! sent)
+    return 0;
+
+  if (sent)
+    bgp_adj_out_unsent (adj, peer->slot);
 
-  if (adj->adv)
-    bgp_advertise_clean (peer, adj, afi, safi);
+  if (adv)
+    bgp_advertise_clean (peer, adv, afi, safi);
 
-  BGP_ADJ_OUT_DEL (rn, adj);
-  bgp_adj_out_free (adj);
+  bgp_adj_out_release (rn, peer);
+  return 1;
 }
-
-void
-bgp_adj_in_set (struct bgp_node *rn, struct peer *peer, struct attr *attr)
+
+unsigned long
+bgp_adj_out_stats (unsigned long *bytes)
+{
+  if (bytes)
+    *bytes = bgp_adj_out_bytes;
+  return bgp_adj_out_routes;
+}
+
+/* Routes and bytes held by all adjacencies in, for "show bgp memory".  */
+static unsigned long bgp_adj_in_routes;
+static unsigned long bgp_adj_in_bytes;
+
+static unsigned long
+bgp_adj_in_size (struct bgp_adj_in *adj)
+{
+  return sizeof (struct bgp_adj_in)
+    + (unsigned long) adj->size * adj->stride
+    + (unsigned long) adj->index.size * sizeof (u_int32_t)
+    + (unsigned long) adj->attr_size * sizeof (struct bgp_adj_in_attr)
+    + (unsigned long) adj->attr_index.size * sizeof (u_int32_t);
+}
+
+static u_int32_t
+bgp_adj_in_route_hash (struct bgp_adj_in *adj, u_int32_t id)
+{
+  struct bgp_adj_in_route *route = BGP_ADJ_IN_ROUTE (adj, id);
+
+  return jhash (route->key, adj->keylen, route->prefixlen);
+}
+
+static u_int32_t
+bgp_adj_in_attr_hash (struct bgp_adj_in *adj, u_int32_t id)
+{
+  struct attr *attr = adj->attr[id].attr;
+
+  return jhash (&attr, sizeof (struct attr *), 0);
+}
+
+/* Take the entry in slot I out of INDEX, moving up the entries after
+   it which would otherwise no longer be found.  */
+static void
+bgp_adj_in_index_delete (struct bgp_adj_in *adj,
+			 struct bgp_adj_in_index *index, u_int32_t i,
+			 u_int32_t (*hash) (struct bgp_adj_in *, u_int32_t))
+{
+  u_int32_t mask = index->size - 1;
+  u_int32_t j, home;
+
+  index->slot[i] = 0;
+  for (j = (i + 1) & mask; index->slot[j]; j = (j + 1) & mask)
+    {
+      home = (*hash) (adj, index->slot[j] - 1) & mask;
+
+      /* Leave it if its home lies cyclically in (i, j].  */
+      if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+	continue;
+
+      index->slot[i] = index->slot[j];
+      index->slot[j] = 0;
+      i = j;
+    }
+}
+
+/* Make room in INDEX for COUNT entries, at most three quarters full.  */
+static void
+bgp_adj_in_index_reserve (struct bgp_adj_in *adj,
+			  struct bgp_adj_in_index *index, u_int32_t count,
+			  u_int32_t limit,
+			  u_int32_t (*hash) (struct bgp_adj_in *, u_int32_t))
 {
-  struct bgp_adj_in *adj;
+  u_int32_t size, id, i;
+
+  if (count * 4 <= index->size * 3)
+    return;
+
+  for (size = index->size ? index->size : 16; count * 4 > size * 3; size *= 2)
+    ;
 
-  for (adj = rn->adj_in; adj; adj = adj->next)
+  XFREE (MTYPE_BGP_ADJ_IN_INDEX, index->slot);
+  index->slot = XCALLOC (MTYPE_BGP_ADJ_IN_INDEX, size * sizeof (u_int32_t));
+  index->size = size;
+
+  /* LIMIT entries are numbered in order, some possibly unused.  */
+  for (id = 0; id < limit; id++)
     {
-      if (adj->peer == peer)
+      /* Unused attribute numbers have no attribute.  */
+      if (hash == bgp_adj_in_attr_hash && ! adj->attr[id].attr)
+	continue;
+      for (i = (*hash) (adj, id) & (size - 1); index->slot[i];
+	   i = (i + 1) & (size - 1))
+	;
+      index->slot[i] = id + 1;
+    }
+}
+
+/* Slot of the index for the route to KEY, or the empty slot where it
+   would go.  */
+static u_int32_t
+bgp_adj_in_route_lookup (struct bgp_adj_in *adj, u_char prefixlen,
+			 u_char *key)
+{
+  u_int32_t mask = adj->index.size - 1;
+  u_int32_t i;
+  struct bgp_adj_in_route *route;
+
+  for (i = jhash (key, adj->keylen, prefixlen) & mask; adj->index.slot[i];
+       i = (i + 1) & mask)
+    {
+      route = BGP_ADJ_IN_ROUTE (adj, adj->index.slot[i] - 1);
+      if (route->prefixlen == prefixlen
+	  && memcmp (route->key, key, adj->keylen) == 0)
+	break;
+    }
+  return i;
+}
+
+/* Number of the attribute, taking a reference to it.  */
+static u_int32_t
+bgp_adj_in_attr_get (struct bgp_adj_in *adj, struct attr *attr)
+{
+  struct attr *interned;
+  u_int32_t mask, i, id;
+
+  interned = bgp_attr_intern (attr);
+
+  if (adj->attr_index.size)
+    {
+      mask = adj->attr_index.size - 1;
+      for (i = jhash (&interned, sizeof (struct attr *), 0) & mask;
+	   adj->attr_index.slot[i]; i = (i + 1) & mask)
 	{
-	  if (adj->attr != attr)
+	  id = adj->attr_index.slot[i] - 1;
+	  if (adj->attr[id].attr == interned)
 	    {
-	      bgp_attr_unintern (&adj->attr);
-	      adj->attr = bgp_attr_intern (attr);
+	      /* The table holds one reference for all its routes.  */
+	      bgp_attr_unintern (&interned);
+	      adj->attr[id].refcnt++;
+	      return id;
 	    }
-	  return;
 	}
     }
-  adj = XCALLOC (MTYPE_BGP_ADJ_IN, sizeof (struct bgp_adj_in));
-  adj->peer = peer_lock (peer); /* adj_in peer reference */
-  adj->attr = bgp_attr_intern (attr);
-  BGP_ADJ_IN_ADD (rn, adj);
-  bgp_lock_node (rn);
+
+  if (adj->attr_free)
+    {
+      id = adj->attr_free - 1;
+      adj->attr_free = adj->attr[id].refcnt;
+    }
+  else
+    {
+      if (adj->attr_used == adj->attr_size)
+	{
+	  adj->attr_size = adj->attr_size ? adj->attr_size * 2 : 4;
+	  adj->attr = XREALLOC (MTYPE_BGP_ADJ_IN_ATTR, adj->attr,
+				adj->attr_size
+				* sizeof (struct bgp_adj_in_attr));
+	}
+      id = adj->attr_used++;
+    }
+  adj->attr[id].attr = interned;
+  adj->attr[id].refcnt = 1;
+  adj->attr_count++;
+
+  bgp_adj_in_index_reserve (adj, &adj->attr_index, adj->attr_count,
+			    adj->attr_used, bgp_adj_in_attr_hash);
+  /* Growing the index may already have put it in.  */
+  mask = adj->attr_index.size - 1;
+  for (i = bgp_adj_in_attr_hash (adj, id) & mask; adj->attr_index.slot[i];
+       i = (i + 1) & mask)
+    if (adj->attr_index.slot[i] == id + 1)
+      return id;
+  adj->attr_index.slot[i] = id + 1;
+  return id;
+}
+
+/* Drop a reference to attribute ID.  */
+static void
+bgp_adj_in_attr_put (struct bgp_adj_in *adj, u_int32_t id)
+{
+  u_int32_t mask, i;
+
+  if (--adj->attr[id].refcnt)
+    return;
+
+  mask = adj->attr_index.size - 1;
+  for (i = bgp_adj_in_attr_hash (adj, id) & mask;
+       adj->attr_index.slot[i] != id + 1; i = (i + 1) & mask)
+    ;
+  bgp_adj_in_index_delete (adj, &adj->attr_index, i, bgp_adj_in_attr_hash);
+
+  bgp_attr_unintern (&adj->attr[id].attr);
+  adj->attr[id].attr = NULL;
+  adj->attr[id].refcnt = adj->attr_free;
+  adj->attr_free = id + 1;
+  adj->attr_count--;
+}
+
+/* Bytes identifying the route to P in ADJ.  */
+static void
+bgp_adj_in_key (struct bgp_adj_in *adj, struct prefix *p,
+		struct prefix_rd *prd, u_char *key)
+{
+  u_int32_t addrlen = prefix_blen (p);
+
+  memcpy (key, &p->u.prefix, addrlen);
+  if (adj->keylen > addrlen)
+    memcpy (key + addrlen, prd->val, sizeof (prd->val));
 }
 
 void
-bgp_adj_in_remove (struct bgp_node *rn, struct bgp_adj_in *bai)
+bgp_adj_in_set (struct peer *peer, afi_t afi, safi_t safi, struct prefix *p,
+		struct prefix_rd *prd, u_char *tag, struct attr *attr)
 {
-  bgp_attr_unintern (&bai->attr);
-  BGP_ADJ_IN_DEL (rn, bai);
-  peer_unlock (bai->peer); /* adj_in peer reference */
-  XFREE (MTYPE_BGP_ADJ_IN, bai);
+  struct bgp_adj_in *adj = peer->adj_in[afi][safi];
+  struct bgp_adj_in_route *route;
+  u_char key[sizeof (struct prefix_rd) + sizeof (p->u)];
+  u_int32_t i, id;
+
+  if (! adj)
+    {
+      adj = XCALLOC (MTYPE_BGP_ADJ_IN, sizeof (struct bgp_adj_in));
+      adj->family = p->family;
+      adj->keylen = prefix_blen (p);
+      if (safi == SAFI_MPLS_VPN)
+	adj->keylen += sizeof (prd->val);
+      adj->stride = (sizeof (struct bgp_adj_in_route) + adj->keylen + 3) & ~3;
+      peer->adj_in[afi][safi] = adj;
+      bgp_adj_in_bytes += bgp_adj_in_size (adj);
+    }
+  bgp_adj_in_bytes -= bgp_adj_in_size (adj);
+
+  bgp_adj_in_key (adj, p, prd, key);
+  bgp_adj_in_index_reserve (adj, &adj->index, adj->count + 1, adj->count,
+			    bgp_adj_in_route_hash);
+  i = bgp_adj_in_route_lookup (adj, p->prefixlen, key);
+
+  if (adj->index.slot[i])
+    {
+      route = BGP_ADJ_IN_ROUTE (adj, adj->index.slot[i] - 1);
+      if (adj->attr[route->attr].attr != attr)
+	{
+	  id = bgp_adj_in_attr_get (adj, attr);
+	  bgp_adj_in_attr_put (adj, route->attr);
+	  route->attr = id;
+	}
+    }
+  else
+    {
+      if (adj->count == adj->size)
+	{
+	  adj->size = adj->size ? adj->size + adj->size / 2 : 16;
+	  adj->route = XREALLOC (MTYPE_BGP_ADJ_IN_ROUTE, adj->route,
+				 (size_t) adj->size * adj->stride);
+	}
+      route = BGP_ADJ_IN_ROUTE (adj, adj->count);
+      route->attr = bgp_adj_in_attr_get (adj, attr);
+      route->prefixlen = p->prefixlen;
+      memcpy (route->key, key, adj->keylen);
+      adj->index.slot[i] = ++adj->count;
+      bgp_adj_in_routes++;
+    }
+
+  if (tag)
+    memcpy (route->tag, tag, sizeof (route->tag));
+  else
+    memset (route->tag, 0, sizeof (route->tag));
+
+  bgp_adj_in_bytes += bgp_adj_in_size (adj);
 }
 
 void
-bgp_adj_in_unset (struct bgp_node *rn, struct peer *peer)
+bgp_adj_in_unset (struct peer *peer, afi_t afi, safi_t safi,
+		  struct prefix *p, struct prefix_rd *prd)
 {
-  struct bgp_adj_in *adj;
+  struct bgp_adj_in *adj = peer->adj_in[afi][safi];
+  struct bgp_adj_in_route *route, *last;
+  u_char key[sizeof (struct prefix_rd) + sizeof (p->u)];
+  u_int32_t i, id;
 
-  for (adj = rn->adj_in; adj; adj = adj->next)
-    if (adj->peer == peer)
-      break;
+  if (! adj)
+    return;
+
+  bgp_adj_in_key (adj, p, prd, key);
+  i = bgp_adj_in_route_lookup (adj, p->prefixlen, key);
+  if (! adj->index.slot[i])
+    return;
+
+  if (adj->count == 1)
+    {
+      bgp_adj_in_finish (&peer->adj_in[afi][safi]);
+      return;
+    }
+
+  id = adj->index.slot[i] - 1;
+  route = BGP_ADJ_IN_ROUTE (adj, id);
+  bgp_adj_in_attr_put (adj, route->attr);
+  bgp_adj_in_index_delete (adj, &adj->index, i, bgp_adj_in_route_hash);
+
+  /* Fill the hole with the last route.  */
+  if (id != adj->count - 1)
+    {
+      last = BGP_ADJ_IN_ROUTE (adj, adj->count - 1);
+      i = bgp_adj_in_route_lookup (adj, last->prefixlen, last->key);
+      adj->index.slot[i] = id + 1;
+      memcpy (route, last, adj->stride);
+    }
+  adj->count--;
+  bgp_adj_in_routes--;
+}
+
+/* Attribute of route I of ADJ, with its prefix, route distinguisher
+   and label.  */
+struct attr *
+bgp_adj_in_get (struct bgp_adj_in *adj, u_int32_t i, struct prefix *p,
+		struct prefix_rd *prd, u_char **tag)
+{
+  struct bgp_adj_in_route *route = BGP_ADJ_IN_ROUTE (adj, i);
+  size_t addrlen;
+
+  memset (p, 0, sizeof (struct prefix));
+  p->family = adj->family;
+  p->prefixlen = route->prefixlen;
+  addrlen = prefix_blen (p);
+  memcpy (&p->u.prefix, route->key, addrlen);
+
+  if (prd)
+    {
+      memset (prd, 0, sizeof (struct prefix_rd));
+      if (adj->keylen > addrlen)
+	{
+	  prd->family = AF_UNSPEC;
+	  prd->prefixlen = 64;
+	  memcpy (prd->val, route->key + addrlen, sizeof (prd->val));
+	}
+    }
+  if (tag)
+    *tag = route->tag;
+
+  return adj->attr[route->attr].attr;
+}
+
+/* Forget all routes of the adjacency in.  */
+void
+bgp_adj_in_finish (struct bgp_adj_in **adjp)
+{
+  struct bgp_adj_in *adj = *adjp;
+  u_int32_t id;
 
   if (! adj)
     return;
 
-  bgp_adj_in_remove (rn, adj);
-  bgp_unlock_node (rn);
+  bgp_adj_in_bytes -= bgp_adj_in_size (adj);
+  bgp_adj_in_routes -= adj->count;
+
+  for (id = 0; id < adj->attr_used; id++)
+    if (adj->attr[id].attr)
+      bgp_attr_unintern (&adj->attr[id].attr);
+
+  XFREE (MTYPE_BGP_ADJ_IN_ROUTE, adj->route);
+  XFREE (MTYPE_BGP_ADJ_IN_INDEX, adj->index.slot);
+  XFREE (MTYPE_BGP_ADJ_IN_ATTR, adj->attr);
+  XFREE (MTYPE_BGP_ADJ_IN_INDEX, adj->attr_index.slot);
+  XFREE (MTYPE_BGP_ADJ_IN, adj);
+  *adjp = NULL;
 }
-
+
+/* Routes held by all adjacencies in, and in BYTES their memory.  */
+unsigned long
+bgp_adj_in_stats (unsigned long *bytes)
+{
+  if (bytes)
+    *bytes = bgp_adj_in_bytes;
+  return bgp_adj_in_routes;
+}
+
 void
 bgp_sync_init (struct peer *peer)
 {
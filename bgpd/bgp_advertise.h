@@ -53,8 +53,9 @@ struct bgp_advertise
   /* Prefix information.  */
   struct bgp_node *rn;
 
-  /* Reference pointer.  */
-  struct bgp_adj_out *adj;
+  /* Peer advertised to, and the next advertisement of the prefix.  */
+  struct peer *peer;
+  struct bgp_advertise *adj_next;
 
   /* Advertisement attribute.  */
   struct bgp_advertise_attr *baa;
@@ -63,43 +64,113 @@ struct bgp_advertise
   struct bgp_info *binfo;
 };
 
-/* BGP adjacency out.  */
+/* A peer sent another attribute than most for a prefix.  */
+struct bgp_adj_out_attr
+{
+  int slot;
+  struct attr *attr;
+};
+
+/* BGP adjacency out: what was sent to the peers for a prefix.  A bit
+   per peer slot marks the peers the prefix was sent to.  Most are
+   usually sent the same attribute, kept once; the others are listed
+   with their own.  Advertisements still to be sent hang off it too.  */
 struct bgp_adj_out
 {
-  /* Lined list pointer.  */
-  struct bgp_adj_out *next;
-  struct bgp_adj_out *prev;
+  /* Advertisements pending, at most one per peer.  */
+  struct bgp_advertise *adv;
 
-  /* Advertised peer.  */
-  struct peer *peer;
+  /* Attribute sent to the peers not in OTHER.  */
+  struct attr *attr;
+
+  /* Peers sent another attribute.  */
+  struct bgp_adj_out_attr *other;
+  u_int16_t other_count;
+
+  /* Peers the prefix was sent to.  */
+  u_int16_t count;
+
+  /* Words of SENT.  */
+  u_int16_t words;
+
+  u_int32_t sent[];
+};
+
+/* Open addressed index of 1 + the number of an entry, 0 for none.  */
+struct bgp_adj_in_index
+{
+  u_int32_t *slot;
+  u_int32_t size;
+};
 
-  /* Advertised attribute.  */
+/* A distinct attribute of the routes of a BGP adjacency in.  */
+struct bgp_adj_in_attr
+{
+  /* Interned attribute, NULL while the entry is unused.  */
   struct attr *attr;
 
-  /* Advertisement information.  */
-  struct bgp_advertise *adv;
+  /* Routes with the attribute, or 1 + the next unused entry.  */
+  u_int32_t refcnt;
 };
 
-/* BGP adjacency in. */
-struct bgp_adj_in
+/* A route of a BGP adjacency in, followed by the bytes of its prefix
+   and, for VPNs, its route distinguisher.  */
+struct bgp_adj_in_route
 {
-  /* Linked list pointer.  */
-  struct bgp_adj_in *next;
-  struct bgp_adj_in *prev;
+  /* Number of the attribute.  */
+  u_int32_t attr;
 
-  /* Received peer.  */
-  struct peer *peer;
+  u_char prefixlen;
 
-  /* Received attribute.  */
-  struct attr *attr;
+  /* MPLS label, for VPNs.  */
+  u_char tag[3];
+
+  u_char key[];
 };
 
+/* BGP adjacency in: the routes received from a peer with
+   soft-reconfiguration inbound in an address family, before policy.
+   Routes are kept in an array, found by prefix through an index, and
+   refer to their attribute by its number in a table of the distinct
+   attributes received.  */
+struct bgp_adj_in
+{
+  /* Routes, of STRIDE bytes each, in no particular order.  */
+  u_char *route;
+  u_int32_t count;
+  u_int32_t size;
+  u_int32_t stride;
+
+  /* Routes by prefix.  */
+  struct bgp_adj_in_index index;
+
+  /* Bytes of prefix and route distinguisher after each route.  */
+  u_int32_t keylen;
+  u_char family;
+
+  /* Attributes, the first ATTR_USED of ATTR_SIZE ever used.  */
+  struct bgp_adj_in_attr *attr;
+  u_int32_t attr_used;
+  u_int32_t attr_size;
+  u_int32_t attr_free;
+
+  /* Attributes by address.  */
+  struct bgp_adj_in_index attr_index;
+  u_int32_t attr_count;
+};
+
+#define BGP_ADJ_IN_ROUTE(A,I) \
+  ((struct bgp_adj_in_route *) ((A)->route + (size_t) (I) * (A)->stride))
+
 /* BGP advertisement list.  */
 struct bgp_synchronize
 {
   struct bgp_advertise_fifo update;
   struct bgp_advertise_fifo withdraw;
   struct bgp_advertise_fifo withdraw_low;
+
+  /* Advertisements queued, to be updated or withdrawn.  */
+  unsigned long count;
 };
 
 /* BGP adjacency linked list.  */
@@ -122,27 +193,32 @@ struct bgp_synchronize
       (N)->TYPE = (A)->next;                          \
   } while (0)
 
-#define BGP_ADJ_IN_ADD(N,A)    BGP_INFO_ADD(N,A,adj_in)
-#define BGP_ADJ_IN_DEL(N,A)    BGP_INFO_DEL(N,A,adj_in)
-#define BGP_ADJ_OUT_ADD(N,A)   BGP_INFO_ADD(N,A,adj_out)
-#define BGP_ADJ_OUT_DEL(N,A)   BGP_INFO_DEL(N,A,adj_out)
-
 /* Prototypes.  */
 extern void bgp_adj_out_set (struct bgp_node *, struct peer *, struct prefix *,
 		      struct attr *, afi_t, safi_t, struct bgp_info *);
 extern void bgp_adj_out_unset (struct bgp_node *, struct peer *, struct prefix *,
 			afi_t, safi_t);
-extern void bgp_adj_out_remove (struct bgp_node *, struct bgp_adj_out *, 
-			 struct peer *, afi_t, safi_t);
+extern int bgp_adj_out_remove (struct bgp_node *, struct peer *,
+			       afi_t, safi_t);
 extern int bgp_adj_out_lookup (struct peer *, struct prefix *, afi_t, safi_t,
 			struct bgp_node *);
-
-extern void bgp_adj_in_set (struct bgp_node *, struct peer *, struct attr *);
-extern void bgp_adj_in_unset (struct bgp_node *, struct peer *);
-extern void bgp_adj_in_remove (struct bgp_node *, struct bgp_adj_in *);
+extern int bgp_adj_out_sent (struct bgp_node *, struct peer *, struct attr *);
+extern struct attr *bgp_adj_out_attr (struct bgp_node *, struct peer *);
+extern int bgp_adj_out_pending (struct bgp_node *, struct peer *);
+extern unsigned long bgp_adj_out_stats (unsigned long *);
+
+extern void bgp_adj_in_set (struct peer *, afi_t, safi_t, struct prefix *,
+			    struct prefix_rd *, u_char *, struct attr *);
+extern void bgp_adj_in_unset (struct peer *, afi_t, safi_t, struct prefix *,
+			      struct prefix_rd *);
+extern struct attr *bgp_adj_in_get (struct bgp_adj_in *, u_int32_t,
+				    struct prefix *, struct prefix_rd *,
+				    u_char **);
+extern void bgp_adj_in_finish (struct bgp_adj_in **);
+extern unsigned long bgp_adj_in_stats (unsigned long *);
 
 extern struct bgp_advertise *
-bgp_advertise_clean (struct peer *, struct bgp_adj_out *, afi_t, safi_t);
+bgp_advertise_clean (struct peer *, struct bgp_advertise *, afi_t, safi_t);
 
 extern void bgp_sync_init (struct peer *);
 extern void bgp_sync_delete (struct peer *);
@@ -1047,6 +1047,7 @@ aspath_aggregate (struct aspath *as1, struct aspath *as2)
       
       seg1 = seg1->next;
       seg2 = seg2->next;
+      match = 0;
     }
 
   if (! aspath)
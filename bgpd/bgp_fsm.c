@@ -40,6 +40,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_route.h"
 #include "bgpd/bgp_dump.h"
 #include "bgpd/bgp_open.h"
+#include "bgpd/bgp_io.h"
 #ifdef HAVE_SNMP
 #include "bgpd/bgp_snmp.h"
 #endif /* HAVE_SNMP */
@@ -184,7 +185,8 @@ bgp_timer_set (struct peer *peer)
       BGP_TIMER_OFF (peer->t_connect);
 
       /* Same as OpenConfirm, if holdtime is zero then both holdtime
-         and keepalive must be turned off. */
+         and keepalive must be turned off.  The I/O thread sends the
+         keepalives of the peers it has. */
       if (peer->v_holdtime == 0)
 	{
 	  BGP_TIMER_OFF (peer->t_holdtime);
@@ -194,8 +196,11 @@ bgp_timer_set (struct peer *peer)
 	{
 	  BGP_TIMER_ON (peer->t_holdtime, bgp_holdtime_timer,
 			peer->v_holdtime);
-	  BGP_TIMER_ON (peer->t_keepalive, bgp_keepalive_timer,
-			peer->v_keepalive);
+	  if (peer->io)
+	    BGP_TIMER_OFF (peer->t_keepalive);
+	  else
+	    BGP_TIMER_ON (peer->t_keepalive, bgp_keepalive_timer,
+			  peer->v_keepalive);
 	}
       BGP_TIMER_OFF (peer->t_asorig);
       break;
@@ -257,10 +262,18 @@ static int
 bgp_holdtime_timer (struct thread *thread)
 {
   struct peer *peer;
+  long left;
 
   peer = THREAD_ARG (thread);
   peer->t_holdtime = NULL;
 
+  /* The I/O thread may have read messages not processed yet. */
+  if ((left = bgp_io_holdtime_left (peer)) > 0)
+    {
+      BGP_TIMER_ON (peer->t_holdtime, bgp_holdtime_timer, left);
+      return 0;
+    }
+
   if (BGP_DEBUG (fsm, FSM))
     zlog (peer->log, LOG_DEBUG,
 	  "%s [FSM] Timer (holdtime timer expire)",
@@ -408,6 +421,10 @@ bgp_fsm_change_status (struct peer *peer, int status)
   if (status >= Clearing)
     bgp_clear_route_all (peer);
   
+  /* Only Established sessions are left to the I/O thread. */
+  if (status != Established)
+    bgp_io_detach (peer);
+
   /* Preserve old status and change into new status. */
   peer->ostatus = peer->status;
   peer->status = status;
@@ -497,6 +514,7 @@ bgp_stop (struct peer *peer)
     }
 
   /* Stop read and write threads when exists. */
+  bgp_io_detach (peer);
   BGP_READ_OFF (peer->t_read);
   BGP_WRITE_OFF (peer->t_write);
 
@@ -507,6 +525,7 @@ bgp_stop (struct peer *peer)
   BGP_TIMER_OFF (peer->t_keepalive);
   BGP_TIMER_OFF (peer->t_asorig);
   BGP_TIMER_OFF (peer->t_routeadv);
+  bgp_announce_route_cancel (peer);
 
   /* Stream reset. */
   peer->packet_size = 0;
@@ -518,6 +537,11 @@ bgp_stop (struct peer *peer)
     stream_reset (peer->work);
   if (peer->obuf)
     stream_fifo_clean (peer->obuf);
+  if (peer->rbuf)
+    {
+      stream_free (peer->rbuf);
+      peer->rbuf = NULL;
+    }
 
   /* Close of file descriptor. */
   if (peer->fd >= 0)
@@ -898,6 +922,8 @@ bgp_establish (struct peer *peer)
 
   BGP_TIMER_ON (peer->t_routeadv, bgp_routeadv_timer, 1);
 
+  bgp_io_attach (peer);
+
   return 0;
 }
 
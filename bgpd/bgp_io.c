@@ -0,0 +1,871 @@
+/* BGP socket I/O thread.
+
+This file is part of GNU Zebra.
+
+GNU Zebra is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 2, or (at your option) any
+later version.
+
+GNU Zebra is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Zebra; see the file COPYING.  If not, write to the Free
+Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.  */
+
+/* With "bgp io-thread", the socket of a peer is handed to a separate
+   thread once the session is Established.  That thread reads and
+   frames messages, checks their headers, and queues them for the main
+   thread; it writes what the main thread queues, and sends keepalives
+   itself when nothing else went out for the keepalive interval.  A busy
+   main thread therefore neither delays keepalives nor lets the hold
+   timer expire on a peer which kept talking.  The session returns to
+   the main thread (and is then torn down) by bgp_io_detach(). */
+
+#include <zebra.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /* HAVE_PTHREAD */
+
+#include "thread.h"
+#include "stream.h"
+#include "memory.h"
+#include "log.h"
+#include "network.h"
+#include "sockopt.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_fsm.h"
+#include "bgpd/bgp_debug.h"
+#include "bgpd/bgp_packet.h"
+#include "bgpd/bgp_io.h"
+
+#ifdef HAVE_PTHREAD
+
+static struct
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t detached;
+  pthread_t thread;
+  int running;
+
+  /* Pipes to wake the I/O thread and the main thread. */
+  int wake_io[2];
+  int wake_main[2];
+  struct thread *t_ready;
+  struct thread *t_more;
+
+  /* Peers attached, and those with something for the main thread. */
+  struct bgp_io *peers;
+  struct bgp_io *ready_head;
+  struct bgp_io *ready_tail;
+
+  /* Peers the I/O thread is waiting on. */
+  struct bgp_io **polled;
+  unsigned int polled_max;
+
+  /* An error of the I/O thread, which must not log, for the main
+     thread to log. */
+  const char *error;
+  int error_priority;
+  int error_errno;
+} iothread =
+{
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+};
+
+static int bgp_io_ready (struct thread *);
+
+/* Monotonic seconds, safe to read from either thread. */
+static time_t
+bgp_io_clock (void)
+{
+#ifdef HAVE_CLOCK_MONOTONIC
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+#else
+  return time (NULL);
+#endif /* HAVE_CLOCK_MONOTONIC */
+}
+
+static unsigned int
+bgp_io_ring_count (struct bgp_io_ring *ring)
+{
+  return __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE)
+         - __atomic_load_n (&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+static void
+bgp_io_ring_push (struct bgp_io_ring *ring, struct stream *s)
+{
+  unsigned int head = ring->head;
+
+  ring->msg[head % BGP_IO_RING_SIZE] = s;
+  __atomic_store_n (&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static struct stream *
+bgp_io_ring_pop (struct bgp_io_ring *ring)
+{
+  unsigned int tail = ring->tail;
+  struct stream *s;
+
+  if (__atomic_load_n (&ring->head, __ATOMIC_ACQUIRE) == tail)
+    return NULL;
+  s = ring->msg[tail % BGP_IO_RING_SIZE];
+  __atomic_store_n (&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  return s;
+}
+
+static void
+bgp_io_ring_clean (struct bgp_io_ring *ring)
+{
+  struct stream *s;
+
+  while ((s = bgp_io_ring_pop (ring)) != NULL)
+    stream_free (s);
+}
+
+/* Returns 0, or the errno of a failed write. */
+static int
+bgp_io_wake (int fd)
+{
+  u_char c = 0;
+
+  /* A full pipe already has the reader on its way. */
+  if (write (fd, &c, 1) < 0 && ! ERRNO_IO_RETRY (errno))
+    return errno;
+  return 0;
+}
+
+/* Main thread: wake the I/O thread. */
+static void
+bgp_io_wake_io (void)
+{
+  int err;
+
+  if ((err = bgp_io_wake (iothread.wake_io[1])) != 0)
+    zlog_warn ("can't wake BGP I/O: %s", safe_strerror (err));
+}
+
+/* I/O thread: leave an error for the main thread to log.  Only the
+   first one not logged yet is kept. */
+static void
+bgp_io_error (int priority, const char *what, int err)
+{
+  pthread_mutex_lock (&iothread.mutex);
+  if (iothread.error == NULL)
+    {
+      iothread.error = what;
+      iothread.error_priority = priority;
+      iothread.error_errno = err;
+    }
+  pthread_mutex_unlock (&iothread.mutex);
+}
+
+/* Main thread: log what bgp_io_error() left. */
+static void
+bgp_io_log_error (void)
+{
+  const char *what;
+  int priority, err;
+
+  pthread_mutex_lock (&iothread.mutex);
+  what = iothread.error;
+  priority = iothread.error_priority;
+  err = iothread.error_errno;
+  iothread.error = NULL;
+  pthread_mutex_unlock (&iothread.mutex);
+
+  if (what)
+    zlog (NULL, priority, "BGP I/O thread: %s: %s", what,
+	  safe_strerror (err));
+}
+
+/* Main thread: move the counts of the I/O thread into the peer's. */
+static void
+bgp_io_take_counts (struct peer *peer, struct bgp_io *io)
+{
+  peer->read_chunks += __atomic_exchange_n (&io->read_chunks, 0,
+					    __ATOMIC_RELAXED);
+  peer->read_msgs += __atomic_exchange_n (&io->read_msgs, 0,
+					  __ATOMIC_RELAXED);
+  peer->update_out += __atomic_exchange_n (&io->update_out, 0,
+					   __ATOMIC_RELAXED);
+  peer->notify_out += __atomic_exchange_n (&io->notify_out, 0,
+					   __ATOMIC_RELAXED);
+  peer->keepalive_out += __atomic_exchange_n (&io->keepalive_out, 0,
+					      __ATOMIC_RELAXED);
+  peer->refresh_out += __atomic_exchange_n (&io->refresh_out, 0,
+					    __ATOMIC_RELAXED);
+  peer->dynamic_cap_out += __atomic_exchange_n (&io->dynamic_cap_out, 0,
+						__ATOMIC_RELAXED);
+}
+
+static void
+bgp_io_drain (int fd)
+{
+  u_char buf[64];
+
+  while (read (fd, buf, sizeof (buf)) > 0)
+    ;
+}
+
+/* Queue io for the main thread.  Called with the mutex held. */
+static void
+bgp_io_set_ready (struct bgp_io *io)
+{
+  if (io->ready || io->detached)
+    return;
+  io->ready = 1;
+  io->ready_next = NULL;
+  if (iothread.ready_tail)
+    iothread.ready_tail->ready_next = io;
+  else
+    iothread.ready_head = io;
+  iothread.ready_tail = io;
+}
+
+static struct bgp_io *
+bgp_io_pop_ready (void)
+{
+  struct bgp_io *io;
+
+  io = iothread.ready_head;
+  if (io)
+    {
+      iothread.ready_head = io->ready_next;
+      if (iothread.ready_head == NULL)
+	iothread.ready_tail = NULL;
+      io->ready = 0;
+    }
+  return io;
+}
+
+static void
+bgp_io_unset_ready (struct bgp_io *io)
+{
+  struct bgp_io **p, *prev = NULL;
+
+  if (! io->ready)
+    return;
+  for (p = &iothread.ready_head; *p; prev = *p, p = &(*p)->ready_next)
+    if (*p == io)
+      {
+	*p = io->ready_next;
+	if (iothread.ready_tail == io)
+	  iothread.ready_tail = prev;
+	break;
+      }
+  io->ready = 0;
+}
+
+/* I/O thread: queue the messages which are whole, while there is
+   room, and read more chunks if the socket has some.  Returns whether
+   anything is left for the main thread. */
+static int
+bgp_io_read (struct bgp_io *io, int readable, time_t now)
+{
+  struct stream *s;
+  bgp_size_t size;
+  int nbytes;
+  int count = 0, reads = 0;
+
+  for (;;)
+    {
+      while (bgp_io_ring_count (&io->in) < BGP_IO_RING_SIZE
+	     && STREAM_READABLE (io->rbuf) >= BGP_HEADER_SIZE)
+	{
+	  /* The main thread checks it again, and sends the NOTIFY. */
+	  if (bgp_packet_check_header (io->peer, io->rbuf, 0) < 0)
+	    {
+	      s = stream_new (BGP_HEADER_SIZE);
+	      stream_put (s, STREAM_PNT (io->rbuf), BGP_HEADER_SIZE);
+	      bgp_io_ring_push (&io->in, s);
+	      io->rx_status = BGP_IO_RX_BAD_HEADER;
+	      return 1;
+	    }
+	  if ((size = bgp_packet_whole (io->rbuf)) == 0)
+	    break;
+
+	  s = stream_new (size);
+	  stream_put (s, STREAM_PNT (io->rbuf), size);
+	  stream_forward_getp (io->rbuf, size);
+	  bgp_io_ring_push (&io->in, s);
+	  __atomic_fetch_add (&io->read_msgs, 1, __ATOMIC_RELAXED);
+	  count++;
+	}
+
+      if (! readable || reads >= BGP_IO_READ_MAX
+	  || bgp_io_ring_count (&io->in) == BGP_IO_RING_SIZE)
+	break;
+
+      nbytes = bgp_read_chunk (io->rbuf, io->fd);
+      if (nbytes == -2)
+	break;
+      if (nbytes <= 0)
+	{
+	  io->rx_status = nbytes ? BGP_IO_RX_ERROR : BGP_IO_RX_CLOSED;
+	  io->rx_errno = errno;
+	  return 1;
+	}
+      __atomic_fetch_add (&io->read_chunks, 1, __ATOMIC_RELAXED);
+      reads++;
+    }
+
+  if (count)
+    __atomic_store_n (&io->last_read, now, __ATOMIC_RELAXED);
+  return count > 0;
+}
+
+static struct stream *
+bgp_io_keepalive (void)
+{
+  struct stream *s;
+
+  s = stream_new (BGP_HEADER_SIZE);
+  stream_put (s, NULL, BGP_MARKER_SIZE);
+  memset (STREAM_DATA (s), 0xff, BGP_MARKER_SIZE);
+  stream_putw (s, BGP_HEADER_SIZE);
+  stream_putc (s, BGP_MSG_KEEPALIVE);
+  return s;
+}
+
+static void
+bgp_io_count_out (struct bgp_io *io, struct stream *s)
+{
+  u_int32_t *count;
+
+  switch (stream_getc_from (s, BGP_MARKER_SIZE + 2))
+    {
+    case BGP_MSG_UPDATE:
+      count = &io->update_out;
+      break;
+    case BGP_MSG_NOTIFY:
+      count = &io->notify_out;
+      break;
+    case BGP_MSG_KEEPALIVE:
+      count = &io->keepalive_out;
+      break;
+    case BGP_MSG_ROUTE_REFRESH_NEW:
+    case BGP_MSG_ROUTE_REFRESH_OLD:
+      count = &io->refresh_out;
+      break;
+    case BGP_MSG_CAPABILITY:
+      count = &io->dynamic_cap_out;
+      break;
+    default:
+      return;
+    }
+  __atomic_fetch_add (count, 1, __ATOMIC_RELAXED);
+}
+
+/* I/O thread: write queued messages, or a keepalive when due, until the
+   socket is full.  Returns 1 when the main thread should be told
+   something, that there is room to queue more or an error. */
+static int
+bgp_io_write (struct bgp_io *io, time_t now)
+{
+  struct stream *s;
+  int writenum, num;
+  int popped = 0, corked = 0;
+
+  for (;;)
+    {
+      if (io->wbuf == NULL)
+	{
+	  if ((io->wbuf = bgp_io_ring_pop (&io->out)) != NULL)
+	    popped = 1;
+	  else if (io->v_keepalive
+		   && now - io->last_write >= io->v_keepalive)
+	    io->wbuf = bgp_io_keepalive ();
+	  else
+	    break;
+	}
+      s = io->wbuf;
+
+      if (! corked)
+	{
+	  sockopt_cork (io->fd, 1);
+	  corked = 1;
+	}
+
+      writenum = stream_get_endp (s) - stream_get_getp (s);
+      num = write (io->fd, STREAM_PNT (s), writenum);
+      if (num < 0)
+	{
+	  if (ERRNO_IO_RETRY (errno))
+	    break;
+	  io->tx_errno = errno;
+	  break;
+	}
+      if (num != writenum)
+	{
+	  stream_forward_getp (s, num);
+	  break;
+	}
+
+      bgp_io_count_out (io, s);
+      stream_free (s);
+      io->wbuf = NULL;
+      io->last_write = now;
+    }
+
+  if (corked)
+    sockopt_cork (io->fd, 0);
+
+  return popped || io->tx_errno;
+}
+
+/* How long the I/O thread may sleep: until the next keepalive is due.
+   Returns NULL for as long as it likes. */
+static struct timeval *
+bgp_io_timeout (time_t now, struct timeval *tv)
+{
+  struct bgp_io *io;
+  time_t wait;
+  struct timeval *timeout = NULL;
+
+  for (io = iothread.peers; io; io = io->next)
+    if (io->v_keepalive && ! io->tx_errno)
+      {
+	wait = io->last_write + io->v_keepalive - now;
+	if (wait < 0)
+	  wait = 0;
+	if (timeout == NULL || wait < tv->tv_sec)
+	  {
+	    tv->tv_sec = wait;
+	    tv->tv_usec = 0;
+	    timeout = tv;
+	  }
+      }
+  return timeout;
+}
+
+static void *
+bgp_io_thread (void *arg)
+{
+  struct bgp_io *io, **p;
+  sigset_t sigs;
+  fd_set readfd, writefd;
+  struct timeval tv, *timeout;
+  unsigned int n, i;
+  int maxfd, wake, tell, err;
+  time_t now;
+
+  /* Signals are the main thread's business. */
+  sigfillset (&sigs);
+  pthread_sigmask (SIG_BLOCK, &sigs, NULL);
+
+  for (;;)
+    {
+      pthread_mutex_lock (&iothread.mutex);
+
+      /* Let go of the peers the main thread wants back. */
+      for (p = &iothread.peers; (io = *p) != NULL; )
+	if (io->detach)
+	  {
+	    *p = io->next;
+	    io->detached = 1;
+	    pthread_cond_broadcast (&iothread.detached);
+	  }
+	else
+	  p = &io->next;
+
+      n = 0;
+      for (io = iothread.peers; io; io = io->next)
+	n++;
+      if (n > iothread.polled_max)
+	{
+	  iothread.polled_max = n * 2;
+	  iothread.polled = XREALLOC (MTYPE_BGP_IO, iothread.polled,
+				      iothread.polled_max
+				      * sizeof (struct bgp_io *));
+	}
+
+      FD_ZERO (&readfd);
+      FD_ZERO (&writefd);
+      FD_SET (iothread.wake_io[0], &readfd);
+      maxfd = iothread.wake_io[0];
+      n = 0;
+      for (io = iothread.peers; io; io = io->next)
+	{
+	  if (io->rx_status == BGP_IO_RX_OK)
+	    {
+	      if (bgp_io_ring_count (&io->in) < BGP_IO_RING_SIZE)
+		FD_SET (io->fd, &readfd);
+	      else
+		io->in_full = 1;
+	    }
+	  if (! io->tx_errno && (io->wbuf || bgp_io_ring_count (&io->out)))
+	    FD_SET (io->fd, &writefd);
+	  if (io->fd > maxfd)
+	    maxfd = io->fd;
+	  iothread.polled[n++] = io;
+	}
+      now = bgp_io_clock ();
+      timeout = bgp_io_timeout (now, &tv);
+
+      pthread_mutex_unlock (&iothread.mutex);
+
+      if (select (maxfd + 1, &readfd, &writefd, NULL, timeout) < 0)
+	{
+	  if (errno != EINTR)
+	    {
+	      bgp_io_error (LOG_ERR, "select failed", errno);
+	      bgp_io_wake (iothread.wake_main[1]);
+	      sleep (1);
+	    }
+	  continue;
+	}
+
+      if (FD_ISSET (iothread.wake_io[0], &readfd))
+	bgp_io_drain (iothread.wake_io[0]);
+
+      /* A peer being detached is still ours until the top of the loop;
+         the main thread waits for that. */
+      now = bgp_io_clock ();
+      wake = 0;
+      for (i = 0; i < n; i++)
+	{
+	  io = iothread.polled[i];
+	  tell = 0;
+
+	  if (io->rx_status == BGP_IO_RX_OK)
+	    tell |= bgp_io_read (io, FD_ISSET (io->fd, &readfd), now);
+	  if (! io->tx_errno)
+	    tell |= bgp_io_write (io, now);
+
+	  if (tell)
+	    {
+	      pthread_mutex_lock (&iothread.mutex);
+	      if (bgp_io_ring_count (&io->in) || io->rx_status
+		  || io->tx_errno || io->out_full)
+		{
+		  io->out_full = 0;
+		  if (! io->ready)
+		    wake = 1;
+		  bgp_io_set_ready (io);
+		}
+	      pthread_mutex_unlock (&iothread.mutex);
+	    }
+	}
+
+      if (wake && (err = bgp_io_wake (iothread.wake_main[1])) != 0)
+	bgp_io_error (LOG_WARNING, "can't wake the main thread", err);
+    }
+
+  return NULL;
+}
+
+static int
+bgp_io_start (void)
+{
+  if (iothread.running)
+    return 1;
+
+  if (pipe (iothread.wake_io) < 0)
+    return 0;
+  if (pipe (iothread.wake_main) < 0)
+    {
+      close (iothread.wake_io[0]);
+      close (iothread.wake_io[1]);
+      return 0;
+    }
+  set_nonblocking (iothread.wake_io[0]);
+  set_nonblocking (iothread.wake_io[1]);
+  set_nonblocking (iothread.wake_main[0]);
+  set_nonblocking (iothread.wake_main[1]);
+
+  if (pthread_create (&iothread.thread, NULL, bgp_io_thread, NULL) != 0)
+    {
+      zlog_err ("can't start BGP I/O thread: %s", safe_strerror (errno));
+      close (iothread.wake_io[0]);
+      close (iothread.wake_io[1]);
+      close (iothread.wake_main[0]);
+      close (iothread.wake_main[1]);
+      return 0;
+    }
+  pthread_detach (iothread.thread);
+
+  iothread.t_ready = thread_add_read (bm->master, bgp_io_ready, NULL,
+				    iothread.wake_main[0]);
+  iothread.running = 1;
+  return 1;
+}
+
+/* Main thread: hand the messages read to the FSM and refill the
+   output.  Returns whether more is waiting. */
+static int
+bgp_io_process (struct peer *peer, struct bgp_io *io)
+{
+  struct stream *s;
+  int count = 0, more = 0;
+
+  bgp_io_take_counts (peer, io);
+
+  while (peer->io == io && (s = bgp_io_ring_pop (&io->in)) != NULL)
+    {
+      stream_reset (peer->ibuf);
+      stream_put (peer->ibuf, STREAM_DATA (s), stream_get_endp (s));
+      stream_free (s);
+
+      if (bgp_packet_check_header (peer, peer->ibuf, 1) < 0)
+	return 0;
+      stream_set_getp (peer->ibuf, BGP_HEADER_SIZE);
+      peer->packet_size = stream_get_endp (peer->ibuf);
+      bgp_packet_process (peer);
+
+      if (++count >= BGP_IO_PROCESS_MAX)
+	{
+	  more = 1;
+	  break;
+	}
+    }
+
+  /* The FSM may have let go of the peer. */
+  if (peer->io != io)
+    return 0;
+
+  pthread_mutex_lock (&iothread.mutex);
+  if (count && io->in_full)
+    {
+      io->in_full = 0;
+      bgp_io_wake_io ();
+    }
+  pthread_mutex_unlock (&iothread.mutex);
+
+  if (more || bgp_io_ring_count (&io->in))
+    return 1;
+
+  if (io->rx_status == BGP_IO_RX_CLOSED || io->rx_status == BGP_IO_RX_ERROR)
+    {
+      bgp_read_failed (peer, io->rx_status == BGP_IO_RX_CLOSED
+			     ? 0 : io->rx_errno);
+      return 0;
+    }
+  if (io->tx_errno)
+    {
+      BGP_EVENT_ADD (peer, TCP_fatal_error);
+      return 0;
+    }
+
+  BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+  return 0;
+}
+
+static int
+bgp_io_ready (struct thread *thread)
+{
+  struct bgp_io *io;
+  struct peer *peer;
+  unsigned int n, i;
+
+  /* Called on the pipe, or as an event to carry on. */
+  if (THREAD_ARG (thread) == NULL)
+    {
+      iothread.t_ready = thread_add_read (bm->master, bgp_io_ready, NULL,
+					iothread.wake_main[0]);
+      bgp_io_drain (iothread.wake_main[0]);
+    }
+  else
+    iothread.t_more = NULL;
+
+  bgp_io_log_error ();
+
+  /* One round over the peers ready now; those with more left go to the
+     back, to be continued after the event loop has had a turn. */
+  pthread_mutex_lock (&iothread.mutex);
+  n = 0;
+  for (io = iothread.ready_head; io; io = io->ready_next)
+    n++;
+  pthread_mutex_unlock (&iothread.mutex);
+
+  for (i = 0; i < n; i++)
+    {
+      pthread_mutex_lock (&iothread.mutex);
+      io = bgp_io_pop_ready ();
+      pthread_mutex_unlock (&iothread.mutex);
+      if (io == NULL)
+	break;
+
+      peer = peer_lock (io->peer);
+      if (bgp_io_process (peer, io))
+	{
+	  pthread_mutex_lock (&iothread.mutex);
+	  bgp_io_set_ready (io);
+	  pthread_mutex_unlock (&iothread.mutex);
+	}
+      peer_unlock (peer);
+    }
+
+  pthread_mutex_lock (&iothread.mutex);
+  if (iothread.ready_head && ! iothread.t_more)
+    iothread.t_more = thread_add_event (bm->master, bgp_io_ready, &iothread, 0);
+  pthread_mutex_unlock (&iothread.mutex);
+
+  return 0;
+}
+
+/* Hand a newly Established peer's socket to the I/O thread. */
+void
+bgp_io_attach (struct peer *peer)
+{
+  struct bgp_io *io;
+
+  if (peer->io || peer->fd < 0 || ! bgp_option_check (BGP_OPT_IO_THREAD))
+    return;
+  if (! bgp_io_start ())
+    return;
+
+  BGP_READ_OFF (peer->t_read);
+
+  /* Sockets we connected are blocking, and the I/O thread reads and
+     writes until it would block. */
+  set_nonblocking (peer->fd);
+
+  io = XCALLOC (MTYPE_BGP_IO, sizeof (struct bgp_io));
+  io->peer = peer;
+  io->fd = peer->fd;
+  io->rbuf = stream_new (BGP_READ_CHUNK_SIZE + BGP_MAX_PACKET_SIZE);
+  io->v_keepalive = peer->v_holdtime ? peer->v_keepalive : 0;
+  io->last_write = io->last_read = bgp_io_clock ();
+
+  /* Carry over what bgp_read() may have started on. */
+  if (stream_get_endp (peer->ibuf))
+    stream_put (io->rbuf, STREAM_DATA (peer->ibuf),
+		stream_get_endp (peer->ibuf));
+  stream_reset (peer->ibuf);
+  peer->packet_size = 0;
+  peer->io = io;
+
+  pthread_mutex_lock (&iothread.mutex);
+  io->next = iothread.peers;
+  iothread.peers = io;
+  pthread_mutex_unlock (&iothread.mutex);
+  bgp_io_wake_io ();
+
+  if (BGP_DEBUG (events, EVENTS))
+    zlog_debug ("%s socket handed to the I/O thread", peer->host);
+
+  /* What is queued already goes out through the thread. */
+  BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+}
+
+/* Take the socket back from the I/O thread, dropping whatever is queued
+   either way.  Only done when the session goes down. */
+void
+bgp_io_detach (struct peer *peer)
+{
+  struct bgp_io *io = peer->io;
+
+  if (io == NULL)
+    return;
+
+  pthread_mutex_lock (&iothread.mutex);
+  io->detach = 1;
+  bgp_io_wake_io ();
+  while (! io->detached)
+    pthread_cond_wait (&iothread.detached, &iothread.mutex);
+  bgp_io_unset_ready (io);
+  pthread_mutex_unlock (&iothread.mutex);
+
+  bgp_io_take_counts (peer, io);
+  peer->io = NULL;
+  bgp_io_ring_clean (&io->in);
+  bgp_io_ring_clean (&io->out);
+  if (io->wbuf)
+    stream_free (io->wbuf);
+  stream_free (io->rbuf);
+  XFREE (MTYPE_BGP_IO, io);
+}
+
+/* Whether bgp_write() may queue another message. */
+int
+bgp_io_out_room (struct peer *peer)
+{
+  return bgp_io_ring_count (&peer->io->out) < BGP_IO_RING_SIZE;
+}
+
+void
+bgp_io_send (struct peer *peer, struct stream *s)
+{
+  bgp_io_ring_push (&peer->io->out, s);
+}
+
+/* Wake the I/O thread for what bgp_write() queued.  If more is waiting
+   and there is no room for it, the I/O thread reports back once it has
+   made some. */
+void
+bgp_io_kick (struct peer *peer, int more)
+{
+  struct bgp_io *io = peer->io;
+
+  if (more && ! bgp_io_out_room (peer))
+    {
+      pthread_mutex_lock (&iothread.mutex);
+      io->out_full = 1;
+      pthread_mutex_unlock (&iothread.mutex);
+      /* It may have made room before seeing the flag. */
+      if (bgp_io_out_room (peer))
+	BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+    }
+  else if (more)
+    BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+  bgp_io_wake_io ();
+}
+
+/* Seconds until the hold timer should really expire, counting messages
+   read by the I/O thread but not processed yet. */
+long
+bgp_io_holdtime_left (struct peer *peer)
+{
+  time_t last_read;
+
+  if (peer->io == NULL)
+    return 0;
+  last_read = __atomic_load_n (&peer->io->last_read, __ATOMIC_RELAXED);
+  return (long) peer->v_holdtime - (bgp_io_clock () - last_read);
+}
+
+#else /* HAVE_PTHREAD */
+
+void
+bgp_io_attach (struct peer *peer)
+{
+}
+
+void
+bgp_io_detach (struct peer *peer)
+{
+}
+
+int
+bgp_io_out_room (struct peer *peer)
+{
+  return 0;
+}
+
+void
+bgp_io_send (struct peer *peer, struct stream *s)
+{
+}
+
+void
+bgp_io_kick (struct peer *peer, int more)
+{
+}
+
+long
+bgp_io_holdtime_left (struct peer *peer)
+{
+  return 0;
+}
+
+#endif /* HAVE_PTHREAD */
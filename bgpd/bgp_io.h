@@ -0,0 +1,106 @@
+/* BGP socket I/O thread.
+
+This file is part of GNU Zebra.
+
+GNU Zebra is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 2, or (at your option) any
+later version.
+
+GNU Zebra is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Zebra; see the file COPYING.  If not, write to the Free
+Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.  */
+
+#ifndef _QUAGGA_BGP_IO_H
+#define _QUAGGA_BGP_IO_H
+
+/* Messages which may wait in each direction between the threads. */
+#define BGP_IO_RING_SIZE      256
+
+/* Chunks read for a peer in one go, before turning to the next. */
+#define BGP_IO_READ_MAX         4
+
+/* Messages the main thread processes for a peer in one go. */
+#define BGP_IO_PROCESS_MAX     64
+
+/* Single producer, single consumer queue of messages.  Only the
+   producer moves head and only the consumer moves tail. */
+struct bgp_io_ring
+{
+  struct stream *msg[BGP_IO_RING_SIZE];
+  unsigned int head;
+  unsigned int tail;
+};
+
+/* An Established peer whose socket the I/O thread reads and writes. */
+struct bgp_io
+{
+  struct peer *peer;
+  int fd;
+
+  /* Complete messages read, for the main thread. */
+  struct bgp_io_ring in;
+
+  /* Messages to write, from the main thread. */
+  struct bgp_io_ring out;
+
+  /* The rest belongs to the I/O thread, except where noted. */
+
+  /* Chunks read, with the start of the next message. */
+  struct stream *rbuf;
+
+  /* Message being written. */
+  struct stream *wbuf;
+
+  /* Seconds between keepalives, 0 for none. */
+  int v_keepalive;
+  time_t last_write;
+
+  /* When a message was last read; read by the main thread too. */
+  time_t last_read;
+
+  /* Why reading stopped, set once for the main thread. */
+  int rx_status;
+#define BGP_IO_RX_OK          0
+#define BGP_IO_RX_CLOSED      1
+#define BGP_IO_RX_ERROR       2
+#define BGP_IO_RX_BAD_HEADER  3
+  int rx_errno;
+
+  /* Error writing, for the main thread. */
+  int tx_errno;
+
+  /* Counts of the I/O thread, which the main thread moves into the
+     peer's; updated atomically. */
+  u_int32_t read_chunks;
+  u_int32_t read_msgs;
+  u_int32_t update_out;
+  u_int32_t notify_out;
+  u_int32_t keepalive_out;
+  u_int32_t refresh_out;
+  u_int32_t dynamic_cap_out;
+
+  /* Under the I/O thread's mutex. */
+  int detach;			/* main thread wants the peer back */
+  int detached;			/* I/O thread has let go of it */
+  int in_full;			/* not read until the main thread catches up */
+  int out_full;			/* main thread waits for room to write */
+  int ready;			/* on the main thread's ready list */
+  struct bgp_io *ready_next;
+  struct bgp_io *next;		/* attached peers */
+};
+
+extern void bgp_io_attach (struct peer *);
+extern void bgp_io_detach (struct peer *);
+extern int bgp_io_out_room (struct peer *);
+extern void bgp_io_send (struct peer *, struct stream *);
+extern void bgp_io_kick (struct peer *, int more);
+extern long bgp_io_holdtime_left (struct peer *);
+
+#endif /* _QUAGGA_BGP_IO_H */
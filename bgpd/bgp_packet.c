@@ -47,6 +47,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_mplsvpn.h"
 #include "bgpd/bgp_advertise.h"
 #include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_io.h"
 
 int stream_put_prefix (struct stream *, struct prefix *);
 
@@ -142,7 +143,6 @@ static struct stream *
 bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
 {
   struct stream *s;
-  struct bgp_adj_out *adj;
   struct bgp_advertise *adv;
   struct stream *packet;
   struct bgp_node *rn = NULL;
@@ -159,7 +159,6 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
     {
       assert (adv->rn);
       rn = adv->rn;
-      adj = adv->adj;
       if (adv->binfo)
         binfo = adv->binfo;
 
@@ -208,14 +207,10 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
         }
 
       /* Synchnorize attribute.  */
-      if (adj->attr)
-	bgp_attr_unintern (&adj->attr);
-      else
+      if (bgp_adj_out_sent (rn, peer, adv->baa->attr))
 	peer->scount[afi][safi]++;
 
-      adj->attr = bgp_attr_intern (adv->baa->attr);
-
-      adv = bgp_advertise_clean (peer, adj, afi, safi);
+      adv = bgp_advertise_clean (peer, adv, afi, safi);
 
       if (! (afi == AFI_IP && safi == SAFI_UNICAST))
 	break;
@@ -282,7 +277,6 @@ bgp_withdraw_packet (struct peer *peer, afi_t afi, safi_t safi)
 {
   struct stream *s;
   struct stream *packet;
-  struct bgp_adj_out *adj;
   struct bgp_advertise *adv;
   struct bgp_node *rn;
   unsigned long pos;
@@ -295,7 +289,6 @@ bgp_withdraw_packet (struct peer *peer, afi_t afi, safi_t safi)
   while ((adv = FIFO_HEAD (&peer->sync[afi][safi]->withdraw)) != NULL)
     {
       assert (adv->rn);
-      adj = adv->adj;
       rn = adv->rn;
 
       if (STREAM_REMAIN (s) 
@@ -337,7 +330,7 @@ bgp_withdraw_packet (struct peer *peer, afi_t afi, safi_t safi)
 
       peer->scount[afi][safi]--;
 
-      bgp_adj_out_remove (rn, adj, peer, afi, safi);
+      bgp_adj_out_remove (rn, peer, afi, safi);
       bgp_unlock_node (rn);
 
       if (! (afi == AFI_IP && safi == SAFI_UNICAST))
@@ -559,9 +552,11 @@ bgp_write_packet (struct peer *peer)
 	      return s;
 	  }
 
+	/* The end-of-RIB, once the table is all announced. */
 	if (CHECK_FLAG (peer->cap, PEER_CAP_RESTART_RCV))
 	  {
 	    if (peer->afc_nego[afi][safi] && peer->synctime
+		&& ! peer->announce[afi][safi]
 		&& ! CHECK_FLAG (peer->af_sflags[afi][safi], PEER_STATUS_EOR_SEND)
 		&& safi != SAFI_MPLS_VPN)
 	      {
@@ -621,9 +616,23 @@ bgp_write (struct thread *thread)
       return 0;
     }
 
+  /* The I/O thread writes, and counts, for this peer. */
+  if (peer->io)
+    {
+      while (count++ < BGP_WRITE_PACKET_MAX && bgp_io_out_room (peer)
+	     && bgp_write_packet (peer) != NULL)
+	bgp_io_send (peer, stream_fifo_pop (peer->obuf));
+      bgp_io_kick (peer, bgp_write_proceed (peer));
+      bgp_announce_resume (peer);
+      return 0;
+    }
+
   s = bgp_write_packet (peer);
   if (!s)
-    return 0;	/* nothing to send */
+    {
+      bgp_announce_resume (peer);
+      return 0;	/* nothing to send */
+    }
 
   sockopt_cork (peer->fd, 1);
 
@@ -699,6 +708,7 @@ bgp_write (struct thread *thread)
   
   if (bgp_write_proceed (peer))
     BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+  bgp_announce_resume (peer);
 
  done:
   sockopt_cork (peer->fd, 0);
@@ -871,6 +881,9 @@ bgp_notify_send_with_data (struct peer *peer, u_char code, u_char sub_code,
   /* Set BGP packet length. */
   length = bgp_packet_set_size (s);
   
+  /* Take the socket back to write this ourselves. */
+  bgp_io_detach (peer);
+
   /* Add packet to the peer. */
   stream_fifo_clean (peer->obuf);
   bgp_packet_add (peer, s);
@@ -2312,6 +2325,34 @@ bgp_capability_receive (struct peer *peer, bgp_size_t size)
   return bgp_capability_msg_parse (peer, pnt, size);
 }
 
+/* The connection was closed, or reading failed with err. */
+void
+bgp_read_failed (struct peer *peer, int err)
+{
+  if (err)
+    plog_err (peer->log, "%s [Error] bgp_read_packet error: %s",
+	      peer->host, safe_strerror (err));
+  else if (BGP_DEBUG (events, EVENTS))
+    plog_debug (peer->log, "%s [Event] BGP connection closed fd %d",
+	       peer->host, peer->fd);
+
+  if (peer->status == Established) 
+    {
+      if (CHECK_FLAG (peer->sflags, PEER_STATUS_NSF_MODE))
+	{
+	  peer->last_reset = PEER_DOWN_NSF_CLOSE_SESSION;
+	  SET_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT);
+	}
+      else
+	peer->last_reset = PEER_DOWN_CLOSE_SESSION;
+    }
+
+  if (err)
+    BGP_EVENT_ADD (peer, TCP_fatal_error);
+  else
+    BGP_EVENT_ADD (peer, TCP_connection_closed);
+}
+
 /* BGP read utility function. */
 static int
 bgp_read_packet (struct peer *peer)
@@ -2328,50 +2369,14 @@ bgp_read_packet (struct peer *peer)
   /* Read packet from fd. */
   nbytes = stream_read_try (peer->ibuf, peer->fd, readsize);
 
-  /* If read byte is smaller than zero then error occured. */
-  if (nbytes < 0) 
-    {
-      /* Transient error should retry */
-      if (nbytes == -2)
-	return -1;
-
-      plog_err (peer->log, "%s [Error] bgp_read_packet error: %s",
-		 peer->host, safe_strerror (errno));
-
-      if (peer->status == Established) 
-	{
-	  if (CHECK_FLAG (peer->sflags, PEER_STATUS_NSF_MODE))
-	    {
-	      peer->last_reset = PEER_DOWN_NSF_CLOSE_SESSION;
-	      SET_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT);
-	    }
-	  else
-	    peer->last_reset = PEER_DOWN_CLOSE_SESSION;
-	}
-
-      BGP_EVENT_ADD (peer, TCP_fatal_error);
-      return -1;
-    }  
+  /* Transient error should retry */
+  if (nbytes == -2)
+    return -1;
 
-  /* When read byte is zero : clear bgp peer and return */
-  if (nbytes == 0) 
+  /* Otherwise the session is over. */
+  if (nbytes <= 0)
     {
-      if (BGP_DEBUG (events, EVENTS))
-	plog_debug (peer->log, "%s [Event] BGP connection closed fd %d",
-		   peer->host, peer->fd);
-
-      if (peer->status == Established) 
-	{
-	  if (CHECK_FLAG (peer->sflags, PEER_STATUS_NSF_MODE))
-	    {
-	      peer->last_reset = PEER_DOWN_NSF_CLOSE_SESSION;
-	      SET_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT);
-	    }
-	  else
-	    peer->last_reset = PEER_DOWN_CLOSE_SESSION;
-	}
-
-      BGP_EVENT_ADD (peer, TCP_connection_closed);
+      bgp_read_failed (peer, nbytes ? errno : 0);
       return -1;
     }
 
@@ -2389,7 +2394,7 @@ bgp_marker_all_one (struct stream *s, int length)
   int i;
 
   for (i = 0; i < length; i++)
-    if (s->data[i] != 0xff)
+    if (s->data[s->getp + i] != 0xff)
       return 0;
 
   return 1;
@@ -2404,119 +2409,88 @@ bgp_recent_clock (void)
   return recent_relative_time().tv_sec;
 }
 
-/* Starting point of packet process function. */
+/* Check the header of the message at the read pointer of s.  A bad one
+   is logged and answered with a NOTIFICATION when notify is set;
+   without it nothing else is touched, so that the I/O thread may call
+   this.  Returns 0 if the header is good, -1 otherwise. */
 int
-bgp_read (struct thread *thread)
+bgp_packet_check_header (struct peer *peer, struct stream *s, int notify)
 {
-  int ret;
-  u_char type = 0;
-  struct peer *peer;
+  u_char type;
   bgp_size_t size;
   char notify_data_length[2];
 
-  /* Yes first of all get peer pointer. */
-  peer = THREAD_ARG (thread);
-  peer->t_read = NULL;
+  size = stream_getw_from (s, stream_get_getp (s) + BGP_MARKER_SIZE);
+  type = stream_getc_from (s, stream_get_getp (s) + BGP_MARKER_SIZE + 2);
+  memcpy (notify_data_length, STREAM_PNT (s) + BGP_MARKER_SIZE, 2);
 
-  /* For non-blocking IO check. */
-  if (peer->status == Connect)
+  /* Marker check */
+  if (((type == BGP_MSG_OPEN) || (type == BGP_MSG_KEEPALIVE))
+      && ! bgp_marker_all_one (s, BGP_MARKER_SIZE))
     {
-      bgp_connect_check (peer);
-      goto done;
+      if (notify)
+	bgp_notify_send (peer,
+			 BGP_NOTIFY_HEADER_ERR, 
+			 BGP_NOTIFY_HEADER_NOT_SYNC);
+      return -1;
     }
-  else
+
+  /* BGP type check. */
+  if (type != BGP_MSG_OPEN && type != BGP_MSG_UPDATE 
+      && type != BGP_MSG_NOTIFY && type != BGP_MSG_KEEPALIVE 
+      && type != BGP_MSG_ROUTE_REFRESH_NEW
+      && type != BGP_MSG_ROUTE_REFRESH_OLD
+      && type != BGP_MSG_CAPABILITY)
     {
-      if (peer->fd < 0)
-	{
-	  zlog_err ("bgp_read peer's fd is negative value %d", peer->fd);
-	  return -1;
-	}
-      BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
+      if (! notify)
+	return -1;
+      if (BGP_DEBUG (normal, NORMAL))
+	plog_debug (peer->log,
+		  "%s unknown message type 0x%02x",
+		  peer->host, type);
+      bgp_notify_send_with_data (peer,
+				 BGP_NOTIFY_HEADER_ERR,
+				 BGP_NOTIFY_HEADER_BAD_MESTYPE,
+				 &type, 1);
+      return -1;
     }
-
-  /* Read packet header to determine type of the packet */
-  if (peer->packet_size == 0)
-    peer->packet_size = BGP_HEADER_SIZE;
-
-  if (stream_get_endp (peer->ibuf) < BGP_HEADER_SIZE)
+  /* Mimimum packet length check. */
+  if ((size < BGP_HEADER_SIZE)
+      || (size > BGP_MAX_PACKET_SIZE)
+      || (type == BGP_MSG_OPEN && size < BGP_MSG_OPEN_MIN_SIZE)
+      || (type == BGP_MSG_UPDATE && size < BGP_MSG_UPDATE_MIN_SIZE)
+      || (type == BGP_MSG_NOTIFY && size < BGP_MSG_NOTIFY_MIN_SIZE)
+      || (type == BGP_MSG_KEEPALIVE && size != BGP_MSG_KEEPALIVE_MIN_SIZE)
+      || (type == BGP_MSG_ROUTE_REFRESH_NEW && size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
+      || (type == BGP_MSG_ROUTE_REFRESH_OLD && size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
+      || (type == BGP_MSG_CAPABILITY && size < BGP_MSG_CAPABILITY_MIN_SIZE))
     {
-      ret = bgp_read_packet (peer);
-
-      /* Header read error or partial read packet. */
-      if (ret < 0) 
-	goto done;
-
-      /* Get size and type. */
-      stream_forward_getp (peer->ibuf, BGP_MARKER_SIZE);
-      memcpy (notify_data_length, stream_pnt (peer->ibuf), 2);
-      size = stream_getw (peer->ibuf);
-      type = stream_getc (peer->ibuf);
-
-      if (BGP_DEBUG (normal, NORMAL) && type != 2 && type != 0)
-	zlog_debug ("%s rcv message type %d, length (excl. header) %d",
-		   peer->host, type, size - BGP_HEADER_SIZE);
-
-      /* Marker check */
-      if (((type == BGP_MSG_OPEN) || (type == BGP_MSG_KEEPALIVE))
-	  && ! bgp_marker_all_one (peer->ibuf, BGP_MARKER_SIZE))
-	{
-	  bgp_notify_send (peer,
-			   BGP_NOTIFY_HEADER_ERR, 
-			   BGP_NOTIFY_HEADER_NOT_SYNC);
-	  goto done;
-	}
-
-      /* BGP type check. */
-      if (type != BGP_MSG_OPEN && type != BGP_MSG_UPDATE 
-	  && type != BGP_MSG_NOTIFY && type != BGP_MSG_KEEPALIVE 
-	  && type != BGP_MSG_ROUTE_REFRESH_NEW
-	  && type != BGP_MSG_ROUTE_REFRESH_OLD
-	  && type != BGP_MSG_CAPABILITY)
-	{
-	  if (BGP_DEBUG (normal, NORMAL))
-	    plog_debug (peer->log,
-		      "%s unknown message type 0x%02x",
-		      peer->host, type);
-	  bgp_notify_send_with_data (peer,
-				     BGP_NOTIFY_HEADER_ERR,
-			 	     BGP_NOTIFY_HEADER_BAD_MESTYPE,
-				     &type, 1);
-	  goto done;
-	}
-      /* Mimimum packet length check. */
-      if ((size < BGP_HEADER_SIZE)
-	  || (size > BGP_MAX_PACKET_SIZE)
-	  || (type == BGP_MSG_OPEN && size < BGP_MSG_OPEN_MIN_SIZE)
-	  || (type == BGP_MSG_UPDATE && size < BGP_MSG_UPDATE_MIN_SIZE)
-	  || (type == BGP_MSG_NOTIFY && size < BGP_MSG_NOTIFY_MIN_SIZE)
-	  || (type == BGP_MSG_KEEPALIVE && size != BGP_MSG_KEEPALIVE_MIN_SIZE)
-	  || (type == BGP_MSG_ROUTE_REFRESH_NEW && size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
-	  || (type == BGP_MSG_ROUTE_REFRESH_OLD && size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
-	  || (type == BGP_MSG_CAPABILITY && size < BGP_MSG_CAPABILITY_MIN_SIZE))
-	{
-	  if (BGP_DEBUG (normal, NORMAL))
-	    plog_debug (peer->log,
-		      "%s bad message length - %d for %s",
-		      peer->host, size, 
-		      type == 128 ? "ROUTE-REFRESH" :
-		      bgp_type_str[(int) type]);
-	  bgp_notify_send_with_data (peer,
-				     BGP_NOTIFY_HEADER_ERR,
-			  	     BGP_NOTIFY_HEADER_BAD_MESLEN,
-				     (u_char *) notify_data_length, 2);
-	  goto done;
-	}
-
-      /* Adjust size to message length. */
-      peer->packet_size = size;
+      if (! notify)
+	return -1;
+      if (BGP_DEBUG (normal, NORMAL))
+	plog_debug (peer->log,
+		  "%s bad message length - %d for %s",
+		  peer->host, size, 
+		  type == 128 ? "ROUTE-REFRESH" :
+		  bgp_type_str[(int) type]);
+      bgp_notify_send_with_data (peer,
+				 BGP_NOTIFY_HEADER_ERR,
+				 BGP_NOTIFY_HEADER_BAD_MESLEN,
+				 (u_char *) notify_data_length, 2);
+      return -1;
     }
 
-  ret = bgp_read_packet (peer);
-  if (ret < 0) 
-    goto done;
+  return 0;
+}
+
+/* Hand the whole message in peer->ibuf, read past its header, to the
+   routine for its type. */
+void
+bgp_packet_process (struct peer *peer)
+{
+  u_char type;
+  bgp_size_t size;
 
-  /* Get size and type again. */
-  size = stream_getw_from (peer->ibuf, BGP_MARKER_SIZE);
   type = stream_getc_from (peer->ibuf, BGP_MARKER_SIZE + 2);
 
   /* BGP packet dump function. */
@@ -2524,6 +2498,10 @@ bgp_read (struct thread *thread)
   
   size = (peer->packet_size - BGP_HEADER_SIZE);
 
+  if (BGP_DEBUG (normal, NORMAL) && type != 2 && type != 0)
+    zlog_debug ("%s rcv message type %d, length (excl. header) %d",
+	       peer->host, type, size);
+
   /* Read rest of the packet and call each sort of packet routine */
   switch (type) 
     {
@@ -2557,6 +2535,151 @@ bgp_read (struct thread *thread)
   peer->packet_size = 0;
   if (peer->ibuf)
     stream_reset (peer->ibuf);
+}
+
+/* Move what is left unread in s to its front, then read from fd what
+   fits of a chunk.  Returns as stream_read_try(), and -2 as well when
+   s is full.  The I/O thread calls this too. */
+int
+bgp_read_chunk (struct stream *s, int fd)
+{
+  size_t left = STREAM_READABLE (s);
+
+  if (stream_get_getp (s))
+    {
+      memmove (STREAM_DATA (s), STREAM_PNT (s), left);
+      stream_set_getp (s, 0);
+      stream_set_endp (s, left);
+    }
+  if (STREAM_WRITEABLE (s) == 0)
+    return -2;
+
+  return stream_read_try (s, fd, MIN (STREAM_WRITEABLE (s),
+				      BGP_READ_CHUNK_SIZE));
+}
+
+/* Size of the message at the read pointer of s, whose header has been
+   checked, or 0 while it is not all there. */
+bgp_size_t
+bgp_packet_whole (struct stream *s)
+{
+  bgp_size_t size;
+
+  size = stream_getw_from (s, stream_get_getp (s) + BGP_MARKER_SIZE);
+  return STREAM_READABLE (s) >= size ? size : 0;
+}
+
+/* An Established session is read a chunk at a time, and each message
+   the chunk completes is processed before going back to the event
+   loop.  The chunk size bounds the work done for one peer in a go. */
+static void
+bgp_read_chunked (struct peer *peer)
+{
+  struct stream *rbuf;
+  bgp_size_t size;
+  int nbytes;
+
+  /* Carry over what was read of a message before the session was up. */
+  if (peer->rbuf == NULL)
+    {
+      peer->rbuf = stream_new (BGP_READ_CHUNK_SIZE + BGP_MAX_PACKET_SIZE);
+      stream_put (peer->rbuf, STREAM_DATA (peer->ibuf),
+		  stream_get_endp (peer->ibuf));
+      stream_reset (peer->ibuf);
+      peer->packet_size = 0;
+    }
+
+  nbytes = bgp_read_chunk (peer->rbuf, peer->fd);
+  if (nbytes == -2)
+    return;
+  if (nbytes <= 0)
+    {
+      bgp_read_failed (peer, nbytes ? errno : 0);
+      return;
+    }
+  peer->read_chunks++;
+
+  /* Messages may reset the session, which lets go of rbuf. */
+  while (peer->status == Established
+	 && (rbuf = peer->rbuf) != NULL
+	 && STREAM_READABLE (rbuf) >= BGP_HEADER_SIZE)
+    {
+      if (bgp_packet_check_header (peer, rbuf, 1) < 0)
+	return;
+      if ((size = bgp_packet_whole (rbuf)) == 0)
+	break;
+
+      stream_reset (peer->ibuf);
+      stream_put (peer->ibuf, STREAM_PNT (rbuf), size);
+      stream_forward_getp (rbuf, size);
+      stream_set_getp (peer->ibuf, BGP_HEADER_SIZE);
+      peer->packet_size = size;
+      peer->read_msgs++;
+      bgp_packet_process (peer);
+    }
+}
+
+/* Starting point of packet process function. */
+int
+bgp_read (struct thread *thread)
+{
+  int ret;
+  struct peer *peer;
+
+  /* Yes first of all get peer pointer. */
+  peer = THREAD_ARG (thread);
+  peer->t_read = NULL;
+
+  /* For non-blocking IO check. */
+  if (peer->status == Connect)
+    {
+      bgp_connect_check (peer);
+      goto done;
+    }
+  else
+    {
+      if (peer->fd < 0)
+	{
+	  zlog_err ("bgp_read peer's fd is negative value %d", peer->fd);
+	  return -1;
+	}
+      BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
+    }
+
+  if (peer->status == Established)
+    {
+      bgp_read_chunked (peer);
+      goto done;
+    }
+
+  /* Until then, messages are read one at a time: the session may move
+     to another peer structure after an OPEN. */
+
+  /* Read packet header to determine type of the packet */
+  if (peer->packet_size == 0)
+    peer->packet_size = BGP_HEADER_SIZE;
+
+  if (stream_get_endp (peer->ibuf) < BGP_HEADER_SIZE)
+    {
+      ret = bgp_read_packet (peer);
+
+      /* Header read error or partial read packet. */
+      if (ret < 0) 
+	goto done;
+
+      if (bgp_packet_check_header (peer, peer->ibuf, 1) < 0)
+	goto done;
+
+      /* Adjust size to message length. */
+      stream_set_getp (peer->ibuf, BGP_HEADER_SIZE);
+      peer->packet_size = stream_getw_from (peer->ibuf, BGP_MARKER_SIZE);
+    }
+
+  ret = bgp_read_packet (peer);
+  if (ret < 0) 
+    goto done;
+
+  bgp_packet_process (peer);
 
  done:
   if (CHECK_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER))
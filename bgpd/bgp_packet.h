@@ -26,6 +26,9 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #define BGP_UNFEASIBLE_LEN    2U
 #define BGP_WRITE_PACKET_MAX 10U
 
+/* Most read from an Established session in one go. */
+#define BGP_READ_CHUNK_SIZE  (8 * BGP_MAX_PACKET_SIZE)
+
 /* When to refresh */
 #define REFRESH_IMMEDIATE 1
 #define REFRESH_DEFER     2 
@@ -54,4 +57,10 @@ extern void bgp_default_withdraw_send (struct peer *, afi_t, safi_t);
 
 extern int bgp_capability_receive (struct peer *, bgp_size_t);
 
+extern int bgp_packet_check_header (struct peer *, struct stream *, int);
+extern int bgp_read_chunk (struct stream *, int);
+extern bgp_size_t bgp_packet_whole (struct stream *);
+extern void bgp_packet_process (struct peer *);
+extern void bgp_read_failed (struct peer *, int);
+
 #endif /* _QUAGGA_BGP_PACKET_H */
@@ -34,6 +34,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "plist.h"
 #include "thread.h"
 #include "workqueue.h"
+#include "hash.h"
+#include "jhash.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_table.h"
@@ -76,7 +78,10 @@ bgp_afi_node_get (struct bgp_table *table, afi_t afi, safi_t safi, struct prefix
       prn = bgp_node_get (table, (struct prefix *) prd);
 
       if (prn->info == NULL)
-	prn->info = bgp_table_init (afi, safi);
+	{
+	  prn->info = bgp_table_init (afi, safi);
+	  ((struct bgp_table *) prn->info)->type = table->type;
+	}
       else
 	bgp_unlock_node (prn);
       table = prn->info;
@@ -99,6 +104,192 @@ bgp_info_extra_new (void)
   return new;
 }
 
+/* Route-server client policy outcomes.  Slots index the bitmap of
+   clients which deny a path. */
+#define BGP_RSCLIENT_WORD(S)	((unsigned int) (S) / 32)
+#define BGP_RSCLIENT_BIT(S)	(1U << ((S) % 32))
+
+static void
+bgp_info_rsclient_free (struct bgp_info_rsclient *rsc)
+{
+  unsigned int i;
+
+  for (i = 0; i < rsc->ndelta; i++)
+    bgp_attr_unintern (&rsc->delta[i].attr);
+  if (rsc->delta)
+    XFREE (MTYPE_BGP_RSCLIENT_OUTCOME, rsc->delta);
+  if (rsc->denied)
+    XFREE (MTYPE_BGP_RSCLIENT_OUTCOME, rsc->denied);
+  XFREE (MTYPE_BGP_RSCLIENT_OUTCOME, rsc);
+}
+
+/* Index of SLOT in the deltas, or where it would go. */
+static unsigned int
+bgp_rsclient_delta_find (struct bgp_info_rsclient *rsc, int slot)
+{
+  unsigned int lo = 0;
+  unsigned int hi = rsc->ndelta;
+  unsigned int mid;
+
+  while (lo < hi)
+    {
+      mid = (lo + hi) / 2;
+      if (rsc->delta[mid].slot < slot)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
+static int
+bgp_rsclient_denied (struct bgp_info_rsclient *rsc, int slot)
+{
+  return (BGP_RSCLIENT_WORD (slot) < rsc->denied_words
+	  && (rsc->denied[BGP_RSCLIENT_WORD (slot)] & BGP_RSCLIENT_BIT (slot)));
+}
+
+/* The attribute route-server client RSCLIENT sees for RI, NULL if
+   its policy denies the path or the path is its own. */
+static struct attr *
+bgp_rsclient_outcome (struct bgp_info *ri, struct peer *rsclient)
+{
+  struct bgp_info_rsclient *rsc;
+  int slot = rsclient->rsclient_slot;
+  unsigned int i;
+
+  if (ri->peer == rsclient)
+    return NULL;
+
+  rsc = ri->extra ? ri->extra->rsclient : NULL;
+  if (! rsc)
+    return ri->attr;
+
+  if (bgp_rsclient_denied (rsc, slot))
+    return NULL;
+
+  i = bgp_rsclient_delta_find (rsc, slot);
+  if (i < rsc->ndelta && rsc->delta[i].slot == slot)
+    return rsc->delta[i].attr;
+
+  return ri->attr;
+}
+
+static void
+bgp_rsclient_delta_remove (struct bgp_info_rsclient *rsc, unsigned int i)
+{
+  bgp_attr_unintern (&rsc->delta[i].attr);
+  rsc->ndelta--;
+  memmove (&rsc->delta[i], &rsc->delta[i + 1],
+	   (rsc->ndelta - i) * sizeof (struct bgp_rsclient_delta));
+}
+
+/* Drop RI's outcomes once every client sees its own attribute. */
+static void
+bgp_rsclient_outcome_trim (struct bgp_info *ri)
+{
+  struct bgp_info_rsclient *rsc = ri->extra->rsclient;
+  unsigned int i;
+
+  if (rsc->ndelta)
+    return;
+  for (i = 0; i < rsc->denied_words; i++)
+    if (rsc->denied[i])
+      return;
+
+  bgp_info_rsclient_free (rsc);
+  ri->extra->rsclient = NULL;
+}
+
+/* Record that the client in SLOT sees ATTR for RI, or that its policy
+   denies the path if ATTR is NULL.  The reference to ATTR is handed
+   over.  Returns whether what the client sees changed. */
+static int
+bgp_rsclient_outcome_set (struct bgp_info *ri, int slot, struct attr *attr)
+{
+  struct bgp_info_rsclient *rsc;
+  unsigned int word = BGP_RSCLIENT_WORD (slot);
+  unsigned int i;
+  int found;
+  int changed = 0;
+
+  rsc = ri->extra ? ri->extra->rsclient : NULL;
+  if (! rsc)
+    {
+      if (attr == ri->attr)
+	{
+	  bgp_attr_unintern (&attr);
+	  return 0;
+	}
+      rsc = XCALLOC (MTYPE_BGP_RSCLIENT_OUTCOME,
+		     sizeof (struct bgp_info_rsclient));
+      bgp_info_extra_get (ri)->rsclient = rsc;
+    }
+
+  i = bgp_rsclient_delta_find (rsc, slot);
+  found = (i < rsc->ndelta && rsc->delta[i].slot == slot);
+
+  if (! attr)
+    {
+      if (bgp_rsclient_denied (rsc, slot))
+	return 0;
+      if (word >= rsc->denied_words)
+	{
+	  rsc->denied = XREALLOC (MTYPE_BGP_RSCLIENT_OUTCOME, rsc->denied,
+				  (word + 1) * sizeof (u_int32_t));
+	  memset (&rsc->denied[rsc->denied_words], 0,
+		  (word + 1 - rsc->denied_words) * sizeof (u_int32_t));
+	  rsc->denied_words = word + 1;
+	}
+      rsc->denied[word] |= BGP_RSCLIENT_BIT (slot);
+      if (found)
+	bgp_rsclient_delta_remove (rsc, i);
+      return 1;
+    }
+
+  if (bgp_rsclient_denied (rsc, slot))
+    {
+      rsc->denied[word] &= ~BGP_RSCLIENT_BIT (slot);
+      changed = 1;
+    }
+
+  if (attr == ri->attr)
+    {
+      bgp_attr_unintern (&attr);
+      if (found)
+	{
+	  bgp_rsclient_delta_remove (rsc, i);
+	  changed = 1;
+	}
+    }
+  else if (found)
+    {
+      if (rsc->delta[i].attr == attr)
+	bgp_attr_unintern (&attr);
+      else
+	{
+	  bgp_attr_unintern (&rsc->delta[i].attr);
+	  rsc->delta[i].attr = attr;
+	  changed = 1;
+	}
+    }
+  else
+    {
+      rsc->delta = XREALLOC (MTYPE_BGP_RSCLIENT_OUTCOME, rsc->delta,
+			     (rsc->ndelta + 1)
+			     * sizeof (struct bgp_rsclient_delta));
+      memmove (&rsc->delta[i + 1], &rsc->delta[i],
+	       (rsc->ndelta - i) * sizeof (struct bgp_rsclient_delta));
+      rsc->delta[i].slot = slot;
+      rsc->delta[i].attr = attr;
+      rsc->ndelta++;
+      changed = 1;
+    }
+
+  bgp_rsclient_outcome_trim (ri);
+  return changed;
+}
+
 static void
 bgp_info_extra_free (struct bgp_info_extra **extra)
 {
@@ -108,6 +299,9 @@ bgp_info_extra_free (struct bgp_info_extra **extra)
         bgp_damp_info_free ((*extra)->damp_info, 0);
       
       (*extra)->damp_info = NULL;
+
+      if ((*extra)->rsclient)
+        bgp_info_rsclient_free ((*extra)->rsclient);
       
       XFREE (MTYPE_BGP_ROUTE_EXTRA, *extra);
       
@@ -182,6 +376,202 @@ bgp_info_unlock (struct bgp_info *binfo)
   return binfo;
 }
 
+/* What the decision process looks at of a path, kept with the node in
+   the order of its paths so that comparing them touches neither the
+   attribute nor the AS path.  Only what the attribute alone decides is
+   kept, for the configuration to apply at each comparison. */
+struct bgp_path_key
+{
+  struct bgp_info *ri;
+  struct attr *attr;		/* what the key was made of, locked */
+
+  u_int32_t weight;
+  u_int32_t local_pref;
+  u_int32_t med;
+  u_int32_t originator_id;	/* host order */
+  as_t peer_as;
+  as_t left_as;			/* first AS of a leading AS_SEQUENCE */
+  as_t left_confed_as;		/* first AS of a leading AS_CONFED_SEQUENCE */
+
+  u_int16_t hops;
+  u_int16_t confeds;
+  u_int16_t cluster;
+
+  u_char origin;
+  u_char sort;
+
+  u_char flags;
+#define BGP_PATH_KEY_NORMAL		(1 << 0)
+#define BGP_PATH_KEY_LOCAL_PREF		(1 << 1)
+#define BGP_PATH_KEY_MED		(1 << 2)
+#define BGP_PATH_KEY_ORIGINATOR_ID	(1 << 3)
+#define BGP_PATH_KEY_LEFT		(1 << 4)
+#define BGP_PATH_KEY_LEFT_CONFED	(1 << 5)
+};
+
+/* The keys of the paths of a node, one for each in rn->info order. */
+struct bgp_path_vec
+{
+  int count;
+  int size;
+  struct bgp_path_key key[];
+};
+
+static void
+bgp_path_key_set (struct bgp_path_key *key, struct bgp_info *ri,
+		  struct attr *attr)
+{
+  struct attr_extra *attre = attr->extra;
+  struct assegment *seg;
+  unsigned int hops = 0;
+  unsigned int confeds = 0;
+
+  key->ri = ri;
+  key->weight = attre ? attre->weight : 0;
+  key->local_pref = attr->local_pref;
+  key->med = attr->med;
+  key->originator_id = attre ? ntohl (attre->originator_id.s_addr) : 0;
+  key->cluster = (attr->flag & ATTR_FLAG_BIT (BGP_ATTR_CLUSTER_LIST))
+		 ? attre->cluster->length : 0;
+  key->peer_as = ri->peer->as;
+  key->origin = attr->origin;
+  key->sort = ri->peer->sort;
+
+  key->flags = 0;
+  if (ri->sub_type == BGP_ROUTE_NORMAL)
+    key->flags |= BGP_PATH_KEY_NORMAL;
+  if (attr->flag & ATTR_FLAG_BIT (BGP_ATTR_LOCAL_PREF))
+    key->flags |= BGP_PATH_KEY_LOCAL_PREF;
+  if (attr->flag & ATTR_FLAG_BIT (BGP_ATTR_MULTI_EXIT_DISC))
+    key->flags |= BGP_PATH_KEY_MED;
+  if (attr->flag & ATTR_FLAG_BIT (BGP_ATTR_ORIGINATOR_ID))
+    key->flags |= BGP_PATH_KEY_ORIGINATOR_ID;
+
+  /* One walk for what aspath_count_hops, aspath_count_confeds,
+     aspath_cmp_left and aspath_cmp_left_confed would each find. */
+  seg = attr->aspath ? attr->aspath->segments : NULL;
+  if (seg && seg->type == AS_CONFED_SEQUENCE)
+    {
+      key->left_confed_as = seg->as[0];
+      key->flags |= BGP_PATH_KEY_LEFT_CONFED;
+    }
+  for (; seg; seg = seg->next)
+    switch (seg->type)
+      {
+      case AS_SEQUENCE:
+	if (! hops && ! CHECK_FLAG (key->flags, BGP_PATH_KEY_LEFT))
+	  {
+	    key->left_as = seg->as[0];
+	    key->flags |= BGP_PATH_KEY_LEFT;
+	  }
+	hops += seg->length;
+	break;
+      case AS_SET:
+	hops++;
+	break;
+      case AS_CONFED_SEQUENCE:
+	confeds += seg->length;
+	break;
+      case AS_CONFED_SET:
+	confeds++;
+	break;
+      }
+  key->hops = MIN (hops, UINT16_MAX);
+  key->confeds = MIN (confeds, UINT16_MAX);
+}
+
+/* Make the key of the node's path again from its attribute.  The key
+   holds a reference to the attribute it was made of, which cannot
+   then be freed and another take its place at the same address. */
+static void
+bgp_path_key_refresh (struct bgp_path_key *key, struct bgp_info *ri)
+{
+  if (key->attr)
+    bgp_attr_unintern (&key->attr);
+  key->attr = bgp_attr_intern (ri->attr);
+  bgp_path_key_set (key, ri, ri->attr);
+}
+
+/* Keys for the paths of RN as they are now.  Made at the first
+   selection of the node, and after for each path whose attribute
+   changed; checking that is a pass down the vector, not a walk down
+   the list of paths.  Nodes without paths, as those which only join
+   others in the table, get none. */
+static struct bgp_path_vec *
+bgp_path_vec_get (struct bgp_node *rn)
+{
+  static struct bgp_path_vec empty;
+  struct bgp_path_vec *vec = rn->paths;
+  struct bgp_info *ri;
+  int i, n;
+
+  if (! rn->info)
+    return &empty;
+
+  if (vec)
+    {
+      for (i = 0; i < vec->count; i++)
+	if (vec->key[i].attr != vec->key[i].ri->attr)
+	  bgp_path_key_refresh (&vec->key[i], vec->key[i].ri);
+      return vec;
+    }
+
+  n = 0;
+  for (ri = rn->info; ri; ri = ri->next)
+    n++;
+  vec = XMALLOC (MTYPE_BGP_PATH_VEC, sizeof (struct bgp_path_vec)
+		 + n * sizeof (struct bgp_path_key));
+  vec->size = n;
+  vec->count = 0;
+  for (ri = rn->info; ri; ri = ri->next)
+    {
+      vec->key[vec->count].attr = NULL;
+      bgp_path_key_refresh (&vec->key[vec->count++], ri);
+    }
+  rn->paths = vec;
+  return vec;
+}
+
+/* A path was added at the head of the node's paths. */
+static void
+bgp_path_vec_add (struct bgp_node *rn, struct bgp_info *ri)
+{
+  struct bgp_path_vec *vec = rn->paths;
+
+  if (vec->count == vec->size)
+    {
+      vec->size = vec->size * 2 + 1;
+      vec = XREALLOC (MTYPE_BGP_PATH_VEC, vec, sizeof (struct bgp_path_vec)
+		      + vec->size * sizeof (struct bgp_path_key));
+      rn->paths = vec;
+    }
+  memmove (&vec->key[1], &vec->key[0],
+	   vec->count * sizeof (struct bgp_path_key));
+  vec->count++;
+
+  /* Made by the next selection. */
+  vec->key[0].ri = ri;
+  vec->key[0].attr = NULL;
+}
+
+static void
+bgp_path_vec_del (struct bgp_node *rn, struct bgp_info *ri)
+{
+  struct bgp_path_vec *vec = rn->paths;
+  int i;
+
+  for (i = 0; i < vec->count; i++)
+    if (vec->key[i].ri == ri)
+      {
+	if (vec->key[i].attr)
+	  bgp_attr_unintern (&vec->key[i].attr);
+	vec->count--;
+	memmove (&vec->key[i], &vec->key[i + 1],
+		 (vec->count - i) * sizeof (struct bgp_path_key));
+	return;
+      }
+}
+
 void
 bgp_info_add (struct bgp_node *rn, struct bgp_info *ri)
 {
@@ -194,6 +584,8 @@ bgp_info_add (struct bgp_node *rn, struct bgp_info *ri)
   if (top)
     top->prev = ri;
   rn->info = ri;
+  if (rn->paths)
+    bgp_path_vec_add (rn, ri);
   
   bgp_info_lock (ri);
   bgp_lock_node (rn);
@@ -211,6 +603,8 @@ bgp_info_reap (struct bgp_node *rn, struct bgp_info *ri)
     ri->prev->next = ri->next;
   else
     rn->info = ri->next;
+  if (rn->paths)
+    bgp_path_vec_del (rn, ri);
   
   bgp_info_mpath_dequeue (ri);
   bgp_info_unlock (ri);
@@ -305,13 +699,28 @@ bgp_info_unset_flag (struct bgp_node *rn, struct bgp_info *ri, u_int32_t flag)
   bgp_pcount_adjust (rn, ri);
 }
 
+/* Whether the two paths have the same first neighbour AS, as
+   aspath_cmp_left or aspath_cmp_left_confed have it. */
+static int
+bgp_path_key_same_left (const struct bgp_path_key *a,
+			const struct bgp_path_key *b)
+{
+  if (CHECK_FLAG (a->flags & b->flags, BGP_PATH_KEY_LEFT)
+      && a->left_as == b->left_as)
+    return 1;
+  if (CHECK_FLAG (a->flags & b->flags, BGP_PATH_KEY_LEFT_CONFED)
+      && a->left_confed_as == b->left_confed_as)
+    return 1;
+  return 0;
+}
+
 /* Get MED value.  If MED value is missing and "bgp bestpath
    missing-as-worst" is specified, treat it as the worst value. */
 static u_int32_t
-bgp_med_value (struct attr *attr, struct bgp *bgp)
+bgp_path_key_med (const struct bgp_path_key *key, struct bgp *bgp)
 {
-  if (attr->flag & ATTR_FLAG_BIT (BGP_ATTR_MULTI_EXIT_DISC))
-    return attr->med;
+  if (CHECK_FLAG (key->flags, BGP_PATH_KEY_MED))
+    return key->med;
   else
     {
       if (bgp_flag_check (bgp, BGP_FLAG_MED_MISSING_AS_WORST))
@@ -323,24 +732,16 @@ bgp_med_value (struct attr *attr, struct bgp *bgp)
 
 /* Compare two bgp route entity.  br is preferable then return 1. */
 static int
-bgp_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist,
-	      int *paths_eq)
+bgp_path_key_cmp (struct bgp *bgp, const struct bgp_path_key *new,
+		  const struct bgp_path_key *exist, int *paths_eq)
 {
-  struct attr *newattr, *existattr;
-  struct attr_extra *newattre, *existattre;
-  bgp_peer_sort_t new_sort;
-  bgp_peer_sort_t exist_sort;
   u_int32_t new_pref;
   u_int32_t exist_pref;
   u_int32_t new_med;
   u_int32_t exist_med;
-  u_int32_t new_weight;
-  u_int32_t exist_weight;
-  uint32_t newm, existm;
-  struct in_addr new_id;
-  struct in_addr exist_id;
-  int new_cluster;
-  int exist_cluster;
+  u_int32_t newm, existm;
+  u_int32_t new_id;
+  u_int32_t exist_id;
   int internal_as_route;
   int confed_as_route;
   int ret;
@@ -353,31 +754,19 @@ bgp_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist,
   if (exist == NULL)
     return 1;
 
-  newattr = new->attr;
-  existattr = exist->attr;
-  newattre = newattr->extra;
-  existattre = existattr->extra;
-
   /* 1. Weight check. */
-  new_weight = exist_weight = 0;
-
-  if (newattre)
-    new_weight = newattre->weight;
-  if (existattre)
-    exist_weight = existattre->weight;
-
-  if (new_weight > exist_weight)
+  if (new->weight > exist->weight)
     return 1;
-  if (new_weight < exist_weight)
+  if (new->weight < exist->weight)
     return 0;
 
   /* 2. Local preference check. */
   new_pref = exist_pref = bgp->default_local_pref;
 
-  if (newattr->flag & ATTR_FLAG_BIT (BGP_ATTR_LOCAL_PREF))
-    new_pref = newattr->local_pref;
-  if (existattr->flag & ATTR_FLAG_BIT (BGP_ATTR_LOCAL_PREF))
-    exist_pref = existattr->local_pref;
+  if (CHECK_FLAG (new->flags, BGP_PATH_KEY_LOCAL_PREF))
+    new_pref = new->local_pref;
+  if (CHECK_FLAG (exist->flags, BGP_PATH_KEY_LOCAL_PREF))
+    exist_pref = exist->local_pref;
 
   if (new_pref > exist_pref)
     return 1;
@@ -389,63 +778,48 @@ bgp_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist,
    *  - BGP_ROUTE_AGGREGATE
    *  - BGP_ROUTE_REDISTRIBUTE
    */
-  if (! (new->sub_type == BGP_ROUTE_NORMAL))
+  if (! CHECK_FLAG (new->flags, BGP_PATH_KEY_NORMAL))
      return 1;
-  if (! (exist->sub_type == BGP_ROUTE_NORMAL))
+  if (! CHECK_FLAG (exist->flags, BGP_PATH_KEY_NORMAL))
      return 0;
 
   /* 4. AS path length check. */
   if (! bgp_flag_check (bgp, BGP_FLAG_ASPATH_IGNORE))
     {
-      int exist_hops = aspath_count_hops (existattr->aspath);
-      int exist_confeds = aspath_count_confeds (existattr->aspath);
-      
+      int new_hops = new->hops;
+      int exist_hops = exist->hops;
+
       if (bgp_flag_check (bgp, BGP_FLAG_ASPATH_CONFED))
 	{
-	  int aspath_hops;
-	  
-	  aspath_hops = aspath_count_hops (newattr->aspath);
-          aspath_hops += aspath_count_confeds (newattr->aspath);
-          
-	  if ( aspath_hops < (exist_hops + exist_confeds))
-	    return 1;
-	  if ( aspath_hops > (exist_hops + exist_confeds))
-	    return 0;
-	}
-      else
-	{
-	  int newhops = aspath_count_hops (newattr->aspath);
-	  
-	  if (newhops < exist_hops)
-	    return 1;
-          if (newhops > exist_hops)
-	    return 0;
+	  new_hops += new->confeds;
+	  exist_hops += exist->confeds;
 	}
+
+      if (new_hops < exist_hops)
+	return 1;
+      if (new_hops > exist_hops)
+	return 0;
     }
 
   /* 5. Origin check. */
-  if (newattr->origin < existattr->origin)
+  if (new->origin < exist->origin)
     return 1;
-  if (newattr->origin > existattr->origin)
+  if (new->origin > exist->origin)
     return 0;
 
   /* 6. MED check. */
-  internal_as_route = (aspath_count_hops (newattr->aspath) == 0
-		      && aspath_count_hops (existattr->aspath) == 0);
-  confed_as_route = (aspath_count_confeds (newattr->aspath) > 0
-		    && aspath_count_confeds (existattr->aspath) > 0
-		    && aspath_count_hops (newattr->aspath) == 0
-		    && aspath_count_hops (existattr->aspath) == 0);
-  
+  internal_as_route = (new->hops == 0 && exist->hops == 0);
+  confed_as_route = (new->confeds > 0 && exist->confeds > 0
+		     && internal_as_route);
+
   if (bgp_flag_check (bgp, BGP_FLAG_ALWAYS_COMPARE_MED)
       || (bgp_flag_check (bgp, BGP_FLAG_MED_CONFED)
 	 && confed_as_route)
-      || aspath_cmp_left (newattr->aspath, existattr->aspath)
-      || aspath_cmp_left_confed (newattr->aspath, existattr->aspath)
+      || bgp_path_key_same_left (new, exist)
       || internal_as_route)
     {
-      new_med = bgp_med_value (new->attr, bgp);
-      exist_med = bgp_med_value (exist->attr, bgp);
+      new_med = bgp_path_key_med (new, bgp);
+      exist_med = bgp_path_key_med (exist, bgp);
 
       if (new_med < exist_med)
 	return 1;
@@ -454,93 +828,68 @@ bgp_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist,
     }
 
   /* 7. Peer type check. */
-  new_sort = new->peer->sort;
-  exist_sort = exist->peer->sort;
-
-  if (new_sort == BGP_PEER_EBGP
-      && (exist_sort == BGP_PEER_IBGP || exist_sort == BGP_PEER_CONFED))
+  if (new->sort == BGP_PEER_EBGP
+      && (exist->sort == BGP_PEER_IBGP || exist->sort == BGP_PEER_CONFED))
     return 1;
-  if (exist_sort == BGP_PEER_EBGP
-      && (new_sort == BGP_PEER_IBGP || new_sort == BGP_PEER_CONFED))
+  if (exist->sort == BGP_PEER_EBGP
+      && (new->sort == BGP_PEER_IBGP || new->sort == BGP_PEER_CONFED))
     return 0;
 
   /* 8. IGP metric check. */
-  newm = existm = 0;
-
-  if (new->extra)
-    newm = new->extra->igpmetric;
-  if (exist->extra)
-    existm = exist->extra->igpmetric;
+  newm = new->ri->extra ? new->ri->extra->igpmetric : 0;
+  existm = exist->ri->extra ? exist->ri->extra->igpmetric : 0;
 
   if (newm < existm)
-    ret = 1;
+    return 1;
   if (newm > existm)
-    ret = 0;
+    return 0;
 
   /* 9. Maximum path check. */
-  if (newm == existm)
+  if (new->sort == BGP_PEER_IBGP)
     {
-      if (new->peer->sort == BGP_PEER_IBGP)
-	{
-	  if (aspath_cmp (new->attr->aspath, exist->attr->aspath))
-	    *paths_eq = 1;
-	}
-      else if (new->peer->as == exist->peer->as)
+      if (aspath_cmp (new->ri->attr->aspath, exist->ri->attr->aspath))
 	*paths_eq = 1;
     }
-  else
-    {
-      /*
-       * TODO: If unequal cost ibgp multipath is enabled we can
-       * mark the paths as equal here instead of returning
-       */
-      return ret;
-    }
+  else if (new->peer_as == exist->peer_as)
+    *paths_eq = 1;
 
   /* 10. If both paths are external, prefer the path that was received
      first (the oldest one).  This step minimizes route-flap, since a
      newer path won't displace an older one, even if it was the
      preferred route based on the additional decision criteria below.  */
   if (! bgp_flag_check (bgp, BGP_FLAG_COMPARE_ROUTER_ID)
-      && new_sort == BGP_PEER_EBGP
-      && exist_sort == BGP_PEER_EBGP)
+      && new->sort == BGP_PEER_EBGP
+      && exist->sort == BGP_PEER_EBGP)
     {
-      if (CHECK_FLAG (new->flags, BGP_INFO_SELECTED))
+      if (CHECK_FLAG (new->ri->flags, BGP_INFO_SELECTED))
 	return 1;
-      if (CHECK_FLAG (exist->flags, BGP_INFO_SELECTED))
+      if (CHECK_FLAG (exist->ri->flags, BGP_INFO_SELECTED))
 	return 0;
     }
 
   /* 11. Rourter-ID comparision. */
-  if (newattr->flag & ATTR_FLAG_BIT(BGP_ATTR_ORIGINATOR_ID))
-    new_id.s_addr = newattre->originator_id.s_addr;
+  if (CHECK_FLAG (new->flags, BGP_PATH_KEY_ORIGINATOR_ID))
+    new_id = new->originator_id;
   else
-    new_id.s_addr = new->peer->remote_id.s_addr;
-  if (existattr->flag & ATTR_FLAG_BIT(BGP_ATTR_ORIGINATOR_ID))
-    exist_id.s_addr = existattre->originator_id.s_addr;
+    new_id = ntohl (new->ri->peer->remote_id.s_addr);
+  if (CHECK_FLAG (exist->flags, BGP_PATH_KEY_ORIGINATOR_ID))
+    exist_id = exist->originator_id;
   else
-    exist_id.s_addr = exist->peer->remote_id.s_addr;
+    exist_id = ntohl (exist->ri->peer->remote_id.s_addr);
 
-  if (ntohl (new_id.s_addr) < ntohl (exist_id.s_addr))
+  if (new_id < exist_id)
     return 1;
-  if (ntohl (new_id.s_addr) > ntohl (exist_id.s_addr))
+  if (new_id > exist_id)
     return 0;
 
   /* 12. Cluster length comparision. */
-  new_cluster = exist_cluster = 0;
-
-  if (newattr->flag & ATTR_FLAG_BIT(BGP_ATTR_CLUSTER_LIST))
-    new_cluster = newattre->cluster->length;
-  if (existattr->flag & ATTR_FLAG_BIT(BGP_ATTR_CLUSTER_LIST))
-    exist_cluster = existattre->cluster->length;
-
-  if (new_cluster < exist_cluster)
+  if (new->cluster < exist->cluster)
     return 1;
-  if (new_cluster > exist_cluster)
+  if (new->cluster > exist->cluster)
     return 0;
 
   /* 13. Neighbor address comparision. */
-  ret = sockunion_cmp (new->peer->su_remote, exist->peer->su_remote);
+  ret = sockunion_cmp (new->ri->peer->su_remote, exist->ri->peer->su_remote);
 
   if (ret == 1)
     return 0;
@@ -1288,87 +1637,89 @@ bgp_announce_check_rsclient (struct bgp_info *ri, struct peer *rsclient,
   return 1;
 }
 
-struct bgp_info_pair
-{
-  struct bgp_info *old;
-  struct bgp_info *new;
-};
-
-static void
+void
 bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
 		    struct bgp_maxpaths_cfg *mpath_cfg,
 		    struct bgp_info_pair *result)
 {
-  struct bgp_info *new_select;
+  struct bgp_path_vec *vec;
+  struct bgp_path_key *new_select;
+  struct bgp_path_key *key1;
+  struct bgp_path_key *key2;
   struct bgp_info *old_select;
   struct bgp_info *ri;
-  struct bgp_info *ri1;
-  struct bgp_info *ri2;
-  struct bgp_info *nextri = NULL;
   int paths_eq, do_mpath;
+  int i, j;
   struct list mp_list;
 
   bgp_mp_list_init (&mp_list);
   do_mpath = (mpath_cfg->maxpaths_ebgp != BGP_DEFAULT_MAXPATHS ||
 	      mpath_cfg->maxpaths_ibgp != BGP_DEFAULT_MAXPATHS);
 
+  vec = bgp_path_vec_get (rn);
+
   /* bgp deterministic-med */
   new_select = NULL;
   if (bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
-    for (ri1 = rn->info; ri1; ri1 = ri1->next)
+    for (i = 0; i < vec->count; i++)
       {
-	if (CHECK_FLAG (ri1->flags, BGP_INFO_DMED_CHECK))
+	key1 = &vec->key[i];
+	if (CHECK_FLAG (key1->ri->flags, BGP_INFO_DMED_CHECK))
 	  continue;
-	if (BGP_INFO_HOLDDOWN (ri1))
+	if (BGP_INFO_HOLDDOWN (key1->ri))
 	  continue;
 
-	new_select = ri1;
+	new_select = key1;
 	if (do_mpath)
-	  bgp_mp_list_add (&mp_list, ri1);
-	old_select = CHECK_FLAG (ri1->flags, BGP_INFO_SELECTED) ? ri1 : NULL;
-	if (ri1->next)
-	  for (ri2 = ri1->next; ri2; ri2 = ri2->next)
-	    {
-	      if (CHECK_FLAG (ri2->flags, BGP_INFO_DMED_CHECK))
-		continue;
-	      if (BGP_INFO_HOLDDOWN (ri2))
-		continue;
-
-	      if (aspath_cmp_left (ri1->attr->aspath, ri2->attr->aspath)
-		  || aspath_cmp_left_confed (ri1->attr->aspath,
-					     ri2->attr->aspath))
-		{
-		  if (CHECK_FLAG (ri2->flags, BGP_INFO_SELECTED))
-		    old_select = ri2;
-		  if (bgp_info_cmp (bgp, ri2, new_select, &paths_eq))
-		    {
-		      bgp_info_unset_flag (rn, new_select, BGP_INFO_DMED_SELECTED);
-		      new_select = ri2;
-		      if (do_mpath && !paths_eq)
-			{
-			  bgp_mp_list_clear (&mp_list);
-			  bgp_mp_list_add (&mp_list, ri2);
-			}
-		    }
-
-		  if (do_mpath && paths_eq)
-		    bgp_mp_list_add (&mp_list, ri2);
-
-		  bgp_info_set_flag (rn, ri2, BGP_INFO_DMED_CHECK);
-		}
-	    }
-	bgp_info_set_flag (rn, new_select, BGP_INFO_DMED_CHECK);
-	bgp_info_set_flag (rn, new_select, BGP_INFO_DMED_SELECTED);
+	  bgp_mp_list_add (&mp_list, key1->ri);
+	old_select = CHECK_FLAG (key1->ri->flags, BGP_INFO_SELECTED)
+		     ? key1->ri : NULL;
+	for (j = i + 1; j < vec->count; j++)
+	  {
+	    key2 = &vec->key[j];
+	    if (CHECK_FLAG (key2->ri->flags, BGP_INFO_DMED_CHECK))
+	      continue;
+	    if (BGP_INFO_HOLDDOWN (key2->ri))
+	      continue;
+
+	    if (bgp_path_key_same_left (key1, key2))
+	      {
+		if (CHECK_FLAG (key2->ri->flags, BGP_INFO_SELECTED))
+		  old_select = key2->ri;
+		if (bgp_path_key_cmp (bgp, key2, new_select, &paths_eq))
+		  {
+		    bgp_info_unset_flag (rn, new_select->ri,
+					 BGP_INFO_DMED_SELECTED);
+		    new_select = key2;
+		    if (do_mpath && !paths_eq)
+		      {
+			bgp_mp_list_clear (&mp_list);
+			bgp_mp_list_add (&mp_list, key2->ri);
+		      }
+		  }
+
+		if (do_mpath && paths_eq)
+		  bgp_mp_list_add (&mp_list, key2->ri);
 
-	bgp_info_mpath_update (rn, new_select, old_select, &mp_list, mpath_cfg);
+		bgp_info_set_flag (rn, key2->ri, BGP_INFO_DMED_CHECK);
+	      }
+	  }
+	bgp_info_set_flag (rn, new_select->ri, BGP_INFO_DMED_CHECK);
+	bgp_info_set_flag (rn, new_select->ri, BGP_INFO_DMED_SELECTED);
+
+	bgp_info_mpath_update (rn, new_select->ri, old_select, &mp_list,
+			       mpath_cfg);
 	bgp_mp_list_clear (&mp_list);
       }
 
   /* Check old selected route and new selected route. */
   old_select = NULL;
   new_select = NULL;
-  for (ri = rn->info; (ri != NULL) && (nextri = ri->next, 1); ri = nextri)
+  for (i = 0; i < vec->count; )
     {
+      key1 = &vec->key[i];
+      ri = key1->ri;
+
       if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED))
 	old_select = ri;
 
@@ -1380,9 +1731,12 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
           if (CHECK_FLAG (ri->flags, BGP_INFO_REMOVED)
               && (ri != old_select))
               bgp_info_reap (rn, ri);
+          else
+            i++;
           
           continue;
         }
+      i++;
 
       if (bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED)
           && (! CHECK_FLAG (ri->flags, BGP_INFO_DMED_SELECTED)))
@@ -1393,12 +1747,12 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
       bgp_info_unset_flag (rn, ri, BGP_INFO_DMED_CHECK);
       bgp_info_unset_flag (rn, ri, BGP_INFO_DMED_SELECTED);
 
-      if (bgp_info_cmp (bgp, ri, new_select, &paths_eq))
+      if (bgp_path_key_cmp (bgp, key1, new_select, &paths_eq))
 	{
 	  if (do_mpath && bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
-	    bgp_mp_dmed_deselect (new_select);
+	    bgp_mp_dmed_deselect (new_select ? new_select->ri : NULL);
 
-	  new_select = ri;
+	  new_select = key1;
 
 	  if (do_mpath && !paths_eq)
 	    {
@@ -1415,13 +1769,19 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
     
 
   if (!bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
-    bgp_info_mpath_update (rn, new_select, old_select, &mp_list, mpath_cfg);
+    bgp_info_mpath_update (rn, new_select ? new_select->ri : NULL,
+			   old_select, &mp_list, mpath_cfg);
 
-  bgp_info_mpath_aggregate_update (new_select, old_select);
+  bgp_info_mpath_aggregate_update (new_select ? new_select->ri : NULL,
+				   old_select);
   bgp_mp_list_clear (&mp_list);
 
+  /* The last path went. */
+  if (rn->paths && ! rn->paths->count)
+    XFREE (MTYPE_BGP_PATH_VEC, rn->paths);
+
   result->old = old_select;
-  result->new = new_select;
+  result->new = new_select ? new_select->ri : NULL;
 
   return;
 }
@@ -1449,111 +1809,399 @@ bgp_process_announce_selected (struct peer *peer, struct bgp_info *selected,
       PEER_STATUS_ORF_WAIT_REFRESH))
     return 0;
 
-  /* It's initialized in bgp_announce_[check|check_rsclient]() */
+  /* It's initialized in bgp_announce_check() */
   attr.extra = &extra;
 
-  switch (bgp_node_table (rn)->type)
-    {
-      case BGP_TABLE_MAIN:
-      /* Announcement to peer->conf.  If the route is filtered,
-         withdraw it. */
-        if (selected && bgp_announce_check (selected, peer, p, &attr, afi, safi))
-          bgp_adj_out_set (rn, peer, p, &attr, afi, safi, selected);
-        else
-          bgp_adj_out_unset (rn, peer, p, afi, safi);
-        break;
-      case BGP_TABLE_RSCLIENT:
-        /* Announcement to peer->conf.  If the route is filtered, 
-           withdraw it. */
-        if (selected && 
-            bgp_announce_check_rsclient (selected, peer, p, &attr, afi, safi))
-          bgp_adj_out_set (rn, peer, p, &attr, afi, safi, selected);
-        else
-	  bgp_adj_out_unset (rn, peer, p, afi, safi);
-        break;
-    }
+  /* Announcement to peer->conf.  If the route is filtered,
+     withdraw it. */
+  if (selected && bgp_announce_check (selected, peer, p, &attr, afi, safi))
+    bgp_adj_out_set (rn, peer, p, &attr, afi, safi, selected);
+  else
+    bgp_adj_out_unset (rn, peer, p, afi, safi);
 
   return 0;
 }
 
-struct bgp_process_queue 
+/* Best of the N paths at PATHS, copies of the paths of a node of the
+   shared route-server table with the attributes one client sees, NULL
+   where its policy denies the path.  Multipath is not kept for
+   route-server clients. */
+static struct bgp_info *
+bgp_rsclient_select (struct bgp *bgp, struct bgp_info *paths, int n)
 {
-  struct bgp *bgp;
-  struct bgp_node *rn;
-  afi_t afi;
-  safi_t safi;
-};
+  static struct bgp_path_key *keys;
+  static int keys_max;
+  struct bgp_path_key *new_select = NULL;
+  struct bgp_path_key *best;
+  int dmed;
+  int paths_eq;
+  int nkeys = 0;
+  int i, j;
 
-static wq_item_status
-bgp_process_rsclient (struct work_queue *wq, void *data)
-{
-  struct bgp_process_queue *pq = data;
-  struct bgp *bgp = pq->bgp;
-  struct bgp_node *rn = pq->rn;
-  afi_t afi = pq->afi;
-  safi_t safi = pq->safi;
-  struct bgp_info *new_select;
-  struct bgp_info *old_select;
-  struct bgp_info_pair old_and_new;
-  struct listnode *node, *nnode;
-  struct peer *rsclient = bgp_node_table (rn)->owner;
-  
-  /* Best path selection. */
-  bgp_best_selection (bgp, rn, &bgp->maxpaths[afi][safi], &old_and_new);
-  new_select = old_and_new.new;
-  old_select = old_and_new.old;
+  dmed = bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED);
 
-  if (CHECK_FLAG (rsclient->sflags, PEER_STATUS_GROUP))
+  if (n > keys_max)
     {
-      if (rsclient->group)
-        for (ALL_LIST_ELEMENTS (rsclient->group->peer, node, nnode, rsclient))
-          {
-            /* Nothing to do. */
-            if (old_select && old_select == new_select)
-              if (!CHECK_FLAG (old_select->flags, BGP_INFO_ATTR_CHANGED))
-                continue;
-
-            if (old_select)
-              bgp_info_unset_flag (rn, old_select, BGP_INFO_SELECTED);
-            if (new_select)
-              {
-                bgp_info_set_flag (rn, new_select, BGP_INFO_SELECTED);
-                bgp_info_unset_flag (rn, new_select, BGP_INFO_ATTR_CHANGED);
-		UNSET_FLAG (new_select->flags, BGP_INFO_MULTIPATH_CHG);
-             }
-
-            bgp_process_announce_selected (rsclient, new_select, rn,
-                                           afi, safi);
-          }
+      keys_max = MAX (n, 2 * keys_max);
+      keys = XREALLOC (MTYPE_TMP, keys,
+		       keys_max * sizeof (struct bgp_path_key));
     }
-  else
+  for (i = 0; i < n; i++)
+    if (paths[i].attr && ! BGP_INFO_HOLDDOWN (&paths[i]))
+      bgp_path_key_set (&keys[nkeys++], &paths[i], paths[i].attr);
+
+  for (i = 0; i < nkeys; i++)
+    UNSET_FLAG (keys[i].ri->flags, BGP_INFO_DMED_CHECK);
+
+  for (i = 0; i < nkeys; i++)
     {
-      if (old_select)
-	bgp_info_unset_flag (rn, old_select, BGP_INFO_SELECTED);
-      if (new_select)
-	{
-	  bgp_info_set_flag (rn, new_select, BGP_INFO_SELECTED);
-	  bgp_info_unset_flag (rn, new_select, BGP_INFO_ATTR_CHANGED);
-	  UNSET_FLAG (new_select->flags, BGP_INFO_MULTIPATH_CHG);
-	}
-      bgp_process_announce_selected (rsclient, new_select, rn, afi, safi);
+      if (CHECK_FLAG (keys[i].ri->flags, BGP_INFO_DMED_CHECK))
+	continue;
+
+      /* bgp deterministic-med: only the best path of those from the
+	 same neighbour AS goes on. */
+      best = &keys[i];
+      if (dmed)
+	for (j = i + 1; j < nkeys; j++)
+	  {
+	    if (CHECK_FLAG (keys[j].ri->flags, BGP_INFO_DMED_CHECK))
+	      continue;
+
+	    if (bgp_path_key_same_left (&keys[i], &keys[j]))
+	      {
+		SET_FLAG (keys[j].ri->flags, BGP_INFO_DMED_CHECK);
+		if (bgp_path_key_cmp (bgp, &keys[j], best, &paths_eq))
+		  best = &keys[j];
+	      }
+	  }
+
+      if (bgp_path_key_cmp (bgp, best, new_select, &paths_eq))
+	new_select = best;
     }
 
-  if (old_select && CHECK_FLAG (old_select->flags, BGP_INFO_REMOVED))
-    bgp_info_reap (rn, old_select);
-  
-  UNSET_FLAG (rn->flags, BGP_NODE_PROCESS_SCHEDULED);
-  return WQ_SUCCESS;
+  return new_select ? new_select->ri : NULL;
+}
+
+/* Copy the N paths at ALL to PATHS, with the attributes ATTRS. */
+static void
+bgp_rsclient_paths (struct bgp_info **all, struct attr **attrs, int n,
+		    struct bgp_info *paths)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    {
+      paths[i] = *all[i];
+      paths[i].attr = attrs[i];
+      paths[i].mpath = NULL;
+      UNSET_FLAG (paths[i].flags, BGP_INFO_SELECTED);
+    }
+}
+
+/* The client whose slot holds PEER's outcomes: its peer-group, for a
+   member. */
+static struct peer *
+bgp_rsclient_owner (struct peer *peer, afi_t afi, safi_t safi)
+{
+  if (peer->af_group[afi][safi] && peer->group)
+    return peer->group->conf;
+  return peer;
+}
+
+/* Announce SELECTED, a copy of path RI with the attributes the client
+   sees, to route-server client PEER. */
+static void
+bgp_process_announce_rsclient (struct peer *peer, struct bgp_info *selected,
+			       struct bgp_info *ri, struct bgp_node *rn,
+			       afi_t afi, safi_t safi)
+{
+  struct attr *sent;
+  struct attr attr;
+  struct attr_extra extra;
+
+  if (peer->status != Established)
+    return;
+
+  if (! peer->afc_nego[afi][safi])
+    return;
+
+  if (CHECK_FLAG (peer->af_sflags[afi][safi],
+      PEER_STATUS_ORF_WAIT_REFRESH))
+    return;
+
+  /* It's initialized in bgp_announce_check_rsclient() */
+  attr.extra = &extra;
+
+  if (selected
+      && bgp_announce_check_rsclient (selected, peer, &rn->p, &attr,
+				      afi, safi))
+    {
+      /* The node may have changed for other clients only. */
+      if (! bgp_adj_out_pending (rn, peer)
+	  && (sent = bgp_adj_out_attr (rn, peer)) != NULL
+	  && attrhash_cmp (sent, &attr))
+	return;
+
+      bgp_adj_out_set (rn, peer, &rn->p, &attr, afi, safi, ri);
+    }
+  else
+    bgp_adj_out_unset (rn, peer, &rn->p, afi, safi);
+}
+
+/* Clients whose policies made the same of every path of a node share
+   a selection. */
+struct bgp_rsclient_class
+{
+  struct attr **attrs;
+  int best;			/* index of the selected path, or -1 */
+};
+
+static void
+bgp_rsclient_class_select (struct bgp *bgp, struct bgp_rsclient_class *class,
+			   struct bgp_info **all, struct bgp_info *paths,
+			   int n)
+{
+  struct bgp_info *selected;
+
+  bgp_rsclient_paths (all, class->attrs, n, paths);
+  selected = bgp_rsclient_select (bgp, paths, n);
+  class->best = selected ? selected - paths : -1;
+}
+
+/* Announce the selection of CLASS to RSCLIENT, or to each member of a
+   peer-group's configuration. */
+static void
+bgp_process_rsclient_class (struct peer *rsclient,
+			    struct bgp_rsclient_class *class,
+			    struct bgp_info **all, struct bgp_node *rn,
+			    afi_t afi, safi_t safi)
+{
+  struct bgp_info selected;
+  struct bgp_info *ri = NULL;
+  struct listnode *node, *nnode;
+  struct peer *peer;
+
+  if (class->best >= 0)
+    {
+      ri = all[class->best];
+      selected = *ri;
+      selected.attr = class->attrs[class->best];
+      selected.mpath = NULL;
+    }
+
+  if (CHECK_FLAG (rsclient->sflags, PEER_STATUS_GROUP))
+    {
+      if (rsclient->group)
+	for (ALL_LIST_ELEMENTS (rsclient->group->peer, node, nnode, peer))
+	  bgp_process_announce_rsclient (peer, ri ? &selected : NULL, ri, rn,
+					 afi, safi);
+    }
+  else
+    bgp_process_announce_rsclient (rsclient, ri ? &selected : NULL, ri, rn,
+				   afi, safi);
 }
 
+struct bgp_process_queue 
+{
+  struct bgp *bgp;
+  struct bgp_node *rn;
+  afi_t afi;
+  safi_t safi;
+};
+
+/* Best-path selection runs once for the clients that see every path
+   of the node with its own attribute, and once per distinct outcome
+   of the policies of the others. */
 static wq_item_status
-bgp_process_main (struct work_queue *wq, void *data)
+bgp_process_rsclient (struct work_queue *wq, void *data)
 {
   struct bgp_process_queue *pq = data;
   struct bgp *bgp = pq->bgp;
   struct bgp_node *rn = pq->rn;
   afi_t afi = pq->afi;
   safi_t safi = pq->safi;
+  struct bgp_info *ri;
+  struct bgp_info *nextri;
+  struct bgp_info **all;
+  struct bgp_info *paths;
+  struct attr **attrs;
+  struct bgp_rsclient_class *classes;
+  struct bgp_rsclient_class *class;
+  struct bgp_info_rsclient *rsc;
+  struct listnode *node, *nnode;
+  struct peer *rsclient;
+  u_int32_t *special;
+  unsigned int words = 1;
+  unsigned int w, d;
+  int nclasses = 0;
+  int slot;
+  int n = 0;
+  int i, k;
+
+  for (ri = rn->info; ri; ri = ri->next)
+    n++;
+
+  for (ALL_LIST_ELEMENTS (bgp->rsclient, node, nnode, rsclient))
+    if (CHECK_FLAG (rsclient->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+      words = MAX (words, BGP_RSCLIENT_WORD (rsclient->rsclient_slot) + 1);
+
+  all = XMALLOC (MTYPE_TMP, (n + 1) * sizeof (struct bgp_info *));
+  attrs = XMALLOC (MTYPE_TMP, (n + 1) * sizeof (struct attr *));
+  paths = XMALLOC (MTYPE_TMP, (n + 1) * sizeof (struct bgp_info));
+  classes = XMALLOC (MTYPE_TMP, (listcount (bgp->rsclient) + 1)
+			       * sizeof (struct bgp_rsclient_class));
+  special = XCALLOC (MTYPE_TMP, words * sizeof (u_int32_t));
+
+  /* Slots for which some usable path is not as it is. */
+  i = 0;
+  for (ri = rn->info; ri; ri = ri->next)
+    {
+      all[i] = ri;
+      attrs[i] = ri->attr;
+      i++;
+
+      if (BGP_INFO_HOLDDOWN (ri))
+	continue;
+
+      /* Nor does its sender see a path. */
+      if (CHECK_FLAG (ri->peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT)
+	  && ! ri->peer->af_group[afi][safi]
+	  && BGP_RSCLIENT_WORD (ri->peer->rsclient_slot) < words)
+	special[BGP_RSCLIENT_WORD (ri->peer->rsclient_slot)]
+	  |= BGP_RSCLIENT_BIT (ri->peer->rsclient_slot);
+
+      rsc = ri->extra ? ri->extra->rsclient : NULL;
+      if (! rsc)
+	continue;
+      for (w = 0; w < rsc->denied_words && w < words; w++)
+	special[w] |= rsc->denied[w];
+      for (d = 0; d < rsc->ndelta; d++)
+	if (BGP_RSCLIENT_WORD (rsc->delta[d].slot) < words)
+	  special[BGP_RSCLIENT_WORD (rsc->delta[d].slot)]
+	    |= BGP_RSCLIENT_BIT (rsc->delta[d].slot);
+    }
+
+  /* The clients which see every path as it is. */
+  classes[0].attrs = XMALLOC (MTYPE_TMP, (n + 1) * sizeof (struct attr *));
+  memcpy (classes[0].attrs, attrs, n * sizeof (struct attr *));
+  bgp_rsclient_class_select (bgp, &classes[0], all, paths, n);
+  nclasses = 1;
+
+  for (ALL_LIST_ELEMENTS (bgp->rsclient, node, nnode, rsclient))
+    {
+      if (! CHECK_FLAG (rsclient->af_flags[afi][safi],
+			PEER_FLAG_RSERVER_CLIENT))
+	continue;
+
+      slot = rsclient->rsclient_slot;
+      class = &classes[0];
+
+      if (special[BGP_RSCLIENT_WORD (slot)] & BGP_RSCLIENT_BIT (slot))
+	{
+	  for (i = 0; i < n; i++)
+	    attrs[i] = BGP_INFO_HOLDDOWN (all[i])
+	      ? NULL : bgp_rsclient_outcome (all[i], rsclient);
+
+	  for (k = 0; k < nclasses; k++)
+	    if (! memcmp (classes[k].attrs, attrs, n * sizeof (struct attr *)))
+	      break;
+
+	  class = &classes[k];
+	  if (k == nclasses)
+	    {
+	      class->attrs = XMALLOC (MTYPE_TMP, (n + 1)
+					       * sizeof (struct attr *));
+	      memcpy (class->attrs, attrs, n * sizeof (struct attr *));
+	      bgp_rsclient_class_select (bgp, class, all, paths, n);
+	      nclasses++;
+	    }
+	}
+
+      bgp_process_rsclient_class (rsclient, class, all, rn, afi, safi);
+    }
+
+  for (ri = rn->info; (ri != NULL) && (nextri = ri->next, 1); ri = nextri)
+    {
+      bgp_info_unset_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
+      if (CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+	bgp_info_reap (rn, ri);
+    }
+
+  for (k = 0; k < nclasses; k++)
+    XFREE (MTYPE_TMP, classes[k].attrs);
+  XFREE (MTYPE_TMP, special);
+  XFREE (MTYPE_TMP, classes);
+  XFREE (MTYPE_TMP, paths);
+  XFREE (MTYPE_TMP, attrs);
+  XFREE (MTYPE_TMP, all);
+
+  UNSET_FLAG (rn->flags, BGP_NODE_PROCESS_SCHEDULED);
+  return WQ_SUCCESS;
+}
+
+/* The paths of node RN as route-server client RSCLIENT sees them:
+   copies with the attributes it sees, linked in a list, with the one
+   selected for it flagged.  Paths it does not see are left out.  The
+   copies are in the order of the paths, in BUF, to be freed with
+   XFREE (MTYPE_TMP, ...). */
+struct bgp_info *
+bgp_rsclient_view (struct peer *rsclient, struct bgp_node *rn,
+		   struct bgp_info **buf)
+{
+  struct bgp_info *ri;
+  struct bgp_info **all;
+  struct attr **attrs;
+  struct bgp_info *paths;
+  struct bgp_info *selected;
+  struct bgp_info *head = NULL;
+  struct bgp_info *prev = NULL;
+  int n = 0;
+  int i;
+
+  for (ri = rn->info; ri; ri = ri->next)
+    n++;
+
+  all = XMALLOC (MTYPE_TMP, (n + 1) * sizeof (struct bgp_info *));
+  attrs = XMALLOC (MTYPE_TMP, (n + 1) * sizeof (struct attr *));
+  paths = XMALLOC (MTYPE_TMP, (n + 1) * sizeof (struct bgp_info));
+
+  for (i = 0, ri = rn->info; ri; ri = ri->next, i++)
+    {
+      all[i] = ri;
+      attrs[i] = bgp_rsclient_outcome (ri, rsclient);
+    }
+
+  bgp_rsclient_paths (all, attrs, n, paths);
+  selected = bgp_rsclient_select (rsclient->bgp, paths, n);
+  if (selected)
+    SET_FLAG (selected->flags, BGP_INFO_SELECTED);
+
+  for (i = 0; i < n; i++)
+    {
+      if (! paths[i].attr)
+	continue;
+      paths[i].prev = prev;
+      paths[i].next = NULL;
+      if (prev)
+	prev->next = &paths[i];
+      else
+	head = &paths[i];
+      prev = &paths[i];
+    }
+
+  XFREE (MTYPE_TMP, attrs);
+  XFREE (MTYPE_TMP, all);
+
+  *buf = paths;
+  return head;
+}
+
+/* Select the best path of RN of the main table again, and pass it on
+   to the peers and zebra. */
+static void
+bgp_process_main_node (struct bgp *bgp, struct bgp_node *rn,
+		       afi_t afi, safi_t safi)
+{
   struct prefix *p = &rn->p;
   struct bgp_info *new_select;
   struct bgp_info *old_select;
@@ -1577,7 +2225,7 @@ bgp_process_main (struct work_queue *wq, void *data)
           
 	  UNSET_FLAG (old_select->flags, BGP_INFO_MULTIPATH_CHG);
           UNSET_FLAG (rn->flags, BGP_NODE_PROCESS_SCHEDULED);
-          return WQ_SUCCESS;
+          return;
         }
     }
 
@@ -1620,6 +2268,14 @@ bgp_process_main (struct work_queue *wq, void *data)
     bgp_info_reap (rn, old_select);
   
   UNSET_FLAG (rn->flags, BGP_NODE_PROCESS_SCHEDULED);
+}
+
+static wq_item_status
+bgp_process_main (struct work_queue *wq, void *data)
+{
+  struct bgp_process_queue *pq = data;
+
+  bgp_process_main_node (pq->bgp, pq->rn, pq->afi, pq->safi);
   return WQ_SUCCESS;
 }
 
@@ -1796,14 +2452,20 @@ bgp_maximum_prefix_overflow (struct peer *peer, afi_t afi,
  * damping into consideration (eg, because the session went down)
  */
 static void
-bgp_rib_remove (struct bgp_node *rn, struct bgp_info *ri, struct peer *peer,
-		afi_t afi, safi_t safi)
+bgp_rib_remove_path (struct bgp_node *rn, struct bgp_info *ri,
+		     struct peer *peer, afi_t afi, safi_t safi)
 {
   bgp_aggregate_decrement (peer->bgp, &rn->p, ri, afi, safi);
   
   if (!CHECK_FLAG (ri->flags, BGP_INFO_HISTORY))
     bgp_info_delete (rn, ri); /* keep historical info */
-    
+}
+
+static void
+bgp_rib_remove (struct bgp_node *rn, struct bgp_info *ri, struct peer *peer,
+		afi_t afi, safi_t safi)
+{
+  bgp_rib_remove_path (rn, ri, peer, afi, safi);
   bgp_process (peer->bgp, rn, afi, safi);
 }
 
@@ -1828,209 +2490,387 @@ bgp_rib_withdraw (struct bgp_node *rn, struct bgp_info *ri, struct peer *peer,
   bgp_rib_remove (rn, ri, peer, afi, safi);
 }
 
-static void
-bgp_update_rsclient (struct peer *rsclient, afi_t afi, safi_t safi,
-      struct attr *attr, struct peer *peer, struct prefix *p, int type,
-      int sub_type, struct prefix_rd *prd, u_char *tag)
+/* Whether a peer other than EXCEPT is a route-server client for
+   AFI/SAFI. */
+static int
+bgp_rsclient_configured (struct bgp *bgp, afi_t afi, safi_t safi,
+			 struct peer *except)
 {
-  struct bgp_node *rn;
-  struct bgp *bgp;
+  struct listnode *node;
+  struct peer *rsclient;
+
+  for (ALL_LIST_ELEMENTS_RO (bgp->rsclient, node, rsclient))
+    if (rsclient != except
+	&& CHECK_FLAG (rsclient->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+      return 1;
+  return 0;
+}
+
+/* What the export policy of the peer of path RI and the import policy
+   of RSCLIENT make of the path: an interned attribute, or NULL with
+   REASON if the path is denied. */
+static struct attr *
+bgp_rsclient_policy (struct peer *rsclient, struct bgp_info *ri,
+		     struct prefix *p, afi_t afi, safi_t safi,
+		     const char **reason)
+{
+  struct bgp *bgp = rsclient->bgp;
+  struct peer *peer = ri->peer;
+  struct attr *attr = ri->attr;
   struct attr new_attr;
   struct attr_extra new_extra;
   struct attr *attr_new;
   struct attr *attr_new2;
-  struct bgp_info *ri;
-  struct bgp_info *new;
-  const char *reason;
-  char buf[SU_ADDRSTRLEN];
-
-  /* Do not insert announces from a rsclient into its own 'bgp_table'. */
-  if (peer == rsclient)
-    return;
-
-  bgp = peer->bgp;
-  rn = bgp_afi_node_get (rsclient->rib[afi][safi], afi, safi, p, prd);
-
-  /* Check previously received route. */
-  for (ri = rn->info; ri; ri = ri->next)
-    if (ri->peer == peer && ri->type == type && ri->sub_type == sub_type)
-      break;
-
-  /* AS path loop check. */
-  if (aspath_loop_check (attr->aspath, rsclient->as) > peer->allowas_in[afi][safi])
-    {
-      reason = "as-path contains our own AS;";
-      goto filtered;
-    }
+  struct bgp_static *bgp_static = NULL;
+  struct bgp_node *rn;
+  struct bgp_info info;
+  int is_static;
+  int export_map;
+  int ret;
 
-  /* Route reflector originator ID check.  */
-  if (attr->flag & ATTR_FLAG_BIT (BGP_ATTR_ORIGINATOR_ID)
-      && IPV4_ADDR_SAME (&rsclient->remote_id, &attr->extra->originator_id))
-    {
-      reason = "originator is us;";
-      goto filtered;
-    }
-  
-  new_attr.extra = &new_extra;
-  bgp_attr_dup (&new_attr, attr);
+  is_static = (peer == bgp->peer_self && ri->sub_type == BGP_ROUTE_STATIC);
 
-  /* Apply export policy. */
-  if (CHECK_FLAG(peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT) &&
-        bgp_export_modifier (rsclient, peer, p, &new_attr, afi, safi) == RMAP_DENY)
+  if (is_static)
     {
-      reason = "export-policy;";
-      goto filtered;
+      rn = bgp_node_lookup (bgp->route[afi][safi], p);
+      if (rn)
+	{
+	  bgp_static = rn->info;
+	  bgp_unlock_node (rn);
+	}
+      export_map = (bgp_static && bgp_static->rmap.name);
     }
-
-  attr_new2 = bgp_attr_intern (&new_attr);
-  
-  /* Apply import policy. */
-  if (bgp_import_modifier (rsclient, peer, p, &new_attr, afi, safi) == RMAP_DENY)
+  else
     {
-      bgp_attr_unintern (&attr_new2);
-
-      reason = "import-policy;";
-      goto filtered;
-    }
-
-  attr_new = bgp_attr_intern (&new_attr);
-  bgp_attr_unintern (&attr_new2);
+      /* AS path loop check. */
+      if (aspath_loop_check (attr->aspath, rsclient->as)
+	  > peer->allowas_in[afi][safi])
+	{
+	  *reason = "as-path contains our own AS;";
+	  return NULL;
+	}
 
-  /* IPv4 unicast next hop check.  */
-  if ((afi == AFI_IP) && ((safi == SAFI_UNICAST) || safi == SAFI_MULTICAST))
-    {
-     /* Next hop must not be 0.0.0.0 nor Class D/E address. */
-      if (new_attr.nexthop.s_addr == 0
-         || IPV4_CLASS_DE (ntohl (new_attr.nexthop.s_addr)))
-       {
-         bgp_attr_unintern (&attr_new);
+      /* Route reflector originator ID check.  */
+      if (attr->flag & ATTR_FLAG_BIT (BGP_ATTR_ORIGINATOR_ID)
+	  && IPV4_ADDR_SAME (&rsclient->remote_id,
+			     &attr->extra->originator_id))
+	{
+	  *reason = "originator is us;";
+	  return NULL;
+	}
 
-         reason = "martian next-hop;";
-         goto filtered;
-       }
+      export_map = (CHECK_FLAG (peer->af_flags[afi][safi],
+				PEER_FLAG_RSERVER_CLIENT)
+		    && ROUTE_MAP_EXPORT_NAME (&peer->filter[afi][safi]));
     }
 
-  /* If the update is implicit withdraw. */
-  if (ri)
+  /* Most clients take most paths as they are. */
+  if (! export_map && ! ROUTE_MAP_IMPORT_NAME (&rsclient->filter[afi][safi]))
+    attr_new = bgp_attr_intern (attr);
+  else
     {
-      ri->uptime = bgp_clock ();
-
-      /* Same attribute comes in. */
-      if (!CHECK_FLAG(ri->flags, BGP_INFO_REMOVED)
-          && attrhash_cmp (ri->attr, attr_new))
-        {
+      new_attr.extra = &new_extra;
+      bgp_attr_dup (&new_attr, attr);
 
-          bgp_info_unset_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
+      /* Apply export policy. */
+      if (is_static && export_map)
+	{
+	  info.peer = rsclient;
+	  info.attr = &new_attr;
 
-          if (BGP_DEBUG (update, UPDATE_IN))
-            zlog (peer->log, LOG_DEBUG,
-                    "%s rcvd %s/%d for RS-client %s...duplicate ignored",
-                    peer->host,
-                    inet_ntop(p->family, &p->u.prefix, buf, SU_ADDRSTRLEN),
-                    p->prefixlen, rsclient->host);
+	  SET_FLAG (rsclient->rmap_type, PEER_RMAP_TYPE_EXPORT);
+	  SET_FLAG (rsclient->rmap_type, PEER_RMAP_TYPE_NETWORK);
 
-          bgp_unlock_node (rn);
-          bgp_attr_unintern (&attr_new);
+	  ret = route_map_apply (bgp_static->rmap.map, p, RMAP_BGP, &info);
 
-          return;
-        }
+	  rsclient->rmap_type = 0;
 
-      /* Withdraw/Announce before we fully processed the withdraw */
-      if (CHECK_FLAG(ri->flags, BGP_INFO_REMOVED))
-        bgp_info_restore (rn, ri);
-      
-      /* Received Logging. */
-      if (BGP_DEBUG (update, UPDATE_IN))
-        zlog (peer->log, LOG_DEBUG, "%s rcvd %s/%d for RS-client %s",
-                peer->host,
-                inet_ntop(p->family, &p->u.prefix, buf, SU_ADDRSTRLEN),
-                p->prefixlen, rsclient->host);
+	  if (ret == RMAP_DENYMATCH)
+	    {
+	      bgp_attr_flush (&new_attr);
+	      *reason = "network route-map;";
+	      return NULL;
+	    }
+	}
+      else if (export_map
+	       && bgp_export_modifier (rsclient, peer, p, &new_attr,
+				       afi, safi) == RMAP_DENY)
+	{
+	  *reason = "export-policy;";
+	  return NULL;
+	}
 
-      /* The attribute is changed. */
-      bgp_info_set_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
+      attr_new2 = bgp_attr_intern (&new_attr);
 
-      /* Update to new attribute.  */
-      bgp_attr_unintern (&ri->attr);
-      ri->attr = attr_new;
+      /* Apply import policy. */
+      if (is_static)
+	SET_FLAG (peer->rmap_type, PEER_RMAP_TYPE_NETWORK);
 
-      /* Update MPLS tag.  */
-      if (safi == SAFI_MPLS_VPN)
-        memcpy ((bgp_info_extra_get (ri))->tag, tag, 3);
+      ret = bgp_import_modifier (rsclient, peer, p, &new_attr, afi, safi);
 
-      bgp_info_set_flag (rn, ri, BGP_INFO_VALID);
+      peer->rmap_type = 0;
 
-      /* Process change. */
-      bgp_process (bgp, rn, afi, safi);
-      bgp_unlock_node (rn);
+      if (ret == RMAP_DENY)
+	{
+	  bgp_attr_unintern (&attr_new2);
+	  *reason = "import-policy;";
+	  return NULL;
+	}
 
-      return;
+      attr_new = bgp_attr_intern (&new_attr);
+      bgp_attr_unintern (&attr_new2);
     }
 
-  /* Received Logging. */
+  /* IPv4 unicast next hop check.  */
+  if (! is_static
+      && (afi == AFI_IP) && ((safi == SAFI_UNICAST) || safi == SAFI_MULTICAST))
+    {
+      /* Next hop must not be 0.0.0.0 nor Class D/E address. */
+      if (attr_new->nexthop.s_addr == 0
+	  || IPV4_CLASS_DE (ntohl (attr_new->nexthop.s_addr)))
+	{
+	  bgp_attr_unintern (&attr_new);
+	  *reason = "martian next-hop;";
+	  return NULL;
+	}
+    }
+
+  return attr_new;
+}
+
+static void
+bgp_rsclient_denied_log (struct peer *rsclient, struct bgp_info *ri,
+			 struct prefix *p, const char *reason)
+{
+  char buf[SU_ADDRSTRLEN];
+
   if (BGP_DEBUG (update, UPDATE_IN))
+    zlog (ri->peer->log, LOG_DEBUG,
+	  "%s rcvd UPDATE about %s/%d -- DENIED for RS-client %s due to: %s",
+	  ri->peer->host,
+	  inet_ntop (p->family, &p->u.prefix, buf, SU_ADDRSTRLEN),
+	  p->prefixlen, rsclient->host, reason);
+}
+
+/* Record what the policies of every route-server client make of path
+   RI of node RN. */
+static void
+bgp_rsclient_evaluate (struct bgp *bgp, struct bgp_node *rn,
+		       struct bgp_info *ri, afi_t afi, safi_t safi)
+{
+  static struct attr **outcome;
+  static int outcome_max;
+  struct bgp_info_rsclient *rsc;
+  struct listnode *node;
+  struct peer *rsclient;
+  struct attr *attr;
+  const char *reason;
+  int nslots = 0;
+  int ndenied = 0;
+  int ndelta = 0;
+  int i;
+
+  for (ALL_LIST_ELEMENTS_RO (bgp->rsclient, node, rsclient))
+    if (CHECK_FLAG (rsclient->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+      nslots = MAX (nslots, rsclient->rsclient_slot + 1);
+
+  if (nslots > outcome_max)
     {
-      zlog (peer->log, LOG_DEBUG, "%s rcvd %s/%d for RS-client %s",
-              peer->host,
-              inet_ntop(p->family, &p->u.prefix, buf, SU_ADDRSTRLEN),
-              p->prefixlen, rsclient->host);
+      outcome = XREALLOC (MTYPE_TMP, outcome, nslots * sizeof (struct attr *));
+      outcome_max = nslots;
     }
+  for (i = 0; i < nslots; i++)
+    outcome[i] = ri->attr;
 
-  /* Make new BGP info. */
-  new = bgp_info_new ();
-  new->type = type;
-  new->sub_type = sub_type;
-  new->peer = peer;
-  new->attr = attr_new;
-  new->uptime = bgp_clock ();
+  for (ALL_LIST_ELEMENTS_RO (bgp->rsclient, node, rsclient))
+    {
+      /* A client never sees its own paths, which needs no record. */
+      if (! CHECK_FLAG (rsclient->af_flags[afi][safi],
+			PEER_FLAG_RSERVER_CLIENT)
+	  || ri->peer == rsclient)
+	continue;
 
-  /* Update MPLS tag. */
-  if (safi == SAFI_MPLS_VPN)
-    memcpy ((bgp_info_extra_get (new))->tag, tag, 3);
+      attr = bgp_rsclient_policy (rsclient, ri, &rn->p, afi, safi, &reason);
+      if (! attr)
+	{
+	  bgp_rsclient_denied_log (rsclient, ri, &rn->p, reason);
+	  ndenied++;
+	}
+      else if (attr == ri->attr)
+	{
+	  bgp_attr_unintern (&attr);
+	  continue;
+	}
+      else
+	ndelta++;
 
-  bgp_info_set_flag (rn, new, BGP_INFO_VALID);
+      outcome[rsclient->rsclient_slot] = attr;
+    }
 
-  /* Register new BGP information. */
-  bgp_info_add (rn, new);
-  
-  /* route_node_get lock */
-  bgp_unlock_node (rn);
-  
-  /* Process change. */
-  bgp_process (bgp, rn, afi, safi);
+  if (ri->extra && ri->extra->rsclient)
+    {
+      bgp_info_rsclient_free (ri->extra->rsclient);
+      ri->extra->rsclient = NULL;
+    }
 
-  return;
+  if (! ndenied && ! ndelta)
+    return;
 
- filtered: 
+  rsc = XCALLOC (MTYPE_BGP_RSCLIENT_OUTCOME, sizeof (struct bgp_info_rsclient));
+  if (ndenied)
+    {
+      rsc->denied_words = BGP_RSCLIENT_WORD (nslots - 1) + 1;
+      rsc->denied = XCALLOC (MTYPE_BGP_RSCLIENT_OUTCOME,
+			     rsc->denied_words * sizeof (u_int32_t));
+    }
+  if (ndelta)
+    rsc->delta = XMALLOC (MTYPE_BGP_RSCLIENT_OUTCOME,
+			  ndelta * sizeof (struct bgp_rsclient_delta));
 
-  /* This BGP update is filtered.  Log the reason then update BGP entry.  */
-  if (BGP_DEBUG (update, UPDATE_IN))
-        zlog (peer->log, LOG_DEBUG,
-        "%s rcvd UPDATE about %s/%d -- DENIED for RS-client %s due to: %s",
-        peer->host,
-        inet_ntop (p->family, &p->u.prefix, buf, SU_ADDRSTRLEN),
-        p->prefixlen, rsclient->host, reason);
+  for (i = 0; i < nslots; i++)
+    if (! outcome[i])
+      rsc->denied[BGP_RSCLIENT_WORD (i)] |= BGP_RSCLIENT_BIT (i);
+    else if (outcome[i] != ri->attr)
+      {
+	rsc->delta[rsc->ndelta].slot = i;
+	rsc->delta[rsc->ndelta].attr = outcome[i];
+	rsc->ndelta++;
+      }
 
-  if (ri)
-    bgp_rib_remove (rn, ri, peer, afi, safi);
+  bgp_info_extra_get (ri)->rsclient = rsc;
+}
 
-  bgp_unlock_node (rn);
+/* Record again what the policies of RSCLIENT make of path RI of node
+   RN.  Returns whether that changed. */
+static int
+bgp_rsclient_refresh (struct peer *rsclient, struct bgp_node *rn,
+		      struct bgp_info *ri, afi_t afi, safi_t safi)
+{
+  struct attr *attr;
+  const char *reason;
 
-  return;
+  if (ri->peer == rsclient)
+    return 0;
+
+  attr = bgp_rsclient_policy (rsclient, ri, &rn->p, afi, safi, &reason);
+  if (! attr)
+    bgp_rsclient_denied_log (rsclient, ri, &rn->p, reason);
+
+  return bgp_rsclient_outcome_set (ri, rsclient->rsclient_slot, attr);
 }
 
+/* Store a path received from PEER in the route-server table, once for
+   all the route-server clients, and record what their policies make
+   of it. */
 static void
-bgp_withdraw_rsclient (struct peer *rsclient, afi_t afi, safi_t safi,
-      struct peer *peer, struct prefix *p, int type, int sub_type,
+bgp_update_rsclient (struct peer *peer, afi_t afi, safi_t safi,
+      struct attr *attr, struct prefix *p, int type, int sub_type,
       struct prefix_rd *prd, u_char *tag)
 {
   struct bgp_node *rn;
+  struct bgp *bgp;
+  struct attr new_attr;
+  struct attr_extra new_extra;
+  struct attr *attr_new;
   struct bgp_info *ri;
   char buf[SU_ADDRSTRLEN];
 
-  if (rsclient == peer)
-    return;
+  bgp = peer->bgp;
+  rn = bgp_afi_node_get (bgp->rsclient_rib[afi][safi], afi, safi, p, prd);
+
+  /* Check previously received route. */
+  for (ri = rn->info; ri; ri = ri->next)
+    if (ri->peer == peer && ri->type == type && ri->sub_type == sub_type)
+      break;
+
+  new_attr.extra = &new_extra;
+  bgp_attr_dup (&new_attr, attr);
+
+  /* Apply default weight value. */
+  if (peer->weight)
+    (bgp_attr_extra_get (&new_attr))->weight = peer->weight;
+
+  attr_new = bgp_attr_intern (&new_attr);
+
+  /* If the update is implicit withdraw. */
+  if (ri)
+    {
+      ri->uptime = bgp_clock ();
+
+      /* Same attribute comes in. */
+      if (!CHECK_FLAG(ri->flags, BGP_INFO_REMOVED)
+          && attrhash_cmp (ri->attr, attr_new))
+        {
+          bgp_info_unset_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
+
+          if (BGP_DEBUG (update, UPDATE_IN))
+            zlog (peer->log, LOG_DEBUG,
+                    "%s rcvd %s/%d for RS-clients...duplicate ignored",
+                    peer->host,
+                    inet_ntop(p->family, &p->u.prefix, buf, SU_ADDRSTRLEN),
+                    p->prefixlen);
 
-  rn = bgp_afi_node_get (rsclient->rib[afi][safi], afi, safi, p, prd);
+          bgp_unlock_node (rn);
+          bgp_attr_unintern (&attr_new);
+
+          return;
+        }
+
+      /* Withdraw/Announce before we fully processed the withdraw */
+      if (CHECK_FLAG(ri->flags, BGP_INFO_REMOVED))
+        bgp_info_restore (rn, ri);
+
+      /* The attribute is changed. */
+      bgp_info_set_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
+
+      /* Update to new attribute.  */
+      bgp_attr_unintern (&ri->attr);
+      ri->attr = attr_new;
+    }
+  else
+    {
+      /* Make new BGP info. */
+      ri = bgp_info_new ();
+      ri->type = type;
+      ri->sub_type = sub_type;
+      ri->peer = peer;
+      ri->attr = attr_new;
+      ri->uptime = bgp_clock ();
+
+      /* Register new BGP information. */
+      bgp_info_add (rn, ri);
+    }
+
+  /* Received Logging. */
+  if (BGP_DEBUG (update, UPDATE_IN))
+    zlog (peer->log, LOG_DEBUG, "%s rcvd %s/%d for RS-clients",
+            peer->host,
+            inet_ntop(p->family, &p->u.prefix, buf, SU_ADDRSTRLEN),
+            p->prefixlen);
+
+  /* Update MPLS tag.  */
+  if (safi == SAFI_MPLS_VPN)
+    memcpy ((bgp_info_extra_get (ri))->tag, tag, 3);
+
+  bgp_info_set_flag (rn, ri, BGP_INFO_VALID);
+
+  bgp_rsclient_evaluate (bgp, rn, ri, afi, safi);
+
+  /* Process change. */
+  bgp_process (bgp, rn, afi, safi);
+  bgp_unlock_node (rn);
+}
+
+static void
+bgp_withdraw_rsclient (struct peer *peer, afi_t afi, safi_t safi,
+      struct prefix *p, int type, int sub_type, struct prefix_rd *prd)
+{
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+  char buf[SU_ADDRSTRLEN];
+
+  rn = bgp_afi_node_get (peer->bgp->rsclient_rib[afi][safi], afi, safi,
+			 p, prd);
 
   /* Lookup withdrawn route. */
   for (ri = rn->info; ri; ri = ri->next)
@@ -2074,7 +2914,7 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
      Adj-RIBs-In.  */
   if (! soft_reconfig && CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_SOFT_RECONFIG)
       && peer != bgp->peer_self)
-    bgp_adj_in_set (rn, peer, attr);
+    bgp_adj_in_set (peer, afi, safi, p, prd, tag, attr);
 
   /* Check previously received route. */
   for (ri = rn->info; ri; ri = ri->next)
@@ -2377,8 +3217,6 @@ bgp_update (struct peer *peer, struct prefix *p, struct attr *attr,
             afi_t afi, safi_t safi, int type, int sub_type,
             struct prefix_rd *prd, u_char *tag, int soft_reconfig)
 {
-  struct peer *rsclient;
-  struct listnode *node, *nnode;
   struct bgp *bgp;
   int ret;
 
@@ -2387,13 +3225,9 @@ bgp_update (struct peer *peer, struct prefix *p, struct attr *attr,
 
   bgp = peer->bgp;
 
-  /* Process the update for each RS-client. */
-  for (ALL_LIST_ELEMENTS (bgp->rsclient, node, nnode, rsclient))
-    {
-      if (CHECK_FLAG (rsclient->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
-        bgp_update_rsclient (rsclient, afi, safi, attr, peer, p, type,
-                sub_type, prd, tag);
-    }
+  /* Process the update for the RS-clients. */
+  if (bgp_rsclient_configured (bgp, afi, safi, NULL))
+    bgp_update_rsclient (peer, afi, safi, attr, p, type, sub_type, prd, tag);
 
   return ret;
 }
@@ -2407,17 +3241,12 @@ bgp_withdraw (struct peer *peer, struct prefix *p, struct attr *attr,
   char buf[SU_ADDRSTRLEN];
   struct bgp_node *rn;
   struct bgp_info *ri;
-  struct peer *rsclient;
-  struct listnode *node, *nnode;
 
   bgp = peer->bgp;
 
-  /* Process the withdraw for each RS-client. */
-  for (ALL_LIST_ELEMENTS (bgp->rsclient, node, nnode, rsclient))
-    {
-      if (CHECK_FLAG (rsclient->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
-        bgp_withdraw_rsclient (rsclient, afi, safi, peer, p, type, sub_type, prd, tag);
-    }
+  /* Process the withdraw for the RS-clients. */
+  if (bgp_rsclient_configured (bgp, afi, safi, NULL))
+    bgp_withdraw_rsclient (peer, afi, safi, p, type, sub_type, prd);
 
   /* Logging. */
   if (BGP_DEBUG (update, UPDATE_IN))  
@@ -2433,7 +3262,7 @@ bgp_withdraw (struct peer *peer, struct prefix *p, struct attr *attr,
      further calculation. */
   if (CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_SOFT_RECONFIG)
       && peer != bgp->peer_self)
-    bgp_adj_in_unset (rn, peer);
+    bgp_adj_in_unset (peer, afi, safi, p, prd);
 
   /* Lookup withdrawn route. */
   for (ri = rn->info; ri; ri = ri->next)
@@ -2558,44 +3387,264 @@ bgp_default_originate (struct peer *peer, afi_t afi, safi_t safi, int withdraw)
   aspath_unintern (&aspath);
 }
 
+/* Announce to PEER what is selected at RN. */
 static void
-bgp_announce_table (struct peer *peer, afi_t afi, safi_t safi,
-                   struct bgp_table *table, int rsclient)
+bgp_announce_node (struct peer *peer, afi_t afi, safi_t safi,
+		   struct bgp_node *rn)
 {
-  struct bgp_node *rn;
   struct bgp_info *ri;
   struct attr attr;
   struct attr_extra extra;
 
-  if (! table)
-    table = (rsclient) ? peer->rib[afi][safi] : peer->bgp->rib[afi][safi];
+  /* It's initialized in bgp_announce_check() */
+  attr.extra = &extra;
 
-  if (safi != SAFI_MPLS_VPN
-      && CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_DEFAULT_ORIGINATE))
-    bgp_default_originate (peer, afi, safi, 0);
+  for (ri = rn->info; ri; ri = ri->next)
+    if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED) && ri->peer != peer)
+      {
+	if (bgp_announce_check (ri, peer, &rn->p, &attr, afi, safi))
+	  bgp_adj_out_set (rn, peer, &rn->p, &attr, afi, safi, ri);
+	else
+	  bgp_adj_out_unset (rn, peer, &rn->p, afi, safi);
+      }
+}
 
-  /* It's initialized in bgp_announce_[check|check_rsclient]() */
+/* Announce to route-server client PEER what is selected for it at RN
+   of the shared route-server table. */
+static void
+bgp_announce_node_rsclient (struct peer *peer, afi_t afi, safi_t safi,
+			    struct bgp_node *rn)
+{
+  struct bgp_info *ri;
+  struct bgp_info *view;
+  struct bgp_info *buf;
+  struct bgp_info *selected;
+  struct peer *rsclient;
+  struct attr attr;
+  struct attr_extra extra;
+  int i;
+
+  if (! rn->info)
+    return;
+
+  rsclient = bgp_rsclient_owner (peer, afi, safi);
+
+  /* It's initialized in bgp_announce_check_rsclient() */
   attr.extra = &extra;
 
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next(rn))
-    for (ri = rn->info; ri; ri = ri->next)
-      if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED) && ri->peer != peer)
+  selected = NULL;
+  for (view = bgp_rsclient_view (rsclient, rn, &buf); view;
+       view = view->next)
+    if (CHECK_FLAG (view->flags, BGP_INFO_SELECTED))
+      selected = view;
+
+  if (selected && selected->peer != peer
+      && bgp_announce_check_rsclient (selected, peer, &rn->p, &attr,
+				      afi, safi))
+    {
+      for (i = 0, ri = rn->info; i < selected - buf; i++)
+	ri = ri->next;
+      bgp_adj_out_set (rn, peer, &rn->p, &attr, afi, safi, ri);
+    }
+  else
+    bgp_adj_out_unset (rn, peer, &rn->p, afi, safi);
+
+  XFREE (MTYPE_TMP, buf);
+}
+
+/* Where a walk of the tables announcing them to a peer has got to. */
+struct bgp_announce
+{
+  /* Walking the route-server table, after the main one.  */
+  int rsclient;
+
+  /* The walk of the table has begun.  */
+  int started;
+
+  /* VPNs: the node of the route distinguisher whose table is walked,
+     and that table, both locked.  */
+  struct bgp_node *prn;
+  struct bgp_table *table;
+
+  /* Next node to announce, locked.  */
+  struct bgp_node *rn;
+};
+
+static void
+bgp_announce_free (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct bgp_announce *ann = peer->announce[afi][safi];
+
+  if (ann->rn)
+    bgp_unlock_node (ann->rn);
+  if (ann->table)
+    bgp_table_unlock (ann->table);
+  if (ann->prn)
+    bgp_unlock_node (ann->prn);
+  XFREE (MTYPE_BGP_ANNOUNCE, ann);
+  peer->announce[afi][safi] = NULL;
+}
+
+/* The next node of the VPN table PRN on, with a table of routes. */
+static struct bgp_node *
+bgp_announce_vpn_next (struct bgp_node *prn)
+{
+  while (prn && ! prn->info)
+    prn = bgp_route_next (prn);
+  return prn;
+}
+
+/* Announce the next node of the walk.  Returns 0 when it is over. */
+static int
+bgp_announce_step (struct peer *peer, afi_t afi, safi_t safi,
+		   struct bgp_announce *ann)
+{
+  struct bgp_table *rib;
+  struct bgp_node *rn;
+
+  if (! peer->afc_nego[afi][safi])
+    return 0;
+
+  while (! ann->rn)
+    {
+      rib = ann->rsclient ? peer->bgp->rsclient_rib[afi][safi]
+			  : peer->bgp->rib[afi][safi];
+
+      if (ann->table)
+	{
+	  bgp_table_unlock (ann->table);
+	  ann->table = NULL;
+	}
+
+      if (! ann->started)
 	{
-         if ( (rsclient) ?
-              (bgp_announce_check_rsclient (ri, peer, &rn->p, &attr, afi, safi))
-              : (bgp_announce_check (ri, peer, &rn->p, &attr, afi, safi)))
-	    bgp_adj_out_set (rn, peer, &rn->p, &attr, afi, safi, ri);
+	  ann->started = 1;
+	  if (safi == SAFI_MPLS_VPN)
+	    ann->prn = bgp_announce_vpn_next (bgp_table_top (rib));
 	  else
-	    bgp_adj_out_unset (rn, peer, &rn->p, afi, safi);
+	    ann->rn = bgp_table_top (rib);
 	}
+      else if (ann->prn)
+	ann->prn = bgp_announce_vpn_next (bgp_route_next (ann->prn));
+
+      if (ann->prn)
+	{
+	  ann->table = ann->prn->info;
+	  bgp_table_lock (ann->table);
+	  ann->rn = bgp_table_top (ann->table);
+	  continue;
+	}
+      if (ann->rn)
+	break;
+
+      /* Done with the table. */
+      if (ann->rsclient
+	  || ! CHECK_FLAG (peer->af_flags[afi][safi],
+			   PEER_FLAG_RSERVER_CLIENT))
+	return 0;
+      ann->rsclient = 1;
+      ann->started = 0;
+    }
+
+  rn = ann->rn;
+  if (! ann->rsclient)
+    bgp_announce_node (peer, afi, safi, rn);
+  else if (CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+    bgp_announce_node_rsclient (peer, afi, safi, rn);
+  ann->rn = bgp_route_next (rn);
+  return 1;
+}
+
+static int
+bgp_announce_walk (struct thread *thread)
+{
+  struct peer *peer;
+  afi_t afi;
+  safi_t safi;
+  int i, more;
+
+  peer = THREAD_ARG (thread);
+  peer->t_announce = NULL;
+
+  /* The address families in turn, some nodes at a time, for as long
+     as the slice lasts and the peer has room for more to send. */
+  do
+    {
+      more = 0;
+      for (afi = AFI_IP; afi < AFI_MAX; afi++)
+	for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+	  {
+	    if (! peer->announce[afi][safi]
+		|| peer->sync[afi][safi]->count >= BGP_ANNOUNCE_QUEUE_MAX)
+	      continue;
+
+	    for (i = 0; i < BGP_ANNOUNCE_NODES; i++)
+	      if (! bgp_announce_step (peer, afi, safi,
+				       peer->announce[afi][safi]))
+		{
+		  bgp_announce_free (peer, afi, safi);
+		  break;
+		}
+	    if (peer->announce[afi][safi])
+	      more = 1;
+	  }
+    }
+  while (more && ! thread_should_yield (thread));
+
+  /* Carry on after the event loop has had a turn, if it was the slice
+     that ran out rather than room; bgp_write() picks up after that. */
+  if (more)
+    peer->t_announce = thread_add_background (bm->master, bgp_announce_walk,
+					      peer, 0);
+
+  /* What was queued, and the end-of-RIB once done. */
+  BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+  return 0;
 }
 
+/* Carry on announcing the tables to PEER, as its queue drains. */
 void
-bgp_announce_route (struct peer *peer, afi_t afi, safi_t safi)
+bgp_announce_resume (struct peer *peer)
 {
-  struct bgp_node *rn;
-  struct bgp_table *table;
+  afi_t afi;
+  safi_t safi;
+
+  if (peer->t_announce)
+    return;
 
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      if (peer->announce[afi][safi]
+	  && peer->sync[afi][safi]->count < BGP_ANNOUNCE_QUEUE_MAX / 2)
+	{
+	  peer->t_announce = thread_add_background (bm->master,
+						    bgp_announce_walk,
+						    peer, 0);
+	  return;
+	}
+}
+
+/* Stop announcing the tables to PEER, as the session goes down. */
+void
+bgp_announce_route_cancel (struct peer *peer)
+{
+  afi_t afi;
+  safi_t safi;
+
+  THREAD_OFF (peer->t_announce);
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      if (peer->announce[afi][safi])
+	bgp_announce_free (peer, afi, safi);
+}
+
+/* Announce the tables of an address family to PEER.  The tables are
+   walked in the background, no more at a time than keeps the peer's
+   output going, rather than queueing an advertisement for each route
+   at once.  Announcing afresh starts the walk over. */
+void
+bgp_announce_route (struct peer *peer, afi_t afi, safi_t safi)
+{
   if (peer->status != Established)
     return;
 
@@ -2606,16 +3655,18 @@ bgp_announce_route (struct peer *peer, afi_t afi, safi_t safi)
   if (CHECK_FLAG (peer->af_sflags[afi][safi], PEER_STATUS_ORF_WAIT_REFRESH))
     return;
 
-  if (safi != SAFI_MPLS_VPN)
-    bgp_announce_table (peer, afi, safi, NULL, 0);
-  else
-    for (rn = bgp_table_top (peer->bgp->rib[afi][safi]); rn;
-	 rn = bgp_route_next(rn))
-      if ((table = (rn->info)) != NULL)
-       bgp_announce_table (peer, afi, safi, table, 0);
+  if (safi != SAFI_MPLS_VPN
+      && CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_DEFAULT_ORIGINATE))
+    bgp_default_originate (peer, afi, safi, 0);
 
-  if (CHECK_FLAG(peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
-    bgp_announce_table (peer, afi, safi, NULL, 1);
+  if (peer->announce[afi][safi])
+    bgp_announce_free (peer, afi, safi);
+  peer->announce[afi][safi] = XCALLOC (MTYPE_BGP_ANNOUNCE,
+				       sizeof (struct bgp_announce));
+
+  if (! peer->t_announce)
+    peer->t_announce = thread_add_background (bm->master, bgp_announce_walk,
+					      peer, 0);
 }
 
 void
@@ -2628,115 +3679,90 @@ bgp_announce_route_all (struct peer *peer)
     for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
       bgp_announce_route (peer, afi, safi);
 }
-
+
 static void
 bgp_soft_reconfig_table_rsclient (struct peer *rsclient, afi_t afi,
-        safi_t safi, struct bgp_table *table, struct prefix_rd *prd)
+        safi_t safi, struct bgp_table *rstable)
 {
   struct bgp_node *rn;
-  struct bgp_adj_in *ain;
-
-  if (! table)
-    table = rsclient->bgp->rib[afi][safi];
+  struct bgp_info *ri;
 
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
-    for (ain = rn->adj_in; ain; ain = ain->next)
+  /* What the client's policies make of every path, and what it is to
+     be sent, may have changed. */
+  for (rn = bgp_table_top (rstable); rn; rn = bgp_route_next (rn))
+    if (rn->info)
       {
-        struct bgp_info *ri = rn->info;
-        u_char *tag = (ri && ri->extra) ? ri->extra->tag : NULL;
-
-        bgp_update_rsclient (rsclient, afi, safi, ain->attr, ain->peer,
-                &rn->p, ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, prd, tag);
+        for (ri = rn->info; ri; ri = ri->next)
+          bgp_rsclient_refresh (rsclient, rn, ri, afi, safi);
+        bgp_process (rsclient->bgp, rn, afi, safi);
       }
 }
 
 void
 bgp_soft_reconfig_rsclient (struct peer *rsclient, afi_t afi, safi_t safi)
 {
-  struct bgp_table *table;
+  struct bgp *bgp = rsclient->bgp;
   struct bgp_node *rn;
-  
-  if (safi != SAFI_MPLS_VPN)
-    bgp_soft_reconfig_table_rsclient (rsclient, afi, safi, NULL, NULL);
-
-  else
-    for (rn = bgp_table_top (rsclient->bgp->rib[afi][safi]); rn;
-            rn = bgp_route_next (rn))
-      if ((table = rn->info) != NULL)
-        {
-          struct prefix_rd prd;
-          prd.family = AF_UNSPEC;
-          prd.prefixlen = 64;
-          memcpy(&prd.val, rn->p.u.val, 8);
-
-          bgp_soft_reconfig_table_rsclient (rsclient, afi, safi, table, &prd);
-        }
-}
-
-static void
-bgp_soft_reconfig_table (struct peer *peer, afi_t afi, safi_t safi,
-			 struct bgp_table *table, struct prefix_rd *prd)
-{
-  int ret;
-  struct bgp_node *rn;
-  struct bgp_adj_in *ain;
-
-  if (! table)
-    table = peer->bgp->rib[afi][safi];
+  struct listnode *node, *nnode;
+  struct peer *peer;
+  struct prefix p;
+  struct prefix_rd prd;
+  struct attr *attr;
+  u_char *tag;
+  u_int32_t i;
 
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
-    for (ain = rn->adj_in; ain; ain = ain->next)
+  /* Paths received before the first client was configured are only
+     in the adj-in of peers with soft-reconfiguration. */
+  for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
+    for (i = 0; peer->adj_in[afi][safi] && i < peer->adj_in[afi][safi]->count;
+         i++)
       {
-	if (ain->peer == peer)
-	  {
-	    struct bgp_info *ri = rn->info;
-	    u_char *tag = (ri && ri->extra) ? ri->extra->tag : NULL;
-
-	    ret = bgp_update (peer, &rn->p, ain->attr, afi, safi,
-			      ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL,
-			      prd, tag, 1);
-
-	    if (ret < 0)
-	      {
-		bgp_unlock_node (rn);
-		return;
-	      }
-	    continue;
-	  }
+        attr = bgp_adj_in_get (peer->adj_in[afi][safi], i, &p, &prd, &tag);
+        bgp_update_rsclient (peer, afi, safi, attr, &p,
+                ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, &prd, tag);
       }
+
+  if (safi != SAFI_MPLS_VPN)
+    bgp_soft_reconfig_table_rsclient (rsclient, afi, safi,
+                                      bgp->rsclient_rib[afi][safi]);
+  else
+    for (rn = bgp_table_top (bgp->rsclient_rib[afi][safi]); rn;
+            rn = bgp_route_next (rn))
+      if (rn->info)
+        bgp_soft_reconfig_table_rsclient (rsclient, afi, safi, rn->info);
 }
 
 void
 bgp_soft_reconfig_in (struct peer *peer, afi_t afi, safi_t safi)
 {
-  struct bgp_node *rn;
-  struct bgp_table *table;
+  int ret;
+  struct prefix p;
+  struct prefix_rd prd;
+  struct attr *attr;
+  u_char *tag;
+  u_char label[3];
+  u_int32_t i;
 
   if (peer->status != Established)
     return;
 
-  if (safi != SAFI_MPLS_VPN)
-    bgp_soft_reconfig_table (peer, afi, safi, NULL, NULL);
-  else
-    for (rn = bgp_table_top (peer->bgp->rib[afi][safi]); rn;
-	 rn = bgp_route_next (rn))
-      if ((table = rn->info) != NULL)
-        {
-          struct prefix_rd prd;
-          prd.family = AF_UNSPEC;
-          prd.prefixlen = 64;
-          memcpy(&prd.val, rn->p.u.val, 8);
+  /* Stream through the routes as received, in no particular order.
+     Updating may reset the peer and with it the routes kept. */
+  for (i = 0; peer->adj_in[afi][safi] && i < peer->adj_in[afi][safi]->count;
+       i++)
+    {
+      attr = bgp_adj_in_get (peer->adj_in[afi][safi], i, &p, &prd, &tag);
+      memcpy (label, tag, sizeof (label));
 
-          bgp_soft_reconfig_table (peer, afi, safi, table, &prd);
-        }
+      ret = bgp_update (peer, &p, attr, afi, safi,
+			ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL,
+			safi == SAFI_MPLS_VPN ? &prd : NULL,
+			safi == SAFI_MPLS_VPN ? label : NULL, 1);
+      if (ret < 0)
+	return;
+    }
 }
-
 
-struct bgp_clear_node_queue
-{
-  struct bgp_node *rn;
-  enum bgp_clear_route_type purpose;
-};
 
 static wq_item_status
 bgp_clear_route_node (struct work_queue *wq, void *data)
@@ -2751,7 +3777,7 @@ bgp_clear_route_node (struct work_queue *wq, void *data)
   assert (rn && peer);
   
   for (ri = rn->info; ri; ri = ri->next)
-    if (ri->peer == peer || cnq->purpose == BGP_CLEAR_ROUTE_MY_RSCLIENT)
+    if (ri->peer == peer)
       {
         /* graceful restart STALE flag set. */
         if (CHECK_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT)
@@ -2760,7 +3786,16 @@ bgp_clear_route_node (struct work_queue *wq, void *data)
             && ! CHECK_FLAG (ri->flags, BGP_INFO_UNUSEABLE))
           bgp_info_set_flag (rn, ri, BGP_INFO_STALE);
         else
-          bgp_rib_remove (rn, ri, peer, afi, safi);
+          {
+            bgp_rib_remove_path (rn, ri, peer, afi, safi);
+            /* Select again in this pass, rather than queue the node
+               for another. */
+            if (bgp_node_table (rn)->type == BGP_TABLE_MAIN
+                && ! CHECK_FLAG (rn->flags, BGP_NODE_PROCESS_SCHEDULED))
+              bgp_process_main_node (peer->bgp, rn, afi, safi);
+            else
+              bgp_process (peer->bgp, rn, afi, safi);
+          }
         break;
       }
   return WQ_SUCCESS;
@@ -2812,16 +3847,22 @@ bgp_clear_node_queue_init (struct peer *peer)
   peer->clear_node_queue->spec.data = peer;
 }
 
+/* Queue the nodes of TABLE with a path of PEER to be cleared.  Those
+   where the path is the selected one come first, so that traffic moves
+   off the peer as soon as can be; the others, where clearing changes
+   nothing forwarded, go on LATER, for the queue once all tables to be
+   cleared have been walked. */
 static void
 bgp_clear_route_table (struct peer *peer, afi_t afi, safi_t safi,
-                       struct bgp_table *table, struct peer *rsclient,
-                       enum bgp_clear_route_type purpose)
+                       struct bgp_table *table,
+                       enum bgp_clear_route_type purpose,
+                       struct list *later)
 {
   struct bgp_node *rn;
   
   
   if (! table)
-    table = (rsclient) ? rsclient->rib[afi][safi] : peer->bgp->rib[afi][safi];
+    table = peer->bgp->rib[afi][safi];
   
   /* If still no table => afi/safi isn't configured at all or smth. */
   if (! table)
@@ -2830,8 +3871,6 @@ bgp_clear_route_table (struct peer *peer, afi_t afi, safi_t safi,
   for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
     {
       struct bgp_info *ri;
-      struct bgp_adj_in *ain;
-      struct bgp_adj_out *aout;
 
       /* XXX:TODO: This is suboptimal, every non-empty route_node is
        * queued for every clearing peer, regardless of whether it is
@@ -2841,7 +3880,8 @@ bgp_clear_route_table (struct peer *peer, afi_t afi, safi_t safi,
        * scrubbed, potentially, when a peer is removed:
        *
        * 1 peer's routes visible via the RIB (ie accepted routes)
-       * 2 peer's routes visible by the (optional) peer's adj-in index
+       * 2 peer's routes kept by the (optional) peer's adj-in store,
+       *   which is dropped as a whole in bgp_clear_route
        * 3 other routes visible by the peer's adj-out index
        *
        * 3 there is no hurry in scrubbing, once the struct peer is
@@ -2864,23 +3904,11 @@ bgp_clear_route_table (struct peer *peer, afi_t afi, safi_t safi,
        * this may actually be achievable. It doesn't seem to be a huge
        * problem at this time,
        */
-      for (ain = rn->adj_in; ain; ain = ain->next)
-        if (ain->peer == peer || purpose == BGP_CLEAR_ROUTE_MY_RSCLIENT)
-          {
-            bgp_adj_in_remove (rn, ain);
-            bgp_unlock_node (rn);
-            break;
-          }
-      for (aout = rn->adj_out; aout; aout = aout->next)
-        if (aout->peer == peer || purpose == BGP_CLEAR_ROUTE_MY_RSCLIENT)
-          {
-            bgp_adj_out_remove (rn, aout, peer, afi, safi);
-            bgp_unlock_node (rn);
-            break;
-          }
+      if (bgp_adj_out_remove (rn, peer, afi, safi))
+        bgp_unlock_node (rn);
 
       for (ri = rn->info; ri; ri = ri->next)
-        if (ri->peer == peer || purpose == BGP_CLEAR_ROUTE_MY_RSCLIENT)
+        if (ri->peer == peer)
           {
             struct bgp_clear_node_queue *cnq;
 
@@ -2891,22 +3919,19 @@ bgp_clear_route_table (struct peer *peer, afi_t afi, safi_t safi,
                            sizeof (struct bgp_clear_node_queue));
             cnq->rn = rn;
             cnq->purpose = purpose;
-            work_queue_add (peer->clear_node_queue, cnq);
+            if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED))
+              work_queue_add (peer->clear_node_queue, cnq);
+            else
+              listnode_add (later, cnq);
             break;
           }
     }
   return;
 }
 
-void
-bgp_clear_route (struct peer *peer, afi_t afi, safi_t safi,
-                 enum bgp_clear_route_type purpose)
+static void
+bgp_clear_route_start (struct peer *peer)
 {
-  struct bgp_node *rn;
-  struct bgp_table *table;
-  struct peer *rsclient;
-  struct listnode *node, *nnode;
-
   if (peer->clear_node_queue == NULL)
     bgp_clear_node_queue_init (peer);
   
@@ -2924,32 +3949,56 @@ bgp_clear_route (struct peer *peer, afi_t afi, safi_t safi,
    */
   if (!peer->clear_node_queue->thread)
     peer_lock (peer); /* bgp_clear_node_complete */
+}
+
+/* Walk the tables of AFI/SAFI for the nodes with a path of PEER. */
+static void
+bgp_clear_route_walk (struct peer *peer, afi_t afi, safi_t safi,
+                      enum bgp_clear_route_type purpose, struct list *later)
+{
+  struct bgp_node *rn;
+  struct bgp_table *table;
 
   switch (purpose)
     {
     case BGP_CLEAR_ROUTE_NORMAL:
+      bgp_adj_in_finish (&peer->adj_in[afi][safi]);
       if (safi != SAFI_MPLS_VPN)
-        bgp_clear_route_table (peer, afi, safi, NULL, NULL, purpose);
+        {
+          bgp_clear_route_table (peer, afi, safi, NULL, purpose, later);
+          bgp_clear_route_table (peer, afi, safi,
+                                 peer->bgp->rsclient_rib[afi][safi], purpose,
+                                 later);
+        }
       else
-        for (rn = bgp_table_top (peer->bgp->rib[afi][safi]); rn;
-             rn = bgp_route_next (rn))
-          if ((table = rn->info) != NULL)
-            bgp_clear_route_table (peer, afi, safi, table, NULL, purpose);
-
-      for (ALL_LIST_ELEMENTS (peer->bgp->rsclient, node, nnode, rsclient))
-        if (CHECK_FLAG(rsclient->af_flags[afi][safi],
-                       PEER_FLAG_RSERVER_CLIENT))
-          bgp_clear_route_table (peer, afi, safi, NULL, rsclient, purpose);
-      break;
-
-    case BGP_CLEAR_ROUTE_MY_RSCLIENT:
-      bgp_clear_route_table (peer, afi, safi, NULL, peer, purpose);
+        {
+          for (rn = bgp_table_top (peer->bgp->rib[afi][safi]); rn;
+               rn = bgp_route_next (rn))
+            if ((table = rn->info) != NULL)
+              bgp_clear_route_table (peer, afi, safi, table, purpose, later);
+          for (rn = bgp_table_top (peer->bgp->rsclient_rib[afi][safi]); rn;
+               rn = bgp_route_next (rn))
+            if ((table = rn->info) != NULL)
+              bgp_clear_route_table (peer, afi, safi, table, purpose, later);
+        }
       break;
 
     default:
       assert (0);
       break;
     }
+}
+
+/* Queue the nodes the walks put off, after all the others. */
+static void
+bgp_clear_route_finish (struct peer *peer, struct list *later)
+{
+  struct listnode *node;
+  struct bgp_clear_node_queue *cnq;
+
+  for (ALL_LIST_ELEMENTS_RO (later, node, cnq))
+    work_queue_add (peer->clear_node_queue, cnq);
+  list_delete (later);
   
   /* If no routes were cleared, nothing was added to workqueue, the
    * completion function won't be run by workqueue code - call it here. 
@@ -2973,58 +4022,153 @@ bgp_clear_route (struct peer *peer, afi_t afi, safi_t safi,
   if (!peer->clear_node_queue->thread)
     bgp_clear_node_complete (peer->clear_node_queue);
 }
-  
+
+void
+bgp_clear_route (struct peer *peer, afi_t afi, safi_t safi,
+                 enum bgp_clear_route_type purpose)
+{
+  struct list *later;
+
+  bgp_clear_route_start (peer);
+  later = list_new ();
+  bgp_clear_route_walk (peer, afi, safi, purpose, later);
+  bgp_clear_route_finish (peer, later);
+}
+
+/* Clear the routes of PEER in all families, those where its paths are
+   not selected only after those where they are, in any family. */
 void
 bgp_clear_route_all (struct peer *peer)
 {
+  struct list *later;
   afi_t afi;
   safi_t safi;
 
+  bgp_clear_route_start (peer);
+  later = list_new ();
   for (afi = AFI_IP; afi < AFI_MAX; afi++)
     for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
-      bgp_clear_route (peer, afi, safi, BGP_CLEAR_ROUTE_NORMAL);
+      bgp_clear_route_walk (peer, afi, safi, BGP_CLEAR_ROUTE_NORMAL, later);
+  bgp_clear_route_finish (peer, later);
 }
 
 void
 bgp_clear_adj_in (struct peer *peer, afi_t afi, safi_t safi)
 {
-  struct bgp_table *table;
+  bgp_adj_in_finish (&peer->adj_in[afi][safi]);
+}
+
+void
+bgp_clear_stale_route (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+  struct bgp_table *table;
+  int i;
+
+  for (i = 0; i < 2; i++)
+    {
+      table = i ? peer->bgp->rsclient_rib[afi][safi] : peer->bgp->rib[afi][safi];
+
+      for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+	{
+	  for (ri = rn->info; ri; ri = ri->next)
+	    if (ri->peer == peer)
+	      {
+		if (CHECK_FLAG (ri->flags, BGP_INFO_STALE))
+		  bgp_rib_remove (rn, ri, peer, afi, safi);
+		break;
+	      }
+	}
+    }
+}
+
+/* Lowest slot of route-server client outcomes free in BGP. */
+int
+bgp_rsclient_slot_new (struct bgp *bgp)
+{
+  struct listnode *node;
+  struct peer *rsclient;
+  int slot;
+
+  for (slot = 0; ; slot++)
+    {
+      for (ALL_LIST_ELEMENTS_RO (bgp->rsclient, node, rsclient))
+	if (rsclient->rsclient_slot == slot)
+	  break;
+      if (! node)
+	return slot;
+    }
+}
+
+static void
+bgp_clear_rsclient_table (struct peer *peer, afi_t afi, safi_t safi,
+			  struct bgp_table *table, int last)
+{
   struct bgp_node *rn;
-  struct bgp_adj_in *ain;
-
-  table = peer->bgp->rib[afi][safi];
+  struct bgp_info *ri;
+  struct bgp_info *next;
+  struct bgp_info_rsclient *rsc;
+  unsigned int i;
+  int slot = peer->rsclient_slot;
 
   for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
-    for (ain = rn->adj_in; ain ; ain = ain->next)
-      if (ain->peer == peer)
+    {
+      if (bgp_adj_out_remove (rn, peer, afi, safi))
+	bgp_unlock_node (rn);
+
+      for (ri = rn->info; ri; ri = next)
 	{
-          bgp_adj_in_remove (rn, ain);
-          bgp_unlock_node (rn);
-          break;
+	  next = ri->next;
+
+	  if (last)
+	    {
+	      bgp_info_delete (rn, ri);
+	      bgp_process (peer->bgp, rn, afi, safi);
+	      continue;
+	    }
+
+	  rsc = ri->extra ? ri->extra->rsclient : NULL;
+	  if (! rsc)
+	    continue;
+
+	  if (bgp_rsclient_denied (rsc, slot))
+	    rsc->denied[BGP_RSCLIENT_WORD (slot)] &= ~BGP_RSCLIENT_BIT (slot);
+	  i = bgp_rsclient_delta_find (rsc, slot);
+	  if (i < rsc->ndelta && rsc->delta[i].slot == slot)
+	    bgp_rsclient_delta_remove (rsc, i);
+	  bgp_rsclient_outcome_trim (ri);
 	}
+    }
 }
 
+/* Forget what the policies of PEER made of the paths of the shared
+   route-server table, and what was sent to it, as it stops being a
+   route-server client on its own.  The paths go with the last
+   client. */
 void
-bgp_clear_stale_route (struct peer *peer, afi_t afi, safi_t safi)
+bgp_clear_rsclient (struct peer *peer, afi_t afi, safi_t safi)
 {
+  struct bgp *bgp = peer->bgp;
   struct bgp_node *rn;
-  struct bgp_info *ri;
   struct bgp_table *table;
+  int last;
 
-  table = peer->bgp->rib[afi][safi];
+  if (! bgp || ! bgp->rsclient_rib[afi][safi])
+    return;
 
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
-    {
-      for (ri = rn->info; ri; ri = ri->next)
-	if (ri->peer == peer)
-	  {
-	    if (CHECK_FLAG (ri->flags, BGP_INFO_STALE))
-	      bgp_rib_remove (rn, ri, peer, afi, safi);
-	    break;
-	  }
-    }
+  last = ! bgp_rsclient_configured (bgp, afi, safi, peer);
+
+  if (safi != SAFI_MPLS_VPN)
+    bgp_clear_rsclient_table (peer, afi, safi, bgp->rsclient_rib[afi][safi],
+			      last);
+  else
+    for (rn = bgp_table_top (bgp->rsclient_rib[afi][safi]); rn;
+	 rn = bgp_route_next (rn))
+      if ((table = rn->info) != NULL)
+	bgp_clear_rsclient_table (peer, afi, safi, table, last);
 }
-
+
 /* Delete all kernel routes. */
 void
 bgp_cleanup_routes (void)
@@ -3244,13 +4388,15 @@ bgp_static_free (struct bgp_static *bgp_static)
 }
 
 static void
-bgp_static_withdraw_rsclient (struct bgp *bgp, struct peer *rsclient,
-        struct prefix *p, afi_t afi, safi_t safi)
+bgp_static_withdraw_rsclient (struct bgp *bgp, struct prefix *p,
+			      afi_t afi, safi_t safi)
 {
   struct bgp_node *rn;
   struct bgp_info *ri;
 
-  rn = bgp_afi_node_get (rsclient->rib[afi][safi], afi, safi, p, NULL);
+  rn = bgp_node_lookup (bgp->rsclient_rib[afi][safi], p);
+  if (! rn)
+    return;
 
   /* Check selected route and self inserted route. */
   for (ri = rn->info; ri; ri = ri->next)
@@ -3270,30 +4416,24 @@ bgp_static_withdraw_rsclient (struct bgp *bgp, struct peer *rsclient,
   bgp_unlock_node (rn);
 }
 
+/* Store network P in the route-server table, once for all the
+   route-server clients, and record again what their policies make of
+   it: the network's route-map may have changed too. */
 static void
-bgp_static_update_rsclient (struct peer *rsclient, struct prefix *p,
+bgp_static_update_rsclient (struct bgp *bgp, struct prefix *p,
                             struct bgp_static *bgp_static,
                             afi_t afi, safi_t safi)
 {
   struct bgp_node *rn;
   struct bgp_info *ri;
-  struct bgp_info *new;
-  struct bgp_info info;
   struct attr *attr_new;
   struct attr attr;
-  struct attr new_attr;
-  struct attr_extra new_extra;
-  struct bgp *bgp;
-  int ret;
-  char buf[SU_ADDRSTRLEN];
-
-  bgp = rsclient->bgp;
 
   assert (bgp_static);
   if (!bgp_static)
     return;
 
-  rn = bgp_afi_node_get (rsclient->rib[afi][safi], afi, safi, p, NULL);
+  rn = bgp_afi_node_get (bgp->rsclient_rib[afi][safi], afi, safi, p, NULL);
 
   bgp_attr_default_set (&attr, BGP_ORIGIN_IGP);
 
@@ -3303,68 +4443,8 @@ bgp_static_update_rsclient (struct peer *rsclient, struct prefix *p,
   
   if (bgp_static->atomic)
     attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_ATOMIC_AGGREGATE);
-  
-  /* Apply network route-map for export to this rsclient. */
-  if (bgp_static->rmap.name)
-    {
-      struct attr attr_tmp = attr;
-      info.peer = rsclient;
-      info.attr = &attr_tmp;
-      
-      SET_FLAG (rsclient->rmap_type, PEER_RMAP_TYPE_EXPORT);
-      SET_FLAG (rsclient->rmap_type, PEER_RMAP_TYPE_NETWORK);
-
-      ret = route_map_apply (bgp_static->rmap.map, p, RMAP_BGP, &info);
-
-      rsclient->rmap_type = 0;
-
-      if (ret == RMAP_DENYMATCH)
-        {
-          /* Free uninterned attribute. */
-          bgp_attr_flush (&attr_tmp);
-
-          /* Unintern original. */
-          aspath_unintern (&attr.aspath);
-          bgp_static_withdraw_rsclient (bgp, rsclient, p, afi, safi);
-          bgp_attr_extra_free (&attr);
-          
-          return;
-        }
-      attr_new = bgp_attr_intern (&attr_tmp);
-    }
-  else
-    attr_new = bgp_attr_intern (&attr);
-
-  new_attr.extra = &new_extra;
-  bgp_attr_dup(&new_attr, attr_new);
-  
-  SET_FLAG (bgp->peer_self->rmap_type, PEER_RMAP_TYPE_NETWORK);
-
-  if (bgp_import_modifier (rsclient, bgp->peer_self, p, &new_attr, afi, safi) 
-        == RMAP_DENY)
-    {
-      /* This BGP update is filtered.  Log the reason then update BGP entry.  */
-      if (BGP_DEBUG (update, UPDATE_IN))
-              zlog (rsclient->log, LOG_DEBUG,
-              "Static UPDATE about %s/%d -- DENIED for RS-client %s due to: import-policy",
-              inet_ntop (p->family, &p->u.prefix, buf, SU_ADDRSTRLEN),
-              p->prefixlen, rsclient->host);
-
-      bgp->peer_self->rmap_type = 0;
-
-      bgp_attr_unintern (&attr_new);
-      aspath_unintern (&attr.aspath);
-      bgp_attr_extra_free (&attr);
-
-      bgp_static_withdraw_rsclient (bgp, rsclient, p, afi, safi);
-      
-      return;
-    }
 
-  bgp->peer_self->rmap_type = 0;
-
-  bgp_attr_unintern (&attr_new);
-  attr_new = bgp_attr_intern (&new_attr);
+  attr_new = bgp_attr_intern (&attr);
 
   for (ri = rn->info; ri; ri = ri->next)
     if (ri->peer == bgp->peer_self && ri->type == ZEBRA_ROUTE_BGP
@@ -3372,16 +4452,10 @@ bgp_static_update_rsclient (struct peer *rsclient, struct prefix *p,
       break;
 
   if (ri)
-       {
+    {
       if (attrhash_cmp (ri->attr, attr_new) &&
 	  !CHECK_FLAG(ri->flags, BGP_INFO_REMOVED))
-        {
-          bgp_unlock_node (rn);
-          bgp_attr_unintern (&attr_new);
-          aspath_unintern (&attr.aspath);
-          bgp_attr_extra_free (&attr);
-          return;
-       }
+	bgp_attr_unintern (&attr_new);
       else
         {
           /* The attribute is changed. */
@@ -3393,34 +4467,31 @@ bgp_static_update_rsclient (struct peer *rsclient, struct prefix *p,
           bgp_attr_unintern (&ri->attr);
           ri->attr = attr_new;
           ri->uptime = bgp_clock ();
-
-          /* Process change. */
-          bgp_process (bgp, rn, afi, safi);
-          bgp_unlock_node (rn);
-          aspath_unintern (&attr.aspath);
-          bgp_attr_extra_free (&attr);
-          return;
         }
     }
-  
-  /* Make new BGP info. */
-  new = bgp_info_new ();
-  new->type = ZEBRA_ROUTE_BGP;
-  new->sub_type = BGP_ROUTE_STATIC;
-  new->peer = bgp->peer_self;
-  SET_FLAG (new->flags, BGP_INFO_VALID);
-  new->attr = attr_new;
-  new->uptime = bgp_clock ();
+  else
+    {
+      /* Make new BGP info. */
+      ri = bgp_info_new ();
+      ri->type = ZEBRA_ROUTE_BGP;
+      ri->sub_type = BGP_ROUTE_STATIC;
+      ri->peer = bgp->peer_self;
+      SET_FLAG (ri->flags, BGP_INFO_VALID);
+      ri->attr = attr_new;
+      ri->uptime = bgp_clock ();
+
+      /* Register new BGP information. */
+      bgp_info_add (rn, ri);
+    }
+
+  bgp_rsclient_evaluate (bgp, rn, ri, afi, safi);
 
-  /* Register new BGP information. */
-  bgp_info_add (rn, new);
-  
-  /* route_node_get lock */
-  bgp_unlock_node (rn);
-  
   /* Process change. */
   bgp_process (bgp, rn, afi, safi);
 
+  /* route_node_get lock */
+  bgp_unlock_node (rn);
+
   /* Unintern original. */
   aspath_unintern (&attr.aspath);
   bgp_attr_extra_free (&attr);
@@ -3552,16 +4623,10 @@ void
 bgp_static_update (struct bgp *bgp, struct prefix *p,
                   struct bgp_static *bgp_static, afi_t afi, safi_t safi)
 {
-  struct peer *rsclient;
-  struct listnode *node, *nnode;
-
   bgp_static_update_main (bgp, p, bgp_static, afi, safi);
 
-  for (ALL_LIST_ELEMENTS (bgp->rsclient, node, nnode, rsclient))
-    {
-      if (CHECK_FLAG (rsclient->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
-        bgp_static_update_rsclient (rsclient, p, bgp_static, afi, safi);
-    }
+  if (bgp_rsclient_configured (bgp, afi, safi, NULL))
+    bgp_static_update_rsclient (bgp, p, bgp_static, afi, safi);
 }
 
 static void
@@ -3623,6 +4688,8 @@ bgp_static_withdraw (struct bgp *bgp, struct prefix *p, afi_t afi,
 
   /* Unlock bgp_node_lookup. */
   bgp_unlock_node (rn);
+
+  bgp_static_withdraw_rsclient (bgp, p, afi, safi);
 }
 
 void
@@ -3640,8 +4707,7 @@ bgp_check_local_routes_rsclient (struct peer *rsclient, afi_t afi, safi_t safi)
       {
         p = &rn->p;
 
-        bgp_static_update_rsclient (rsclient, p, bgp_static,
-                afi, safi);
+        bgp_static_update_rsclient (bgp, p, bgp_static, afi, safi);
       }
 }
 
@@ -4475,51 +5541,322 @@ struct bgp_aggregate
   /* Route-map for aggregated route. */
   struct route_map *map;
 
-  /* Suppress-count. */
+  /* Number of contributing routes. */
   unsigned long count;
 
   /* SAFI configuration. */
   safi_t safi;
+
+  /* Contributing routes, each with the attribute it was counted
+     with. */
+  struct hash *routes;
+
+  /* For as-set, the number of contributing routes with each origin,
+     each AS path and each community value, so that a route coming or
+     going only updates its own share. */
+  unsigned long origin[BGP_ORIGIN_INCOMPLETE + 1];
+  struct hash *aspaths;
+  struct hash *communities;
+
+  /* The aggregate route must be made again. */
+  int changed;
+};
+
+/* A route counted in an aggregate. */
+struct bgp_aggregate_route
+{
+  struct bgp_info *ri;
+  struct attr *attr;
+};
+
+/* An AS path of contributing routes. */
+struct bgp_aggregate_aspath
+{
+  struct aspath *aspath;
+  unsigned long count;
+};
+
+/* A community value of contributing routes, in network byte order. */
+struct bgp_aggregate_community
+{
+  u_int32_t val;
+  unsigned long count;
 };
 
+static unsigned int
+bgp_aggregate_route_key (void *p)
+{
+  const struct bgp_aggregate_route *ar = p;
+  return jhash_1word ((u_int32_t) (uintptr_t) ar->ri, 0);
+}
+
+static int
+bgp_aggregate_route_cmp (const void *p1, const void *p2)
+{
+  const struct bgp_aggregate_route *ar1 = p1;
+  const struct bgp_aggregate_route *ar2 = p2;
+  return ar1->ri == ar2->ri;
+}
+
+static void *
+bgp_aggregate_route_alloc (void *p)
+{
+  const struct bgp_aggregate_route *ar = p;
+  struct bgp_aggregate_route *new;
+
+  new = XCALLOC (MTYPE_BGP_AGGREGATE_ROUTE, sizeof (*new));
+  new->ri = ar->ri;
+  return new;
+}
+
+static unsigned int
+bgp_aggregate_aspath_key (void *p)
+{
+  const struct bgp_aggregate_aspath *aa = p;
+  return jhash_1word ((u_int32_t) (uintptr_t) aa->aspath, 0);
+}
+
+static int
+bgp_aggregate_aspath_cmp (const void *p1, const void *p2)
+{
+  const struct bgp_aggregate_aspath *aa1 = p1;
+  const struct bgp_aggregate_aspath *aa2 = p2;
+  return aa1->aspath == aa2->aspath;
+}
+
+static void *
+bgp_aggregate_aspath_alloc (void *p)
+{
+  const struct bgp_aggregate_aspath *aa = p;
+  struct bgp_aggregate_aspath *new;
+
+  new = XCALLOC (MTYPE_BGP_AGGREGATE_COUNT, sizeof (*new));
+  new->aspath = aa->aspath;
+  return new;
+}
+
+static unsigned int
+bgp_aggregate_community_key (void *p)
+{
+  const struct bgp_aggregate_community *ac = p;
+  return jhash_1word (ac->val, 0);
+}
+
+static int
+bgp_aggregate_community_cmp (const void *p1, const void *p2)
+{
+  const struct bgp_aggregate_community *ac1 = p1;
+  const struct bgp_aggregate_community *ac2 = p2;
+  return ac1->val == ac2->val;
+}
+
+static void *
+bgp_aggregate_community_alloc (void *p)
+{
+  const struct bgp_aggregate_community *ac = p;
+  struct bgp_aggregate_community *new;
+
+  new = XCALLOC (MTYPE_BGP_AGGREGATE_COUNT, sizeof (*new));
+  new->val = ac->val;
+  return new;
+}
+
 static struct bgp_aggregate *
 bgp_aggregate_new (void)
 {
-  return XCALLOC (MTYPE_BGP_AGGREGATE, sizeof (struct bgp_aggregate));
+  struct bgp_aggregate *aggregate;
+
+  aggregate = XCALLOC (MTYPE_BGP_AGGREGATE, sizeof (struct bgp_aggregate));
+  aggregate->routes = hash_create (bgp_aggregate_route_key,
+				   bgp_aggregate_route_cmp);
+  aggregate->aspaths = hash_create (bgp_aggregate_aspath_key,
+				    bgp_aggregate_aspath_cmp);
+  aggregate->communities = hash_create (bgp_aggregate_community_key,
+					bgp_aggregate_community_cmp);
+  return aggregate;
+}
+
+static void
+bgp_aggregate_route_free (void *p)
+{
+  struct bgp_aggregate_route *ar = p;
+
+  bgp_attr_unintern (&ar->attr);
+  XFREE (MTYPE_BGP_AGGREGATE_ROUTE, ar);
+}
+
+static void
+bgp_aggregate_count_free (void *p)
+{
+  XFREE (MTYPE_BGP_AGGREGATE_COUNT, p);
 }
 
 static void
 bgp_aggregate_free (struct bgp_aggregate *aggregate)
 {
+  hash_clean (aggregate->routes, bgp_aggregate_route_free);
+  hash_free (aggregate->routes);
+  hash_clean (aggregate->aspaths, bgp_aggregate_count_free);
+  hash_free (aggregate->aspaths);
+  hash_clean (aggregate->communities, bgp_aggregate_count_free);
+  hash_free (aggregate->communities);
   XFREE (MTYPE_BGP_AGGREGATE, aggregate);
-}     
+}
 
+/* Add (delta 1) or take away (delta -1) what ATTR brings to an as-set
+   aggregate.  Only a value appearing or disappearing changes the
+   aggregate route. */
 static void
-bgp_aggregate_route (struct bgp *bgp, struct prefix *p, struct bgp_info *rinew,
-		     afi_t afi, safi_t safi, struct bgp_info *del, 
-		     struct bgp_aggregate *aggregate)
+bgp_aggregate_count (struct bgp_aggregate *aggregate, struct attr *attr,
+		     int delta)
 {
-  struct bgp_table *table;
-  struct bgp_node *top;
-  struct bgp_node *rn;
-  u_char origin;
-  struct aspath *aspath = NULL;
-  struct aspath *asmerge = NULL;
-  struct community *community = NULL;
-  struct community *commerge = NULL;
-  struct in_addr nexthop;
-  u_int32_t med = 0;
-  struct bgp_info *ri;
-  struct bgp_info *new;
-  int first = 1;
-  unsigned long match = 0;
+  struct bgp_aggregate_aspath aa;
+  struct bgp_aggregate_aspath *aap;
+  struct bgp_aggregate_community ac;
+  struct bgp_aggregate_community *acp;
+  int i;
+
+  if (! aggregate->as_set)
+    return;
+
+  if (attr->origin <= BGP_ORIGIN_INCOMPLETE)
+    {
+      if (delta > 0)
+	{
+	  if (aggregate->origin[attr->origin]++ == 0)
+	    aggregate->changed = 1;
+	}
+      else if (--aggregate->origin[attr->origin] == 0)
+	aggregate->changed = 1;
+    }
+
+  aa.aspath = attr->aspath;
+  aap = hash_get (aggregate->aspaths, &aa, bgp_aggregate_aspath_alloc);
+  if (delta > 0)
+    {
+      if (aap->count++ == 0)
+	aggregate->changed = 1;
+    }
+  else if (--aap->count == 0)
+    {
+      hash_release (aggregate->aspaths, aap);
+      bgp_aggregate_count_free (aap);
+      aggregate->changed = 1;
+    }
+
+  if (! attr->community)
+    return;
+
+  for (i = 0; i < attr->community->size; i++)
+    {
+      memcpy (&ac.val, com_nthval (attr->community, i), sizeof (u_int32_t));
+      acp = hash_get (aggregate->communities, &ac,
+		      bgp_aggregate_community_alloc);
+      if (delta > 0)
+	{
+	  if (acp->count++ == 0)
+	    aggregate->changed = 1;
+	}
+      else if (--acp->count == 0)
+	{
+	  hash_release (aggregate->communities, acp);
+	  bgp_aggregate_count_free (acp);
+	  aggregate->changed = 1;
+	}
+    }
+}
+
+/* Count RI in the aggregate, or count it again if its attribute has
+   changed.  Return 1 if it was not counted before. */
+static int
+bgp_aggregate_route_add (struct bgp_aggregate *aggregate, struct bgp_info *ri)
+{
+  struct bgp_aggregate_route lookup;
+  struct bgp_aggregate_route *ar;
+  int added = 0;
+
+  lookup.ri = ri;
+  ar = hash_get (aggregate->routes, &lookup, bgp_aggregate_route_alloc);
+
+  if (ar->attr == ri->attr)
+    return 0;
 
-  /* Record adding route's nexthop and med. */
-  if (rinew)
+  if (ar->attr)
     {
-      nexthop = rinew->attr->nexthop;
-      med = rinew->attr->med;
+      bgp_aggregate_count (aggregate, ar->attr, -1);
+      bgp_attr_unintern (&ar->attr);
     }
+  else
+    {
+      if (aggregate->count++ == 0)
+	aggregate->changed = 1;
+      added = 1;
+    }
+
+  ar->attr = bgp_attr_intern (ri->attr);
+  bgp_aggregate_count (aggregate, ar->attr, 1);
+
+  return added;
+}
+
+/* Stop counting RI in the aggregate.  Return 1 if it was counted. */
+static int
+bgp_aggregate_route_del (struct bgp_aggregate *aggregate, struct bgp_info *ri)
+{
+  struct bgp_aggregate_route lookup;
+  struct bgp_aggregate_route *ar;
+
+  lookup.ri = ri;
+  ar = hash_release (aggregate->routes, &lookup);
+  if (! ar)
+    return 0;
+
+  bgp_aggregate_count (aggregate, ar->attr, -1);
+  bgp_aggregate_route_free (ar);
+
+  if (--aggregate->count == 0)
+    aggregate->changed = 1;
+
+  return 1;
+}
+
+static void
+bgp_aggregate_aspath_merge (struct hash_backet *backet, void *arg)
+{
+  struct bgp_aggregate_aspath *aa = backet->data;
+  struct aspath **aspath = arg;
+  struct aspath *asmerge;
+
+  if (*aspath)
+    {
+      asmerge = aspath_aggregate (*aspath, aa->aspath);
+      aspath_free (*aspath);
+      *aspath = asmerge;
+    }
+  else
+    *aspath = aspath_dup (aa->aspath);
+}
+
+static void
+bgp_aggregate_community_merge (struct hash_backet *backet, void *arg)
+{
+  struct bgp_aggregate_community *ac = backet->data;
+  struct community *community = arg;
+
+  memcpy (com_nthval (community, community->size), &ac->val,
+	  sizeof (u_int32_t));
+  community->size++;
+}
+
+/* Attribute of the aggregate route, from the counted values. */
+static struct attr *
+bgp_aggregate_attr (struct bgp *bgp, struct bgp_aggregate *aggregate)
+{
+  u_char origin = BGP_ORIGIN_IGP;
+  struct aspath *aspath = NULL;
+  struct community *community = NULL;
+  struct community tmp;
+  int i;
 
   /* ORIGIN attribute: If at least one route among routes that are
      aggregated has ORIGIN with the value INCOMPLETE, then the
@@ -4529,152 +5866,94 @@ bgp_aggregate_route (struct bgp *bgp, struct prefix *p, struct bgp_info *rinew,
      route must have the origin attribute with the value EGP. In all
      other case the value of the ORIGIN attribute of the aggregated
      route is INTERNAL. */
-  origin = BGP_ORIGIN_IGP;
-
-  table = bgp->rib[afi][safi];
-
-  top = bgp_node_get (table, p);
-  for (rn = bgp_node_get (table, p); rn; rn = bgp_route_next_until (rn, top))
-    if (rn->p.prefixlen > p->prefixlen)
-      {
-	match = 0;
-
-	for (ri = rn->info; ri; ri = ri->next)
-	  {
-	    if (BGP_INFO_HOLDDOWN (ri))
-	      continue;
-
-	    if (del && ri == del)
-	      continue;
+  if (aggregate->as_set)
+    {
+      for (i = BGP_ORIGIN_IGP; i <= BGP_ORIGIN_INCOMPLETE; i++)
+	if (aggregate->origin[i])
+	  origin = i;
 
-	    if (! rinew && first)
-	      {
-		nexthop = ri->attr->nexthop;
-		med = ri->attr->med;
-		first = 0;
-	      }
+      hash_iterate (aggregate->aspaths, bgp_aggregate_aspath_merge, &aspath);
 
-#ifdef AGGREGATE_NEXTHOP_CHECK
-	    if (! IPV4_ADDR_SAME (&ri->attr->nexthop, &nexthop)
-		|| ri->attr->med != med)
-	      {
-		if (aspath)
-		  aspath_free (aspath);
-		if (community)
-		  community_free (community);
-		bgp_unlock_node (rn);
-		bgp_unlock_node (top);
-		return;
-	      }
-#endif /* AGGREGATE_NEXTHOP_CHECK */
+      if (aggregate->communities->count)
+	{
+	  memset (&tmp, 0, sizeof (struct community));
+	  tmp.val = XMALLOC (MTYPE_TMP, aggregate->communities->count
+				       * sizeof (u_int32_t));
+	  hash_iterate (aggregate->communities, bgp_aggregate_community_merge,
+			&tmp);
+	  community = community_uniq_sort (&tmp);
+	  XFREE (MTYPE_TMP, tmp.val);
+	}
+    }
 
-	    if (ri->sub_type != BGP_ROUTE_AGGREGATE)
-	      {
-		if (aggregate->summary_only)
-		  {
-		    (bgp_info_extra_get (ri))->suppress++;
-		    bgp_info_set_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
-		    match++;
-		  }
+  return bgp_attr_aggregate_intern (bgp, origin, aspath, community,
+				    aggregate->as_set);
+}
 
-		aggregate->count++;
+/* Bring the aggregate route at P in line with what is counted, if
+   that has changed. */
+static void
+bgp_aggregate_update (struct bgp *bgp, struct prefix *p, afi_t afi,
+		      safi_t safi, struct bgp_aggregate *aggregate)
+{
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+  struct bgp_info *new;
+  struct attr *attr;
 
-		if (aggregate->as_set)
-		  {
-		    if (origin < ri->attr->origin)
-		      origin = ri->attr->origin;
+  if (! aggregate->changed)
+    return;
+  aggregate->changed = 0;
 
-		    if (aspath)
-		      {
-			asmerge = aspath_aggregate (aspath, ri->attr->aspath);
-			aspath_free (aspath);
-			aspath = asmerge;
-		      }
-		    else
-		      aspath = aspath_dup (ri->attr->aspath);
+  rn = bgp_node_get (bgp->rib[afi][safi], p);
 
-		    if (ri->attr->community)
-		      {
-			if (community)
-			  {
-			    commerge = community_merge (community,
-							ri->attr->community);
-			    community = community_uniq_sort (commerge);
-			    community_free (commerge);
-			  }
-			else
-			  community = community_dup (ri->attr->community);
-		      }
-		  }
-	      }
-	  }
-	if (match)
-	  bgp_process (bgp, rn, afi, safi);
-      }
-  bgp_unlock_node (top);
+  for (ri = rn->info; ri; ri = ri->next)
+    if (ri->peer == bgp->peer_self
+	&& ri->type == ZEBRA_ROUTE_BGP
+	&& ri->sub_type == BGP_ROUTE_AGGREGATE
+	&& ! CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+      break;
 
-  if (rinew)
+  if (aggregate->count == 0)
     {
-      aggregate->count++;
-      
-      if (aggregate->summary_only)
-        (bgp_info_extra_get (rinew))->suppress++;
-
-      if (aggregate->as_set)
+      /* Withdraw aggregate route from routing table. */
+      if (ri)
 	{
-	  if (origin < rinew->attr->origin)
-	    origin = rinew->attr->origin;
-
-	  if (aspath)
-	    {
-	      asmerge = aspath_aggregate (aspath, rinew->attr->aspath);
-	      aspath_free (aspath);
-	      aspath = asmerge;
-	    }
-	  else
-	    aspath = aspath_dup (rinew->attr->aspath);
-
-	  if (rinew->attr->community)
-	    {
-	      if (community)
-		{
-		  commerge = community_merge (community,
-					      rinew->attr->community);
-		  community = community_uniq_sort (commerge);
-		  community_free (commerge);
-		}
-	      else
-		community = community_dup (rinew->attr->community);
-	    }
+	  bgp_info_delete (rn, ri);
+	  bgp_process (bgp, rn, afi, safi);
 	}
+      bgp_unlock_node (rn);
+      return;
     }
 
-  if (aggregate->count > 0)
+  attr = bgp_aggregate_attr (bgp, aggregate);
+
+  if (ri && ri->attr == attr)
+    bgp_attr_unintern (&attr);
+  else if (ri)
+    {
+      bgp_info_set_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
+      bgp_attr_unintern (&ri->attr);
+      ri->attr = attr;
+      ri->uptime = bgp_clock ();
+      bgp_process (bgp, rn, afi, safi);
+    }
+  else
     {
-      rn = bgp_node_get (table, p);
       new = bgp_info_new ();
       new->type = ZEBRA_ROUTE_BGP;
       new->sub_type = BGP_ROUTE_AGGREGATE;
       new->peer = bgp->peer_self;
       SET_FLAG (new->flags, BGP_INFO_VALID);
-      new->attr = bgp_attr_aggregate_intern (bgp, origin, aspath, community, aggregate->as_set);
+      new->attr = attr;
       new->uptime = bgp_clock ();
 
       bgp_info_add (rn, new);
-      bgp_unlock_node (rn);
       bgp_process (bgp, rn, afi, safi);
     }
-  else
-    {
-      if (aspath)
-	aspath_free (aspath);
-      if (community)
-	community_free (community);
-    }
-}
 
-void bgp_aggregate_delete (struct bgp *, struct prefix *, afi_t, safi_t,
-			   struct bgp_aggregate *);
+  bgp_unlock_node (rn);
+}
 
 void
 bgp_aggregate_increment (struct bgp *bgp, struct prefix *p,
@@ -4701,14 +5980,19 @@ bgp_aggregate_increment (struct bgp *bgp, struct prefix *p,
   if (BGP_INFO_HOLDDOWN (ri))
     return;
 
+  if (ri->sub_type == BGP_ROUTE_AGGREGATE)
+    return;
+
   child = bgp_node_get (table, p);
 
   /* Aggregate address configuration check. */
   for (rn = child; rn; rn = bgp_node_parent_nolock (rn))
     if ((aggregate = rn->info) != NULL && rn->p.prefixlen < p->prefixlen)
       {
-	bgp_aggregate_delete (bgp, &rn->p, afi, safi, aggregate);
-	bgp_aggregate_route (bgp, &rn->p, ri, afi, safi, NULL, aggregate);
+	if (bgp_aggregate_route_add (aggregate, ri)
+	    && aggregate->summary_only)
+	  (bgp_info_extra_get (ri))->suppress++;
+	bgp_aggregate_update (bgp, &rn->p, afi, safi, aggregate);
       }
   bgp_unlock_node (child);
 }
@@ -4721,6 +6005,7 @@ bgp_aggregate_decrement (struct bgp *bgp, struct prefix *p,
   struct bgp_node *rn;
   struct bgp_aggregate *aggregate;
   struct bgp_table *table;
+  int unsuppressed = 0;
 
   /* MPLS-VPN aggregation is not yet supported. */
   if (safi == SAFI_MPLS_VPN)
@@ -4741,10 +6026,25 @@ bgp_aggregate_decrement (struct bgp *bgp, struct prefix *p,
   for (rn = child; rn; rn = bgp_node_parent_nolock (rn))
     if ((aggregate = rn->info) != NULL && rn->p.prefixlen < p->prefixlen)
       {
-	bgp_aggregate_delete (bgp, &rn->p, afi, safi, aggregate);
-	bgp_aggregate_route (bgp, &rn->p, NULL, afi, safi, del, aggregate);
+	if (bgp_aggregate_route_del (aggregate, del)
+	    && aggregate->summary_only && del->extra
+	    && --del->extra->suppress == 0)
+	  unsuppressed = 1;
+	bgp_aggregate_update (bgp, &rn->p, afi, safi, aggregate);
       }
   bgp_unlock_node (child);
+
+  /* If this route was suppressed, process the change. */
+  if (unsuppressed)
+    {
+      rn = bgp_node_lookup (bgp->rib[afi][safi], p);
+      if (rn)
+	{
+	  bgp_info_set_flag (rn, del, BGP_INFO_ATTR_CHANGED);
+	  bgp_process (bgp, rn, afi, safi);
+	  bgp_unlock_node (rn);
+	}
+    }
 }
 
 static void
@@ -4754,14 +6054,8 @@ bgp_aggregate_add (struct bgp *bgp, struct prefix *p, afi_t afi, safi_t safi,
   struct bgp_table *table;
   struct bgp_node *top;
   struct bgp_node *rn;
-  struct bgp_info *new;
   struct bgp_info *ri;
   unsigned long match;
-  u_char origin = BGP_ORIGIN_IGP;
-  struct aspath *aspath = NULL;
-  struct aspath *asmerge = NULL;
-  struct community *community = NULL;
-  struct community *commerge = NULL;
 
   table = bgp->rib[afi][safi];
 
@@ -4783,7 +6077,8 @@ bgp_aggregate_add (struct bgp *bgp, struct prefix *p, afi_t afi, safi_t safi,
 	    if (BGP_INFO_HOLDDOWN (ri))
 	      continue;
 
-	    if (ri->sub_type != BGP_ROUTE_AGGREGATE)
+	    if (ri->sub_type != BGP_ROUTE_AGGREGATE
+		&& bgp_aggregate_route_add (aggregate, ri))
 	      {
 		/* summary-only aggregate route suppress aggregated
 		   route announcement.  */
@@ -4793,36 +6088,6 @@ bgp_aggregate_add (struct bgp *bgp, struct prefix *p, afi_t afi, safi_t safi,
 		    bgp_info_set_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
 		    match++;
 		  }
-		/* as-set aggregate route generate origin, as path,
-		   community aggregation.  */
-		if (aggregate->as_set)
-		  {
-		    if (origin < ri->attr->origin)
-		      origin = ri->attr->origin;
-
-		    if (aspath)
-		      {
-			asmerge = aspath_aggregate (aspath, ri->attr->aspath);
-			aspath_free (aspath);
-			aspath = asmerge;
-		      }
-		    else
-		      aspath = aspath_dup (ri->attr->aspath);
-
-		    if (ri->attr->community)
-		      {
-			if (community)
-			  {
-			    commerge = community_merge (community,
-							ri->attr->community);
-			    community = community_uniq_sort (commerge);
-			    community_free (commerge);
-			  }
-			else
-			  community = community_dup (ri->attr->community);
-		      }
-		  }
-		aggregate->count++;
 	      }
 	  }
 	
@@ -4833,27 +6098,10 @@ bgp_aggregate_add (struct bgp *bgp, struct prefix *p, afi_t afi, safi_t safi,
   bgp_unlock_node (top);
 
   /* Add aggregate route to BGP table. */
-  if (aggregate->count)
-    {
-      rn = bgp_node_get (table, p);
-
-      new = bgp_info_new ();
-      new->type = ZEBRA_ROUTE_BGP;
-      new->sub_type = BGP_ROUTE_AGGREGATE;
-      new->peer = bgp->peer_self;
-      SET_FLAG (new->flags, BGP_INFO_VALID);
-      new->attr = bgp_attr_aggregate_intern (bgp, origin, aspath, community, aggregate->as_set);
-      new->uptime = bgp_clock ();
-
-      bgp_info_add (rn, new);
-      bgp_unlock_node (rn);
-      
-      /* Process change. */
-      bgp_process (bgp, rn, afi, safi);
-    }
+  bgp_aggregate_update (bgp, p, afi, safi, aggregate);
 }
 
-void
+static void
 bgp_aggregate_delete (struct bgp *bgp, struct prefix *p, afi_t afi, 
 		      safi_t safi, struct bgp_aggregate *aggregate)
 {
@@ -4879,22 +6127,16 @@ bgp_aggregate_delete (struct bgp *bgp, struct prefix *p, afi_t afi,
 
 	for (ri = rn->info; ri; ri = ri->next)
 	  {
-	    if (BGP_INFO_HOLDDOWN (ri))
-	      continue;
-
-	    if (ri->sub_type != BGP_ROUTE_AGGREGATE)
+	    if (bgp_aggregate_route_del (aggregate, ri)
+		&& aggregate->summary_only && ri->extra)
 	      {
-		if (aggregate->summary_only && ri->extra)
-		  {
-		    ri->extra->suppress--;
+		ri->extra->suppress--;
 
-		    if (ri->extra->suppress == 0)
-		      {
-			bgp_info_set_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
-			match++;
-		      }
+		if (ri->extra->suppress == 0)
+		  {
+		    bgp_info_set_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
+		    match++;
 		  }
-		aggregate->count--;
 	      }
 	  }
 
@@ -4905,23 +6147,62 @@ bgp_aggregate_delete (struct bgp *bgp, struct prefix *p, afi_t afi,
   bgp_unlock_node (top);
 
   /* Delete aggregate route from BGP table. */
-  rn = bgp_node_get (table, p);
+  aggregate->count = 0;
+  aggregate->changed = 1;
+  bgp_aggregate_update (bgp, p, afi, safi, aggregate);
+}
 
-  for (ri = rn->info; ri; ri = ri->next)
-    if (ri->peer == bgp->peer_self 
-	&& ri->type == ZEBRA_ROUTE_BGP
-	&& ri->sub_type == BGP_ROUTE_AGGREGATE)
-      break;
+/* Aggregate P, replacing whatever aggregate was there. */
+void
+bgp_aggregate_address_set (struct bgp *bgp, struct prefix *p, afi_t afi,
+			   safi_t safi, u_char summary_only, u_char as_set)
+{
+  struct bgp_node *rn;
+  struct bgp_aggregate *aggregate;
 
-  /* Withdraw static BGP route from routing table. */
-  if (ri)
-    {
-      bgp_info_delete (rn, ri);
-      bgp_process (bgp, rn, afi, safi);
-    }
+  bgp_aggregate_address_unset (bgp, p, afi, safi);
 
-  /* Unlock bgp_node_lookup. */
+  rn = bgp_node_get (bgp->aggregate[afi][safi], p);
+
+  /* Make aggregate address structure. */
+  aggregate = bgp_aggregate_new ();
+  aggregate->summary_only = summary_only;
+  aggregate->as_set = as_set;
+  aggregate->safi = safi;
+  rn->info = aggregate;
+
+  /* Aggregate address insert into BGP routing table. */
+  if (safi & SAFI_UNICAST)
+    bgp_aggregate_add (bgp, p, afi, SAFI_UNICAST, aggregate);
+  if (safi & SAFI_MULTICAST)
+    bgp_aggregate_add (bgp, p, afi, SAFI_MULTICAST, aggregate);
+}
+
+/* Stop aggregating P.  Return -1 if it was not aggregated. */
+int
+bgp_aggregate_address_unset (struct bgp *bgp, struct prefix *p, afi_t afi,
+			     safi_t safi)
+{
+  struct bgp_node *rn;
+  struct bgp_aggregate *aggregate;
+
+  rn = bgp_node_lookup (bgp->aggregate[afi][safi], p);
+  if (! rn)
+    return -1;
+
+  aggregate = rn->info;
+  if (aggregate->safi & SAFI_UNICAST)
+    bgp_aggregate_delete (bgp, p, afi, SAFI_UNICAST, aggregate);
+  if (aggregate->safi & SAFI_MULTICAST)
+    bgp_aggregate_delete (bgp, p, afi, SAFI_MULTICAST, aggregate);
+
+  /* Unlock aggregate address configuration. */
+  rn->info = NULL;
+  bgp_aggregate_free (aggregate);
+  bgp_unlock_node (rn);
   bgp_unlock_node (rn);
+
+  return 0;
 }
 
 /* Aggregate route attribute. */
@@ -4934,9 +6215,7 @@ bgp_aggregate_unset (struct vty *vty, const char *prefix_str,
 {
   int ret;
   struct prefix p;
-  struct bgp_node *rn;
   struct bgp *bgp;
-  struct bgp_aggregate *aggregate;
 
   /* Convert string to prefix structure. */
   ret = str2prefix (prefix_str, &p);
@@ -4951,26 +6230,13 @@ bgp_aggregate_unset (struct vty *vty, const char *prefix_str,
   bgp = vty->index;
 
   /* Old configuration check. */
-  rn = bgp_node_lookup (bgp->aggregate[afi][safi], &p);
-  if (! rn)
+  if (bgp_aggregate_address_unset (bgp, &p, afi, safi) < 0)
     {
       vty_out (vty, "%% There is no aggregate-address configuration.%s",
                VTY_NEWLINE);
       return CMD_WARNING;
     }
 
-  aggregate = rn->info;
-  if (aggregate->safi & SAFI_UNICAST)
-    bgp_aggregate_delete (bgp, &p, afi, SAFI_UNICAST, aggregate);
-  if (aggregate->safi & SAFI_MULTICAST)
-    bgp_aggregate_delete (bgp, &p, afi, SAFI_MULTICAST, aggregate);
-
-  /* Unlock aggregate address configuration. */
-  rn->info = NULL;
-  bgp_aggregate_free (aggregate);
-  bgp_unlock_node (rn);
-  bgp_unlock_node (rn);
-
   return CMD_SUCCESS;
 }
 
@@ -4983,7 +6249,6 @@ bgp_aggregate_set (struct vty *vty, const char *prefix_str,
   struct prefix p;
   struct bgp_node *rn;
   struct bgp *bgp;
-  struct bgp_aggregate *aggregate;
 
   /* Convert string to prefix structure. */
   ret = str2prefix (prefix_str, &p);
@@ -4998,33 +6263,15 @@ bgp_aggregate_set (struct vty *vty, const char *prefix_str,
   bgp = vty->index;
 
   /* Old configuration check. */
-  rn = bgp_node_get (bgp->aggregate[afi][safi], &p);
-
-  if (rn->info)
+  rn = bgp_node_lookup (bgp->aggregate[afi][safi], &p);
+  if (rn)
     {
       vty_out (vty, "There is already same aggregate network.%s", VTY_NEWLINE);
-      /* try to remove the old entry */
-      ret = bgp_aggregate_unset (vty, prefix_str, afi, safi);
-      if (ret)
-        {
-          vty_out (vty, "Error deleting aggregate.%s", VTY_NEWLINE);
-	  bgp_unlock_node (rn);
-	  return CMD_WARNING;
-        }
+      bgp_unlock_node (rn);
     }
 
-  /* Make aggregate address structure. */
-  aggregate = bgp_aggregate_new ();
-  aggregate->summary_only = summary_only;
-  aggregate->as_set = as_set;
-  aggregate->safi = safi;
-  rn->info = aggregate;
-
-  /* Aggregate address insert into BGP routing table. */
-  if (safi & SAFI_UNICAST)
-    bgp_aggregate_add (bgp, &p, afi, SAFI_UNICAST, aggregate);
-  if (safi & SAFI_MULTICAST)
-    bgp_aggregate_add (bgp, &p, afi, SAFI_MULTICAST, aggregate);
+  /* Replaces the old entry, if any. */
+  bgp_aggregate_address_set (bgp, &p, afi, safi, summary_only, as_set);
 
   return CMD_SUCCESS;
 }
@@ -6147,230 +7394,450 @@ enum bgp_show_type
   bgp_show_type_damp_neighbor
 };
 
+/* Chunk of table nodes a "show ip bgp" walk processes per event loop
+   turn before it yields to let the vty output drain. */
+#define BGP_SHOW_CHUNK 1000
+
+/* State of a "show ip bgp" table walk, kept across event loop turns
+   when the output is deferred. */
+struct bgp_show_state
+{
+  bgp_table_iter_t iter;
+  struct in_addr router_id;
+  enum bgp_show_type type;
+  void *output_arg;
+  int compact;
+  int header;
+  unsigned long output_count;
+
+  /* Route-server client whose view of the route-server table is
+     shown, or NULL. */
+  struct peer *rsclient;
+
+  /* Private copy of the filter argument, when it has to outlive the
+     command that set up the walk. */
+  union
+  {
+    struct prefix p;
+    union sockunion su;
+  } arg;
+};
+
+static int
+bgp_show_type_is_flap (enum bgp_show_type type)
+{
+  switch (type)
+    {
+    case bgp_show_type_flap_statistics:
+    case bgp_show_type_flap_address:
+    case bgp_show_type_flap_prefix:
+    case bgp_show_type_flap_cidr_only:
+    case bgp_show_type_flap_regexp:
+    case bgp_show_type_flap_filter_list:
+    case bgp_show_type_flap_prefix_list:
+    case bgp_show_type_flap_prefix_longer:
+    case bgp_show_type_flap_route_map:
+    case bgp_show_type_flap_neighbor:
+      return 1;
+    default:
+      return 0;
+    }
+}
+
+/* Compact, machine-readable route line: status, prefix, next hop,
+   MED, local preference, weight, origin and AS path, separated by
+   single spaces.  Absent attributes are shown as "-". */
+static void
+route_vty_out_compact (struct vty *vty, struct prefix *p,
+		       struct bgp_info *binfo)
+{
+  struct attr *attr = binfo->attr;
+  char buf[INET6_ADDRSTRLEN];
+  const char *str;
+
+  if (CHECK_FLAG (binfo->flags, BGP_INFO_REMOVED))
+    vty_out_buf (vty, "R", 1);
+  else if (CHECK_FLAG (binfo->flags, BGP_INFO_STALE))
+    vty_out_buf (vty, "S", 1);
+  else if (binfo->extra && binfo->extra->suppress)
+    vty_out_buf (vty, "s", 1);
+  else if (CHECK_FLAG (binfo->flags, BGP_INFO_DAMPED))
+    vty_out_buf (vty, "d", 1);
+  else if (CHECK_FLAG (binfo->flags, BGP_INFO_HISTORY))
+    vty_out_buf (vty, "h", 1);
+  else if (CHECK_FLAG (binfo->flags, BGP_INFO_VALID))
+    vty_out_buf (vty, "*", 1);
+  else
+    vty_out_buf (vty, "-", 1);
+
+  if (CHECK_FLAG (binfo->flags, BGP_INFO_SELECTED))
+    vty_out_buf (vty, "> ", 2);
+  else
+    vty_out_buf (vty, "  ", 2);
+
+  str = inet_ntop (p->family, &p->u.prefix, buf, sizeof (buf));
+  vty_out_buf (vty, str, strlen (str));
+  vty_out_buf (vty, "/", 1);
+  vty_out_uint (vty, p->prefixlen);
+  vty_out_buf (vty, " ", 1);
+
+  if (p->family == AF_INET)
+    str = inet_ntop (AF_INET, &attr->nexthop, buf, sizeof (buf));
+#ifdef HAVE_IPV6
+  else if (p->family == AF_INET6 && attr->extra)
+    str = inet_ntop (AF_INET6, &attr->extra->mp_nexthop_global,
+		     buf, sizeof (buf));
+#endif /* HAVE_IPV6 */
+  else
+    str = "-";
+  vty_out_buf (vty, str, strlen (str));
+
+  vty_out_buf (vty, " ", 1);
+  if (attr->flag & ATTR_FLAG_BIT (BGP_ATTR_MULTI_EXIT_DISC))
+    vty_out_uint (vty, attr->med);
+  else
+    vty_out_buf (vty, "-", 1);
+
+  vty_out_buf (vty, " ", 1);
+  if (attr->flag & ATTR_FLAG_BIT (BGP_ATTR_LOCAL_PREF))
+    vty_out_uint (vty, attr->local_pref);
+  else
+    vty_out_buf (vty, "-", 1);
+
+  vty_out_buf (vty, " ", 1);
+  vty_out_uint (vty, attr->extra ? attr->extra->weight : 0);
+
+  vty_out_buf (vty, " ", 1);
+  vty_out_buf (vty, bgp_origin_str[attr->origin], 1);
+
+  if (attr->aspath && attr->aspath->segments)
+    {
+      str = aspath_print (attr->aspath);
+      vty_out_buf (vty, " ", 1);
+      vty_out_buf (vty, str, strlen (str));
+    }
+
+  vty_out_buf (vty, VTY_NEWLINE, strlen (VTY_NEWLINE));
+}
+
+/* Does the path pass the filter of a "show ip bgp" walk? */
 static int
-bgp_show_table (struct vty *vty, struct bgp_table *table, struct in_addr *router_id,
-	  enum bgp_show_type type, void *output_arg)
+bgp_show_match (struct bgp_node *rn, struct bgp_info *ri,
+		enum bgp_show_type type, void *output_arg)
 {
-  struct bgp_info *ri;
-  struct bgp_node *rn;
-  int header = 1;
-  int display;
-  unsigned long output_count;
+  if (bgp_show_type_is_flap (type)
+      || type == bgp_show_type_dampend_paths
+      || type == bgp_show_type_damp_neighbor)
+    {
+      if (!(ri->extra && ri->extra->damp_info))
+	return 0;
+    }
+  if (type == bgp_show_type_regexp
+      || type == bgp_show_type_flap_regexp)
+    {
+      regex_t *regex = output_arg;
 
-  /* This is first entry point, so reset total line. */
-  output_count = 0;
+      if (bgp_regexec (regex, ri->attr->aspath) == REG_NOMATCH)
+	return 0;
+    }
+  if (type == bgp_show_type_prefix_list
+      || type == bgp_show_type_flap_prefix_list)
+    {
+      struct prefix_list *plist = output_arg;
 
-  /* Start processing of routes. */
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn)) 
-    if (rn->info != NULL)
-      {
-	display = 0;
+      if (prefix_list_apply (plist, &rn->p) != PREFIX_PERMIT)
+	return 0;
+    }
+  if (type == bgp_show_type_filter_list
+      || type == bgp_show_type_flap_filter_list)
+    {
+      struct as_list *as_list = output_arg;
 
-	for (ri = rn->info; ri; ri = ri->next)
-	  {
-	    if (type == bgp_show_type_flap_statistics
-		|| type == bgp_show_type_flap_address
-		|| type == bgp_show_type_flap_prefix
-		|| type == bgp_show_type_flap_cidr_only
-		|| type == bgp_show_type_flap_regexp
-		|| type == bgp_show_type_flap_filter_list
-		|| type == bgp_show_type_flap_prefix_list
-		|| type == bgp_show_type_flap_prefix_longer
-		|| type == bgp_show_type_flap_route_map
-		|| type == bgp_show_type_flap_neighbor
-		|| type == bgp_show_type_dampend_paths
-		|| type == bgp_show_type_damp_neighbor)
-	      {
-		if (!(ri->extra && ri->extra->damp_info))
-		  continue;
-	      }
-	    if (type == bgp_show_type_regexp
-		|| type == bgp_show_type_flap_regexp)
-	      {
-		regex_t *regex = output_arg;
-		    
-		if (bgp_regexec (regex, ri->attr->aspath) == REG_NOMATCH)
-		  continue;
-	      }
-	    if (type == bgp_show_type_prefix_list
-		|| type == bgp_show_type_flap_prefix_list)
-	      {
-		struct prefix_list *plist = output_arg;
-		    
-		if (prefix_list_apply (plist, &rn->p) != PREFIX_PERMIT)
-		  continue;
-	      }
-	    if (type == bgp_show_type_filter_list
-		|| type == bgp_show_type_flap_filter_list)
-	      {
-		struct as_list *as_list = output_arg;
+      if (as_list_apply (as_list, ri->attr->aspath) != AS_FILTER_PERMIT)
+	return 0;
+    }
+  if (type == bgp_show_type_route_map
+      || type == bgp_show_type_flap_route_map)
+    {
+      struct route_map *rmap = output_arg;
+      struct bgp_info binfo;
+      struct attr dummy_attr;
+      struct attr_extra dummy_extra;
+      int ret;
 
-		if (as_list_apply (as_list, ri->attr->aspath) != AS_FILTER_PERMIT)
-		  continue;
-	      }
-	    if (type == bgp_show_type_route_map
-		|| type == bgp_show_type_flap_route_map)
-	      {
-		struct route_map *rmap = output_arg;
-		struct bgp_info binfo;
-		struct attr dummy_attr;
-		struct attr_extra dummy_extra;
-		int ret;
+      dummy_attr.extra = &dummy_extra;
+      bgp_attr_dup (&dummy_attr, ri->attr);
 
-		dummy_attr.extra = &dummy_extra;
-		bgp_attr_dup (&dummy_attr, ri->attr);
+      binfo.peer = ri->peer;
+      binfo.attr = &dummy_attr;
 
-		binfo.peer = ri->peer;
-		binfo.attr = &dummy_attr;
+      ret = route_map_apply (rmap, &rn->p, RMAP_BGP, &binfo);
+      if (ret == RMAP_DENYMATCH)
+	return 0;
+    }
+  if (type == bgp_show_type_neighbor
+      || type == bgp_show_type_flap_neighbor
+      || type == bgp_show_type_damp_neighbor)
+    {
+      union sockunion *su = output_arg;
 
-		ret = route_map_apply (rmap, &rn->p, RMAP_BGP, &binfo);
-		if (ret == RMAP_DENYMATCH)
-		  continue;
-	      }
-	    if (type == bgp_show_type_neighbor
-		|| type == bgp_show_type_flap_neighbor
-		|| type == bgp_show_type_damp_neighbor)
-	      {
-		union sockunion *su = output_arg;
+      if (ri->peer->su_remote == NULL || ! sockunion_same(ri->peer->su_remote, su))
+	return 0;
+    }
+  if (type == bgp_show_type_cidr_only
+      || type == bgp_show_type_flap_cidr_only)
+    {
+      u_int32_t destination;
 
-		if (ri->peer->su_remote == NULL || ! sockunion_same(ri->peer->su_remote, su))
-		  continue;
-	      }
-	    if (type == bgp_show_type_cidr_only
-		|| type == bgp_show_type_flap_cidr_only)
-	      {
-		u_int32_t destination;
-
-		destination = ntohl (rn->p.u.prefix4.s_addr);
-		if (IN_CLASSC (destination) && rn->p.prefixlen == 24)
-		  continue;
-		if (IN_CLASSB (destination) && rn->p.prefixlen == 16)
-		  continue;
-		if (IN_CLASSA (destination) && rn->p.prefixlen == 8)
-		  continue;
-	      }
-	    if (type == bgp_show_type_prefix_longer
-		|| type == bgp_show_type_flap_prefix_longer)
-	      {
-		struct prefix *p = output_arg;
+      destination = ntohl (rn->p.u.prefix4.s_addr);
+      if (IN_CLASSC (destination) && rn->p.prefixlen == 24)
+	return 0;
+      if (IN_CLASSB (destination) && rn->p.prefixlen == 16)
+	return 0;
+      if (IN_CLASSA (destination) && rn->p.prefixlen == 8)
+	return 0;
+    }
+  if (type == bgp_show_type_prefix_longer
+      || type == bgp_show_type_flap_prefix_longer)
+    {
+      struct prefix *p = output_arg;
 
-		if (! prefix_match (p, &rn->p))
-		  continue;
-	      }
-	    if (type == bgp_show_type_community_all)
-	      {
-		if (! ri->attr->community)
-		  continue;
-	      }
-	    if (type == bgp_show_type_community)
-	      {
-		struct community *com = output_arg;
+      if (! prefix_match (p, &rn->p))
+	return 0;
+    }
+  if (type == bgp_show_type_community_all)
+    {
+      if (! ri->attr->community)
+	return 0;
+    }
+  if (type == bgp_show_type_community)
+    {
+      struct community *com = output_arg;
 
-		if (! ri->attr->community ||
-		    ! community_match (ri->attr->community, com))
-		  continue;
-	      }
-	    if (type == bgp_show_type_community_exact)
-	      {
-		struct community *com = output_arg;
+      if (! ri->attr->community ||
+	  ! community_match (ri->attr->community, com))
+	return 0;
+    }
+  if (type == bgp_show_type_community_exact)
+    {
+      struct community *com = output_arg;
 
-		if (! ri->attr->community ||
-		    ! community_cmp (ri->attr->community, com))
-		  continue;
-	      }
-	    if (type == bgp_show_type_community_list)
-	      {
-		struct community_list *list = output_arg;
+      if (! ri->attr->community ||
+	  ! community_cmp (ri->attr->community, com))
+	return 0;
+    }
+  if (type == bgp_show_type_community_list)
+    {
+      struct community_list *list = output_arg;
 
-		if (! community_list_match (ri->attr->community, list))
-		  continue;
-	      }
-	    if (type == bgp_show_type_community_list_exact)
-	      {
-		struct community_list *list = output_arg;
+      if (! community_list_match (ri->attr->community, list))
+	return 0;
+    }
+  if (type == bgp_show_type_community_list_exact)
+    {
+      struct community_list *list = output_arg;
 
-		if (! community_list_exact_match (ri->attr->community, list))
-		  continue;
-	      }
-	    if (type == bgp_show_type_flap_address
-		|| type == bgp_show_type_flap_prefix)
-	      {
-		struct prefix *p = output_arg;
+      if (! community_list_exact_match (ri->attr->community, list))
+	return 0;
+    }
+  if (type == bgp_show_type_flap_address
+      || type == bgp_show_type_flap_prefix)
+    {
+      struct prefix *p = output_arg;
 
-		if (! prefix_match (&rn->p, p))
-		  continue;
+      if (! prefix_match (&rn->p, p))
+	return 0;
 
-		if (type == bgp_show_type_flap_prefix)
-		  if (p->prefixlen != rn->p.prefixlen)
-		    continue;
-	      }
-	    if (type == bgp_show_type_dampend_paths
-		|| type == bgp_show_type_damp_neighbor)
-	      {
-		if (! CHECK_FLAG (ri->flags, BGP_INFO_DAMPED)
-		    || CHECK_FLAG (ri->flags, BGP_INFO_HISTORY))
-		  continue;
-	      }
+      if (type == bgp_show_type_flap_prefix)
+	if (p->prefixlen != rn->p.prefixlen)
+	  return 0;
+    }
+  if (type == bgp_show_type_dampend_paths
+      || type == bgp_show_type_damp_neighbor)
+    {
+      if (! CHECK_FLAG (ri->flags, BGP_INFO_DAMPED)
+	  || CHECK_FLAG (ri->flags, BGP_INFO_HISTORY))
+	return 0;
+    }
 
-	    if (header)
-	      {
-		vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (*router_id), VTY_NEWLINE);
-		vty_out (vty, BGP_SHOW_SCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
-		vty_out (vty, BGP_SHOW_OCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
-		if (type == bgp_show_type_dampend_paths
-		    || type == bgp_show_type_damp_neighbor)
-		  vty_out (vty, BGP_SHOW_DAMP_HEADER, VTY_NEWLINE);
-		else if (type == bgp_show_type_flap_statistics
-			 || type == bgp_show_type_flap_address
-			 || type == bgp_show_type_flap_prefix
-			 || type == bgp_show_type_flap_cidr_only
-			 || type == bgp_show_type_flap_regexp
-			 || type == bgp_show_type_flap_filter_list
-			 || type == bgp_show_type_flap_prefix_list
-			 || type == bgp_show_type_flap_prefix_longer
-			 || type == bgp_show_type_flap_route_map
-			 || type == bgp_show_type_flap_neighbor)
-		  vty_out (vty, BGP_SHOW_FLAP_HEADER, VTY_NEWLINE);
-		else
-		  vty_out (vty, BGP_SHOW_HEADER, VTY_NEWLINE);
-		header = 0;
-	      }
+  return 1;
+}
 
-	    if (type == bgp_show_type_dampend_paths
-		|| type == bgp_show_type_damp_neighbor)
-	      damp_route_vty_out (vty, &rn->p, ri, display, SAFI_UNICAST);
-	    else if (type == bgp_show_type_flap_statistics
-		     || type == bgp_show_type_flap_address
-		     || type == bgp_show_type_flap_prefix
-		     || type == bgp_show_type_flap_cidr_only
-		     || type == bgp_show_type_flap_regexp
-		     || type == bgp_show_type_flap_filter_list
-		     || type == bgp_show_type_flap_prefix_list
-		     || type == bgp_show_type_flap_prefix_longer
-		     || type == bgp_show_type_flap_route_map
-		     || type == bgp_show_type_flap_neighbor)
-	      flap_route_vty_out (vty, &rn->p, ri, display, SAFI_UNICAST);
-	    else
-	      route_vty_out (vty, &rn->p, ri, display, SAFI_UNICAST);
-	    display++;
-	  }
-	if (display)
-	  output_count++;
-      }
+/* Display up to BGP_SHOW_CHUNK nodes of the table walk. */
+static int
+bgp_show_table_chunk (struct vty *vty, void *arg)
+{
+  struct bgp_show_state *state = arg;
+  enum bgp_show_type type = state->type;
+  struct bgp_info *ri;
+  struct bgp_info *first;
+  struct bgp_info *buf = NULL;
+  struct bgp_node *rn;
+  int display;
+  int count = 0;
+
+  while (count++ < BGP_SHOW_CHUNK
+	 && (rn = bgp_table_iter_next (&state->iter)) != NULL)
+    {
+      if (rn->info == NULL)
+	continue;
+
+      display = 0;
+
+      first = rn->info;
+      if (state->rsclient)
+	first = bgp_rsclient_view (state->rsclient, rn, &buf);
+
+      for (ri = first; ri; ri = ri->next)
+	{
+	  if (! bgp_show_match (rn, ri, type, state->output_arg))
+	    continue;
+
+	  if (state->header && state->compact)
+	    state->header = 0;
+	  if (state->header)
+	    {
+	      vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (state->router_id), VTY_NEWLINE);
+	      vty_out (vty, BGP_SHOW_SCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
+	      vty_out (vty, BGP_SHOW_OCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
+	      if (type == bgp_show_type_dampend_paths
+		  || type == bgp_show_type_damp_neighbor)
+		vty_out (vty, BGP_SHOW_DAMP_HEADER, VTY_NEWLINE);
+	      else if (bgp_show_type_is_flap (type))
+		vty_out (vty, BGP_SHOW_FLAP_HEADER, VTY_NEWLINE);
+	      else
+		vty_out (vty, BGP_SHOW_HEADER, VTY_NEWLINE);
+	      state->header = 0;
+	    }
+
+	  if (state->compact)
+	    route_vty_out_compact (vty, &rn->p, ri);
+	  else if (type == bgp_show_type_dampend_paths
+		   || type == bgp_show_type_damp_neighbor)
+	    damp_route_vty_out (vty, &rn->p, ri, display, SAFI_UNICAST);
+	  else if (bgp_show_type_is_flap (type))
+	    flap_route_vty_out (vty, &rn->p, ri, display, SAFI_UNICAST);
+	  else
+	    route_vty_out (vty, &rn->p, ri, display, SAFI_UNICAST);
+	  display++;
+	}
+      if (display)
+	state->output_count++;
+
+      if (buf)
+	{
+	  XFREE (MTYPE_TMP, buf);
+	  buf = NULL;
+	}
+    }
+
+  if (! bgp_table_iter_is_done (&state->iter))
+    {
+      bgp_table_iter_pause (&state->iter);
+      return VTY_OUTPUT_MORE;
+    }
+
+  if (state->compact)
+    return VTY_OUTPUT_DONE;
 
   /* No route is displayed */
-  if (output_count == 0)
+  if (state->output_count == 0)
     {
       if (type == bgp_show_type_normal)
 	vty_out (vty, "No BGP network exists%s", VTY_NEWLINE);
     }
   else
     vty_out (vty, "%sTotal number of prefixes %ld%s",
-	     VTY_NEWLINE, output_count, VTY_NEWLINE);
+	     VTY_NEWLINE, state->output_count, VTY_NEWLINE);
+
+  return VTY_OUTPUT_DONE;
+}
+
+static void
+bgp_show_table_clean (struct vty *vty, void *arg)
+{
+  struct bgp_show_state *state = arg;
+
+  bgp_table_iter_cleanup (&state->iter);
+  if (state->rsclient)
+    peer_unlock (state->rsclient);
+  XFREE (MTYPE_BGP_SHOW_STATE, state);
+}
+
+/* Walk the table, yielding to the event loop between chunks where
+   the filter argument allows it.  Arguments that are configuration
+   objects or that the caller frees on return could change under a
+   paused walk, so those are shown in one go.  With RSCLIENT, TABLE
+   is the route-server table as that client sees it. */
+static int
+bgp_show_table_common (struct vty *vty, struct bgp_table *table,
+		       struct in_addr *router_id, enum bgp_show_type type,
+		       void *output_arg, int compact, struct peer *rsclient)
+{
+  struct bgp_show_state *state;
+  int defer = 1;
+
+  state = XCALLOC (MTYPE_BGP_SHOW_STATE, sizeof (struct bgp_show_state));
+  bgp_table_iter_init (&state->iter, table);
+  state->router_id = *router_id;
+  state->type = type;
+  state->compact = compact;
+  state->header = 1;
+  if (rsclient)
+    state->rsclient = peer_lock (rsclient);
+
+  switch (type)
+    {
+    case bgp_show_type_prefix_longer:
+    case bgp_show_type_flap_address:
+    case bgp_show_type_flap_prefix:
+    case bgp_show_type_flap_prefix_longer:
+      prefix_copy (&state->arg.p, output_arg);
+      state->output_arg = &state->arg.p;
+      break;
+    case bgp_show_type_neighbor:
+    case bgp_show_type_flap_neighbor:
+    case bgp_show_type_damp_neighbor:
+      state->arg.su = *(union sockunion *) output_arg;
+      state->output_arg = &state->arg.su;
+      break;
+    default:
+      state->output_arg = output_arg;
+      defer = (output_arg == NULL);
+      break;
+    }
+
+  if (defer)
+    vty_out_defer (vty, bgp_show_table_chunk, bgp_show_table_clean, state);
+  else
+    {
+      while (bgp_show_table_chunk (vty, state) == VTY_OUTPUT_MORE)
+	;
+      bgp_show_table_clean (vty, state);
+    }
 
   return CMD_SUCCESS;
 }
 
+static int
+bgp_show_table (struct vty *vty, struct bgp_table *table, struct in_addr *router_id,
+	  enum bgp_show_type type, void *output_arg)
+{
+  return bgp_show_table_common (vty, table, router_id, type, output_arg, 0,
+				NULL);
+}
+
+/* Display the route-server table as route-server client PEER sees
+   it. */
+static int
+bgp_show_table_rsclient (struct vty *vty, struct peer *peer, afi_t afi,
+			 safi_t safi)
+{
+  return bgp_show_table_common (vty, peer->bgp->rsclient_rib[afi][safi],
+				&peer->remote_id, bgp_show_type_normal, NULL,
+				0, bgp_rsclient_owner (peer, afi, safi));
+}
+
 static int
 bgp_show (struct vty *vty, struct bgp *bgp, afi_t afi, safi_t safi,
          enum bgp_show_type type, void *output_arg)
@@ -6393,6 +7860,22 @@ bgp_show (struct vty *vty, struct bgp *bgp, afi_t afi, safi_t safi,
   return bgp_show_table (vty, table, &bgp->router_id, type, output_arg);
 }
 
+static int
+bgp_show_compact (struct vty *vty, afi_t afi, safi_t safi)
+{
+  struct bgp *bgp;
+
+  bgp = bgp_get_default ();
+  if (bgp == NULL)
+    {
+      vty_out (vty, "No BGP process is configured%s", VTY_NEWLINE);
+      return CMD_WARNING;
+    }
+
+  return bgp_show_table_common (vty, bgp->rib[afi][safi], &bgp->router_id,
+				bgp_show_type_normal, NULL, 1, NULL);
+}
+
 /* Header of detailed BGP route information */
 static void
 route_vty_out_detail_header (struct vty *vty, struct bgp *bgp,
@@ -6476,12 +7959,13 @@ route_vty_out_detail_header (struct vty *vty, struct bgp *bgp,
   vty_out (vty, "%s", VTY_NEWLINE);
 }
 
-/* Display specified route of BGP table. */
+/* Display specified route of BGP table, or of the route-server table
+   as route-server client RSCLIENT sees it. */
 static int
 bgp_show_route_in_table (struct vty *vty, struct bgp *bgp, 
                          struct bgp_table *rib, const char *ip_str,
                          afi_t afi, safi_t safi, struct prefix_rd *prd,
-                         int prefix_check)
+                         int prefix_check, struct peer *rsclient)
 {
   int ret;
   int header;
@@ -6489,7 +7973,9 @@ bgp_show_route_in_table (struct vty *vty, struct bgp *bgp,
   struct prefix match;
   struct bgp_node *rn;
   struct bgp_node *rm;
+  struct bgp_node view;
   struct bgp_info *ri;
+  struct bgp_info *buf = NULL;
   struct bgp_table *table;
 
   /* Check IP address argument. */
@@ -6547,16 +8033,23 @@ bgp_show_route_in_table (struct vty *vty, struct bgp *bgp,
         {
           if (! prefix_check || rn->p.prefixlen == match.prefixlen)
             {
-              for (ri = rn->info; ri; ri = ri->next)
+              view = *rn;
+              if (rsclient)
+                view.info = bgp_rsclient_view (rsclient, rn, &buf);
+
+              for (ri = view.info; ri; ri = ri->next)
                 {
                   if (header)
                     {
-                      route_vty_out_detail_header (vty, bgp, rn, NULL, afi, safi);
+                      route_vty_out_detail_header (vty, bgp, &view, NULL, afi, safi);
                       header = 0;
                     }
                   display++;
                   route_vty_out_detail (vty, bgp, &rn->p, ri, afi, safi);
                 }
+
+              if (buf)
+                XFREE (MTYPE_TMP, buf);
             }
 
           bgp_unlock_node (rn);
@@ -6601,7 +8094,7 @@ bgp_show_route (struct vty *vty, const char *view_name, const char *ip_str,
     }
  
   return bgp_show_route_in_table (vty, bgp, bgp->rib[afi][safi], ip_str, 
-                                   afi, safi, prd, prefix_check);
+                                   afi, safi, prd, prefix_check, NULL);
 }
 
 /* BGP route print out function. */
@@ -6615,6 +8108,17 @@ DEFUN (show_ip_bgp,
   return bgp_show (vty, NULL, AFI_IP, SAFI_UNICAST, bgp_show_type_normal, NULL);
 }
 
+DEFUN (show_ip_bgp_compact,
+       show_ip_bgp_compact_cmd,
+       "show ip bgp compact",
+       SHOW_STR
+       IP_STR
+       BGP_STR
+       "Compact machine-readable output, one path per line\n")
+{
+  return bgp_show_compact (vty, AFI_IP, SAFI_UNICAST);
+}
+
 DEFUN (show_ip_bgp_ipv4,
        show_ip_bgp_ipv4_cmd,
        "show ip bgp ipv4 (unicast|multicast)",
@@ -6848,6 +8352,16 @@ DEFUN (show_bgp,
                    NULL);
 }
 
+DEFUN (show_bgp_compact,
+       show_bgp_compact_cmd,
+       "show bgp compact",
+       SHOW_STR
+       BGP_STR
+       "Compact machine-readable output, one path per line\n")
+{
+  return bgp_show_compact (vty, AFI_IP6, SAFI_UNICAST);
+}
+
 ALIAS (show_bgp,
        show_bgp_ipv6_cmd,
        "show bgp ipv6",
@@ -9626,16 +11140,16 @@ bgp_peer_count_walker (struct thread *t)
   struct bgp_node *rn;
   struct peer_pcounts *pc = THREAD_ARG (t);
   const struct peer *peer = pc->peer;
+  struct bgp_adj_in *adj_in;
+
+  adj_in = peer->adj_in[pc->table->afi][pc->table->safi];
+  if (adj_in)
+    pc->count[PCOUNT_ADJ_IN] = adj_in->count;
   
   for (rn = bgp_table_top (pc->table); rn; rn = bgp_route_next (rn))
     {
-      struct bgp_adj_in *ain;
       struct bgp_info *ri;
       
-      for (ain = rn->adj_in; ain; ain = ain->next)
-        if (ain->peer == peer)
-          pc->count[PCOUNT_ADJ_IN]++;
-
       for (ri = rn->info; ri; ri = ri->next)
         {
           char buf[SU_ADDRSTRLEN];
@@ -9820,13 +11334,37 @@ DEFUN (show_ip_bgp_vpnv4_neighbor_prefix_counts,
 }
 
 
+/* A route received, for showing in prefix order.  */
+struct adj_in_route
+{
+  struct prefix p;
+  struct attr *attr;
+};
+
+/* Order of the prefixes in a table: by address, then length.  */
+static int
+adj_in_route_cmp (const void *a, const void *b)
+{
+  const struct adj_in_route *ra = a;
+  const struct adj_in_route *rb = b;
+  int ret;
+
+  ret = memcmp (&ra->p.u.prefix, &rb->p.u.prefix, prefix_blen (&ra->p));
+  if (ret)
+    return ret;
+  return (int) ra->p.prefixlen - (int) rb->p.prefixlen;
+}
+
 static void
 show_adj_route (struct vty *vty, struct peer *peer, afi_t afi, safi_t safi,
 		int in)
 {
   struct bgp_table *table;
-  struct bgp_adj_in *ain;
-  struct bgp_adj_out *adj;
+  struct bgp_adj_in *adj_in;
+  struct adj_in_route *routes = NULL;
+  u_int32_t count = 0;
+  u_int32_t i;
+  struct attr *attr;
   unsigned long output_count;
   struct bgp_node *rn;
   int header1 = 1;
@@ -9854,54 +11392,59 @@ show_adj_route (struct vty *vty, struct peer *peer, afi_t afi, safi_t safi,
       header1 = 0;
     }
 
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
-    if (in)
-      {
-	for (ain = rn->adj_in; ain; ain = ain->next)
-	  if (ain->peer == peer)
-	    {
-	      if (header1)
-		{
-		  vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (bgp->router_id), VTY_NEWLINE);
-		  vty_out (vty, BGP_SHOW_SCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
-		  vty_out (vty, BGP_SHOW_OCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
-		  header1 = 0;
-		}
-	      if (header2)
-		{
-		  vty_out (vty, BGP_SHOW_HEADER, VTY_NEWLINE);
-		  header2 = 0;
-		}
-	      if (ain->attr)
-		{ 
-		  route_vty_out_tmp (vty, &rn->p, ain->attr, safi);
-		  output_count++;
-		}
-	    }
-      }
-    else
+  /* The routes received are kept in no particular order.  */
+  if (in && (adj_in = peer->adj_in[afi][safi]) != NULL)
+    {
+      count = adj_in->count;
+      routes = XMALLOC (MTYPE_TMP, count * sizeof (struct adj_in_route));
+      for (i = 0; i < count; i++)
+	routes[i].attr = bgp_adj_in_get (adj_in, i, &routes[i].p, NULL, NULL);
+      qsort (routes, count, sizeof (struct adj_in_route), adj_in_route_cmp);
+    }
+
+  for (i = 0; i < count; i++)
+    {
+      if (header1)
+	{
+	  vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (bgp->router_id), VTY_NEWLINE);
+	  vty_out (vty, BGP_SHOW_SCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
+	  vty_out (vty, BGP_SHOW_OCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
+	  header1 = 0;
+	}
+      if (header2)
+	{
+	  vty_out (vty, BGP_SHOW_HEADER, VTY_NEWLINE);
+	  header2 = 0;
+	}
+      route_vty_out_tmp (vty, &routes[i].p, routes[i].attr, safi);
+      output_count++;
+    }
+  if (routes)
+    XFREE (MTYPE_TMP, routes);
+
+  if (! in)
+    for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
       {
-	for (adj = rn->adj_out; adj; adj = adj->next)
-	  if (adj->peer == peer)
-	    {
-	      if (header1)
-		{
-		  vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (bgp->router_id), VTY_NEWLINE);
-		  vty_out (vty, BGP_SHOW_SCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
-		  vty_out (vty, BGP_SHOW_OCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
-		  header1 = 0;
-		}
-	      if (header2)
-		{
-		  vty_out (vty, BGP_SHOW_HEADER, VTY_NEWLINE);
-		  header2 = 0;
-		}
-	      if (adj->attr)
-		{	
-		  route_vty_out_tmp (vty, &rn->p, adj->attr, safi);
-		  output_count++;
-		}
-	    }
+	if (bgp_adj_out_pending (rn, peer) || bgp_adj_out_attr (rn, peer))
+	  {
+	    if (header1)
+	      {
+		vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (bgp->router_id), VTY_NEWLINE);
+		vty_out (vty, BGP_SHOW_SCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
+		vty_out (vty, BGP_SHOW_OCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
+		header1 = 0;
+	      }
+	    if (header2)
+	      {
+		vty_out (vty, BGP_SHOW_HEADER, VTY_NEWLINE);
+		header2 = 0;
+	      }
+	    if ((attr = bgp_adj_out_attr (rn, peer)) != NULL)
+	      {
+		route_vty_out_tmp (vty, &rn->p, attr, safi);
+		output_count++;
+	      }
+	  }
       }
   
   if (output_count != 0)
@@ -10617,7 +12160,6 @@ DEFUN (show_ip_bgp_view_rsclient,
        "Information about Route Server Client\n"
        NEIGHBOR_ADDR_STR)
 {
-  struct bgp_table *table;
   struct peer *peer;
 
   if (argc == 2)
@@ -10643,9 +12185,7 @@ DEFUN (show_ip_bgp_view_rsclient,
       return CMD_WARNING;
     }
 
-  table = peer->rib[AFI_IP][SAFI_UNICAST];
-
-  return bgp_show_table (vty, table, &peer->remote_id, bgp_show_type_normal, NULL);
+  return bgp_show_table_rsclient (vty, peer, AFI_IP, SAFI_UNICAST);
 }
 
 ALIAS (show_ip_bgp_view_rsclient,
@@ -10670,7 +12210,6 @@ DEFUN (show_bgp_view_ipv4_safi_rsclient,
        "Information about Route Server Client\n"
        NEIGHBOR_ADDR_STR)
 {
-  struct bgp_table *table;
   struct peer *peer;
   safi_t safi;
 
@@ -10700,9 +12239,7 @@ DEFUN (show_bgp_view_ipv4_safi_rsclient,
       return CMD_WARNING;
     }
 
-  table = peer->rib[AFI_IP][safi];
-
-  return bgp_show_table (vty, table, &peer->remote_id, bgp_show_type_normal, NULL);
+  return bgp_show_table_rsclient (vty, peer, AFI_IP, safi);
 }
 
 ALIAS (show_bgp_view_ipv4_safi_rsclient,
@@ -10774,9 +12311,10 @@ DEFUN (show_ip_bgp_view_rsclient_route,
       return CMD_WARNING;
     }
  
-  return bgp_show_route_in_table (vty, bgp, peer->rib[AFI_IP][SAFI_UNICAST], 
+  return bgp_show_route_in_table (vty, bgp, bgp->rsclient_rib[AFI_IP][SAFI_UNICAST], 
                                   (argc == 3) ? argv[2] : argv[1],
-                                  AFI_IP, SAFI_UNICAST, NULL, 0);
+                                  AFI_IP, SAFI_UNICAST, NULL, 0,
+                                  bgp_rsclient_owner (peer, AFI_IP, SAFI_UNICAST));
 }
 
 ALIAS (show_ip_bgp_view_rsclient_route,
@@ -10853,9 +12391,10 @@ DEFUN (show_bgp_view_ipv4_safi_rsclient_route,
       return CMD_WARNING;
     }
 
-  return bgp_show_route_in_table (vty, bgp, peer->rib[AFI_IP][safi],
+  return bgp_show_route_in_table (vty, bgp, bgp->rsclient_rib[AFI_IP][safi],
                                   (argc == 4) ? argv[3] : argv[2],
-                                  AFI_IP, safi, NULL, 0);
+                                  AFI_IP, safi, NULL, 0,
+                                  bgp_rsclient_owner (peer, AFI_IP, safi));
 }
 
 ALIAS (show_bgp_view_ipv4_safi_rsclient_route,
@@ -10928,9 +12467,10 @@ DEFUN (show_ip_bgp_view_rsclient_prefix,
     return CMD_WARNING;
     }
     
-  return bgp_show_route_in_table (vty, bgp, peer->rib[AFI_IP][SAFI_UNICAST], 
+  return bgp_show_route_in_table (vty, bgp, bgp->rsclient_rib[AFI_IP][SAFI_UNICAST], 
                                   (argc == 3) ? argv[2] : argv[1],
-                                  AFI_IP, SAFI_UNICAST, NULL, 1);
+                                  AFI_IP, SAFI_UNICAST, NULL, 1,
+                                  bgp_rsclient_owner (peer, AFI_IP, SAFI_UNICAST));
 }
 
 ALIAS (show_ip_bgp_view_rsclient_prefix,
@@ -11007,9 +12547,10 @@ DEFUN (show_bgp_view_ipv4_safi_rsclient_prefix,
     return CMD_WARNING;
     }
 
-  return bgp_show_route_in_table (vty, bgp, peer->rib[AFI_IP][safi],
+  return bgp_show_route_in_table (vty, bgp, bgp->rsclient_rib[AFI_IP][safi],
                                   (argc == 4) ? argv[3] : argv[2],
-                                  AFI_IP, safi, NULL, 1);
+                                  AFI_IP, safi, NULL, 1,
+                                  bgp_rsclient_owner (peer, AFI_IP, safi));
 }
 
 ALIAS (show_bgp_view_ipv4_safi_rsclient_prefix,
@@ -11250,7 +12791,6 @@ DEFUN (show_bgp_view_rsclient,
        "Information about Route Server Client\n"
        NEIGHBOR_ADDR_STR)
 {
-  struct bgp_table *table;
   struct peer *peer;
 
   if (argc == 2)
@@ -11276,9 +12816,7 @@ DEFUN (show_bgp_view_rsclient,
       return CMD_WARNING;
     }
 
-  table = peer->rib[AFI_IP6][SAFI_UNICAST];
-
-  return bgp_show_table (vty, table, &peer->remote_id, bgp_show_type_normal, NULL);
+  return bgp_show_table_rsclient (vty, peer, AFI_IP6, SAFI_UNICAST);
 }
 
 ALIAS (show_bgp_view_rsclient,
@@ -11302,7 +12840,6 @@ DEFUN (show_bgp_view_ipv6_safi_rsclient,
        "Information about Route Server Client\n"
        NEIGHBOR_ADDR_STR)
 {
-  struct bgp_table *table;
   struct peer *peer;
   safi_t safi;
 
@@ -11332,9 +12869,7 @@ DEFUN (show_bgp_view_ipv6_safi_rsclient,
       return CMD_WARNING;
     }
 
-  table = peer->rib[AFI_IP6][safi];
-
-  return bgp_show_table (vty, table, &peer->remote_id, bgp_show_type_normal, NULL);
+  return bgp_show_table_rsclient (vty, peer, AFI_IP6, safi);
 }
 
 ALIAS (show_bgp_view_ipv6_safi_rsclient,
@@ -11405,9 +12940,10 @@ DEFUN (show_bgp_view_rsclient_route,
       return CMD_WARNING;
     }
 
-  return bgp_show_route_in_table (vty, bgp, peer->rib[AFI_IP6][SAFI_UNICAST],
+  return bgp_show_route_in_table (vty, bgp, bgp->rsclient_rib[AFI_IP6][SAFI_UNICAST],
                                   (argc == 3) ? argv[2] : argv[1],
-                                  AFI_IP6, SAFI_UNICAST, NULL, 0);
+                                  AFI_IP6, SAFI_UNICAST, NULL, 0,
+                                  bgp_rsclient_owner (peer, AFI_IP6, SAFI_UNICAST));
 }
 
 ALIAS (show_bgp_view_rsclient_route,
@@ -11483,9 +13019,10 @@ DEFUN (show_bgp_view_ipv6_safi_rsclient_route,
       return CMD_WARNING;
     }
 
-  return bgp_show_route_in_table (vty, bgp, peer->rib[AFI_IP6][safi],
+  return bgp_show_route_in_table (vty, bgp, bgp->rsclient_rib[AFI_IP6][safi],
                                   (argc == 4) ? argv[3] : argv[2],
-                                  AFI_IP6, safi, NULL, 0);
+                                  AFI_IP6, safi, NULL, 0,
+                                  bgp_rsclient_owner (peer, AFI_IP6, safi));
 }
 
 ALIAS (show_bgp_view_ipv6_safi_rsclient_route,
@@ -11557,9 +13094,10 @@ DEFUN (show_bgp_view_rsclient_prefix,
       return CMD_WARNING;
     }
 
-  return bgp_show_route_in_table (vty, bgp, peer->rib[AFI_IP6][SAFI_UNICAST],
+  return bgp_show_route_in_table (vty, bgp, bgp->rsclient_rib[AFI_IP6][SAFI_UNICAST],
                                   (argc == 3) ? argv[2] : argv[1],
-                                  AFI_IP6, SAFI_UNICAST, NULL, 1);
+                                  AFI_IP6, SAFI_UNICAST, NULL, 1,
+                                  bgp_rsclient_owner (peer, AFI_IP6, SAFI_UNICAST));
 }
 
 ALIAS (show_bgp_view_rsclient_prefix,
@@ -11635,9 +13173,10 @@ DEFUN (show_bgp_view_ipv6_safi_rsclient_prefix,
     return CMD_WARNING;
     }
 
-  return bgp_show_route_in_table (vty, bgp, peer->rib[AFI_IP6][safi],
+  return bgp_show_route_in_table (vty, bgp, bgp->rsclient_rib[AFI_IP6][safi],
                                   (argc == 4) ? argv[3] : argv[2],
-                                  AFI_IP6, safi, NULL, 1);
+                                  AFI_IP6, safi, NULL, 1,
+                                  bgp_rsclient_owner (peer, AFI_IP6, safi));
 }
 
 ALIAS (show_bgp_view_ipv6_safi_rsclient_prefix,
@@ -12476,6 +14015,7 @@ bgp_route_init (void)
   install_element (BGP_IPV4M_NODE, &no_aggregate_address_mask_summary_as_set_cmd);
 
   install_element (VIEW_NODE, &show_ip_bgp_cmd);
+  install_element (VIEW_NODE, &show_ip_bgp_compact_cmd);
   install_element (VIEW_NODE, &show_ip_bgp_ipv4_cmd);
   install_element (VIEW_NODE, &show_bgp_ipv4_safi_cmd);
   install_element (VIEW_NODE, &show_ip_bgp_route_cmd);
@@ -12609,6 +14149,7 @@ bgp_route_init (void)
   install_element (RESTRICTED_NODE, &show_bgp_view_ipv4_safi_rsclient_prefix_cmd);
 
   install_element (ENABLE_NODE, &show_ip_bgp_cmd);
+  install_element (ENABLE_NODE, &show_ip_bgp_compact_cmd);
   install_element (ENABLE_NODE, &show_ip_bgp_ipv4_cmd);
   install_element (ENABLE_NODE, &show_bgp_ipv4_safi_cmd);
   install_element (ENABLE_NODE, &show_ip_bgp_route_cmd);
@@ -12736,6 +14277,7 @@ bgp_route_init (void)
   install_element (BGP_NODE, &old_no_ipv6_aggregate_address_summary_only_cmd);
 
   install_element (VIEW_NODE, &show_bgp_cmd);
+  install_element (VIEW_NODE, &show_bgp_compact_cmd);
   install_element (VIEW_NODE, &show_bgp_ipv6_cmd);
   install_element (VIEW_NODE, &show_bgp_ipv6_safi_cmd);
   install_element (VIEW_NODE, &show_bgp_route_cmd);
@@ -12860,6 +14402,7 @@ bgp_route_init (void)
   install_element (RESTRICTED_NODE, &show_bgp_view_ipv6_safi_rsclient_prefix_cmd);
 
   install_element (ENABLE_NODE, &show_bgp_cmd);
+  install_element (ENABLE_NODE, &show_bgp_compact_cmd);
   install_element (ENABLE_NODE, &show_bgp_ipv6_cmd);
   install_element (ENABLE_NODE, &show_bgp_ipv6_safi_cmd);
   install_element (ENABLE_NODE, &show_bgp_route_cmd);
@@ -40,6 +40,30 @@ struct bgp_info_extra
 
   /* MPLS label.  */
   u_char tag[3];  
+
+  /* Route-server client policy outcomes, for paths of the shared
+     route-server table.  */
+  struct bgp_info_rsclient *rsclient;
+};
+
+/* What the route-server clients' policies made of a path of the
+   shared route-server table.  A client sees the path's own attribute
+   unless its slot is denied or has an attribute of its own. */
+struct bgp_rsclient_delta
+{
+  int slot;
+  struct attr *attr;
+};
+
+struct bgp_info_rsclient
+{
+  /* Clients whose policy denies the path, a bit per slot.  */
+  u_int32_t *denied;
+  unsigned int denied_words;
+
+  /* Clients whose policy changed the attribute, sorted by slot.  */
+  struct bgp_rsclient_delta *delta;
+  unsigned int ndelta;
 };
 
 struct bgp_info
@@ -163,10 +187,30 @@ struct bgp_static
 #define UNSUPPRESS_MAP_NAME(F)  ((F)->usmap.name)
 #define UNSUPPRESS_MAP(F)       ((F)->usmap.map)
 
+/* Selected path of a node, before and after a selection. */
+struct bgp_info_pair
+{
+  struct bgp_info *old;
+  struct bgp_info *new;
+};
+
+/* Advertisements a peer may have queued before announcing the tables
+   to it waits for them to go out; it carries on under half that. */
+#define BGP_ANNOUNCE_QUEUE_MAX 2048
+
+/* Nodes announced to a peer before turning to the next family. */
+#define BGP_ANNOUNCE_NODES       64
+
 enum bgp_clear_route_type
 {
-  BGP_CLEAR_ROUTE_NORMAL,
-  BGP_CLEAR_ROUTE_MY_RSCLIENT
+  BGP_CLEAR_ROUTE_NORMAL
+};
+
+/* Item of a peer's clear_node_queue. */
+struct bgp_clear_node_queue
+{
+  struct bgp_node *rn;
+  enum bgp_clear_route_type purpose;
 };
 
 /* Prototypes. */
@@ -175,6 +219,8 @@ extern void bgp_route_finish (void);
 extern void bgp_cleanup_routes (void);
 extern void bgp_announce_route (struct peer *, afi_t, safi_t);
 extern void bgp_announce_route_all (struct peer *);
+extern void bgp_announce_route_cancel (struct peer *);
+extern void bgp_announce_resume (struct peer *);
 extern void bgp_default_originate (struct peer *, afi_t, safi_t, int);
 extern void bgp_soft_reconfig_in (struct peer *, afi_t, safi_t);
 extern void bgp_soft_reconfig_rsclient (struct peer *, afi_t, safi_t);
@@ -182,6 +228,10 @@ extern void bgp_check_local_routes_rsclient (struct peer *rsclient, afi_t afi, s
 extern void bgp_clear_route (struct peer *, afi_t, safi_t,
                              enum bgp_clear_route_type);
 extern void bgp_clear_route_all (struct peer *);
+extern void bgp_clear_rsclient (struct peer *, afi_t, safi_t);
+extern int bgp_rsclient_slot_new (struct bgp *);
+extern struct bgp_info *bgp_rsclient_view (struct peer *, struct bgp_node *,
+					   struct bgp_info **);
 extern void bgp_clear_adj_in (struct peer *, afi_t, safi_t);
 extern void bgp_clear_stale_route (struct peer *, afi_t, safi_t);
 
@@ -224,6 +274,9 @@ extern int bgp_withdraw (struct peer *, struct prefix *, struct attr *,
 
 /* for bgp_nexthop and bgp_damp */
 extern void bgp_process (struct bgp *, struct bgp_node *, afi_t, safi_t);
+extern void bgp_best_selection (struct bgp *, struct bgp_node *,
+				struct bgp_maxpaths_cfg *,
+				struct bgp_info_pair *);
 extern int bgp_config_write_network (struct vty *, struct bgp *, afi_t, safi_t, int *);
 extern int bgp_config_write_distance (struct vty *, struct bgp *);
 
@@ -231,6 +284,10 @@ extern void bgp_aggregate_increment (struct bgp *, struct prefix *, struct bgp_i
 			      afi_t, safi_t);
 extern void bgp_aggregate_decrement (struct bgp *, struct prefix *, struct bgp_info *,
 			      afi_t, safi_t);
+extern void bgp_aggregate_address_set (struct bgp *, struct prefix *, afi_t,
+				       safi_t, u_char, u_char);
+extern int bgp_aggregate_address_unset (struct bgp *, struct prefix *, afi_t,
+					safi_t);
 
 extern u_char bgp_distance_apply (struct prefix *, struct bgp_info *, struct bgp *);
 
@@ -48,12 +48,6 @@ bgp_table_unlock (struct bgp_table *rt)
   route_table_finish (rt->route_table);
   rt->route_table = NULL;
 
-  if (rt->owner)
-    {
-      peer_unlock (rt->owner);
-      rt->owner = NULL;
-    }
-
   XFREE (MTYPE_BGP_TABLE, rt);
 }
 
@@ -87,6 +81,7 @@ bgp_node_destroy (route_table_delegate_t *delegate,
 {
   struct bgp_node *bgp_node;
   bgp_node = bgp_node_from_rnode (node);
+  XFREE (MTYPE_BGP_PATH_VEC, bgp_node->paths);
   XFREE (MTYPE_BGP_NODE, bgp_node);
 }
 
@@ -39,9 +39,6 @@ struct bgp_table
   
   int lock;
 
-  /* The owner of this 'bgp_table' structure. */
-  struct peer *owner;
-
   struct route_table *route_table;
 };
 
@@ -59,7 +56,8 @@ struct bgp_node
 
   struct bgp_adj_out *adj_out;
 
-  struct bgp_adj_in *adj_in;
+  /* Decision keys of the paths at info, see bgp_best_selection. */
+  struct bgp_path_vec *paths;
 
   struct bgp_node *prn;
 
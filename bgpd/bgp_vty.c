@@ -286,6 +286,32 @@ DEFUN (no_bgp_config_type,
   return CMD_SUCCESS;
 }
 
+DEFUN (bgp_io_thread,
+       bgp_io_thread_cmd,
+       "bgp io-thread",
+       BGP_STR
+       "Read and write Established sessions on a separate thread\n")
+{
+#ifndef HAVE_PTHREAD
+  vty_out (vty, "%% BGP I/O thread is not supported%s", VTY_NEWLINE);
+  return CMD_WARNING;
+#else
+  bgp_option_set (BGP_OPT_IO_THREAD);
+  return CMD_SUCCESS;
+#endif /* HAVE_PTHREAD */
+}
+
+DEFUN (no_bgp_io_thread,
+       no_bgp_io_thread_cmd,
+       "no bgp io-thread",
+       NO_STR
+       BGP_STR
+       "Read and write Established sessions on a separate thread\n")
+{
+  bgp_option_unset (BGP_OPT_IO_THREAD);
+  return CMD_SUCCESS;
+}
+
 DEFUN (no_synchronization,
        no_synchronization_cmd,
        "no synchronization",
@@ -2272,6 +2298,7 @@ peer_rsclient_set_vty (struct vty *vty, const char *peer_str,
   if ( ! peer_rsclient_active (peer) )
     {
       peer = peer_lock (peer); /* rsclient peer list reference */
+      peer->rsclient_slot = bgp_rsclient_slot_new (bgp);
       listnode_add_sort (bgp->rsclient, peer);
       locked_and_added = 1;
     }
@@ -2288,11 +2315,6 @@ peer_rsclient_set_vty (struct vty *vty, const char *peer_str,
       return bgp_vty_return (vty, ret);
     }
 
-  peer->rib[afi][safi] = bgp_table_init (afi, safi);
-  peer->rib[afi][safi]->type = BGP_TABLE_RSCLIENT;
-  /* RIB peer reference.  Released when table is free'd in bgp_table_free. */
-  peer->rib[afi][safi]->owner = peer_lock (peer);
-
   /* Check for existing 'network' and 'redistribute' routes. */
   bgp_check_local_routes_rsclient (peer, afi, safi);
 
@@ -2314,9 +2336,6 @@ peer_rsclient_set_vty (struct vty *vty, const char *peer_str,
           if (ret < 0)
             return bgp_vty_return (vty, ret);
 
-          /* Make peer's RIB point to group's RIB. */
-          peer->rib[afi][safi] = group->conf->rib[afi][safi];
-
           /* Import policy. */
           if (pfilter->map[RMAP_IMPORT].name)
             free (pfilter->map[RMAP_IMPORT].name);
@@ -2371,8 +2390,6 @@ peer_rsclient_unset_vty (struct vty *vty, const char *peer_str,
           ret = peer_af_flag_unset (peer, afi, safi, PEER_FLAG_RSERVER_CLIENT);
           if (ret < 0)
             return bgp_vty_return (vty, ret);
-
-          peer->rib[afi][safi] = NULL;
         }
 
         peer = group->conf;
@@ -2382,15 +2399,14 @@ peer_rsclient_unset_vty (struct vty *vty, const char *peer_str,
   if (ret < 0)
     return bgp_vty_return (vty, ret);
 
+  bgp_clear_rsclient (peer, afi, safi);
+
   if ( ! peer_rsclient_active (peer) )
     {
-      bgp_clear_route (peer, afi, safi, BGP_CLEAR_ROUTE_MY_RSCLIENT);
       listnode_delete (bgp->rsclient, peer);
       peer_unlock (peer); /* peer bgp rsclient reference */
     }
 
-  bgp_table_finish (&peer->rib[bgp_node_afi(vty)][bgp_node_safi(vty)]);
-
   return CMD_SUCCESS;
 }
 
@@ -6762,6 +6778,7 @@ DEFUN (show_bgp_memory,
 {
   char memstrbuf[MTYPE_MEMSTR_LEN];
   unsigned long count;
+  unsigned long bytes;
   
   /* RIB related usage stats */
   count = mtype_stats_alloc (MTYPE_BGP_NODE);
@@ -6788,15 +6805,13 @@ DEFUN (show_bgp_memory,
              VTY_NEWLINE);
   
   /* Adj-In/Out */
-  if ((count = mtype_stats_alloc (MTYPE_BGP_ADJ_IN)))
+  if ((count = bgp_adj_in_stats (&bytes)))
     vty_out (vty, "%ld Adj-In entries, using %s of memory%s", count,
-             mtype_memstr (memstrbuf, sizeof (memstrbuf),
-                           count * sizeof (struct bgp_adj_in)),
+             mtype_memstr (memstrbuf, sizeof (memstrbuf), bytes),
              VTY_NEWLINE);
-  if ((count = mtype_stats_alloc (MTYPE_BGP_ADJ_OUT)))
+  if ((count = bgp_adj_out_stats (&bytes)))
     vty_out (vty, "%ld Adj-Out entries, using %s of memory%s", count,
-             mtype_memstr (memstrbuf, sizeof (memstrbuf),
-                           count * sizeof (struct bgp_adj_out)),
+             mtype_memstr (memstrbuf, sizeof (memstrbuf), bytes),
              VTY_NEWLINE);
   
   if ((count = mtype_stats_alloc (MTYPE_BGP_NEXTHOP_CACHE)))
@@ -7582,6 +7597,9 @@ bgp_show_peer (struct vty *vty, struct peer *p)
   /* Configured timer values. */
   vty_out (vty, ", hold time is %d, keepalive interval is %d seconds%s",
 	   p->v_holdtime, p->v_keepalive, VTY_NEWLINE);
+  if (p->io)
+    vty_out (vty, "  Socket read and written by the I/O thread%s",
+	     VTY_NEWLINE);
   if (CHECK_FLAG (p->config, PEER_CONFIG_TIMER))
     {
       vty_out (vty, "  Configured hold time is %d", p->holdtime);
@@ -7761,6 +7779,10 @@ bgp_show_peer (struct vty *vty, struct peer *p)
 	   p->update_out + p->keepalive_out + p->refresh_out + p->dynamic_cap_out,
 	   p->open_in + p->notify_in + p->update_in + p->keepalive_in + p->refresh_in +
 	   p->dynamic_cap_in, VTY_NEWLINE);
+  if (p->read_chunks)
+    vty_out (vty, "    Messages per read: %.2f (%u in %u reads)%s",
+	     (double) p->read_msgs / p->read_chunks, p->read_msgs,
+	     p->read_chunks, VTY_NEWLINE);
 
   /* advertisement-interval */
   vty_out (vty, "  Minimum time between advertisement runs is %d seconds%s",
@@ -9082,6 +9104,10 @@ bgp_vty_init (void)
   install_element (CONFIG_NODE, &bgp_config_type_cmd);
   install_element (CONFIG_NODE, &no_bgp_config_type_cmd);
 
+  /* "bgp io-thread" commands. */
+  install_element (CONFIG_NODE, &bgp_io_thread_cmd);
+  install_element (CONFIG_NODE, &no_bgp_io_thread_cmd);
+
   /* Dummy commands (Currently not supported) */
   install_element (BGP_NODE, &no_synchronization_cmd);
   install_element (BGP_NODE, &no_auto_summary_cmd);
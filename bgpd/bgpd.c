@@ -58,6 +58,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_network.h"
 #include "bgpd/bgp_vty.h"
 #include "bgpd/bgp_mpath.h"
+#include "bgpd/bgp_io.h"
 #ifdef HAVE_SNMP
 #include "bgpd/bgp_snmp.h"
 #endif /* HAVE_SNMP */
@@ -83,6 +84,7 @@ bgp_option_set (int flag)
     case BGP_OPT_MULTIPLE_INSTANCE:
     case BGP_OPT_CONFIG_CISCO:
     case BGP_OPT_NO_LISTEN:
+    case BGP_OPT_IO_THREAD:
       SET_FLAG (bm->options, flag);
       break;
     default:
@@ -102,6 +104,7 @@ bgp_option_unset (int flag)
       /* Fall through.  */
     case BGP_OPT_NO_FIB:
     case BGP_OPT_CONFIG_CISCO:
+    case BGP_OPT_IO_THREAD:
       UNSET_FLAG (bm->options, flag);
       break;
     default:
@@ -705,17 +708,54 @@ peer_sort (struct peer *peer)
   return peer->sort;
 }
 
+/* Give PEER the lowest slot free in its BGP instance.  */
+static void
+peer_slot_new (struct peer *peer)
+{
+  struct bgp *bgp = peer->bgp;
+  int i;
+
+  for (i = 0; i < bgp->peer_slot_words; i++)
+    if (bgp->peer_slot[i] != 0xffffffff)
+      break;
+
+  if (i == bgp->peer_slot_words)
+    {
+      bgp->peer_slot = XREALLOC (MTYPE_BGP_PEER_SLOT, bgp->peer_slot,
+				 (i + 1) * sizeof (u_int32_t));
+      bgp->peer_slot[i] = 0;
+      bgp->peer_slot_words++;
+    }
+
+  for (peer->slot = i * 32; bgp->peer_slot[i] & (1U << (peer->slot % 32));
+       peer->slot++)
+    ;
+  bgp->peer_slot[i] |= 1U << (peer->slot % 32);
+}
+
+/* Free the slot of PEER, once nothing is recorded in it.  */
+static void
+peer_slot_free (struct peer *peer)
+{
+  peer->bgp->peer_slot[peer->slot / 32] &= ~(1U << (peer->slot % 32));
+}
+
 static void
 peer_free (struct peer *peer)
 {
+  afi_t afi;
+  safi_t safi;
+
   assert (peer->status == Deleted);
 
+  peer_slot_free (peer);
   bgp_unlock(peer->bgp);
 
   /* this /ought/ to have been done already through bgp_stop earlier,
    * but just to be sure.. 
    */
   bgp_timer_set (peer);
+  bgp_io_detach (peer);
   BGP_READ_OFF (peer->t_read);
   BGP_WRITE_OFF (peer->t_write);
   BGP_EVENT_FLUSH (peer);
@@ -737,6 +777,10 @@ peer_free (struct peer *peer)
   if (peer->clear_node_queue)
     work_queue_free (peer->clear_node_queue);
   
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      bgp_adj_in_finish (&peer->adj_in[afi][safi]);
+
   bgp_sync_delete (peer);
   memset (peer, 0, sizeof (struct peer));
   
@@ -814,6 +858,7 @@ peer_new (struct bgp *bgp)
   peer->bgp = bgp;
   peer = peer_lock (peer); /* initial reference */
   bgp_lock (bgp);
+  peer_slot_new (peer);
 
   /* Set default flags.  */
   for (afi = AFI_IP; afi < AFI_MAX; afi++)
@@ -1250,21 +1295,15 @@ peer_delete (struct peer *peer)
       peer_unlock (peer); /* rsclient list reference */
       list_delete_node (bgp->rsclient, pn);
 
-      /* Clear our own rsclient ribs. */
+      /* Forget what our policy made of the shared rsclient ribs. */
       for (afi = AFI_IP; afi < AFI_MAX; afi++)
         for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
           if (CHECK_FLAG(peer->af_flags[afi][safi],
-                         PEER_FLAG_RSERVER_CLIENT))
-            bgp_clear_route (peer, afi, safi, BGP_CLEAR_ROUTE_MY_RSCLIENT);
+                         PEER_FLAG_RSERVER_CLIENT)
+              && ! peer->af_group[afi][safi])
+            bgp_clear_rsclient (peer, afi, safi);
     }
 
-  /* Free RIB for any family in which peer is RSERVER_CLIENT, and is not
-      member of a peer_group. */
-  for (afi = AFI_IP; afi < AFI_MAX; afi++)
-    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
-      if (peer->rib[afi][safi] && ! peer->af_group[afi][safi])
-        bgp_table_finish (&peer->rib[afi][safi]);
-
   /* Buffers.  */
   if (peer->ibuf)
     stream_free (peer->ibuf);
@@ -1272,8 +1311,10 @@ peer_delete (struct peer *peer)
     stream_fifo_free (peer->obuf);
   if (peer->work)
     stream_free (peer->work);
+  if (peer->rbuf)
+    stream_free (peer->rbuf);
   peer->obuf = NULL;
-  peer->work = peer->ibuf = NULL;
+  peer->work = peer->ibuf = peer->rbuf = NULL;
 
   /* Local and remote addresses. */
   if (peer->su_local)
@@ -1473,9 +1514,6 @@ peer_group2peer_config_copy (struct peer_group *group, struct peer *peer,
   /* route-server-client */
   if (CHECK_FLAG(conf->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
     {
-      /* Make peer's RIB point to group's RIB. */
-      peer->rib[afi][safi] = group->conf->rib[afi][safi];
-
       /* Import policy. */
       if (pfilter->map[RMAP_IMPORT].name)
         free (pfilter->map[RMAP_IMPORT].name);
@@ -1842,12 +1880,11 @@ peer_group_bind (struct bgp *bgp, union sockunion *su,
         {
           peer_unlock (peer); /* peer rsclient reference */
           list_delete_node (bgp->rsclient, pn);
-
-          /* Clear our own rsclient rib for this afi/safi. */
-          bgp_clear_route (peer, afi, safi, BGP_CLEAR_ROUTE_MY_RSCLIENT);
         }
 
-      bgp_table_finish (&peer->rib[afi][safi]);
+      /* Forget what our policy made of the shared rsclient rib, the
+         group's now applies. */
+      bgp_clear_rsclient (peer, afi, safi);
 
       /* Import policy. */
       if (peer->filter[afi][safi].map[RMAP_IMPORT].name)
@@ -1895,9 +1932,6 @@ peer_group_unbind (struct bgp *bgp, struct peer *peer,
   peer->afc[afi][safi] = 0;
   peer_af_flag_reset (peer, afi, safi);
 
-  if (peer->rib[afi][safi])
-    peer->rib[afi][safi] = NULL;
-
   if (! peer_group_active (peer))
     {
       assert (listnode_lookup (group->peer, peer));
@@ -1954,6 +1988,8 @@ bgp_create (as_t *as, const char *name)
 	bgp->route[afi][safi] = bgp_table_init (afi, safi);
 	bgp->aggregate[afi][safi] = bgp_table_init (afi, safi);
 	bgp->rib[afi][safi] = bgp_table_init (afi, safi);
+	bgp->rsclient_rib[afi][safi] = bgp_table_init (afi, safi);
+	bgp->rsclient_rib[afi][safi]->type = BGP_TABLE_RSCLIENT;
 	bgp->maxpaths[afi][safi].maxpaths_ebgp = BGP_DEFAULT_MAXPATHS;
 	bgp->maxpaths[afi][safi].maxpaths_ibgp = BGP_DEFAULT_MAXPATHS;
       }
@@ -2144,6 +2180,7 @@ bgp_free (struct bgp *bgp)
   list_delete (bgp->group);
   list_delete (bgp->peer);
   list_delete (bgp->rsclient);
+  XFREE (MTYPE_BGP_PEER_SLOT, bgp->peer_slot);
 
   if (bgp->name)
     free (bgp->name);
@@ -2157,6 +2194,8 @@ bgp_free (struct bgp *bgp)
           bgp_table_finish (&bgp->aggregate[afi][safi]) ;
 	if (bgp->rib[afi][safi])
           bgp_table_finish (&bgp->rib[afi][safi]);
+	if (bgp->rsclient_rib[afi][safi])
+          bgp_table_finish (&bgp->rsclient_rib[afi][safi]);
       }
   XFREE (MTYPE_BGP, bgp);
 }
@@ -5183,6 +5222,13 @@ bgp_config_write (struct vty *vty)
       write++;
     }
 
+  /* BGP I/O thread. */
+  if (bgp_option_check (BGP_OPT_IO_THREAD))
+    {
+      vty_out (vty, "bgp io-thread%s", VTY_NEWLINE);
+      write++;
+    }
+
   /* BGP configuration. */
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
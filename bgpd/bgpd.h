@@ -60,6 +60,7 @@ struct bgp_master
 #define BGP_OPT_MULTIPLE_INSTANCE        (1 << 1)
 #define BGP_OPT_CONFIG_CISCO             (1 << 2)
 #define BGP_OPT_NO_LISTEN                (1 << 3)
+#define BGP_OPT_IO_THREAD                (1 << 4)
 };
 
 /* BGP instance structure.  */
@@ -86,6 +87,10 @@ struct bgp
   /* BGP route-server-clients. */
   struct list *rsclient;
 
+  /* Slots of peers, a bit each, set while in use.  */
+  u_int32_t *peer_slot;
+  int peer_slot_words;
+
   /* BGP configuration.  */
   u_int16_t config;
 #define BGP_CONFIG_ROUTER_ID              (1 << 0)
@@ -134,6 +139,9 @@ struct bgp
   /* BGP routing information base.  */
   struct bgp_table *rib[AFI_MAX][SAFI_MAX];
 
+  /* Paths offered to route-server clients, shared by all of them.  */
+  struct bgp_table *rsclient_rib[AFI_MAX][SAFI_MAX];
+
   /* BGP redistribute configuration. */
   u_char redist[AFI_MAX][ZEBRA_ROUTE_MAX];
 
@@ -304,14 +312,24 @@ struct peer
   /* Local router ID. */
   struct in_addr local_id;
 
-  /* Peer specific RIB when configured as route-server-client. */
-  struct bgp_table *rib[AFI_MAX][SAFI_MAX];
+  /* Slot of a route-server client in the outcomes recorded for the
+     paths of bgp->rsclient_rib. */
+  int rsclient_slot;
+
+  /* Bit of the peer in the adjacencies out of the prefixes of BGP.  */
+  int slot;
 
   /* Packet receive and send buffer. */
   struct stream *ibuf;
   struct stream_fifo *obuf;
   struct stream *work;
 
+  /* Chunks read from an Established session, see bgp_read(). */
+  struct stream *rbuf;
+
+  /* Socket handed to the I/O thread, when Established. */
+  struct bgp_io *io;
+
   /* Status of the peer. */
   int status;
   int ostatus;
@@ -470,6 +488,7 @@ struct peer
   struct thread *t_pmax_restart;
   struct thread *t_gr_restart;
   struct thread *t_gr_stale;
+  struct thread *t_announce;
   
   /* workqueues */
   struct work_queue *clear_node_queue;
@@ -488,6 +507,8 @@ struct peer
   u_int32_t refresh_out;	/* Route Refresh output count */
   u_int32_t dynamic_cap_in;	/* Dynamic Capability input count.  */
   u_int32_t dynamic_cap_out;	/* Dynamic Capability output count.  */
+  u_int32_t read_chunks;	/* Reads of an Established session */
+  u_int32_t read_msgs;		/* Messages those reads completed */
 
   /* BGP state count */
   u_int32_t established;	/* Established */
@@ -497,12 +518,18 @@ struct peer
   struct bgp_synchronize *sync[AFI_MAX][SAFI_MAX];
   time_t synctime;
 
+  /* Tables being announced, a slice at a time, see bgp_announce_route.  */
+  struct bgp_announce *announce[AFI_MAX][SAFI_MAX];
+
   /* Send prefix count. */
   unsigned long scount[AFI_MAX][SAFI_MAX];
 
   /* Announcement attribute hash.  */
   struct hash *hash[AFI_MAX][SAFI_MAX];
 
+  /* Routes received before policy, for soft-reconfiguration inbound.  */
+  struct bgp_adj_in *adj_in[AFI_MAX][SAFI_MAX];
+
   /* Notify data. */
   struct bgp_notify notify;
 
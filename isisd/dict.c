@@ -54,6 +54,17 @@
 #define dict_nil(D) (&(D)->nilnode)
 #define DICT_DEPTH_MAX 64
 
+/*
+ * Checks which walk the whole tree.  They make every insertion and
+ * deletion linear in the size of the dictionary, so they are only made
+ * when DICT_DEBUG is defined.
+ */
+#ifdef DICT_DEBUG
+#define dict_assert_slow(x) assert (x)
+#else
+#define dict_assert_slow(x) ((void) 0)
+#endif
+
 static dnode_t *dnode_alloc(void *context);
 static void dnode_free(dnode_t *node, void *context);
 
@@ -537,7 +548,7 @@ void dict_insert(dict_t *dict, dnode_t *node, const void *key)
     node->key = key;
 
     assert (!dict_isfull(dict));
-    assert (!dict_contains(dict, node));
+    dict_assert_slow (!dict_contains(dict, node));
     assert (!dnode_is_in_a_dict(node));
 
     /* basic binary tree insert */
@@ -616,7 +627,7 @@ void dict_insert(dict_t *dict, dnode_t *node, const void *key)
 
     dict_root(dict)->color = dnode_black;
 
-    assert (dict_verify(dict));
+    dict_assert_slow (dict_verify(dict));
 }
 
 /*
@@ -632,7 +643,7 @@ dnode_t *dict_delete(dict_t *dict, dnode_t *delete)
     /* basic deletion */
 
     assert (!dict_isempty(dict));
-    assert (dict_contains(dict, delete));
+    dict_assert_slow (dict_contains(dict, delete));
 
     /*
      * If the node being deleted has two children, then we replace it with its
@@ -712,7 +723,7 @@ dnode_t *dict_delete(dict_t *dict, dnode_t *delete)
 
     dict->nodecount--;
 
-    assert (verify_bintree(dict));
+    dict_assert_slow (verify_bintree(dict));
 
     /* red-black adjustments */
 
@@ -789,7 +800,7 @@ dnode_t *dict_delete(dict_t *dict, dnode_t *delete)
 	dict_root(dict)->color = dnode_black;
     }
 
-    assert (dict_verify(dict));
+    dict_assert_slow (dict_verify(dict));
 
     return delete;
 }
@@ -36,8 +36,8 @@
 #include "isisd/include-netbsd/iso.h"
 #include "isisd/isis_constants.h"
 #include "isisd/isis_common.h"
-#include "isisd/isis_circuit.h"
 #include "isisd/isis_flags.h"
+#include "isisd/isis_circuit.h"
 #include "isisd/isisd.h"
 #include "isisd/isis_constants.h"
 #include "isisd/isis_circuit.h"
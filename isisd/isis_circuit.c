@@ -144,6 +144,8 @@ void
 isis_circuit_deconfigure (struct isis_circuit *circuit, struct isis_area *area)
 {
   /* Free the index of SRM and SSN flags */
+  flags_circuit_clear_all (circuit, ISIS_FLAG_SRM);
+  flags_circuit_clear_all (circuit, ISIS_FLAG_SSN);
   flags_free_index (&area->flags, circuit->idx);
   circuit->idx = 0;
   /* Remove circuit from area */
@@ -552,6 +554,14 @@ isis_circuit_update_all_srmflags (struct isis_circuit *circuit, int is_set)
   assert (circuit);
   area = circuit->area;
   assert (area);
+
+  /* Only the LSPs queued on the circuit need looking at to clear. */
+  if (! is_set)
+    {
+      flags_circuit_clear_all (circuit, ISIS_FLAG_SRM);
+      return;
+    }
+
   for (level = ISIS_LEVEL1; level <= ISIS_LEVEL2; level++)
     {
       if (level & circuit->is_type)
@@ -564,14 +574,7 @@ isis_circuit_update_all_srmflags (struct isis_circuit *circuit, int is_set)
                 {
                   dnode_next = dict_next (area->lspdb[level - 1], dnode);
                   lsp = dnode_get (dnode);
-                  if (is_set)
-                    {
-                      ISIS_SET_FLAG (lsp->SRMflags, circuit);
-                    }
-                  else
-                    {
-                      ISIS_CLEAR_FLAG (lsp->SRMflags, circuit);
-                    }
+                  flags_lsp_set (lsp, circuit, ISIS_FLAG_SRM);
                 }
             }
         }
@@ -702,7 +705,6 @@ isis_circuit_up (struct isis_circuit *circuit)
                    circuit->fd);
 #endif
 
-  circuit->lsp_queue = list_new ();
   circuit->lsp_queue_last_cleared = time (NULL);
 
   return ISIS_OK;
@@ -777,13 +779,8 @@ isis_circuit_down (struct isis_circuit *circuit)
   THREAD_TIMER_OFF (circuit->t_send_psnp[0]);
   THREAD_TIMER_OFF (circuit->t_send_psnp[1]);
   THREAD_OFF (circuit->t_read);
-
-  if (circuit->lsp_queue)
-    {
-      circuit->lsp_queue->del = NULL;
-      list_delete (circuit->lsp_queue);
-      circuit->lsp_queue = NULL;
-    }
+  THREAD_OFF (circuit->t_send_lsp);
+  circuit->lsp_send_next = NULL;
 
   /* send one gratuitous hello to spead up convergence */
   if (circuit->is_type & IS_LEVEL_1)
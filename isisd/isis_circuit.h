@@ -75,7 +75,11 @@ struct isis_circuit
   struct thread *t_read;
   struct thread *t_send_csnp[2];
   struct thread *t_send_psnp[2];
-  struct list *lsp_queue;	/* LSPs to be txed (both levels) */
+  struct thread *t_send_lsp;
+  /* LSPs with SRM and SSN set on this circuit (both levels) */
+  struct isis_flag_queue flag_queue[ISIS_FLAGS];
+  /* next LSP of the SRM queue to send in this round, NULL between rounds */
+  struct isis_flag_entry *lsp_send_next;
   time_t lsp_queue_last_cleared;/* timestamp used to enforce transmit interval;
                                  * for scalability, use one timestamp per 
                                  * circuit, instead of one per lsp per circuit
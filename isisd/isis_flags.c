@@ -24,10 +24,18 @@
 #include <zebra.h>
 #include "log.h"
 #include "linklist.h"
+#include "memory.h"
+#include "vty.h"
+#include "stream.h"
+#include "if.h"
 
+#include "isisd/dict.h"
 #include "isisd/isis_constants.h"
 #include "isisd/isis_common.h"
 #include "isisd/isis_flags.h"
+#include "isisd/isis_circuit.h"
+#include "isisd/isis_tlv.h"
+#include "isisd/isis_lsp.h"
 
 void
 flags_initialize (struct flags *flags)
@@ -84,3 +92,144 @@ flags_any_set (u_int32_t * flags)
 
   return bcmp (flags, zero, ISIS_MAX_CIRCUITS * 4);
 }
+
+static u_int32_t *
+flags_bits (struct isis_lsp *lsp, int flag)
+{
+  return (flag == ISIS_FLAG_SRM) ? lsp->SRMflags : lsp->SSNflags;
+}
+
+/* Entry for an LSP on the queues of a circuit, created if need be. */
+static struct isis_flag_entry *
+flags_entry_get (struct isis_lsp *lsp, struct isis_circuit *circuit)
+{
+  struct isis_flag_entry *entry;
+  int size;
+
+  if (circuit->idx >= lsp->flag_table_size)
+    {
+      size = (circuit->idx | 0x1F) + 1;
+      lsp->flag_table = XREALLOC (MTYPE_ISIS_FLAGS, lsp->flag_table,
+                                  size * sizeof (struct isis_flag_entry *));
+      memset (lsp->flag_table + lsp->flag_table_size, 0,
+              (size - lsp->flag_table_size) *
+              sizeof (struct isis_flag_entry *));
+      lsp->flag_table_size = size;
+    }
+
+  entry = lsp->flag_table[circuit->idx];
+  if (entry == NULL)
+    {
+      entry = XCALLOC (MTYPE_ISIS_FLAG_ENTRY, sizeof (struct isis_flag_entry));
+      entry->lsp = lsp;
+      entry->circuit = circuit;
+      lsp->flag_table[circuit->idx] = entry;
+      lsp->flag_entries++;
+    }
+
+  return entry;
+}
+
+/* Free the entry once neither flag is set for its circuit. */
+static void
+flags_entry_put (struct isis_flag_entry *entry)
+{
+  struct isis_lsp *lsp = entry->lsp;
+  struct isis_circuit *circuit = entry->circuit;
+
+  if (ISIS_CHECK_FLAG (lsp->SRMflags, circuit)
+      || ISIS_CHECK_FLAG (lsp->SSNflags, circuit))
+    return;
+
+  lsp->flag_table[circuit->idx] = NULL;
+  XFREE (MTYPE_ISIS_FLAG_ENTRY, entry);
+
+  if (--lsp->flag_entries == 0)
+    {
+      XFREE (MTYPE_ISIS_FLAGS, lsp->flag_table);
+      lsp->flag_table_size = 0;
+    }
+}
+
+void
+flags_lsp_set (struct isis_lsp *lsp, struct isis_circuit *circuit, int flag)
+{
+  u_int32_t *bits = flags_bits (lsp, flag);
+  struct isis_flag_queue *queue = &circuit->flag_queue[flag];
+  struct isis_flag_entry *entry;
+
+  if (ISIS_CHECK_FLAG (bits, circuit))
+    return;
+  bits[circuit->idx >> 5] |= (1 << (circuit->idx & 0x1F));
+
+  entry = flags_entry_get (lsp, circuit);
+  entry->link[flag].next = NULL;
+  entry->link[flag].prev = queue->tail;
+  if (queue->tail)
+    queue->tail->link[flag].next = entry;
+  else
+    queue->head = entry;
+  queue->tail = entry;
+  queue->count++;
+}
+
+void
+flags_lsp_clear (struct isis_lsp *lsp, struct isis_circuit *circuit, int flag)
+{
+  u_int32_t *bits = flags_bits (lsp, flag);
+  struct isis_flag_queue *queue = &circuit->flag_queue[flag];
+  struct isis_flag_entry *entry;
+
+  if (! ISIS_CHECK_FLAG (bits, circuit))
+    return;
+  bits[circuit->idx >> 5] &= ~(1 << (circuit->idx & 0x1F));
+
+  entry = lsp->flag_table[circuit->idx];
+
+  /* Keep the send round going past an LSP that is no longer due. */
+  if (flag == ISIS_FLAG_SRM && circuit->lsp_send_next == entry)
+    circuit->lsp_send_next = entry->link[flag].next;
+
+  if (entry->link[flag].prev)
+    entry->link[flag].prev->link[flag].next = entry->link[flag].next;
+  else
+    queue->head = entry->link[flag].next;
+  if (entry->link[flag].next)
+    entry->link[flag].next->link[flag].prev = entry->link[flag].prev;
+  else
+    queue->tail = entry->link[flag].prev;
+  queue->count--;
+
+  flags_entry_put (entry);
+}
+
+/* Clear a flag for every circuit it is set for. */
+void
+flags_lsp_clear_all (struct isis_lsp *lsp, int flag)
+{
+  u_int32_t *bits = flags_bits (lsp, flag);
+  struct isis_flag_entry *entry;
+  int idx;
+
+  for (idx = 0; idx < lsp->flag_table_size; idx++)
+    {
+      entry = lsp->flag_table[idx];
+      if (entry && ISIS_CHECK_FLAG (bits, entry->circuit))
+        {
+          flags_lsp_clear (lsp, entry->circuit, flag);
+          /* The table goes with the last entry. */
+          if (lsp->flag_table == NULL)
+            break;
+        }
+    }
+}
+
+/* Clear a flag for every LSP it is set for on a circuit. */
+void
+flags_circuit_clear_all (struct isis_circuit *circuit, int flag)
+{
+  struct isis_flag_entry *entry;
+
+  while ((entry = circuit->flag_queue[flag].head) != NULL)
+    flags_lsp_clear (entry->lsp, circuit, flag);
+}
@@ -37,32 +37,51 @@ struct flags
   struct list *free_idcs;
 };
 
+struct isis_lsp;
+struct isis_circuit;
+
+/*
+ * An LSP with its SRM or SSN flag set for a circuit is also linked on
+ * the circuit's queue for that flag, so that what is to be sent on a
+ * circuit is found without walking the LSP database.  The entry linking
+ * an LSP on the queues of one circuit is reached from the LSP through
+ * the circuit index, like the flag bits, and exists only while one of
+ * the two flags is set.
+ */
+#define ISIS_FLAG_SRM 0
+#define ISIS_FLAG_SSN 1
+#define ISIS_FLAGS    2
+
+struct isis_flag_entry
+{
+  struct isis_lsp *lsp;
+  struct isis_circuit *circuit;
+  struct
+  {
+    struct isis_flag_entry *next;
+    struct isis_flag_entry *prev;
+  } link[ISIS_FLAGS];
+};
+
+struct isis_flag_queue
+{
+  struct isis_flag_entry *head;
+  struct isis_flag_entry *tail;
+  unsigned long count;
+};
+
 void flags_initialize (struct flags *flags);
 long int flags_get_index (struct flags *flags);
 void flags_free_index (struct flags *flags, long int index);
 int flags_any_set (u_int32_t * flags);
 
-#define ISIS_SET_FLAG(F,C) \
-        { \
-          F[C->idx>>5] |= (1<<(C->idx & 0x1F)); \
-        }
-
-#define ISIS_CLEAR_FLAG(F,C) \
-        { \
-          F[C->idx>>5] &= ~(1<<(C->idx & 0x1F)); \
-        }
+void flags_lsp_set (struct isis_lsp *lsp, struct isis_circuit *circuit,
+                    int flag);
+void flags_lsp_clear (struct isis_lsp *lsp, struct isis_circuit *circuit,
+                      int flag);
+void flags_lsp_clear_all (struct isis_lsp *lsp, int flag);
+void flags_circuit_clear_all (struct isis_circuit *circuit, int flag);
 
 #define ISIS_CHECK_FLAG(F, C)  (F[(C)->idx>>5] & (1<<(C->idx & 0x1F)))
 
-/* sets all u_32int_t flags to 1 */
-#define ISIS_FLAGS_SET_ALL(FLAGS) \
-        { \
-          memset(FLAGS,0xFF,ISIS_MAX_CIRCUITS*4); \
-        }
-
-#define ISIS_FLAGS_CLEAR_ALL(FLAGS) \
-        { \
-          memset(FLAGS,0x00,ISIS_MAX_CIRCUITS*4); \
-        }
-
 #endif /* _ZEBRA_ISIS_FLAGS_H */
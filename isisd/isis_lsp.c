@@ -35,6 +35,7 @@
 #include "if.h"
 #include "checksum.h"
 #include "md5.h"
+#include "jhash.h"
 
 #include "isisd/dict.h"
 #include "isisd/isis_constants.h"
@@ -62,6 +63,7 @@ static int lsp_l1_refresh (struct thread *thread);
 static int lsp_l2_refresh (struct thread *thread);
 static int lsp_l1_refresh_pseudo (struct thread *thread);
 static int lsp_l2_refresh_pseudo (struct thread *thread);
+static void lsp_lifetime_start (struct isis_lsp *lsp);
 
 int
 lsp_id_cmp (u_char * id1, u_char * id2)
@@ -69,12 +71,66 @@ lsp_id_cmp (u_char * id1, u_char * id2)
   return memcmp (id1, id2, ISIS_SYS_ID_LEN + 2);
 }
 
+/*
+ * The dict keeps the LSPs in LSP ID order for CSNPs and show commands;
+ * point lookups go through a hash of the same dict nodes, kept in the
+ * dict context, which the default node allocator does not use.  Every
+ * insertion into and deletion from an lspdb must go through
+ * lspdb_insert() and lspdb_delete() to keep the two in step.
+ */
+#define LSPDB_HASH(D) ((struct hash *) (D)->dict_context)
+
+static unsigned int
+lspdb_hash_key (void *p)
+{
+  dnode_t *dnode = p;
+
+  return jhash ((void *) dnode_getkey (dnode), ISIS_SYS_ID_LEN + 2, 0);
+}
+
+static int
+lspdb_hash_cmp (const void *p1, const void *p2)
+{
+  const dnode_t *d1 = p1, *d2 = p2;
+
+  return memcmp (d1->dict_key, d2->dict_key, ISIS_SYS_ID_LEN + 2) == 0;
+}
+
+static dnode_t *
+lspdb_lookup (dict_t * lspdb, const u_char * id)
+{
+  dnode_t key;
+
+  key.dict_key = id;
+  return hash_lookup (LSPDB_HASH (lspdb), &key);
+}
+
+static void
+lspdb_insert (dict_t * lspdb, struct isis_lsp *lsp)
+{
+  dnode_t *dnode;
+
+  dnode = dnode_create (lsp);
+  dict_insert (lspdb, dnode, lsp->lsp_header->lsp_id);
+  hash_get (LSPDB_HASH (lspdb), dnode, hash_alloc_intern);
+}
+
+/* Unlink a node; its key must still be valid, so call this before the
+ * LSP is destroyed. */
+static dnode_t *
+lspdb_delete (dict_t * lspdb, dnode_t * dnode)
+{
+  hash_release (LSPDB_HASH (lspdb), dnode);
+  return dict_delete (lspdb, dnode);
+}
+
 dict_t *
 lsp_db_init (void)
 {
   dict_t *dict;
 
   dict = dict_create (DICTCOUNT_T_MAX, (dict_comp_t) lsp_id_cmp);
+  dict->dict_context = hash_create (lspdb_hash_key, lspdb_hash_cmp);
 
   return dict;
 }
@@ -95,7 +151,7 @@ lsp_search (u_char * id, dict_t * lspdb)
     }
 #endif /* EXTREME DEBUG */
 
-  node = dict_lookup (lspdb, id);
+  node = lspdb_lookup (lspdb, id);
 
   if (node)
     return (struct isis_lsp *) dnode_get (node);
@@ -128,23 +184,12 @@ lsp_clear_data (struct isis_lsp *lsp)
 static void
 lsp_destroy (struct isis_lsp *lsp)
 {
-  struct listnode *cnode, *lnode, *lnnode;
-  struct isis_lsp *lsp_in_list;
-  struct isis_circuit *circuit;
-
   if (!lsp)
     return;
 
-  for (ALL_LIST_ELEMENTS_RO (lsp->area->circuit_list, cnode, circuit))
-    {
-      if (circuit->lsp_queue == NULL)
-        continue;
-      for (ALL_LIST_ELEMENTS (circuit->lsp_queue, lnode, lnnode, lsp_in_list))
-        if (lsp_in_list == lsp)
-          list_delete_node(circuit->lsp_queue, lnode);
-    }
-  ISIS_FLAGS_CLEAR_ALL (lsp->SSNflags);
-  ISIS_FLAGS_CLEAR_ALL (lsp->SRMflags);
+  wheel_timer_cancel (&lsp->t_lifetime);
+  flags_lsp_clear_all (lsp, ISIS_FLAG_SSN);
+  flags_lsp_clear_all (lsp, ISIS_FLAG_SRM);
 
   lsp_clear_data (lsp);
 
@@ -175,11 +220,12 @@ lsp_db_destroy (dict_t * lspdb)
     {
       next = dict_next (lspdb, dnode);
       lsp = dnode_get (dnode);
+      dnode_destroy (lspdb_delete (lspdb, dnode));
       lsp_destroy (lsp);
-      dict_delete_free (lspdb, dnode);
       dnode = next;
     }
 
+  hash_free (LSPDB_HASH (lspdb));
   dict_free (lspdb);
 
   return;
@@ -197,9 +243,9 @@ lsp_remove_frags (struct list *frags, dict_t * lspdb)
 
   for (ALL_LIST_ELEMENTS (frags, lnode, lnnode, lsp))
     {
-      dnode = dict_lookup (lspdb, lsp->lsp_header->lsp_id);
+      dnode = lspdb_lookup (lspdb, lsp->lsp_header->lsp_id);
+      dnode_destroy (lspdb_delete (lspdb, dnode));
       lsp_destroy (lsp);
-      dnode_destroy (dict_delete (lspdb, dnode));
     }
 
   list_delete_all_node (frags);
@@ -213,10 +259,10 @@ lsp_search_and_destroy (u_char * id, dict_t * lspdb)
   dnode_t *node;
   struct isis_lsp *lsp;
 
-  node = dict_lookup (lspdb, id);
+  node = lspdb_lookup (lspdb, id);
   if (node)
     {
-      node = dict_delete (lspdb, node);
+      node = lspdb_delete (lspdb, node);
       lsp = dnode_get (node);
       /*
        * If this is a zero lsp, remove all the frags now 
@@ -247,6 +293,8 @@ int
 lsp_compare (char *areatag, struct isis_lsp *lsp, u_int32_t seq_num,
 	     u_int16_t checksum, u_int16_t rem_lifetime)
 {
+  lsp_age (lsp);
+
   /* no point in double ntohl on seqnum */
   if (lsp->lsp_header->seq_num == seq_num &&
       lsp->lsp_header->checksum == checksum &&
@@ -478,27 +526,16 @@ lsp_update_data (struct isis_lsp *lsp, struct stream *stream,
   lsp->age_out = ZERO_AGE_LIFETIME;
   lsp->installed = time (NULL);
   /*
-   * Get LSP data i.e. TLVs
+   * Get LSP data i.e. TLVs.  Addresses, neighbours and reachability
+   * are not kept; SPF and the show commands walk them in the PDU
+   * through lsp_tlv_view().
    */
   expected |= TLVFLAG_AUTH_INFO;
-  expected |= TLVFLAG_AREA_ADDRS;
-  expected |= TLVFLAG_IS_NEIGHS;
   expected |= TLVFLAG_NLPID;
   if (area->dynhostname)
     expected |= TLVFLAG_DYN_HOSTNAME;
   if (area->newmetric)
-    {
-      expected |= TLVFLAG_TE_IS_NEIGHS;
-      expected |= TLVFLAG_TE_IPV4_REACHABILITY;
-      expected |= TLVFLAG_TE_ROUTER_ID;
-    }
-  expected |= TLVFLAG_IPV4_ADDR;
-  expected |= TLVFLAG_IPV4_INT_REACHABILITY;
-  expected |= TLVFLAG_IPV4_EXT_REACHABILITY;
-#ifdef HAVE_IPV6
-  expected |= TLVFLAG_IPV6_ADDR;
-  expected |= TLVFLAG_IPV6_REACHABILITY;
-#endif /* HAVE_IPV6 */
+    expected |= TLVFLAG_TE_ROUTER_ID;
 
   retval = parse_tlvs (area->area_tag, STREAM_DATA (lsp->pdu) +
                        ISIS_FIXED_HDR_LEN + ISIS_LSP_HDR_LEN,
@@ -531,9 +568,9 @@ lsp_update (struct isis_lsp *lsp, struct stream *stream,
   /* Remove old LSP from database. This is required since the
    * lsp_update_data will free the lsp->pdu (which has the key, lsp_id)
    * and will update it with the new data in the stream. */
-  dnode = dict_lookup (area->lspdb[level - 1], lsp->lsp_header->lsp_id);
+  dnode = lspdb_lookup (area->lspdb[level - 1], lsp->lsp_header->lsp_id);
   if (dnode)
-    dnode_destroy (dict_delete (area->lspdb[level - 1], dnode));
+    dnode_destroy (lspdb_delete (area->lspdb[level - 1], dnode));
 
   /* rebuild the lsp data */
   lsp_update_data (lsp, stream, area, level);
@@ -623,7 +660,8 @@ lsp_new (u_char * lsp_id, u_int16_t rem_lifetime, u_int32_t seq_num,
 void
 lsp_insert (struct isis_lsp *lsp, dict_t * lspdb)
 {
-  dict_alloc_insert (lspdb, lsp->lsp_header->lsp_id, lsp);
+  lspdb_insert (lspdb, lsp);
+  lsp_lifetime_start (lsp);
   if (lsp->lsp_header->seq_num != 0)
     {
       isis_spf_schedule (lsp->area, lsp->level);
@@ -703,48 +741,104 @@ lsp_build_list (u_char * start_id, u_char * stop_id, u_char num_lsps,
 }
 
 /*
- * Build a list of LSPs with SSN flag set for the given circuit
+ * Build a list of LSPs of a level with SSN flag set for the given circuit
  */
 void
-lsp_build_list_ssn (struct isis_circuit *circuit, u_char num_lsps,
-                    struct list *list, dict_t * lspdb)
+lsp_build_list_ssn (struct isis_circuit *circuit, int level,
+                    u_char num_lsps, struct list *list)
 {
-  dnode_t *dnode, *next;
-  struct isis_lsp *lsp;
+  struct isis_flag_entry *entry;
   u_char count = 0;
 
-  dnode = dict_first (lspdb);
-  while (dnode != NULL)
-    {
-      next = dict_next (lspdb, dnode);
-      lsp = dnode_get (dnode);
-      if (ISIS_CHECK_FLAG (lsp->SSNflags, circuit))
-        {
-          listnode_add (list, lsp);
-          ++count;
-        }
-      if (count == num_lsps)
-        break;
-      dnode = next;
-    }
+  for (entry = circuit->flag_queue[ISIS_FLAG_SSN].head;
+       entry && count < num_lsps; entry = entry->link[ISIS_FLAG_SSN].next)
+    if (entry->lsp->level == level)
+      {
+        listnode_add (list, entry->lsp);
+        ++count;
+      }
 
   return;
 }
 
-static void
-lsp_set_time (struct isis_lsp *lsp)
+/*
+ * Bring rem_lifetime in the header, or age_out once it has reached
+ * zero, up to date from the lifetime timer.  The header keeps a non
+ * zero lifetime until the timer has run, so that tests for zero need
+ * not call this.
+ */
+void
+lsp_age (struct isis_lsp *lsp)
 {
-  assert (lsp);
+  unsigned long remain;
 
+  if (! WHEEL_TIMER_PENDING (&lsp->t_lifetime))
+    return;
+
+  remain = wheel_timer_remain_second (&lsp->t_lifetime);
   if (lsp->lsp_header->rem_lifetime == 0)
-    {
-      if (lsp->age_out > 0)
-        lsp->age_out--;
-      return;
-    }
+    lsp->age_out = remain;
+  else
+    lsp->lsp_header->rem_lifetime = htons (MAX (remain, 1));
+}
+
+static int
+lsp_lifetime_expire (struct wheel_timer *t)
+{
+  struct isis_lsp *lsp = WHEEL_TIMER_ARG (t);
+  dict_t *lspdb = lsp->area->lspdb[lsp->level - 1];
+  dnode_t *dnode;
+
+  /*
+   * The lsp rem_lifetime is kept at 0 for MaxAge or
+   * ZeroAgeLifetime depending on explicit purge or
+   * natural age out.
+   */
+  if (lsp->lsp_header->rem_lifetime != 0)
+    {
+      lsp->lsp_header->rem_lifetime = 0;
+      /* 7.3.16.4 a) set SRM flags on all */
+      if (lsp->lsp_header->seq_num != 0)
+        lsp_set_all_srmflags (lsp);
+      /* 7.3.16.4 b) retain only the header FIXME  */
+      /* 7.3.16.4 c) record the time to purge FIXME */
+      /* isis_spf_schedule is called inside lsp_destroy() once the
+       * lsp has aged out; so it is not needed here. */
+      lsp_lifetime_start (lsp);
+      return 0;
+    }
+
+  zlog_debug ("ISIS-Upd (%s): L%u LSP %s seq 0x%08x aged out",
+              lsp->area->area_tag, lsp->level,
+              rawlspid_print (lsp->lsp_header->lsp_id),
+              ntohl (lsp->lsp_header->seq_num));
+#ifdef TOPOLOGY_GENERATE
+  if (lsp->from_topology)
+    THREAD_TIMER_OFF (lsp->t_lsp_top_ref);
+#endif /* TOPOLOGY_GENERATE */
+  dnode = lspdb_lookup (lspdb, lsp->lsp_header->lsp_id);
+  if (dnode)
+    dnode_destroy (lspdb_delete (lspdb, dnode));
+  lsp_destroy (lsp);
+  return 0;
+}
+
+/*
+ * (Re)start the lifetime timer from the header, or from age_out if the
+ * remaining lifetime is zero.  Called whenever either is set.
+ */
+static void
+lsp_lifetime_start (struct isis_lsp *lsp)
+{
+  unsigned long seconds;
+
+  if (lsp->lsp_header->rem_lifetime != 0)
+    seconds = ntohs (lsp->lsp_header->rem_lifetime);
+  else
+    seconds = lsp->age_out;
 
-  lsp->lsp_header->rem_lifetime =
-    htons (ntohs (lsp->lsp_header->rem_lifetime) - 1);
+  wheel_timer_add (lsp->area->lsp_wheel, &lsp->t_lifetime,
+                   lsp_lifetime_expire, lsp, seconds);
 }
 
 static void
@@ -801,6 +895,7 @@ lsp_print (struct isis_lsp *lsp, struct vty *vty, char dynhost)
   u_char LSPid[255];
   char age_out[8];
 
+  lsp_age (lsp);
   lspid_print (lsp->lsp_header->lsp_id, LSPid, dynhost, 1);
   vty_out (vty, "%-21s%c  ", LSPid, lsp->own_lsp ? '*' : ' ');
   vty_out (vty, "%5u   ", ntohs (lsp->lsp_header->pdu_len));
@@ -818,12 +913,24 @@ lsp_print (struct isis_lsp *lsp, struct vty *vty, char dynhost)
            lsp_bits2string (&lsp->lsp_header->lsp_bits), VTY_NEWLINE);
 }
 
+/* View of the TLVs of an LSP, read from its PDU. */
+void
+lsp_tlv_view (struct isis_lsp *lsp, struct tlv_view *view)
+{
+  int len;
+
+  len = MIN (ntohs (lsp->lsp_header->pdu_len), stream_get_endp (lsp->pdu));
+  tlv_view_init (view, STREAM_DATA (lsp->pdu) + ISIS_FIXED_HDR_LEN +
+		 ISIS_LSP_HDR_LEN, len - ISIS_FIXED_HDR_LEN - ISIS_LSP_HDR_LEN);
+}
+
 void
 lsp_print_detail (struct isis_lsp *lsp, struct vty *vty, char dynhost)
 {
   struct area_addr *area_addr;
   int i;
-  struct listnode *lnode;
+  struct tlv_view view;
+  struct tlv_iter iter;
   struct is_neigh *is_neigh;
   struct te_is_neigh *te_is_neigh;
   struct ipv4_reachability *ipv4_reach;
@@ -842,15 +949,15 @@ lsp_print_detail (struct isis_lsp *lsp, struct vty *vty, char dynhost)
 
   lspid_print (lsp->lsp_header->lsp_id, LSPid, dynhost, 1);
   lsp_print (lsp, vty, dynhost);
+  lsp_tlv_view (lsp, &view);
 
   /* for all area address */
-  if (lsp->tlv_data.area_addrs)
-    for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.area_addrs, lnode, area_addr))
-      {
-	vty_out (vty, "  Area Address: %s%s",
-		 isonet_print (area_addr->area_addr, area_addr->addr_len),
-		 VTY_NEWLINE);
-      }
+  for (ALL_TLV_ITEMS (&view, iter, AREA_ADDRESSES, area_addr))
+    {
+      vty_out (vty, "  Area Address: %s%s",
+	       isonet_print (area_addr->area_addr, area_addr->addr_len),
+	       VTY_NEWLINE);
+    }
   
   /* for the nlpid tlv */
   if (lsp->tlv_data.nlpids)
@@ -897,26 +1004,22 @@ lsp_print_detail (struct isis_lsp *lsp, struct vty *vty, char dynhost)
       vty_out (vty, "  Router ID   : %s%s", ipv4_address, VTY_NEWLINE);
     }
 
-  if (lsp->tlv_data.ipv4_addrs)
-    for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.ipv4_addrs, lnode, ipv4_addr))
-      {
-        memcpy (ipv4_address, inet_ntoa (*ipv4_addr), sizeof (ipv4_address));
-        vty_out (vty, "  IPv4 Address: %s%s", ipv4_address, VTY_NEWLINE);
-      }
+  for (ALL_TLV_ITEMS (&view, iter, IPV4_ADDR, ipv4_addr))
+    {
+      memcpy (ipv4_address, inet_ntoa (*ipv4_addr), sizeof (ipv4_address));
+      vty_out (vty, "  IPv4 Address: %s%s", ipv4_address, VTY_NEWLINE);
+    }
 
   /* for the IS neighbor tlv */
-  if (lsp->tlv_data.is_neighs)
-    for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.is_neighs, lnode, is_neigh))
-      {
-	lspid_print (is_neigh->neigh_id, LSPid, dynhost, 0);
-	vty_out (vty, "  Metric      : %-8d IS            : %s%s",
-		 is_neigh->metrics.metric_default, LSPid, VTY_NEWLINE);
-      }
+  for (ALL_TLV_ITEMS (&view, iter, IS_NEIGHBOURS, is_neigh))
+    {
+      lspid_print (is_neigh->neigh_id, LSPid, dynhost, 0);
+      vty_out (vty, "  Metric      : %-8d IS            : %s%s",
+	       is_neigh->metrics.metric_default, LSPid, VTY_NEWLINE);
+    }
   
   /* for the internal reachable tlv */
-  if (lsp->tlv_data.ipv4_int_reachs)
-    for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.ipv4_int_reachs, lnode,
-			       ipv4_reach))
+  for (ALL_TLV_ITEMS (&view, iter, IPV4_INT_REACHABILITY, ipv4_reach))
     {
       memcpy (ipv4_reach_prefix, inet_ntoa (ipv4_reach->prefix),
 	      sizeof (ipv4_reach_prefix));
@@ -928,9 +1031,7 @@ lsp_print_detail (struct isis_lsp *lsp, struct vty *vty, char dynhost)
     }
 
   /* for the external reachable tlv */
-  if (lsp->tlv_data.ipv4_ext_reachs)
-    for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.ipv4_ext_reachs, lnode, 
-			       ipv4_reach))
+  for (ALL_TLV_ITEMS (&view, iter, IPV4_EXT_REACHABILITY, ipv4_reach))
     {
       memcpy (ipv4_reach_prefix, inet_ntoa (ipv4_reach->prefix),
 	      sizeof (ipv4_reach_prefix));
@@ -943,8 +1044,7 @@ lsp_print_detail (struct isis_lsp *lsp, struct vty *vty, char dynhost)
   
   /* IPv6 tlv */
 #ifdef HAVE_IPV6
-  if (lsp->tlv_data.ipv6_reachs)
-    for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.ipv6_reachs, lnode, ipv6_reach))
+  for (ALL_TLV_ITEMS (&view, iter, IPV6_REACHABILITY, ipv6_reach))
     {
       memset (&in6, 0, sizeof (in6));
       memcpy (in6.s6_addr, ipv6_reach->prefix,
@@ -963,8 +1063,7 @@ lsp_print_detail (struct isis_lsp *lsp, struct vty *vty, char dynhost)
 #endif
 
   /* TE IS neighbor tlv */
-  if (lsp->tlv_data.te_is_neighs)
-    for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.te_is_neighs, lnode, te_is_neigh))
+  for (ALL_TLV_ITEMS (&view, iter, TE_IS_NEIGHBOURS, te_is_neigh))
     {
       lspid_print (te_is_neigh->neigh_id, LSPid, dynhost, 0);
       vty_out (vty, "  Metric      : %-8d IS-Extended   : %s%s",
@@ -972,9 +1071,7 @@ lsp_print_detail (struct isis_lsp *lsp, struct vty *vty, char dynhost)
     }
 
   /* TE IPv4 tlv */
-  if (lsp->tlv_data.te_ipv4_reachs)
-    for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.te_ipv4_reachs, lnode,
-			       te_ipv4_reach))
+  for (ALL_TLV_ITEMS (&view, iter, TE_IPV4_REACHABILITY, te_ipv4_reach))
     {
       /* FIXME: There should be better way to output this stuff. */
       vty_out (vty, "  Metric      : %-8d IPv4-Extended : %s/%d%s",
@@ -1659,6 +1756,7 @@ lsp_regenerate (struct isis_area *area, int level)
   lsp->lsp_header->lsp_bits = lsp_bits_generate (level, area->overload_bit);
   rem_lifetime = lsp_rem_lifetime (area, level);
   lsp->lsp_header->rem_lifetime = htons (rem_lifetime);
+  lsp_lifetime_start (lsp);
   lsp_seqnum_update (lsp);
 
   lsp->last_generated = time (NULL);
@@ -1671,6 +1769,7 @@ lsp_regenerate (struct isis_area *area, int level)
        * so that no fragment expires before the lsp is refreshed.
        */
       frag->lsp_header->rem_lifetime = htons (rem_lifetime);
+      lsp_lifetime_start (frag);
       lsp_set_all_srmflags (frag);
     }
 
@@ -2015,6 +2114,7 @@ lsp_regenerate_pseudo (struct isis_circuit *circuit, int level)
   lsp->lsp_header->lsp_bits = lsp_bits_generate (level, 0);
   rem_lifetime = lsp_rem_lifetime (circuit->area, level);
   lsp->lsp_header->rem_lifetime = htons (rem_lifetime);
+  lsp_lifetime_start (lsp);
   lsp_inc_seqnum (lsp, 0);
   lsp->last_generated = time (NULL);
   lsp_set_all_srmflags (lsp);
@@ -2154,23 +2254,17 @@ lsp_regenerate_schedule_pseudo (struct isis_circuit *circuit, int level)
 }
 
 /*
- * Walk through LSPs for an area
- *  - set remaining lifetime
- *  - set LSPs with SRMflag set for sending
+ * Walk through the circuits of an area
+ *  - start sending the LSPs with SRMflag set
+ * Remaining lifetimes are kept by the area's lsp_wheel.
  */
 int
 lsp_tick (struct thread *thread)
 {
   struct isis_area *area;
   struct isis_circuit *circuit;
-  struct isis_lsp *lsp;
-  struct list *lsp_list;
-  struct listnode *lspnode, *cnode;
-  dnode_t *dnode, *dnode_next;
-  int level;
-  u_int16_t rem_lifetime;
-
-  lsp_list = list_new ();
+  struct listnode *cnode;
+  time_t now;
 
   area = THREAD_ARG (thread);
   assert (area);
@@ -2178,96 +2272,26 @@ lsp_tick (struct thread *thread)
   THREAD_TIMER_ON (master, area->t_tick, lsp_tick, area, 1);
 
   /*
-   * Build a list of LSPs with (any) SRMflag set
-   * and removed the ones that have aged out
+   * Send LSPs on circuits indicated by the SRMflags: start a round
+   * over the circuit's SRM queue, unless one is going on or the last
+   * one ended less than MIN_LSP_TRANS_INTERVAL ago.
    */
-  for (level = 0; level < ISIS_LEVELS; level++)
+  now = time (NULL);
+  for (ALL_LIST_ELEMENTS_RO (area->circuit_list, cnode, circuit))
     {
-      if (area->lspdb[level] && dict_count (area->lspdb[level]) > 0)
-        {
-          for (dnode = dict_first (area->lspdb[level]);
-               dnode != NULL; dnode = dnode_next)
-            {
-              dnode_next = dict_next (area->lspdb[level], dnode);
-              lsp = dnode_get (dnode);
-
-              /*
-               * The lsp rem_lifetime is kept at 0 for MaxAge or
-               * ZeroAgeLifetime depending on explicit purge or
-               * natural age out. So schedule spf only once when
-               * the first time rem_lifetime becomes 0.
-               */
-              rem_lifetime = ntohs(lsp->lsp_header->rem_lifetime);
-              lsp_set_time (lsp);
-
-              /*
-               * Schedule may run spf which should be done only after
-               * the lsp rem_lifetime becomes 0 for the first time.
-               * ISO 10589 - 7.3.16.4 first paragraph.
-               */
-              if (rem_lifetime == 1 && lsp->lsp_header->seq_num != 0)
-                {
-                  /* 7.3.16.4 a) set SRM flags on all */
-                  lsp_set_all_srmflags (lsp);
-                  /* 7.3.16.4 b) retain only the header FIXME  */
-                  /* 7.3.16.4 c) record the time to purge FIXME */
-                  /* run/schedule spf */
-                  /* isis_spf_schedule is called inside lsp_destroy() below;
-                   * so it is not needed here. */
-                  /* isis_spf_schedule (lsp->area, lsp->level); */
-                }
-
-              if (lsp->age_out == 0)
-                {
-                  zlog_debug ("ISIS-Upd (%s): L%u LSP %s seq 0x%08x aged out",
-                              area->area_tag,
-                              lsp->level,
-                              rawlspid_print (lsp->lsp_header->lsp_id),
-                              ntohl (lsp->lsp_header->seq_num));
-#ifdef TOPOLOGY_GENERATE
-                  if (lsp->from_topology)
-                    THREAD_TIMER_OFF (lsp->t_lsp_top_ref);
-#endif /* TOPOLOGY_GENERATE */
-                  lsp_destroy (lsp);
-                  lsp = NULL;
-                  dict_delete_free (area->lspdb[level], dnode);
-                }
-              else if (flags_any_set (lsp->SRMflags))
-                listnode_add (lsp_list, lsp);
-            }
-
-          /*
-           * Send LSPs on circuits indicated by the SRMflags
-           */
-          if (listcount (lsp_list) > 0)
-            {
-              for (ALL_LIST_ELEMENTS_RO (area->circuit_list, cnode, circuit))
-                {
-                  int diff = time (NULL) - circuit->lsp_queue_last_cleared;
-                  if (circuit->lsp_queue == NULL ||
-                      diff < MIN_LSP_TRANS_INTERVAL)
-                    continue;
-                  for (ALL_LIST_ELEMENTS_RO (lsp_list, lspnode, lsp))
-                    {
-                      if (circuit->upadjcount[lsp->level - 1] &&
-                          ISIS_CHECK_FLAG (lsp->SRMflags, circuit))
-                        {
-                          /* Add the lsp only if it is not already in lsp
-                           * queue */
-                          if (! listnode_lookup (circuit->lsp_queue, lsp))
-                            {
-                              listnode_add (circuit->lsp_queue, lsp);
-                              thread_add_event (master, send_lsp, circuit, 0);
-                            }
-                        }
-                    }
-                }
-              list_delete_all_node (lsp_list);
-            }
-        }
-    }
+      if (circuit->state != C_STATE_UP || circuit->is_passive
+          || circuit->lsp_send_next != NULL
+          || circuit->flag_queue[ISIS_FLAG_SRM].head == NULL)
+        continue;
+      if (now - circuit->lsp_queue_last_cleared < MIN_LSP_TRANS_INTERVAL)
+        continue;
+      if (circuit->upadjcount[0] == 0 && circuit->upadjcount[1] == 0)
+        continue;
 
-  list_delete (lsp_list);
+      circuit->lsp_send_next = circuit->flag_queue[ISIS_FLAG_SRM].head;
+      if (circuit->t_send_lsp == NULL)
+        circuit->t_send_lsp = thread_add_event (master, send_lsp, circuit, 0);
+    }
 
   return ISIS_OK;
 }
@@ -2300,6 +2324,7 @@ lsp_purge_pseudo (u_char * id, struct isis_circuit *circuit, int level)
   lsp->lsp_header->lsp_bits = lsp_bits;
   lsp->level = level;
   lsp->age_out = lsp->area->max_lsp_lifetime[level-1];
+  lsp_lifetime_start (lsp);
   stream_forward_endp (lsp->pdu, ISIS_FIXED_HDR_LEN + ISIS_LSP_HDR_LEN);
 
   /*
@@ -2379,16 +2404,18 @@ void lsp_set_all_srmflags (struct isis_lsp *lsp)
 
   assert (lsp);
 
-  ISIS_FLAGS_CLEAR_ALL(lsp->SRMflags);
-
+  /* Flags are only ever set for circuits of the area, so setting them
+   * on every one of those leaves the others clear. */
   if (lsp->area)
     {
       struct list *circuit_list = lsp->area->circuit_list;
       for (ALL_LIST_ELEMENTS_RO (circuit_list, node, circuit))
         {
-          ISIS_SET_FLAG(lsp->SRMflags, circuit);
+          flags_lsp_set (lsp, circuit, ISIS_FLAG_SRM);
         }
     }
+  else
+    flags_lsp_clear_all (lsp, ISIS_FLAG_SRM);
 }
 
 #ifdef TOPOLOGY_GENERATE
@@ -2419,6 +2446,7 @@ top_lsp_refresh (struct thread *thread)
                                                  lsp->area->overload_bit);
   rem_lifetime = lsp_rem_lifetime (lsp->area, IS_LEVEL_1);
   lsp->lsp_header->rem_lifetime = htons (rem_lifetime);
+  lsp_lifetime_start (lsp);
 
   refresh_time = lsp_refresh_time (lsp, rem_lifetime);
   THREAD_TIMER_ON (master, lsp->t_lsp_top_ref, top_lsp_refresh, lsp,
@@ -2491,8 +2519,8 @@ remove_topology_lsps (struct isis_area *area)
       if (lsp->from_topology)
 	{
 	  THREAD_TIMER_OFF (lsp->t_lsp_top_ref);
+	  dnode_destroy (lspdb_delete (area->lspdb[0], dnode));
 	  lsp_destroy (lsp);
-	  dict_delete (area->lspdb[0], dnode);
 	}
       dnode = dnode_next;
     }
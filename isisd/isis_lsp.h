@@ -24,6 +24,8 @@
 #ifndef _ZEBRA_ISIS_LSP_H
 #define _ZEBRA_ISIS_LSP_H
 
+#include "wheel.h"
+
 /* Structure for isis_lsp, this structure will only support the fixed
  * System ID (Currently 6) (atleast for now). In order to support more
  * We will have to split the header into two parts, and for readability
@@ -41,6 +43,10 @@ struct isis_lsp
   u_int32_t auth_tlv_offset;    /* authentication TLV position in the pdu */
   u_int32_t SRMflags[ISIS_MAX_CIRCUITS];
   u_int32_t SSNflags[ISIS_MAX_CIRCUITS];
+  /* Queue entries by circuit index, while SRM or SSN is set somewhere */
+  struct isis_flag_entry **flag_table;
+  int flag_table_size;
+  int flag_entries;
   int level;			/* L1 or L2? */
   int scheduled;		/* scheduled for sending */
   time_t installed;
@@ -52,6 +58,9 @@ struct isis_lsp
 #endif
   /* used for 60 second counting when rem_lifetime is zero */
   int age_out;
+  /* Runs out when rem_lifetime, then age_out, reaches zero; the header
+   * and age_out are only brought up to date by lsp_age () */
+  struct wheel_timer t_lifetime;
   struct isis_area *area;
   struct tlvs tlv_data;		/* Simplifies TLV access */
 };
@@ -81,8 +90,8 @@ void lsp_build_list (u_char * start_id, u_char * stop_id, u_char num_lsps,
 		     struct list *list, dict_t * lspdb);
 void lsp_build_list_nonzero_ht (u_char * start_id, u_char * stop_id,
 				struct list *list, dict_t * lspdb);
-void lsp_build_list_ssn (struct isis_circuit *circuit, u_char num_lsps,
-                         struct list *list, dict_t * lspdb);
+void lsp_build_list_ssn (struct isis_circuit *circuit, int level,
+                         u_char num_lsps, struct list *list);
 
 void lsp_search_and_destroy (u_char * id, dict_t * lspdb);
 void lsp_purge_pseudo (u_char * id, struct isis_circuit *circuit, int level);
@@ -105,7 +114,9 @@ int lsp_compare (char *areatag, struct isis_lsp *lsp, u_int32_t seq_num,
 void lsp_update (struct isis_lsp *lsp, struct stream *stream,
                  struct isis_area *area, int level);
 void lsp_inc_seqnum (struct isis_lsp *lsp, u_int32_t seq_num);
+void lsp_age (struct isis_lsp *lsp);
 void lsp_print (struct isis_lsp *lsp, struct vty *vty, char dynhost);
+void lsp_tlv_view (struct isis_lsp *lsp, struct tlv_view *view);
 void lsp_print_detail (struct isis_lsp *lsp, struct vty *vty, char dynhost);
 int lsp_print_all (struct vty *vty, dict_t * lspdb, char detail,
 		   char dynhost);
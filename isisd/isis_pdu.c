@@ -1409,26 +1409,26 @@ dontcheckadj:
 		  /* ii */
                   lsp_set_all_srmflags (lsp);
 		  /* iii */
-		  ISIS_CLEAR_FLAG (lsp->SRMflags, circuit);
+		  flags_lsp_clear (lsp, circuit, ISIS_FLAG_SRM);
 		  /* v */
-		  ISIS_FLAGS_CLEAR_ALL (lsp->SSNflags);	/* FIXME: OTHER than c */
+		  flags_lsp_clear_all (lsp, ISIS_FLAG_SSN);	/* FIXME: OTHER than c */
 		  /* iv */
 		  if (circuit->circ_type != CIRCUIT_T_BROADCAST)
-		    ISIS_SET_FLAG (lsp->SSNflags, circuit);
+		    flags_lsp_set (lsp, circuit, ISIS_FLAG_SSN);
 
 		}		/* 7.3.16.4 b) 2) */
 	      else if (comp == LSP_EQUAL)
 		{
 		  /* i */
-		  ISIS_CLEAR_FLAG (lsp->SRMflags, circuit);
+		  flags_lsp_clear (lsp, circuit, ISIS_FLAG_SRM);
 		  /* ii */
 		  if (circuit->circ_type != CIRCUIT_T_BROADCAST)
-		    ISIS_SET_FLAG (lsp->SSNflags, circuit);
+		    flags_lsp_set (lsp, circuit, ISIS_FLAG_SSN);
 		}		/* 7.3.16.4 b) 3) */
 	      else
 		{
-		  ISIS_SET_FLAG (lsp->SRMflags, circuit);
-		  ISIS_CLEAR_FLAG (lsp->SSNflags, circuit);
+		  flags_lsp_set (lsp, circuit, ISIS_FLAG_SRM);
+		  flags_lsp_clear (lsp, circuit, ISIS_FLAG_SSN);
 		}
 	    }
           else if (lsp->lsp_header->rem_lifetime != 0)
@@ -1441,8 +1441,8 @@ dontcheckadj:
                 }
               else
                 {
-                  ISIS_SET_FLAG (lsp->SRMflags, circuit);
-                  ISIS_CLEAR_FLAG (lsp->SSNflags, circuit);
+                  flags_lsp_set (lsp, circuit, ISIS_FLAG_SRM);
+                  flags_lsp_clear (lsp, circuit, ISIS_FLAG_SSN);
                 }
               if (isis->debugs & DEBUG_UPDATE_PACKETS)
                 zlog_debug ("ISIS-Upd (%s): (1) re-originating LSP %s new "
@@ -1519,31 +1519,40 @@ dontcheckadj:
 	  /* ii */
           lsp_set_all_srmflags (lsp);
 	  /* iii */
-	  ISIS_CLEAR_FLAG (lsp->SRMflags, circuit);
+	  flags_lsp_clear (lsp, circuit, ISIS_FLAG_SRM);
 
 	  /* iv */
 	  if (circuit->circ_type != CIRCUIT_T_BROADCAST)
-	    ISIS_SET_FLAG (lsp->SSNflags, circuit);
+	    flags_lsp_set (lsp, circuit, ISIS_FLAG_SSN);
 	  /* FIXME: v) */
 	}
       /* 7.3.15.1 e) 2) LSP equal to the one in db */
       else if (comp == LSP_EQUAL)
 	{
-	  ISIS_CLEAR_FLAG (lsp->SRMflags, circuit);
+	  flags_lsp_clear (lsp, circuit, ISIS_FLAG_SRM);
 	  lsp_update (lsp, circuit->rcv_stream, circuit->area, level);
 	  if (circuit->circ_type != CIRCUIT_T_BROADCAST)
-	    ISIS_SET_FLAG (lsp->SSNflags, circuit);
+	    flags_lsp_set (lsp, circuit, ISIS_FLAG_SSN);
 	}
       /* 7.3.15.1 e) 3) LSP older than the one in db */
       else
 	{
-	  ISIS_SET_FLAG (lsp->SRMflags, circuit);
-	  ISIS_CLEAR_FLAG (lsp->SSNflags, circuit);
+	  flags_lsp_set (lsp, circuit, ISIS_FLAG_SRM);
+	  flags_lsp_clear (lsp, circuit, ISIS_FLAG_SSN);
 	}
     }
   return retval;
 }
 
+static int
+lsp_entry_cmp (const void *p1, const void *p2)
+{
+  struct lsp_entry *e1 = *(struct lsp_entry * const *) p1;
+  struct lsp_entry *e2 = *(struct lsp_entry * const *) p2;
+
+  return lsp_id_cmp (e1->lsp_id, e2->lsp_id);
+}
+
 /*
  * Process Sequence Numbers
  * ISO - 10589
@@ -1564,8 +1573,9 @@ process_snp (int snp_type, int level, struct isis_circuit *circuit,
   uint32_t found = 0, expected = 0, auth_tlv_offset = 0;
   struct isis_lsp *lsp;
   struct lsp_entry *entry;
-  struct listnode *node, *nnode;
-  struct listnode *node2, *nnode2;
+  struct lsp_entry **entries = NULL;
+  unsigned int nentries, i;
+  struct listnode *node;
   struct tlvs tlvs;
   struct list *lsp_list = NULL;
   struct isis_passwd *passwd;
@@ -1767,13 +1777,13 @@ process_snp (int snp_type, int level, struct isis_circuit *circuit,
 	    if (cmp == LSP_EQUAL)
 	      {
 		/* if (circuit->circ_type != CIRCUIT_T_BROADCAST) */
-	        ISIS_CLEAR_FLAG (lsp->SRMflags, circuit);
+	        flags_lsp_clear (lsp, circuit, ISIS_FLAG_SRM);
 	      }
 	    /* 7.3.15.2 b) 3) if it is older, clear SSN and set SRM */
 	    else if (cmp == LSP_OLDER)
 	      {
-		ISIS_CLEAR_FLAG (lsp->SSNflags, circuit);
-		ISIS_SET_FLAG (lsp->SRMflags, circuit);
+		flags_lsp_clear (lsp, circuit, ISIS_FLAG_SSN);
+		flags_lsp_set (lsp, circuit, ISIS_FLAG_SRM);
 	      }
 	    /* 7.3.15.2 b) 4) if it is newer, set SSN and clear SRM on p2p */
 	    else
@@ -1781,13 +1791,13 @@ process_snp (int snp_type, int level, struct isis_circuit *circuit,
 		if (own_lsp)
 		  {
 		    lsp_inc_seqnum (lsp, ntohl (entry->seq_num));
-		    ISIS_SET_FLAG (lsp->SRMflags, circuit);
+		    flags_lsp_set (lsp, circuit, ISIS_FLAG_SRM);
 		  }
 		else
 		  {
-		    ISIS_SET_FLAG (lsp->SSNflags, circuit);
+		    flags_lsp_set (lsp, circuit, ISIS_FLAG_SSN);
 		    /* if (circuit->circ_type != CIRCUIT_T_BROADCAST) */
-		    ISIS_CLEAR_FLAG (lsp->SRMflags, circuit);
+		    flags_lsp_clear (lsp, circuit, ISIS_FLAG_SRM);
 		  }
 	      }
 	  }
@@ -1802,8 +1812,8 @@ process_snp (int snp_type, int level, struct isis_circuit *circuit,
 			       0, 0, entry->checksum, level);
 		lsp->area = circuit->area;
 		lsp_insert (lsp, circuit->area->lspdb[level - 1]);
-		ISIS_FLAGS_CLEAR_ALL (lsp->SRMflags);
-		ISIS_SET_FLAG (lsp->SSNflags, circuit);
+		flags_lsp_clear_all (lsp, ISIS_FLAG_SRM);
+		flags_lsp_set (lsp, circuit, ISIS_FLAG_SSN);
 	      }
 	  }
       }
@@ -1820,25 +1830,34 @@ process_snp (int snp_type, int level, struct isis_circuit *circuit,
       lsp_build_list_nonzero_ht (chdr->start_lsp_id, chdr->stop_lsp_id,
 				 lsp_list, circuit->area->lspdb[level - 1]);
 
-      /* Fixme: Find a better solution */
-      if (tlvs.lsp_entries)
+      /* Sort the reported entries and merge them against the list,
+       * which is in LSP ID order; the entries should be sorted already
+       * but a neighbour's ordering is not relied on. */
+      nentries = 0;
+      if (tlvs.lsp_entries && listcount (tlvs.lsp_entries))
 	{
-	  for (ALL_LIST_ELEMENTS (tlvs.lsp_entries, node, nnode, entry))
-	  {
-	    for (ALL_LIST_ELEMENTS (lsp_list, node2, nnode2, lsp))
-	    {
-	      if (lsp_id_cmp (lsp->lsp_header->lsp_id, entry->lsp_id) == 0)
-		{
-		  list_delete_node (lsp_list, node2);
-		  break;
-		}
-	    }
-	  }
+	  entries = XMALLOC (MTYPE_TMP, listcount (tlvs.lsp_entries)
+				        * sizeof (struct lsp_entry *));
+	  for (ALL_LIST_ELEMENTS_RO (tlvs.lsp_entries, node, entry))
+	    entries[nentries++] = entry;
+	  qsort (entries, nentries, sizeof (struct lsp_entry *),
+		 lsp_entry_cmp);
 	}
-      /* on remaining LSPs we set SRM (neighbor knew not of) */
+      /* on LSPs not reported we set SRM (neighbor knew not of) */
+      i = 0;
       for (ALL_LIST_ELEMENTS_RO (lsp_list, node, lsp))
-	ISIS_SET_FLAG (lsp->SRMflags, circuit);
+	{
+	  while (i < nentries &&
+		 lsp_id_cmp (entries[i]->lsp_id, lsp->lsp_header->lsp_id) < 0)
+	    i++;
+	  if (i < nentries &&
+	      lsp_id_cmp (entries[i]->lsp_id, lsp->lsp_header->lsp_id) == 0)
+	    continue;
+	  flags_lsp_set (lsp, circuit, ISIS_FLAG_SRM);
+	}
       /* lets free it */
+      if (entries)
+	XFREE (MTYPE_TMP, entries);
       list_delete (lsp_list);
 
     }
@@ -2950,8 +2969,7 @@ send_psnp (int level, struct isis_circuit *circuit)
   while (1)
     {
       list = list_new ();
-      lsp_build_list_ssn (circuit, num_lsps, list,
-                          circuit->area->lspdb[level - 1]);
+      lsp_build_list_ssn (circuit, level, num_lsps, list);
 
       if (listcount (list) == 0)
         {
@@ -2994,7 +3012,7 @@ send_psnp (int level, struct isis_circuit *circuit)
        * for the LSPs in list
        */
       for (ALL_LIST_ELEMENTS_RO (list, node, lsp))
-        ISIS_CLEAR_FLAG (lsp->SSNflags, circuit);
+        flags_lsp_clear (lsp, circuit, ISIS_FLAG_SSN);
       list_delete (list);
     }
 
@@ -3047,56 +3065,53 @@ send_l2_psnp (struct thread *thread)
 
 /*
  * ISO 10589 - 7.3.14.3
+ *
+ * Sends the next LSP of the round started by lsp_tick (), walking the
+ * circuit's SRM queue, and schedules itself for the one after.
  */
 int
 send_lsp (struct thread *thread)
 {
   struct isis_circuit *circuit;
+  struct isis_flag_entry *entry;
   struct isis_lsp *lsp;
-  struct listnode *node;
   int retval = ISIS_OK;
 
   circuit = THREAD_ARG (thread);
   assert (circuit);
+  circuit->t_send_lsp = NULL;
 
   if (circuit->state != C_STATE_UP || circuit->is_passive == 1)
   {
+    circuit->lsp_send_next = NULL;
     return retval;
   }
 
-  node = listhead (circuit->lsp_queue);
-
   /*
-   * Handle case where there are no LSPs on the queue. This can
-   * happen, for instance, if an adjacency goes down before this
-   * thread gets a chance to run.
+   * Skip LSPs of a level the circuit does not run, or for which
+   * there are no adjacencies in state up on the circuit.
    */
-  if (!node)
+  while ((entry = circuit->lsp_send_next) != NULL)
     {
-      return retval;
+      lsp = entry->lsp;
+      if ((lsp->level & circuit->is_type)
+          && circuit->upadjcount[lsp->level - 1] != 0)
+        break;
+      circuit->lsp_send_next = entry->link[ISIS_FLAG_SRM].next;
     }
 
-  lsp = listgetdata(node);
-
-  /*
-   * Do not send if levels do not match
-   */
-  if (!(lsp->level & circuit->is_type))
+  /* The round is over; this sets when the next one may start. */
+  if (entry == NULL)
     {
-      list_delete_node (circuit->lsp_queue, node);
+      circuit->lsp_queue_last_cleared = time (NULL);
       return retval;
     }
 
-  /*
-   * Do not send if we do not have adjacencies in state up on the circuit
-   */
-  if (circuit->upadjcount[lsp->level - 1] == 0)
-    {
-      list_delete_node (circuit->lsp_queue, node);
-      return retval;
-    }
+  circuit->lsp_send_next = entry->link[ISIS_FLAG_SRM].next;
+  circuit->t_send_lsp = thread_add_event (master, send_lsp, circuit, 0);
 
   /* copy our lsp to the send buffer */
+  lsp_age (lsp);
   stream_copy (circuit->snd_stream, lsp->pdu);
 
   if (isis->debugs & DEBUG_UPDATE_PACKETS)
@@ -3123,23 +3138,11 @@ send_lsp (struct thread *thread)
       return retval;
     }
 
-  /*
-   * If the sending succeeded, we can del the lsp from circuits
-   * lsp_queue
-   */
-  list_delete_node (circuit->lsp_queue, node);
-
-  /* Set the last-cleared time if the queue is empty. */
-  /* TODO: Is is possible that new lsps keep being added to the queue
-   * that the queue is never empty? */
-  if (list_isempty (circuit->lsp_queue))
-    circuit->lsp_queue_last_cleared = time (NULL);
-
   /*
    * On broadcast circuits also the SRMflag can be cleared
    */
   if (circuit->circ_type == CIRCUIT_T_BROADCAST)
-    ISIS_CLEAR_FLAG (lsp->SRMflags, circuit);
+    flags_lsp_clear (lsp, circuit, ISIS_FLAG_SRM);
 
   return retval;
 }
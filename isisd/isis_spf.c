@@ -22,6 +22,9 @@
  */
 
 #include <zebra.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /* HAVE_PTHREAD */
 
 #include "thread.h"
 #include "linklist.h"
@@ -189,11 +192,6 @@ isis_vertex_new (void *id, enum vertextype vtype)
   struct isis_vertex *vertex;
 
   vertex = XCALLOC (MTYPE_ISIS_VERTEX, sizeof (struct isis_vertex));
-  if (vertex == NULL)
-    {
-      zlog_err ("isis_vertex_new Out of memory!");
-      return NULL;
-    }
 
   vertex->type = vtype;
   switch (vtype)
@@ -218,7 +216,7 @@ isis_vertex_new (void *id, enum vertextype vtype)
 	      sizeof (struct prefix));
       break;
     default:
-      zlog_err ("WTF!");
+      assert (0);
     }
 
   vertex->Adj_N = list_new ();
@@ -402,6 +400,158 @@ spftree_area_adj_del (struct isis_area *area, struct isis_adjacency *adj)
   return;
 }
 
+/*
+ * What isis_spf_compute() ran into.  The computation may be on a worker
+ * thread, which must not log: the notes are logged by isis_spf_install()
+ * on the main thread.
+ */
+enum isis_spf_note_type
+{
+  SPF_NOTE_NO_OWN_LSP,
+  SPF_NOTE_ZERO_SEQNUM,		/* lsp_id */
+  SPF_NOTE_ZERO_SEQNUM_PSEUDO,	/* lsp_id */
+  SPF_NOTE_NO_ADJ_LSP,		/* lsp_id, circuit */
+  SPF_NOTE_UNKNOWN_ADJ_TYPE,
+  SPF_NOTE_NO_ADJS,		/* circuit, debug only */
+  SPF_NOTE_NO_DR,		/* circuit, debug only */
+  SPF_NOTE_NO_DR_ADJ,		/* lsp_id, circuit */
+  SPF_NOTE_NO_DR_LSP,		/* lsp_id, circuit */
+  SPF_NOTE_UNSUPPORTED_MEDIA,
+  SPF_NOTE_NO_LSP		/* lsp_id */
+};
+
+struct isis_spf_note
+{
+  enum isis_spf_note_type type;
+  u_char lsp_id[ISIS_SYS_ID_LEN + 2];
+  struct isis_circuit *circuit;
+};
+
+#define ISIS_SPF_NOTES_MAX 16
+
+/* How the computation of a tree ended. */
+enum isis_spf_status
+{
+  SPF_STATUS_OK,
+  SPF_STATUS_PRELOAD_FAILED,
+  SPF_STATUS_TENT_EMPTY
+};
+
+struct isis_spf_job
+{
+  struct isis_spftree *spftree;
+  int level;
+  int family;
+  enum isis_spf_status status;
+  struct isis_spf_note notes[ISIS_SPF_NOTES_MAX];
+  int nnotes;			/* notes made, may be more than kept */
+};
+
+static void
+isis_spf_job_init (struct isis_spf_job *job, struct isis_spftree *spftree,
+		   int level, int family)
+{
+  job->spftree = spftree;
+  job->level = level;
+  job->family = family;
+  job->status = SPF_STATUS_OK;
+  job->nnotes = 0;
+}
+
+static void
+isis_spf_note (struct isis_spf_job *job, enum isis_spf_note_type type,
+	       const u_char *lsp_id, struct isis_circuit *circuit)
+{
+  struct isis_spf_note *note;
+
+  if (job->nnotes++ >= ISIS_SPF_NOTES_MAX)
+    return;
+  note = &job->notes[job->nnotes - 1];
+  note->type = type;
+  if (lsp_id)
+    memcpy (note->lsp_id, lsp_id, ISIS_SYS_ID_LEN + 2);
+  note->circuit = circuit;
+}
+
+/* Log what the computation of job ran into.  Main thread only. */
+static void
+isis_spf_log_notes (struct isis_spf_job *job, u_char *sysid)
+{
+  struct isis_spf_note *note;
+  int i;
+
+  for (i = 0; i < MIN (job->nnotes, ISIS_SPF_NOTES_MAX); i++)
+    {
+      note = &job->notes[i];
+      switch (note->type)
+	{
+	case SPF_NOTE_NO_OWN_LSP:
+	  zlog_warn ("ISIS-Spf: could not find own l%d LSP!", job->level);
+	  break;
+	case SPF_NOTE_ZERO_SEQNUM:
+	  zlog_warn ("isis_spf_process_lsp(): lsp %s with 0 seq_num - ignore",
+		     rawlspid_print (note->lsp_id));
+	  break;
+	case SPF_NOTE_ZERO_SEQNUM_PSEUDO:
+	  zlog_warn ("isis_spf_process_pseudo_lsp(): lsp %s with 0 seq_num"
+		     " - do not process", rawlspid_print (note->lsp_id));
+	  break;
+	case SPF_NOTE_NO_ADJ_LSP:
+	  zlog_warn ("ISIS-Spf: No LSP %s found for IS adjacency "
+		     "L%d on %s (ID %u)",
+		     rawlspid_print (note->lsp_id), job->level,
+		     note->circuit->interface->name,
+		     note->circuit->circuit_id);
+	  break;
+	case SPF_NOTE_UNKNOWN_ADJ_TYPE:
+	  zlog_warn ("isis_spf_preload_tent unknown adj type");
+	  break;
+	case SPF_NOTE_NO_ADJS:
+	  if (isis->debugs & DEBUG_SPF_EVENTS)
+	    zlog_debug ("ISIS-Spf: no L%d adjacencies on circuit %s",
+			job->level, note->circuit->interface->name);
+	  break;
+	case SPF_NOTE_NO_DR:
+	  if (isis->debugs & DEBUG_SPF_EVENTS)
+	    zlog_debug ("ISIS-Spf: No L%d DR on %s (ID %d)",
+			job->level, note->circuit->interface->name,
+			note->circuit->circuit_id);
+	  break;
+	case SPF_NOTE_NO_DR_ADJ:
+	  zlog_warn ("ISIS-Spf: No adjacency found from root "
+		     "to L%d DR %s on %s (ID %d)",
+		     job->level, rawlspid_print (note->lsp_id),
+		     note->circuit->interface->name,
+		     note->circuit->circuit_id);
+	  break;
+	case SPF_NOTE_NO_DR_LSP:
+	  zlog_warn ("ISIS-Spf: No lsp found from root "
+		     "to L%d DR %s on %s (ID %d)",
+		     job->level, rawlspid_print (note->lsp_id),
+		     note->circuit->interface->name,
+		     note->circuit->circuit_id);
+	  break;
+	case SPF_NOTE_UNSUPPORTED_MEDIA:
+	  zlog_warn ("isis_spf_preload_tent unsupported media");
+	  break;
+	case SPF_NOTE_NO_LSP:
+	  zlog_warn ("ISIS-Spf: No LSP found for %s",
+		     rawlspid_print (note->lsp_id));
+	  break;
+	}
+    }
+  if (job->nnotes > ISIS_SPF_NOTES_MAX)
+    zlog_warn ("ISIS-Spf: %d more L%d SPF warnings not logged",
+	       job->nnotes - ISIS_SPF_NOTES_MAX, job->level);
+
+  if (job->status == SPF_STATUS_PRELOAD_FAILED)
+    zlog_warn ("ISIS-Spf: failed to load TENT SPF-root:%s",
+	       print_sys_hostname (sysid));
+  else if (job->status == SPF_STATUS_TENT_EMPTY)
+    zlog_warn ("ISIS-Spf: TENT is empty SPF-root:%s",
+	       print_sys_hostname (sysid));
+}
+
 /* 
  * Find the system LSP: returns the LSP in our LSP database 
  * associated with the given system ID.
@@ -425,8 +575,10 @@ isis_root_system_lsp (struct isis_area *area, int level, u_char *sysid)
  * Add this IS to the root of SPT
  */
 static struct isis_vertex *
-isis_spf_add_root (struct isis_spftree *spftree, int level, u_char *sysid)
+isis_spf_add_root (struct isis_spf_job *job, u_char *sysid)
 {
+  struct isis_spftree *spftree = job->spftree;
+  int level = job->level;
   struct isis_vertex *vertex;
   struct isis_lsp *lsp;
 #ifdef EXTREME_DEBUG
@@ -435,7 +587,7 @@ isis_spf_add_root (struct isis_spftree *spftree, int level, u_char *sysid)
 
   lsp = isis_root_system_lsp (spftree->area, level, sysid);
   if (lsp == NULL)
-    zlog_warn ("ISIS-Spf: could not find own l%d LSP!", level);
+    isis_spf_note (job, SPF_NOTE_NO_OWN_LSP, NULL, NULL);
 
   if (!spftree->area->oldmetric)
     vertex = isis_vertex_new (sysid, VTYPE_NONPSEUDO_TE_IS);
@@ -711,11 +863,14 @@ process_N (struct isis_spftree *spftree, enum vertextype vtype, void *id,
  * C.2.6 Step 1
  */
 static int
-isis_spf_process_lsp (struct isis_spftree *spftree, struct isis_lsp *lsp,
+isis_spf_process_lsp (struct isis_spf_job *job, struct isis_lsp *lsp,
 		      uint32_t cost, uint16_t depth, int family,
 		      u_char *root_sysid, struct isis_vertex *parent)
 {
-  struct listnode *node, *fragnode = NULL;
+  struct isis_spftree *spftree = job->spftree;
+  struct listnode *fragnode = NULL;
+  struct tlv_view view;
+  struct tlv_iter iter;
   uint32_t dist;
   struct is_neigh *is_neigh;
   struct te_is_neigh *te_is_neigh;
@@ -734,7 +889,8 @@ isis_spf_process_lsp (struct isis_spftree *spftree, struct isis_lsp *lsp,
 lspfragloop:
   if (lsp->lsp_header->seq_num == 0)
     {
-      zlog_warn ("isis_spf_process_lsp(): lsp with 0 seq_num - ignore");
+      isis_spf_note (job, SPF_NOTE_ZERO_SEQNUM, lsp->lsp_header->lsp_id,
+		     NULL);
       return ISIS_WARNING;
     }
 
@@ -742,29 +898,28 @@ lspfragloop:
       zlog_debug ("ISIS-Spf: process_lsp %s", print_sys_hostname(lsp->lsp_header->lsp_id));
 #endif /* EXTREME_DEBUG */
 
+  lsp_tlv_view (lsp, &view);
+
   if (!ISIS_MASK_LSP_OL_BIT (lsp->lsp_header->lsp_bits))
   {
-    if (lsp->tlv_data.is_neighs)
+    for (ALL_TLV_ITEMS (&view, iter, IS_NEIGHBOURS, is_neigh))
     {
-      for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.is_neighs, node, is_neigh))
-      {
-        /* C.2.6 a) */
-        /* Two way connectivity */
-        if (!memcmp (is_neigh->neigh_id, root_sysid, ISIS_SYS_ID_LEN))
-          continue;
-        if (!memcmp (is_neigh->neigh_id, null_sysid, ISIS_SYS_ID_LEN))
-          continue;
-        dist = cost + is_neigh->metrics.metric_default;
-        vtype = LSP_PSEUDO_ID (is_neigh->neigh_id) ? VTYPE_PSEUDO_IS
-          : VTYPE_NONPSEUDO_IS;
-        process_N (spftree, vtype, (void *) is_neigh->neigh_id, dist,
-            depth + 1, family, parent);
-      }
+      /* C.2.6 a) */
+      /* Two way connectivity */
+      if (!memcmp (is_neigh->neigh_id, root_sysid, ISIS_SYS_ID_LEN))
+        continue;
+      if (!memcmp (is_neigh->neigh_id, null_sysid, ISIS_SYS_ID_LEN))
+        continue;
+      dist = cost + is_neigh->metrics.metric_default;
+      vtype = LSP_PSEUDO_ID (is_neigh->neigh_id) ? VTYPE_PSEUDO_IS
+        : VTYPE_NONPSEUDO_IS;
+      process_N (spftree, vtype, (void *) is_neigh->neigh_id, dist,
+          depth + 1, family, parent);
     }
-    if (lsp->tlv_data.te_is_neighs)
+    /* Wide metrics are only used when they are accepted. */
+    if (spftree->area->newmetric)
     {
-      for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.te_is_neighs, node,
-            te_is_neigh))
+      for (ALL_TLV_ITEMS (&view, iter, TE_IS_NEIGHBOURS, te_is_neigh))
       {
         if (!memcmp (te_is_neigh->neigh_id, root_sysid, ISIS_SYS_ID_LEN))
           continue;
@@ -779,10 +934,10 @@ lspfragloop:
     }
   }
 
-  if (family == AF_INET && lsp->tlv_data.ipv4_int_reachs)
+  if (family == AF_INET)
   {
     prefix.family = AF_INET;
-    for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.ipv4_int_reachs, node, ipreach))
+    for (ALL_TLV_ITEMS (&view, iter, IPV4_INT_REACHABILITY, ipreach))
     {
       dist = cost + ipreach->metrics.metric_default;
       vtype = VTYPE_IPREACH_INTERNAL;
@@ -793,10 +948,10 @@ lspfragloop:
                  family, parent);
     }
   }
-  if (family == AF_INET && lsp->tlv_data.ipv4_ext_reachs)
+  if (family == AF_INET)
   {
     prefix.family = AF_INET;
-    for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.ipv4_ext_reachs, node, ipreach))
+    for (ALL_TLV_ITEMS (&view, iter, IPV4_EXT_REACHABILITY, ipreach))
     {
       dist = cost + ipreach->metrics.metric_default;
       vtype = VTYPE_IPREACH_EXTERNAL;
@@ -807,11 +962,10 @@ lspfragloop:
                  family, parent);
     }
   }
-  if (family == AF_INET && lsp->tlv_data.te_ipv4_reachs)
+  if (family == AF_INET && spftree->area->newmetric)
   {
     prefix.family = AF_INET;
-    for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.te_ipv4_reachs,
-                               node, te_ipv4_reach))
+    for (ALL_TLV_ITEMS (&view, iter, TE_IPV4_REACHABILITY, te_ipv4_reach))
     {
       assert ((te_ipv4_reach->control & 0x3F) <= IPV4_MAX_BITLEN);
 
@@ -826,10 +980,10 @@ lspfragloop:
     }
   }
 #ifdef HAVE_IPV6
-  if (family == AF_INET6 && lsp->tlv_data.ipv6_reachs)
+  if (family == AF_INET6)
   {
     prefix.family = AF_INET6;
-    for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.ipv6_reachs, node, ip6reach))
+    for (ALL_TLV_ITEMS (&view, iter, IPV6_REACHABILITY, ip6reach))
     {
       assert (ip6reach->prefix_len <= IPV6_MAX_BITLEN);
 
@@ -861,13 +1015,16 @@ lspfragloop:
 }
 
 static int
-isis_spf_process_pseudo_lsp (struct isis_spftree *spftree,
+isis_spf_process_pseudo_lsp (struct isis_spf_job *job,
 			     struct isis_lsp *lsp, uint32_t cost,
 			     uint16_t depth, int family,
 			     u_char *root_sysid,
 			     struct isis_vertex *parent)
 {
-  struct listnode *node, *fragnode = NULL;
+  struct isis_spftree *spftree = job->spftree;
+  struct listnode *fragnode = NULL;
+  struct tlv_view view;
+  struct tlv_iter iter;
   struct is_neigh *is_neigh;
   struct te_is_neigh *te_is_neigh;
   enum vertextype vtype;
@@ -877,8 +1034,8 @@ pseudofragloop:
 
   if (lsp->lsp_header->seq_num == 0)
     {
-      zlog_warn ("isis_spf_process_pseudo_lsp(): lsp with 0 seq_num"
-		 " - do not process");
+      isis_spf_note (job, SPF_NOTE_ZERO_SEQNUM_PSEUDO,
+		     lsp->lsp_header->lsp_id, NULL);
       return ISIS_WARNING;
     }
 
@@ -889,20 +1046,21 @@ pseudofragloop:
 
   /* RFC3787 section 4 SHOULD ignore overload bit in pseudo LSPs */
 
-  if (lsp->tlv_data.is_neighs)
-    for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.is_neighs, node, is_neigh))
-      {
-	/* Two way connectivity */
-	if (!memcmp (is_neigh->neigh_id, root_sysid, ISIS_SYS_ID_LEN))
-	  continue;
-        dist = cost + is_neigh->metrics.metric_default;
-        vtype = LSP_PSEUDO_ID (is_neigh->neigh_id) ? VTYPE_PSEUDO_IS
-          : VTYPE_NONPSEUDO_IS;
-        process_N (spftree, vtype, (void *) is_neigh->neigh_id, dist,
-            depth + 1, family, parent);
-      }
-  if (lsp->tlv_data.te_is_neighs)
-    for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.te_is_neighs, node, te_is_neigh))
+  lsp_tlv_view (lsp, &view);
+
+  for (ALL_TLV_ITEMS (&view, iter, IS_NEIGHBOURS, is_neigh))
+    {
+      /* Two way connectivity */
+      if (!memcmp (is_neigh->neigh_id, root_sysid, ISIS_SYS_ID_LEN))
+	continue;
+      dist = cost + is_neigh->metrics.metric_default;
+      vtype = LSP_PSEUDO_ID (is_neigh->neigh_id) ? VTYPE_PSEUDO_IS
+	: VTYPE_NONPSEUDO_IS;
+      process_N (spftree, vtype, (void *) is_neigh->neigh_id, dist,
+		 depth + 1, family, parent);
+    }
+  if (spftree->area->newmetric)
+    for (ALL_TLV_ITEMS (&view, iter, TE_IS_NEIGHBOURS, te_is_neigh))
       {
 	/* Two way connectivity */
 	if (!memcmp (te_is_neigh->neigh_id, root_sysid, ISIS_SYS_ID_LEN))
@@ -929,10 +1087,12 @@ pseudofragloop:
 }
 
 static int
-isis_spf_preload_tent (struct isis_spftree *spftree, int level,
-		       int family, u_char *root_sysid,
+isis_spf_preload_tent (struct isis_spf_job *job, u_char *root_sysid,
 		       struct isis_vertex *parent)
 {
+  struct isis_spftree *spftree = job->spftree;
+  int level = job->level;
+  int family = job->family;
   struct isis_circuit *circuit;
   struct listnode *cnode, *anode, *ipnode;
   struct isis_adjacency *adj;
@@ -1001,8 +1161,7 @@ isis_spf_preload_tent (struct isis_spftree *spftree, int level,
 	    {
 	      list_delete (adj_list);
 	      if (isis->debugs & DEBUG_SPF_EVENTS)
-		zlog_debug ("ISIS-Spf: no L%d adjacencies on circuit %s",
-			    level, circuit->interface->name);
+		isis_spf_note (job, SPF_NOTE_NO_ADJS, NULL, circuit);
 	      continue;
 	    }
           for (ALL_LIST_ELEMENTS_RO (adj_list, anode, adj))
@@ -1031,14 +1190,11 @@ isis_spf_preload_tent (struct isis_spftree *spftree, int level,
 		  LSP_FRAGMENT (lsp_id) = 0;
 		  lsp = lsp_search (lsp_id, spftree->area->lspdb[level - 1]);
                   if (lsp == NULL || lsp->lsp_header->rem_lifetime == 0)
-                    zlog_warn ("ISIS-Spf: No LSP %s found for IS adjacency "
-                        "L%d on %s (ID %u)",
-			rawlspid_print (lsp_id), level,
-			circuit->interface->name, circuit->circuit_id);
+		    isis_spf_note (job, SPF_NOTE_NO_ADJ_LSP, lsp_id, circuit);
 		  break;
 		case ISIS_SYSTYPE_UNKNOWN:
 		default:
-		  zlog_warn ("isis_spf_preload_tent unknow adj type");
+		  isis_spf_note (job, SPF_NOTE_UNKNOWN_ADJ_TYPE, NULL, NULL);
 		}
 	    }
 	  list_delete (adj_list);
@@ -1053,30 +1209,23 @@ isis_spf_preload_tent (struct isis_spftree *spftree, int level,
 	  if (memcmp (lsp_id, null_lsp_id, ISIS_SYS_ID_LEN + 1) == 0)
 	    {
 	      if (isis->debugs & DEBUG_SPF_EVENTS)
-		zlog_debug ("ISIS-Spf: No L%d DR on %s (ID %d)",
-		    level, circuit->interface->name, circuit->circuit_id);
+		isis_spf_note (job, SPF_NOTE_NO_DR, NULL, circuit);
 	      continue;
 	    }
 	  adj = isis_adj_lookup (lsp_id, adjdb);
 	  /* if no adj, we are the dis or error */
 	  if (!adj && !circuit->u.bc.is_dr[level - 1])
 	    {
-              zlog_warn ("ISIS-Spf: No adjacency found from root "
-                  "to L%d DR %s on %s (ID %d)",
-		  level, rawlspid_print (lsp_id),
-		  circuit->interface->name, circuit->circuit_id);
+	      isis_spf_note (job, SPF_NOTE_NO_DR_ADJ, lsp_id, circuit);
               continue;
 	    }
 	  lsp = lsp_search (lsp_id, spftree->area->lspdb[level - 1]);
 	  if (lsp == NULL || lsp->lsp_header->rem_lifetime == 0)
 	    {
-	      zlog_warn ("ISIS-Spf: No lsp (%p) found from root "
-                  "to L%d DR %s on %s (ID %d)",
-		  lsp, level, rawlspid_print (lsp_id), 
-		  circuit->interface->name, circuit->circuit_id);
+	      isis_spf_note (job, SPF_NOTE_NO_DR_LSP, lsp_id, circuit);
               continue;
 	    }
-	  isis_spf_process_pseudo_lsp (spftree, lsp,
+	  isis_spf_process_pseudo_lsp (job, lsp,
                                        circuit->te_metric[level - 1], 0,
                                        family, root_sysid, parent);
 	}
@@ -1106,7 +1255,7 @@ isis_spf_preload_tent (struct isis_spftree *spftree, int level,
 	      break;
 	    case ISIS_SYSTYPE_UNKNOWN:
 	    default:
-	      zlog_warn ("isis_spf_preload_tent unknown adj type");
+	      isis_spf_note (job, SPF_NOTE_UNKNOWN_ADJ_TYPE, NULL, NULL);
 	      break;
 	    }
 	}
@@ -1116,7 +1265,7 @@ isis_spf_preload_tent (struct isis_spftree *spftree, int level,
         }
       else
 	{
-	  zlog_warn ("isis_spf_preload_tent unsupported media");
+	  isis_spf_note (job, SPF_NOTE_UNSUPPORTED_MEDIA, NULL, circuit);
 	  retval = ISIS_WARNING;
 	}
     }
@@ -1132,7 +1281,9 @@ static void
 add_to_paths (struct isis_spftree *spftree, struct isis_vertex *vertex,
 	      int level)
 {
+#ifdef EXTREME_DEBUG
   u_char buff[BUFSIZ];
+#endif /* EXTREME_DEBUG */
 
   if (isis_find_vertex (spftree->paths, vertex->N.id, vertex->type))
     return;
@@ -1145,17 +1296,6 @@ add_to_paths (struct isis_spftree *spftree, struct isis_vertex *vertex,
 	      vertex->depth, vertex->d_N);
 #endif /* EXTREME_DEBUG */
 
-  if (vertex->type > VTYPE_ES)
-    {
-      if (listcount (vertex->Adj_N) > 0)
-	isis_route_create ((struct prefix *) &vertex->N.prefix, vertex->d_N,
-			   vertex->depth, vertex->Adj_N, spftree->area, level);
-      else if (isis->debugs & DEBUG_SPF_EVENTS)
-	zlog_debug ("ISIS-Spf: no adjacencies do not install route for "
-                    "%s depth %d dist %d", vid2string (vertex, buff),
-                    vertex->depth, vertex->d_N);
-    }
-
   return;
 }
 
@@ -1169,33 +1309,35 @@ init_spt (struct isis_spftree *spftree)
   return;
 }
 
-static int
-isis_run_spf (struct isis_area *area, int level, int family, u_char *sysid)
+static struct isis_spftree *
+isis_spftree_get (struct isis_area *area, int level, int family)
 {
-  int retval = ISIS_OK;
-  struct listnode *node;
-  struct isis_vertex *vertex;
-  struct isis_vertex *root_vertex;
-  struct isis_spftree *spftree = NULL;
-  u_char lsp_id[ISIS_SYS_ID_LEN + 2];
-  struct isis_lsp *lsp;
-  struct route_table *table = NULL;
-  struct timeval time_now;
-  unsigned long long start_time, end_time;
-
-  /* Get time that can't roll backwards. */
-  quagga_gettime(QUAGGA_CLK_MONOTONIC, &time_now);
-  start_time = time_now.tv_sec;
-  start_time = (start_time * 1000000) + time_now.tv_usec;
-
   if (family == AF_INET)
-    spftree = area->spftree[level - 1];
+    return area->spftree[level - 1];
 #ifdef HAVE_IPV6
-  else if (family == AF_INET6)
-    spftree = area->spftree6[level - 1];
+  if (family == AF_INET6)
+    return area->spftree6[level - 1];
 #endif
+  return NULL;
+}
+
+/*
+ * A run is split in three.  isis_spf_prepare() and isis_spf_install()
+ * touch the route tables and run on the main thread.  isis_spf_compute()
+ * only reads the area, its circuits, adjacencies and LSP database, and
+ * only writes its own tree and job, which keeps what is to be logged;
+ * with spf-workers, the trees of an area due at the same time are
+ * computed on several threads while the main thread waits for them, so
+ * nothing they read can change under them.
+ */
+static struct isis_spftree *
+isis_spf_prepare (struct isis_area *area, int level, int family)
+{
+  struct isis_spftree *spftree;
+  struct route_table *table = NULL;
+
+  spftree = isis_spftree_get (area, level, family);
   assert (spftree);
-  assert (sysid);
 
   /* Make all routes in current route table inactive. */
   if (family == AF_INET)
@@ -1211,14 +1353,34 @@ isis_run_spf (struct isis_area *area, int level, int family, u_char *sysid)
    * C.2.5 Step 0
    */
   init_spt (spftree);
+
+  return spftree;
+}
+
+static int
+isis_spf_compute (struct isis_spf_job *job, u_char *sysid)
+{
+  struct isis_spftree *spftree = job->spftree;
+  int level = job->level;
+  int family = job->family;
+  int retval = ISIS_OK;
+  struct listnode *node;
+  struct isis_vertex *vertex;
+  struct isis_vertex *root_vertex;
+  struct isis_area *area = spftree->area;
+  u_char lsp_id[ISIS_SYS_ID_LEN + 2];
+  struct isis_lsp *lsp;
+
+  assert (sysid);
+
   /*              a) */
-  root_vertex = isis_spf_add_root (spftree, level, sysid);
+  root_vertex = isis_spf_add_root (job, sysid);
   /*              b) */
-  retval = isis_spf_preload_tent (spftree, level, family, sysid, root_vertex);
+  retval = isis_spf_preload_tent (job, sysid, root_vertex);
   if (retval != ISIS_OK)
     {
-      zlog_warn ("ISIS-Spf: failed to load TENT SPF-root:%s", print_sys_hostname(sysid));
-      goto out;
+      job->status = SPF_STATUS_PRELOAD_FAILED;
+      return retval;
     }
 
   /*
@@ -1226,8 +1388,8 @@ isis_run_spf (struct isis_area *area, int level, int family, u_char *sysid)
    */
   if (listcount (spftree->tents) == 0)
     {
-      zlog_warn ("ISIS-Spf: TENT is empty SPF-root:%s", print_sys_hostname(sysid));
-      goto out;
+      job->status = SPF_STATUS_TENT_EMPTY;
+      return retval;
     }
 
   while (listcount (spftree->tents) > 0)
@@ -1257,40 +1419,275 @@ isis_run_spf (struct isis_area *area, int level, int family, u_char *sysid)
 	    {
 	      if (LSP_PSEUDO_ID (lsp_id))
 		{
-		  isis_spf_process_pseudo_lsp (spftree, lsp, vertex->d_N,
+		  isis_spf_process_pseudo_lsp (job, lsp, vertex->d_N,
 					       vertex->depth, family, sysid,
 					       vertex);
 		}
 	      else
 		{
-		  isis_spf_process_lsp (spftree, lsp, vertex->d_N,
+		  isis_spf_process_lsp (job, lsp, vertex->d_N,
 					vertex->depth, family, sysid, vertex);
 		}
 	    }
 	  else
-	    {
-	      zlog_warn ("ISIS-Spf: No LSP found for %s",
-			 rawlspid_print (lsp_id));
-	    }
+	    isis_spf_note (job, SPF_NOTE_NO_LSP, lsp_id, NULL);
 	  break;
 	default:;
 	}
     }
 
-out:
-  isis_route_validate (area);
+  return retval;
+}
+
+/* Routes for the reachabilities in PATHS, in the order they were found. */
+static void
+isis_spf_install (struct isis_spf_job *job, u_char *sysid)
+{
+  struct isis_spftree *spftree = job->spftree;
+  int level = job->level;
+  struct listnode *node;
+  struct isis_vertex *vertex;
+  u_char buff[BUFSIZ];
+
+  isis_spf_log_notes (job, sysid);
+
+  for (ALL_LIST_ELEMENTS_RO (spftree->paths, node, vertex))
+    {
+      if (vertex->type <= VTYPE_ES)
+	continue;
+      if (listcount (vertex->Adj_N) > 0)
+	isis_route_create ((struct prefix *) &vertex->N.prefix, vertex->d_N,
+			   vertex->depth, vertex->Adj_N, spftree->area, level);
+      else if (isis->debugs & DEBUG_SPF_EVENTS)
+	zlog_debug ("ISIS-Spf: no adjacencies do not install route for "
+                    "%s depth %d dist %d", vid2string (vertex, buff),
+                    vertex->depth, vertex->d_N);
+    }
+
   spftree->pending = 0;
   spftree->runcount++;
   spftree->last_run_timestamp = time (NULL);
+}
+
+static unsigned long long
+spf_time_now (void)
+{
+  struct timeval time_now;
+
+  /* Get time that can't roll backwards. */
   quagga_gettime(QUAGGA_CLK_MONOTONIC, &time_now);
-  end_time = time_now.tv_sec;
-  end_time = (end_time * 1000000) + time_now.tv_usec;
-  spftree->last_run_duration = end_time - start_time;
+  return (unsigned long long) time_now.tv_sec * 1000000 + time_now.tv_usec;
+}
+
+static int
+isis_run_spf (struct isis_area *area, int level, int family, u_char *sysid)
+{
+  int retval;
+  struct isis_spftree *spftree;
+  struct isis_spf_job job;
+  unsigned long long start_time;
+
+  start_time = spf_time_now ();
+
+  spftree = isis_spf_prepare (area, level, family);
+  isis_spf_job_init (&job, spftree, level, family);
+  retval = isis_spf_compute (&job, sysid);
+  isis_spf_install (&job, sysid);
+  isis_route_validate (area);
 
+  spftree->last_run_duration = spf_time_now () - start_time;
 
   return retval;
 }
 
+#ifdef HAVE_PTHREAD
+/* Worker threads, shared by all areas.  They are started as needed and
+ * then wait for work for the life of the daemon. */
+static struct
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t work;		/* jobs were posted */
+  pthread_cond_t done;		/* the last job is finished */
+  int nthreads;
+  struct isis_spf_job *jobs;
+  int njobs;
+  int next;			/* first job not taken yet */
+  int finished;
+  int active;			/* jobs being computed */
+  int limit;			/* most jobs to compute at once */
+} spf_pool =
+{
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+  PTHREAD_COND_INITIALIZER,
+};
+
+/* Compute jobs until there are none left to take.  Called, and returns,
+ * with the mutex held. */
+static void
+spf_pool_run_jobs (void)
+{
+  struct isis_spf_job *job;
+
+  while (spf_pool.next < spf_pool.njobs && spf_pool.active < spf_pool.limit)
+    {
+      job = &spf_pool.jobs[spf_pool.next++];
+      spf_pool.active++;
+      pthread_mutex_unlock (&spf_pool.mutex);
+
+      isis_spf_compute (job, isis->sysid);
+
+      pthread_mutex_lock (&spf_pool.mutex);
+      spf_pool.active--;
+      if (++spf_pool.finished == spf_pool.njobs)
+	pthread_cond_signal (&spf_pool.done);
+    }
+}
+
+static void *
+spf_pool_worker (void *arg)
+{
+  sigset_t sigs;
+
+  /* Signals are the main thread's business. */
+  sigfillset (&sigs);
+  pthread_sigmask (SIG_BLOCK, &sigs, NULL);
+
+  pthread_mutex_lock (&spf_pool.mutex);
+  for (;;)
+    {
+      spf_pool_run_jobs ();
+      pthread_cond_wait (&spf_pool.work, &spf_pool.mutex);
+    }
+
+  return NULL;
+}
+
+/* Compute the trees of jobs on up to workers threads, this one included,
+ * and return when all of them are done. */
+static void
+spf_pool_compute (struct isis_spf_job *jobs, int njobs, int workers)
+{
+  pthread_t thread;
+
+  workers = MIN (MIN (workers, njobs), ISIS_SPF_WORKERS_MAX);
+
+  pthread_mutex_lock (&spf_pool.mutex);
+  while (spf_pool.nthreads < workers - 1)
+    {
+      if (pthread_create (&thread, NULL, spf_pool_worker, NULL) != 0)
+	{
+	  zlog_warn ("ISIS-Spf: can't start SPF worker: %s",
+		     safe_strerror (errno));
+	  break;
+	}
+      pthread_detach (thread);
+      spf_pool.nthreads++;
+    }
+
+  spf_pool.jobs = jobs;
+  spf_pool.njobs = njobs;
+  spf_pool.next = 0;
+  spf_pool.finished = 0;
+  spf_pool.limit = workers;
+  pthread_cond_broadcast (&spf_pool.work);
+
+  spf_pool_run_jobs ();
+  while (spf_pool.finished < spf_pool.njobs)
+    pthread_cond_wait (&spf_pool.done, &spf_pool.mutex);
+
+  spf_pool.jobs = NULL;
+  spf_pool.njobs = 0;
+  pthread_mutex_unlock (&spf_pool.mutex);
+}
+
+/* Run the SPF for every tree of the area marked due, computing them in
+ * parallel. */
+static int
+isis_run_spf_batch (struct thread *thread)
+{
+  struct isis_area *area;
+  struct isis_spftree *spftree;
+  struct isis_spf_job jobs[ISIS_LEVELS * 2];
+  int families[] = { AF_INET,
+#ifdef HAVE_IPV6
+                     AF_INET6,
+#endif
+                   };
+  unsigned long long start_time, duration;
+  int njobs = 0;
+  int level, i, j;
+
+  area = THREAD_ARG (thread);
+  assert (area);
+  area->t_spf_batch = NULL;
+
+  start_time = spf_time_now ();
+
+  for (i = 0; i < (int) (sizeof (families) / sizeof (families[0])); i++)
+    for (level = ISIS_LEVEL1; level <= ISIS_LEVEL2; level++)
+      {
+	spftree = isis_spftree_get (area, level, families[i]);
+	if (spftree == NULL || ! spftree->due)
+	  continue;
+	spftree->due = 0;
+	isis_spf_prepare (area, level, families[i]);
+	isis_spf_job_init (&jobs[njobs++], spftree, level, families[i]);
+      }
+
+  if (njobs == 0)
+    return ISIS_OK;
+
+  if (isis->debugs & DEBUG_SPF_EVENTS)
+    zlog_debug ("ISIS-Spf (%s) computing %d SPF trees on %d threads",
+		area->area_tag, njobs,
+		MIN (MIN (njobs, area->spf_workers), ISIS_SPF_WORKERS_MAX));
+
+  /* EXTREME_DEBUG traces every vertex through the static buffers of
+     print_sys_hostname(), so then the trees are computed in turn. */
+#ifndef EXTREME_DEBUG
+  if (njobs > 1)
+    spf_pool_compute (jobs, njobs, area->spf_workers);
+  else
+#endif /* EXTREME_DEBUG */
+    for (j = 0; j < njobs; j++)
+      isis_spf_compute (&jobs[j], isis->sysid);
+
+  for (j = 0; j < njobs; j++)
+    isis_spf_install (&jobs[j], isis->sysid);
+  isis_route_validate (area);
+
+  /* The trees computed together share the time taken. */
+  duration = spf_time_now () - start_time;
+  for (j = 0; j < njobs; j++)
+    jobs[j].spftree->last_run_duration = duration;
+
+  return ISIS_OK;
+}
+#endif /* HAVE_PTHREAD */
+
+/* Run the SPF for level and family now or, with spf-workers, together
+ * with the area's other trees due now, once the current event is done. */
+static int
+isis_spf_run_or_batch (struct isis_area *area, int level, int family)
+{
+#ifdef HAVE_PTHREAD
+  struct isis_spftree *spftree;
+
+  if (area->spf_workers > 1)
+    {
+      spftree = isis_spftree_get (area, level, family);
+      spftree->due = 1;
+      spftree->pending = 1;
+      if (area->t_spf_batch == NULL)
+	area->t_spf_batch = thread_add_event (master, isis_run_spf_batch,
+					      area, 0);
+      return ISIS_OK;
+    }
+#endif /* HAVE_PTHREAD */
+
+  return isis_run_spf (area, level, family, isis->sysid);
+}
+
 int
 isis_run_spf_l1 (struct thread *thread)
 {
@@ -1315,7 +1712,7 @@ isis_run_spf_l1 (struct thread *thread)
     zlog_debug ("ISIS-Spf (%s) L1 SPF needed, periodic SPF", area->area_tag);
 
   if (area->ip_circuits)
-    retval = isis_run_spf (area, 1, AF_INET, isis->sysid);
+    retval = isis_spf_run_or_batch (area, 1, AF_INET);
 
   return retval;
 }
@@ -1343,7 +1740,7 @@ isis_run_spf_l2 (struct thread *thread)
     zlog_debug ("ISIS-Spf (%s) L2 SPF needed, periodic SPF", area->area_tag);
 
   if (area->ip_circuits)
-    retval = isis_run_spf (area, 2, AF_INET, isis->sysid);
+    retval = isis_spf_run_or_batch (area, 2, AF_INET);
 
   return retval;
 }
@@ -1369,7 +1766,7 @@ isis_spf_schedule (struct isis_area *area, int level)
 
   /* wait configured min_spf_interval before doing the SPF */
   if (diff >= area->min_spf_interval[level-1])
-      return isis_run_spf (area, level, AF_INET, isis->sysid);
+      return isis_spf_run_or_batch (area, level, AF_INET);
 
   if (level == 1)
     THREAD_TIMER_ON (master, spftree->t_spf, isis_run_spf_l1, area,
@@ -1411,7 +1808,7 @@ isis_run_spf6_l1 (struct thread *thread)
     zlog_debug ("ISIS-Spf (%s) L1 SPF needed, periodic SPF", area->area_tag);
 
   if (area->ipv6_circuits)
-    retval = isis_run_spf (area, 1, AF_INET6, isis->sysid);
+    retval = isis_spf_run_or_batch (area, 1, AF_INET6);
 
   return retval;
 }
@@ -1439,7 +1836,7 @@ isis_run_spf6_l2 (struct thread *thread)
     zlog_debug ("ISIS-Spf (%s) L2 SPF needed, periodic SPF.", area->area_tag);
 
   if (area->ipv6_circuits)
-    retval = isis_run_spf (area, 2, AF_INET6, isis->sysid);
+    retval = isis_spf_run_or_batch (area, 2, AF_INET6);
 
   return retval;
 }
@@ -1466,7 +1863,7 @@ isis_spf_schedule6 (struct isis_area *area, int level)
 
   /* wait configured min_spf_interval before doing the SPF */
   if (diff >= area->min_spf_interval[level-1])
-      return isis_run_spf (area, level, AF_INET6, isis->sysid);
+      return isis_spf_run_or_batch (area, level, AF_INET6);
 
   if (level == 1)
     THREAD_TIMER_ON (master, spftree->t_spf, isis_run_spf6_l1, area,
@@ -751,6 +751,121 @@ parse_tlvs (char *areatag, u_char * stream, int size, u_int32_t * expected,
   return retval;
 }
 
+void
+tlv_view_init (struct tlv_view *view, u_char * stream, int size)
+{
+  view->start = stream;
+  view->end = stream + (size > 0 ? size : 0);
+}
+
+void
+tlv_iter_init (struct tlv_iter *iter, const struct tlv_view *view,
+	       u_char type)
+{
+  iter->type = type;
+  iter->next = view->start;
+  iter->end = view->end;
+  iter->pnt = iter->tlv_end = view->start;
+}
+
+/*
+ * Length of the item at pnt in a TLV of the given type, with avail
+ * octets left in the TLV, or 0 if the item is malformed or the type is
+ * not one tlv_iter_next() walks.
+ */
+static int
+tlv_item_len (u_char type, u_char * pnt, int avail)
+{
+  int len;
+
+  switch (type)
+    {
+    case AREA_ADDRESSES:
+      len = 1 + ((struct area_addr *) pnt)->addr_len;
+      break;
+    case IS_NEIGHBOURS:
+      len = IS_NEIGHBOURS_LEN;
+      break;
+    case TE_IS_NEIGHBOURS:
+      if (avail < 11)
+	return 0;
+      len = 11 + ((struct te_is_neigh *) pnt)->sub_tlvs_length;
+      break;
+    case LSP_ENTRIES:
+      len = LSP_ENTRIES_LEN;
+      break;
+    case IPV4_ADDR:
+      len = IPV4_MAX_BYTELEN;
+      break;
+    case IPV4_INT_REACHABILITY:
+    case IPV4_EXT_REACHABILITY:
+      len = IPV4_REACH_LEN;
+      break;
+    case TE_IPV4_REACHABILITY:
+      /* No sub-TLVs are defined, so none are looked for. */
+      if (avail < 5
+	  || (((struct te_ipv4_reachability *) pnt)->control & 0x3F)
+	     > IPV4_MAX_BITLEN)
+	return 0;
+      len = 5 + PSIZE (((struct te_ipv4_reachability *) pnt)->control & 0x3F);
+      break;
+#ifdef HAVE_IPV6
+    case IPV6_ADDR:
+      len = IPV6_MAX_BYTELEN;
+      break;
+    case IPV6_REACHABILITY:
+      if (avail < 6
+	  || ((struct ipv6_reachability *) pnt)->prefix_len > IPV6_MAX_BITLEN)
+	return 0;
+      len = 6 + PSIZE (((struct ipv6_reachability *) pnt)->prefix_len);
+      break;
+#endif /* HAVE_IPV6 */
+    default:
+      return 0;
+    }
+
+  return len <= avail ? len : 0;
+}
+
+/*
+ * Return the next item of the iterator's type, or NULL when there are
+ * no more.  As in parse_tlvs(), the walk stops at a TLV which overruns
+ * the PDU.
+ */
+void *
+tlv_iter_next (struct tlv_iter *iter)
+{
+  u_char *item;
+  int len;
+
+  while (1)
+    {
+      if (iter->pnt < iter->tlv_end)
+	{
+	  item = iter->pnt;
+	  len = tlv_item_len (iter->type, item, iter->tlv_end - item);
+	  if (len > 0)
+	    {
+	      iter->pnt += len;
+	      return item;
+	    }
+	  iter->pnt = iter->tlv_end;
+	}
+
+      if (iter->next + 2 > iter->end
+	  || iter->next + 2 + iter->next[1] > iter->end)
+	return NULL;
+
+      iter->pnt = iter->next + 2;
+      iter->tlv_end = iter->pnt + iter->next[1];
+      if (iter->next[0] != iter->type)
+	iter->pnt = iter->tlv_end;
+      else if (iter->type == IS_NEIGHBOURS)
+	iter->pnt++;		/* Virtual Flag */
+      iter->next = iter->tlv_end;
+    }
+}
+
 int
 add_tlv (u_char tag, u_char len, u_char * value, struct stream *stream)
 {
@@ -983,6 +1098,7 @@ tlv_add_lsp_entries (struct list *lsps, struct stream *stream)
 	    return retval;
 	  pos = value;
 	}
+      lsp_age (lsp);
       *((u_int16_t *) pos) = lsp->lsp_header->rem_lifetime;
       pos += 2;
       memcpy (pos, lsp->lsp_header->lsp_id, ISIS_SYS_ID_LEN + 2);
@@ -290,6 +290,37 @@ struct tlvs
 #define TLVFLAG_CHECKSUM                  (1<<20)
 #define TLVFLAG_GRACEFUL_RESTART          (1<<21)
 
+/*
+ * In-place view of the TLVs of a PDU.  The items of one TLV type are
+ * walked straight from the PDU, with the checks parse_tlvs() makes,
+ * and nothing is allocated:
+ *
+ *   for (ALL_TLV_ITEMS (&view, iter, IS_NEIGHBOURS, is_neigh))
+ *
+ * Items which do not fit in their TLV, and the rest of a TLV after an
+ * item with an invalid prefix length, are skipped.
+ */
+struct tlv_view
+{
+  u_char *start;
+  u_char *end;
+};
+
+struct tlv_iter
+{
+  u_char type;
+  u_char *next;			/* next TLV to look at */
+  u_char *end;			/* end of the TLVs */
+  u_char *pnt;			/* next item of the current TLV */
+  u_char *tlv_end;		/* end of the current TLV */
+};
+
+#define ALL_TLV_ITEMS(view,iter,type,item) \
+  tlv_iter_init (&(iter), (view), (type)), \
+  (item) = tlv_iter_next (&(iter)); \
+  (item) != NULL; \
+  (item) = tlv_iter_next (&(iter))
+
 void init_tlvs (struct tlvs *tlvs, uint32_t expected);
 void free_tlvs (struct tlvs *tlvs);
 int parse_tlvs (char *areatag, u_char * stream, int size,
@@ -298,6 +329,11 @@ int parse_tlvs (char *areatag, u_char * stream, int size,
 int add_tlv (u_char, u_char, u_char *, struct stream *);
 void free_tlv (void *val);
 
+void tlv_view_init (struct tlv_view *view, u_char * stream, int size);
+void tlv_iter_init (struct tlv_iter *iter, const struct tlv_view *view,
+		    u_char type);
+void *tlv_iter_next (struct tlv_iter *iter);
+
 int tlv_add_area_addrs (struct list *area_addrs, struct stream *stream);
 int tlv_add_is_neighs (struct list *is_neighs, struct stream *stream);
 int tlv_add_te_is_neighs (struct list *te_is_neighs, struct stream *stream);
@@ -141,6 +141,7 @@ isis_area_create (const char *area_tag)
   area->circuit_list = list_new ();
   area->area_addrs = list_new ();
   THREAD_TIMER_ON (master, area->t_tick, lsp_tick, area, 1);
+  area->lsp_wheel = wheel_new (master, WHEEL_SIZE_DEFAULT);
   flags_initialize (&area->flags);
 
   /*
@@ -154,6 +155,7 @@ isis_area_create (const char *area_tag)
   area->lsp_gen_interval[1] = DEFAULT_MIN_LSP_GEN_INTERVAL;
   area->min_spf_interval[0] = MINIMUM_SPF_INTERVAL;
   area->min_spf_interval[1] = MINIMUM_SPF_INTERVAL;
+  area->spf_workers = 1;
   area->dynhostname = 1;
   area->oldmetric = 0;
   area->newmetric = 1;
@@ -290,8 +292,11 @@ isis_area_destroy (struct vty *vty, const char *area_tag)
   area->area_addrs = NULL;
 
   THREAD_TIMER_OFF (area->t_tick);
+  wheel_free (area->lsp_wheel);
+  area->lsp_wheel = NULL;
   THREAD_TIMER_OFF (area->t_lsp_refresh[0]);
   THREAD_TIMER_OFF (area->t_lsp_refresh[1]);
+  THREAD_OFF (area->t_spf_batch);
 
   thread_cancel_event (master, area);
 
@@ -1258,6 +1263,9 @@ DEFUN (show_isis_summary,
       }
     }
 
+    if (area->spf_workers > 1)
+      vty_out (vty, "  SPF workers: %d%s", area->spf_workers, VTY_NEWLINE);
+
     for (level = ISIS_LEVEL1; level <= ISIS_LEVELS; level++)
     {
       if ((area->is_type & level) == 0)
@@ -2333,6 +2341,57 @@ ALIAS (no_spf_interval,
        "Set interval for level 2 only\n"
        "Minimum interval between consecutive SPFs in seconds\n")
 
+DEFUN (spf_workers,
+       spf_workers_cmd,
+       "spf-workers <1-16>",
+       "Threads to compute the SPF trees on\n"
+       "Number of threads, 1 to compute the trees one after the other\n")
+{
+  struct isis_area *area;
+  int workers;
+
+  area = vty->index;
+  workers = atoi (argv[0]);
+  if (workers < 1 || workers > ISIS_SPF_WORKERS_MAX)
+    {
+      vty_out (vty, "%% Invalid number of SPF workers %s, 1 to %d%s",
+	       argv[0], ISIS_SPF_WORKERS_MAX, VTY_NEWLINE);
+      return CMD_WARNING;
+    }
+#ifndef HAVE_PTHREAD
+  if (workers > 1)
+    {
+      vty_out (vty, "%% SPF worker threads are not supported%s",
+	       VTY_NEWLINE);
+      return CMD_WARNING;
+    }
+#endif /* HAVE_PTHREAD */
+  area->spf_workers = workers;
+
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_spf_workers,
+       no_spf_workers_cmd,
+       "no spf-workers",
+       NO_STR
+       "Threads to compute the SPF trees on\n")
+{
+  struct isis_area *area;
+
+  area = vty->index;
+  area->spf_workers = 1;
+
+  return CMD_SUCCESS;
+}
+
+ALIAS (no_spf_workers,
+       no_spf_workers_arg_cmd,
+       "no spf-workers <1-16>",
+       NO_STR
+       "Threads to compute the SPF trees on\n"
+       "Number of threads, 1 to compute the trees one after the other\n")
+
 static int
 set_lsp_max_lifetime (struct vty *vty, struct isis_area *area,
                       uint16_t interval, int level)
@@ -2982,6 +3041,12 @@ isis_config_write (struct vty *vty)
 		write++;
 	      }
 	  }
+	if (area->spf_workers != 1)
+	  {
+	    vty_out (vty, " spf-workers %d%s", area->spf_workers,
+		     VTY_NEWLINE);
+	    write++;
+	  }
 	/* Authentication passwords. */
 	if (area->area_passwd.type == ISIS_PASSWD_TYPE_HMAC_MD5)
 	  {
@@ -3221,6 +3286,9 @@ isis_init ()
   install_element (ISIS_NODE, &spf_interval_l2_cmd);
   install_element (ISIS_NODE, &no_spf_interval_l2_cmd);
   install_element (ISIS_NODE, &no_spf_interval_l2_arg_cmd);
+  install_element (ISIS_NODE, &spf_workers_cmd);
+  install_element (ISIS_NODE, &no_spf_workers_cmd);
+  install_element (ISIS_NODE, &no_spf_workers_arg_cmd);
 
   install_element (ISIS_NODE, &max_lsp_lifetime_cmd);
   install_element (ISIS_NODE, &no_max_lsp_lifetime_cmd);
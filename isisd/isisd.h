@@ -95,8 +95,10 @@ struct isis_area
   struct list *circuit_list;	/* IS-IS circuits */
   struct flags flags;
   struct thread *t_tick;	/* LSP walker */
+  struct timer_wheel *lsp_wheel;	/* LSP lifetimes */
   struct thread *t_lsp_refresh[ISIS_LEVELS];
   int lsp_regenerate_pending[ISIS_LEVELS];
+  struct thread *t_spf_batch;	/* computes the SPF trees due together */
 
   /*
    * Configurables 
@@ -121,6 +123,8 @@ struct isis_area
   u_int16_t lsp_gen_interval[ISIS_LEVELS];
   /* min interval between between consequtive SPFs */
   u_int16_t min_spf_interval[ISIS_LEVELS];
+  /* threads the SPF trees may be computed on */
+  u_char spf_workers;
   /* the percentage of LSP mtu size used, before generating a new frag */
   int lsp_frag_threshold;
   int ip_circuits;
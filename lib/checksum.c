@@ -9,13 +9,13 @@
 #include <zebra.h>
 #include "checksum.h"
 
-int			/* return checksum in low-order 16 bits */
-in_cksum(void *parg, int nbytes)
+/* Sum of the 16-bit words of the buffer, to be folded by in_cksum(). */
+static long
+in_cksum_sum_scalar (const u_char *buf, int nbytes)
 {
-	u_short *ptr = parg;
+	const u_short *ptr = (const u_short *) buf;
 	register long		sum;		/* assumes long == 32 bits */
 	u_short			oddbyte;
-	register u_short	answer;		/* assumes u_short == 16 bits */
 
 	/*
 	 * Our algorithm is simple, using a 32-bit accumulator (sum),
@@ -32,10 +32,288 @@ in_cksum(void *parg, int nbytes)
 				/* mop up an odd byte, if necessary */
 	if (nbytes == 1) {
 		oddbyte = 0;		/* make sure top half is zero */
-		*((u_char *) &oddbyte) = *(u_char *)ptr;   /* one byte only */
+		*((u_char *) &oddbyte) = *(const u_char *)ptr;   /* one byte only */
 		sum += oddbyte;
 	}
 
+	return sum;
+}
+
+/* Fletcher Checksum -- Refer to RFC1008. */
+#define MODX                 4102   /* 5802 should be fine */
+
+/* Run the Fletcher sums c0 and c1 over the buffer.  Both are left
+ * reduced modulo 255. */
+static void
+fletcher_sums_scalar (const u_char *p, size_t left, int *c0p, int *c1p)
+{
+  int c0 = *c0p, c1 = *c1p;
+  size_t partial_len, i;
+
+  while (left != 0)
+    {
+      partial_len = MIN(left, MODX);
+
+      for (i = 0; i < partial_len; i++)
+	{
+	  c0 = c0 + *(p++);
+	  c1 += c0;
+	}
+
+      c0 = c0 % 255;
+      c1 = c1 % 255;
+
+      left -= partial_len;
+    }
+
+  *c0p = c0;
+  *c1p = c1;
+}
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+
+/* The vector kernels sum whole blocks, a chunk at a time; what is left
+ * goes through the scalar code.  A chunk is small enough for none of
+ * the 32-bit lanes to overflow. */
+#define CKSUM_SIMD_CHUNK     4096
+
+__attribute__ ((target ("sse2")))
+static u_int64_t
+cksum_hsum_epi32_128 (__m128i v)
+{
+  u_int32_t lanes[4];
+
+  _mm_storeu_si128 ((__m128i *) lanes, v);
+  return (u_int64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+__attribute__ ((target ("sse2")))
+static u_int64_t
+cksum_hsum_epi64_128 (__m128i v)
+{
+  u_int64_t lanes[2];
+
+  _mm_storeu_si128 ((__m128i *) lanes, v);
+  return lanes[0] + lanes[1];
+}
+
+__attribute__ ((target ("sse2")))
+static long
+in_cksum_sum_sse2 (const u_char *buf, int nbytes)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  u_int64_t sum = 0;
+
+  while (nbytes >= 16)
+    {
+      __m128i acc = zero;
+      int n = MIN (nbytes, CKSUM_SIMD_CHUNK) & ~15;
+
+      nbytes -= n;
+      for (; n; n -= 16, buf += 16)
+	{
+	  __m128i v = _mm_loadu_si128 ((const __m128i *) buf);
+
+	  acc = _mm_add_epi32 (acc, _mm_unpacklo_epi16 (v, zero));
+	  acc = _mm_add_epi32 (acc, _mm_unpackhi_epi16 (v, zero));
+	}
+      sum += cksum_hsum_epi32_128 (acc);
+    }
+
+  return (long) (sum + in_cksum_sum_scalar (buf, nbytes));
+}
+
+__attribute__ ((target ("avx2")))
+static long
+in_cksum_sum_avx2 (const u_char *buf, int nbytes)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  u_int64_t sum = 0;
+
+  while (nbytes >= 32)
+    {
+      __m256i acc = zero;
+      int n = MIN (nbytes, CKSUM_SIMD_CHUNK) & ~31;
+
+      nbytes -= n;
+      for (; n; n -= 32, buf += 32)
+	{
+	  __m256i v = _mm256_loadu_si256 ((const __m256i *) buf);
+
+	  acc = _mm256_add_epi32 (acc, _mm256_unpacklo_epi16 (v, zero));
+	  acc = _mm256_add_epi32 (acc, _mm256_unpackhi_epi16 (v, zero));
+	}
+      sum += cksum_hsum_epi32_128 (_mm_add_epi32
+				   (_mm256_castsi256_si128 (acc),
+				    _mm256_extracti128_si256 (acc, 1)));
+    }
+
+  return (long) (sum + in_cksum_sum_scalar (buf, nbytes));
+}
+
+/* Per block of n bytes starting with sums c0 and c1, c0 gains the sum
+ * of the bytes, and c1 gains n * c0 plus each byte weighted by its
+ * distance from the end of the block, n for the first down to 1.  The
+ * weights within a vector are applied with a multiply-add; the part
+ * due to the vectors before is the running sum of their byte sums,
+ * kept in vs1_prev. */
+__attribute__ ((target ("sse2")))
+static void
+fletcher_sums_sse2 (const u_char *p, size_t left, int *c0p, int *c1p)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i w_lo = _mm_setr_epi16 (16, 15, 14, 13, 12, 11, 10, 9);
+  const __m128i w_hi = _mm_setr_epi16 (8, 7, 6, 5, 4, 3, 2, 1);
+  u_int64_t c0 = *c0p, c1 = *c1p;
+
+  while (left >= 16)
+    {
+      __m128i vs1 = zero, vs1_prev = zero, vs2 = zero;
+      size_t n = MIN (left, CKSUM_SIMD_CHUNK) & ~15;
+
+      left -= n;
+      c1 += n * c0;
+      for (; n; n -= 16, p += 16)
+	{
+	  __m128i v = _mm_loadu_si128 ((const __m128i *) p);
+
+	  vs1_prev = _mm_add_epi32 (vs1_prev, vs1);
+	  vs1 = _mm_add_epi32 (vs1, _mm_sad_epu8 (v, zero));
+	  vs2 = _mm_add_epi32 (vs2, _mm_madd_epi16 (_mm_unpacklo_epi8 (v, zero),
+						    w_lo));
+	  vs2 = _mm_add_epi32 (vs2, _mm_madd_epi16 (_mm_unpackhi_epi8 (v, zero),
+						    w_hi));
+	}
+      /* The byte sums are in the low half of each 64-bit lane. */
+      c0 += cksum_hsum_epi64_128 (vs1);
+      c1 += 16 * cksum_hsum_epi64_128 (vs1_prev) + cksum_hsum_epi32_128 (vs2);
+      c0 %= 255;
+      c1 %= 255;
+    }
+
+  *c0p = c0;
+  *c1p = c1;
+  fletcher_sums_scalar (p, left, c0p, c1p);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+fletcher_sums_avx2 (const u_char *p, size_t left, int *c0p, int *c1p)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  const __m256i ones = _mm256_set1_epi16 (1);
+  const __m256i weights =
+    _mm256_setr_epi8 (32, 31, 30, 29, 28, 27, 26, 25,
+		      24, 23, 22, 21, 20, 19, 18, 17,
+		      16, 15, 14, 13, 12, 11, 10, 9,
+		      8, 7, 6, 5, 4, 3, 2, 1);
+  u_int64_t c0 = *c0p, c1 = *c1p;
+  u_int64_t lanes[4];
+
+  while (left >= 32)
+    {
+      __m256i vs1 = zero, vs1_prev = zero, vs2 = zero;
+      __m128i s;
+      size_t n = MIN (left, CKSUM_SIMD_CHUNK) & ~31;
+
+      left -= n;
+      c1 += n * c0;
+      for (; n; n -= 32, p += 32)
+	{
+	  __m256i v = _mm256_loadu_si256 ((const __m256i *) p);
+
+	  vs1_prev = _mm256_add_epi32 (vs1_prev, vs1);
+	  vs1 = _mm256_add_epi32 (vs1, _mm256_sad_epu8 (v, zero));
+	  vs2 = _mm256_add_epi32 (vs2, _mm256_madd_epi16
+				  (_mm256_maddubs_epi16 (v, weights), ones));
+	}
+      _mm256_storeu_si256 ((__m256i *) lanes, vs1);
+      c0 += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+      _mm256_storeu_si256 ((__m256i *) lanes, vs1_prev);
+      c1 += 32 * (lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+      s = _mm_add_epi32 (_mm256_castsi256_si128 (vs2),
+			 _mm256_extracti128_si256 (vs2, 1));
+      c1 += cksum_hsum_epi32_128 (s);
+      c0 %= 255;
+      c1 %= 255;
+    }
+
+  *c0p = c0;
+  *c1p = c1;
+  fletcher_sums_scalar (p, left, c0p, c1p);
+}
+#endif /* HAVE_X86_SIMD */
+
+static const struct checksum_kernel
+{
+  const char *name;
+  long (*in_cksum_sum) (const u_char *, int);
+  void (*fletcher_sums) (const u_char *, size_t, int *, int *);
+} checksum_kernels[CHECKSUM_IMPL_MAX] =
+{
+  [CHECKSUM_SCALAR] = { "scalar", in_cksum_sum_scalar, fletcher_sums_scalar },
+#ifdef HAVE_X86_SIMD
+  [CHECKSUM_SSE2] = { "sse2", in_cksum_sum_sse2, fletcher_sums_sse2 },
+  [CHECKSUM_AVX2] = { "avx2", in_cksum_sum_avx2, fletcher_sums_avx2 },
+#endif /* HAVE_X86_SIMD */
+};
+
+static const struct checksum_kernel *checksum_kernel;
+
+const char *
+checksum_impl_name (int impl)
+{
+  if (impl < 0 || impl >= CHECKSUM_IMPL_MAX)
+    return NULL;
+  return checksum_kernels[impl].name;
+}
+
+/* Whether the implementation is built in and runs on this CPU. */
+int
+checksum_impl_supported (int impl)
+{
+  if (impl < 0 || impl >= CHECKSUM_IMPL_MAX || ! checksum_kernels[impl].name)
+    return 0;
+
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init ();
+  switch (impl)
+    {
+    case CHECKSUM_SSE2:
+      return __builtin_cpu_supports ("sse2");
+    case CHECKSUM_AVX2:
+      return __builtin_cpu_supports ("avx2");
+    }
+#endif /* HAVE_X86_SIMD */
+  return 1;
+}
+
+/* Use the given implementation, or the fastest supported one if impl
+ * is negative or unsupported.  Returns the one in use.  The first
+ * checksum selects the fastest if nothing was set before. */
+int
+checksum_select (int impl)
+{
+  if (! checksum_impl_supported (impl))
+    for (impl = CHECKSUM_IMPL_MAX - 1; impl > CHECKSUM_SCALAR; impl--)
+      if (checksum_impl_supported (impl))
+	break;
+
+  checksum_kernel = &checksum_kernels[impl];
+  return impl;
+}
+
+int			/* return checksum in low-order 16 bits */
+in_cksum(void *parg, int nbytes)
+{
+	register long		sum;
+	register u_short	answer;		/* assumes u_short == 16 bits */
+
+	if (! checksum_kernel)
+		checksum_select (-1);
+	sum = checksum_kernel->in_cksum_sum (parg, nbytes);
+
 	/*
 	 * Add back carry outs from top 16 bits to low 16 bits.
 	 */
@@ -46,9 +324,6 @@ in_cksum(void *parg, int nbytes)
 	return(answer);
 }
 
-/* Fletcher Checksum -- Refer to RFC1008. */
-#define MODX                 4102   /* 5802 should be fine */
-
 /* To be consistent, offset is 0-based index, rather than the 1-based 
    index required in the specification ISO 8473, Annex C.1 */
 /* calling with offset == FLETCHER_CHECKSUM_VALIDATE will validate the checksum
@@ -56,11 +331,9 @@ in_cksum(void *parg, int nbytes)
 u_int16_t
 fletcher_checksum(u_char * buffer, const size_t len, const uint16_t offset)
 {
-  u_int8_t *p;
   int x, y, c0, c1;
   u_int16_t checksum;
   u_int16_t *csum;
-  size_t partial_len, i, left = len;
   
   checksum = 0;
 
@@ -73,25 +346,11 @@ fletcher_checksum(u_char * buffer, const size_t len, const uint16_t offset)
       *(csum) = 0;
     }
 
-  p = buffer;
   c0 = 0;
   c1 = 0;
-
-  while (left != 0)
-    {
-      partial_len = MIN(left, MODX);
-
-      for (i = 0; i < partial_len; i++)
-	{
-	  c0 = c0 + *(p++);
-	  c1 += c0;
-	}
-
-      c0 = c0 % 255;
-      c1 = c1 % 255;
-
-      left -= partial_len;
-    }
+  if (! checksum_kernel)
+    checksum_select (-1);
+  checksum_kernel->fletcher_sums (buffer, len, &c0, &c1);
 
   /* The cast is important, to ensure the mod is taken as a signed value. */
   x = (int)((len - offset - 1) * c0 - c1) % 255;
@@ -1,3 +1,17 @@
 extern int in_cksum(void *, int);
 #define FLETCHER_CHECKSUM_VALIDATE 0xffff
 extern u_int16_t fletcher_checksum(u_char *, const size_t len, const uint16_t offset);
+
+/* Checksum implementations, slowest first.  Only the scalar one is
+ * always built; the others depend on the compiler and CPU. */
+enum checksum_impl
+{
+  CHECKSUM_SCALAR,
+  CHECKSUM_SSE2,
+  CHECKSUM_AVX2,
+  CHECKSUM_IMPL_MAX
+};
+
+extern const char *checksum_impl_name (int);
+extern int checksum_impl_supported (int);
+extern int checksum_select (int);
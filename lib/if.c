@@ -35,10 +35,23 @@
 #include "buffer.h"
 #include "str.h"
 #include "log.h"
+#include "hash.h"
+#include "jhash.h"
 
 /* Master list of interfaces. */
 struct list *iflist;
 
+/* Interfaces by index and by name, kept by if_create(), if_delete()
+   and if_set_index(). */
+static struct hash *if_index_hash;
+static struct hash *if_name_hash;
+
+/* IPv4 connected prefixes, each with the list of connected addresses
+   having it, kept by connected_add() and connected_delete(). */
+static struct route_table *connected_ipv4_table;
+
+static void connected_index_delete (struct connected *);
+
 /* One for each program.  This structure is needed to store hooks. */
 struct if_master
 {
@@ -111,6 +124,82 @@ if_cmp_func (struct interface *ifp1, struct interface *ifp2)
   return 0;
 }
 
+static unsigned int
+if_index_hash_key (void *arg)
+{
+  struct interface *ifp = arg;
+
+  return jhash_1word (ifp->ifindex, 0);
+}
+
+static int
+if_index_hash_cmp (const void *a, const void *b)
+{
+  const struct interface *ifp1 = a;
+  const struct interface *ifp2 = b;
+
+  return ifp1->ifindex == ifp2->ifindex;
+}
+
+static unsigned int
+if_name_hash_key (void *arg)
+{
+  struct interface *ifp = arg;
+
+  return string_hash_make (ifp->name);
+}
+
+static int
+if_name_hash_cmp (const void *a, const void *b)
+{
+  const struct interface *ifp1 = a;
+  const struct interface *ifp2 = b;
+
+  return strcmp (ifp1->name, ifp2->name) == 0;
+}
+
+static void
+if_index_link (struct interface *ifp)
+{
+  if (ifp->ifindex != IFINDEX_INTERNAL)
+    hash_get (if_index_hash, ifp, hash_alloc_intern);
+}
+
+/* Take an interface out of the index hash.  Should another interface
+   have the same index, it takes the place. */
+static void
+if_index_unlink (struct interface *ifp)
+{
+  struct listnode *node;
+  struct interface *other;
+
+  if (ifp->ifindex == IFINDEX_INTERNAL
+      || hash_lookup (if_index_hash, ifp) != ifp)
+    return;
+
+  hash_release (if_index_hash, ifp);
+  for (ALL_LIST_ELEMENTS_RO (iflist, node, other))
+    if (other != ifp && other->ifindex == ifp->ifindex)
+      {
+        if_index_link (other);
+        break;
+      }
+}
+
+/* Set the index of an interface.  This must be used rather than
+   assigning ifp->ifindex, which would leave if_lookup_by_index()
+   stale. */
+void
+if_set_index (struct interface *ifp, unsigned int ifindex)
+{
+  if (ifp->ifindex == ifindex)
+    return;
+
+  if_index_unlink (ifp);
+  ifp->ifindex = ifindex;
+  if_index_link (ifp);
+}
+
 /* Create new interface structure. */
 struct interface *
 if_create (const char *name, int namelen)
@@ -125,7 +214,10 @@ if_create (const char *name, int namelen)
   strncpy (ifp->name, name, namelen);
   ifp->name[namelen] = '\0';
   if (if_lookup_by_name(ifp->name) == NULL)
-    listnode_add_sort (iflist, ifp);
+    {
+      listnode_add_sort (iflist, ifp);
+      hash_get (if_name_hash, ifp, hash_alloc_intern);
+    }
   else
     zlog_err("if_create(%s): corruption detected -- interface with this "
 	     "name exists already!", ifp->name);
@@ -142,10 +234,15 @@ if_create (const char *name, int namelen)
 void
 if_delete_retain (struct interface *ifp)
 {
+  struct listnode *node;
+  struct connected *ifc;
+
   if (if_master.if_delete_hook)
     (*if_master.if_delete_hook) (ifp);
 
   /* Free connected address list */
+  for (ALL_LIST_ELEMENTS_RO (ifp->connected, node, ifc))
+    connected_index_delete (ifc);
   list_delete_all_node (ifp->connected);
 }
 
@@ -154,6 +251,9 @@ void
 if_delete (struct interface *ifp)
 {
   listnode_delete (iflist, ifp);
+  if_index_unlink (ifp);
+  if (hash_lookup (if_name_hash, ifp) == ifp)
+    hash_release (if_name_hash, ifp);
 
   if_delete_retain(ifp);
 
@@ -182,15 +282,13 @@ if_add_hook (int type, int (*func)(struct interface *ifp))
 struct interface *
 if_lookup_by_index (unsigned int index)
 {
-  struct listnode *node;
-  struct interface *ifp;
+  struct interface key;
 
-  for (ALL_LIST_ELEMENTS_RO(iflist, node, ifp))
-    {
-      if (ifp->ifindex == index)
-	return ifp;
-    }
-  return NULL;
+  if (index == IFINDEX_INTERNAL)
+    return NULL;
+
+  key.ifindex = index;
+  return hash_lookup (if_index_hash, &key);
 }
 
 const char *
@@ -215,33 +313,23 @@ ifname2ifindex (const char *name)
 struct interface *
 if_lookup_by_name (const char *name)
 {
-  struct listnode *node;
-  struct interface *ifp;
-  
-  if (name)
-    for (ALL_LIST_ELEMENTS_RO (iflist, node, ifp))
-      {
-        if (strcmp(name, ifp->name) == 0)
-          return ifp;
-      }
-  return NULL;
+  if (name == NULL)
+    return NULL;
+
+  return if_lookup_by_name_len (name, strlen (name));
 }
 
 struct interface *
 if_lookup_by_name_len(const char *name, size_t namelen)
 {
-  struct listnode *node;
-  struct interface *ifp;
+  struct interface key;
 
   if (namelen > INTERFACE_NAMSIZ)
     return NULL;
 
-  for (ALL_LIST_ELEMENTS_RO (iflist, node, ifp))
-    {
-      if (!memcmp(name, ifp->name, namelen) && (ifp->name[namelen] == '\0'))
-	return ifp;
-    }
-  return NULL;
+  memcpy (key.name, name, namelen);
+  key.name[namelen] = '\0';
+  return hash_lookup (if_name_hash, &key);
 }
 
 /* Lookup interface by IPv4 address. */
@@ -270,15 +358,14 @@ if_lookup_exact_address (struct in_addr src)
   return NULL;
 }
 
-/* Lookup interface by IPv4 address. */
+/* Lookup interface by IPv4 address: the interface with the longest
+   connected prefix covering it, the first in iflist order on a tie. */
 struct interface *
 if_lookup_address (struct in_addr src)
 {
-  struct listnode *node;
   struct prefix addr;
-  int bestlen = 0;
+  struct route_node *rn;
   struct listnode *cnode;
-  struct interface *ifp;
   struct connected *c;
   struct interface *match;
 
@@ -288,19 +375,17 @@ if_lookup_address (struct in_addr src)
 
   match = NULL;
 
-  for (ALL_LIST_ELEMENTS_RO (iflist, node, ifp))
-    {
-      for (ALL_LIST_ELEMENTS_RO (ifp->connected, cnode, c))
-	{
-	  if (c->address && (c->address->family == AF_INET) &&
-	      prefix_match(CONNECTED_PREFIX(c), &addr) &&
-	      (c->address->prefixlen > bestlen))
-	    {
-	      bestlen = c->address->prefixlen;
-	      match = ifp;
-	    }
-	}
-    }
+  rn = route_node_match (connected_ipv4_table, &addr);
+  if (! rn)
+    return NULL;
+
+  /* A zero length prefix never matches. */
+  if (rn->p.prefixlen > 0)
+    for (ALL_LIST_ELEMENTS_RO ((struct list *) rn->info, cnode, c))
+      if (! match || if_cmp_func (c->ifp, match) < 0)
+	match = c->ifp;
+
+  route_unlock_node (rn);
   return match;
 }
 
@@ -685,6 +770,84 @@ connected_same_prefix (struct prefix *p1, struct prefix *p2)
   return 0;
 }
 
+/* Key of a connected address in connected_ipv4_table.  Returns 0 if it
+   does not go there. */
+static int
+connected_index_prefix (struct connected *ifc, struct prefix *p)
+{
+  struct prefix *cp;
+
+  if (! ifc->address || ifc->address->family != AF_INET)
+    return 0;
+
+  cp = CONNECTED_PREFIX (ifc);
+  if (! cp)
+    return 0;
+
+  prefix_copy (p, cp);
+  apply_mask (p);
+  return 1;
+}
+
+static void
+connected_index_add (struct connected *ifc)
+{
+  struct prefix p;
+  struct route_node *rn;
+
+  if (! connected_index_prefix (ifc, &p))
+    return;
+
+  rn = route_node_get (connected_ipv4_table, &p);
+  if (rn->info)
+    route_unlock_node (rn);
+  else
+    rn->info = list_new ();
+  listnode_add (rn->info, ifc);
+}
+
+static void
+connected_index_delete (struct connected *ifc)
+{
+  struct prefix p;
+  struct route_node *rn;
+  struct list *list;
+
+  if (! connected_index_prefix (ifc, &p))
+    return;
+
+  rn = route_node_lookup (connected_ipv4_table, &p);
+  if (! rn)
+    return;
+
+  list = rn->info;
+  listnode_delete (list, ifc);
+  if (list_isempty (list))
+    {
+      list_delete (list);
+      rn->info = NULL;
+      route_unlock_node (rn);
+    }
+  route_unlock_node (rn);
+}
+
+/* Add a connected address to its interface.  The address and flags of
+   a connected address must not change while it is on the interface. */
+void
+connected_add (struct interface *ifp, struct connected *ifc)
+{
+  listnode_add (ifp->connected, ifc);
+  connected_index_add (ifc);
+}
+
+/* Take a connected address off its interface; it is not freed. */
+void
+connected_delete (struct interface *ifp, struct connected *ifc)
+{
+  connected_index_delete (ifc);
+  listnode_delete (ifp->connected, ifc);
+}
+
 struct connected *
 connected_delete_by_prefix (struct interface *ifp, struct prefix *p)
 {
@@ -700,7 +863,7 @@ connected_delete_by_prefix (struct interface *ifp, struct prefix *p)
 
       if (connected_same_prefix (ifc->address, p))
 	{
-	  listnode_delete (ifp->connected, ifc);
+	  connected_delete (ifp, ifc);
 	  return ifc;
 	}
     }
@@ -755,7 +918,7 @@ connected_add_by_prefix (struct interface *ifp, struct prefix *p,
     }
 
   /* Add connected address to the interface. */
-  listnode_add (ifp->connected, ifc);
+  connected_add (ifp, ifc);
   return ifc;
 }
 
@@ -783,93 +946,15 @@ if_indextoname (unsigned int ifindex, char *name)
 }
 #endif
 
-#if 0 /* this route_table of struct connected's is unused
-       * however, it would be good to use a route_table rather than
-       * a list..
-       */
-/* Interface looking up by interface's address. */
-/* Interface's IPv4 address reverse lookup table. */
-struct route_table *ifaddr_ipv4_table;
-/* struct route_table *ifaddr_ipv6_table; */
-
-static void
-ifaddr_ipv4_add (struct in_addr *ifaddr, struct interface *ifp)
-{
-  struct route_node *rn;
-  struct prefix_ipv4 p;
-
-  p.family = AF_INET;
-  p.prefixlen = IPV4_MAX_PREFIXLEN;
-  p.prefix = *ifaddr;
-
-  rn = route_node_get (ifaddr_ipv4_table, (struct prefix *) &p);
-  if (rn)
-    {
-      route_unlock_node (rn);
-      zlog_info ("ifaddr_ipv4_add(): address %s is already added",
-		 inet_ntoa (*ifaddr));
-      return;
-    }
-  rn->info = ifp;
-}
-
-static void
-ifaddr_ipv4_delete (struct in_addr *ifaddr, struct interface *ifp)
-{
-  struct route_node *rn;
-  struct prefix_ipv4 p;
-
-  p.family = AF_INET;
-  p.prefixlen = IPV4_MAX_PREFIXLEN;
-  p.prefix = *ifaddr;
-
-  rn = route_node_lookup (ifaddr_ipv4_table, (struct prefix *) &p);
-  if (! rn)
-    {
-      zlog_info ("ifaddr_ipv4_delete(): can't find address %s",
-		 inet_ntoa (*ifaddr));
-      return;
-    }
-  rn->info = NULL;
-  route_unlock_node (rn);
-  route_unlock_node (rn);
-}
-
-/* Lookup interface by interface's IP address or interface index. */
-static struct interface *
-ifaddr_ipv4_lookup (struct in_addr *addr, unsigned int ifindex)
-{
-  struct prefix_ipv4 p;
-  struct route_node *rn;
-  struct interface *ifp;
-
-  if (addr)
-    {
-      p.family = AF_INET;
-      p.prefixlen = IPV4_MAX_PREFIXLEN;
-      p.prefix = *addr;
-
-      rn = route_node_lookup (ifaddr_ipv4_table, (struct prefix *) &p);
-      if (! rn)
-	return NULL;
-      
-      ifp = rn->info;
-      route_unlock_node (rn);
-      return ifp;
-    }
-  else
-    return if_lookup_by_index(ifindex);
-}
-#endif /* ifaddr_ipv4_table */
 
 /* Initialize interface list. */
 void
 if_init (void)
 {
   iflist = list_new ();
-#if 0
-  ifaddr_ipv4_table = route_table_init ();
-#endif /* ifaddr_ipv4_table */
+  if_index_hash = hash_create (if_index_hash_key, if_index_hash_cmp);
+  if_name_hash = hash_create (if_name_hash_key, if_name_hash_cmp);
+  connected_ipv4_table = route_table_init ();
 
   if (iflist) {
     iflist->cmp = (int (*)(void *, void *))if_cmp_func;
@@ -895,4 +980,11 @@ if_terminate (void)
 
   list_delete (iflist);
   iflist = NULL;
+
+  hash_free (if_index_hash);
+  if_index_hash = NULL;
+  hash_free (if_name_hash);
+  if_name_hash = NULL;
+  route_table_finish (connected_ipv4_table);
+  connected_ipv4_table = NULL;
 }
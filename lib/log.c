@@ -34,6 +34,9 @@
 #ifdef HAVE_UCONTEXT_H
 #include <ucontext.h>
 #endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 static int logfile_fd = -1;	/* Used in signal handler. */
 
@@ -144,6 +147,394 @@ time_print(FILE *fp, struct timestamp_control *ctl)
     }
   fprintf(fp, "%s ", ctl->buf);
 }
+
+#ifdef HAVE_PTHREAD
+/* Asynchronous logging.  Every logging thread formats its messages into
+   a ring of its own, which only that thread fills and only the writer
+   thread drains.  The logging path takes the lock only to wake the
+   writer when it had caught up with the ring.  The writer thread drains
+   all rings in batches, with a single flush of the log file per batch,
+   and sleeps on a condition variable when there is nothing to write.
+   When a ring is full the message is dropped and counted; the writer
+   reports the count.
+
+   Messages at LOG_CRIT and above are always written synchronously, so
+   that assertion failures and the like are on disk before we abort.
+   zlog_signal() does not go through here, but writes out what is still
+   pending in the rings before its own message. */
+#define ZLOG_RING_SIZE		512	/* slots per ring, power of 2 */
+#define ZLOG_MSG_SIZE		1024	/* longest message text */
+
+/* Destinations a message is to be written to. */
+#define ZLOG_MSG_FILE		(1 << 0)
+#define ZLOG_MSG_SYSLOG		(1 << 1)
+
+struct zlog_msg
+{
+  int priority;
+  int dests;
+  size_t len;		/* length of text */
+  size_t msgstart;	/* message proper, past timestamp and prefixes */
+  char text[ZLOG_MSG_SIZE];
+};
+
+struct zlog_ring
+{
+  struct zlog_ring *next;
+
+  /* Only the logging thread writes head and dropped, only the writer
+     thread writes tail. */
+  volatile unsigned int head;
+  volatile unsigned int tail;
+  volatile unsigned long dropped;
+  unsigned long dropped_seen;
+
+  /* Set when the logging thread has exited. */
+  volatile int orphaned;
+
+  struct zlog_msg msg[ZLOG_RING_SIZE];
+};
+
+static struct
+{
+  pthread_t thread;
+  pthread_key_t key;
+  int key_created;
+  volatile int running;
+  struct zlog *zl;
+
+  /* Protects the ring list, and zl->fp against the writer. */
+  pthread_mutex_t mutex;
+  struct zlog_ring *rings;
+
+  /* The writer waits on this, under the mutex, when idle. */
+  pthread_cond_t wake;
+
+  unsigned long dropped;
+} zlog_async =
+{
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+  .wake = PTHREAD_COND_INITIALIZER,
+};
+
+#define ZLOG_LOCK(zl) \
+  do { if ((zl)->async) pthread_mutex_lock (&zlog_async.mutex); } while (0)
+#define ZLOG_UNLOCK(zl) \
+  do { if ((zl)->async) pthread_mutex_unlock (&zlog_async.mutex); } while (0)
+
+static void
+zlog_ring_orphan (void *arg)
+{
+  struct zlog_ring *ring = arg;
+
+  ring->orphaned = 1;
+}
+
+/* The calling thread's ring, created on first use. */
+static struct zlog_ring *
+zlog_ring_get (void)
+{
+  struct zlog_ring *ring;
+
+  ring = pthread_getspecific (zlog_async.key);
+  if (ring)
+    return ring;
+
+  ring = XCALLOC (MTYPE_ZLOG_RING, sizeof (struct zlog_ring));
+  pthread_setspecific (zlog_async.key, ring);
+
+  pthread_mutex_lock (&zlog_async.mutex);
+  ring->next = zlog_async.rings;
+  zlog_async.rings = ring;
+  pthread_mutex_unlock (&zlog_async.mutex);
+
+  return ring;
+}
+
+/* Format a message into the calling thread's ring. */
+static void
+zlog_async_put (struct zlog *zl, int priority, int dests,
+		struct timestamp_control *ctl, const char *format,
+		va_list args)
+{
+  struct zlog_ring *ring = zlog_ring_get ();
+  struct zlog_msg *msg;
+  unsigned int head = ring->head;
+  int len;
+
+  if (head - ring->tail >= ZLOG_RING_SIZE)
+    {
+      ring->dropped++;
+      return;
+    }
+  msg = &ring->msg[head & (ZLOG_RING_SIZE - 1)];
+
+  if (!ctl->already_rendered)
+    {
+      ctl->len = quagga_timestamp(ctl->precision, ctl->buf, sizeof(ctl->buf));
+      ctl->already_rendered = 1;
+    }
+  len = snprintf (msg->text, sizeof (msg->text), "%s %s%s%s: ", ctl->buf,
+		  zl->record_priority ? zlog_priority[priority] : "",
+		  zl->record_priority ? ": " : "",
+		  zlog_proto_names[zl->protocol]);
+  if (len < 0 || len >= (int) sizeof (msg->text))
+    len = 0;
+  msg->msgstart = len;
+
+  len = vsnprintf (msg->text + msg->msgstart,
+		   sizeof (msg->text) - msg->msgstart, format, args);
+  if (len < 0)
+    len = 0;
+  else if (len >= (int) (sizeof (msg->text) - msg->msgstart))
+    len = sizeof (msg->text) - msg->msgstart - 1;
+  msg->len = msg->msgstart + len;
+  msg->priority = priority;
+  msg->dests = dests;
+
+  /* Message contents must be visible before the slot is published. */
+  __sync_synchronize ();
+  ring->head = head + 1;
+
+  /* If the writer had drained everything before this message it may be
+     asleep.  Otherwise it has yet to move the tail past the older
+     messages, and will see this one when it does. */
+  __sync_synchronize ();
+  if (ring->tail == head)
+    {
+      pthread_mutex_lock (&zlog_async.mutex);
+      pthread_cond_signal (&zlog_async.wake);
+      pthread_mutex_unlock (&zlog_async.mutex);
+    }
+}
+
+/* Write out everything pending in the rings.  Returns the number of
+   messages written.  Called with the mutex held. */
+static unsigned int
+zlog_async_drain (struct zlog *zl)
+{
+  struct zlog_ring *ring, **prev;
+  struct zlog_msg *msg;
+  unsigned int count = 0;
+  unsigned long dropped;
+
+  for (prev = &zlog_async.rings; (ring = *prev) != NULL; )
+    {
+      while (ring->tail != ring->head)
+	{
+	  __sync_synchronize ();
+	  msg = &ring->msg[ring->tail & (ZLOG_RING_SIZE - 1)];
+
+	  if ((msg->dests & ZLOG_MSG_FILE) && zl->fp)
+	    {
+	      fwrite (msg->text, 1, msg->len, zl->fp);
+	      putc ('\n', zl->fp);
+	    }
+	  if (msg->dests & ZLOG_MSG_SYSLOG)
+	    syslog (msg->priority|zl->facility, "%s",
+		    msg->text + msg->msgstart);
+
+	  /* Done with the slot before handing it back, and the new tail
+	     visible before head is read again; see zlog_async_put(). */
+	  __sync_synchronize ();
+	  ring->tail++;
+	  __sync_synchronize ();
+	  count++;
+	}
+
+      dropped = ring->dropped;
+      if (dropped != ring->dropped_seen)
+	{
+	  zlog_async.dropped += dropped - ring->dropped_seen;
+	  if (zl->fp && zl->maxlvl[ZLOG_DEST_FILE] != ZLOG_DISABLED)
+	    fprintf (zl->fp, "%s: %lu log messages dropped, logging too fast\n",
+		     zlog_proto_names[zl->protocol],
+		     dropped - ring->dropped_seen);
+	  if (zl->maxlvl[ZLOG_DEST_SYSLOG] >= LOG_WARNING)
+	    syslog (LOG_WARNING|zl->facility,
+		    "%lu log messages dropped, logging too fast",
+		    dropped - ring->dropped_seen);
+	  ring->dropped_seen = dropped;
+	}
+
+      if (ring->orphaned && ring->tail == ring->head)
+	{
+	  *prev = ring->next;
+	  XFREE (MTYPE_ZLOG_RING, ring);
+	}
+      else
+	prev = &ring->next;
+    }
+
+  if (count && zl->fp)
+    fflush (zl->fp);
+
+  return count;
+}
+
+static void *
+zlog_async_writer (void *arg)
+{
+  struct zlog *zl = arg;
+  sigset_t sigs;
+  unsigned int count;
+
+  /* Signals are the main thread's business. */
+  sigfillset (&sigs);
+  pthread_sigmask (SIG_BLOCK, &sigs, NULL);
+
+  pthread_mutex_lock (&zlog_async.mutex);
+  while (zlog_async.running)
+    {
+      count = zlog_async_drain (zl);
+      if (! count && zlog_async.running)
+	pthread_cond_wait (&zlog_async.wake, &zlog_async.mutex);
+    }
+  pthread_mutex_unlock (&zlog_async.mutex);
+
+  return NULL;
+}
+
+/* The configuration is read before the daemons detach, so the writer
+   thread has to be carried over into the child. */
+static void
+zlog_async_prefork (void)
+{
+  pthread_mutex_lock (&zlog_async.mutex);
+}
+
+static void
+zlog_async_postfork_parent (void)
+{
+  pthread_mutex_unlock (&zlog_async.mutex);
+}
+
+static void
+zlog_async_postfork_child (void)
+{
+  /* The parent's writer may have been waiting; it is not here. */
+  pthread_cond_init (&zlog_async.wake, NULL);
+  pthread_mutex_unlock (&zlog_async.mutex);
+  if (zlog_async.running
+      && pthread_create (&zlog_async.thread, NULL, zlog_async_writer,
+			 zlog_async.zl) != 0)
+    {
+      zlog_async.running = 0;
+      zlog_async.zl->async = 0;
+      zlog_async_drain (zlog_async.zl);
+    }
+}
+
+int
+zlog_async_start (struct zlog *zl)
+{
+  if (zl == NULL)
+    zl = zlog_default;
+
+  if (zl->async)
+    return 1;
+
+  if (! zlog_async.key_created)
+    {
+      if (pthread_key_create (&zlog_async.key, zlog_ring_orphan) != 0)
+	return 0;
+      pthread_atfork (zlog_async_prefork, zlog_async_postfork_parent,
+		      zlog_async_postfork_child);
+      zlog_async.key_created = 1;
+    }
+
+  zlog_async.zl = zl;
+  zlog_async.running = 1;
+  if (pthread_create (&zlog_async.thread, NULL, zlog_async_writer, zl) != 0)
+    {
+      zlog_async.running = 0;
+      return 0;
+    }
+
+  zl->async = 1;
+  return 1;
+}
+
+void
+zlog_async_stop (struct zlog *zl)
+{
+  if (zl == NULL)
+    zl = zlog_default;
+
+  if (! zl->async)
+    return;
+
+  pthread_mutex_lock (&zlog_async.mutex);
+  zlog_async.running = 0;
+  pthread_cond_signal (&zlog_async.wake);
+  pthread_mutex_unlock (&zlog_async.mutex);
+  pthread_join (zlog_async.thread, NULL);
+  zl->async = 0;
+
+  /* Whatever was logged since the writer's last pass. */
+  zlog_async_drain (zl);
+}
+
+unsigned long
+zlog_async_dropped (void)
+{
+  return zlog_async.dropped;
+}
+
+/* Write the messages still pending for the log file to FD, from a
+   signal handler: no lock, and only write().  The rings are left as
+   they are, the process is about to go. */
+static void
+zlog_async_dump_sigsafe (int fd)
+{
+  struct zlog_ring *ring;
+  struct zlog_msg *msg;
+  unsigned int tail, head;
+
+  if (! zlog_default || ! zlog_default->async)
+    return;
+
+  for (ring = zlog_async.rings; ring; ring = ring->next)
+    {
+      head = ring->head;
+      __sync_synchronize ();
+      for (tail = ring->tail; tail != head; tail++)
+	{
+	  msg = &ring->msg[tail & (ZLOG_RING_SIZE - 1)];
+	  if (msg->dests & ZLOG_MSG_FILE)
+	    {
+	      write (fd, msg->text, msg->len);
+	      write (fd, "\n", 1);
+	    }
+	}
+    }
+}
+#else /* HAVE_PTHREAD */
+#define ZLOG_LOCK(zl)
+#define ZLOG_UNLOCK(zl)
+
+int
+zlog_async_start (struct zlog *zl)
+{
+  return 0;
+}
+
+void
+zlog_async_stop (struct zlog *zl)
+{
+}
+
+unsigned long
+zlog_async_dropped (void)
+{
+  return 0;
+}
+
+static void
+zlog_async_dump_sigsafe (int fd)
+{
+}
+#endif /* HAVE_PTHREAD */
   
 
 /* va_list version of zlog. */
@@ -151,6 +542,7 @@ static void
 vzlog (struct zlog *zl, int priority, const char *format, va_list args)
 {
   struct timestamp_control tsctl;
+  int direct = 1;
   tsctl.already_rendered = 0;
 
   /* If zlog is not specified, use default one. */
@@ -172,8 +564,30 @@ vzlog (struct zlog *zl, int priority, const char *format, va_list args)
     }
   tsctl.precision = zl->timestamp_precision;
 
+#ifdef HAVE_PTHREAD
+  /* File and syslog output through the writer thread. */
+  if (zl->async && priority > LOG_CRIT)
+    {
+      int dests = 0;
+
+      direct = 0;
+
+      if (priority <= zl->maxlvl[ZLOG_DEST_SYSLOG])
+	dests |= ZLOG_MSG_SYSLOG;
+      if (priority <= zl->maxlvl[ZLOG_DEST_FILE])
+	dests |= ZLOG_MSG_FILE;
+      if (dests)
+	{
+	  va_list ac;
+	  va_copy(ac, args);
+	  zlog_async_put (zl, priority, dests, &tsctl, format, ac);
+	  va_end(ac);
+	}
+    }
+#endif /* HAVE_PTHREAD */
+
   /* Syslog output */
-  if (priority <= zl->maxlvl[ZLOG_DEST_SYSLOG])
+  if (direct && priority <= zl->maxlvl[ZLOG_DEST_SYSLOG])
     {
       va_list ac;
       va_copy(ac, args);
@@ -182,7 +596,7 @@ vzlog (struct zlog *zl, int priority, const char *format, va_list args)
     }
 
   /* File output. */
-  if ((priority <= zl->maxlvl[ZLOG_DEST_FILE]) && zl->fp)
+  if (direct && (priority <= zl->maxlvl[ZLOG_DEST_FILE]) && zl->fp)
     {
       va_list ac;
       time_print (zl->fp, &tsctl);
@@ -400,9 +814,14 @@ zlog_signal(int signo, const char *action
 #define PRI LOG_CRIT
 
 #define DUMP(FD) write(FD, buf, s-buf);
-  /* If no file logging configured, try to write to fallback log file. */
+  /* If no file logging configured, try to write to fallback log file.
+     What the writer thread has not got to yet goes first: it likely
+     explains the crash. */
   if ((logfile_fd >= 0) || ((logfile_fd = open_crashlog()) >= 0))
-    DUMP(logfile_fd)
+    {
+      zlog_async_dump_sigsafe (logfile_fd);
+      DUMP(logfile_fd)
+    }
   if (!zlog_default)
     DUMP(STDERR_FILENO)
   else
@@ -649,6 +1068,7 @@ openzlog (const char *progname, zlog_proto_t protocol,
 void
 closezlog (struct zlog *zl)
 {
+  zlog_async_stop (zl);
   closelog();
 
   if (zl->fp != NULL)
@@ -691,10 +1111,12 @@ zlog_set_file (struct zlog *zl, const char *filename, int log_level)
     return 0;
 
   /* Set flags. */
+  ZLOG_LOCK (zl);
   zl->filename = strdup (filename);
   zl->maxlvl[ZLOG_DEST_FILE] = log_level;
   zl->fp = fp;
   logfile_fd = fileno(fp);
+  ZLOG_UNLOCK (zl);
 
   return 1;
 }
@@ -706,6 +1128,7 @@ zlog_reset_file (struct zlog *zl)
   if (zl == NULL)
     zl = zlog_default;
 
+  ZLOG_LOCK (zl);
   if (zl->fp)
     fclose (zl->fp);
   zl->fp = NULL;
@@ -715,6 +1138,7 @@ zlog_reset_file (struct zlog *zl)
   if (zl->filename)
     free (zl->filename);
   zl->filename = NULL;
+  ZLOG_UNLOCK (zl);
 
   return 1;
 }
@@ -728,6 +1152,7 @@ zlog_rotate (struct zlog *zl)
   if (zl == NULL)
     zl = zlog_default;
 
+  ZLOG_LOCK (zl);
   if (zl->fp)
     fclose (zl->fp);
   zl->fp = NULL;
@@ -746,6 +1171,7 @@ zlog_rotate (struct zlog *zl)
       umask(oldumask);
       if (zl->fp == NULL)
         {
+	  ZLOG_UNLOCK (zl);
 	  zlog_err("Log rotate failed: cannot open file %s for append: %s",
 	  	   zl->filename, safe_strerror(save_errno));
 	  return -1;
@@ -753,6 +1179,7 @@ zlog_rotate (struct zlog *zl)
       logfile_fd = fileno(zl->fp);
       zl->maxlvl[ZLOG_DEST_FILE] = level;
     }
+  ZLOG_UNLOCK (zl);
 
   return 1;
 }
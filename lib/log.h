@@ -83,6 +83,8 @@ struct zlog
   			   priority of the message? */
   int syslog_options;	/* 2nd arg to openlog */
   int timestamp_precision;	/* # of digits of subsecond precision */
+  int async;		/* is file and syslog output done by the
+			   asynchronous writer thread? */
 };
 
 /* Message structure. */
@@ -146,6 +148,14 @@ extern int zlog_reset_file (struct zlog *zl);
 /* Rotate log. */
 extern int zlog_rotate (struct zlog *);
 
+/* Hand file and syslog output over to a writer thread, so that logging
+   threads only format their messages.  Returns 0 if not supported. */
+extern int zlog_async_start (struct zlog *zl);
+/* Write out whatever is pending and go back to synchronous logging. */
+extern void zlog_async_stop (struct zlog *zl);
+/* Number of messages dropped because a logging thread's ring was full. */
+extern unsigned long zlog_async_dropped (void);
+
 /* For hackey message lookup and check */
 #define LOOKUP_DEF(x, y, def) mes_lookup(x, x ## _max, y, def, #x)
 #define LOOKUP(x, y) LOOKUP_DEF(x, y, "(no item found)")
@@ -246,24 +246,34 @@ static struct
 } mstat [MTYPE_MAX];
 #endif /* MEMORY_LOG */
 
-/* Increment allocation counter. */
+/* Increment allocation counter.  Helper threads allocate too, so the
+   counters are updated atomically where threads are used. */
 static void
 alloc_inc (int type)
 {
+#ifdef HAVE_PTHREAD
+  __sync_fetch_and_add (&mstat[type].alloc, 1);
+#else
   mstat[type].alloc++;
+#endif /* HAVE_PTHREAD */
 }
 
 /* Decrement allocation counter. */
 static void
 alloc_dec (int type)
 {
+#ifdef HAVE_PTHREAD
+  __sync_fetch_and_sub (&mstat[type].alloc, 1);
+#else
   mstat[type].alloc--;
+#endif /* HAVE_PTHREAD */
 }
 
 /* Looking up memory status from vty interface. */
 #include "vector.h"
 #include "vty.h"
 #include "command.h"
+#include "stream.h"
 
 static void
 log_memstats(int pri)
@@ -405,6 +415,10 @@ DEFUN (show_memory_all,
 #ifdef HAVE_MALLINFO
   needsep = show_memory_mallinfo (vty);
 #endif /* HAVE_MALLINFO */
+
+  if (needsep)
+    show_separator (vty);
+  needsep = stream_pool_show (vty);
   
   for (ml = mlists; ml->list; ml++)
     {
@@ -31,6 +31,7 @@ struct memory_list memory_list_lib[] =
   { MTYPE_BUFFER_DATA,		"Buffer data"			},
   { MTYPE_STREAM,		"Stream"			},
   { MTYPE_STREAM_DATA,		"Stream data"			},
+  { MTYPE_STREAM_CACHE,		"Stream cache"			},
   { MTYPE_STREAM_FIFO,		"Stream FIFO"			},
   { MTYPE_PREFIX,		"Prefix"			},
   { MTYPE_PREFIX_IPV4,		"Prefix IPv4"			},
@@ -62,12 +63,15 @@ struct memory_list memory_list_lib[] =
   { MTYPE_SOCKUNION,		"Socket union"			},
   { MTYPE_PRIVS,		"Privilege information"		},
   { MTYPE_ZLOG,			"Logging"			},
+  { MTYPE_ZLOG_RING,		"Logging ring"			},
   { MTYPE_ZCLIENT,		"Zclient"			},
   { MTYPE_WORK_QUEUE,		"Work queue"			},
   { MTYPE_WORK_QUEUE_ITEM,	"Work queue item"		},
   { MTYPE_WORK_QUEUE_NAME,	"Work queue name string"	},
   { MTYPE_PQUEUE,		"Priority queue"		},
   { MTYPE_PQUEUE_DATA,		"Priority queue data"		},
+  { MTYPE_TIMER_WHEEL,		"Timer wheel"			},
+  { MTYPE_MSG_BATCH,		"Datagram batch"		},
   { MTYPE_HOST,			"Host config"			},
   { -1, NULL },
 };
@@ -84,6 +88,10 @@ struct memory_list memory_list_zebra[] =
   { MTYPE_STATIC_IPV6,		"Static IPv6 route"		},
   { MTYPE_RIB_DEST,		"RIB destination"		},
   { MTYPE_RIB_TABLE_INFO,	"RIB table info"		},
+  { MTYPE_RIB_SHOW_STATE,	"RIB show table walk"		},
+  { MTYPE_NEXTHOP_CACHE,	"Nexthop cache"			},
+  { MTYPE_NEXTHOP_CACHE_DEP,	"Nexthop cache dependency"	},
+  { MTYPE_NEXTHOP_GROUP,	"Nexthop group"			},
   { -1, NULL },
 };
 
@@ -107,13 +115,21 @@ struct memory_list memory_list_bgp[] =
   { MTYPE_BGP_NODE,		"BGP node"			},
   { MTYPE_BGP_ROUTE,		"BGP route"			},
   { MTYPE_BGP_ROUTE_EXTRA,	"BGP ancillary route info"	},
+  { MTYPE_BGP_PATH_VEC,		"BGP path decision keys"	},
+  { MTYPE_BGP_RSCLIENT_OUTCOME,	"BGP RS-client policy outcome"	},
   { MTYPE_BGP_CONN,		"BGP connected"			},
   { MTYPE_BGP_STATIC,		"BGP static"			},
   { MTYPE_BGP_ADVERTISE_ATTR,	"BGP adv attr"			},
   { MTYPE_BGP_ADVERTISE,	"BGP adv"			},
+  { MTYPE_BGP_ANNOUNCE,		"BGP table announcement"	},
   { MTYPE_BGP_SYNCHRONISE,	"BGP synchronise"		},
   { MTYPE_BGP_ADJ_IN,		"BGP adj in"			},
+  { MTYPE_BGP_ADJ_IN_ROUTE,	"BGP adj in routes"		},
+  { MTYPE_BGP_ADJ_IN_ATTR,	"BGP adj in attributes"		},
+  { MTYPE_BGP_ADJ_IN_INDEX,	"BGP adj in index"		},
   { MTYPE_BGP_ADJ_OUT,		"BGP adj out"			},
+  { MTYPE_BGP_ADJ_OUT_ATTR,	"BGP adj out attributes"	},
+  { MTYPE_BGP_PEER_SLOT,	"BGP peer slots"		},
   { MTYPE_BGP_MPATH_INFO,	"BGP multipath info"		},
   { 0, NULL },
   { MTYPE_AS_LIST,		"BGP AS list"			},
@@ -151,7 +167,11 @@ struct memory_list memory_list_bgp[] =
   { MTYPE_BGP_DAMP_ARRAY,	"BGP Dampening array"		},
   { MTYPE_BGP_REGEXP,		"BGP regexp"			},
   { MTYPE_BGP_AGGREGATE,	"BGP aggregate"			},
+  { MTYPE_BGP_AGGREGATE_ROUTE,	"BGP aggregated route"		},
+  { MTYPE_BGP_AGGREGATE_COUNT,	"BGP aggregate count"		},
   { MTYPE_BGP_ADDR,		"BGP own address"		},
+  { MTYPE_BGP_SHOW_STATE,	"BGP show table walk"		},
+  { MTYPE_BGP_IO,		"BGP I/O thread"		},
   { -1, NULL }
 };
 
@@ -252,6 +272,8 @@ struct memory_list memory_list_isis[] =
   { MTYPE_ISIS_NEXTHOP6,      "ISIS nexthop6"			},
   { MTYPE_ISIS_DICT,          "ISIS dictionary"			},
   { MTYPE_ISIS_DICT_NODE,     "ISIS dictionary node"		},
+  { MTYPE_ISIS_FLAGS,         "ISIS SRM/SSN flag table"		},
+  { MTYPE_ISIS_FLAG_ENTRY,    "ISIS SRM/SSN queue entry"		},
   { -1, NULL },
 };
 
@@ -0,0 +1,319 @@
+/*
+ * Batched datagram send and receive.
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "thread.h"
+#include "memory.h"
+#include "log.h"
+#include "vty.h"
+#include "network.h"
+#include "msgbatch.h"
+
+static int msg_batch_flush_thread (struct thread *);
+
+struct msg_batch *
+msg_batch_new (struct thread_master *master, int fd, unsigned int max,
+               size_t size)
+{
+  struct msg_batch *batch;
+
+  assert (max > 0 && size > 0);
+
+  batch = XCALLOC (MTYPE_MSG_BATCH, sizeof (struct msg_batch));
+  batch->master = master;
+  batch->fd = fd;
+  batch->max = max;
+  batch->size = size;
+  batch->msgs = XCALLOC (MTYPE_MSG_BATCH, max * sizeof (struct msg_batch_msg));
+  batch->data = XMALLOC (MTYPE_MSG_BATCH, max * size);
+
+  return batch;
+}
+
+/* Free a batch.  Datagrams still queued are dropped. */
+void
+msg_batch_free (struct msg_batch *batch)
+{
+  THREAD_OFF (batch->t_flush);
+  XFREE (MTYPE_MSG_BATCH, batch->msgs);
+  XFREE (MTYPE_MSG_BATCH, batch->data);
+  XFREE (MTYPE_MSG_BATCH, batch);
+}
+
+static void
+msg_batch_hdr (struct msg_batch *batch, unsigned int i, struct msghdr *hdr,
+               struct iovec *iov, int sending)
+{
+  struct msg_batch_msg *msg = &batch->msgs[i];
+
+  iov->iov_base = MSG_BATCH_DATA (batch, i);
+  iov->iov_len = sending ? msg->len : batch->size;
+
+  memset (hdr, 0, sizeof (struct msghdr));
+  hdr->msg_name = &msg->addr;
+  hdr->msg_namelen = sending ? msg->addrlen : sizeof (msg->addr);
+  hdr->msg_iov = iov;
+  hdr->msg_iovlen = 1;
+  if (! sending || msg->controllen)
+    {
+      hdr->msg_control = msg->control.buf;
+      hdr->msg_controllen = sending ? msg->controllen
+                                    : sizeof (msg->control.buf);
+    }
+}
+
+/* Queue a datagram, gathered from iov, for destination to.  Returns 0,
+ * or -1 if it does not fit in a batch buffer. */
+int
+msg_batch_add (struct msg_batch *batch, const struct sockaddr *to,
+               socklen_t tolen, const struct iovec *iov, int iovcnt)
+{
+  struct msg_batch_msg *msg;
+  char *p;
+  size_t len = 0;
+  int i;
+
+  for (i = 0; i < iovcnt; i++)
+    len += iov[i].iov_len;
+  if (len > batch->size || tolen > sizeof (msg->addr))
+    {
+      errno = EMSGSIZE;
+      return -1;
+    }
+
+  if (batch->count == batch->max)
+    msg_batch_flush (batch);
+  /* Still blocked; make room by dropping the oldest datagram. */
+  if (batch->count == batch->max)
+    {
+      batch->errors++;
+      memmove (batch->msgs, batch->msgs + 1,
+               (batch->max - 1) * sizeof (struct msg_batch_msg));
+      memmove (batch->data, batch->data + batch->size,
+               (batch->max - 1) * batch->size);
+      batch->count--;
+    }
+
+  msg = &batch->msgs[batch->count];
+  memcpy (&msg->addr, to, tolen);
+  msg->addrlen = tolen;
+  msg->len = len;
+  msg->controllen = 0;
+
+  p = MSG_BATCH_DATA (batch, batch->count);
+  for (i = 0; i < iovcnt; i++)
+    {
+      memcpy (p, iov[i].iov_base, iov[i].iov_len);
+      p += iov[i].iov_len;
+    }
+  batch->count++;
+
+  if (! batch->t_flush)
+    batch->t_flush = thread_add_event (batch->master, msg_batch_flush_thread,
+                                       batch, 0);
+  return 0;
+}
+
+/* Attach ancillary data to the datagram queued last. */
+int
+msg_batch_add_control (struct msg_batch *batch, int level, int type,
+                       const void *data, size_t len)
+{
+  struct msg_batch_msg *msg;
+  struct cmsghdr *cmsg;
+
+  assert (batch->count > 0);
+  msg = &batch->msgs[batch->count - 1];
+
+  if (msg->controllen + CMSG_SPACE (len) > sizeof (msg->control.buf))
+    {
+      errno = ENOBUFS;
+      return -1;
+    }
+
+  cmsg = (struct cmsghdr *) (msg->control.buf + msg->controllen);
+  memset (cmsg, 0, CMSG_SPACE (len));
+  cmsg->cmsg_level = level;
+  cmsg->cmsg_type = type;
+  cmsg->cmsg_len = CMSG_LEN (len);
+  memcpy (CMSG_DATA (cmsg), data, len);
+  msg->controllen += CMSG_SPACE (len);
+
+  return 0;
+}
+
+/* Drop the first n queued datagrams. */
+static void
+msg_batch_consume (struct msg_batch *batch, unsigned int n)
+{
+  if (n < batch->count)
+    {
+      memmove (batch->msgs, batch->msgs + n,
+               (batch->count - n) * sizeof (struct msg_batch_msg));
+      memmove (batch->data, batch->data + (size_t) n * batch->size,
+               (batch->count - n) * batch->size);
+    }
+  batch->count -= n;
+}
+
+/* Send what is queued.  Returns the number of datagrams sent.  If the
+ * socket would block, what is left is sent when it becomes writable. */
+int
+msg_batch_flush (struct msg_batch *batch)
+{
+  int sent = 0;
+  int ret;
+
+  THREAD_OFF (batch->t_flush);
+
+  while (batch->count > 0)
+    {
+#ifdef HAVE_SENDMMSG
+      struct mmsghdr hdrs[batch->count];
+      struct iovec iovs[batch->count];
+      unsigned int i;
+
+      for (i = 0; i < batch->count; i++)
+        {
+          msg_batch_hdr (batch, i, &hdrs[i].msg_hdr, &iovs[i], 1);
+          hdrs[i].msg_len = 0;
+        }
+      ret = sendmmsg (batch->fd, hdrs, batch->count, 0);
+#else
+      struct msghdr hdr;
+      struct iovec iov;
+
+      msg_batch_hdr (batch, 0, &hdr, &iov, 1);
+      ret = sendmsg (batch->fd, &hdr, 0) < 0 ? -1 : 1;
+#endif /* HAVE_SENDMMSG */
+      batch->syscalls++;
+
+      if (ret < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          if (ERRNO_IO_RETRY (errno))
+            {
+              batch->t_flush = thread_add_write (batch->master,
+                                                 msg_batch_flush_thread,
+                                                 batch, batch->fd);
+              break;
+            }
+          /* This datagram cannot be sent; skip it. */
+          zlog_warn ("can't send packet: %s", safe_strerror (errno));
+          batch->errors++;
+          ret = 1;
+        }
+      else
+        {
+          batch->packets += ret;
+          sent += ret;
+        }
+      msg_batch_consume (batch, ret);
+    }
+
+  return sent;
+}
+
+static int
+msg_batch_flush_thread (struct thread *thread)
+{
+  struct msg_batch *batch = THREAD_ARG (thread);
+
+  batch->t_flush = NULL;
+  msg_batch_flush (batch);
+  return 0;
+}
+
+/* Read the datagrams waiting on the socket, at most max of them.
+ * Returns how many were read, with batch->count set to that, or -1 with
+ * errno set if none could be read. */
+int
+msg_batch_recv (struct msg_batch *batch)
+{
+  unsigned int i;
+  int ret;
+
+#ifdef HAVE_RECVMMSG
+  struct mmsghdr hdrs[batch->max];
+  struct iovec iovs[batch->max];
+
+  for (i = 0; i < batch->max; i++)
+    {
+      msg_batch_hdr (batch, i, &hdrs[i].msg_hdr, &iovs[i], 0);
+      hdrs[i].msg_len = 0;
+    }
+
+  do
+    ret = recvmmsg (batch->fd, hdrs, batch->max, MSG_DONTWAIT, NULL);
+  while (ret < 0 && errno == EINTR);
+  batch->syscalls++;
+
+  for (i = 0; ret > 0 && i < (unsigned int) ret; i++)
+    {
+      batch->msgs[i].len = hdrs[i].msg_len;
+      batch->msgs[i].addrlen = hdrs[i].msg_hdr.msg_namelen;
+      batch->msgs[i].controllen = hdrs[i].msg_hdr.msg_controllen;
+    }
+#else
+  struct msghdr hdr;
+  struct iovec iov;
+  ssize_t len;
+
+  for (i = 0; i < batch->max; i++)
+    {
+      msg_batch_hdr (batch, i, &hdr, &iov, 0);
+      do
+        len = recvmsg (batch->fd, &hdr, MSG_DONTWAIT);
+      while (len < 0 && errno == EINTR);
+      batch->syscalls++;
+      if (len < 0)
+        break;
+      batch->msgs[i].len = len;
+      batch->msgs[i].addrlen = hdr.msg_namelen;
+      batch->msgs[i].controllen = hdr.msg_controllen;
+    }
+  ret = (i > 0) ? (int) i : -1;
+#endif /* HAVE_RECVMMSG */
+
+  if (ret < 0)
+    {
+      batch->count = 0;
+      return -1;
+    }
+
+  batch->count = ret;
+  batch->packets += ret;
+  return ret;
+}
+
+void
+msg_batch_show (struct vty *vty, const char *name, struct msg_batch *batch)
+{
+  vty_out (vty, "  %s: %lu datagrams in %lu system calls, %lu saved",
+           name, batch->packets, batch->syscalls,
+           batch->packets > batch->syscalls
+             ? batch->packets - batch->syscalls : 0);
+  if (batch->errors)
+    vty_out (vty, ", %lu errors", batch->errors);
+  vty_out (vty, "%s", VTY_NEWLINE);
+}
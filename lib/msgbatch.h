@@ -0,0 +1,95 @@
+/*
+ * Batched datagram send and receive.
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _ZEBRA_MSGBATCH_H
+#define _ZEBRA_MSGBATCH_H
+
+#include "sockunion.h"
+
+/* A batch holds up to max datagrams of at most size bytes each, all for
+ * one socket.
+ *
+ * When sending, datagrams are copied in with msg_batch_add() and go
+ * out together, with sendmmsg() where available, either when the batch
+ * is full or from an event scheduled by the first add, that is once the
+ * current thread has finished.  A send that would block leaves the rest
+ * queued until the socket is writable.
+ *
+ * When receiving, msg_batch_recv() reads everything that is waiting,
+ * up to max datagrams, with one recvmmsg() where available.
+ */
+
+#define MSG_BATCH_CONTROL_SIZE 64
+
+struct msg_batch_msg
+{
+  union sockunion addr;
+  socklen_t addrlen;
+  size_t len;
+  size_t controllen;
+  union
+  {
+    struct cmsghdr align;
+    char buf[MSG_BATCH_CONTROL_SIZE];
+  } control;
+};
+
+struct msg_batch
+{
+  struct thread_master *master;
+  int fd;
+
+  unsigned int max;
+  size_t size;
+
+  /* Datagrams queued, or received by the last msg_batch_recv(). */
+  unsigned int count;
+
+  struct msg_batch_msg *msgs;
+  char *data;
+
+  struct thread *t_flush;
+
+  /* Statistics. */
+  unsigned long packets;
+  unsigned long syscalls;
+  unsigned long errors;
+};
+
+extern struct msg_batch *msg_batch_new (struct thread_master *, int fd,
+                                        unsigned int max, size_t size);
+extern void msg_batch_free (struct msg_batch *);
+
+extern int msg_batch_add (struct msg_batch *, const struct sockaddr *,
+                          socklen_t, const struct iovec *, int iovcnt);
+extern int msg_batch_add_control (struct msg_batch *, int level, int type,
+                                  const void *, size_t);
+extern int msg_batch_flush (struct msg_batch *);
+
+extern int msg_batch_recv (struct msg_batch *);
+
+#define MSG_BATCH_DATA(B,I) ((B)->data + (size_t) (I) * (B)->size)
+#define MSG_BATCH_LEN(B,I) ((B)->msgs[(I)].len)
+#define MSG_BATCH_ADDR(B,I) (&(B)->msgs[(I)].addr)
+
+extern void msg_batch_show (struct vty *, const char *, struct msg_batch *);
+
+#endif /* _ZEBRA_MSGBATCH_H */
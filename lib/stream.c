@@ -28,6 +28,10 @@
 #include "network.h"
 #include "prefix.h"
 #include "log.h"
+#include "vty.h"
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /* HAVE_PTHREAD */
 
 /* Tests whether a position is valid */ 
 #define GETP_VALID(S,G) \
@@ -85,11 +89,269 @@
       } \
   } while (0);
 
+/* Streams are pooled by size class, powers of two from
+   STREAM_POOL_MIN bytes, their buffers rounded up to the size of their
+   class.  Freed streams go to a cache of the freeing thread, which
+   only that thread touches, so the usual path takes no lock.  A cache
+   overflowing gives half its limit to a depot shared by all threads,
+   and an empty one takes as many back from there, under a lock, before
+   anything is allocated afresh.  The depot matters as streams are
+   often made by one thread and freed by another, as with bgpd's I/O
+   thread.  */
+#define STREAM_POOL_MIN		64
+#define STREAM_POOL_CLASSES	9	/* up to 16384 bytes */
+#define STREAM_POOL_SIZE(C)	((size_t) STREAM_POOL_MIN << (C))
+
+/* Streams of a class a cache holds, 64 or 256KB of buffers at most;
+   the depot holds four times as many. */
+#define STREAM_CACHE_MAX(C) \
+  (STREAM_POOL_SIZE (C) > 4096 ? 262144 / STREAM_POOL_SIZE (C) : 64)
+#define STREAM_DEPOT_MAX(C)	(4 * STREAM_CACHE_MAX (C))
+
+struct stream_cache
+{
+  struct stream_cache *next;
+
+  /* Free streams of each class, linked through their next pointer. */
+  struct stream *free[STREAM_POOL_CLASSES];
+  unsigned int count[STREAM_POOL_CLASSES];
+
+  /* For "show memory": streams allocated, given out again, and given
+     back to the system.  Only the owner writes them. */
+  unsigned long alloc[STREAM_POOL_CLASSES];
+  unsigned long reuse[STREAM_POOL_CLASSES];
+  unsigned long freed[STREAM_POOL_CLASSES];
+};
+
+/* The depot, also holding the counters of threads gone, and the list
+   of the caches of the others. */
+static struct stream_cache stream_depot;
+static struct stream_cache *stream_caches;
+
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t stream_depot_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t stream_cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stream_cache_key;
+
+#define STREAM_DEPOT_LOCK()	pthread_mutex_lock (&stream_depot_mutex)
+#define STREAM_DEPOT_UNLOCK()	pthread_mutex_unlock (&stream_depot_mutex)
+#else
+static struct stream_cache stream_cache;
+
+#define STREAM_DEPOT_LOCK()
+#define STREAM_DEPOT_UNLOCK()
+#endif /* HAVE_PTHREAD */
+
+/* Size class of a buffer of SIZE bytes, -1 if too large to pool. */
+static int
+stream_pool_class (size_t size)
+{
+  int c;
+
+  for (c = 0; c < STREAM_POOL_CLASSES; c++)
+    if (size <= STREAM_POOL_SIZE (c))
+      return c;
+  return -1;
+}
+
+static void
+stream_release (struct stream *s)
+{
+  XFREE (MTYPE_STREAM_DATA, s->data);
+  XFREE (MTYPE_STREAM, s);
+}
+
+/* Move up to COUNT streams of class C from FROM to TO, the depot
+   holding no more than its limit.  Returns those left over, for the
+   caller to release once out of the lock. */
+static struct stream *
+stream_cache_move (struct stream_cache *from, struct stream_cache *to,
+		   int c, unsigned int count)
+{
+  struct stream *s;
+  struct stream *over = NULL;
+
+  while (count-- && (s = from->free[c]) != NULL)
+    {
+      from->free[c] = s->next;
+      from->count[c]--;
+
+      if (to == &stream_depot && to->count[c] >= STREAM_DEPOT_MAX (c))
+	{
+	  s->next = over;
+	  over = s;
+	  continue;
+	}
+      s->next = to->free[c];
+      to->free[c] = s;
+      to->count[c]++;
+    }
+  return over;
+}
+
+static void
+stream_cache_spill (struct stream_cache *cache, int c, unsigned int count)
+{
+  struct stream *over;
+  struct stream *next;
+
+  STREAM_DEPOT_LOCK ();
+  over = stream_cache_move (cache, &stream_depot, c, count);
+  STREAM_DEPOT_UNLOCK ();
+
+  for (; over; over = next)
+    {
+      next = over->next;
+      stream_release (over);
+      cache->freed[c]++;
+    }
+}
+
+#ifdef HAVE_PTHREAD
+/* A thread exits: its streams and counters go to the depot. */
+static void
+stream_cache_exit (void *arg)
+{
+  struct stream_cache *cache = arg;
+  struct stream_cache **prev;
+  int c;
+
+  for (c = 0; c < STREAM_POOL_CLASSES; c++)
+    stream_cache_spill (cache, c, cache->count[c]);
+
+  STREAM_DEPOT_LOCK ();
+  for (prev = &stream_caches; *prev != cache; prev = &(*prev)->next)
+    ;
+  *prev = cache->next;
+  for (c = 0; c < STREAM_POOL_CLASSES; c++)
+    {
+      stream_depot.alloc[c] += cache->alloc[c];
+      stream_depot.reuse[c] += cache->reuse[c];
+      stream_depot.freed[c] += cache->freed[c];
+    }
+  STREAM_DEPOT_UNLOCK ();
+
+  XFREE (MTYPE_STREAM_CACHE, cache);
+}
+
+static void
+stream_cache_key_create (void)
+{
+  pthread_key_create (&stream_cache_key, stream_cache_exit);
+}
+#endif /* HAVE_PTHREAD */
+
+/* The calling thread's cache, created on first use. */
+static struct stream_cache *
+stream_cache_get (void)
+{
+  struct stream_cache *cache;
+
+#ifdef HAVE_PTHREAD
+  pthread_once (&stream_cache_once, stream_cache_key_create);
+  cache = pthread_getspecific (stream_cache_key);
+  if (cache)
+    return cache;
+
+  cache = XCALLOC (MTYPE_STREAM_CACHE, sizeof (struct stream_cache));
+  pthread_setspecific (stream_cache_key, cache);
+#else
+  cache = &stream_cache;
+  if (stream_caches)
+    return cache;
+#endif /* HAVE_PTHREAD */
+
+  STREAM_DEPOT_LOCK ();
+  cache->next = stream_caches;
+  stream_caches = cache;
+  STREAM_DEPOT_UNLOCK ();
+
+  return cache;
+}
+
+/* A free stream of class C, or NULL if there is none. */
+static struct stream *
+stream_pool_get (struct stream_cache *cache, int c)
+{
+  struct stream *s;
+  struct stream *over;
+
+  /* The depot count is only a hint, read without the lock. */
+  if (! cache->free[c] && stream_depot.count[c])
+    {
+      STREAM_DEPOT_LOCK ();
+      over = stream_cache_move (&stream_depot, cache, c,
+				STREAM_CACHE_MAX (c) / 2);
+      STREAM_DEPOT_UNLOCK ();
+      assert (over == NULL);
+    }
+
+  if ((s = cache->free[c]) == NULL)
+    return NULL;
+
+  cache->free[c] = s->next;
+  cache->count[c]--;
+  cache->reuse[c]++;
+  return s;
+}
+
+static void
+stream_pool_put (struct stream_cache *cache, int c, struct stream *s)
+{
+  if (cache->count[c] >= STREAM_CACHE_MAX (c))
+    stream_cache_spill (cache, c, STREAM_CACHE_MAX (c) / 2);
+
+  s->next = cache->free[c];
+  cache->free[c] = s;
+  cache->count[c]++;
+}
+
+/* Show the stream pool, for "show memory".  The counters of other
+   threads are read as they are, without them stopping. */
+int
+stream_pool_show (struct vty *vty)
+{
+  struct stream_cache *cache;
+  unsigned long alloc, reuse, freed, cached;
+  int c, shown = 0;
+
+  STREAM_DEPOT_LOCK ();
+  for (c = 0; c < STREAM_POOL_CLASSES; c++)
+    {
+      alloc = stream_depot.alloc[c];
+      reuse = stream_depot.reuse[c];
+      freed = stream_depot.freed[c];
+      cached = stream_depot.count[c];
+      for (cache = stream_caches; cache; cache = cache->next)
+	{
+	  alloc += cache->alloc[c];
+	  reuse += cache->reuse[c];
+	  freed += cache->freed[c];
+	  cached += cache->count[c];
+	}
+      if (! alloc)
+	continue;
+
+      if (! shown)
+	vty_out (vty, "Stream pool:   size     in use     cached  allocated"
+		 "     reused%s", VTY_NEWLINE);
+      vty_out (vty, "             %6lu %10lu %10lu %10lu %10lu%s",
+	       (unsigned long) STREAM_POOL_SIZE (c),
+	       alloc - freed - cached, cached, alloc, reuse, VTY_NEWLINE);
+      shown = 1;
+    }
+  STREAM_DEPOT_UNLOCK ();
+
+  return shown;
+}
+
 /* Make stream buffer. */
 struct stream *
 stream_new (size_t size)
 {
+  struct stream_cache *cache = NULL;
   struct stream *s;
+  int c;
 
   assert (size > 0);
   
@@ -99,30 +361,49 @@ stream_new (size_t size)
       return NULL;
     }
   
+  if ((c = stream_pool_class (size)) >= 0)
+    {
+      cache = stream_cache_get ();
+      if ((s = stream_pool_get (cache, c)) != NULL)
+	{
+	  s->next = NULL;
+	  s->getp = s->endp = 0;
+	  s->size = size;
+	  return s;
+	}
+    }
+
   s = XCALLOC (MTYPE_STREAM, sizeof (struct stream));
 
   if (s == NULL)
     return s;
   
-  if ( (s->data = XMALLOC (MTYPE_STREAM_DATA, size)) == NULL)
+  if ( (s->data = XMALLOC (MTYPE_STREAM_DATA,
+			   c >= 0 ? STREAM_POOL_SIZE (c) : size)) == NULL)
     {
       XFREE (MTYPE_STREAM, s);
       return NULL;
     }
   
+  if (cache)
+    cache->alloc[c]++;
   s->size = size;
   return s;
 }
 
-/* Free it now. */
+/* Free it now, or keep it for reuse. */
 void
 stream_free (struct stream *s)
 {
+  int c;
+
   if (!s)
     return;
   
-  XFREE (MTYPE_STREAM_DATA, s->data);
-  XFREE (MTYPE_STREAM, s);
+  if ((c = stream_pool_class (s->size)) >= 0)
+    stream_pool_put (stream_cache_get (), c, s);
+  else
+    stream_release (s);
 }
 
 struct stream *
@@ -157,15 +438,34 @@ stream_dup (struct stream *s)
 size_t
 stream_resize (struct stream *s, size_t newsize)
 {
+  struct stream_cache *cache;
   u_char *newdata;
+  int c, newc;
   STREAM_VERIFY_SANE (s);
   
-  newdata = XREALLOC (MTYPE_STREAM_DATA, s->data, newsize);
-  
-  if (newdata == NULL)
-    return s->size;
-  
-  s->data = newdata;
+  /* The buffer is that of its size class, which may do. */
+  c = stream_pool_class (s->size);
+  newc = stream_pool_class (newsize);
+  if (newc < 0 || newc != c)
+    {
+      newdata = XREALLOC (MTYPE_STREAM_DATA, s->data,
+			  newc >= 0 ? STREAM_POOL_SIZE (newc) : newsize);
+  
+      if (newdata == NULL)
+	return s->size;
+  
+      s->data = newdata;
+
+      /* Counted as freed from one class and allocated in the other. */
+      if (c >= 0 || newc >= 0)
+	{
+	  cache = stream_cache_get ();
+	  if (c >= 0)
+	    cache->freed[c]++;
+	  if (newc >= 0)
+	    cache->alloc[newc]++;
+	}
+    }
   s->size = newsize;
   
   if (s->endp > s->size)
@@ -25,6 +25,8 @@
 
 #include "prefix.h"
 
+struct vty;
+
 /*
  * A stream is an arbitrary buffer, whose contents generally are assumed to
  * be in network order.
@@ -137,6 +139,7 @@ struct stream_fifo
  */
 extern struct stream *stream_new (size_t);
 extern void stream_free (struct stream *);
+extern int stream_pool_show (struct vty *);
 extern struct stream * stream_copy (struct stream *, struct stream *src);
 extern struct stream *stream_dup (struct stream *);
 extern size_t stream_resize (struct stream *, size_t);
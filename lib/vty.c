@@ -151,6 +151,85 @@ vty_out (struct vty *vty, const char *format, ...)
   return len;
 }
 
+/* Output a preformatted buffer, without going through vsnprintf. */
+void
+vty_out_buf (struct vty *vty, const char *buf, size_t len)
+{
+  if (vty_shell (vty))
+    fwrite (buf, 1, len, stdout);
+  else
+    buffer_put (vty->obuf, buf, len);
+}
+
+/* Output an unsigned decimal number, for the compact show formats. */
+void
+vty_out_uint (struct vty *vty, unsigned long val)
+{
+  char buf[24];
+  char *p = buf + sizeof (buf);
+
+  do
+    *--p = '0' + val % 10;
+  while ((val /= 10) != 0);
+
+  vty_out_buf (vty, p, buf + sizeof (buf) - p);
+}
+
+/* Defer the rest of a command's output.  FUNC is called to produce
+   the next chunk each time the vty's output buffer has drained, and
+   returns VTY_OUTPUT_MORE for as long as it has more to say.  CLEAN,
+   if non-NULL, releases ARG once FUNC is done or the vty goes away.
+
+   This keeps a long "show" walk from holding the event loop and from
+   queueing its whole output in the vty buffer.  Vtys that are not
+   driven by the event loop get all of the output straight away, as
+   does a command issued while another one is still being output. */
+void
+vty_out_defer (struct vty *vty, int (*func) (struct vty *, void *),
+	       void (*clean) (struct vty *, void *), void *arg)
+{
+  if ((vty->type != VTY_TERM && vty->type != VTY_SHELL_SERV)
+      || vty->output_func)
+    {
+      while ((*func) (vty, arg) == VTY_OUTPUT_MORE)
+	;
+      if (clean)
+	(*clean) (vty, arg);
+      return;
+    }
+
+  vty->output_func = func;
+  vty->output_clean = clean;
+  vty->output_arg = arg;
+}
+
+/* Drop any deferred output still pending on the vty. */
+static void
+vty_out_defer_cancel (struct vty *vty)
+{
+  if (! vty->output_func)
+    return;
+
+  if (vty->output_clean)
+    (*vty->output_clean) (vty, vty->output_arg);
+
+  vty->output_func = NULL;
+  vty->output_clean = NULL;
+  vty->output_arg = NULL;
+}
+
+/* Produce the next chunk of deferred output.  Returns 0 once the
+   deferred output is complete. */
+static int
+vty_out_defer_resume (struct vty *vty)
+{
+  if ((*vty->output_func) (vty, vty->output_arg) == VTY_OUTPUT_MORE)
+    return 1;
+
+  vty_out_defer_cancel (vty);
+  return 0;
+}
+
 static int
 vty_log_out (struct vty *vty, const char *level, const char *proto_str,
 	     const char *format, struct timestamp_control *ctl, va_list va)
@@ -1290,7 +1369,8 @@ vty_execute (struct vty *vty)
   vty->cp = vty->length = 0;
   vty_clear_buf (vty);
 
-  if (vty->status != VTY_CLOSE )
+  /* With deferred output, the prompt follows the last chunk. */
+  if (vty->status != VTY_CLOSE && ! vty->output_func)
     vty_prompt (vty);
 
   return ret;
@@ -1331,6 +1411,7 @@ vty_escape_map (unsigned char c, struct vty *vty)
 static void
 vty_buffer_reset (struct vty *vty)
 {
+  vty_out_defer_cancel (vty);
   buffer_reset (vty->obuf);
   vty_prompt (vty);
   vty_redraw_line (vty);
@@ -1400,7 +1481,7 @@ vty_read (struct thread *thread)
 	}
 	        
 
-      if (vty->status == VTY_MORE)
+      if (vty->status == VTY_MORE || vty->output_func)
 	{
 	  switch (buf[i])
 	    {
@@ -1590,6 +1671,14 @@ vty_flush (struct thread *thread)
     case BUFFER_EMPTY:
       if (vty->status == VTY_CLOSE)
 	vty_close (vty);
+      else if (vty->output_func)
+	{
+	  /* Previous chunk is out, go and produce the next one. */
+	  vty->status = VTY_NORMAL;
+	  if (! vty_out_defer_resume (vty))
+	    vty_prompt (vty);
+	  vty_event (VTY_WRITE, vty_sock, vty);
+	}
       else
 	{
 	  vty->status = VTY_NORMAL;
@@ -2026,6 +2115,16 @@ vtysh_accept (struct thread *thread)
   return 0;
 }
 
+/* Tell vtysh that the command has completed, with its return code. */
+static void
+vtysh_put_result (struct vty *vty, int ret)
+{
+  u_char header[4] = {0, 0, 0, 0};
+
+  header[3] = ret;
+  buffer_put(vty->obuf, header, 4);
+}
+
 static int
 vtysh_flush(struct vty *vty)
 {
@@ -2042,6 +2141,12 @@ vtysh_flush(struct vty *vty)
       return -1;
       break;
     case BUFFER_EMPTY:
+      if (vty->output_func)
+	{
+	  if (! vty_out_defer_resume (vty))
+	    vtysh_put_result (vty, vty->output_ret);
+	  vty_event(VTYSH_WRITE, vty->fd, vty);
+	}
       break;
     }
   return 0;
@@ -2056,7 +2161,6 @@ vtysh_read (struct thread *thread)
   struct vty *vty;
   unsigned char buf[VTY_READ_BUFSIZ];
   unsigned char *p;
-  u_char header[4] = {0, 0, 0, 0};
 
   sock = THREAD_FD (thread);
   vty = THREAD_ARG (thread);
@@ -2104,8 +2208,11 @@ vtysh_read (struct thread *thread)
 	  printf ("vtysh node: %d\n", vty->node);
 #endif /* VTYSH_DEBUG */
 
-	  header[3] = ret;
-	  buffer_put(vty->obuf, header, 4);
+	  /* Deferred output is followed by the result once complete. */
+	  if (vty->output_func)
+	    vty->output_ret = ret;
+	  else
+	    vtysh_put_result (vty, ret);
 
 	  if (!vty->t_write && (vtysh_flush(vty) < 0))
 	    /* Try to flush results; exit if a write error occurs. */
@@ -2164,6 +2271,9 @@ vty_close (struct vty *vty)
 {
   int i;
 
+  /* Release whatever deferred output still holds on to. */
+  vty_out_defer_cancel (vty);
+
   /* Cancel threads.*/
   if (vty->t_read)
     thread_cancel (vty->t_read);
@@ -119,8 +119,22 @@ struct vty
 
   /* What address is this vty comming from. */
   char address[SU_ADDRSTRLEN];
+
+  /* Deferred output, see vty_out_defer().  The function is called
+     again each time the output buffer has drained, until it returns
+     VTY_OUTPUT_DONE. */
+  int (*output_func) (struct vty *, void *);
+  void (*output_clean) (struct vty *, void *);
+  void *output_arg;
+
+  /* Return code of the command that deferred its output. */
+  int output_ret;
 };
 
+/* Return values of a deferred output function. */
+#define VTY_OUTPUT_DONE  0
+#define VTY_OUTPUT_MORE  1
+
 /* Integrated configuration file. */
 #define INTEGRATE_DEFAULT_CONFIG "Quagga.conf"
 
@@ -227,6 +241,10 @@ extern void vty_terminate (void);
 extern void vty_reset (void);
 extern struct vty *vty_new (void);
 extern int vty_out (struct vty *, const char *, ...) PRINTF_ATTRIBUTE(2, 3);
+extern void vty_out_buf (struct vty *, const char *, size_t);
+extern void vty_out_uint (struct vty *, unsigned long);
+extern void vty_out_defer (struct vty *, int (*) (struct vty *, void *),
+                           void (*) (struct vty *, void *), void *);
 extern void vty_read_config (char *, char *);
 extern void vty_time_print (struct vty *, int);
 extern void vty_serv_sock (const char *, unsigned short, const char *);
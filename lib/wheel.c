@@ -0,0 +1,247 @@
+/*
+ * Timer wheel for large numbers of coarse, frequently refreshed timers.
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "thread.h"
+#include "memory.h"
+#include "wheel.h"
+
+static time_t
+wheel_time (void)
+{
+  struct timeval tv;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &tv);
+  return tv.tv_sec;
+}
+
+static void
+wheel_list_init (struct wheel_timer *head)
+{
+  head->next = head->prev = head;
+}
+
+static void
+wheel_unlink (struct wheel_timer *t)
+{
+  t->prev->next = t->next;
+  t->next->prev = t->prev;
+  t->next = t->prev = NULL;
+}
+
+/* Link a timer into the slot of its slot_time. */
+static void
+wheel_link (struct timer_wheel *wheel, struct wheel_timer *t)
+{
+  struct wheel_timer *head;
+
+  head = &wheel->slots[t->slot_time & (wheel->size - 1)];
+  t->next = head;
+  t->prev = head->prev;
+  head->prev->next = t;
+  head->prev = t;
+}
+
+/* Run the timers of one slot.  The slot is emptied first, so that
+ * timers added from the callbacks never land in the list being
+ * walked. */
+static void
+wheel_run_slot (struct timer_wheel *wheel, time_t sec, time_t now)
+{
+  struct wheel_timer *head;
+  struct wheel_timer pending;
+  struct wheel_timer *t;
+
+  head = &wheel->slots[sec & (wheel->size - 1)];
+  if (head->next == head)
+    return;
+
+  pending.next = head->next;
+  pending.prev = head->prev;
+  pending.next->prev = &pending;
+  pending.prev->next = &pending;
+  wheel_list_init (head);
+
+  while ((t = pending.next) != &pending)
+    {
+      wheel_unlink (t);
+
+      /* Linked for a later turn of the wheel. */
+      if (t->slot_time > now)
+        {
+          wheel_link (wheel, t);
+          continue;
+        }
+
+      /* Refreshed since it was linked; move it to its new slot. */
+      if (t->expiry > now)
+        {
+          t->slot_time = t->expiry;
+          wheel_link (wheel, t);
+          wheel->relinked++;
+          continue;
+        }
+
+      t->wheel = NULL;
+      wheel->count--;
+      wheel->expired++;
+      (*t->func) (t);
+    }
+}
+
+static int
+wheel_tick (struct thread *thread)
+{
+  struct timer_wheel *wheel;
+  time_t now;
+  time_t sec;
+
+  wheel = THREAD_ARG (thread);
+  wheel->t_tick = NULL;
+
+  now = wheel_time ();
+
+  /* After a long stall every slot is visited once. */
+  if (now - wheel->now > (time_t) wheel->size)
+    wheel->now = now - wheel->size;
+
+  for (sec = wheel->now + 1; sec <= now; sec++)
+    {
+      wheel->now = sec;
+      wheel_run_slot (wheel, sec, now);
+    }
+
+  if (wheel->count)
+    wheel->t_tick = thread_add_timer (wheel->master, wheel_tick, wheel, 1);
+
+  return 0;
+}
+
+/* Create a wheel with at least size one-second slots.  Timers longer
+ * than the wheel are fine; they are looked at once per turn. */
+struct timer_wheel *
+wheel_new (struct thread_master *master, unsigned int size)
+{
+  struct timer_wheel *wheel;
+  unsigned int i;
+
+  if (size == 0)
+    size = WHEEL_SIZE_DEFAULT;
+
+  wheel = XCALLOC (MTYPE_TIMER_WHEEL, sizeof (struct timer_wheel));
+  wheel->master = master;
+  for (wheel->size = 1; wheel->size < size; wheel->size <<= 1)
+    ;
+  wheel->slots = XCALLOC (MTYPE_TIMER_WHEEL,
+                          wheel->size * sizeof (struct wheel_timer));
+  for (i = 0; i < wheel->size; i++)
+    wheel_list_init (&wheel->slots[i]);
+  wheel->now = wheel_time ();
+
+  return wheel;
+}
+
+/* Free a wheel.  Timers still pending are stopped without being run. */
+void
+wheel_free (struct timer_wheel *wheel)
+{
+  struct wheel_timer *head;
+  unsigned int i;
+
+  for (i = 0; i < wheel->size; i++)
+    {
+      head = &wheel->slots[i];
+      while (head->next != head)
+        {
+          head->next->wheel = NULL;
+          wheel_unlink (head->next);
+        }
+    }
+
+  if (wheel->t_tick)
+    thread_cancel (wheel->t_tick);
+
+  XFREE (MTYPE_TIMER_WHEEL, wheel->slots);
+  XFREE (MTYPE_TIMER_WHEEL, wheel);
+}
+
+/* Start a timer, or restart it if it is already pending.  Pushing the
+ * expiry of a pending timer later does not touch the wheel. */
+void
+wheel_timer_add (struct timer_wheel *wheel, struct wheel_timer *t,
+                 int (*func) (struct wheel_timer *), void *arg,
+                 unsigned long seconds)
+{
+  time_t now;
+  time_t expiry;
+
+  now = wheel_time ();
+  expiry = now + seconds;
+
+  t->func = func;
+  t->arg = arg;
+
+  if (t->wheel == wheel && expiry >= t->slot_time)
+    {
+      t->expiry = expiry;
+      return;
+    }
+
+  if (t->wheel)
+    wheel_timer_cancel (t);
+
+  /* An idle wheel has not been ticking; catch it up. */
+  if (! wheel->t_tick)
+    wheel->now = now;
+
+  t->expiry = expiry;
+  t->slot_time = expiry > wheel->now ? expiry : wheel->now + 1;
+  t->wheel = wheel;
+  wheel_link (wheel, t);
+  wheel->count++;
+
+  if (! wheel->t_tick)
+    wheel->t_tick = thread_add_timer (wheel->master, wheel_tick, wheel, 1);
+}
+
+void
+wheel_timer_cancel (struct wheel_timer *t)
+{
+  if (! t->wheel)
+    return;
+
+  wheel_unlink (t);
+  t->wheel->count--;
+  t->wheel = NULL;
+}
+
+unsigned long
+wheel_timer_remain_second (struct wheel_timer *t)
+{
+  time_t now;
+
+  if (! t->wheel)
+    return 0;
+
+  now = wheel_time ();
+  return t->expiry > now ? t->expiry - now : 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * Timer wheel for large numbers of coarse, frequently refreshed timers.
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _ZEBRA_WHEEL_H
+#define _ZEBRA_WHEEL_H
+
+/* A wheel has one slot per second.  A timer sits in the slot of the
+ * second it was last linked for; pushing its expiry further out only
+ * rewrites the expiry, and the timer is moved to the right slot when
+ * its old slot comes round.  Refreshing a pending timer is therefore
+ * a single store, and the wheel costs one thread timer per second
+ * however many timers it holds.
+ */
+struct wheel_timer
+{
+  struct wheel_timer *next;
+  struct wheel_timer *prev;
+
+  /* Wheel the timer is pending on, NULL when not running. */
+  struct timer_wheel *wheel;
+
+  /* Monotonic second the timer is due, and the second of the slot it
+   * is currently linked into (never later than expiry). */
+  time_t expiry;
+  time_t slot_time;
+
+  int (*func) (struct wheel_timer *);
+  void *arg;
+};
+
+struct timer_wheel
+{
+  struct thread_master *master;
+  struct thread *t_tick;
+
+  /* Last second whose slot has been run. */
+  time_t now;
+
+  /* Number of slots, a power of two, and the slot heads. */
+  unsigned int size;
+  struct wheel_timer *slots;
+
+  /* Pending timers. */
+  unsigned long count;
+
+  /* Statistics. */
+  unsigned long expired;
+  unsigned long relinked;
+};
+
+#define WHEEL_SIZE_DEFAULT 256
+
+#define WHEEL_TIMER_ARG(T) ((T)->arg)
+#define WHEEL_TIMER_PENDING(T) ((T)->wheel != NULL)
+
+extern struct timer_wheel *wheel_new (struct thread_master *, unsigned int);
+extern void wheel_free (struct timer_wheel *);
+
+extern void wheel_timer_add (struct timer_wheel *, struct wheel_timer *,
+                             int (*) (struct wheel_timer *), void *,
+                             unsigned long);
+extern void wheel_timer_cancel (struct wheel_timer *);
+extern unsigned long wheel_timer_remain_second (struct wheel_timer *);
+
+#endif /* _ZEBRA_WHEEL_H */
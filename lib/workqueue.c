@@ -174,22 +174,24 @@ DEFUN(show_work_queues,
   struct work_queue *wq;
   
   vty_out (vty, 
-           "%c %8s %5s %8s %21s%s",
+           "%c %8s %5s %8s %21s %15s%s",
            ' ', "List","(ms) ","Q. Runs","Cycle Counts   ",
+           "Item Time (us)",
            VTY_NEWLINE);
   vty_out (vty,
-           "%c %8s %5s %8s %7s %6s %6s %s%s",
+           "%c %8s %5s %8s %7s %6s %6s %7s %7s %s%s",
            'P',
            "Items",
            "Hold",
            "Total",
            "Best","Gran.","Avg.", 
+           "Avg.","Max.",
            "Name", 
            VTY_NEWLINE);
  
   for (ALL_LIST_ELEMENTS_RO ((&work_queues), node, wq))
     {
-      vty_out (vty,"%c %8d %5d %8ld %7d %6d %6u %s%s",
+      vty_out (vty,"%c %8d %5d %8ld %7d %6d %6u %7lu %7lu %s%s",
                (CHECK_FLAG (wq->flags, WQ_UNPLUGGED) ? ' ' : 'P'),
                listcount (wq->items),
                wq->spec.hold,
@@ -197,6 +199,8 @@ DEFUN(show_work_queues,
                wq->cycles.best, wq->cycles.granularity,
                  (wq->runs) ? 
                    (unsigned int) (wq->cycles.total / wq->runs) : 0,
+               (wq->cycles.total) ? wq->usec.total / wq->cycles.total : 0,
+               wq->usec.max,
                wq->name,
                VTY_NEWLINE);
     }
@@ -230,6 +234,21 @@ work_queue_unplug (struct work_queue *wq)
   work_queue_schedule (wq, wq->spec.hold);
 }
 
+/* Account the time spent on an item since start. */
+static void
+work_queue_time (struct work_queue *wq, struct timeval *start)
+{
+  struct timeval now;
+  unsigned long usec;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  usec = (now.tv_sec - start->tv_sec) * 1000000
+         + (now.tv_usec - start->tv_usec);
+  wq->usec.total += usec;
+  if (usec > wq->usec.max)
+    wq->usec.max = usec;
+}
+
 /* timer thread to process a work queue
  * will reschedule itself if required,
  * otherwise work_queue_item_add 
@@ -243,6 +262,7 @@ work_queue_run (struct thread *thread)
   unsigned int cycles = 0;
   struct listnode *node, *nnode;
   char yielded = 0;
+  struct timeval start;
 
   wq = THREAD_ARG (thread);
   wq->thread = NULL;
@@ -284,6 +304,7 @@ work_queue_run (struct thread *thread)
       }
 
     /* run and take care of items that want to be retried immediately */
+    quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
     do
       {
         ret = wq->spec.workfunc (wq, item->data);
@@ -291,6 +312,7 @@ work_queue_run (struct thread *thread)
       }
     while ((ret == WQ_RETRY_NOW) 
            && (item->ran < wq->spec.max_retries));
+    work_queue_time (wq, &start);
 
     switch (ret)
       {
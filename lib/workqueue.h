@@ -95,6 +95,11 @@ struct work_queue
     unsigned int granularity;
     unsigned long total;
   } cycles;	/* cycle counts */
+
+  struct {
+    unsigned long total;
+    unsigned long max;
+  } usec;	/* time spent in workfunc, per item processed */
   
   /* private state */
   u_int16_t flags;		/* user set flag */
@@ -121,7 +121,7 @@ ospf6_zebra_if_del (int command, struct zclient *zclient, zebra_size_t length)
   ospf6_interface_if_del (ifp);
 #endif /*0*/
 
-  ifp->ifindex = IFINDEX_INTERNAL;
+  if_set_index (ifp, IFINDEX_INTERNAL);
   return 0;
 }
 
@@ -40,6 +40,7 @@
 #include "md5.h"
 #include "keychain.h"
 #include "privs.h"
+#include "network.h"
 
 #include "ripd/ripd.h"
 #include "ripd/rip_debug.h"
@@ -47,6 +48,12 @@
 /* UDP receive buffer size */
 #define RIP_UDP_RCV_BUF 41600
 
+/* Send multicast on the RIP socket, choosing interface and source
+   address per packet, rather than on a socket of its own. */
+#if defined (HAVE_STRUCT_IN_PKTINFO) && defined (IP_PKTINFO)
+#define RIP_SEND_PKTINFO
+#endif
+
 /* privileges global */
 extern struct zebra_privs_t ripd_privs;
 
@@ -123,16 +130,15 @@ rip_info_free (struct rip_info *rinfo)
 
 /* RIP route garbage collect timer. */
 static int
-rip_garbage_collect (struct thread *t)
+rip_garbage_collect (struct wheel_timer *t)
 {
   struct rip_info *rinfo;
   struct route_node *rp;
 
-  rinfo = THREAD_ARG (t);
-  rinfo->t_garbage_collect = NULL;
+  rinfo = WHEEL_TIMER_ARG (t);
 
   /* Off timeout timer. */
-  RIP_TIMER_OFF (rinfo->t_timeout);
+  RIP_ROUTE_TIMER_OFF (rinfo->t_timeout);
   
   /* Get route_node pointer. */
   rp = rinfo->rp;
@@ -149,18 +155,17 @@ rip_garbage_collect (struct thread *t)
 
 /* Timeout RIP routes. */
 static int
-rip_timeout (struct thread *t)
+rip_timeout (struct wheel_timer *t)
 {
   struct rip_info *rinfo;
   struct route_node *rn;
 
-  rinfo = THREAD_ARG (t);
-  rinfo->t_timeout = NULL;
+  rinfo = WHEEL_TIMER_ARG (t);
 
   rn = rinfo->rp;
 
   /* - The garbage-collection timer is set for 120 seconds. */
-  RIP_TIMER_ON (rinfo->t_garbage_collect, rip_garbage_collect, 
+  RIP_ROUTE_TIMER_ON (rinfo->t_garbage_collect, rip_garbage_collect, 
 		rip->garbage_time);
 
   rip_zebra_ipv4_delete ((struct prefix_ipv4 *)&rn->p, &rinfo->nexthop,
@@ -180,14 +185,15 @@ rip_timeout (struct thread *t)
   return 0;
 }
 
+/* Restart the route timeout.  This runs for every route in every
+   update received, so it must stay cheap: a pending timer on the
+   wheel is only given a new expiry. */
 static void
 rip_timeout_update (struct rip_info *rinfo)
 {
   if (rinfo->metric != RIP_METRIC_INFINITY)
-    {
-      RIP_TIMER_OFF (rinfo->t_timeout);
-      RIP_TIMER_ON (rinfo->t_timeout, rip_timeout, rip->timeout_time);
-    }
+    wheel_timer_add (rip->wheel, &rinfo->t_timeout, rip_timeout, rinfo,
+                     rip->timeout_time);
 }
 
 static int
@@ -496,8 +502,8 @@ rip_rte_process (struct rte *rte, struct sockaddr_in *from,
             }
           else
             {
-              RIP_TIMER_OFF (rinfo->t_timeout);
-              RIP_TIMER_OFF (rinfo->t_garbage_collect);
+              RIP_ROUTE_TIMER_OFF (rinfo->t_timeout);
+              RIP_ROUTE_TIMER_OFF (rinfo->t_garbage_collect);
                                                                                 
               rp->info = NULL;
               if (rip_route_rte (rinfo))
@@ -625,7 +631,7 @@ rip_rte_process (struct rte *rte, struct sockaddr_in *from,
               rinfo->type = ZEBRA_ROUTE_RIP;
               rinfo->sub_type = RIP_ROUTE_RTE;
 
-              RIP_TIMER_OFF (rinfo->t_garbage_collect);
+              RIP_ROUTE_TIMER_OFF (rinfo->t_garbage_collect);
 
               if (!IPV4_ADDR_SAME (&rinfo->nexthop, nexthop))
                 IPV4_ADDR_COPY (&rinfo->nexthop, nexthop);
@@ -665,9 +671,9 @@ rip_rte_process (struct rte *rte, struct sockaddr_in *from,
               if (oldmetric != RIP_METRIC_INFINITY)
                 {
                   /* - The garbage-collection timer is set for 120 seconds. */
-                  RIP_TIMER_ON (rinfo->t_garbage_collect,
+                  RIP_ROUTE_TIMER_ON (rinfo->t_garbage_collect,
                                 rip_garbage_collect, rip->garbage_time);
-                  RIP_TIMER_OFF (rinfo->t_timeout);
+                  RIP_ROUTE_TIMER_OFF (rinfo->t_timeout);
 
                   /* - The metric for the route is set to 16
                      (infinity).  This causes the route to be removed
@@ -1402,6 +1408,38 @@ rip_create_socket (struct sockaddr_in *from)
   return sock;
 }
 
+/* Queue a packet on the RIP socket.  Multicast packets, for which ifc
+ * is given, carry their interface and source address as ancillary
+ * data. */
+static int
+rip_send_batch (u_char *buf, int size, struct sockaddr_in *sin,
+		struct connected *ifc)
+{
+  struct iovec iov;
+
+  iov.iov_base = buf;
+  iov.iov_len = size;
+  if (msg_batch_add (rip->send_batch, (struct sockaddr *) sin,
+		     sizeof (struct sockaddr_in), &iov, 1) < 0)
+    return -1;
+
+#ifdef RIP_SEND_PKTINFO
+  if (ifc)
+    {
+      struct in_pktinfo pktinfo;
+
+      memset (&pktinfo, 0, sizeof (pktinfo));
+      pktinfo.ipi_ifindex = ifc->ifp->ifindex;
+      pktinfo.ipi_spec_dst = ifc->address->u.prefix4;
+      if (msg_batch_add_control (rip->send_batch, IPPROTO_IP, IP_PKTINFO,
+				 &pktinfo, sizeof (pktinfo)) < 0)
+	return -1;
+    }
+#endif /* RIP_SEND_PKTINFO */
+
+  return size;
+}
+
 /* RIP packet send to destination address, on interface denoted by
  * by connected argument. NULL to argument denotes destination should be
  * should be RIP multicast group
@@ -1470,6 +1508,13 @@ rip_send_packet (u_char * buf, int size, struct sockaddr_in *to,
     }
   else
     {
+#ifdef RIP_SEND_PKTINFO
+      sin.sin_port = htons (RIP_PORT_DEFAULT);
+      sin.sin_addr.s_addr = htonl (INADDR_RIP_GROUP);
+
+      /* The interface and source address go with the packet. */
+      send_sock = rip->sock;
+#else
       struct sockaddr_in from;
       
       sin.sin_port = htons (RIP_PORT_DEFAULT);
@@ -1495,10 +1540,15 @@ rip_send_packet (u_char * buf, int size, struct sockaddr_in *to,
           return -1;
         }
       rip_interface_multicast_set (send_sock, ifc);
+#endif /* RIP_SEND_PKTINFO */
     }
 
-  ret = sendto (send_sock, buf, size, 0, (struct sockaddr *)&sin,
-		sizeof (struct sockaddr_in));
+  /* Packets for the RIP socket are batched. */
+  if (send_sock == rip->sock)
+    ret = rip_send_batch (buf, size, &sin, to ? NULL : ifc);
+  else
+    ret = sendto (send_sock, buf, size, 0, (struct sockaddr *)&sin,
+		  sizeof (struct sockaddr_in));
 
   if (IS_RIP_DEBUG_EVENT)
       zlog_debug ("SEND to  %s.%d", inet_ntoa(sin.sin_addr), 
@@ -1507,7 +1557,7 @@ rip_send_packet (u_char * buf, int size, struct sockaddr_in *to,
   if (ret < 0)
     zlog_warn ("can't send packet : %s", safe_strerror (errno));
 
-  if (!to)
+  if (send_sock != rip->sock)
     close(send_sock);
 
   return ret;
@@ -1555,8 +1605,8 @@ rip_redistribute_add (int type, int sub_type, struct prefix_ipv4 *p,
 	    }
 	}
 
-      RIP_TIMER_OFF (rinfo->t_timeout);
-      RIP_TIMER_OFF (rinfo->t_garbage_collect);
+      RIP_ROUTE_TIMER_OFF (rinfo->t_timeout);
+      RIP_ROUTE_TIMER_OFF (rinfo->t_garbage_collect);
 
       if (rip_route_rte (rinfo))
 	rip_zebra_ipv4_delete ((struct prefix_ipv4 *)&rp->p, &rinfo->nexthop,
@@ -1625,9 +1675,9 @@ rip_redistribute_delete (int type, int sub_type, struct prefix_ipv4 *p,
 	{
 	  /* Perform poisoned reverse. */
 	  rinfo->metric = RIP_METRIC_INFINITY;
-	  RIP_TIMER_ON (rinfo->t_garbage_collect, 
+	  RIP_ROUTE_TIMER_ON (rinfo->t_garbage_collect, 
 			rip_garbage_collect, rip->garbage_time);
-	  RIP_TIMER_OFF (rinfo->t_timeout);
+	  RIP_ROUTE_TIMER_OFF (rinfo->t_timeout);
 	  rinfo->flags |= RIP_RTF_CHANGED;
 
           if (IS_RIP_DEBUG_EVENT)
@@ -1808,44 +1858,20 @@ rip_read_new (struct thread *t)
 }
 #endif /* RIP_RECVMSG */
 
-/* First entry point of RIP packet. */
+/* Process one RIP packet. */
 static int
-rip_read (struct thread *t)
+rip_read_packet (union rip_buf *rip_buf, int len, struct sockaddr_in *from)
 {
-  int sock;
   int ret;
   int rtenum;
-  union rip_buf rip_buf;
   struct rip_packet *packet;
-  struct sockaddr_in from;
-  int len;
   int vrecv;
-  socklen_t fromlen;
   struct interface *ifp;
   struct connected *ifc;
   struct rip_interface *ri;
 
-  /* Fetch socket then register myself. */
-  sock = THREAD_FD (t);
-  rip->t_read = NULL;
-
-  /* Add myself to tne next event */
-  rip_event (RIP_READ, sock);
-
-  /* RIPd manages only IPv4. */
-  memset (&from, 0, sizeof (struct sockaddr_in));
-  fromlen = sizeof (struct sockaddr_in);
-
-  len = recvfrom (sock, (char *)&rip_buf.buf, sizeof (rip_buf.buf), 0, 
-		  (struct sockaddr *) &from, &fromlen);
-  if (len < 0) 
-    {
-      zlog_info ("recvfrom failed: %s", safe_strerror (errno));
-      return len;
-    }
-
   /* Check is this packet comming from myself? */
-  if (if_check_address (from.sin_addr)) 
+  if (if_check_address (from->sin_addr)) 
     {
       if (IS_RIP_DEBUG_PACKET)
 	zlog_debug ("ignore packet comes from myself");
@@ -1853,29 +1879,29 @@ rip_read (struct thread *t)
     }
 
   /* Which interface is this packet comes from. */
-  ifp = if_lookup_address (from.sin_addr);
+  ifp = if_lookup_address (from->sin_addr);
   
   /* RIP packet received */
   if (IS_RIP_DEBUG_EVENT)
     zlog_debug ("RECV packet from %s port %d on %s",
-	       inet_ntoa (from.sin_addr), ntohs (from.sin_port),
+	       inet_ntoa (from->sin_addr), ntohs (from->sin_port),
 	       ifp ? ifp->name : "unknown");
 
   /* If this packet come from unknown interface, ignore it. */
   if (ifp == NULL)
     {
       zlog_info ("rip_read: cannot find interface for packet from %s port %d",
-		 inet_ntoa(from.sin_addr), ntohs (from.sin_port));
+		 inet_ntoa(from->sin_addr), ntohs (from->sin_port));
       return -1;
     }
   
-  ifc = connected_lookup_address (ifp, from.sin_addr);
+  ifc = connected_lookup_address (ifp, from->sin_addr);
   
   if (ifc == NULL)
     {
       zlog_info ("rip_read: cannot find connected address for packet from %s "
 		 "port %d on interface %s",
-		 inet_ntoa(from.sin_addr), ntohs (from.sin_port), ifp->name);
+		 inet_ntoa(from->sin_addr), ntohs (from->sin_port), ifp->name);
       return -1;
     }
 
@@ -1884,14 +1910,14 @@ rip_read (struct thread *t)
     {
       zlog_warn ("packet size %d is smaller than minimum size %d",
 		 len, RIP_PACKET_MINSIZ);
-      rip_peer_bad_packet (&from);
+      rip_peer_bad_packet (from);
       return len;
     }
   if (len > RIP_PACKET_MAXSIZ)
     {
       zlog_warn ("packet size %d is larger than max size %d",
 		 len, RIP_PACKET_MAXSIZ);
-      rip_peer_bad_packet (&from);
+      rip_peer_bad_packet (from);
       return len;
     }
 
@@ -1899,7 +1925,7 @@ rip_read (struct thread *t)
   if ((len - RIP_PACKET_MINSIZ) % 20)
     {
       zlog_warn ("packet size %d is wrong for RIP packet alignment", len);
-      rip_peer_bad_packet (&from);
+      rip_peer_bad_packet (from);
       return len;
     }
 
@@ -1907,13 +1933,13 @@ rip_read (struct thread *t)
   rtenum = ((len - RIP_PACKET_MINSIZ) / 20);
 
   /* For easy to handle. */
-  packet = &rip_buf.rip_packet;
+  packet = &rip_buf->rip_packet;
 
   /* RIP version check. */
   if (packet->version == 0)
     {
       zlog_info ("version 0 with command %d received.", packet->command);
-      rip_peer_bad_packet (&from);
+      rip_peer_bad_packet (from);
       return -1;
     }
 
@@ -1930,11 +1956,11 @@ rip_read (struct thread *t)
 
   /* Is RIP running or is this RIP neighbor ?*/
   ri = ifp->info;
-  if (! ri->running && ! rip_neighbor_lookup (&from))
+  if (! ri->running && ! rip_neighbor_lookup (from))
     {
       if (IS_RIP_DEBUG_EVENT)
 	zlog_debug ("RIP is not enabled on interface %s.", ifp->name);
-      rip_peer_bad_packet (&from);
+      rip_peer_bad_packet (from);
       return -1;
     }
 
@@ -1946,7 +1972,7 @@ rip_read (struct thread *t)
       if (IS_RIP_DEBUG_PACKET)
         zlog_debug ("  packet's v%d doesn't fit to if version spec", 
                    packet->version);
-      rip_peer_bad_packet (&from);
+      rip_peer_bad_packet (from);
       return -1;
     }
   if ((packet->version == RIPv2) && !(vrecv & RIPv2))
@@ -1954,7 +1980,7 @@ rip_read (struct thread *t)
       if (IS_RIP_DEBUG_PACKET)
         zlog_debug ("  packet's v%d doesn't fit to if version spec", 
                    packet->version);
-      rip_peer_bad_packet (&from);
+      rip_peer_bad_packet (from);
       return -1;
     }
   
@@ -1969,7 +1995,7 @@ rip_read (struct thread *t)
       if (IS_RIP_DEBUG_EVENT)
 	zlog_debug ("packet RIPv%d is dropped because authentication disabled", 
 		   packet->version);
-      rip_peer_bad_packet (&from);
+      rip_peer_bad_packet (from);
       return -1;
     }
   
@@ -2006,7 +2032,7 @@ rip_read (struct thread *t)
         {
           if (IS_RIP_DEBUG_PACKET)
             zlog_debug ("RIPv1" " dropped because authentication enabled");
-          rip_peer_bad_packet (&from);
+          rip_peer_bad_packet (from);
           return -1;
         }
     }
@@ -2019,7 +2045,7 @@ rip_read (struct thread *t)
           /* There definitely is no authentication in the packet. */
           if (IS_RIP_DEBUG_PACKET)
             zlog_debug ("RIPv2 authentication failed: no auth RTE in packet");
-          rip_peer_bad_packet (&from);
+          rip_peer_bad_packet (from);
           return -1;
         }
       
@@ -2028,7 +2054,7 @@ rip_read (struct thread *t)
         {
           if (IS_RIP_DEBUG_PACKET)
             zlog_debug ("RIPv2" " dropped because authentication enabled");
-	  rip_peer_bad_packet (&from);
+	  rip_peer_bad_packet (from);
 	  return -1;
         }
       
@@ -2037,12 +2063,12 @@ rip_read (struct thread *t)
         {
           case RIP_AUTH_SIMPLE_PASSWORD:
             auth_desc = "simple";
-            ret = rip_auth_simple_password (packet->rte, &from, ifp);
+            ret = rip_auth_simple_password (packet->rte, from, ifp);
             break;
           
           case RIP_AUTH_MD5:
             auth_desc = "MD5";
-            ret = rip_auth_md5 (packet, &from, len, ifp);
+            ret = rip_auth_md5 (packet, from, len, ifp);
             /* Reset RIP packet length to trim MD5 data. */
             len = ret;
             break;
@@ -2064,7 +2090,7 @@ rip_read (struct thread *t)
         {
           if (IS_RIP_DEBUG_PACKET)
             zlog_debug ("RIPv2 %s authentication failure", auth_desc);
-          rip_peer_bad_packet (&from);
+          rip_peer_bad_packet (from);
           return -1;
         }
     }
@@ -2073,32 +2099,65 @@ rip_read (struct thread *t)
   switch (packet->command)
     {
     case RIP_RESPONSE:
-      rip_response_process (packet, len, &from, ifc);
+      rip_response_process (packet, len, from, ifc);
       break;
     case RIP_REQUEST:
     case RIP_POLL:
-      rip_request_process (packet, len, &from, ifc);
+      rip_request_process (packet, len, from, ifc);
       break;
     case RIP_TRACEON:
     case RIP_TRACEOFF:
       zlog_info ("Obsolete command %s received, please sent it to routed", 
 		 lookup (rip_msg, packet->command));
-      rip_peer_bad_packet (&from);
+      rip_peer_bad_packet (from);
       break;
     case RIP_POLL_ENTRY:
       zlog_info ("Obsolete command %s received", 
 		 lookup (rip_msg, packet->command));
-      rip_peer_bad_packet (&from);
+      rip_peer_bad_packet (from);
       break;
     default:
       zlog_info ("Unknown RIP command %d received", packet->command);
-      rip_peer_bad_packet (&from);
+      rip_peer_bad_packet (from);
       break;
     }
 
   return len;
 }
 
+/* First entry point of RIP packet.  Everything waiting on the socket
+   is read at once, then processed in order. */
+static int
+rip_read (struct thread *t)
+{
+  int sock;
+  int ret;
+  int i;
+  struct msg_batch *batch;
+
+  /* Fetch socket then register myself. */
+  sock = THREAD_FD (t);
+  rip->t_read = NULL;
+
+  /* Add myself to tne next event */
+  rip_event (RIP_READ, sock);
+
+  batch = rip->recv_batch;
+  ret = msg_batch_recv (batch);
+  if (ret < 0)
+    {
+      if (! ERRNO_IO_RETRY (errno))
+	zlog_info ("recvfrom failed: %s", safe_strerror (errno));
+      return ret;
+    }
+
+  for (i = 0; i < ret; i++)
+    rip_read_packet ((union rip_buf *) MSG_BATCH_DATA (batch, i),
+		     MSG_BATCH_LEN (batch, i), &MSG_BATCH_ADDR (batch, i)->sin);
+
+  return 0;
+}
+
 /* Write routing table entry to the stream and return next index of
    the routing table entry in the stream. */
 static int
@@ -2676,9 +2735,9 @@ rip_redistribute_withdraw (int type)
 	  {
 	    /* Perform poisoned reverse. */
 	    rinfo->metric = RIP_METRIC_INFINITY;
-	    RIP_TIMER_ON (rinfo->t_garbage_collect, 
+	    RIP_ROUTE_TIMER_ON (rinfo->t_garbage_collect, 
 			  rip_garbage_collect, rip->garbage_time);
-	    RIP_TIMER_OFF (rinfo->t_timeout);
+	    RIP_ROUTE_TIMER_OFF (rinfo->t_timeout);
 	    rinfo->flags |= RIP_RTF_CHANGED;
 
 	    if (IS_RIP_DEBUG_EVENT) {
@@ -2712,6 +2771,7 @@ rip_create (void)
   rip->table = route_table_init ();
   rip->route = route_table_init ();
   rip->neighbor = route_table_init ();
+  rip->wheel = wheel_new (master, WHEEL_SIZE_DEFAULT);
 
   /* Make output stream. */
   rip->obuf = stream_new (1500);
@@ -2720,6 +2780,10 @@ rip_create (void)
   rip->sock = rip_create_socket (NULL);
   if (rip->sock < 0)
     return rip->sock;
+  rip->send_batch = msg_batch_new (master, rip->sock, RIP_BATCH_SIZE,
+				   STREAM_SIZE (rip->obuf));
+  rip->recv_batch = msg_batch_new (master, rip->sock, RIP_BATCH_SIZE,
+				   sizeof (union rip_buf));
 
   /* Create read and timer thread. */
   rip_event (RIP_READ, rip->sock);
@@ -3381,18 +3445,17 @@ rip_vty_out_uptime (struct vty *vty, struct rip_info *rinfo)
   struct tm *tm;
 #define TIME_BUF 25
   char timebuf [TIME_BUF];
-  struct thread *thread;
 
-  if ((thread = rinfo->t_timeout) != NULL)
+  if (WHEEL_TIMER_PENDING (&rinfo->t_timeout))
     {
-      clock = thread_timer_remain_second (thread);
+      clock = wheel_timer_remain_second (&rinfo->t_timeout);
       tm = gmtime (&clock);
       strftime (timebuf, TIME_BUF, "%M:%S", tm);
       vty_out (vty, "%5s", timebuf);
     }
-  else if ((thread = rinfo->t_garbage_collect) != NULL)
+  else if (WHEEL_TIMER_PENDING (&rinfo->t_garbage_collect))
     {
-      clock = thread_timer_remain_second (thread);
+      clock = wheel_timer_remain_second (&rinfo->t_garbage_collect);
       tm = gmtime (&clock);
       strftime (timebuf, TIME_BUF, "%M:%S", tm);
       vty_out (vty, "%5s", timebuf);
@@ -3599,6 +3662,13 @@ DEFUN (show_ip_rip_status,
   vty_out (vty, "    Gateway          BadPackets BadRoutes  Distance Last Update%s", VTY_NEWLINE);
   rip_peer_display (vty);
 
+  if (rip->send_batch)
+    {
+      vty_out (vty, "  Socket:%s", VTY_NEWLINE);
+      msg_batch_show (vty, "  Sent", rip->send_batch);
+      msg_batch_show (vty, "  Received", rip->recv_batch);
+    }
+
   rip_distance_show (vty);
 
   return CMD_SUCCESS;
@@ -3807,8 +3877,8 @@ rip_clean (void)
 	      rip_zebra_ipv4_delete ((struct prefix_ipv4 *)&rp->p,
 				     &rinfo->nexthop, rinfo->metric);
 	
-	    RIP_TIMER_OFF (rinfo->t_timeout);
-	    RIP_TIMER_OFF (rinfo->t_garbage_collect);
+	    RIP_ROUTE_TIMER_OFF (rinfo->t_timeout);
+	    RIP_ROUTE_TIMER_OFF (rinfo->t_garbage_collect);
 
 	    rp->info = NULL;
 	    route_unlock_node (rp);
@@ -3820,6 +3890,7 @@ rip_clean (void)
       RIP_TIMER_OFF (rip->t_update);
       RIP_TIMER_OFF (rip->t_triggered_update);
       RIP_TIMER_OFF (rip->t_triggered_interval);
+      wheel_free (rip->wheel);
 
       /* Cancel read thread. */
       if (rip->t_read)
@@ -3828,7 +3899,14 @@ rip_clean (void)
 	  rip->t_read = NULL;
 	}
 
-      /* Close RIP socket. */
+      /* Send what is still queued, then close RIP socket. */
+      if (rip->send_batch)
+	{
+	  msg_batch_flush (rip->send_batch);
+	  msg_batch_free (rip->send_batch);
+	}
+      if (rip->recv_batch)
+	msg_batch_free (rip->recv_batch);
       if (rip->sock >= 0)
 	{
 	  close (rip->sock);
@@ -22,6 +22,9 @@
 #ifndef _ZEBRA_RIP_H
 #define _ZEBRA_RIP_H
 
+#include "wheel.h"
+#include "msgbatch.h"
+
 /* RIP version number. */
 #define RIPv1                            1
 #define RIPv2                            2
@@ -45,6 +48,9 @@
 #define RIP_PACKET_MINSIZ                4
 #define RIP_PACKET_MAXSIZ              512
 
+/* Datagrams read or sent per system call. */
+#define RIP_BATCH_SIZE                  64
+
 #define RIP_HEADER_SIZE                  4
 #define RIP_RTE_SIZE                    20
 
@@ -100,6 +106,10 @@ struct rip
   /* RIP socket. */
   int sock;
 
+  /* Datagrams waiting to be sent on it, and those last read from it. */
+  struct msg_batch *send_batch;
+  struct msg_batch *recv_batch;
+
   /* Default version of rip instance. */
   int version_send;	/* version 1 or 2 (but not both) */
   int version_recv;	/* version 1 or 2 or both */
@@ -115,6 +125,9 @@ struct rip
   
   /* RIP neighbor. */
   struct route_table *neighbor;
+
+  /* Route timeout and garbage-collect timers. */
+  struct timer_wheel *wheel;
   
   /* RIP threads. */
   struct thread *t_read;
@@ -213,8 +226,8 @@ struct rip_info
   u_char flags;
 
   /* Garbage collect timer. */
-  struct thread *t_timeout;
-  struct thread *t_garbage_collect;
+  struct wheel_timer t_timeout;
+  struct wheel_timer t_garbage_collect;
 
   /* Route-map futures - this variables can be changed. */
   struct in_addr nexthop_out;
@@ -356,13 +369,15 @@ enum rip_event
   RIP_TRIGGERED_UPDATE,
 };
 
-/* Macro for timer turn on. */
-#define RIP_TIMER_ON(T,F,V) \
+/* Macros for route timers, which run off rip->wheel. */
+#define RIP_ROUTE_TIMER_ON(T,F,V) \
   do { \
-    if (!(T)) \
-      (T) = thread_add_timer (master, (F), rinfo, (V)); \
+    if (!WHEEL_TIMER_PENDING (&(T))) \
+      wheel_timer_add (rip->wheel, &(T), (F), rinfo, (V)); \
   } while (0)
 
+#define RIP_ROUTE_TIMER_OFF(T) wheel_timer_cancel (&(T))
+
 /* Macro for timer turn off. */
 #define RIP_TIMER_OFF(X) \
   do { \
@@ -406,16 +406,15 @@ ripng_lladdr_check (struct interface *ifp, struct in6_addr *addr)
 
 /* RIPng route garbage collect timer. */
 static int
-ripng_garbage_collect (struct thread *t)
+ripng_garbage_collect (struct wheel_timer *t)
 {
   struct ripng_info *rinfo;
   struct route_node *rp;
 
-  rinfo = THREAD_ARG (t);
-  rinfo->t_garbage_collect = NULL;
+  rinfo = WHEEL_TIMER_ARG (t);
 
   /* Off timeout timer. */
-  RIPNG_TIMER_OFF (rinfo->t_timeout);
+  RIPNG_ROUTE_TIMER_OFF (rinfo->t_timeout);
   
   /* Get route_node pointer. */
   rp = rinfo->rp;
@@ -432,19 +431,18 @@ ripng_garbage_collect (struct thread *t)
 
 /* Timeout RIPng routes. */
 static int
-ripng_timeout (struct thread *t)
+ripng_timeout (struct wheel_timer *t)
 {
   struct ripng_info *rinfo;
   struct route_node *rp;
 
-  rinfo = THREAD_ARG (t);
-  rinfo->t_timeout = NULL;
+  rinfo = WHEEL_TIMER_ARG (t);
 
   /* Get route_node pointer. */
   rp = rinfo->rp;
 
   /* - The garbage-collection timer is set for 120 seconds. */
-  RIPNG_TIMER_ON (rinfo->t_garbage_collect, ripng_garbage_collect, 
+  RIPNG_ROUTE_TIMER_ON (rinfo->t_garbage_collect, ripng_garbage_collect, 
 		  ripng->garbage_time);
 
   /* Delete this route from the kernel. */
@@ -468,14 +466,15 @@ ripng_timeout (struct thread *t)
   return 0;
 }
 
+/* Restart the route timeout.  A pending timer on the wheel is only
+   given a new expiry, so refreshing every route of every update stays
+   cheap. */
 static void
 ripng_timeout_update (struct ripng_info *rinfo)
 {
   if (rinfo->metric != RIPNG_METRIC_INFINITY)
-    {
-      RIPNG_TIMER_OFF (rinfo->t_timeout);
-      RIPNG_TIMER_ON (rinfo->t_timeout, ripng_timeout, ripng->timeout_time);
-    }
+    wheel_timer_add (ripng->wheel, &rinfo->t_timeout, ripng_timeout, rinfo,
+                     ripng->timeout_time);
 }
 
 static int
@@ -841,7 +840,7 @@ ripng_route_process (struct rte *rte, struct sockaddr_in6 *from,
 	      rinfo->type = ZEBRA_ROUTE_RIPNG;
 	      rinfo->sub_type = RIPNG_ROUTE_RTE;
 
-	      RIPNG_TIMER_OFF (rinfo->t_garbage_collect);
+	      RIPNG_ROUTE_TIMER_OFF (rinfo->t_garbage_collect);
 
 	      if (! IPV6_ADDR_SAME (&rinfo->nexthop, nexthop))
 		IPV6_ADDR_COPY (&rinfo->nexthop, nexthop);
@@ -884,9 +883,9 @@ ripng_route_process (struct rte *rte, struct sockaddr_in6 *from,
 	      if (oldmetric != RIPNG_METRIC_INFINITY)
 		{
 		  /* - The garbage-collection timer is set for 120 seconds. */
-		  RIPNG_TIMER_ON (rinfo->t_garbage_collect, 
+		  RIPNG_ROUTE_TIMER_ON (rinfo->t_garbage_collect, 
 				  ripng_garbage_collect, ripng->garbage_time);
-		  RIPNG_TIMER_OFF (rinfo->t_timeout);
+		  RIPNG_ROUTE_TIMER_OFF (rinfo->t_timeout);
 
 		  /* - The metric for the route is set to 16
 		     (infinity).  This causes the route to be removed
@@ -963,8 +962,8 @@ ripng_redistribute_add (int type, int sub_type, struct prefix_ipv6 *p,
 	}
       }
       
-      RIPNG_TIMER_OFF (rinfo->t_timeout);
-      RIPNG_TIMER_OFF (rinfo->t_garbage_collect);
+      RIPNG_ROUTE_TIMER_OFF (rinfo->t_timeout);
+      RIPNG_ROUTE_TIMER_OFF (rinfo->t_garbage_collect);
 
       /* Tells the other daemons about the deletion of
        * this RIPng route
@@ -1048,9 +1047,9 @@ ripng_redistribute_delete (int type, int sub_type, struct prefix_ipv6 *p,
 	{
 	  /* Perform poisoned reverse. */
 	  rinfo->metric = RIPNG_METRIC_INFINITY;
-	  RIPNG_TIMER_ON (rinfo->t_garbage_collect, 
+	  RIPNG_ROUTE_TIMER_ON (rinfo->t_garbage_collect, 
 			ripng_garbage_collect, ripng->garbage_time);
-	  RIPNG_TIMER_OFF (rinfo->t_timeout);
+	  RIPNG_ROUTE_TIMER_OFF (rinfo->t_timeout);
 
 	  /* Aggregate count decrement. */
 	  ripng_aggregate_decrement (rp, rinfo);
@@ -1085,9 +1084,9 @@ ripng_redistribute_withdraw (int type)
 	  {
 	    /* Perform poisoned reverse. */
 	    rinfo->metric = RIPNG_METRIC_INFINITY;
-	    RIPNG_TIMER_ON (rinfo->t_garbage_collect, 
+	    RIPNG_ROUTE_TIMER_ON (rinfo->t_garbage_collect, 
 			  ripng_garbage_collect, ripng->garbage_time);
-	    RIPNG_TIMER_OFF (rinfo->t_timeout);
+	    RIPNG_ROUTE_TIMER_OFF (rinfo->t_timeout);
 
 	    /* Aggregate count decrement. */
 	    ripng_aggregate_decrement (rp, rinfo);
@@ -1845,6 +1844,7 @@ ripng_create (void)
   ripng->table = route_table_init ();
   ripng->route = route_table_init ();
   ripng->aggregate = route_table_init ();
+  ripng->wheel = wheel_new (master, WHEEL_SIZE_DEFAULT);
  
   /* Make socket. */
   ripng->sock = ripng_make_socket ();
@@ -1938,18 +1938,17 @@ ripng_vty_out_uptime (struct vty *vty, struct ripng_info *rinfo)
   struct tm *tm;
 #define TIME_BUF 25
   char timebuf [TIME_BUF];
-  struct thread *thread;
-  
-  if ((thread = rinfo->t_timeout) != NULL)
+
+  if (WHEEL_TIMER_PENDING (&rinfo->t_timeout))
     {
-      clock = thread_timer_remain_second (thread);
+      clock = wheel_timer_remain_second (&rinfo->t_timeout);
       tm = gmtime (&clock);
       strftime (timebuf, TIME_BUF, "%M:%S", tm);
       vty_out (vty, "%5s", timebuf);
     }
-  else if ((thread = rinfo->t_garbage_collect) != NULL)
+  else if (WHEEL_TIMER_PENDING (&rinfo->t_garbage_collect))
     {
-      clock = thread_timer_remain_second (thread);
+      clock = wheel_timer_remain_second (&rinfo->t_garbage_collect);
       tm = gmtime (&clock);
       strftime (timebuf, TIME_BUF, "%M:%S", tm);
       vty_out (vty, "%5s", timebuf);
@@ -2785,8 +2784,8 @@ ripng_clean()
           ripng_zebra_ipv6_delete ((struct prefix_ipv6 *)&rp->p,
                                    &rinfo->nexthop, rinfo->metric);
 
-        RIPNG_TIMER_OFF (rinfo->t_timeout);
-        RIPNG_TIMER_OFF (rinfo->t_garbage_collect);
+        RIPNG_ROUTE_TIMER_OFF (rinfo->t_timeout);
+        RIPNG_ROUTE_TIMER_OFF (rinfo->t_garbage_collect);
 
         rp->info = NULL;
         route_unlock_node (rp);
@@ -2799,6 +2798,7 @@ ripng_clean()
     RIPNG_TIMER_OFF (ripng->t_update);
     RIPNG_TIMER_OFF (ripng->t_triggered_update);
     RIPNG_TIMER_OFF (ripng->t_triggered_interval);
+    wheel_free (ripng->wheel);
 
     /* Cancel the read thread */
     if (ripng->t_read) {
@@ -25,6 +25,7 @@
 
 #include <zclient.h>
 #include <vty.h>
+#include <wheel.h>
 
 /* RIPng version and port number. */
 #define RIPNG_V1                         1
@@ -117,6 +118,9 @@ struct ripng
   /* RIPng aggregate route information. */
   struct route_table *aggregate;
 
+  /* Route timeout and garbage-collect timers. */
+  struct timer_wheel *wheel;
+
   /* RIPng threads. */
   struct thread *t_read;
   struct thread *t_write;
@@ -190,8 +194,8 @@ struct ripng_info
   u_char flags;
 
   /* Garbage collect timer. */
-  struct thread *t_timeout;
-  struct thread *t_garbage_collect;
+  struct wheel_timer t_timeout;
+  struct wheel_timer t_garbage_collect;
 
   /* Route-map features - this variables can be changed. */
   struct in6_addr nexthop_out;
@@ -318,13 +322,16 @@ enum ripng_event
   RIPNG_TRIGGERED_UPDATE,
 };
 
-/* RIPng timer on/off macro. */
-#define RIPNG_TIMER_ON(T,F,V) \
+/* RIPng route timer on/off macro; route timers run off ripng->wheel. */
+#define RIPNG_ROUTE_TIMER_ON(T,F,V) \
 do { \
-   if (!(T)) \
-      (T) = thread_add_timer (master, (F), rinfo, (V)); \
+   if (!WHEEL_TIMER_PENDING (&(T))) \
+      wheel_timer_add (ripng->wheel, &(T), (F), rinfo, (V)); \
 } while (0)
 
+#define RIPNG_ROUTE_TIMER_OFF(T) wheel_timer_cancel (&(T))
+
+/* RIPng timer off macro. */
 #define RIPNG_TIMER_OFF(T) \
 do { \
    if (T) \
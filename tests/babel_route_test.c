@@ -0,0 +1,246 @@
+/*
+ * babeld route table benchmark.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Replays a synthetic update stream through update_route() and reports
+ * the CPU time per update.  The neighbour's interface is left down, so
+ * nothing is sent on the network; messages for zebra are written to a
+ * socketpair which is drained as the run goes.
+ *
+ *   testbabelroute [prefixes [updates]]   (default 20000, 500000)
+ */
+
+#include <zebra.h>
+
+#include "thread.h"
+#include "command.h"
+#include "if.h"
+#include "zclient.h"
+#include "network.h"
+
+#include "babeld/babel_main.h"
+#include "babeld/babeld.h"
+#include "babeld/util.h"
+#include "babeld/kernel.h"
+#include "babeld/source.h"
+#include "babeld/neighbour.h"
+#include "babeld/route.h"
+#include "babeld/babel_zebra.h"
+
+#include "prng.h"
+
+/* Globals normally provided by babel_main.c. */
+struct thread_master *master;
+struct timeval babel_now;
+unsigned char myid[8];
+int debug = 0;
+int resend_delay = -1;
+const unsigned char zeroes[16] = {0};
+const unsigned char ones[16] =
+    {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+     0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+unsigned char protocol_group[16];
+int protocol_port;
+int protocol_socket = -1;
+
+void
+babel_load_state_file (void)
+{
+}
+
+void
+show_babel_main_configuration (struct vty *vty)
+{
+}
+
+#define BENCH_PLEN    64
+#define BENCH_ORIGINS 64
+
+static void
+bench_prefix (unsigned char *prefix, unsigned int k)
+{
+  memset (prefix, 0, 16);
+  prefix[0] = 0x20;
+  prefix[1] = 0x01;
+  prefix[2] = 0x0d;
+  prefix[3] = 0xb8;
+  prefix[4] = k >> 24;
+  prefix[5] = k >> 16;
+  prefix[6] = k >> 8;
+  prefix[7] = k;
+}
+
+static void
+bench_id (unsigned char *id, unsigned int k)
+{
+  memset (id, 0, 8);
+  id[0] = 0x02;
+  id[7] = k % BENCH_ORIGINS + 1;
+}
+
+static unsigned long
+cpu_since (RUSAGE_T *before)
+{
+  RUSAGE_T after;
+  unsigned long cpu;
+
+  thread_getrusage (&after);
+  thread_consumed_time (&after, before, &cpu);
+  return cpu;
+}
+
+static void
+drain (int fd)
+{
+  char buf[65536];
+
+  while (read (fd, buf, sizeof (buf)) > 0)
+    ;
+}
+
+static int
+count_routes (void)
+{
+  int n = 0, i;
+
+  for (i = 0; i < installed_routes_estimate (); i++)
+    {
+      struct babel_route *r;
+      for (r = routes[i]; r; r = r->next)
+        n++;
+    }
+  return n;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct interface *ifp;
+  struct neighbour *neigh;
+  struct prng *prng;
+  unsigned char prefix[16], id[8], nh[16];
+  unsigned short *seqno;
+  char *present;
+  RUSAGE_T before;
+  unsigned long cpu;
+  int nprefixes = 20000, nupdates = 500000;
+  int i, expected = 0, flushed = 0, fail = 0;
+  int sv[2];
+
+  if (argc > 1)
+    nprefixes = atoi (argv[1]);
+  if (argc > 2)
+    nupdates = atoi (argv[2]);
+  if (nprefixes <= 0 || nupdates <= 0)
+    {
+      fprintf (stderr, "usage: %s [prefixes [updates]]\n", argv[0]);
+      exit (1);
+    }
+
+  master = thread_master_create ();
+  cmd_init (1);
+  babeld_quagga_init ();
+  gettime (&babel_now);
+  memset (myid, 0xee, sizeof (myid));
+
+  zclient = zclient_new ();
+  if (socketpair (AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    {
+      perror ("socketpair");
+      exit (1);
+    }
+  zclient->sock = sv[0];
+  set_nonblocking (sv[1]);
+
+  ifp = if_get_by_name ("bench0");
+  if_set_index (ifp, 1);
+  memset (nh, 0, sizeof (nh));
+  nh[0] = 0xfe;
+  nh[1] = 0x80;
+  nh[15] = 1;
+  neigh = find_neighbour (nh, ifp);
+
+  seqno = calloc (nprefixes, sizeof (unsigned short));
+  present = calloc (nprefixes, 1);
+  prng = prng_new (0);
+
+  /* Fill the table. */
+  thread_getrusage (&before);
+  for (i = 0; i < nprefixes; i++)
+    {
+      bench_prefix (prefix, i);
+      bench_id (id, i);
+      if (update_route (id, prefix, BENCH_PLEN, seqno[i], 96, 400,
+                        neigh, nh, NULL, 0))
+        present[i] = 1;
+      if (i % 64 == 0)
+        drain (sv[1]);
+    }
+  cpu = cpu_since (&before);
+  printf ("fill: %d prefixes, %.3f usec/update\n",
+          nprefixes, (double) cpu / nprefixes);
+
+  /* Churn: mostly refreshes and metric changes, with some prefixes
+   * flushed and learnt again. */
+  thread_getrusage (&before);
+  for (i = 0; i < nupdates; i++)
+    {
+      unsigned int r = prng_rand (prng);
+      unsigned int k = r % nprefixes;
+
+      bench_prefix (prefix, k);
+      bench_id (id, k);
+
+      if (present[k] && (r >> 24) < 16)
+        {
+          flush_route (find_route (prefix, BENCH_PLEN, neigh, nh));
+          present[k] = 0;
+          flushed++;
+          continue;
+        }
+
+      if ((r >> 24) < 64)
+        seqno[k]++;
+      if (update_route (id, prefix, BENCH_PLEN, seqno[k],
+                        96 + (r >> 28), 400, neigh, nh, NULL, 0))
+        present[k] = 1;
+      if (i % 64 == 0)
+        drain (sv[1]);
+    }
+  cpu = cpu_since (&before);
+  printf ("churn: %d updates (%d flushes), %.3f usec/update\n",
+          nupdates, flushed, (double) cpu / nupdates);
+
+  for (i = 0; i < nprefixes; i++)
+    {
+      bench_prefix (prefix, i);
+      if ((find_route (prefix, BENCH_PLEN, neigh, nh) != NULL) != present[i])
+        fail = 1;
+      expected += present[i];
+    }
+  if (count_routes () != expected)
+    fail = 1;
+  printf ("consistency: %s (%d routes)\n", fail ? "FAILED" : "OK", expected);
+
+  prng_free (prng);
+  free (present);
+  free (seqno);
+  return fail;
+}
@@ -0,0 +1,322 @@
+/*
+ * BGP adjacency in tests.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Receives, changes and withdraws random routes of IPv4, IPv6 and VPN
+ * address families in the adjacencies in of a peer, and every so
+ * often checks that the routes kept are exactly those last received,
+ * each once with its attribute and label.  Then reports the memory per
+ * route kept, against the list entry per route bgpd kept before.
+ *
+ *   testbgpadjin [changes [routes]]    (default 100000, 20000)
+ */
+
+#include <zebra.h>
+
+#include "vty.h"
+#include "stream.h"
+#include "privs.h"
+#include "linklist.h"
+#include "memory.h"
+#include "prefix.h"
+#include "thread.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_aspath.h"
+#include "bgpd/bgp_advertise.h"
+
+#include "prng.h"
+
+/* need these to link in libbgp */
+struct zebra_privs_t *bgpd_privs = NULL;
+struct thread_master *master = NULL;
+
+static struct peer peer;
+
+#define NATTRS 8
+static struct attr *attrs[NATTRS];
+
+static const struct family
+{
+  const char *name;
+  afi_t afi;
+  safi_t safi;
+} families[] =
+{
+  { "IPv4 unicast", AFI_IP,  SAFI_UNICAST  },
+  { "IPv6 unicast", AFI_IP6, SAFI_UNICAST  },
+  { "VPNv4",        AFI_IP,  SAFI_MPLS_VPN },
+};
+#define NFAMILIES (sizeof (families) / sizeof (families[0]))
+
+/* A route which may have been received. */
+struct slot
+{
+  struct attr *attr;
+  u_char tag[3];
+  u_char seen;
+};
+
+/* Route number S: pairs of prefixes of two lengths at one address, or
+ * for VPNs the same prefix in three route distinguishers. */
+static void
+slot_route (const struct family *f, unsigned int s, struct prefix *p,
+            struct prefix_rd *prd)
+{
+  unsigned int a;
+
+  memset (p, 0, sizeof (struct prefix));
+  memset (prd, 0, sizeof (struct prefix_rd));
+  prd->family = AF_UNSPEC;
+  prd->prefixlen = 64;
+
+  if (f->safi == SAFI_MPLS_VPN)
+    {
+      a = s / 3;
+      p->family = AF_INET;
+      p->prefixlen = 24;
+      p->u.val[0] = 10;
+      p->u.val[1] = a >> 8;
+      p->u.val[2] = a & 0xff;
+      prd->val[7] = s % 3;
+      return;
+    }
+
+  a = s / 2;
+  if (f->afi == AFI_IP)
+    {
+      p->family = AF_INET;
+      p->prefixlen = s % 2 ? 32 : 24;
+      p->u.val[0] = 10;
+      p->u.val[1] = a >> 8;
+      p->u.val[2] = a & 0xff;
+    }
+  else
+    {
+      p->family = AF_INET6;
+      p->prefixlen = s % 2 ? 64 : 48;
+      p->u.val[0] = 0x20;
+      p->u.val[1] = 0x01;
+      p->u.val[4] = a >> 8;
+      p->u.val[5] = a & 0xff;
+    }
+}
+
+static unsigned int
+route_slot (const struct family *f, struct prefix *p, struct prefix_rd *prd)
+{
+  unsigned int a = (p->u.val[f->afi == AFI_IP ? 1 : 4] << 8)
+                   | p->u.val[f->afi == AFI_IP ? 2 : 5];
+
+  if (f->safi == SAFI_MPLS_VPN)
+    return a * 3 + prd->val[7];
+  return a * 2 + (p->prefixlen == (f->afi == AFI_IP ? 32 : 64));
+}
+
+static struct attr *
+make_attr (unsigned int i)
+{
+  struct attr attr;
+  struct attr *new;
+  char buf[64];
+
+  memset (&attr, 0, sizeof (struct attr));
+  bgp_attr_extra_get (&attr);
+  attr.origin = BGP_ORIGIN_IGP;
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_ORIGIN);
+  snprintf (buf, sizeof (buf), "200 %u", 300 + i);
+  attr.aspath = aspath_str2aspath (buf);
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_AS_PATH);
+
+  new = bgp_attr_intern (&attr);
+  bgp_attr_extra_free (&attr);
+  return new;
+}
+
+/* Whether the routes kept are those of SLOTS. */
+static int
+check (const struct family *f, struct slot *slots, unsigned int nslots,
+       unsigned int count)
+{
+  struct bgp_adj_in *adj = peer.adj_in[f->afi][f->safi];
+  struct prefix p;
+  struct prefix_rd prd;
+  struct attr *attr;
+  u_char *tag;
+  unsigned int i, s, refs;
+
+  if (! count)
+    return adj ? 1 : 0;
+  if (! adj || adj->count != count)
+    return 1;
+
+  for (s = 0; s < nslots; s++)
+    slots[s].seen = 0;
+
+  for (i = 0; i < adj->count; i++)
+    {
+      attr = bgp_adj_in_get (adj, i, &p, &prd, &tag);
+      s = route_slot (f, &p, &prd);
+      if (s >= nslots || slots[s].seen || slots[s].attr != attr)
+        return 1;
+      if (f->safi == SAFI_MPLS_VPN && memcmp (tag, slots[s].tag, 3))
+        return 1;
+      slots[s].seen = 1;
+    }
+
+  /* Each distinct attribute once, counting its routes. */
+  refs = 0;
+  for (i = 0; i < adj->attr_used; i++)
+    if (adj->attr[i].attr)
+      refs += adj->attr[i].refcnt;
+  if (refs != count || adj->attr_count > NATTRS)
+    return 1;
+
+  return 0;
+}
+
+static int
+test_family (struct prng *prng, const struct family *f, int changes,
+             unsigned int nslots)
+{
+  struct slot *slots;
+  struct prefix p;
+  struct prefix_rd prd;
+  unsigned int count = 0;
+  unsigned int s;
+  int i, fail = 0;
+
+  slots = XCALLOC (MTYPE_TMP, nslots * sizeof (struct slot));
+
+  for (i = 0; i < changes && ! fail; i++)
+    {
+      s = prng_rand (prng) % nslots;
+      slot_route (f, s, &p, &prd);
+
+      if (slots[s].attr && prng_rand (prng) % 2)
+        {
+          bgp_adj_in_unset (&peer, f->afi, f->safi, &p, &prd);
+          slots[s].attr = NULL;
+          count--;
+        }
+      else
+        {
+          if (! slots[s].attr)
+            count++;
+          slots[s].attr = attrs[prng_rand (prng) % NATTRS];
+          slots[s].tag[2] = prng_rand (prng);
+          bgp_adj_in_set (&peer, f->afi, f->safi, &p, &prd, slots[s].tag,
+                          slots[s].attr);
+        }
+
+      if (i % 997 == 0)
+        fail = check (f, slots, nslots, count);
+    }
+  if (! fail)
+    fail = check (f, slots, nslots, count);
+
+  /* Withdrawing all frees it all. */
+  for (s = 0; s < nslots && ! fail; s++)
+    if (slots[s].attr)
+      {
+        slot_route (f, s, &p, &prd);
+        bgp_adj_in_unset (&peer, f->afi, f->safi, &p, &prd);
+        slots[s].attr = NULL;
+        count--;
+      }
+  if (! fail)
+    fail = check (f, slots, nslots, count);
+
+  printf ("%-12s %d changes: %s\n", f->name, changes, fail ? "FAILED" : "OK");
+  XFREE (MTYPE_TMP, slots);
+  return fail;
+}
+
+/* Memory per route of a full adjacency in. */
+static void
+bench (struct prng *prng, const struct family *f, unsigned int routes)
+{
+  struct prefix p;
+  struct prefix_rd prd;
+  unsigned long bytes;
+  unsigned int s;
+
+  for (s = 0; s < routes; s++)
+    {
+      slot_route (f, s, &p, &prd);
+      bgp_adj_in_set (&peer, f->afi, f->safi, &p, &prd, NULL,
+                      attrs[prng_rand (prng) % NATTRS]);
+    }
+  bgp_adj_in_stats (&bytes);
+
+  /* A list entry of four pointers per route, before malloc overhead. */
+  printf ("%-12s %u routes: %.1f bytes per route, was %lu\n", f->name,
+          routes, (double) bytes / routes, (unsigned long) (4 * sizeof (void *)));
+
+  bgp_adj_in_finish (&peer.adj_in[f->afi][f->safi]);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct prng *prng;
+  int changes = 100000, routes = 20000;
+  unsigned int i;
+  int fail = 0;
+
+  if (argc > 1)
+    changes = atoi (argv[1]);
+  if (argc > 2)
+    routes = atoi (argv[2]);
+  if (changes <= 0 || routes <= 0 || routes > 65536)
+    {
+      fprintf (stderr, "usage: %s [changes [routes]]\n", argv[0]);
+      exit (1);
+    }
+
+  master = thread_master_create ();
+  bgp_master_init ();
+  bgp_attr_init ();
+
+  for (i = 0; i < NATTRS; i++)
+    attrs[i] = make_attr (i);
+  prng = prng_new (0);
+
+  for (i = 0; i < NFAMILIES; i++)
+    fail |= test_family (prng, &families[i], changes, routes);
+
+  /* Only the references of the test are left. */
+  for (i = 0; i < NATTRS; i++)
+    if (attrs[i]->refcnt != 1)
+      {
+        printf ("attribute %u has %lu references left\n", i,
+                attrs[i]->refcnt - 1);
+        fail = 1;
+      }
+
+  for (i = 0; i < NFAMILIES; i++)
+    bench (prng, &families[i], routes);
+
+  prng_free (prng);
+  return fail;
+}
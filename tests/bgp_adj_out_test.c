@@ -0,0 +1,362 @@
+/*
+ * BGP adjacency out tests.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Announces, withdraws and clears random prefixes to peers, sending
+ * what is queued to a peer as bgp_update_packet and bgp_withdraw_packet
+ * would, and every so often checks what is recorded as sent and pending
+ * for each prefix and peer.  Then reports the memory per prefix and
+ * peer sent, against the object per prefix and peer bgpd kept before.
+ *
+ *   testbgpadjout [changes [prefixes]]    (default 100000, 2000)
+ */
+
+#include <zebra.h>
+
+#include "vty.h"
+#include "stream.h"
+#include "privs.h"
+#include "linklist.h"
+#include "memory.h"
+#include "prefix.h"
+#include "thread.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_aspath.h"
+#include "bgpd/bgp_advertise.h"
+
+#include "prng.h"
+
+/* need these to link in libbgp */
+struct zebra_privs_t *bgpd_privs = NULL;
+struct thread_master *master = NULL;
+
+static struct bgp *bgp;
+static as_t asn = 100;
+
+#define NPEERS 64
+static struct peer *peers[NPEERS];
+
+#define NATTRS 4
+static struct attr *attrs[NATTRS];
+
+/* The path announced, held by the test.  */
+static struct bgp_info path = { .lock = 1 };
+
+/* What a peer was sent of a prefix, and what is pending.  */
+struct slot
+{
+  struct attr *sent;
+  struct attr *update;
+  int withdraw;
+};
+
+/* Node of prefix I, locked.  */
+static struct bgp_node *
+prefix_node (unsigned int i)
+{
+  struct prefix p;
+
+  memset (&p, 0, sizeof (struct prefix));
+  p.family = AF_INET;
+  p.prefixlen = 24;
+  p.u.val[0] = 10;
+  p.u.val[1] = i >> 8;
+  p.u.val[2] = i & 0xff;
+
+  return bgp_node_get (bgp->rib[AFI_IP][SAFI_UNICAST], &p);
+}
+
+static struct attr *
+make_attr (unsigned int i)
+{
+  struct attr attr;
+  struct attr *new;
+  char buf[64];
+
+  memset (&attr, 0, sizeof (struct attr));
+  bgp_attr_extra_get (&attr);
+  attr.origin = BGP_ORIGIN_IGP;
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_ORIGIN);
+  snprintf (buf, sizeof (buf), "100 %u", 300 + i);
+  attr.aspath = aspath_str2aspath (buf);
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_AS_PATH);
+
+  new = bgp_attr_intern (&attr);
+  bgp_attr_extra_free (&attr);
+  return new;
+}
+
+/* Send what is queued to PEER.  */
+static void
+flush (struct peer *peer)
+{
+  struct bgp_synchronize *sync = peer->sync[AFI_IP][SAFI_UNICAST];
+  struct bgp_advertise *adv;
+  struct bgp_node *rn;
+
+  while ((adv = FIFO_HEAD (&sync->withdraw)) != NULL)
+    {
+      rn = adv->rn;
+      bgp_adj_out_remove (rn, peer, AFI_IP, SAFI_UNICAST);
+      bgp_unlock_node (rn);
+    }
+
+  while ((adv = FIFO_HEAD (&sync->update)) != NULL)
+    {
+      bgp_adj_out_sent (adv->rn, peer, adv->baa->attr);
+      bgp_advertise_clean (peer, adv, AFI_IP, SAFI_UNICAST);
+    }
+}
+
+/* Whether what is recorded is what SLOTS say.  */
+static int
+check (struct bgp_node **nodes, struct slot *slots, unsigned int nprefixes)
+{
+  struct bgp_adj_out *adj;
+  struct slot *slot;
+  unsigned long sent = 0;
+  unsigned int i, j;
+  int k, lookup;
+
+  for (i = 0; i < nprefixes; i++)
+    {
+      for (j = 0; j < NPEERS; j++)
+	{
+	  slot = &slots[i * NPEERS + j];
+	  lookup = slot->update ? 1 : slot->withdraw ? 0 : slot->sent != NULL;
+
+	  if (bgp_adj_out_attr (nodes[i], peers[j]) != slot->sent
+	      || bgp_adj_out_pending (nodes[i], peers[j])
+		 != (slot->update || slot->withdraw)
+	      || bgp_adj_out_lookup (peers[j], &nodes[i]->p, AFI_IP,
+				     SAFI_UNICAST, nodes[i]) != lookup)
+	    return 1;
+	  if (slot->sent)
+	    sent++;
+	}
+
+      /* The attribute most were sent is kept once, and only once no
+         longer sent to anyone is it given up.  */
+      if ((adj = nodes[i]->adj_out) != NULL)
+	{
+	  if (adj->count ? adj->count <= adj->other_count || ! adj->attr
+			 : adj->attr || adj->other_count)
+	    return 1;
+	  for (k = 0; k < adj->other_count; k++)
+	    if (adj->other[k].attr == adj->attr)
+	      return 1;
+	}
+    }
+
+  return bgp_adj_out_stats (NULL) != sent;
+}
+
+static int
+test_changes (struct prng *prng, int changes, unsigned int nprefixes)
+{
+  struct bgp_node **nodes;
+  struct slot *slots;
+  struct slot *slot;
+  struct peer *peer;
+  unsigned long bytes;
+  unsigned int i, j, k;
+  int n, fail = 0;
+
+  nodes = XCALLOC (MTYPE_TMP, nprefixes * sizeof (struct bgp_node *));
+  slots = XCALLOC (MTYPE_TMP, nprefixes * NPEERS * sizeof (struct slot));
+  for (i = 0; i < nprefixes; i++)
+    nodes[i] = prefix_node (i);
+
+  for (n = 0; n < changes && ! fail; n++)
+    {
+      i = prng_rand (prng) % nprefixes;
+      j = prng_rand (prng) % NPEERS;
+      slot = &slots[i * NPEERS + j];
+      peer = peers[j];
+
+      switch (prng_rand (prng) % 8)
+	{
+	case 0:
+	  /* Withdrawn.  */
+	  bgp_adj_out_unset (nodes[i], peer, &nodes[i]->p,
+			     AFI_IP, SAFI_UNICAST);
+	  slot->update = NULL;
+	  slot->withdraw = slot->sent != NULL;
+	  break;
+	case 1:
+	  /* The peer cleared.  */
+	  if (bgp_adj_out_remove (nodes[i], peer, AFI_IP, SAFI_UNICAST))
+	    bgp_unlock_node (nodes[i]);
+	  slot->sent = slot->update = NULL;
+	  slot->withdraw = 0;
+	  break;
+	case 2:
+	  /* All queued to the peer sent.  */
+	  flush (peer);
+	  for (k = 0; k < nprefixes; k++)
+	    {
+	      slot = &slots[k * NPEERS + j];
+	      if (slot->update)
+		slot->sent = slot->update;
+	      else if (slot->withdraw)
+		slot->sent = NULL;
+	      slot->update = NULL;
+	      slot->withdraw = 0;
+	    }
+	  break;
+	default:
+	  /* Mostly the attribute most peers are sent.  */
+	  k = prng_rand (prng) % (NATTRS * 2);
+	  slot->update = attrs[k < NATTRS ? k : 0];
+	  slot->withdraw = 0;
+	  bgp_adj_out_set (nodes[i], peer, &nodes[i]->p, slot->update,
+			   AFI_IP, SAFI_UNICAST, &path);
+	  break;
+	}
+
+      if (n % 997 == 0)
+	fail = check (nodes, slots, nprefixes);
+    }
+  if (! fail)
+    fail = check (nodes, slots, nprefixes);
+
+  /* Clearing all peers frees it all.  */
+  for (i = 0; i < nprefixes && ! fail; i++)
+    for (j = 0; j < NPEERS; j++)
+      {
+	if (bgp_adj_out_remove (nodes[i], peers[j], AFI_IP, SAFI_UNICAST))
+	  bgp_unlock_node (nodes[i]);
+	memset (&slots[i * NPEERS + j], 0, sizeof (struct slot));
+      }
+  if (! fail)
+    fail = check (nodes, slots, nprefixes);
+  if (! fail && (bgp_adj_out_stats (&bytes) || bytes || path.lock != 1))
+    fail = 1;
+  for (j = 0; j < NPEERS && ! fail; j++)
+    if (peers[j]->sync[AFI_IP][SAFI_UNICAST]->count || peers[j]->lock != 2)
+      fail = 1;
+
+  printf ("%d changes to %u prefixes and %d peers: %s\n", changes, nprefixes,
+	  NPEERS, fail ? "FAILED" : "OK");
+  for (i = 0; i < nprefixes; i++)
+    bgp_unlock_node (nodes[i]);
+  XFREE (MTYPE_TMP, nodes);
+  XFREE (MTYPE_TMP, slots);
+  return fail;
+}
+
+/* Memory per prefix and peer of NPEER peers sent PREFIXES prefixes,
+   one peer in eight being sent another attribute than the others.  */
+static void
+bench (int npeer, unsigned int nprefixes)
+{
+  struct bgp_node **nodes;
+  unsigned long bytes;
+  unsigned int i;
+  int j;
+
+  nodes = XCALLOC (MTYPE_TMP, nprefixes * sizeof (struct bgp_node *));
+  for (i = 0; i < nprefixes; i++)
+    {
+      nodes[i] = prefix_node (i);
+      for (j = 0; j < npeer; j++)
+	bgp_adj_out_set (nodes[i], peers[j], &nodes[i]->p, attrs[j % 8 == 7],
+			 AFI_IP, SAFI_UNICAST, &path);
+    }
+  for (j = 0; j < npeer; j++)
+    flush (peers[j]);
+
+  bgp_adj_out_stats (&bytes);
+
+  /* An object of five pointers per prefix and peer, before malloc
+     overhead. */
+  printf ("%2d peers %u prefixes: %.1f bytes per prefix per peer, was %lu\n",
+	  npeer, nprefixes, (double) bytes / nprefixes / npeer,
+	  (unsigned long) (5 * sizeof (void *)));
+
+  for (i = 0; i < nprefixes; i++)
+    {
+      for (j = 0; j < npeer; j++)
+	if (bgp_adj_out_remove (nodes[i], peers[j], AFI_IP, SAFI_UNICAST))
+	  bgp_unlock_node (nodes[i]);
+      bgp_unlock_node (nodes[i]);
+    }
+  XFREE (MTYPE_TMP, nodes);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct prng *prng;
+  int changes = 100000, prefixes = 2000;
+  unsigned int i;
+  int fail;
+
+  if (argc > 1)
+    changes = atoi (argv[1]);
+  if (argc > 2)
+    prefixes = atoi (argv[2]);
+  if (changes <= 0 || prefixes <= 0 || prefixes > 65536)
+    {
+      fprintf (stderr, "usage: %s [changes [prefixes]]\n", argv[0]);
+      exit (1);
+    }
+
+  master = thread_master_create ();
+  bgp_master_init ();
+  bgp_option_set (BGP_OPT_NO_LISTEN);
+  bgp_attr_init ();
+
+  if (bgp_get (&bgp, &asn, NULL))
+    return -1;
+
+  /* Withdrawals schedule a write, which is never run.  */
+  for (i = 0; i < NPEERS; i++)
+    {
+      peers[i] = peer_create_accept (bgp);
+      peers[i]->fd = open ("/dev/null", O_WRONLY);
+    }
+  for (i = 0; i < NATTRS; i++)
+    attrs[i] = make_attr (i);
+  prng = prng_new (0);
+
+  fail = test_changes (prng, changes, prefixes);
+
+  /* Only the references of the test are left.  */
+  for (i = 0; i < NATTRS; i++)
+    if (attrs[i]->refcnt != 1)
+      {
+	printf ("attribute %u has %lu references left\n", i,
+		attrs[i]->refcnt - 1);
+	fail = 1;
+      }
+
+  bench (1, 20000);
+  bench (4, 20000);
+  bench (16, 20000);
+  bench (64, 20000);
+
+  prng_free (prng);
+  return fail;
+}
@@ -0,0 +1,504 @@
+/*
+ * BGP aggregate-address tests.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Adds, withdraws, invalidates and changes random routes under nested
+ * aggregates, and after every change checks each aggregate route and
+ * the summary-only suppression of each route against a walk over the
+ * whole subtree, which is how bgpd made aggregate routes before it
+ * counted them as routes come and go.  Then reports the CPU time per
+ * route change of both ways.
+ *
+ *   testbgpaggr [changes [routes]]    (default 20000, 20000)
+ */
+
+#include <zebra.h>
+
+#include "vty.h"
+#include "stream.h"
+#include "privs.h"
+#include "linklist.h"
+#include "memory.h"
+#include "prefix.h"
+#include "thread.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_aspath.h"
+#include "bgpd/bgp_community.h"
+
+#include "prng.h"
+
+/* need these to link in libbgp */
+struct zebra_privs_t *bgpd_privs = NULL;
+struct thread_master *master = NULL;
+
+static struct bgp *bgp;
+static as_t asn = 100;
+
+static struct aggr
+{
+  const char *str;
+  u_char summary_only;
+  u_char as_set;
+  struct prefix p;
+  int configured;
+} aggrs[] =
+{
+  { "10.0.0.0/8",  1, 1 },
+  { "10.1.0.0/16", 0, 1 },
+  { "10.2.0.0/16", 1, 0 },
+  { "10.3.0.0/17", 0, 1 },
+};
+#define NAGGRS (sizeof (aggrs) / sizeof (aggrs[0]))
+
+/* A route which may be in the RIB. */
+struct slot
+{
+  struct prefix p;
+  struct bgp_info *ri;
+};
+
+static struct attr *
+random_attr (struct prng *prng)
+{
+  static const as_t asns[] = { 200, 300, 301, 400, 401, 402, 500 };
+  struct attr attr;
+  struct attr *new;
+  char buf[256];
+  int i, n, len;
+
+  memset (&attr, 0, sizeof (struct attr));
+  bgp_attr_extra_get (&attr);
+  attr.origin = prng_rand (prng) % 3;
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_ORIGIN);
+
+  /* Paths mostly share their first hops, sometimes end in a set. */
+  len = snprintf (buf, sizeof (buf), "%u",
+                  prng_rand (prng) % 8 ? 100 : 101);
+  n = prng_rand (prng) % 4;
+  for (i = 0; i < n; i++)
+    len += snprintf (buf + len, sizeof (buf) - len, " %u",
+                     asns[prng_rand (prng) % 7]);
+  if (prng_rand (prng) % 8 == 0)
+    len += snprintf (buf + len, sizeof (buf) - len, " {%u,%u}",
+                     600 + prng_rand (prng) % 3, 603 + prng_rand (prng) % 3);
+  attr.aspath = aspath_str2aspath (buf);
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_AS_PATH);
+
+  n = prng_rand (prng) % 4;
+  if (n)
+    {
+      len = 0;
+      for (i = 0; i < n; i++)
+        len += snprintf (buf + len, sizeof (buf) - len, "%s65000:%u",
+                         i ? " " : "", prng_rand (prng) % 6);
+      attr.community = community_str2com (buf);
+      attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_COMMUNITIES);
+    }
+
+  new = bgp_attr_intern (&attr);
+  bgp_attr_extra_free (&attr);
+  return new;
+}
+
+static void
+route_add (struct slot *slot, struct attr *attr)
+{
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+
+  ri = XCALLOC (MTYPE_BGP_ROUTE, sizeof (struct bgp_info));
+  ri->type = ZEBRA_ROUTE_BGP;
+  ri->sub_type = BGP_ROUTE_NORMAL;
+  ri->peer = bgp->peer_self;
+  ri->attr = attr;
+  SET_FLAG (ri->flags, BGP_INFO_VALID);
+
+  rn = bgp_node_get (bgp->rib[AFI_IP][SAFI_UNICAST], &slot->p);
+  bgp_aggregate_increment (bgp, &slot->p, ri, AFI_IP, SAFI_UNICAST);
+  bgp_info_add (rn, ri);
+  bgp_unlock_node (rn);
+  slot->ri = ri;
+}
+
+static void
+route_withdraw (struct slot *slot)
+{
+  struct bgp_node *rn;
+
+  rn = bgp_node_get (bgp->rib[AFI_IP][SAFI_UNICAST], &slot->p);
+  bgp_aggregate_decrement (bgp, &slot->p, slot->ri, AFI_IP, SAFI_UNICAST);
+  bgp_info_delete (rn, slot->ri);
+  bgp_unlock_node (rn);
+  slot->ri = NULL;
+}
+
+static void
+route_toggle_valid (struct slot *slot)
+{
+  struct bgp_node *rn;
+  struct bgp_info *ri = slot->ri;
+
+  rn = bgp_node_get (bgp->rib[AFI_IP][SAFI_UNICAST], &slot->p);
+  if (CHECK_FLAG (ri->flags, BGP_INFO_VALID))
+    {
+      bgp_aggregate_decrement (bgp, &slot->p, ri, AFI_IP, SAFI_UNICAST);
+      bgp_info_unset_flag (rn, ri, BGP_INFO_VALID);
+    }
+  else
+    {
+      bgp_info_set_flag (rn, ri, BGP_INFO_VALID);
+      bgp_aggregate_increment (bgp, &slot->p, ri, AFI_IP, SAFI_UNICAST);
+    }
+  bgp_unlock_node (rn);
+}
+
+static void
+route_change (struct slot *slot, struct attr *attr)
+{
+  struct bgp_info *ri = slot->ri;
+
+  bgp_aggregate_decrement (bgp, &slot->p, ri, AFI_IP, SAFI_UNICAST);
+  bgp_attr_unintern (&ri->attr);
+  ri->attr = attr;
+  bgp_aggregate_increment (bgp, &slot->p, ri, AFI_IP, SAFI_UNICAST);
+}
+
+/* The aggregate route attribute as a walk over the subtree makes it,
+ * or NULL if no route is aggregated. */
+static struct attr *
+recompute (struct aggr *aggr)
+{
+  struct bgp_table *table = bgp->rib[AFI_IP][SAFI_UNICAST];
+  struct bgp_node *top;
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+  u_char origin = BGP_ORIGIN_IGP;
+  struct aspath *aspath = NULL;
+  struct aspath *asmerge;
+  struct community *community = NULL;
+  struct community *commerge;
+  unsigned long count = 0;
+
+  top = bgp_node_get (table, &aggr->p);
+  for (rn = bgp_node_get (table, &aggr->p); rn;
+       rn = bgp_route_next_until (rn, top))
+    if (rn->p.prefixlen > aggr->p.prefixlen)
+      for (ri = rn->info; ri; ri = ri->next)
+        {
+          if (BGP_INFO_HOLDDOWN (ri)
+              || CHECK_FLAG (ri->flags, BGP_INFO_REMOVED)
+              || ri->sub_type == BGP_ROUTE_AGGREGATE)
+            continue;
+
+          count++;
+          if (! aggr->as_set)
+            continue;
+
+          if (origin < ri->attr->origin)
+            origin = ri->attr->origin;
+
+          if (aspath)
+            {
+              asmerge = aspath_aggregate (aspath, ri->attr->aspath);
+              aspath_free (aspath);
+              aspath = asmerge;
+            }
+          else
+            aspath = aspath_dup (ri->attr->aspath);
+
+          if (ri->attr->community)
+            {
+              if (community)
+                {
+                  commerge = community_merge (community, ri->attr->community);
+                  community = community_uniq_sort (commerge);
+                  community_free (commerge);
+                }
+              else
+                community = community_dup (ri->attr->community);
+            }
+        }
+  bgp_unlock_node (top);
+
+  if (count == 0)
+    {
+      if (aspath)
+        aspath_free (aspath);
+      if (community)
+        community_free (community);
+      return NULL;
+    }
+  return bgp_attr_aggregate_intern (bgp, origin, aspath, community,
+                                    aggr->as_set);
+}
+
+static struct bgp_info *
+aggregate_route (struct aggr *aggr)
+{
+  struct bgp_node *rn;
+  struct bgp_info *ri = NULL;
+
+  rn = bgp_node_lookup (bgp->rib[AFI_IP][SAFI_UNICAST], &aggr->p);
+  if (! rn)
+    return NULL;
+  for (ri = rn->info; ri; ri = ri->next)
+    if (ri->sub_type == BGP_ROUTE_AGGREGATE
+        && ! CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+      break;
+  bgp_unlock_node (rn);
+  return ri;
+}
+
+static int
+check (struct slot *slots, int nslots, int step)
+{
+  struct attr *attr;
+  struct bgp_info *ri;
+  unsigned int i;
+  int s, suppress, fail = 0;
+
+  for (i = 0; i < NAGGRS; i++)
+    {
+      if (! aggrs[i].configured)
+        continue;
+
+      attr = recompute (&aggrs[i]);
+      ri = aggregate_route (&aggrs[i]);
+      if ((ri ? ri->attr : NULL) != attr)
+        {
+          printf ("step %d: aggregate %s is %s, recomputed %s\n", step,
+                  aggrs[i].str,
+                  ri ? aspath_print (ri->attr->aspath) : "missing",
+                  attr ? aspath_print (attr->aspath) : "missing");
+          fail++;
+        }
+      if (attr)
+        bgp_attr_unintern (&attr);
+    }
+
+  for (s = 0; s < nslots; s++)
+    {
+      ri = slots[s].ri;
+      if (! ri)
+        continue;
+
+      suppress = 0;
+      if (! BGP_INFO_HOLDDOWN (ri))
+        for (i = 0; i < NAGGRS; i++)
+          if (aggrs[i].configured && aggrs[i].summary_only
+              && aggrs[i].p.prefixlen < slots[s].p.prefixlen
+              && prefix_match (&aggrs[i].p, &slots[s].p))
+            suppress++;
+
+      if ((ri->extra ? ri->extra->suppress : 0) != suppress)
+        {
+          printf ("step %d: route %s/%d suppressed %d times, expected %d\n",
+                  step, inet_ntoa (slots[s].p.u.prefix4),
+                  slots[s].p.prefixlen,
+                  ri->extra ? ri->extra->suppress : 0, suppress);
+          fail++;
+        }
+    }
+  return fail;
+}
+
+static void
+aggr_set (struct aggr *aggr)
+{
+  bgp_aggregate_address_set (bgp, &aggr->p, AFI_IP, SAFI_UNICAST,
+                             aggr->summary_only, aggr->as_set);
+  aggr->configured = 1;
+}
+
+static void
+aggr_unset (struct aggr *aggr)
+{
+  bgp_aggregate_address_unset (bgp, &aggr->p, AFI_IP, SAFI_UNICAST);
+  aggr->configured = 0;
+}
+
+static void
+slot_prefix (struct slot *slot, unsigned int n)
+{
+  slot->p.family = AF_INET;
+  slot->p.prefixlen = 24;
+  slot->p.u.prefix4.s_addr = htonl ((10 << 24) | ((n & 0xffff) << 8));
+}
+
+/* Random changes, each checked against the recomputation. */
+static int
+test_changes (struct prng *prng, int changes)
+{
+  struct slot slots[512];
+  int nslots = sizeof (slots) / sizeof (slots[0]);
+  int i, n, fail = 0;
+
+  /* Two paths per prefix, spread over the aggregates. */
+  memset (slots, 0, sizeof (slots));
+  for (i = 0; i < nslots; i++)
+    slot_prefix (&slots[i], (i / 2) % 4 * 256 + (i / 8) * 3);
+
+  for (i = 0; i < (int) NAGGRS; i++)
+    aggr_set (&aggrs[i]);
+
+  for (i = 0; i < changes && fail < 10; i++)
+    {
+      struct slot *slot = &slots[prng_rand (prng) % nslots];
+
+      if (i % 1000 == 999)
+        {
+          n = prng_rand (prng) % NAGGRS;
+          if (aggrs[n].configured)
+            aggr_unset (&aggrs[n]);
+          else
+            aggr_set (&aggrs[n]);
+        }
+      else if (! slot->ri)
+        route_add (slot, random_attr (prng));
+      else
+        switch (prng_rand (prng) % 4)
+          {
+          case 0:
+            route_withdraw (slot);
+            break;
+          case 1:
+            route_toggle_valid (slot);
+            break;
+          default:
+            route_change (slot, random_attr (prng));
+            break;
+          }
+      fail += check (slots, nslots, i);
+    }
+
+  for (i = 0; i < nslots; i++)
+    if (slots[i].ri)
+      route_withdraw (&slots[i]);
+  fail += check (slots, nslots, changes);
+  for (i = 0; i < (int) NAGGRS; i++)
+    if (aggrs[i].configured)
+      aggr_unset (&aggrs[i]);
+
+  printf ("incremental aggregates: %d changes %s\n", changes,
+          fail ? "FAILED" : "OK");
+  return fail;
+}
+
+static unsigned long
+cpu_since (RUSAGE_T *before)
+{
+  RUSAGE_T after;
+  unsigned long cpu;
+
+  thread_getrusage (&after);
+  thread_consumed_time (&after, before, &cpu);
+  return cpu;
+}
+
+/* Route changes under one large as-set aggregate. */
+static void
+bench (struct prng *prng, int changes, int routes)
+{
+  struct slot *slots;
+  struct attr **attrs;
+  struct attr *attr;
+  RUSAGE_T before;
+  unsigned long cpu;
+  int i;
+
+  slots = calloc (routes, sizeof (struct slot));
+  attrs = calloc (changes, sizeof (struct attr *));
+  aggr_set (&aggrs[0]);
+
+  for (i = 0; i < routes; i++)
+    {
+      slot_prefix (&slots[i], i);
+      route_add (&slots[i], random_attr (prng));
+    }
+
+  /* Made in advance so that making them is not timed. */
+  for (i = 0; i < changes; i++)
+    attrs[i] = random_attr (prng);
+
+  thread_getrusage (&before);
+  for (i = 0; i < changes; i++)
+    route_change (&slots[prng_rand (prng) % routes], attrs[i]);
+  cpu = cpu_since (&before);
+  printf ("incremental: %d routes, %.3f usec/change\n", routes,
+          (double) cpu / changes);
+
+  /* The walks this replaces, one as the route goes and one as it comes
+     back, for comparison. */
+  changes = MAX (1, changes / 1000);
+  thread_getrusage (&before);
+  for (i = 0; i < changes * 2; i++)
+    if ((attr = recompute (&aggrs[0])) != NULL)
+      bgp_attr_unintern (&attr);
+  cpu = cpu_since (&before);
+  printf ("recomputation: %d routes, %.3f usec/change\n", routes,
+          (double) cpu / changes);
+
+  for (i = 0; i < routes; i++)
+    route_withdraw (&slots[i]);
+  aggr_unset (&aggrs[0]);
+  free (attrs);
+  free (slots);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct prng *prng;
+  int changes = 20000, routes = 20000;
+  unsigned int i;
+  int fail;
+
+  if (argc > 1)
+    changes = atoi (argv[1]);
+  if (argc > 2)
+    routes = atoi (argv[2]);
+  if (changes <= 0 || routes <= 0 || routes > 65536)
+    {
+      fprintf (stderr, "usage: %s [changes [routes]]\n", argv[0]);
+      exit (1);
+    }
+
+  master = thread_master_create ();
+  bgp_master_init ();
+  bgp_option_set (BGP_OPT_NO_LISTEN);
+  bgp_attr_init ();
+
+  if (bgp_get (&bgp, &asn, NULL))
+    return -1;
+
+  for (i = 0; i < NAGGRS; i++)
+    str2prefix (aggrs[i].str, &aggrs[i].p);
+  prng = prng_new (0);
+
+  fail = test_changes (prng, changes);
+  bench (prng, changes, routes);
+
+  prng_free (prng);
+  return fail;
+}
@@ -0,0 +1,647 @@
+/*
+ * BGP route-server client tests.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Announces and withdraws random paths from route-server clients and
+ * other peers, changes the import and export route-maps of the clients
+ * and turns clients off and on, soft reconfiguring them as an operator
+ * would.  Every so often checks, for each prefix and client, the paths
+ * bgp_rsclient_view gives and the one it selects against applying the
+ * client's policies to each path and selecting among what is left, as
+ * bgpd did in a table of the client's own.  Also checks that a client
+ * turned off leaves nothing in its slot.
+ *
+ *   testbgprsclient [changes [prefixes]]    (default 20000, 200)
+ */
+
+#include <zebra.h>
+
+#include "vty.h"
+#include "stream.h"
+#include "privs.h"
+#include "linklist.h"
+#include "memory.h"
+#include "prefix.h"
+#include "thread.h"
+#include "command.h"
+#include "routemap.h"
+#include "workqueue.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_aspath.h"
+#include "bgpd/bgp_nexthop.h"
+
+#include "prng.h"
+
+/* need these to link in libbgp */
+struct zebra_privs_t *bgpd_privs = NULL;
+struct thread_master *master = NULL;
+
+static struct bgp *bgp;
+static as_t asn = 100;
+
+/* The first NCLIENTS peers may be route-server clients, the others
+   only send paths.  */
+#define NCLIENTS 8
+#define NPEERS   (NCLIENTS + 2)
+static struct peer *peers[NPEERS];
+static int on[NCLIENTS];
+
+#define NATTRS 16
+static struct attr *attrs[NATTRS];
+
+/* What a route-map does: deny paths with a MED, then set the local
+   preference and the MED of the others.  */
+static struct policy
+{
+  const char *name;
+  int deny_med;
+  u_int32_t local_pref;
+  int med;
+  struct route_map *map;
+} policies[] =
+{
+  { NULL,          -1,   0, -1 },
+  { "deny-0",       0,   0, -1 },
+  { "pref-300",    -1, 300, -1 },
+  { "med-3",       -1,   0,  3 },
+  { "deny-1-pref", 1,  50, -1 },
+  { "deny-2-med",   2,   0,  0 },
+  { "pref-med",    -1,  50,  1 },
+  { "deny-3",       3,   0, -1 },
+};
+#define NPOLICIES (sizeof (policies) / sizeof (policies[0]))
+
+static int import[NCLIENTS], export[NCLIENTS];
+
+static struct bgp_table *scratch;
+
+static struct attr *
+make_attr (unsigned int i)
+{
+  struct attr attr;
+  struct attr *new;
+  char buf[64];
+
+  memset (&attr, 0, sizeof (struct attr));
+  bgp_attr_extra_get (&attr);
+  attr.origin = BGP_ORIGIN_IGP;
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_ORIGIN);
+  /* Two neighbour ASes, so that MEDs are not always compared.  */
+  snprintf (buf, sizeof (buf), "%u %u", 200 + (i % 2) * 100, 300 + i);
+  attr.aspath = aspath_str2aspath (buf);
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_AS_PATH);
+  attr.nexthop.s_addr = htonl (0x0a000001);
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_NEXT_HOP);
+  attr.med = (i / 2) % 4;
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_MULTI_EXIT_DISC);
+  attr.local_pref = (i / 8) ? 200 : 100;
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_LOCAL_PREF);
+
+  new = bgp_attr_intern (&attr);
+  bgp_attr_extra_free (&attr);
+  return new;
+}
+
+static struct route_map_index *
+policy_index (struct route_map *map, int pref, enum route_map_type type)
+{
+  struct route_map_index *index;
+
+  index = XCALLOC (MTYPE_TMP, sizeof (struct route_map_index));
+  index->map = map;
+  index->pref = pref;
+  index->type = type;
+  index->prev = map->tail;
+  if (map->tail)
+    map->tail->next = index;
+  else
+    map->head = index;
+  map->tail = index;
+  return index;
+}
+
+/* The route-map of POL, made without the vty.  */
+static struct route_map *
+policy_map (struct policy *pol)
+{
+  struct route_map *map;
+  struct route_map_index *index;
+  char buf[16];
+  int ret = 0;
+
+  map = XCALLOC (MTYPE_TMP, sizeof (struct route_map));
+  map->name = XSTRDUP (MTYPE_TMP, pol->name);
+
+  if (pol->deny_med >= 0)
+    {
+      index = policy_index (map, 10, RMAP_DENY);
+      snprintf (buf, sizeof (buf), "%d", pol->deny_med);
+      ret |= route_map_add_match (index, "metric", buf);
+    }
+  index = policy_index (map, 20, RMAP_PERMIT);
+  if (pol->local_pref)
+    {
+      snprintf (buf, sizeof (buf), "%u", pol->local_pref);
+      ret |= route_map_add_set (index, "local-preference", buf);
+    }
+  if (pol->med >= 0)
+    {
+      snprintf (buf, sizeof (buf), "%d", pol->med);
+      ret |= route_map_add_set (index, "metric", buf);
+    }
+
+  assert (ret == 0);
+  return map;
+}
+
+/* Whether POL denies ATTR, which it changes otherwise.  */
+static int
+policy_apply (struct policy *pol, struct attr *attr)
+{
+  if (! pol->name)
+    return 0;
+  if (pol->deny_med >= 0 && attr->med == (u_int32_t) pol->deny_med)
+    return 1;
+  if (pol->local_pref)
+    {
+      attr->local_pref = pol->local_pref;
+      attr->flag |= ATTR_FLAG_BIT (BGP_ATTR_LOCAL_PREF);
+    }
+  if (pol->med >= 0)
+    {
+      attr->med = pol->med;
+      attr->flag |= ATTR_FLAG_BIT (BGP_ATTR_MULTI_EXIT_DISC);
+    }
+  return 0;
+}
+
+/* A random number below N.  The lowest bit of prng_rand() is always
+   clear.  */
+static unsigned int
+random_below (struct prng *prng, unsigned int n)
+{
+  return (prng_rand (prng) >> 1) % n;
+}
+
+/* Mostly no policy.  */
+static int
+policy_pick (struct prng *prng)
+{
+  unsigned int k = random_below (prng, NPOLICIES * 2);
+
+  return k < NPOLICIES ? (int) k : 0;
+}
+
+static void
+policy_set (struct peer *peer, int direct, int k)
+{
+  struct bgp_filter *filter = &peer->filter[AFI_IP][SAFI_UNICAST];
+
+  if (filter->map[direct].name)
+    free (filter->map[direct].name);
+  filter->map[direct].name = policies[k].name ? strdup (policies[k].name)
+					       : NULL;
+  filter->map[direct].map = policies[k].map;
+}
+
+static int
+peer_index (struct peer *peer)
+{
+  int i;
+
+  for (i = 0; i < NPEERS; i++)
+    if (peers[i] == peer)
+      return i;
+  return -1;
+}
+
+/* What client C sees of ATTR sent by peer S, interned: the export
+   policy of S if it is a client, then the import policy of C.  */
+static struct attr *
+outcome (int c, int s, struct attr *attr)
+{
+  struct attr new;
+  struct attr_extra extra;
+  struct policy *exp;
+  struct policy *imp;
+
+  if (s == c)
+    return NULL;
+
+  exp = &policies[s < NCLIENTS && on[s] ? export[s] : 0];
+  imp = &policies[import[c]];
+  if (! exp->name && ! imp->name)
+    return bgp_attr_intern (attr);
+
+  new.extra = &extra;
+  bgp_attr_dup (&new, attr);
+  if (policy_apply (exp, &new) || policy_apply (imp, &new))
+    return NULL;
+  return bgp_attr_intern (&new);
+}
+
+static void
+client_on (int c)
+{
+  struct peer *peer = peers[c];
+
+  if (! peer_rsclient_active (peer))
+    {
+      peer_lock (peer);
+      peer->rsclient_slot = bgp_rsclient_slot_new (bgp);
+      listnode_add_sort (bgp->rsclient, peer);
+    }
+  peer_af_flag_set (peer, AFI_IP, SAFI_UNICAST, PEER_FLAG_RSERVER_CLIENT);
+  bgp_check_local_routes_rsclient (peer, AFI_IP, SAFI_UNICAST);
+  bgp_soft_reconfig_rsclient (peer, AFI_IP, SAFI_UNICAST);
+  on[c] = 1;
+}
+
+static void
+client_off (int c)
+{
+  struct peer *peer = peers[c];
+
+  peer_af_flag_unset (peer, AFI_IP, SAFI_UNICAST, PEER_FLAG_RSERVER_CLIENT);
+  bgp_clear_rsclient (peer, AFI_IP, SAFI_UNICAST);
+  if (! peer_rsclient_active (peer))
+    {
+      listnode_delete (bgp->rsclient, peer);
+      peer_unlock (peer);
+    }
+  on[c] = 0;
+}
+
+/* What the export policy of a client is applied to changed.  */
+static void
+reconfig_all (void)
+{
+  int c;
+
+  for (c = 0; c < NCLIENTS; c++)
+    if (on[c])
+      bgp_soft_reconfig_rsclient (peers[c], AFI_IP, SAFI_UNICAST);
+}
+
+/* Run the processing of the nodes changed.  */
+static void
+drain (void)
+{
+  struct work_queue *wq[2];
+  struct thread thread;
+  int i;
+
+  wq[0] = bm->process_main_queue;
+  wq[1] = bm->process_rsclient_queue;
+  for (i = 0; i < 2; i++)
+    while (wq[i] && listcount (wq[i]->items))
+      {
+	wq[i]->spec.hold = 0;
+	if (thread_fetch (bm->master, &thread))
+	  thread_call (&thread);
+      }
+}
+
+/* The peer whose path bgp_best_selection picks of the N attributes
+   OUTCOMES of the paths of RN, in a node of their own.  */
+static struct peer *
+ref_select (struct bgp_node *rn, struct attr **outcomes, int n)
+{
+  struct bgp_node *srn;
+  struct bgp_info *ri;
+  struct bgp_info *new;
+  struct bgp_info *next;
+  struct bgp_info **all;
+  struct bgp_info_pair result;
+  struct peer *best;
+  int i;
+
+  all = XMALLOC (MTYPE_TMP, (n + 1) * sizeof (struct bgp_info *));
+  for (i = 0, ri = rn->info; ri; ri = ri->next, i++)
+    all[i] = ri;
+
+  /* In the same order, as it matters without always-compare-med.  */
+  srn = bgp_node_get (scratch, &rn->p);
+  for (i = n - 1; i >= 0; i--)
+    if (outcomes[i])
+      {
+	new = XCALLOC (MTYPE_BGP_ROUTE, sizeof (struct bgp_info));
+	new->type = all[i]->type;
+	new->sub_type = all[i]->sub_type;
+	new->peer = all[i]->peer;
+	new->attr = bgp_attr_intern (outcomes[i]);
+	new->uptime = all[i]->uptime;
+	SET_FLAG (new->flags, BGP_INFO_VALID);
+	bgp_info_add (srn, new);
+      }
+
+  bgp_best_selection (bgp, srn, &bgp->maxpaths[AFI_IP][SAFI_UNICAST],
+		      &result);
+  best = result.new ? result.new->peer : NULL;
+
+  for (ri = srn->info; ri; ri = next)
+    {
+      next = ri->next;
+      bgp_info_delete (srn, ri);
+    }
+  bgp_best_selection (bgp, srn, &bgp->maxpaths[AFI_IP][SAFI_UNICAST],
+		      &result);
+  bgp_unlock_node (srn);
+
+  XFREE (MTYPE_TMP, all);
+  return best;
+}
+
+/* Whether client C sees the paths of RN as the model says.  */
+static int
+check_client (int c, struct bgp_node *rn, int n)
+{
+  struct attr **outcomes;
+  struct bgp_info *ri;
+  struct bgp_info *buf;
+  struct bgp_info *view;
+  struct peer *selected = NULL;
+  int i, fail = 0;
+
+  outcomes = XCALLOC (MTYPE_TMP, (n + 1) * sizeof (struct attr *));
+  for (i = 0, ri = rn->info; ri; ri = ri->next, i++)
+    outcomes[i] = outcome (c, peer_index (ri->peer), ri->attr);
+
+  view = bgp_rsclient_view (peers[c], rn, &buf);
+  for (i = 0, ri = rn->info; ri; ri = ri->next, i++)
+    {
+      if (! outcomes[i])
+	continue;
+      if (! view || view->peer != ri->peer || view->attr != outcomes[i])
+	{
+	  fail = 1;
+	  break;
+	}
+      if (CHECK_FLAG (view->flags, BGP_INFO_SELECTED))
+	selected = view->peer;
+      view = view->next;
+    }
+  if (view)
+    fail = 1;
+  XFREE (MTYPE_TMP, buf);
+
+  if (! fail && selected != ref_select (rn, outcomes, n))
+    fail = 1;
+
+  for (i = 0; i < n; i++)
+    if (outcomes[i])
+      bgp_attr_unintern (&outcomes[i]);
+  XFREE (MTYPE_TMP, outcomes);
+  return fail;
+}
+
+/* Whether the outcomes recorded for RI are only of clients turned on,
+   and are kept as bgp_rsclient_outcome expects.  */
+static int
+check_slots (struct bgp_info *ri)
+{
+  struct bgp_info_rsclient *rsc;
+  u_int32_t used[(NCLIENTS + 31) / 32];
+  unsigned int i;
+  int c;
+
+  rsc = ri->extra ? ri->extra->rsclient : NULL;
+  if (! rsc)
+    return 0;
+
+  memset (used, 0, sizeof (used));
+  for (c = 0; c < NCLIENTS; c++)
+    if (on[c])
+      used[peers[c]->rsclient_slot / 32] |= 1U << (peers[c]->rsclient_slot % 32);
+
+  for (i = 0; i < rsc->denied_words; i++)
+    if (rsc->denied[i] & ~(i < sizeof (used) / sizeof (used[0]) ? used[i] : 0))
+      return 1;
+  for (i = 0; i < rsc->ndelta; i++)
+    if (rsc->delta[i].slot / 32 >= (int) (sizeof (used) / sizeof (used[0]))
+	|| ! (used[rsc->delta[i].slot / 32] & (1U << (rsc->delta[i].slot % 32)))
+	|| rsc->delta[i].attr == ri->attr
+	|| (i && rsc->delta[i - 1].slot >= rsc->delta[i].slot))
+      return 1;
+  return 0;
+}
+
+/* Whether the shared table holds the paths in PATHS, and each client
+   sees them as the model says.  */
+static int
+check (struct prefix *prefixes, struct attr **paths, unsigned int nprefixes)
+{
+  struct bgp_table *table = bgp->rsclient_rib[AFI_IP][SAFI_UNICAST];
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+  unsigned int i;
+  int n, s, c, expected;
+  int fail = 0;
+
+  drain ();
+
+  for (i = 0; i < nprefixes && ! fail; i++)
+    {
+      expected = 0;
+      for (s = 0; s < NPEERS; s++)
+	if (paths[i * NPEERS + s])
+	  expected++;
+
+      rn = bgp_node_lookup (table, &prefixes[i]);
+      if (! rn)
+	{
+	  fail = expected != 0;
+	  continue;
+	}
+
+      n = 0;
+      for (ri = rn->info; ri; ri = ri->next)
+	{
+	  s = peer_index (ri->peer);
+	  if (s < 0 || BGP_INFO_HOLDDOWN (ri)
+	      || paths[i * NPEERS + s] != ri->attr || check_slots (ri))
+	    fail = 1;
+	  n++;
+	}
+      if (n != expected)
+	fail = 1;
+
+      for (c = 0; c < NCLIENTS && ! fail; c++)
+	if (on[c])
+	  fail = check_client (c, rn, n);
+
+      bgp_unlock_node (rn);
+    }
+
+  return fail;
+}
+
+static int
+test_changes (struct prng *prng, int changes, unsigned int nprefixes,
+	      const char *what)
+{
+  struct prefix *prefixes;
+  struct attr **paths;
+  struct attr **path;
+  unsigned int i;
+  int n, s, c, k, clients;
+  int fail = 0;
+
+  prefixes = XCALLOC (MTYPE_TMP, nprefixes * sizeof (struct prefix));
+  paths = XCALLOC (MTYPE_TMP, nprefixes * NPEERS * sizeof (struct attr *));
+  for (i = 0; i < nprefixes; i++)
+    {
+      prefixes[i].family = AF_INET;
+      prefixes[i].prefixlen = 24;
+      prefixes[i].u.val[0] = 10;
+      prefixes[i].u.val[1] = i >> 8;
+      prefixes[i].u.val[2] = i & 0xff;
+    }
+
+  for (n = 0; n < changes && ! fail; n++)
+    {
+      i = random_below (prng, nprefixes);
+      s = random_below (prng, NPEERS);
+      c = random_below (prng, NCLIENTS);
+      path = &paths[i * NPEERS + s];
+
+      switch (random_below (prng, 16))
+	{
+	case 0: case 1: case 2:
+	  bgp_withdraw (peers[s], &prefixes[i], NULL, AFI_IP, SAFI_UNICAST,
+			ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, NULL, NULL);
+	  *path = NULL;
+	  break;
+	case 3:
+	  import[c] = policy_pick (prng);
+	  policy_set (peers[c], RMAP_IMPORT, import[c]);
+	  if (on[c])
+	    bgp_soft_reconfig_rsclient (peers[c], AFI_IP, SAFI_UNICAST);
+	  break;
+	case 4:
+	  export[c] = policy_pick (prng);
+	  policy_set (peers[c], RMAP_EXPORT, export[c]);
+	  reconfig_all ();
+	  break;
+	case 5:
+	  /* Off, as long as another client is left to keep the paths.  */
+	  for (clients = 0, k = 0; k < NCLIENTS; k++)
+	    clients += on[k];
+	  if (! on[c])
+	    client_on (c);
+	  else if (clients > 1)
+	    client_off (c);
+	  reconfig_all ();
+	  break;
+	default:
+	  *path = attrs[random_below (prng, NATTRS)];
+	  bgp_update (peers[s], &prefixes[i], *path, AFI_IP, SAFI_UNICAST,
+		      ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, NULL, NULL, 0);
+	  break;
+	}
+
+      if (n % 199 == 0)
+	fail = check (prefixes, paths, nprefixes);
+    }
+  if (! fail)
+    fail = check (prefixes, paths, nprefixes);
+
+  printf ("%-24s %d changes: %s\n", what, changes, fail ? "FAILED" : "OK");
+
+  for (i = 0; i < nprefixes; i++)
+    for (s = 0; s < NPEERS; s++)
+      if (paths[i * NPEERS + s])
+	bgp_withdraw (peers[s], &prefixes[i], NULL, AFI_IP, SAFI_UNICAST,
+		      ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, NULL, NULL);
+  drain ();
+  XFREE (MTYPE_TMP, prefixes);
+  XFREE (MTYPE_TMP, paths);
+  return fail;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct prng *prng;
+  int changes = 20000, prefixes = 200;
+  unsigned int i;
+  int fail = 0;
+
+  if (argc > 1)
+    changes = atoi (argv[1]);
+  if (argc > 2)
+    prefixes = atoi (argv[2]);
+  if (changes <= 0 || prefixes <= 0 || prefixes > 65536)
+    {
+      fprintf (stderr, "usage: %s [changes [prefixes]]\n", argv[0]);
+      exit (1);
+    }
+
+  master = thread_master_create ();
+  bgp_master_init ();
+  bgp_option_set (BGP_OPT_NO_LISTEN);
+  bgp_option_set (BGP_OPT_NO_FIB);
+  bgp_attr_init ();
+  bgp_address_init ();
+  cmd_init (1);
+  bgp_route_map_init ();
+
+  if (bgp_get (&bgp, &asn, NULL))
+    return -1;
+
+  /* Peers told apart by router-id and address, so that selection does
+     not depend on the order of the paths.  */
+  for (i = 0; i < NPEERS; i++)
+    {
+      peers[i] = peer_create_accept (bgp);
+      peers[i]->as = 64512 + i;
+      peers[i]->remote_id.s_addr = htonl (0x0a000100 + i);
+      peers[i]->su.sin.sin_family = AF_INET;
+      peers[i]->su.sin.sin_addr.s_addr = htonl (0x0a000200 + i);
+      peers[i]->afc[AFI_IP][SAFI_UNICAST] = 1;
+    }
+  for (i = 0; i < NATTRS; i++)
+    attrs[i] = make_attr (i);
+  for (i = 1; i < NPOLICIES; i++)
+    policies[i].map = policy_map (&policies[i]);
+  scratch = bgp_table_init (AFI_IP, SAFI_UNICAST);
+  scratch->type = BGP_TABLE_RSCLIENT;
+
+  prng = prng_new (0);
+  for (i = 0; i < NCLIENTS; i++)
+    {
+      import[i] = policy_pick (prng);
+      policy_set (peers[i], RMAP_IMPORT, import[i]);
+      export[i] = policy_pick (prng);
+      policy_set (peers[i], RMAP_EXPORT, export[i]);
+      client_on (i);
+    }
+
+  fail += test_changes (prng, changes, prefixes, "route-server clients");
+  bgp_flag_set (bgp, BGP_FLAG_DETERMINISTIC_MED);
+  fail += test_changes (prng, changes, prefixes, "deterministic-med");
+
+  prng_free (prng);
+  return fail;
+}
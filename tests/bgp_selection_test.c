@@ -0,0 +1,859 @@
+/*
+ * BGP best path selection tests.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Makes nodes with a path from each of a number of peers, alike enough
+ * that selection often goes deep into the decision process, and checks
+ * that bgp_best_selection picks what comparing the paths as they are,
+ * the way bgpd did before it kept what it compares of each path with
+ * the node, picks, along with as many multipaths.  With and without
+ * deterministic-med and multipath, before and after a path is
+ * selected, and after paths come, go and change.  Then clears the
+ * routes of a peer with paths in IPv4 and IPv6, and checks that the
+ * nodes where its path is selected are queued before any other, and
+ * that clearing selects again without queueing the nodes for another
+ * pass.  Then reports the CPU time per selection of both ways.
+ *
+ *   testbgpselect [nodes [paths [rounds]]]    (default 2000, 30, 20)
+ */
+
+#include <zebra.h>
+
+#include "vty.h"
+#include "stream.h"
+#include "privs.h"
+#include "linklist.h"
+#include "memory.h"
+#include "prefix.h"
+#include "sockunion.h"
+#include "thread.h"
+#include "workqueue.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_aspath.h"
+#include "bgpd/bgp_mpath.h"
+#include "bgpd/bgp_nexthop.h"
+
+#include "prng.h"
+
+/* need these to link in libbgp */
+struct zebra_privs_t *bgpd_privs = NULL;
+struct thread_master *master = NULL;
+
+static struct bgp *bgp;
+static as_t asn = 100;
+
+static struct peer **peers;
+
+static struct bgp_node **rns;
+
+static struct peer *
+make_peer (int i)
+{
+  struct peer *peer;
+
+  peer = XCALLOC (MTYPE_BGP_PEER, sizeof (struct peer));
+  peer->bgp = bgp;
+  peer->lock = 1;
+  if (i % 3 == 0)
+    {
+      peer->as = asn;
+      peer->sort = BGP_PEER_IBGP;
+    }
+  else
+    {
+      peer->as = 200 + i % 4;
+      peer->sort = BGP_PEER_EBGP;
+    }
+  /* Some share a router-ID, down to the neighbour address. */
+  peer->remote_id.s_addr = htonl (0x0a000000 + i / 2);
+  peer->su_remote = XCALLOC (MTYPE_SOCKUNION, sizeof (union sockunion));
+  peer->su_remote->sin.sin_family = AF_INET;
+  peer->su_remote->sin.sin_addr.s_addr = htonl (0xc0a80000 + i);
+  return peer;
+}
+
+static struct attr *
+random_attr (struct prng *prng, struct peer *peer)
+{
+  struct attr attr;
+  struct attr *new;
+  char buf[64];
+  int len, n, i;
+
+  memset (&attr, 0, sizeof (struct attr));
+  bgp_attr_extra_get (&attr);
+  attr.origin = prng_rand (prng) % 4 ? BGP_ORIGIN_IGP : BGP_ORIGIN_INCOMPLETE;
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_ORIGIN);
+
+  if (prng_rand (prng) % 8 == 0)
+    {
+      attr.local_pref = 200;
+      attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_LOCAL_PREF);
+    }
+  if (prng_rand (prng) % 2)
+    {
+      attr.med = prng_rand (prng) % 3;
+      attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_MULTI_EXIT_DISC);
+    }
+
+  /* Neighbour ASes in common, paths of one or two hops.  Internal
+     paths may be of the AS itself. */
+  n = peer->sort == BGP_PEER_IBGP ? prng_rand (prng) % 3 : 1 + prng_rand (prng) % 2;
+  len = 0;
+  buf[0] = '\0';
+  for (i = 0; i < n; i++)
+    len += snprintf (buf + len, sizeof (buf) - len, "%s%u", i ? " " : "",
+                     i == 0 && peer->sort == BGP_PEER_EBGP
+                     ? peer->as : 200 + prng_rand (prng) % 4);
+  attr.aspath = n ? aspath_str2aspath (buf) : aspath_empty ();
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_AS_PATH);
+
+  if (peer->sort == BGP_PEER_IBGP && prng_rand (prng) % 2)
+    {
+      attr.extra->originator_id.s_addr = htonl (0x0a000000
+                                                + prng_rand (prng) % 4);
+      attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_ORIGINATOR_ID);
+    }
+
+  new = bgp_attr_intern (&attr);
+  bgp_attr_extra_free (&attr);
+  return new;
+}
+
+static void
+add_path (struct prng *prng, struct bgp_node *rn, struct peer *peer)
+{
+  struct bgp_info *ri;
+
+  ri = XCALLOC (MTYPE_BGP_ROUTE, sizeof (struct bgp_info));
+  ri->type = ZEBRA_ROUTE_BGP;
+  ri->sub_type = BGP_ROUTE_NORMAL;
+  ri->peer = peer;
+  ri->attr = random_attr (prng, ri->peer);
+  if (ri->peer->sort == BGP_PEER_IBGP)
+    bgp_info_extra_get (ri)->igpmetric = prng_rand (prng) % 2;
+  SET_FLAG (ri->flags, BGP_INFO_VALID);
+  bgp_info_add (rn, ri);
+}
+
+static void
+make_nodes (struct prng *prng, int nodes, int npaths)
+{
+  struct prefix p;
+  int *first;
+  int i, j;
+
+  rns = XCALLOC (MTYPE_TMP, nodes * sizeof (struct bgp_node *));
+  first = XCALLOC (MTYPE_TMP, nodes * sizeof (int));
+  for (i = 0; i < nodes; i++)
+    {
+      memset (&p, 0, sizeof (struct prefix));
+      p.family = AF_INET;
+      p.prefixlen = 24;
+      p.u.prefix4.s_addr = htonl (0x0a000000 + (i << 8));
+      rns[i] = bgp_node_get (bgp->rib[AFI_IP][SAFI_UNICAST], &p);
+      first[i] = prng_rand (prng) % npaths;
+    }
+
+  /* A table at a time, as the peers come up, though each node's paths
+     come in no particular order of peers. */
+  for (j = 0; j < npaths; j++)
+    for (i = 0; i < nodes; i++)
+      add_path (prng, rns[i], peers[(j + first[i]) % npaths]);
+
+  XFREE (MTYPE_TMP, first);
+}
+
+/* For each node a path goes, one changes and one comes back, as if
+   from another peer. */
+static void
+change_nodes (struct prng *prng, int nodes, int npaths)
+{
+  struct bgp_info *ri;
+  struct peer *peer;
+  int i, j;
+
+  for (i = 0; i < nodes; i++)
+    {
+      ri = rns[i]->info;
+      for (j = prng_rand (prng) % npaths; j && ri->next; j--)
+        ri = ri->next;
+      peer = ri->peer;
+      bgp_info_delete (rns[i], ri);
+
+      ri = rns[i]->info;
+      for (j = prng_rand (prng) % npaths; j && ri->next; j--)
+        ri = ri->next;
+      if (! CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+        {
+          bgp_attr_unintern (&ri->attr);
+          ri->attr = random_attr (prng, ri->peer);
+        }
+
+      add_path (prng, rns[i], peer);
+    }
+}
+
+/* Get MED value.  If MED value is missing and "bgp bestpath
+   missing-as-worst" is specified, treat it as the worst value. */
+static u_int32_t
+ref_med_value (struct attr *attr, struct bgp *bgp)
+{
+  if (attr->flag & ATTR_FLAG_BIT (BGP_ATTR_MULTI_EXIT_DISC))
+    return attr->med;
+  else
+    {
+      if (bgp_flag_check (bgp, BGP_FLAG_MED_MISSING_AS_WORST))
+	return BGP_MED_MAX;
+      else
+	return 0;
+    }
+}
+
+/* bgp_info_cmp as it was, comparing the paths as they are. */
+static int
+ref_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist,
+	      int *paths_eq)
+{
+  struct attr *newattr, *existattr;
+  struct attr_extra *newattre, *existattre;
+  bgp_peer_sort_t new_sort;
+  bgp_peer_sort_t exist_sort;
+  u_int32_t new_pref;
+  u_int32_t exist_pref;
+  u_int32_t new_med;
+  u_int32_t exist_med;
+  u_int32_t new_weight;
+  u_int32_t exist_weight;
+  uint32_t newm, existm;
+  struct in_addr new_id;
+  struct in_addr exist_id;
+  int new_cluster;
+  int exist_cluster;
+  int internal_as_route;
+  int confed_as_route;
+  int ret;
+
+  *paths_eq = 0;
+
+  if (new == NULL)
+    return 0;
+  if (exist == NULL)
+    return 1;
+
+  newattr = new->attr;
+  existattr = exist->attr;
+  newattre = newattr->extra;
+  existattre = existattr->extra;
+
+  new_weight = exist_weight = 0;
+  if (newattre)
+    new_weight = newattre->weight;
+  if (existattre)
+    exist_weight = existattre->weight;
+  if (new_weight > exist_weight)
+    return 1;
+  if (new_weight < exist_weight)
+    return 0;
+
+  new_pref = exist_pref = bgp->default_local_pref;
+  if (newattr->flag & ATTR_FLAG_BIT (BGP_ATTR_LOCAL_PREF))
+    new_pref = newattr->local_pref;
+  if (existattr->flag & ATTR_FLAG_BIT (BGP_ATTR_LOCAL_PREF))
+    exist_pref = existattr->local_pref;
+  if (new_pref > exist_pref)
+    return 1;
+  if (new_pref < exist_pref)
+    return 0;
+
+  if (! (new->sub_type == BGP_ROUTE_NORMAL))
+     return 1;
+  if (! (exist->sub_type == BGP_ROUTE_NORMAL))
+     return 0;
+
+  if (! bgp_flag_check (bgp, BGP_FLAG_ASPATH_IGNORE))
+    {
+      int exist_hops = aspath_count_hops (existattr->aspath);
+      int exist_confeds = aspath_count_confeds (existattr->aspath);
+
+      if (bgp_flag_check (bgp, BGP_FLAG_ASPATH_CONFED))
+	{
+	  int aspath_hops;
+
+	  aspath_hops = aspath_count_hops (newattr->aspath);
+          aspath_hops += aspath_count_confeds (newattr->aspath);
+
+	  if ( aspath_hops < (exist_hops + exist_confeds))
+	    return 1;
+	  if ( aspath_hops > (exist_hops + exist_confeds))
+	    return 0;
+	}
+      else
+	{
+	  int newhops = aspath_count_hops (newattr->aspath);
+
+	  if (newhops < exist_hops)
+	    return 1;
+          if (newhops > exist_hops)
+	    return 0;
+	}
+    }
+
+  if (newattr->origin < existattr->origin)
+    return 1;
+  if (newattr->origin > existattr->origin)
+    return 0;
+
+  internal_as_route = (aspath_count_hops (newattr->aspath) == 0
+		      && aspath_count_hops (existattr->aspath) == 0);
+  confed_as_route = (aspath_count_confeds (newattr->aspath) > 0
+		    && aspath_count_confeds (existattr->aspath) > 0
+		    && aspath_count_hops (newattr->aspath) == 0
+		    && aspath_count_hops (existattr->aspath) == 0);
+
+  if (bgp_flag_check (bgp, BGP_FLAG_ALWAYS_COMPARE_MED)
+      || (bgp_flag_check (bgp, BGP_FLAG_MED_CONFED)
+	 && confed_as_route)
+      || aspath_cmp_left (newattr->aspath, existattr->aspath)
+      || aspath_cmp_left_confed (newattr->aspath, existattr->aspath)
+      || internal_as_route)
+    {
+      new_med = ref_med_value (new->attr, bgp);
+      exist_med = ref_med_value (exist->attr, bgp);
+
+      if (new_med < exist_med)
+	return 1;
+      if (new_med > exist_med)
+	return 0;
+    }
+
+  new_sort = new->peer->sort;
+  exist_sort = exist->peer->sort;
+
+  if (new_sort == BGP_PEER_EBGP
+      && (exist_sort == BGP_PEER_IBGP || exist_sort == BGP_PEER_CONFED))
+    return 1;
+  if (exist_sort == BGP_PEER_EBGP
+      && (new_sort == BGP_PEER_IBGP || new_sort == BGP_PEER_CONFED))
+    return 0;
+
+  newm = existm = 0;
+  if (new->extra)
+    newm = new->extra->igpmetric;
+  if (exist->extra)
+    existm = exist->extra->igpmetric;
+  if (newm < existm)
+    return 1;
+  if (newm > existm)
+    return 0;
+
+  if (new->peer->sort == BGP_PEER_IBGP)
+    {
+      if (aspath_cmp (new->attr->aspath, exist->attr->aspath))
+	*paths_eq = 1;
+    }
+  else if (new->peer->as == exist->peer->as)
+    *paths_eq = 1;
+
+  if (! bgp_flag_check (bgp, BGP_FLAG_COMPARE_ROUTER_ID)
+      && new_sort == BGP_PEER_EBGP
+      && exist_sort == BGP_PEER_EBGP)
+    {
+      if (CHECK_FLAG (new->flags, BGP_INFO_SELECTED))
+	return 1;
+      if (CHECK_FLAG (exist->flags, BGP_INFO_SELECTED))
+	return 0;
+    }
+
+  if (newattr->flag & ATTR_FLAG_BIT(BGP_ATTR_ORIGINATOR_ID))
+    new_id.s_addr = newattre->originator_id.s_addr;
+  else
+    new_id.s_addr = new->peer->remote_id.s_addr;
+  if (existattr->flag & ATTR_FLAG_BIT(BGP_ATTR_ORIGINATOR_ID))
+    exist_id.s_addr = existattre->originator_id.s_addr;
+  else
+    exist_id.s_addr = exist->peer->remote_id.s_addr;
+
+  if (ntohl (new_id.s_addr) < ntohl (exist_id.s_addr))
+    return 1;
+  if (ntohl (new_id.s_addr) > ntohl (exist_id.s_addr))
+    return 0;
+
+  new_cluster = exist_cluster = 0;
+  if (newattr->flag & ATTR_FLAG_BIT(BGP_ATTR_CLUSTER_LIST))
+    new_cluster = newattre->cluster->length;
+  if (existattr->flag & ATTR_FLAG_BIT(BGP_ATTR_CLUSTER_LIST))
+    exist_cluster = existattre->cluster->length;
+  if (new_cluster < exist_cluster)
+    return 1;
+  if (new_cluster > exist_cluster)
+    return 0;
+
+  ret = sockunion_cmp (new->peer->su_remote, exist->peer->su_remote);
+  if (ret == 1)
+    return 0;
+  if (ret == -1)
+    return 1;
+
+  return 1;
+}
+
+/* bgp_best_selection as it was, comparing the paths as they are;
+   without reaping, the paths made here are never removed. */
+static struct bgp_info *
+ref_select (int node)
+{
+  struct bgp_node *rn = rns[node];
+  struct bgp_maxpaths_cfg *mpath_cfg = &bgp->maxpaths[AFI_IP][SAFI_UNICAST];
+  struct bgp_info *new_select;
+  struct bgp_info *old_select;
+  struct bgp_info *ri;
+  struct bgp_info *ri1;
+  struct bgp_info *ri2;
+  int paths_eq, do_mpath;
+  struct list mp_list;
+
+  bgp_mp_list_init (&mp_list);
+  do_mpath = (mpath_cfg->maxpaths_ebgp != BGP_DEFAULT_MAXPATHS ||
+	      mpath_cfg->maxpaths_ibgp != BGP_DEFAULT_MAXPATHS);
+
+  new_select = NULL;
+  if (bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
+    for (ri1 = rn->info; ri1; ri1 = ri1->next)
+      {
+	if (CHECK_FLAG (ri1->flags, BGP_INFO_DMED_CHECK))
+	  continue;
+	if (BGP_INFO_HOLDDOWN (ri1))
+	  continue;
+
+	new_select = ri1;
+	if (do_mpath)
+	  bgp_mp_list_add (&mp_list, ri1);
+	old_select = CHECK_FLAG (ri1->flags, BGP_INFO_SELECTED) ? ri1 : NULL;
+	if (ri1->next)
+	  for (ri2 = ri1->next; ri2; ri2 = ri2->next)
+	    {
+	      if (CHECK_FLAG (ri2->flags, BGP_INFO_DMED_CHECK))
+		continue;
+	      if (BGP_INFO_HOLDDOWN (ri2))
+		continue;
+
+	      if (aspath_cmp_left (ri1->attr->aspath, ri2->attr->aspath)
+		  || aspath_cmp_left_confed (ri1->attr->aspath,
+					     ri2->attr->aspath))
+		{
+		  if (CHECK_FLAG (ri2->flags, BGP_INFO_SELECTED))
+		    old_select = ri2;
+		  if (ref_info_cmp (bgp, ri2, new_select, &paths_eq))
+		    {
+		      bgp_info_unset_flag (rn, new_select, BGP_INFO_DMED_SELECTED);
+		      new_select = ri2;
+		      if (do_mpath && !paths_eq)
+			{
+			  bgp_mp_list_clear (&mp_list);
+			  bgp_mp_list_add (&mp_list, ri2);
+			}
+		    }
+
+		  if (do_mpath && paths_eq)
+		    bgp_mp_list_add (&mp_list, ri2);
+
+		  bgp_info_set_flag (rn, ri2, BGP_INFO_DMED_CHECK);
+		}
+	    }
+	bgp_info_set_flag (rn, new_select, BGP_INFO_DMED_CHECK);
+	bgp_info_set_flag (rn, new_select, BGP_INFO_DMED_SELECTED);
+
+	bgp_info_mpath_update (rn, new_select, old_select, &mp_list, mpath_cfg);
+	bgp_mp_list_clear (&mp_list);
+      }
+
+  old_select = NULL;
+  new_select = NULL;
+  for (ri = rn->info; ri; ri = ri->next)
+    {
+      if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED))
+	old_select = ri;
+
+      if (BGP_INFO_HOLDDOWN (ri))
+	continue;
+
+      if (bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED)
+          && (! CHECK_FLAG (ri->flags, BGP_INFO_DMED_SELECTED)))
+	{
+	  bgp_info_unset_flag (rn, ri, BGP_INFO_DMED_CHECK);
+	  continue;
+        }
+      bgp_info_unset_flag (rn, ri, BGP_INFO_DMED_CHECK);
+      bgp_info_unset_flag (rn, ri, BGP_INFO_DMED_SELECTED);
+
+      if (ref_info_cmp (bgp, ri, new_select, &paths_eq))
+	{
+	  if (do_mpath && bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
+	    bgp_mp_dmed_deselect (new_select);
+
+	  new_select = ri;
+
+	  if (do_mpath && !paths_eq)
+	    {
+	      bgp_mp_list_clear (&mp_list);
+	      bgp_mp_list_add (&mp_list, ri);
+	    }
+	}
+      else if (do_mpath && bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
+	bgp_mp_dmed_deselect (ri);
+
+      if (do_mpath && paths_eq)
+	bgp_mp_list_add (&mp_list, ri);
+    }
+
+  if (!bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
+    bgp_info_mpath_update (rn, new_select, old_select, &mp_list, mpath_cfg);
+
+  bgp_info_mpath_aggregate_update (new_select, old_select);
+  bgp_mp_list_clear (&mp_list);
+
+  return new_select;
+}
+
+static struct bgp_info *
+node_select (int i)
+{
+  struct bgp_info_pair result;
+
+  bgp_best_selection (bgp, rns[i], &bgp->maxpaths[AFI_IP][SAFI_UNICAST],
+                      &result);
+  return result.new;
+}
+
+static int
+check (int nodes, int npaths, const char *what)
+{
+  struct bgp_info *ref, *best;
+  u_int32_t ref_mpaths;
+  int i, fail = 0;
+
+  for (i = 0; i < nodes; i++)
+    {
+      ref = ref_select (i);
+      ref_mpaths = ref ? bgp_info_mpath_count (ref) : 0;
+      best = node_select (i);
+      if (best != ref || (best && bgp_info_mpath_count (best) != ref_mpaths))
+        fail++;
+    }
+  printf ("%-32s %d nodes: %s\n", what, nodes, fail ? "FAILED" : "OK");
+  return fail;
+}
+
+/* Mark the best path of each node selected, as bgp_process does. */
+static void
+select_all (int nodes)
+{
+  struct bgp_info *best;
+  struct bgp_info *ri;
+  int i;
+
+  for (i = 0; i < nodes; i++)
+    {
+      best = ref_select (i);
+      for (ri = rns[i]->info; ri; ri = ri->next)
+        UNSET_FLAG (ri->flags, BGP_INFO_SELECTED);
+      if (best)
+        SET_FLAG (best->flags, BGP_INFO_SELECTED);
+    }
+}
+
+/* A peer whose routes go through bgp_update, and may be cleared. */
+static struct peer *
+clear_peer (int i)
+{
+  struct peer *peer;
+  char buf[32];
+
+  peer = peer_create_accept (bgp);
+  snprintf (buf, sizeof (buf), "clear peer %d", i);
+  peer->host = XSTRDUP (MTYPE_BGP_PEER_HOST, buf);
+  peer->as = 64512 + i;
+  peer->remote_id.s_addr = htonl (0x0b000000 + i);
+  peer->su.sin.sin_family = AF_INET;
+  peer->su.sin.sin_addr.s_addr = htonl (0xc0a90000 + i);
+  peer->afc[AFI_IP][SAFI_UNICAST] = 1;
+  peer->afc[AFI_IP6][SAFI_UNICAST] = 1;
+  return peer;
+}
+
+static struct attr *
+pref_attr (u_int32_t local_pref)
+{
+  struct attr attr;
+  struct attr *new;
+
+  memset (&attr, 0, sizeof (struct attr));
+  bgp_attr_extra_get (&attr);
+  attr.origin = BGP_ORIGIN_IGP;
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_ORIGIN);
+  attr.aspath = aspath_str2aspath ("200");
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_AS_PATH);
+  attr.nexthop.s_addr = htonl (0x0a000001);
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_NEXT_HOP);
+  attr.local_pref = local_pref;
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_LOCAL_PREF);
+
+  new = bgp_attr_intern (&attr);
+  bgp_attr_extra_free (&attr);
+  return new;
+}
+
+/* Prefix I of the clearing test, of IPv4 for the first NODES, and of
+   IPv6 for the next.  */
+static afi_t
+clear_prefix (struct prefix *p, int i, int nodes)
+{
+  memset (p, 0, sizeof (struct prefix));
+  if (i < nodes)
+    {
+      p->family = AF_INET;
+      p->prefixlen = 24;
+      p->u.prefix4.s_addr = htonl (0x14000000 + (i << 8));
+      return AFI_IP;
+    }
+  i -= nodes;
+  p->family = AF_INET6;
+  p->prefixlen = 48;
+  p->u.prefix6.s6_addr[0] = 0x20;
+  p->u.prefix6.s6_addr[1] = 0x01;
+  p->u.prefix6.s6_addr[4] = i >> 8;
+  p->u.prefix6.s6_addr[5] = i & 0xff;
+  return AFI_IP6;
+}
+
+/* Run WQ until it is empty. */
+static void
+run_queue (struct work_queue *wq)
+{
+  struct thread thread;
+
+  while (wq && listcount (wq->items))
+    {
+      wq->spec.hold = 0;
+      if (thread_fetch (bm->master, &thread))
+        thread_call (&thread);
+    }
+}
+
+static int
+test_clear (int nodes)
+{
+  struct peer *cleared, *other;
+  struct attr *better, *mid, *worse;
+  struct work_queue_item *item;
+  struct bgp_clear_node_queue *cnq;
+  struct listnode *node;
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+  struct prefix p;
+  afi_t afi;
+  int i, n = 0, nselected = 0, unselected = 0;
+  int fail_order = 0, fail_pass = 0;
+
+  cleared = clear_peer (1);
+  other = clear_peer (2);
+  better = pref_attr (200);
+  mid = pref_attr (150);
+  worse = pref_attr (100);
+
+  /* The cleared peer's path is selected on every other node.  */
+  for (i = 0; i < 2 * nodes; i++)
+    {
+      afi = clear_prefix (&p, i, nodes);
+      bgp_update (cleared, &p, i % 2 ? worse : better, afi, SAFI_UNICAST,
+                  ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, NULL, NULL, 0);
+      bgp_update (other, &p, mid, afi, SAFI_UNICAST,
+                  ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, NULL, NULL, 0);
+    }
+  run_queue (bm->process_main_queue);
+
+  /* Nodes where the path is selected, of both families, first.  */
+  bgp_clear_route_all (cleared);
+  for (ALL_LIST_ELEMENTS_RO (cleared->clear_node_queue->items, node, item))
+    {
+      cnq = item->data;
+      for (ri = cnq->rn->info; ri && ri->peer != cleared; ri = ri->next)
+        ;
+      if (ri && CHECK_FLAG (ri->flags, BGP_INFO_SELECTED))
+        {
+          nselected++;
+          if (unselected)
+            fail_order++;
+        }
+      else
+        unselected = 1;
+      n++;
+    }
+  if (n != 2 * nodes || nselected != nodes)
+    fail_order++;
+  printf ("%-32s %d nodes: %s\n", "cleared selected first", 2 * nodes,
+          fail_order ? "FAILED" : "OK");
+
+  /* What process_main_queue would be given stays there.  */
+  bm->process_main_queue->spec.hold = 60000;
+  run_queue (cleared->clear_node_queue);
+  if (listcount (bm->process_main_queue->items))
+    fail_pass++;
+  for (i = 0; i < 2 * nodes; i++)
+    {
+      afi = clear_prefix (&p, i, nodes);
+      rn = bgp_node_lookup (bgp->rib[afi][SAFI_UNICAST], &p);
+      if (rn == NULL)
+        {
+          fail_pass++;
+          continue;
+        }
+      ri = rn->info;
+      if (ri == NULL || ri->next || ri->peer != other
+          || ! CHECK_FLAG (ri->flags, BGP_INFO_SELECTED))
+        fail_pass++;
+      bgp_unlock_node (rn);
+    }
+  printf ("%-32s %d nodes: %s\n", "cleared in one pass", 2 * nodes,
+          fail_pass ? "FAILED" : "OK");
+  run_queue (bm->process_main_queue);
+
+  bgp_attr_unintern (&better);
+  bgp_attr_unintern (&mid);
+  bgp_attr_unintern (&worse);
+  return fail_order + fail_pass;
+}
+
+static unsigned long
+cpu_since (RUSAGE_T *before)
+{
+  RUSAGE_T after;
+  unsigned long cpu;
+
+  thread_getrusage (&after);
+  thread_consumed_time (&after, before, &cpu);
+  return cpu;
+}
+
+static void
+bench (int nodes, int npaths, int rounds)
+{
+  RUSAGE_T before;
+  unsigned long cpu;
+  int r, i;
+
+  thread_getrusage (&before);
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < nodes; i++)
+      node_select (i);
+  cpu = cpu_since (&before);
+  printf ("bgp_best_selection: %d paths, %.3f usec/node\n", npaths,
+          (double) cpu / rounds / nodes);
+
+  thread_getrusage (&before);
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < nodes; i++)
+      ref_select (i);
+  cpu = cpu_since (&before);
+  printf ("comparing paths as they are: %d paths, %.3f usec/node\n", npaths,
+          (double) cpu / rounds / nodes);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct prng *prng;
+  int nodes = 2000, npaths = 30, rounds = 20;
+  int i, fail = 0;
+
+  if (argc > 1)
+    nodes = atoi (argv[1]);
+  if (argc > 2)
+    npaths = atoi (argv[2]);
+  if (argc > 3)
+    rounds = atoi (argv[3]);
+  if (nodes <= 0 || nodes > 65536 || npaths <= 0 || rounds <= 0)
+    {
+      fprintf (stderr, "usage: %s [nodes [paths [rounds]]]\n", argv[0]);
+      exit (1);
+    }
+
+  master = thread_master_create ();
+  bgp_master_init ();
+  bgp_option_set (BGP_OPT_NO_LISTEN);
+  bgp_option_set (BGP_OPT_NO_FIB);
+  bgp_attr_init ();
+  bgp_address_init ();
+
+  if (bgp_get (&bgp, &asn, NULL))
+    return -1;
+
+  prng = prng_new (0);
+  peers = XCALLOC (MTYPE_TMP, npaths * sizeof (struct peer *));
+  for (i = 0; i < npaths; i++)
+    peers[i] = make_peer (i);
+  make_nodes (prng, nodes, npaths);
+
+  fail += check (nodes, npaths, "none selected");
+  select_all (nodes);
+  fail += check (nodes, npaths, "one selected");
+
+  bgp_flag_set (bgp, BGP_FLAG_DETERMINISTIC_MED);
+  fail += check (nodes, npaths, "deterministic-med");
+  bgp_flag_set (bgp, BGP_FLAG_MED_MISSING_AS_WORST);
+  bgp_flag_set (bgp, BGP_FLAG_COMPARE_ROUTER_ID);
+  fail += check (nodes, npaths, "missing-as-worst compare-routerid");
+  bgp_flag_unset (bgp, BGP_FLAG_DETERMINISTIC_MED);
+  bgp_flag_set (bgp, BGP_FLAG_ALWAYS_COMPARE_MED);
+  fail += check (nodes, npaths, "always-compare-med");
+  bgp_flag_unset (bgp, BGP_FLAG_ALWAYS_COMPARE_MED);
+  bgp_flag_unset (bgp, BGP_FLAG_MED_MISSING_AS_WORST);
+  bgp_flag_unset (bgp, BGP_FLAG_COMPARE_ROUTER_ID);
+
+  bgp->maxpaths[AFI_IP][SAFI_UNICAST].maxpaths_ebgp = 4;
+  bgp->maxpaths[AFI_IP][SAFI_UNICAST].maxpaths_ibgp = 4;
+  fail += check (nodes, npaths, "maximum-paths 4");
+  bgp_flag_set (bgp, BGP_FLAG_DETERMINISTIC_MED);
+  fail += check (nodes, npaths, "maximum-paths 4 deterministic-med");
+  bgp_flag_unset (bgp, BGP_FLAG_DETERMINISTIC_MED);
+  bgp->maxpaths[AFI_IP][SAFI_UNICAST].maxpaths_ebgp = BGP_DEFAULT_MAXPATHS;
+  bgp->maxpaths[AFI_IP][SAFI_UNICAST].maxpaths_ibgp = BGP_DEFAULT_MAXPATHS;
+
+  /* The removed paths go at the first selection after. */
+  change_nodes (prng, nodes, npaths);
+  fail += check (nodes, npaths, "paths changed");
+  select_all (nodes);
+  change_nodes (prng, nodes, npaths);
+  bgp_flag_set (bgp, BGP_FLAG_DETERMINISTIC_MED);
+  fail += check (nodes, npaths, "paths changed deterministic-med");
+  bgp_flag_unset (bgp, BGP_FLAG_DETERMINISTIC_MED);
+
+  fail += test_clear (nodes);
+
+  bench (nodes, npaths, rounds);
+
+  prng_free (prng);
+  return fail != 0;
+}
@@ -0,0 +1,488 @@
+/*
+ * isisd LSP database tests.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Fills a level 2 LSP database, checks lsp_search() against the
+ * ordered dict while LSPs are deleted, then checks that the CSNPs
+ * sent for the database list every LSP once, in order, and reports
+ * the CPU time per lookup and per complete set of CSNPs.
+ *
+ * Also checks that the TLV view walks the same items parse_tlvs()
+ * puts in lists, on random TLVs, and compares their CPU time.
+ *
+ *   testisislsp [lsps [lookups]]    (default 10000, 1000000)
+ */
+
+#include <zebra.h>
+
+#include "thread.h"
+#include "memory.h"
+#include "linklist.h"
+#include "stream.h"
+#include "hash.h"
+#include "vty.h"
+#include "if.h"
+#include "log.h"
+
+#include "isisd/dict.h"
+#include "isisd/isis_constants.h"
+#include "isisd/isis_common.h"
+#include "isisd/isis_flags.h"
+#include "isisd/isis_circuit.h"
+#include "isisd/isisd.h"
+#include "isisd/isis_tlv.h"
+#include "isisd/isis_lsp.h"
+#include "isisd/isis_pdu.h"
+#include "isisd/isis_network.h"
+
+#include "prng.h"
+
+/* Globals normally provided by isis_main.c. */
+struct thread_master *master;
+
+/* No circuit is brought up, so no socket is opened. */
+int
+isis_sock_init (struct isis_circuit *circuit)
+{
+  return ISIS_ERROR;
+}
+
+#define LSP_ID_LEN (ISIS_SYS_ID_LEN + 2)
+#define CSNP_ENTRIES_OFFSET \
+  (ISIS_FIXED_HDR_LEN + ISIS_CSNP_HDRLEN)
+
+/* IDs looked up by the benchmark, made in advance so that the random
+ * number generator is not timed. */
+#define BENCH_KEYS 65536
+static u_char bench_keys[BENCH_KEYS][ISIS_SYS_ID_LEN + 2];
+
+static void
+bench_id (u_char *id, unsigned int k)
+{
+  memset (id, 0, LSP_ID_LEN);
+  id[0] = 0x19;
+  id[2] = k >> 24;
+  id[3] = k >> 16;
+  id[4] = k >> 8;
+  id[5] = k;
+  /* A few pseudonode LSPs. */
+  id[ISIS_SYS_ID_LEN] = (k % 16 == 0) ? 1 : 0;
+}
+
+static void
+bench_insert (struct isis_area *area, dict_t *lspdb, unsigned int k)
+{
+  struct isis_lsp *lsp;
+  u_char id[LSP_ID_LEN];
+
+  bench_id (id, k);
+  lsp = lsp_new (id, 1200, 1, IS_LEVEL_2, 0, IS_LEVEL_2);
+  lsp->area = area;
+  lsp_insert (lsp, lspdb);
+}
+
+/* State of the CSNP walk checked by bench_tx(). */
+static u_char csnp_last[LSP_ID_LEN];
+static unsigned long csnp_entries, csnp_pdus, csnp_errors;
+
+static int
+bench_tx (struct isis_circuit *circuit, int level)
+{
+  struct stream *s = circuit->snd_stream;
+  size_t pos = CSNP_ENTRIES_OFFSET;
+  u_char *data = STREAM_DATA (s);
+
+  csnp_pdus++;
+  while (pos + 2 <= stream_get_endp (s))
+    {
+      u_char type = data[pos], len = data[pos + 1];
+      size_t i;
+
+      if (type == LSP_ENTRIES)
+        for (i = 0; i + LSP_ENTRIES_LEN <= len; i += LSP_ENTRIES_LEN)
+          {
+            u_char *id = data + pos + 2 + i + 2;
+
+            if (csnp_entries && memcmp (id, csnp_last, LSP_ID_LEN) <= 0)
+              csnp_errors++;
+            memcpy (csnp_last, id, LSP_ID_LEN);
+            csnp_entries++;
+          }
+      pos += 2 + len;
+    }
+  return ISIS_OK;
+}
+
+static int
+send_all_csnps (struct isis_circuit *circuit)
+{
+  csnp_entries = csnp_pdus = csnp_errors = 0;
+  return send_csnp (circuit, IS_LEVEL_2);
+}
+
+static int
+check (struct prng *prng, dict_t *lspdb, int nlsps, char *present,
+       const char *what)
+{
+  u_char id[LSP_ID_LEN];
+  struct isis_lsp *lsp;
+  dnode_t *dnode;
+  int i, fail = 0;
+
+  for (i = 0; i < nlsps * 2; i++)
+    {
+      bench_id (id, prng_rand (prng) % (nlsps + nlsps / 8));
+      lsp = lsp_search (id, lspdb);
+      dnode = dict_lookup (lspdb, id);
+      if (lsp != (dnode ? dnode_get (dnode) : NULL))
+        fail++;
+      if (lsp && memcmp (lsp->lsp_header->lsp_id, id, LSP_ID_LEN))
+        fail++;
+    }
+  for (i = 0; i < nlsps; i++)
+    {
+      bench_id (id, i);
+      if ((lsp_search (id, lspdb) != NULL) != present[i])
+        fail++;
+    }
+  if (((struct hash *) lspdb->dict_context)->count != dict_count (lspdb))
+    fail++;
+  printf ("%s: %s\n", what, fail ? "FAILED" : "OK");
+  return fail;
+}
+
+/* Random TLVs of the types the view walks.  Items fit in their TLV,
+ * but some prefix lengths are out of range and the last TLV may
+ * overrun the buffer. */
+static int
+make_tlvs (struct prng *prng, u_char *buf, int size)
+{
+  static const u_char types[] =
+    { AREA_ADDRESSES, IS_NEIGHBOURS, TE_IS_NEIGHBOURS, LSP_ENTRIES,
+      IPV4_ADDR, IPV4_INT_REACHABILITY, IPV4_EXT_REACHABILITY,
+      TE_IPV4_REACHABILITY,
+#ifdef HAVE_IPV6
+      IPV6_ADDR, IPV6_REACHABILITY,
+#endif /* HAVE_IPV6 */
+    };
+  u_char *pnt = buf, *tlv = NULL;
+  int i, len, plen;
+
+  while (pnt + 2 + 255 <= buf + size)
+    {
+      tlv = pnt;
+      tlv[0] = types[prng_rand (prng) % sizeof (types)];
+      pnt += 2;
+      if (tlv[0] == IS_NEIGHBOURS)
+        *pnt++ = 0;
+      for (i = prng_rand (prng) % 12; i > 0; i--)
+        {
+          switch (tlv[0])
+            {
+            case AREA_ADDRESSES:
+              len = 1 + prng_rand (prng) % 13;
+              pnt[0] = len - 1;
+              break;
+            case IS_NEIGHBOURS:
+              len = IS_NEIGHBOURS_LEN;
+              break;
+            case TE_IS_NEIGHBOURS:
+              len = 11 + prng_rand (prng) % 8;
+              pnt[10] = len - 11;
+              break;
+            case LSP_ENTRIES:
+              len = LSP_ENTRIES_LEN;
+              break;
+            case IPV4_ADDR:
+              len = 4;
+              break;
+            case IPV4_INT_REACHABILITY:
+            case IPV4_EXT_REACHABILITY:
+              len = IPV4_REACH_LEN;
+              break;
+            case TE_IPV4_REACHABILITY:
+              plen = prng_rand (prng) % 36;
+              pnt[4] = plen;
+              len = 5 + PSIZE (plen > 32 ? 0 : plen);
+              break;
+            case IPV6_ADDR:
+              len = 16;
+              break;
+            default:
+              plen = prng_rand (prng) % 136;
+              pnt[5] = plen;
+              len = 6 + PSIZE (plen > 128 ? 0 : plen);
+              break;
+            }
+          if (pnt + len > tlv + 2 + 255)
+            break;
+          pnt += len;
+        }
+      tlv[1] = pnt - tlv - 2;
+    }
+  if (tlv && prng_rand (prng) % 4 == 0)
+    tlv[1] = 255;
+  return pnt - buf;
+}
+
+static int
+same_items (const struct tlv_view *view, u_char type, struct list *list)
+{
+  struct tlv_iter iter;
+  struct listnode *node = list ? listhead (list) : NULL;
+  void *item;
+
+  for (ALL_TLV_ITEMS (view, iter, type, item))
+    {
+      if (! node || listgetdata (node) != item)
+        return 0;
+      node = listnextnode (node);
+    }
+  return node == NULL;
+}
+
+static int
+check_view (struct prng *prng, int rounds)
+{
+  u_char buf[4096];
+  struct tlv_view view;
+  struct tlvs tlvs;
+  u_int32_t expected, found;
+  int i, len, fail = 0;
+
+  for (i = 0; i < rounds; i++)
+    {
+      len = make_tlvs (prng, buf, 512 + prng_rand (prng) % 3584);
+      expected = 0xffffffff;
+      parse_tlvs ("test", buf, len, &expected, &found, &tlvs, NULL);
+      tlv_view_init (&view, buf, len);
+      if (! same_items (&view, AREA_ADDRESSES, tlvs.area_addrs)
+          || ! same_items (&view, IS_NEIGHBOURS, tlvs.is_neighs)
+          || ! same_items (&view, TE_IS_NEIGHBOURS, tlvs.te_is_neighs)
+          || ! same_items (&view, LSP_ENTRIES, tlvs.lsp_entries)
+          || ! same_items (&view, IPV4_ADDR, tlvs.ipv4_addrs)
+          || ! same_items (&view, IPV4_INT_REACHABILITY, tlvs.ipv4_int_reachs)
+          || ! same_items (&view, IPV4_EXT_REACHABILITY, tlvs.ipv4_ext_reachs)
+          || ! same_items (&view, TE_IPV4_REACHABILITY, tlvs.te_ipv4_reachs))
+        fail++;
+#ifdef HAVE_IPV6
+      if (! same_items (&view, IPV6_ADDR, tlvs.ipv6_addrs)
+          || ! same_items (&view, IPV6_REACHABILITY, tlvs.ipv6_reachs))
+        fail++;
+#endif /* HAVE_IPV6 */
+      free_tlvs (&tlvs);
+    }
+  printf ("tlv view: %s\n", fail ? "FAILED" : "OK");
+  return fail;
+}
+
+static unsigned long
+cpu_since (RUSAGE_T *before)
+{
+  RUSAGE_T after;
+  unsigned long cpu;
+
+  thread_getrusage (&after);
+  thread_consumed_time (&after, before, &cpu);
+  return cpu;
+}
+
+/* Reading the reachability of a full size LSP, as SPF does. */
+static void
+bench_view (struct prng *prng, int rounds)
+{
+  u_char buf[1470];
+  struct tlv_view view;
+  struct tlv_iter iter;
+  struct tlvs tlvs;
+  struct listnode *node;
+  struct ipv4_reachability *ipreach;
+  u_int32_t expected, found, sum = 0;
+  RUSAGE_T before;
+  unsigned long cpu;
+  int i, len, items = 0;
+
+  /* One TLV of 21 prefixes after another. */
+  for (len = 0; len + 2 + 21 * IPV4_REACH_LEN <= (int) sizeof (buf);
+       len += 2 + 21 * IPV4_REACH_LEN)
+    {
+      buf[len] = IPV4_INT_REACHABILITY;
+      buf[len + 1] = 21 * IPV4_REACH_LEN;
+      for (i = 0; i < 21 * IPV4_REACH_LEN; i++)
+        buf[len + 2 + i] = prng_rand (prng);
+    }
+
+  thread_getrusage (&before);
+  for (i = 0; i < rounds; i++)
+    {
+      expected = TLVFLAG_IPV4_INT_REACHABILITY;
+      parse_tlvs ("bench", buf, len, &expected, &found, &tlvs, NULL);
+      for (ALL_LIST_ELEMENTS_RO (tlvs.ipv4_int_reachs, node, ipreach))
+        {
+          sum += ipreach->metrics.metric_default;
+          items++;
+        }
+      free_tlvs (&tlvs);
+    }
+  cpu = cpu_since (&before);
+  printf ("parse_tlvs: %d prefixes, %.3f usec/LSP\n",
+          items / rounds, (double) cpu / rounds);
+
+  thread_getrusage (&before);
+  for (i = 0; i < rounds; i++)
+    {
+      tlv_view_init (&view, buf, len);
+      for (ALL_TLV_ITEMS (&view, iter, IPV4_INT_REACHABILITY, ipreach))
+        sum += ipreach->metrics.metric_default;
+    }
+  cpu = cpu_since (&before);
+  printf ("tlv view: %.3f usec/LSP\n", (double) cpu / rounds);
+  if (sum == 1)
+    printf ("\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  struct isis_area *area;
+  struct isis_circuit *circuit;
+  struct interface *ifp;
+  struct prng *prng;
+  dict_t *lspdb;
+  u_char id[LSP_ID_LEN];
+  char *present;
+  RUSAGE_T before;
+  unsigned long cpu, found = 0;
+  int nlsps = 10000, nlookups = 1000000;
+  int i, rounds, fail = 0;
+
+  if (argc > 1)
+    nlsps = atoi (argv[1]);
+  if (argc > 2)
+    nlookups = atoi (argv[2]);
+  if (nlsps <= 0 || nlookups <= 0)
+    {
+      fprintf (stderr, "usage: %s [lsps [lookups]]\n", argv[0]);
+      exit (1);
+    }
+
+  /* parse_tlvs() complains about the bad prefix lengths. */
+  zlog_default = openzlog ("testisislsp", ZLOG_NONE,
+                           LOG_CONS | LOG_NDELAY | LOG_PID, LOG_DAEMON);
+  zlog_set_level (NULL, ZLOG_DEST_SYSLOG, ZLOG_DISABLED);
+  zlog_set_level (NULL, ZLOG_DEST_STDOUT, ZLOG_DISABLED);
+  zlog_set_level (NULL, ZLOG_DEST_MONITOR, ZLOG_DISABLED);
+
+  master = thread_master_create ();
+  if_init ();
+  isis_new (0);
+  area = isis_area_create ("bench");
+  lspdb = area->lspdb[1];
+  prng = prng_new (0);
+  present = calloc (nlsps, 1);
+
+  /* Fill the database in random order. */
+  thread_getrusage (&before);
+  for (i = 0; i < nlsps; i++)
+    {
+      unsigned int k = prng_rand (prng) % nlsps;
+
+      if (present[k])
+        continue;
+      bench_insert (area, lspdb, k);
+      present[k] = 1;
+    }
+  for (i = 0; i < nlsps; i++)
+    if (! present[i])
+      {
+        bench_insert (area, lspdb, i);
+        present[i] = 1;
+      }
+  cpu = cpu_since (&before);
+  printf ("fill: %d LSPs, %.3f usec/insert\n", nlsps, (double) cpu / nlsps);
+
+  fail += check (prng, lspdb, nlsps, present, "lookup");
+
+  /* Delete every seventh LSP. */
+  for (i = 0; i < nlsps; i += 7)
+    {
+      bench_id (id, i);
+      lsp_search_and_destroy (id, lspdb);
+      present[i] = 0;
+    }
+  fail += check (prng, lspdb, nlsps, present, "delete");
+  fail += check_view (prng, 20000);
+
+  /* A point-to-point circuit whose CSNPs are checked, not sent. */
+  ifp = if_get_by_name ("bench0");
+  ifp->mtu = 1500;
+  circuit = XCALLOC (MTYPE_ISIS_CIRCUIT, sizeof (struct isis_circuit));
+  circuit->area = area;
+  circuit->interface = ifp;
+  circuit->circ_type = CIRCUIT_T_P2P;
+  circuit->is_type = IS_LEVEL_2;
+  circuit->snd_stream = stream_new (ISO_MTU (circuit));
+  circuit->tx = bench_tx;
+
+  if (send_all_csnps (circuit) != ISIS_OK || csnp_errors
+      || csnp_entries != dict_count (lspdb))
+    fail++;
+  printf ("csnp: %lu entries in %lu PDUs %s\n", csnp_entries, csnp_pdus,
+          (csnp_errors || csnp_entries != dict_count (lspdb))
+            ? "FAILED" : "OK");
+
+  for (i = 0; i < BENCH_KEYS; i++)
+    bench_id (bench_keys[i], prng_rand (prng) % nlsps);
+
+  thread_getrusage (&before);
+  for (i = 0; i < nlookups; i++)
+    found += lsp_search (bench_keys[i % BENCH_KEYS], lspdb) != NULL;
+  cpu = cpu_since (&before);
+  printf ("lsp_search: %.3f usec/lookup\n", (double) cpu / nlookups);
+
+  /* The tree lookup this replaces, for comparison. */
+  thread_getrusage (&before);
+  for (i = 0; i < nlookups; i++)
+    found += dict_lookup (lspdb, bench_keys[i % BENCH_KEYS]) != NULL;
+  cpu = cpu_since (&before);
+  printf ("dict_lookup: %.3f usec/lookup (%lu found)\n",
+          (double) cpu / nlookups, found);
+
+  bench_view (prng, 100000);
+
+  /* The CSNP build is timed on the full database. */
+  for (i = 0; i < nlsps; i += 7)
+    bench_insert (area, lspdb, i);
+
+  rounds = MAX (1, 1000000 / nlsps);
+  thread_getrusage (&before);
+  for (i = 0; i < rounds; i++)
+    send_all_csnps (circuit);
+  cpu = cpu_since (&before);
+  printf ("csnp build: %lu LSPs, %.1f usec per complete set of %lu CSNPs\n",
+          dict_count (lspdb), (double) cpu / rounds, csnp_pdus);
+
+  stream_free (circuit->snd_stream);
+  XFREE (MTYPE_ISIS_CIRCUIT, circuit);
+  lsp_db_destroy (lspdb);
+  prng_free (prng);
+  free (present);
+  return fail;
+}
@@ -0,0 +1,206 @@
+/*
+ * Checksum implementation tests.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Checks every checksum implementation the CPU supports against the
+ * scalar one on random buffers of random length and alignment, then
+ * reports the CPU time per byte of each for in_cksum() and for
+ * fletcher_checksum() on LSA-sized buffers.
+ *
+ *   testchecksumsimd [rounds [megabytes]]   (default 20000, 64)
+ */
+
+#include <zebra.h>
+
+#include "thread.h"
+#include "checksum.h"
+
+#include "prng.h"
+
+struct thread_master *master;
+
+#define MAXLEN 20000
+#define ALIGN  32
+
+static u_char buf[MAXLEN + ALIGN];
+static u_char copy[MAXLEN + ALIGN];
+
+static void
+fill (struct prng *prng, u_char *p, size_t len)
+{
+  unsigned int kind = prng_rand (prng) % 8;
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    switch (kind)
+      {
+      /* All ones, to find lanes that overflow. */
+      case 0:
+        p[i] = 0xff;
+        break;
+      case 1:
+        p[i] = 0;
+        break;
+      default:
+        p[i] = prng_rand (prng);
+        break;
+      }
+}
+
+/* Length to try: around the block, chunk and MODX boundaries, or any. */
+static size_t
+random_len (struct prng *prng)
+{
+  static const size_t edges[] = { 0, 1, 2, 15, 16, 17, 31, 32, 33, 4096, 4102,
+                                  8192, 8204, 12288, MAXLEN };
+  unsigned int r = prng_rand (prng);
+  size_t len;
+
+  if (r % 4)
+    return r / 4 % (MAXLEN + 1);
+  len = edges[r / 4 % (sizeof (edges) / sizeof (edges[0]))];
+  len += (r >> 20) % 5;
+  return MIN (len, MAXLEN) - (len > 2 ? (r >> 24) % 3 : 0);
+}
+
+static int
+check (struct prng *prng, int impl, int rounds)
+{
+  int i, fail = 0;
+
+  for (i = 0; i < rounds; i++)
+    {
+      size_t len = random_len (prng);
+      u_char *p = buf + prng_rand (prng) % ALIGN;
+      u_char *q = copy + (p - buf);
+      u_int16_t offset = FLETCHER_CHECKSUM_VALIDATE;
+      int in_ref, in_got;
+      u_int16_t fl_ref, fl_got;
+
+      fill (prng, p, len);
+      memcpy (q, p, len);
+      if (len > 2 && prng_rand (prng) % 2)
+        offset = prng_rand (prng) % (len - 1);
+
+      checksum_select (CHECKSUM_SCALAR);
+      in_ref = in_cksum (p, len);
+      fl_ref = fletcher_checksum (p, len, offset);
+
+      checksum_select (impl);
+      in_got = in_cksum (q, len);
+      fl_got = fletcher_checksum (q, len, offset);
+
+      if (in_got != in_ref || fl_got != fl_ref || memcmp (p, q, len))
+        {
+          printf ("%s: mismatch at length %zu, alignment %d, offset %u: "
+                  "in_cksum %04x/%04x, fletcher %04x/%04x\n",
+                  checksum_impl_name (impl), len, (int) (p - buf), offset,
+                  in_got, in_ref, fl_got, fl_ref);
+          fail++;
+        }
+      else if (offset != FLETCHER_CHECKSUM_VALIDATE
+               && fletcher_checksum (q, len, FLETCHER_CHECKSUM_VALIDATE) != 0)
+        {
+          printf ("%s: checksum at length %zu does not validate\n",
+                  checksum_impl_name (impl), len);
+          fail++;
+        }
+    }
+  printf ("%s: %d rounds %s\n", checksum_impl_name (impl), rounds,
+          fail ? "FAILED" : "OK");
+  return fail;
+}
+
+static unsigned long
+cpu_since (RUSAGE_T *before)
+{
+  RUSAGE_T after;
+  unsigned long cpu;
+
+  thread_getrusage (&after);
+  thread_consumed_time (&after, before, &cpu);
+  return cpu;
+}
+
+static void
+bench (struct prng *prng, int impl, unsigned long bytes)
+{
+  static const size_t sizes[] = { 64, 1500, 8192 };
+  RUSAGE_T before;
+  unsigned long cpu, done;
+  unsigned int sum = 0;
+  unsigned int i;
+
+  fill (prng, buf, MAXLEN);
+  checksum_select (impl);
+  for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+    {
+      thread_getrusage (&before);
+      for (done = 0; done < bytes; done += sizes[i])
+        sum += in_cksum (buf, sizes[i]);
+      cpu = cpu_since (&before);
+      printf ("%s: in_cksum %5zu bytes: %.3f nsec/byte\n",
+              checksum_impl_name (impl), sizes[i], cpu * 1000.0 / done);
+
+      thread_getrusage (&before);
+      for (done = 0; done < bytes; done += sizes[i])
+        sum += fletcher_checksum (buf, sizes[i], 16);
+      cpu = cpu_since (&before);
+      printf ("%s: fletcher %5zu bytes: %.3f nsec/byte\n",
+              checksum_impl_name (impl), sizes[i], cpu * 1000.0 / done);
+    }
+  if (sum == 1)
+    printf ("\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  struct prng *prng;
+  int rounds = 20000, megabytes = 64;
+  int impl, fail = 0;
+
+  if (argc > 1)
+    rounds = atoi (argv[1]);
+  if (argc > 2)
+    megabytes = atoi (argv[2]);
+  if (rounds <= 0 || megabytes <= 0)
+    {
+      fprintf (stderr, "usage: %s [rounds [megabytes]]\n", argv[0]);
+      exit (1);
+    }
+
+  prng = prng_new (0);
+
+  for (impl = 0; impl < CHECKSUM_IMPL_MAX; impl++)
+    if (checksum_impl_supported (impl))
+      fail += check (prng, impl, rounds);
+    else if (checksum_impl_name (impl))
+      printf ("%s: not supported by this CPU\n", checksum_impl_name (impl));
+
+  for (impl = 0; impl < CHECKSUM_IMPL_MAX; impl++)
+    if (checksum_impl_supported (impl))
+      bench (prng, impl, megabytes * 1024UL * 1024UL);
+
+  printf ("default: %s\n", checksum_impl_name (checksum_select (-1)));
+
+  prng_free (prng);
+  return fail != 0;
+}
@@ -0,0 +1,264 @@
+/*
+ * Interface lookup tests.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Builds a router with many VLAN subinterfaces, each with a /24 and
+ * some with a /30 inside it, then checks if_lookup_by_index(),
+ * if_lookup_by_name() and if_lookup_address() against a walk of
+ * iflist while interfaces are renumbered and deleted, and reports the
+ * CPU time per lookup.
+ *
+ *   testif [interfaces [lookups]]    (default 4000, 1000000)
+ */
+
+#include <zebra.h>
+
+#include "thread.h"
+#include "memory.h"
+#include "linklist.h"
+#include "prefix.h"
+#include "if.h"
+
+#include "prng.h"
+
+struct thread_master *master;
+
+static struct interface *
+walk_by_index (unsigned int index)
+{
+  struct listnode *node;
+  struct interface *ifp;
+
+  for (ALL_LIST_ELEMENTS_RO (iflist, node, ifp))
+    if (ifp->ifindex == index)
+      return ifp;
+  return NULL;
+}
+
+static struct interface *
+walk_by_address (struct in_addr src)
+{
+  struct listnode *node, *cnode;
+  struct interface *ifp, *match = NULL;
+  struct connected *c;
+  struct prefix addr;
+  int bestlen = 0;
+
+  addr.family = AF_INET;
+  addr.u.prefix4 = src;
+  addr.prefixlen = IPV4_MAX_BITLEN;
+
+  for (ALL_LIST_ELEMENTS_RO (iflist, node, ifp))
+    for (ALL_LIST_ELEMENTS_RO (ifp->connected, cnode, c))
+      if (c->address && c->address->family == AF_INET
+          && prefix_match (CONNECTED_PREFIX (c), &addr)
+          && c->address->prefixlen > bestlen)
+        {
+          bestlen = c->address->prefixlen;
+          match = ifp;
+        }
+  return match;
+}
+
+static void
+add_address (struct interface *ifp, u_int32_t addr, int plen)
+{
+  struct prefix p;
+
+  memset (&p, 0, sizeof (p));
+  p.family = AF_INET;
+  p.prefixlen = plen;
+  p.u.prefix4.s_addr = htonl (addr);
+  connected_add_by_prefix (ifp, &p, NULL);
+}
+
+static void
+make_vlan (int i)
+{
+  struct interface *ifp;
+  char name[INTERFACE_NAMSIZ];
+
+  snprintf (name, sizeof (name), "eth0.%d", i);
+  ifp = if_get_by_name (name);
+  if_set_index (ifp, 100 + i);
+  add_address (ifp, 0x0a000001 | (i << 8), 24);
+  /* Every tenth VLAN has a /30 carved out of the previous one's /24. */
+  if (i % 10 == 0 && i > 0)
+    add_address (ifp, 0x0a000005 | ((i - 1) << 8), 30);
+}
+
+static u_int32_t
+random_address (struct prng *prng, int nifs)
+{
+  unsigned int r = prng_rand (prng);
+
+  /* Mostly covered addresses, some outside every prefix. */
+  return 0x0a000000 | ((r % (nifs + nifs / 8)) << 8) | (r >> 24);
+}
+
+static int
+check (struct prng *prng, int nifs, int n, const char *what)
+{
+  int i, fail = 0;
+
+  for (i = 0; i < n; i++)
+    {
+      unsigned int index = 100 + prng_rand (prng) % (nifs + 10);
+      struct in_addr a;
+      struct interface *ifp;
+
+      ifp = walk_by_index (index);
+      if (if_lookup_by_index (index) != ifp)
+        fail++;
+      if (ifp && if_lookup_by_name (ifp->name) != ifp)
+        fail++;
+
+      a.s_addr = htonl (random_address (prng, nifs));
+      if (if_lookup_address (a) != walk_by_address (a))
+        fail++;
+    }
+  printf ("%s: %s\n", what, fail ? "FAILED" : "OK");
+  return fail;
+}
+
+static unsigned long
+cpu_since (RUSAGE_T *before)
+{
+  RUSAGE_T after;
+  unsigned long cpu;
+
+  thread_getrusage (&after);
+  thread_consumed_time (&after, before, &cpu);
+  return cpu;
+}
+
+static void
+bench (struct prng *prng, int nifs, int n)
+{
+  RUSAGE_T before;
+  unsigned long cpu;
+  unsigned long found = 0;
+  int i;
+  char name[INTERFACE_NAMSIZ];
+  struct in_addr a;
+
+  thread_getrusage (&before);
+  for (i = 0; i < n; i++)
+    found += if_lookup_by_index (100 + prng_rand (prng) % nifs) != NULL;
+  cpu = cpu_since (&before);
+  printf ("by index: %.3f usec/lookup\n", (double) cpu / n);
+
+  thread_getrusage (&before);
+  for (i = 0; i < n; i++)
+    {
+      snprintf (name, sizeof (name), "eth0.%u", prng_rand (prng) % nifs);
+      found += if_lookup_by_name (name) != NULL;
+    }
+  cpu = cpu_since (&before);
+  printf ("by name: %.3f usec/lookup\n", (double) cpu / n);
+
+  thread_getrusage (&before);
+  for (i = 0; i < n; i++)
+    {
+      a.s_addr = htonl (random_address (prng, nifs));
+      found += if_lookup_address (a) != NULL;
+    }
+  cpu = cpu_since (&before);
+  printf ("by address: %.3f usec/lookup\n", (double) cpu / n);
+
+  /* The walk these replace, for comparison. */
+  n /= 100;
+  thread_getrusage (&before);
+  for (i = 0; i < n; i++)
+    {
+      a.s_addr = htonl (random_address (prng, nifs));
+      found += walk_by_address (a) != NULL;
+    }
+  cpu = cpu_since (&before);
+  printf ("by address, list walk: %.3f usec/lookup (%lu found)\n",
+          (double) cpu / n, found);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct prng *prng;
+  struct interface *ifp;
+  int nifs = 4000, nlookups = 1000000;
+  int i, fail = 0;
+
+  if (argc > 1)
+    nifs = atoi (argv[1]);
+  if (argc > 2)
+    nlookups = atoi (argv[2]);
+  if (nifs <= 10 || nlookups < 100)
+    {
+      fprintf (stderr, "usage: %s [interfaces [lookups]]\n", argv[0]);
+      exit (1);
+    }
+
+  master = thread_master_create ();
+  if_init ();
+  prng = prng_new (0);
+
+  for (i = 0; i < nifs; i++)
+    make_vlan (i);
+  fail += check (prng, nifs, 20000, "lookup");
+
+  /* Swap two indices. */
+  ifp = if_lookup_by_name ("eth0.1");
+  if_set_index (ifp, IFINDEX_INTERNAL);
+  if_set_index (if_lookup_by_name ("eth0.2"), 101);
+  if_set_index (ifp, 102);
+  fail += check (prng, nifs, 20000, "renumber");
+
+  /* Give an interface the index of another, which then loses it. */
+  if_set_index (if_lookup_by_name ("eth0.3"), 104);
+  if_set_index (if_lookup_by_name ("eth0.4"), IFINDEX_INTERNAL);
+  fail += check (prng, nifs, 20000, "duplicate index");
+
+  /* Delete addresses and interfaces. */
+  for (i = 0; i < nifs; i += 7)
+    {
+      char name[INTERFACE_NAMSIZ];
+      struct prefix p;
+
+      snprintf (name, sizeof (name), "eth0.%d", i);
+      ifp = if_lookup_by_name (name);
+      if (i % 2)
+        if_delete (ifp);
+      else
+        {
+          memset (&p, 0, sizeof (p));
+          p.family = AF_INET;
+          p.prefixlen = 24;
+          p.u.prefix4.s_addr = htonl (0x0a000001 | (i << 8));
+          connected_free (connected_delete_by_prefix (ifp, &p));
+        }
+    }
+  fail += check (prng, nifs, 20000, "delete");
+
+  bench (prng, nifs, nlookups);
+
+  if_terminate ();
+  prng_free (prng);
+  thread_master_free (master);
+  return fail;
+}
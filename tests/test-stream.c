@@ -1,6 +1,10 @@
 #include <zebra.h>
 #include <stream.h>
 #include <thread.h>
+#include <memory.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 static long int ham = 0xdeadbeefdeadbeef;
 struct thread_master *master;
@@ -27,10 +31,170 @@ print_stream (struct stream *s)
   stream_set_getp (s, getp);
 }
 
+/* Freed streams are given out again, whatever size of their class is
+ * asked for, and resizing keeps what they hold.  */
+static int
+check_pool (void)
+{
+  struct stream *s, *t;
+  int fail = 0;
+
+  s = stream_new (3000);
+  stream_putl (s, 0xdeadbeef);
+  stream_free (s);
+  t = stream_new (4096);
+  if (t != s || stream_get_size (t) != 4096
+      || stream_get_endp (t) || stream_get_getp (t) || t->next)
+    fail = 1;
+
+  stream_putl (t, 0xdeadbeef);
+  stream_resize (t, 20000);
+  stream_putl (t, 0xfeedface);
+  stream_resize (t, 8);
+  if (stream_get_size (t) != 8 || stream_getl (t) != 0xdeadbeef
+      || stream_getl (t) != 0xfeedface)
+    fail = 1;
+  stream_free (t);
+
+  s = stream_new (100000);
+  stream_put (s, NULL, 100000);
+  stream_free (s);
+
+  printf ("pool: %s\n", fail ? "FAILED" : "OK");
+  return fail;
+}
+
+/* Sizes of messages, as of BGP updates, keepalives and OSPF packets.  */
+static size_t
+message_size (unsigned int i)
+{
+  static const size_t sizes[] = { 19, 19, 60, 120, 1480, 4096, 230, 4096 };
+
+  return sizes[i % (sizeof (sizes) / sizeof (sizes[0]))];
+}
+
+/* A stream as made before pooling, by two allocations.  */
+static struct stream *
+stream_new_unpooled (size_t size)
+{
+  struct stream *s;
+
+  s = XCALLOC (MTYPE_STREAM, sizeof (struct stream));
+  s->data = XMALLOC (MTYPE_STREAM_DATA, size);
+  s->size = size;
+  return s;
+}
+
+static void
+stream_free_unpooled (struct stream *s)
+{
+  XFREE (MTYPE_STREAM_DATA, s->data);
+  XFREE (MTYPE_STREAM, s);
+}
+
+#define WINDOW 64
+
+/* Messages made and freed by one thread, a window of them queued as by
+ * bgp_packet_add() and bgp_packet_delete().  */
+static void
+bench_queue (const char *name, unsigned int msgs,
+             struct stream *(*make) (size_t), void (*release) (struct stream *))
+{
+  struct stream *window[WINDOW];
+  RUSAGE_T before, after;
+  unsigned long cpu;
+  unsigned int i;
+
+  memset (window, 0, sizeof (window));
+  thread_getrusage (&before);
+  for (i = 0; i < msgs; i++)
+    {
+      if (window[i % WINDOW])
+        release (window[i % WINDOW]);
+      window[i % WINDOW] = make (message_size (i));
+      stream_putc (window[i % WINDOW], i);
+    }
+  thread_getrusage (&after);
+  thread_consumed_time (&after, &before, &cpu);
+  for (i = 0; i < WINDOW; i++)
+    if (window[i])
+      release (window[i]);
+
+  printf ("%-8s one thread: %.1f nsec per message\n", name,
+          cpu * 1000.0 / msgs);
+}
+
+#ifdef HAVE_PTHREAD
+/* Messages made by one thread and freed by another, handed over
+ * through a ring, as between bgpd's I/O thread and the main one.  */
+#define RING 256
+
+static struct
+{
+  struct stream *msg[RING];
+  unsigned int head;
+  unsigned int tail;
+  unsigned int msgs;
+  struct stream *(*make) (size_t);
+} ring;
+
+static void *
+producer (void *arg)
+{
+  unsigned int i, head;
+
+  for (i = 0; i < ring.msgs; i++)
+    {
+      head = ring.head;
+      while (head - __atomic_load_n (&ring.tail, __ATOMIC_ACQUIRE) == RING)
+        sched_yield ();
+      ring.msg[head % RING] = ring.make (message_size (i));
+      __atomic_store_n (&ring.head, head + 1, __ATOMIC_RELEASE);
+    }
+  return NULL;
+}
+
+static void
+bench_threads (const char *name, unsigned int msgs,
+               struct stream *(*make) (size_t), void (*release) (struct stream *))
+{
+  pthread_t thread;
+  RUSAGE_T before, after;
+  unsigned long cpu, real;
+  unsigned int i, tail;
+
+  ring.head = ring.tail = 0;
+  ring.msgs = msgs;
+  ring.make = make;
+
+  thread_getrusage (&before);
+  pthread_create (&thread, NULL, producer, NULL);
+  for (i = 0; i < msgs; i++)
+    {
+      tail = ring.tail;
+      while (__atomic_load_n (&ring.head, __ATOMIC_ACQUIRE) == tail)
+        sched_yield ();
+      release (ring.msg[tail % RING]);
+      __atomic_store_n (&ring.tail, tail + 1, __ATOMIC_RELEASE);
+    }
+  pthread_join (thread, NULL);
+  thread_getrusage (&after);
+  real = thread_consumed_time (&after, &before, &cpu);
+
+  printf ("%-8s two threads: %.2f million messages per second\n", name,
+          msgs / (double) real);
+}
+#endif /* HAVE_PTHREAD */
+
 int
-main (void)
+main (int argc, char **argv)
 {
   struct stream *s;
+  unsigned int msgs = 200000;
+  int fail;
+
+  if (argc > 1)
+    msgs = atoi (argv[1]);
   
   s = stream_new (1024);
   
@@ -50,5 +214,14 @@ main (void)
   printf ("l: 0x%x\n", stream_getl (s));
   printf ("q: 0x%lx\n", stream_getq (s));
   
-  return 0;
+  /* Throughput of stream allocation, pooled and as it was.  */
+  fail = check_pool ();
+  bench_queue ("pooled", msgs, stream_new, stream_free);
+  bench_queue ("unpooled", msgs, stream_new_unpooled, stream_free_unpooled);
+#ifdef HAVE_PTHREAD
+  bench_threads ("pooled", msgs, stream_new, stream_free);
+  bench_threads ("unpooled", msgs, stream_new_unpooled, stream_free_unpooled);
+#endif /* HAVE_PTHREAD */
+
+  return fail;
 }
@@ -0,0 +1,227 @@
+/*
+ * Timer wheel tests.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* First checks that wheel timers fire, refresh and cancel as they
+ * should, then runs a synthetic RIP load: every route's timeout is
+ * refreshed once per update cycle, as ripd does on each received
+ * update, and the CPU spent per cycle is reported for the wheel and
+ * for plain thread timers.
+ *
+ *   testwheel [routes [cycles]]     (default 50000 routes, 5 cycles)
+ */
+
+#include <zebra.h>
+
+#include "thread.h"
+#include "memory.h"
+#include "wheel.h"
+
+struct thread_master *master;
+
+#define ROUTE_TIMEOUT 180
+
+struct route
+{
+  struct wheel_timer t_timeout;
+  struct thread *t_thread;
+  int expired;
+};
+
+static int done;
+
+static int
+route_expire (struct wheel_timer *t)
+{
+  struct route *r = WHEEL_TIMER_ARG (t);
+
+  r->expired++;
+  return 0;
+}
+
+static int
+route_thread_expire (struct thread *t)
+{
+  struct route *r = THREAD_ARG (t);
+
+  r->t_thread = NULL;
+  r->expired++;
+  return 0;
+}
+
+static int
+stop (struct thread *t)
+{
+  done = 1;
+  return 0;
+}
+
+static int
+test_expiry (void)
+{
+  struct timer_wheel *wheel;
+  struct route r[4];
+  struct thread thread;
+  int fail = 0;
+
+  memset (r, 0, sizeof (r));
+  wheel = wheel_new (master, 4);
+
+  /* Expires. */
+  wheel_timer_add (wheel, &r[0].t_timeout, route_expire, &r[0], 1);
+  /* Refreshed past the end of the test. */
+  wheel_timer_add (wheel, &r[1].t_timeout, route_expire, &r[1], 1);
+  wheel_timer_add (wheel, &r[1].t_timeout, route_expire, &r[1], 10);
+  /* Cancelled. */
+  wheel_timer_add (wheel, &r[2].t_timeout, route_expire, &r[2], 1);
+  wheel_timer_cancel (&r[2].t_timeout);
+  /* Longer than the wheel, then brought forward. */
+  wheel_timer_add (wheel, &r[3].t_timeout, route_expire, &r[3], 100);
+  wheel_timer_add (wheel, &r[3].t_timeout, route_expire, &r[3], 2);
+
+  done = 0;
+  thread_add_timer (master, stop, NULL, 4);
+  while (!done && thread_fetch (master, &thread))
+    thread_call (&thread);
+
+  if (r[0].expired != 1 || r[1].expired || r[2].expired || r[3].expired != 1)
+    {
+      printf ("expiry: FAILED (%d %d %d %d)\n", r[0].expired, r[1].expired,
+              r[2].expired, r[3].expired);
+      fail = 1;
+    }
+  else if (wheel->count != 1 || wheel_timer_remain_second (&r[1].t_timeout) == 0)
+    {
+      printf ("expiry: FAILED, %lu pending\n", wheel->count);
+      fail = 1;
+    }
+  else
+    printf ("expiry: OK\n");
+
+  wheel_free (wheel);
+  return fail;
+}
+
+static unsigned long
+cycle_cpu (RUSAGE_T *before)
+{
+  RUSAGE_T after;
+  unsigned long cpu;
+
+  thread_getrusage (&after);
+  thread_consumed_time (&after, before, &cpu);
+  return cpu;
+}
+
+static void
+bench_wheel (struct route *routes, int nroutes, int cycles)
+{
+  struct timer_wheel *wheel;
+  RUSAGE_T before;
+  unsigned long cpu;
+  int i, c;
+
+  wheel = wheel_new (master, WHEEL_SIZE_DEFAULT);
+
+  thread_getrusage (&before);
+  for (i = 0; i < nroutes; i++)
+    wheel_timer_add (wheel, &routes[i].t_timeout, route_expire, &routes[i],
+                     ROUTE_TIMEOUT);
+  cpu = cycle_cpu (&before);
+  printf ("wheel: %d routes added in %lu usec\n", nroutes, cpu);
+
+  for (c = 0; c < cycles; c++)
+    {
+      thread_getrusage (&before);
+      for (i = 0; i < nroutes; i++)
+        wheel_timer_add (wheel, &routes[i].t_timeout, route_expire,
+                         &routes[i], ROUTE_TIMEOUT);
+      cpu = cycle_cpu (&before);
+      printf ("wheel: update cycle %d: %lu usec cpu, %.3f usec/route\n",
+              c + 1, cpu, (double) cpu / nroutes);
+    }
+
+  wheel_free (wheel);
+}
+
+static void
+bench_thread (struct route *routes, int nroutes, int cycles)
+{
+  RUSAGE_T before;
+  unsigned long cpu;
+  int i, c;
+
+  thread_getrusage (&before);
+  for (i = 0; i < nroutes; i++)
+    routes[i].t_thread = thread_add_timer (master, route_thread_expire,
+                                           &routes[i], ROUTE_TIMEOUT);
+  cpu = cycle_cpu (&before);
+  printf ("thread: %d routes added in %lu usec\n", nroutes, cpu);
+
+  for (c = 0; c < cycles; c++)
+    {
+      thread_getrusage (&before);
+      for (i = 0; i < nroutes; i++)
+        {
+          thread_cancel (routes[i].t_thread);
+          routes[i].t_thread = thread_add_timer (master, route_thread_expire,
+                                                 &routes[i], ROUTE_TIMEOUT);
+        }
+      cpu = cycle_cpu (&before);
+      printf ("thread: update cycle %d: %lu usec cpu, %.3f usec/route\n",
+              c + 1, cpu, (double) cpu / nroutes);
+    }
+
+  for (i = 0; i < nroutes; i++)
+    thread_cancel (routes[i].t_thread);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct route *routes;
+  int nroutes = 50000;
+  int cycles = 5;
+  int fail;
+
+  if (argc > 1)
+    nroutes = atoi (argv[1]);
+  if (argc > 2)
+    cycles = atoi (argv[2]);
+  if (nroutes <= 0 || cycles <= 0)
+    {
+      fprintf (stderr, "usage: %s [routes [cycles]]\n", argv[0]);
+      exit (1);
+    }
+
+  master = thread_master_create ();
+
+  fail = test_expiry ();
+
+  routes = XCALLOC (MTYPE_TMP, nroutes * sizeof (struct route));
+  bench_wheel (routes, nroutes, cycles);
+  /* Plain thread timers re-sort the whole timer list on every
+   * refresh; one cycle is enough to show the difference. */
+  bench_thread (routes, nroutes, 1);
+  XFREE (MTYPE_TMP, routes);
+
+  thread_master_free (master);
+  return fail;
+}
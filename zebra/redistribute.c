@@ -30,6 +30,8 @@
 #include "zclient.h"
 #include "linklist.h"
 #include "log.h"
+#include "thread.h"
+#include "buffer.h"
 
 #include "zebra/rib.h"
 #include "zebra/zserv.h"
@@ -137,35 +139,187 @@ zebra_redistribute_default (struct zserv *client)
 #endif /* HAVE_IPV6 */
 }
 
-/* Redistribute routes. */
-static void
-zebra_redistribute (struct zserv *client, int type)
+/* Routes are sent to a client that asks for a route type in the
+   background, a batch of nodes at a time, so that a large table does
+   not hold up zebra.  The next batch is only produced once the client
+   has read most of what was sent before.
+
+   Changes to routes of that type go out as they happen meanwhile, so a
+   route may be sent again by the walk or deleted before it was sent;
+   clients cope with both. */
+#define ZEBRA_REDIST_DUMP_BATCH   1000
+#define ZEBRA_REDIST_DUMP_BUFFER  (256 * 1024)
+
+static int zebra_redistribute_dump (struct thread *);
+
+static const char *
+zebra_redistribute_dump_afi (struct zserv *client)
+{
+  return client->redist_dump_afi == AFI_IP ? "IPv4" : "IPv6";
+}
+
+/* Start walking the table of the given address family, or of the
+   next one that has a table.  Returns 0 if there is none left. */
+static int
+zebra_redistribute_dump_table (struct zserv *client, afi_t afi)
 {
-  struct rib *newrib;
   struct route_table *table;
+
+  for (; afi < AFI_MAX; afi++)
+    {
+#ifndef HAVE_IPV6
+      if (afi == AFI_IP6)
+        continue;
+#endif /* HAVE_IPV6 */
+      table = vrf_table (afi, SAFI_UNICAST, 0);
+      if (table)
+        {
+          client->redist_dump_afi = afi;
+          route_table_iter_init (&client->redist_dump_iter, table);
+          return 1;
+        }
+    }
+  return 0;
+}
+
+/* Start a pass over the tables for the types queued so far. */
+static int
+zebra_redistribute_dump_start (struct zserv *client)
+{
+  int type, queued = 0;
+
+  for (type = 0; type < ZEBRA_ROUTE_MAX; type++)
+    {
+      client->redist_dump[type] = client->redist_dump_queued[type];
+      client->redist_dump_queued[type] = 0;
+      queued |= client->redist_dump[type];
+    }
+  client->redist_dump_nodes = 0;
+
+  return queued && zebra_redistribute_dump_table (client, AFI_IP);
+}
+
+/* Finish the table being walked, and move on to the next one or the
+   next pass.  Returns 0 once there is nothing left to send. */
+static int
+zebra_redistribute_dump_next (struct zserv *client)
+{
+  route_table_iter_cleanup (&client->redist_dump_iter);
+  if (zebra_redistribute_dump_table (client, client->redist_dump_afi + 1))
+    return 1;
+
+  memset (client->redist_dump, 0, sizeof (client->redist_dump));
+  client->redist_dump_passes++;
+  return zebra_redistribute_dump_start (client);
+}
+
+static int
+zebra_redistribute_dumping (struct zserv *client)
+{
+  return client->redist_dump_iter.table != NULL;
+}
+
+/* Schedule the next batch, unless the client still has a lot to read;
+   then zserv_flush_data() gets us going again as it drains. */
+static void
+zebra_redistribute_dump_schedule (struct zserv *client)
+{
+  if (client->t_redist_dump || client->t_suicide
+      || ! zebra_redistribute_dumping (client)
+      || buffer_pending (client->wb) > ZEBRA_REDIST_DUMP_BUFFER)
+    return;
+
+  client->t_redist_dump = thread_add_background (zebrad.master,
+                                                 zebra_redistribute_dump,
+                                                 client, 0);
+}
+
+static int
+zebra_redistribute_dump (struct thread *thread)
+{
+  struct zserv *client = THREAD_ARG (thread);
   struct route_node *rn;
+  struct rib *newrib;
+  int command, n;
 
-  table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
-  if (table)
-    for (rn = route_top (table); rn; rn = route_next (rn))
-      RNODE_FOREACH_RIB (rn, newrib)
-	if (CHECK_FLAG (newrib->flags, ZEBRA_FLAG_SELECTED) 
-	    && newrib->type == type 
-	    && newrib->distance != DISTANCE_INFINITY
-	    && zebra_check_addr (&rn->p))
-	  zsend_route_multipath (ZEBRA_IPV4_ROUTE_ADD, client, &rn->p, newrib);
-  
-#ifdef HAVE_IPV6
-  table = vrf_table (AFI_IP6, SAFI_UNICAST, 0);
-  if (table)
-    for (rn = route_top (table); rn; rn = route_next (rn))
+  client->t_redist_dump = NULL;
+  if (client->t_suicide)
+    return 0;
+
+  for (n = 0; n < ZEBRA_REDIST_DUMP_BATCH; n++)
+    {
+      rn = route_table_iter_next (&client->redist_dump_iter);
+      if (! rn)
+        {
+          if (! zebra_redistribute_dump_next (client))
+            {
+              memset (&client->redist_dump_iter, 0,
+                      sizeof (client->redist_dump_iter));
+              return 0;
+            }
+          continue;
+        }
+      client->redist_dump_nodes++;
+
+      if (! zebra_check_addr (&rn->p))
+        continue;
+
+      command = (client->redist_dump_afi == AFI_IP)
+        ? ZEBRA_IPV4_ROUTE_ADD : ZEBRA_IPV6_ROUTE_ADD;
       RNODE_FOREACH_RIB (rn, newrib)
-	if (CHECK_FLAG (newrib->flags, ZEBRA_FLAG_SELECTED)
-	    && newrib->type == type 
-	    && newrib->distance != DISTANCE_INFINITY
-	    && zebra_check_addr (&rn->p))
-	  zsend_route_multipath (ZEBRA_IPV6_ROUTE_ADD, client, &rn->p, newrib);
-#endif /* HAVE_IPV6 */
+        if (CHECK_FLAG (newrib->flags, ZEBRA_FLAG_SELECTED)
+            && client->redist_dump[newrib->type]
+            && client->redist[newrib->type]
+            && newrib->distance != DISTANCE_INFINITY)
+          {
+            zsend_route_multipath (command, client, &rn->p, newrib);
+            client->redist_dump_routes++;
+          }
+    }
+
+  route_table_iter_pause (&client->redist_dump_iter);
+  zebra_redistribute_dump_schedule (client);
+  return 0;
+}
+
+/* Redistribute routes. */
+static void
+zebra_redistribute (struct zserv *client, int type)
+{
+  client->redist_dump_queued[type] = 1;
+  if (zebra_redistribute_dumping (client))
+    return;
+
+  if (zebra_redistribute_dump_start (client))
+    zebra_redistribute_dump_schedule (client);
+}
+
+/* Called as the client's output buffer drains. */
+void
+zebra_redistribute_dump_resume (struct zserv *client)
+{
+  zebra_redistribute_dump_schedule (client);
+}
+
+/* Drop the dump in progress, the client is going away. */
+void
+zebra_redistribute_dump_stop (struct zserv *client)
+{
+  THREAD_OFF (client->t_redist_dump);
+  route_table_iter_cleanup (&client->redist_dump_iter);
+  memset (&client->redist_dump_iter, 0, sizeof (client->redist_dump_iter));
+}
+
+void
+zebra_redistribute_dump_show (struct vty *vty, struct zserv *client)
+{
+  vty_out (vty, "  Redistribution dump: %lu routes sent in %lu passes",
+           client->redist_dump_routes, client->redist_dump_passes);
+  if (zebra_redistribute_dumping (client))
+    vty_out (vty, ", %s table in progress (%lu nodes walked)%s",
+             zebra_redistribute_dump_afi (client), client->redist_dump_nodes,
+             client->t_redist_dump ? "" : ", waiting for client");
+  vty_out (vty, "%s", VTY_NEWLINE);
 }
 
 void
@@ -266,6 +420,7 @@ zebra_redistribute_delete (int command, struct zserv *client, int length)
     return;
 
   client->redist[type] = 0;
+  client->redist_dump_queued[type] = 0;
 }
 
 void
@@ -24,11 +24,16 @@
 #define _ZEBRA_REDISTRIBUTE_H
 
 #include "table.h"
+#include "vty.h"
 #include "zserv.h"
 
 extern void zebra_redistribute_add (int, struct zserv *, int);
 extern void zebra_redistribute_delete (int, struct zserv *, int);
 
+extern void zebra_redistribute_dump_resume (struct zserv *);
+extern void zebra_redistribute_dump_stop (struct zserv *);
+extern void zebra_redistribute_dump_show (struct vty *, struct zserv *);
+
 extern void zebra_redistribute_default_add (int, struct zserv *, int);
 extern void zebra_redistribute_default_delete (int, struct zserv *, int);
 
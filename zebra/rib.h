@@ -38,6 +38,17 @@ union g_addr {
 #endif /* HAVE_IPV6 */
 };
 
+/* A list of nexthops with their state.  Ribs with identical lists
+ * share one group, interned in a hash; a rib changing its nexthops
+ * first makes the group its own with rib_nexthop_group_unshare(). */
+struct nexthop_group
+{
+  struct nexthop *nexthop;
+
+  /* Number of ribs sharing the group, 0 while it is private. */
+  unsigned long refcnt;
+};
+
 struct rib
 {
   /* Link list. */
@@ -45,7 +56,7 @@ struct rib
   struct rib *prev;
   
   /* Nexthop structure */
-  struct nexthop *nexthop;
+  struct nexthop_group *nhg;
   
   /* Refrence count. */
   unsigned long refcnt;
@@ -91,10 +102,53 @@ struct rib
 #define MQ_SIZE 5
 struct meta_queue
 {
-  struct list *subq[MQ_SIZE];
+  TAILQ_HEAD (, rib_dest_t_) subq[MQ_SIZE];
   u_int32_t size; /* sum of lengths of all subqueues */
 };
 
+/* Default number of route nodes processed per run of the meta queue. */
+#define RIB_PROCESS_BATCH_DEFAULT 100
+
+/*
+ * Result of resolving a nexthop address against the RIB, shared by
+ * all the routes with that nexthop.  See nexthop_cache_get().
+ */
+struct nexthop_cache
+{
+  /* Node in the cache table, keyed by the nexthop address as a host
+   * prefix.  NULL for the entry tracking interface nexthops. */
+  struct route_node *node;
+
+  /* Node of the route the address resolves through, locked, if any. */
+  struct route_node *resolving;
+
+  /* Digest of the resolving route, to tell whether it has changed. */
+  u_int32_t sig;
+
+  /* Bumped whenever the resolution changes. */
+  u_int32_t gen;
+
+  /* Destinations with routes that use this nexthop. */
+  TAILQ_HEAD (, nexthop_cache_dep) deps;
+  unsigned long dep_count;
+};
+
+/* Link between a destination and a nexthop cache entry it depends on. */
+struct nexthop_cache_dep
+{
+  struct nexthop_cache *nhc;
+  struct rib_dest_t_ *dest;
+
+  /* Other entries the destination depends on. */
+  struct nexthop_cache_dep *dest_next;
+
+  /* Other destinations depending on the entry. */
+  TAILQ_ENTRY (nexthop_cache_dep) entries;
+
+  /* rib_process() run in which the dependency was last seen. */
+  u_int32_t seen;
+};
+
 /*
  * Structure that represents a single destination (prefix).
  */
@@ -122,9 +176,21 @@ typedef struct rib_dest_t_
    */
   TAILQ_ENTRY(rib_dest_t_) fpm_q_entries;
 
+  /*
+   * Linkage to put dest on the meta queue, in the sub-queue given by
+   * its RIB_ROUTE_QUEUED flag.
+   */
+  TAILQ_ENTRY(rib_dest_t_) mq_entries;
+
+  /*
+   * Nexthop cache entries the routes for this prefix depend on.
+   */
+  struct nexthop_cache_dep *nhc_deps;
+
 } rib_dest_t;
 
 #define RIB_ROUTE_QUEUED(x)	(1 << (x))
+#define RIB_ROUTE_ANY_QUEUED	(RIB_ROUTE_QUEUED (MQ_SIZE) - 1)
 
 /*
  * The maximum qindex that can be used.
@@ -266,6 +332,9 @@ struct nexthop
    * obtained by recursive resolution will be added to `resolved'.
    * Only one level of recursive resolution is currently supported. */
   struct nexthop *resolved;
+
+  /* Generation of the nexthop cache entry `resolved' was built from. */
+  u_int32_t cache_gen;
 };
 
 /* The following for loop allows to iterate over the nexthop
@@ -314,6 +383,9 @@ struct nexthop
                                       : ((tnexthop) = (nexthop)->next)) \
                        : (((recursing) = 0),((tnexthop) = (tnexthop)->next)))
 
+/* Head of the nexthop list of a rib. */
+#define RIB_NEXTHOPS(R) ((R)->nhg ? (R)->nhg->nexthop : NULL)
+
 /* Routing table instance.  */
 struct vrf
 {
@@ -463,6 +535,7 @@ static_delete_ipv6 (struct prefix *p, u_char type, struct in6_addr *gate,
 #endif /* HAVE_IPV6 */
 
 extern int rib_gc_dest (struct route_node *rn);
+extern int rib_process_batch;
 extern struct route_table *rib_tables_iter_next (rib_tables_iter_t *iter);
 
 /*
@@ -189,7 +189,7 @@ kernel_ioctl_ipv4 (u_long cmd, struct prefix *p, struct rib *rib, int family)
       SET_FLAG (rtentry.rt_flags, RTF_REJECT);
 
       if (cmd == SIOCADDRT)
-	for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+	for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (rib), nexthop, tnexthop, recursing))
 	  {
             /* We shouldn't encounter recursive nexthops on discard routes,
              * but it is probably better to handle that case correctly anyway.
@@ -204,7 +204,7 @@ kernel_ioctl_ipv4 (u_long cmd, struct prefix *p, struct rib *rib, int family)
   memset (&sin_gate, 0, sizeof (struct sockaddr_in));
 
   /* Make gateway. */
-  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+  for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (rib), nexthop, tnexthop, recursing))
     {
       if (CHECK_FLAG(nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
         continue;
@@ -442,7 +442,7 @@ kernel_ioctl_ipv6_multipath (u_long cmd, struct prefix *p, struct rib *rib,
   /* rtm.rtmsg_flags |= RTF_DYNAMIC; */
 
   /* Make gateway. */
-  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+  for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (rib), nexthop, tnexthop, recursing))
     {
       if (CHECK_FLAG(nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
         continue;
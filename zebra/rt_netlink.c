@@ -98,7 +98,7 @@ set_ifindex(struct interface *ifp, unsigned int ifi_index)
 	  if_delete_update(oifp);
         }
     }
-  ifp->ifindex = ifi_index;
+  if_set_index (ifp, ifi_index);
 }
 
 #ifndef SO_RCVBUFFORCE
@@ -1694,7 +1694,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
   if (discard)
     {
       if (cmd == RTM_NEWROUTE)
-        for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+        for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (rib), nexthop, tnexthop, recursing))
           {
             /* We shouldn't encounter recursive nexthops on discard routes,
              * but it is probably better to handle that case correctly anyway.
@@ -1709,7 +1709,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
   /* Count overall nexthops so we can decide whether to use singlepath
    * or multipath case. */
   nexthop_num = 0;
-  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+  for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (rib), nexthop, tnexthop, recursing))
     {
       if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
         continue;
@@ -1725,7 +1725,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
   if (nexthop_num == 1 || MULTIPATH_NUM == 1)
     {
       nexthop_num = 0;
-      for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+      for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (rib), nexthop, tnexthop, recursing))
         {
           if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
             continue;
@@ -1762,7 +1762,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
       rtnh = RTA_DATA (rta);
 
       nexthop_num = 0;
-      for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+      for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (rib), nexthop, tnexthop, recursing))
         {
           if (MULTIPATH_NUM != 0 && nexthop_num >= MULTIPATH_NUM)
             break;
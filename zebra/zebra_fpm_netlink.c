@@ -285,7 +285,7 @@ netlink_route_info_fill (netlink_route_info_t *ri, int cmd,
       goto skip;
     }
 
-  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+  for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (rib), nexthop, tnexthop, recursing))
     {
       if (MULTIPATH_NUM != 0 && ri->num_nhs >= MULTIPATH_NUM)
         break;
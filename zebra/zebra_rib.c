@@ -34,6 +34,8 @@
 #include "workqueue.h"
 #include "prefix.h"
 #include "routemap.h"
+#include "jhash.h"
+#include "hash.h"
 
 #include "zebra/rib.h"
 #include "zebra/rt.h"
@@ -51,6 +53,9 @@ extern struct zebra_t zebrad;
  */
 int rib_process_hold_time = 10;
 
+/* Number of route nodes processed per run of the meta queue. */
+int rib_process_batch = RIB_PROCESS_BATCH_DEFAULT;
+
 /* Each route type's string and default distance value. */
 static const struct
 {  
@@ -217,24 +222,28 @@ _nexthop_add (struct nexthop **target, struct nexthop *nexthop)
   nexthop->prev = last;
 }
 
+static struct nexthop_group *rib_nexthop_group_unshare (struct rib *);
+
 /* Add nexthop to the end of a rib node's nexthop list */
 static void
 nexthop_add (struct rib *rib, struct nexthop *nexthop)
 {
-  _nexthop_add(&rib->nexthop, nexthop);
+  _nexthop_add(&rib_nexthop_group_unshare (rib)->nexthop, nexthop);
   rib->nexthop_num++;
 }
 
-/* Delete specified nexthop from the list. */
+/* Delete specified nexthop from the list, which must be the rib's own. */
 static void
 nexthop_delete (struct rib *rib, struct nexthop *nexthop)
 {
+  assert (rib->nhg && rib->nhg->refcnt == 0);
+
   if (nexthop->next)
     nexthop->next->prev = nexthop->prev;
   if (nexthop->prev)
     nexthop->prev->next = nexthop->next;
   else
-    rib->nexthop = nexthop->next;
+    rib->nhg->nexthop = nexthop->next;
   rib->nexthop_num--;
 }
 
@@ -264,6 +273,162 @@ nexthops_free (struct nexthop *nexthop)
     }
 }
 
+/* Interned nexthop groups. */
+static struct hash *nexthop_group_hash;
+
+static unsigned int
+nexthop_list_hash_key (struct nexthop *head, unsigned int key)
+{
+  struct nexthop *nexthop;
+
+  for (nexthop = head; nexthop; nexthop = nexthop->next)
+    {
+      key = jhash_3words (nexthop->type, nexthop->ifindex, nexthop->flags, key);
+      key = jhash (&nexthop->gate, sizeof (nexthop->gate), key);
+      key = jhash (&nexthop->src, sizeof (nexthop->src), key);
+      key = jhash_1word (nexthop->cache_gen, key);
+      if (nexthop->ifname)
+	key = jhash (nexthop->ifname, strlen (nexthop->ifname), key);
+      if (nexthop->resolved)
+	key = nexthop_list_hash_key (nexthop->resolved, key);
+    }
+  return key;
+}
+
+static unsigned int
+nexthop_group_hash_key (void *arg)
+{
+  struct nexthop_group *nhg = arg;
+
+  return nexthop_list_hash_key (nhg->nexthop, 0);
+}
+
+static int
+nexthop_list_same (const struct nexthop *a, const struct nexthop *b)
+{
+  for (; a && b; a = a->next, b = b->next)
+    {
+      if (a->type != b->type
+	  || a->ifindex != b->ifindex
+	  || a->flags != b->flags
+	  || a->cache_gen != b->cache_gen
+	  || memcmp (&a->gate, &b->gate, sizeof (a->gate))
+	  || memcmp (&a->src, &b->src, sizeof (a->src)))
+	return 0;
+      if ((a->ifname || b->ifname)
+	  && (! a->ifname || ! b->ifname || strcmp (a->ifname, b->ifname)))
+	return 0;
+      if (! nexthop_list_same (a->resolved, b->resolved))
+	return 0;
+    }
+  return a == b;
+}
+
+static int
+nexthop_group_hash_cmp (const void *p1, const void *p2)
+{
+  const struct nexthop_group *a = p1;
+  const struct nexthop_group *b = p2;
+
+  return nexthop_list_same (a->nexthop, b->nexthop);
+}
+
+/* Copy a nexthop list, with the nexthops it resolves to. */
+static struct nexthop *
+nexthop_list_dup (struct nexthop *head)
+{
+  struct nexthop *nexthop, *copy, *list = NULL, *last = NULL;
+
+  for (nexthop = head; nexthop; nexthop = nexthop->next)
+    {
+      copy = XMALLOC (MTYPE_NEXTHOP, sizeof (struct nexthop));
+      *copy = *nexthop;
+      if (nexthop->ifname)
+	copy->ifname = XSTRDUP (0, nexthop->ifname);
+      copy->resolved = nexthop_list_dup (nexthop->resolved);
+      copy->next = NULL;
+      copy->prev = last;
+      if (last)
+	last->next = copy;
+      else
+	list = copy;
+      last = copy;
+    }
+  return list;
+}
+
+static void
+nexthop_group_free (struct nexthop_group *nhg)
+{
+  nexthops_free (nhg->nexthop);
+  XFREE (MTYPE_NEXTHOP_GROUP, nhg);
+}
+
+static void
+nexthop_group_unlock (struct nexthop_group *nhg)
+{
+  if (nhg->refcnt > 1)
+    {
+      nhg->refcnt--;
+      return;
+    }
+  if (nhg->refcnt)
+    hash_release (nexthop_group_hash, nhg);
+  nexthop_group_free (nhg);
+}
+
+/* Make the rib's nexthop group its own, so that it can be changed, and
+ * return it.  A group only the rib uses is taken out of the hash; a
+ * shared one is copied. */
+static struct nexthop_group *
+rib_nexthop_group_unshare (struct rib *rib)
+{
+  struct nexthop_group *nhg = rib->nhg;
+
+  if (! nhg)
+    rib->nhg = XCALLOC (MTYPE_NEXTHOP_GROUP, sizeof (struct nexthop_group));
+  else if (nhg->refcnt == 1)
+    {
+      hash_release (nexthop_group_hash, nhg);
+      nhg->refcnt = 0;
+    }
+  else if (nhg->refcnt > 1)
+    {
+      rib->nhg = XCALLOC (MTYPE_NEXTHOP_GROUP, sizeof (struct nexthop_group));
+      rib->nhg->nexthop = nexthop_list_dup (nhg->nexthop);
+      nhg->refcnt--;
+    }
+  return rib->nhg;
+}
+
+/* Share the rib's nexthop group with the ribs that have an identical
+ * one. */
+static void
+rib_nexthop_group_intern (struct rib *rib)
+{
+  struct nexthop_group *nhg = rib->nhg;
+  struct nexthop_group *found;
+
+  if (! nhg || nhg->refcnt)
+    return;
+
+  found = hash_get (nexthop_group_hash, nhg, hash_alloc_intern);
+  if (found != nhg)
+    {
+      nexthop_group_free (nhg);
+      rib->nhg = found;
+    }
+  found->refcnt++;
+}
+
+static void
+rib_nexthop_group_release (struct rib *rib)
+{
+  if (rib->nhg)
+    nexthop_group_unlock (rib->nhg);
+  rib->nhg = NULL;
+}
+
 struct nexthop *
 nexthop_ifindex_add (struct rib *rib, unsigned int ifindex)
 {
@@ -406,6 +571,316 @@ nexthop_has_fib_child(struct nexthop *nexthop)
   return 0;
 }
 
+/* Nexthop cache.
+ *
+ * Resolving a gateway means finding the longest match for it that has
+ * a selected route other than BGP.  Many routes share few nexthops, so
+ * the result is kept in an entry per nexthop address, in a route table
+ * so that the entries a route change may affect, those under its
+ * prefix, can be found.  Each destination keeps a link to every entry
+ * its routes use, and when rib_process() changes a route, the entries
+ * below it are resolved again; if that changes anything, the
+ * destinations depending on them are queued for processing.
+ *
+ * Nexthops that name an interface depend on interface state instead,
+ * and are all tracked by nexthop_cache_interface, which rib_update()
+ * queues when an interface changes.
+ */
+static struct route_table *nexthop_cache_table[AFI_MAX];
+static struct nexthop_cache nexthop_cache_interface =
+{
+  .deps = TAILQ_HEAD_INITIALIZER (nexthop_cache_interface.deps),
+};
+
+/* Source of nexthop_cache generations and rib_process() runs. */
+static u_int32_t nexthop_cache_generation;
+static u_int32_t rib_process_seq;
+
+static void rib_queue_add (struct zebra_t *zebra, struct route_node *rn);
+
+/* Selected route at the node, if any. */
+static struct rib *
+rib_selected (struct route_node *rn)
+{
+  struct rib *match;
+
+  RNODE_FOREACH_RIB (rn, match)
+    {
+      if (CHECK_FLAG (match->status, RIB_ENTRY_REMOVED))
+	continue;
+      if (CHECK_FLAG (match->flags, ZEBRA_FLAG_SELECTED))
+	return match;
+    }
+  return NULL;
+}
+
+/* Walk up from rn to the first node with a selected route that isn't
+ * BGP, and return it with *matchp set to that route.  Returns NULL if
+ * there is none, or if the walk comes across top.
+ */
+static struct route_node *
+rib_resolve_walk (struct route_node *rn, struct route_node *top,
+		  struct rib **matchp)
+{
+  struct rib *match;
+
+  for (; rn; rn = rn->parent)
+    {
+      if (rn->info == NULL)
+	continue;
+
+      /* If lookup self prefix return immediately. */
+      if (rn == top)
+	return NULL;
+
+      match = rib_selected (rn);
+      if (match && match->type != ZEBRA_ROUTE_BGP)
+	{
+	  *matchp = match;
+	  return rn;
+	}
+    }
+  return NULL;
+}
+
+/* Digest of what a nexthop resolved by match gets from it. */
+static u_int32_t
+nexthop_cache_sig (struct rib *match)
+{
+  struct nexthop *newhop;
+  u_int32_t sig;
+
+  sig = jhash_3words ((uintptr_t) match, match->type,
+		      match->flags & (ZEBRA_FLAG_BLACKHOLE|ZEBRA_FLAG_REJECT),
+		      0);
+  for (newhop = RIB_NEXTHOPS (match); newhop; newhop = newhop->next)
+    {
+      sig = jhash_3words (newhop->type, newhop->ifindex,
+			  newhop->flags & (NEXTHOP_FLAG_FIB|NEXTHOP_FLAG_RECURSIVE),
+			  sig);
+      sig = jhash (&newhop->gate, sizeof (newhop->gate), sig);
+    }
+  return sig;
+}
+
+/* Queue the destinations depending on the entry. */
+static void
+nexthop_cache_requeue (struct nexthop_cache *nhc)
+{
+  struct nexthop_cache_dep *dep;
+
+  TAILQ_FOREACH (dep, &nhc->deps, entries)
+    if (rnode_to_ribs (dep->dest->rnode))
+      rib_queue_add (&zebrad, dep->dest->rnode);
+}
+
+/* (Re)resolve the entry's address.  If the result differs from what it
+ * was, bump the generation and queue the dependent destinations. */
+static void
+nexthop_cache_resolve (struct nexthop_cache *nhc)
+{
+  struct route_table *table;
+  struct route_node *rn, *resolving = NULL;
+  struct rib *match = NULL;
+  u_int32_t sig = 0;
+
+  table = vrf_table (family2afi (nhc->node->p.family), SAFI_UNICAST, 0);
+  if (table && (rn = route_node_match (table, &nhc->node->p)))
+    {
+      route_unlock_node (rn);
+      resolving = rib_resolve_walk (rn, NULL, &match);
+      if (resolving)
+	sig = nexthop_cache_sig (match);
+    }
+
+  if (resolving == nhc->resolving && sig == nhc->sig)
+    return;
+
+  if (IS_ZEBRA_DEBUG_RIB)
+    {
+      char buf[INET6_ADDRSTRLEN];
+
+      zlog_debug ("%s: %s now resolved by %s/%d", __func__,
+		  inet_ntop (nhc->node->p.family, &nhc->node->p.u.prefix,
+			     buf, sizeof (buf)),
+		  resolving ? inet_ntop (resolving->p.family,
+					 &resolving->p.u.prefix,
+					 buf, sizeof (buf)) : "none",
+		  resolving ? resolving->p.prefixlen : 0);
+    }
+
+  if (resolving != nhc->resolving)
+    {
+      if (nhc->resolving)
+	route_unlock_node (nhc->resolving);
+      if (resolving)
+	route_lock_node (resolving);
+      nhc->resolving = resolving;
+    }
+  nhc->sig = sig;
+  nhc->gen = ++nexthop_cache_generation;
+  nexthop_cache_requeue (nhc);
+}
+
+/* Record that the routes at rn depend on the entry. */
+static void
+nexthop_cache_depend (struct route_node *rn, struct nexthop_cache *nhc)
+{
+  rib_dest_t *dest = rib_dest_from_rnode (rn);
+  struct nexthop_cache_dep *dep;
+
+  for (dep = dest->nhc_deps; dep; dep = dep->dest_next)
+    if (dep->nhc == nhc)
+      {
+	dep->seen = rib_process_seq;
+	return;
+      }
+
+  dep = XCALLOC (MTYPE_NEXTHOP_CACHE_DEP, sizeof (struct nexthop_cache_dep));
+  dep->nhc = nhc;
+  dep->dest = dest;
+  dep->seen = rib_process_seq;
+  dep->dest_next = dest->nhc_deps;
+  dest->nhc_deps = dep;
+  TAILQ_INSERT_TAIL (&nhc->deps, dep, entries);
+  nhc->dep_count++;
+}
+
+/* Drop a dependency, and the entry with its last one. */
+static void
+nexthop_cache_dep_free (struct nexthop_cache_dep *dep)
+{
+  struct nexthop_cache *nhc = dep->nhc;
+
+  TAILQ_REMOVE (&nhc->deps, dep, entries);
+  XFREE (MTYPE_NEXTHOP_CACHE_DEP, dep);
+
+  if (--nhc->dep_count || nhc->node == NULL)
+    return;
+
+  if (nhc->resolving)
+    route_unlock_node (nhc->resolving);
+  nhc->node->info = NULL;
+  route_unlock_node (nhc->node);
+  XFREE (MTYPE_NEXTHOP_CACHE, nhc);
+}
+
+/* Drop the dependencies of the destination not seen in the last
+ * rib_process() run, or all of them. */
+static void
+nexthop_cache_dest_prune (rib_dest_t *dest, int all)
+{
+  struct nexthop_cache_dep *dep, **prev;
+
+  prev = &dest->nhc_deps;
+  while ((dep = *prev) != NULL)
+    if (all || dep->seen != rib_process_seq)
+      {
+	*prev = dep->dest_next;
+	nexthop_cache_dep_free (dep);
+      }
+    else
+      prev = &dep->dest_next;
+}
+
+/* Find or make the entry for the nexthop address p, and record that
+ * the routes at top depend on it. */
+static struct nexthop_cache *
+nexthop_cache_get (struct route_node *top, struct prefix *p)
+{
+  afi_t afi = family2afi (p->family);
+  struct route_node *node;
+  struct nexthop_cache *nhc;
+
+  if (! nexthop_cache_table[afi])
+    nexthop_cache_table[afi] = route_table_init ();
+
+  node = route_node_get (nexthop_cache_table[afi], p);
+  if (node->info)
+    {
+      route_unlock_node (node);
+      nhc = node->info;
+    }
+  else
+    {
+      nhc = XCALLOC (MTYPE_NEXTHOP_CACHE, sizeof (struct nexthop_cache));
+      TAILQ_INIT (&nhc->deps);
+      nhc->node = node;
+      node->info = nhc;
+      nexthop_cache_resolve (nhc);
+    }
+
+  nexthop_cache_depend (top, nhc);
+  return nhc;
+}
+
+/* The routes at rn have been processed: resolve again the entries that
+ * may now resolve through it, or resolved through it before. */
+static void
+nexthop_cache_route_changed (struct route_node *rn)
+{
+  struct route_table *table;
+  struct route_node *node, *top;
+  struct nexthop_cache *nhc;
+
+  table = nexthop_cache_table[family2afi (rn->p.family)];
+  if (! table || ! table->top)
+    return;
+
+  /* Hold the subtree root, which may have been made for the walk. */
+  top = route_lock_node (route_node_get (table, &rn->p));
+  for (node = top; node; node = route_next_until (node, top))
+    if ((nhc = node->info) != NULL
+	&& (! nhc->resolving || nhc->resolving == rn
+	    || nhc->resolving->p.prefixlen < rn->p.prefixlen))
+      nexthop_cache_resolve (nhc);
+  route_unlock_node (top);
+}
+
+/* Find the route resolving the nexthop address p for a route at top,
+ * and set *matchp to it.  Returns 0 if there is none. */
+static int
+nexthop_cache_match (struct rib *rib, struct nexthop *nexthop, int set,
+		     struct route_node *top, struct prefix *p,
+		     struct rib **matchp)
+{
+  struct nexthop_cache *nhc;
+  struct route_node *rn;
+  struct rib *match;
+
+  nhc = nexthop_cache_get (top, p);
+
+  /* Let rib_process() know the resolution has changed since the
+   * nexthop was last set up. */
+  if (set)
+    nexthop->cache_gen = nhc->gen;
+  else if (nexthop->cache_gen != nhc->gen)
+    SET_FLAG (rib->flags, ZEBRA_FLAG_CHANGED);
+
+  rn = nhc->resolving;
+  if (! rn)
+    return 0;
+
+  /* The route itself lies between the match and the resolving route. */
+  if (top->p.family == p->family
+      && top->p.prefixlen >= rn->p.prefixlen
+      && prefix_match (&top->p, p))
+    return 0;
+
+  /* The resolving route is being changed and its node not processed
+   * yet; look further up, as the entry will once it is. */
+  match = rib_selected (rn);
+  if (! match || match->type == ZEBRA_ROUTE_BGP)
+    {
+      rn = rib_resolve_walk (rn->parent, top, &match);
+      if (! rn)
+	return 0;
+    }
+
+  *matchp = match;
+  return 1;
+}
+
 /* If force flag is not set, do not modify falgs at all for uninstall
    the route from FIB. */
 static int
@@ -413,8 +888,6 @@ nexthop_active_ipv4 (struct rib *rib, struct nexthop *nexthop, int set,
 		     struct route_node *top)
 {
   struct prefix_ipv4 p;
-  struct route_table *table;
-  struct route_node *rn;
   struct rib *match;
   int resolved;
   struct nexthop *newhop;
@@ -436,113 +909,75 @@ nexthop_active_ipv4 (struct rib *rib, struct nexthop *nexthop, int set,
   p.prefixlen = IPV4_MAX_PREFIXLEN;
   p.prefix = nexthop->gate.ipv4;
 
-  /* Lookup table.  */
-  table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
-  if (! table)
+  if (! nexthop_cache_match (rib, nexthop, set, top, (struct prefix *) &p,
+			     &match))
     return 0;
 
-  rn = route_node_match (table, (struct prefix *) &p);
-  while (rn)
-    {
-      route_unlock_node (rn);
-      
-      /* If lookup self prefix return immediately. */
-      if (rn == top)
-	return 0;
-
-      /* Pick up selected route. */
-      RNODE_FOREACH_RIB (rn, match)
-	{
-	  if (CHECK_FLAG (match->status, RIB_ENTRY_REMOVED))
-	    continue;
-	  if (CHECK_FLAG (match->flags, ZEBRA_FLAG_SELECTED))
-	    break;
-	}
+  /* If the longest prefix match for the nexthop yields
+   * a blackhole, mark it as inactive. */
+  if (CHECK_FLAG (match->flags, ZEBRA_FLAG_BLACKHOLE)
+      || CHECK_FLAG (match->flags, ZEBRA_FLAG_REJECT))
+    return 0;
 
-      /* If there is no selected route or matched route is EGP, go up
-         tree. */
-      if (! match 
-	  || match->type == ZEBRA_ROUTE_BGP)
-	{
-	  do {
-	    rn = rn->parent;
-	  } while (rn && rn->info == NULL);
-	  if (rn)
-	    route_lock_node (rn);
-	}
-      else
-	{
-	  /* If the longest prefix match for the nexthop yields
-	   * a blackhole, mark it as inactive. */
-	  if (CHECK_FLAG (match->flags, ZEBRA_FLAG_BLACKHOLE)
-	      || CHECK_FLAG (match->flags, ZEBRA_FLAG_REJECT))
-	    return 0;
+  if (match->type == ZEBRA_ROUTE_CONNECT)
+    {
+      /* Directly point connected route. */
+      newhop = RIB_NEXTHOPS (match);
+      if (newhop && nexthop->type == NEXTHOP_TYPE_IPV4)
+	nexthop->ifindex = newhop->ifindex;
 
-	  if (match->type == ZEBRA_ROUTE_CONNECT)
-	    {
-	      /* Directly point connected route. */
-	      newhop = match->nexthop;
-	      if (newhop && nexthop->type == NEXTHOP_TYPE_IPV4)
-		nexthop->ifindex = newhop->ifindex;
-	      
-	      return 1;
-	    }
-	  else if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_INTERNAL))
-	    {
-	      resolved = 0;
-	      for (newhop = match->nexthop; newhop; newhop = newhop->next)
-		if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB)
-		    && ! CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_RECURSIVE))
+      return 1;
+    }
+  else if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_INTERNAL))
+    {
+      resolved = 0;
+      for (newhop = RIB_NEXTHOPS (match); newhop; newhop = newhop->next)
+	if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB)
+	    && ! CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_RECURSIVE))
+	  {
+	    if (set)
+	      {
+		SET_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE);
+
+		resolved_hop = XCALLOC(MTYPE_NEXTHOP, sizeof (struct nexthop));
+		SET_FLAG (resolved_hop->flags, NEXTHOP_FLAG_ACTIVE);
+		/* If the resolving route specifies a gateway, use it */
+		if (newhop->type == NEXTHOP_TYPE_IPV4
+		    || newhop->type == NEXTHOP_TYPE_IPV4_IFINDEX
+		    || newhop->type == NEXTHOP_TYPE_IPV4_IFNAME)
 		  {
-		    if (set)
+		    resolved_hop->type = newhop->type;
+		    resolved_hop->gate.ipv4 = newhop->gate.ipv4;
+
+		    if (newhop->ifindex)
 		      {
-			SET_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE);
-
-			resolved_hop = XCALLOC(MTYPE_NEXTHOP, sizeof (struct nexthop));
-			SET_FLAG (resolved_hop->flags, NEXTHOP_FLAG_ACTIVE);
-			/* If the resolving route specifies a gateway, use it */
-			if (newhop->type == NEXTHOP_TYPE_IPV4
-			    || newhop->type == NEXTHOP_TYPE_IPV4_IFINDEX
-			    || newhop->type == NEXTHOP_TYPE_IPV4_IFNAME)
-			  {
-			    resolved_hop->type = newhop->type;
-			    resolved_hop->gate.ipv4 = newhop->gate.ipv4;
-
-			    if (newhop->ifindex)
-			      {
-				resolved_hop->type = NEXTHOP_TYPE_IPV4_IFINDEX;
-				resolved_hop->ifindex = newhop->ifindex;
-			      }
-			  }
-
-			/* If the resolving route is an interface route,
-			 * it means the gateway we are looking up is connected
-			 * to that interface. (The actual network is _not_ onlink).
-			 * Therefore, the resolved route should have the original
-			 * gateway as nexthop as it is directly connected.
-			 *
-			 * On Linux, we have to set the onlink netlink flag because
-			 * otherwise, the kernel won't accept the route. */
-			if (newhop->type == NEXTHOP_TYPE_IFINDEX
-			    || newhop->type == NEXTHOP_TYPE_IFNAME)
-			  {
-			    resolved_hop->flags |= NEXTHOP_FLAG_ONLINK;
-			    resolved_hop->type = NEXTHOP_TYPE_IPV4_IFINDEX;
-			    resolved_hop->gate.ipv4 = nexthop->gate.ipv4;
-			    resolved_hop->ifindex = newhop->ifindex;
-			  }
-
-			_nexthop_add(&nexthop->resolved, resolved_hop);
+			resolved_hop->type = NEXTHOP_TYPE_IPV4_IFINDEX;
+			resolved_hop->ifindex = newhop->ifindex;
 		      }
-		    resolved = 1;
 		  }
-	      return resolved;
-	    }
-	  else
-	    {
-	      return 0;
-	    }
-	}
+
+		/* If the resolving route is an interface route,
+		 * it means the gateway we are looking up is connected
+		 * to that interface. (The actual network is _not_ onlink).
+		 * Therefore, the resolved route should have the original
+		 * gateway as nexthop as it is directly connected.
+		 *
+		 * On Linux, we have to set the onlink netlink flag because
+		 * otherwise, the kernel won't accept the route. */
+		if (newhop->type == NEXTHOP_TYPE_IFINDEX
+		    || newhop->type == NEXTHOP_TYPE_IFNAME)
+		  {
+		    resolved_hop->flags |= NEXTHOP_FLAG_ONLINK;
+		    resolved_hop->type = NEXTHOP_TYPE_IPV4_IFINDEX;
+		    resolved_hop->gate.ipv4 = nexthop->gate.ipv4;
+		    resolved_hop->ifindex = newhop->ifindex;
+		  }
+
+		_nexthop_add(&nexthop->resolved, resolved_hop);
+	      }
+	    resolved = 1;
+	  }
+      return resolved;
     }
   return 0;
 }
@@ -555,8 +990,6 @@ nexthop_active_ipv6 (struct rib *rib, struct nexthop *nexthop, int set,
 		     struct route_node *top)
 {
   struct prefix_ipv6 p;
-  struct route_table *table;
-  struct route_node *rn;
   struct rib *match;
   int resolved;
   struct nexthop *newhop;
@@ -578,107 +1011,69 @@ nexthop_active_ipv6 (struct rib *rib, struct nexthop *nexthop, int set,
   p.prefixlen = IPV6_MAX_PREFIXLEN;
   p.prefix = nexthop->gate.ipv6;
 
-  /* Lookup table.  */
-  table = vrf_table (AFI_IP6, SAFI_UNICAST, 0);
-  if (! table)
+  if (! nexthop_cache_match (rib, nexthop, set, top, (struct prefix *) &p,
+			     &match))
     return 0;
 
-  rn = route_node_match (table, (struct prefix *) &p);
-  while (rn)
-    {
-      route_unlock_node (rn);
-      
-      /* If lookup self prefix return immediately. */
-      if (rn == top)
-	return 0;
-
-      /* Pick up selected route. */
-      RNODE_FOREACH_RIB (rn, match)
-	{
-	  if (CHECK_FLAG (match->status, RIB_ENTRY_REMOVED))
-	    continue;
-	  if (CHECK_FLAG (match->flags, ZEBRA_FLAG_SELECTED))
-	    break;
-	}
+  /* If the longest prefix match for the nexthop yields
+   * a blackhole, mark it as inactive. */
+  if (CHECK_FLAG (match->flags, ZEBRA_FLAG_BLACKHOLE)
+      || CHECK_FLAG (match->flags, ZEBRA_FLAG_REJECT))
+    return 0;
 
-      /* If there is no selected route or matched route is EGP, go up
-         tree. */
-      if (! match
-	  || match->type == ZEBRA_ROUTE_BGP)
-	{
-	  do {
-	    rn = rn->parent;
-	  } while (rn && rn->info == NULL);
-	  if (rn)
-	    route_lock_node (rn);
-	}
-      else
-	{
-	  /* If the longest prefix match for the nexthop yields
-	   * a blackhole, mark it as inactive. */
-	  if (CHECK_FLAG (match->flags, ZEBRA_FLAG_BLACKHOLE)
-	      || CHECK_FLAG (match->flags, ZEBRA_FLAG_REJECT))
-	    return 0;
+  if (match->type == ZEBRA_ROUTE_CONNECT)
+    {
+      /* Directly point connected route. */
+      newhop = RIB_NEXTHOPS (match);
 
-	  if (match->type == ZEBRA_ROUTE_CONNECT)
-	    {
-	      /* Directly point connected route. */
-	      newhop = match->nexthop;
+      if (newhop && nexthop->type == NEXTHOP_TYPE_IPV6)
+	nexthop->ifindex = newhop->ifindex;
 
-	      if (newhop && nexthop->type == NEXTHOP_TYPE_IPV6)
-		nexthop->ifindex = newhop->ifindex;
-	      
-	      return 1;
-	    }
-	  else if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_INTERNAL))
-	    {
-	      resolved = 0;
-	      for (newhop = match->nexthop; newhop; newhop = newhop->next)
-		if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB)
-		    && ! CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_RECURSIVE))
+      return 1;
+    }
+  else if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_INTERNAL))
+    {
+      resolved = 0;
+      for (newhop = RIB_NEXTHOPS (match); newhop; newhop = newhop->next)
+	if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB)
+	    && ! CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_RECURSIVE))
+	  {
+	    if (set)
+	      {
+		SET_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE);
+
+		resolved_hop = XCALLOC(MTYPE_NEXTHOP, sizeof (struct nexthop));
+		SET_FLAG (resolved_hop->flags, NEXTHOP_FLAG_ACTIVE);
+		/* See nexthop_active_ipv4 for a description how the
+		 * resolved nexthop is constructed. */
+		if (newhop->type == NEXTHOP_TYPE_IPV6
+		    || newhop->type == NEXTHOP_TYPE_IPV6_IFINDEX
+		    || newhop->type == NEXTHOP_TYPE_IPV6_IFNAME)
 		  {
-		    if (set)
+		    resolved_hop->type = newhop->type;
+		    resolved_hop->gate.ipv6 = newhop->gate.ipv6;
+
+		    if (newhop->ifindex)
 		      {
-			SET_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE);
-
-			resolved_hop = XCALLOC(MTYPE_NEXTHOP, sizeof (struct nexthop));
-			SET_FLAG (resolved_hop->flags, NEXTHOP_FLAG_ACTIVE);
-			/* See nexthop_active_ipv4 for a description how the
-			 * resolved nexthop is constructed. */
-			if (newhop->type == NEXTHOP_TYPE_IPV6
-			    || newhop->type == NEXTHOP_TYPE_IPV6_IFINDEX
-			    || newhop->type == NEXTHOP_TYPE_IPV6_IFNAME)
-			  {
-			    resolved_hop->type = newhop->type;
-			    resolved_hop->gate.ipv6 = newhop->gate.ipv6;
-
-			    if (newhop->ifindex)
-			      {
-				resolved_hop->type = NEXTHOP_TYPE_IPV6_IFINDEX;
-				resolved_hop->ifindex = newhop->ifindex;
-			      }
-			  }
-
-			if (newhop->type == NEXTHOP_TYPE_IFINDEX
-			    || newhop->type == NEXTHOP_TYPE_IFNAME)
-			  {
-				resolved_hop->flags |= NEXTHOP_FLAG_ONLINK;
-				resolved_hop->type = NEXTHOP_TYPE_IPV6_IFINDEX;
-				resolved_hop->gate.ipv6 = nexthop->gate.ipv6;
-				resolved_hop->ifindex = newhop->ifindex;
-			  }
-
-			_nexthop_add(&nexthop->resolved, resolved_hop);
+			resolved_hop->type = NEXTHOP_TYPE_IPV6_IFINDEX;
+			resolved_hop->ifindex = newhop->ifindex;
 		      }
-		    resolved = 1;
 		  }
-	      return resolved;
-	    }
-	  else
-	    {
-	      return 0;
-	    }
-	}
+
+		if (newhop->type == NEXTHOP_TYPE_IFINDEX
+		    || newhop->type == NEXTHOP_TYPE_IFNAME)
+		  {
+		    resolved_hop->flags |= NEXTHOP_FLAG_ONLINK;
+		    resolved_hop->type = NEXTHOP_TYPE_IPV6_IFINDEX;
+		    resolved_hop->gate.ipv6 = nexthop->gate.ipv6;
+		    resolved_hop->ifindex = newhop->ifindex;
+		  }
+
+		_nexthop_add(&nexthop->resolved, resolved_hop);
+	      }
+	    resolved = 1;
+	  }
+      return resolved;
     }
   return 0;
 }
@@ -737,7 +1132,7 @@ rib_match_ipv4 (struct in_addr addr)
 	    return match;
 	  else
 	    {
-	      for (ALL_NEXTHOPS_RO(match->nexthop, newhop, tnewhop, recursing))
+	      for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (match), newhop, tnewhop, recursing))
 		if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB))
 		  return match;
 	      return NULL;
@@ -784,7 +1179,7 @@ rib_lookup_ipv4 (struct prefix_ipv4 *p)
   if (match->type == ZEBRA_ROUTE_CONNECT)
     return match;
   
-  for (ALL_NEXTHOPS_RO(match->nexthop, nexthop, tnexthop, recursing))
+  for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (match), nexthop, tnexthop, recursing))
     if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
       return match;
 
@@ -846,7 +1241,7 @@ rib_lookup_ipv4_route (struct prefix_ipv4 *p, union sockunion * qgate)
   
   /* Ok, we have a cood candidate, let's check it's nexthop list... */
   nexthops_active = 0;
-  for (ALL_NEXTHOPS_RO(match->nexthop, nexthop, tnexthop, recursing))
+  for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (match), nexthop, tnexthop, recursing))
     if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
       {
         nexthops_active = 1;
@@ -922,7 +1317,7 @@ rib_match_ipv6 (struct in6_addr *addr)
 	    return match;
 	  else
 	    {
-	      for (ALL_NEXTHOPS_RO(match->nexthop, newhop, tnewhop, recursing))
+	      for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (match), newhop, tnewhop, recursing))
 		if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB))
 		  return match;
 	      return NULL;
@@ -961,6 +1356,7 @@ nexthop_active_check (struct route_node *rn, struct rib *rib,
   switch (nexthop->type)
     {
     case NEXTHOP_TYPE_IFINDEX:
+      nexthop_cache_depend (rn, &nexthop_cache_interface);
       ifp = if_lookup_by_index (nexthop->ifindex);
       if (ifp && if_is_operative(ifp))
 	SET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
@@ -970,6 +1366,7 @@ nexthop_active_check (struct route_node *rn, struct rib *rib,
     case NEXTHOP_TYPE_IPV6_IFNAME:
       family = AFI_IP6;
     case NEXTHOP_TYPE_IFNAME:
+      nexthop_cache_depend (rn, &nexthop_cache_interface);
       ifp = if_lookup_by_name (nexthop->ifname);
       if (ifp && if_is_operative(ifp))
 	{
@@ -1004,6 +1401,7 @@ nexthop_active_check (struct route_node *rn, struct rib *rib,
       family = AFI_IP6;
       if (IN6_IS_ADDR_LINKLOCAL (&nexthop->gate.ipv6))
 	{
+	  nexthop_cache_depend (rn, &nexthop_cache_interface);
 	  ifp = if_lookup_by_index (nexthop->ifindex);
 	  if (ifp && if_is_operative(ifp))
 	    SET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
@@ -1060,10 +1458,15 @@ nexthop_active_check (struct route_node *rn, struct rib *rib,
 }
 
 /* Iterate over all nexthops of the given RIB entry and refresh their
- * ACTIVE flag. rib->nexthop_active_num is updated accordingly. If any
- * nexthop is found to toggle the ACTIVE flag, the whole rib structure
- * is flagged with ZEBRA_FLAG_CHANGED. The 4th 'set' argument is
- * transparently passed to nexthop_active_check().
+ * state. rib->nexthop_active_num is updated accordingly. If the state
+ * of any nexthop changes, the whole rib structure is flagged with
+ * ZEBRA_FLAG_CHANGED. The 4th 'set' argument is transparently passed
+ * to nexthop_active_check().
+ *
+ * The nexthops are refreshed in a copy of the rib's group, which is
+ * then interned: they are unchanged if that finds the same group again.
+ * A group that wasn't interned has been changed since the rib was last
+ * processed.
  *
  * Return value is the new number of active nexthops.
  */
@@ -1071,22 +1474,32 @@ nexthop_active_check (struct route_node *rn, struct rib *rib,
 static int
 nexthop_active_update (struct route_node *rn, struct rib *rib, int set)
 {
+  struct nexthop_group *old = rib->nhg;
   struct nexthop *nexthop;
-  unsigned int prev_active, prev_index, new_active;
+  int interned;
 
   rib->nexthop_active_num = 0;
   UNSET_FLAG (rib->flags, ZEBRA_FLAG_CHANGED);
 
-  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-  {
-    prev_active = CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
-    prev_index = nexthop->ifindex;
-    if ((new_active = nexthop_active_check (rn, rib, nexthop, set)))
+  if (! old)
+    return 0;
+
+  /* Hold the old group, so that unsharing copies it. */
+  interned = (old->refcnt > 0);
+  if (interned)
+    old->refcnt++;
+
+  for (nexthop = rib_nexthop_group_unshare (rib)->nexthop; nexthop;
+       nexthop = nexthop->next)
+    if (nexthop_active_check (rn, rib, nexthop, set))
       rib->nexthop_active_num++;
-    if (prev_active != new_active ||
-	prev_index != nexthop->ifindex)
-      SET_FLAG (rib->flags, ZEBRA_FLAG_CHANGED);
-  }
+  rib_nexthop_group_intern (rib);
+
+  if (! interned || rib->nhg != old)
+    SET_FLAG (rib->flags, ZEBRA_FLAG_CHANGED);
+  if (interned)
+    nexthop_group_unlock (old);
+
   return rib->nexthop_active_num;
 }
 
@@ -1104,6 +1517,9 @@ rib_install_kernel (struct route_node *rn, struct rib *rib)
    * the kernel.
    */
   zfpm_trigger_update (rn, "installing in kernel");
+
+  /* The kernel code flags the nexthops it installs. */
+  rib_nexthop_group_unshare (rib);
   switch (PREFIX_FAMILY (&rn->p))
     {
     case AF_INET:
@@ -1119,9 +1535,10 @@ rib_install_kernel (struct route_node *rn, struct rib *rib)
   /* This condition is never met, if we are using rt_socket.c */
   if (ret < 0)
     {
-      for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+      for (ALL_NEXTHOPS_RO(rib->nhg->nexthop, nexthop, tnexthop, recursing))
 	UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
     }
+  rib_nexthop_group_intern (rib);
 }
 
 /* Uninstall the route from kernel. */
@@ -1138,6 +1555,7 @@ rib_uninstall_kernel (struct route_node *rn, struct rib *rib)
    */
   zfpm_trigger_update (rn, "uninstalling from kernel");
 
+  rib_nexthop_group_unshare (rib);
   switch (PREFIX_FAMILY (&rn->p))
     {
     case AF_INET:
@@ -1150,8 +1568,9 @@ rib_uninstall_kernel (struct route_node *rn, struct rib *rib)
 #endif /* HAVE_IPV6 */
     }
 
-  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+  for (ALL_NEXTHOPS_RO(rib->nhg->nexthop, nexthop, tnexthop, recursing))
     UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+  rib_nexthop_group_intern (rib);
 
   return ret;
 }
@@ -1194,6 +1613,12 @@ rib_can_delete_dest (rib_dest_t *dest)
       CHECK_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM))
     return 0;
 
+  /*
+   * Nor while it is on the meta queue.
+   */
+  if (CHECK_FLAG (dest->flags, RIB_ROUTE_ANY_QUEUED))
+    return 0;
+
   return 1;
 }
 
@@ -1225,6 +1650,7 @@ rib_gc_dest (struct route_node *rn)
 		  buf, rn->p.prefixlen);
     }
 
+  nexthop_cache_dest_prune (dest, 1);
   dest->rnode = NULL;
   XFREE (MTYPE_RIB_DEST, dest);
   rn->info = NULL;
@@ -1251,6 +1677,7 @@ rib_process (struct route_node *rn)
   char buf[INET6_ADDRSTRLEN];
   
   assert (rn);
+  rib_process_seq++;
   
   if (IS_ZEBRA_DEBUG_RIB || IS_ZEBRA_DEBUG_RIB_Q)
     inet_ntop (rn->p.family, &rn->p.u.prefix, buf, INET6_ADDRSTRLEN);
@@ -1370,7 +1797,7 @@ rib_process (struct route_node *rn)
              This makes sure the routes are IN the kernel.
            */
 
-          for (ALL_NEXTHOPS_RO(select->nexthop, nexthop, tnexthop, recursing))
+          for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (select), nexthop, tnexthop, recursing))
             if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
             {
               installed = 1;
@@ -1437,60 +1864,56 @@ end:
   if (IS_ZEBRA_DEBUG_RIB_Q)
     zlog_debug ("%s: %s/%d: rn %p dequeued", __func__, buf, rn->p.prefixlen, rn);
 
+  /* Resolve again the nexthops this node may affect, and forget the
+   * ones its routes no longer use. */
+  nexthop_cache_route_changed (rn);
+  if (rn->info)
+    nexthop_cache_dest_prune (rib_dest_from_rnode (rn), 0);
+
   /*
    * Check if the dest can be deleted now.
    */
   rib_gc_dest (rn);
 }
 
-/* Take a list of route_node structs and return 1, if there was a record
- * picked from it and processed by rib_process(). Don't process more, 
- * than one RN record; operate only in the specified sub-queue.
+/* Take the first dest off the given sub-queue and process it.  Return
+ * 1, if there was one.
  */
 static unsigned int
-process_subq (struct list * subq, u_char qindex)
+process_subq (struct meta_queue *mq, u_char qindex)
 {
-  struct listnode *lnode  = listhead (subq);
+  rib_dest_t *dest = TAILQ_FIRST (&mq->subq[qindex]);
   struct route_node *rnode;
 
-  if (!lnode)
+  if (!dest)
     return 0;
 
-  rnode = listgetdata (lnode);
-  rib_process (rnode);
-
-  if (rnode->info)
-    UNSET_FLAG (rib_dest_from_rnode (rnode)->flags, RIB_ROUTE_QUEUED (qindex));
+  TAILQ_REMOVE (&mq->subq[qindex], dest, mq_entries);
+  UNSET_FLAG (dest->flags, RIB_ROUTE_QUEUED (qindex));
+  mq->size--;
 
-#if 0
-  else
-    {
-      zlog_debug ("%s: called for route_node (%p, %d) with no ribs",
-                  __func__, rnode, rnode->lock);
-      zlog_backtrace(LOG_DEBUG);
-    }
-#endif
+  rnode = dest->rnode;
+  rib_process (rnode);
   route_unlock_node (rnode);
-  list_delete_node (subq, lnode);
   return 1;
 }
 
-/* Dispatch the meta queue by picking, processing and unlocking the next RN from
- * a non-empty sub-queue with lowest priority. wq is equal to zebra->ribq and data
- * is pointed to the meta queue structure.
+/* Dispatch the meta queue by picking, processing and unlocking up to
+ * rib_process_batch RNs, each from the non-empty sub-queue with the
+ * highest priority. wq is equal to zebra->ribq and data is pointed to
+ * the meta queue structure.
  */
 static wq_item_status
 meta_queue_process (struct work_queue *dummy, void *data)
 {
   struct meta_queue * mq = data;
   unsigned i;
+  int n;
 
-  for (i = 0; i < MQ_SIZE; i++)
-    if (process_subq (mq->subq[i], i))
-      {
-	mq->size--;
-	break;
-      }
+  for (n = 0; n < rib_process_batch && mq->size; n++)
+    for (i = 0; i < MQ_SIZE; i++)
+      if (process_subq (mq, i))
+        break;
   return mq->size ? WQ_REQUEUE : WQ_SUCCESS;
 }
 
@@ -1512,41 +1935,56 @@ static const u_char meta_queue_map[ZEBRA_ROUTE_MAX] = {
   [ZEBRA_ROUTE_BABEL]   = 2,
 };
 
-/* Look into the RN and queue it into one or more priority queues,
- * increasing the size for each data push done.
+/* Queue the RN's dest into the priority queue of its highest priority
+ * RIB.  A dest is on at most one sub-queue, as processing it once takes
+ * care of all its RIBs; if it is already queued with lower priority, it
+ * is moved up.
  */
 static void
 rib_meta_queue_add (struct meta_queue *mq, struct route_node *rn)
 {
+  rib_dest_t *dest = rib_dest_from_rnode (rn);
   struct rib *rib;
+  u_char qindex = MQ_SIZE, old;
   char buf[INET6_ADDRSTRLEN];
 
   if (IS_ZEBRA_DEBUG_RIB_Q)
     inet_ntop (rn->p.family, &rn->p.u.prefix, buf, INET6_ADDRSTRLEN);
 
+  /* Invariant: at this point we always have rn->info set. */
   RNODE_FOREACH_RIB (rn, rib)
-    {
-      u_char qindex = meta_queue_map[rib->type];
+    if (meta_queue_map[rib->type] < qindex)
+      qindex = meta_queue_map[rib->type];
 
-      /* Invariant: at this point we always have rn->info set. */
-      if (CHECK_FLAG (rib_dest_from_rnode (rn)->flags,
-		      RIB_ROUTE_QUEUED (qindex)))
-	{
-	  if (IS_ZEBRA_DEBUG_RIB_Q)
-	    zlog_debug ("%s: %s/%d: rn %p is already queued in sub-queue %u",
-			__func__, buf, rn->p.prefixlen, rn, qindex);
-	  continue;
-	}
+  for (old = 0; old < MQ_SIZE; old++)
+    if (CHECK_FLAG (dest->flags, RIB_ROUTE_QUEUED (old)))
+      break;
+
+  if (old <= qindex)
+    {
+      if (IS_ZEBRA_DEBUG_RIB_Q)
+	zlog_debug ("%s: %s/%d: rn %p is already queued in sub-queue %u",
+		    __func__, buf, rn->p.prefixlen, rn, old);
+      return;
+    }
 
-      SET_FLAG (rib_dest_from_rnode (rn)->flags, RIB_ROUTE_QUEUED (qindex));
-      listnode_add (mq->subq[qindex], rn);
+  if (old < MQ_SIZE)
+    {
+      TAILQ_REMOVE (&mq->subq[old], dest, mq_entries);
+      UNSET_FLAG (dest->flags, RIB_ROUTE_QUEUED (old));
+    }
+  else
+    {
       route_lock_node (rn);
       mq->size++;
-
-      if (IS_ZEBRA_DEBUG_RIB_Q)
-	zlog_debug ("%s: %s/%d: queued rn %p into sub-queue %u",
-		    __func__, buf, rn->p.prefixlen, rn, qindex);
     }
+
+  SET_FLAG (dest->flags, RIB_ROUTE_QUEUED (qindex));
+  TAILQ_INSERT_TAIL (&mq->subq[qindex], dest, mq_entries);
+
+  if (IS_ZEBRA_DEBUG_RIB_Q)
+    zlog_debug ("%s: %s/%d: queued rn %p into sub-queue %u",
+		__func__, buf, rn->p.prefixlen, rn, qindex);
 }
 
 /* Add route_node to work queue and schedule processing */
@@ -1611,10 +2049,7 @@ meta_queue_new (void)
   assert(new);
 
   for (i = 0; i < MQ_SIZE; i++)
-    {
-      new->subq[i] = list_new ();
-      assert(new->subq[i]);
-    }
+    TAILQ_INIT (&new->subq[i]);
 
   return new;
 }
@@ -1784,7 +2219,7 @@ rib_unlink (struct route_node *rn, struct rib *rib)
     }
 
   /* free RIB and nexthops */
-  nexthops_free(rib->nexthop);
+  rib_nexthop_group_release (rib);
   XFREE (MTYPE_RIB, rib);
 
 }
@@ -1854,7 +2289,7 @@ rib_add_ipv4 (int type, int flags, struct prefix_ipv4 *p,
           break;
         }
       /* Duplicate connected route comes in. */
-      else if ((nexthop = rib->nexthop) &&
+      else if ((nexthop = RIB_NEXTHOPS (rib)) &&
 	       nexthop->type == NEXTHOP_TYPE_IFINDEX &&
 	       nexthop->ifindex == ifindex &&
 	       !CHECK_FLAG (rib->status, RIB_ENTRY_REMOVED))
@@ -1887,7 +2322,7 @@ rib_add_ipv4 (int type, int flags, struct prefix_ipv4 *p,
 
   /* If this route is kernel route, set FIB flag to the route. */
   if (type == ZEBRA_ROUTE_KERNEL || type == ZEBRA_ROUTE_CONNECT)
-    for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+    for (nexthop = RIB_NEXTHOPS (rib); nexthop; nexthop = nexthop->next)
       SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
 
   /* Link new rib to node.*/
@@ -1947,7 +2382,7 @@ void rib_dump (const char * func, const struct prefix * p, const struct rib * ri
     rib->nexthop_fib_num
   );
 
-  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+  for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (rib), nexthop, tnexthop, recursing))
     {
       inet_ntop (p->family, &nexthop->gate, straddr, INET6_ADDRSTRLEN);
       zlog_debug
@@ -2109,7 +2544,7 @@ rib_add_ipv4_multipath (struct prefix_ipv4 *p, struct rib *rib, safi_t safi)
   
   /* If this route is kernel route, set FIB flag to the route. */
   if (rib->type == ZEBRA_ROUTE_KERNEL || rib->type == ZEBRA_ROUTE_CONNECT)
-    for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+    for (nexthop = RIB_NEXTHOPS (rib); nexthop; nexthop = nexthop->next)
       SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
 
   /* Link new rib to node.*/
@@ -2199,7 +2634,7 @@ rib_delete_ipv4 (int type, int flags, struct prefix_ipv4 *p,
 
       if (rib->type != type)
 	continue;
-      if (rib->type == ZEBRA_ROUTE_CONNECT && (nexthop = rib->nexthop) &&
+      if (rib->type == ZEBRA_ROUTE_CONNECT && (nexthop = RIB_NEXTHOPS (rib)) &&
 	  nexthop->type == NEXTHOP_TYPE_IFINDEX)
 	{
 	  if (nexthop->ifindex != ifindex)
@@ -2222,7 +2657,7 @@ rib_delete_ipv4 (int type, int flags, struct prefix_ipv4 *p,
               same = rib;
               break;
             }
-          for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+          for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (rib), nexthop, tnexthop, recursing))
             if (IPV4_ADDR_SAME (&nexthop->gate.ipv4, gate))
               {
                 same = rib;
@@ -2239,8 +2674,10 @@ rib_delete_ipv4 (int type, int flags, struct prefix_ipv4 *p,
       if (fib && type == ZEBRA_ROUTE_KERNEL)
 	{
 	  /* Unset flags. */
-	  for (nexthop = fib->nexthop; nexthop; nexthop = nexthop->next)
+	  for (nexthop = rib_nexthop_group_unshare (fib)->nexthop; nexthop;
+	       nexthop = nexthop->next)
 	    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+	  rib_nexthop_group_intern (fib);
 
 	  UNSET_FLAG (fib->flags, ZEBRA_FLAG_SELECTED);
 	}
@@ -2401,7 +2838,7 @@ static_uninstall_ipv4 (struct prefix *p, struct static_ipv4 *si)
     }
 
   /* Lookup nexthop. */
-  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+  for (nexthop = RIB_NEXTHOPS (rib); nexthop; nexthop = nexthop->next)
     if (static_ipv4_nexthop_same (nexthop, si))
       break;
 
@@ -2419,6 +2856,11 @@ static_uninstall_ipv4 (struct prefix *p, struct static_ipv4 *si)
     {
       if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
         rib_uninstall (rn, rib);
+      /* Find the nexthop again in the rib's own copy of the group. */
+      for (nexthop = rib_nexthop_group_unshare (rib)->nexthop; nexthop;
+	   nexthop = nexthop->next)
+	if (static_ipv4_nexthop_same (nexthop, si))
+	  break;
       nexthop_delete (rib, nexthop);
       nexthop_free (nexthop);
       rib_queue_add (&zebrad, rn);
@@ -2656,7 +3098,7 @@ rib_add_ipv6 (int type, int flags, struct prefix_ipv6 *p,
 	  same = rib;
 	  break;
 	}
-      else if ((nexthop = rib->nexthop) &&
+      else if ((nexthop = RIB_NEXTHOPS (rib)) &&
 	       nexthop->type == NEXTHOP_TYPE_IFINDEX &&
 	       nexthop->ifindex == ifindex)
 	{
@@ -2689,7 +3131,7 @@ rib_add_ipv6 (int type, int flags, struct prefix_ipv6 *p,
 
   /* If this route is kernel route, set FIB flag to the route. */
   if (type == ZEBRA_ROUTE_KERNEL || type == ZEBRA_ROUTE_CONNECT)
-    for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+    for (nexthop = RIB_NEXTHOPS (rib); nexthop; nexthop = nexthop->next)
       SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
 
   /* Link new rib to node.*/
@@ -2772,7 +3214,7 @@ rib_delete_ipv6 (int type, int flags, struct prefix_ipv6 *p,
 
       if (rib->type != type)
         continue;
-      if (rib->type == ZEBRA_ROUTE_CONNECT && (nexthop = rib->nexthop) &&
+      if (rib->type == ZEBRA_ROUTE_CONNECT && (nexthop = RIB_NEXTHOPS (rib)) &&
 	  nexthop->type == NEXTHOP_TYPE_IFINDEX)
 	{
 	  if (nexthop->ifindex != ifindex)
@@ -2795,7 +3237,7 @@ rib_delete_ipv6 (int type, int flags, struct prefix_ipv6 *p,
               same = rib;
               break;
             }
-          for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+          for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (rib), nexthop, tnexthop, recursing))
             if (IPV6_ADDR_SAME (&nexthop->gate.ipv6, gate))
               {
                 same = rib;
@@ -2813,8 +3255,10 @@ rib_delete_ipv6 (int type, int flags, struct prefix_ipv6 *p,
       if (fib && type == ZEBRA_ROUTE_KERNEL)
 	{
 	  /* Unset flags. */
-	  for (nexthop = fib->nexthop; nexthop; nexthop = nexthop->next)
+	  for (nexthop = rib_nexthop_group_unshare (fib)->nexthop; nexthop;
+	       nexthop = nexthop->next)
 	    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+	  rib_nexthop_group_intern (fib);
 
 	  UNSET_FLAG (fib->flags, ZEBRA_FLAG_SELECTED);
 	}
@@ -2976,7 +3420,7 @@ static_uninstall_ipv6 (struct prefix *p, struct static_ipv6 *si)
     }
 
   /* Lookup nexthop. */
-  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+  for (nexthop = RIB_NEXTHOPS (rib); nexthop; nexthop = nexthop->next)
     if (static_ipv6_nexthop_same (nexthop, si))
       break;
 
@@ -2996,6 +3440,11 @@ static_uninstall_ipv6 (struct prefix *p, struct static_ipv6 *si)
     {
       if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
         rib_uninstall (rn, rib);
+      /* Find the nexthop again in the rib's own copy of the group. */
+      for (nexthop = rib_nexthop_group_unshare (rib)->nexthop; nexthop;
+	   nexthop = nexthop->next)
+	if (static_ipv6_nexthop_same (nexthop, si))
+	  break;
       nexthop_delete (rib, nexthop);
       nexthop_free (nexthop);
       rib_queue_add (&zebrad, rn);
@@ -3146,24 +3595,14 @@ static_delete_ipv6 (struct prefix *p, u_char type, struct in6_addr *gate,
 }
 #endif /* HAVE_IPV6 */
 
-/* RIB update function. */
+/* RIB update function, called when an interface or its addresses
+ * change.  Only routes with nexthops naming an interface need looking
+ * at: gateway nexthops follow the connected routes through the nexthop
+ * cache. */
 void
 rib_update (void)
 {
-  struct route_node *rn;
-  struct route_table *table;
-  
-  table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
-  if (table)
-    for (rn = route_top (table); rn; rn = route_next (rn))
-      if (rnode_to_ribs (rn))
-        rib_queue_add (&zebrad, rn);
-
-  table = vrf_table (AFI_IP6, SAFI_UNICAST, 0);
-  if (table)
-    for (rn = route_top (table); rn; rn = route_next (rn))
-      if (rnode_to_ribs (rn))
-        rib_queue_add (&zebrad, rn);
+  nexthop_cache_requeue (&nexthop_cache_interface);
 }
 
 
@@ -3297,6 +3736,8 @@ void
 rib_init (void)
 {
   rib_queue_init (&zebrad);
+  nexthop_group_hash = hash_create (nexthop_group_hash_key,
+				    nexthop_group_hash_cmp);
   /* VRF initialization.  */
   vrf_init ();
 }
@@ -284,8 +284,8 @@ check_replace(struct route_node *np2, struct rib *rib2,
       return;
     }
 
-  if (in_addr_cmp((u_char *)&(*rib)->nexthop->gate.ipv4, 
-                  (u_char *)&rib2->nexthop->gate.ipv4) <= 0)
+  if (in_addr_cmp((u_char *)&RIB_NEXTHOPS (*rib)->gate.ipv4, 
+                  (u_char *)&RIB_NEXTHOPS (rib2)->gate.ipv4) <= 0)
     return;
 
   *np = np2;
@@ -371,7 +371,7 @@ get_fwtable_route_node(struct variable *v, oid objid[], size_t *objid_len,
 	    {
 	      RNODE_FOREACH_RIB (*np, *rib)
 	        {
-		  if (!in_addr_cmp((u_char *)&(*rib)->nexthop->gate.ipv4,
+		  if (!in_addr_cmp((u_char *)&RIB_NEXTHOPS (*rib)->gate.ipv4,
 				   (u_char *)&nexthop))
 		    if (proto == proto_trans((*rib)->type))
 		      return;
@@ -403,7 +403,7 @@ get_fwtable_route_node(struct variable *v, oid objid[], size_t *objid_len,
 	      if ((policy < policy2)
 		  || ((policy == policy2) && (proto < proto2))
 		  || ((policy == policy2) && (proto == proto2)
-		      && (in_addr_cmp((u_char *)&rib2->nexthop->gate.ipv4,
+		      && (in_addr_cmp((u_char *)&RIB_NEXTHOPS (rib2)->gate.ipv4,
 				      (u_char *) &nexthop) >= 0)
 		      ))
 		check_replace(np2, rib2, np, rib);
@@ -428,7 +428,7 @@ get_fwtable_route_node(struct variable *v, oid objid[], size_t *objid_len,
   {
     struct nexthop *nexthop;
 
-    nexthop = (*rib)->nexthop;
+    nexthop = RIB_NEXTHOPS (*rib);
     if (nexthop)
       {
 	pnt = (u_char *) &nexthop->gate.ipv4;
@@ -459,7 +459,7 @@ ipFwTable (struct variable *v, oid objid[], size_t *objid_len,
   if (!np)
     return NULL;
 
-  nexthop = rib->nexthop;
+  nexthop = RIB_NEXTHOPS (rib);
   if (! nexthop)
     return NULL;
 
@@ -583,7 +583,7 @@ vty_show_ip_route_detail (struct vty *vty, struct route_node *rn)
 	  vty_out (vty, " ago%s", VTY_NEWLINE);
 	}
 
-      for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+      for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (rib), nexthop, tnexthop, recursing))
 	{
           char addrstr[32];
 
@@ -663,9 +663,9 @@ vty_show_ip_route (struct vty *vty, struct route_node *rn, struct rib *rib)
   char buf[BUFSIZ];
 
   /* Nexthop information. */
-  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+  for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (rib), nexthop, tnexthop, recursing))
     {
-      if (nexthop == rib->nexthop)
+      if (nexthop == RIB_NEXTHOPS (rib))
 	{
 	  /* Prefix information. */
 	  len = vty_out (vty, "%c%c%c %s/%d",
@@ -781,36 +781,233 @@ vty_show_ip_route (struct vty *vty, struct route_node *rn, struct rib *rib)
     }
 }
 
-DEFUN (show_ip_route,
-       show_ip_route_cmd,
-       "show ip route",
-       SHOW_STR
-       IP_STR
-       "IP routing table\n")
+#ifdef HAVE_IPV6
+static void vty_show_ipv6_route (struct vty *, struct route_node *,
+				 struct rib *);
+#endif /* HAVE_IPV6 */
+
+/* Filters of the "show ip route" and "show ipv6 route" table walks. */
+enum zebra_show_type
 {
-  struct route_table *table;
+  zebra_show_type_all,
+  zebra_show_type_longer,
+  zebra_show_type_supernets,
+  zebra_show_type_protocol,
+};
+
+/* Table nodes a route table walk processes per event loop turn before
+   it yields to let the vty output drain. */
+#define ZEBRA_SHOW_CHUNK 1000
+
+/* State of a route table walk, kept across event loop turns.  VRF
+   tables are never freed, so the iterator can safely outlive the
+   command that started it. */
+struct zebra_show_state
+{
+  route_table_iter_t iter;
+  afi_t afi;
+  enum zebra_show_type type;
+  struct prefix p;
+  int route_type;
+  int compact;
+  int first;
+  void (*show) (struct vty *, struct route_node *, struct rib *);
+};
+
+/* Compact, machine-readable route line: codes, prefix, distance,
+   metric, then one field per nexthop, separated by single spaces. */
+static void
+vty_show_route_compact (struct vty *vty, struct route_node *rn,
+			struct rib *rib)
+{
+  struct nexthop *nexthop;
+  char buf[INET6_ADDRSTRLEN];
+  char codes[4];
+  const char *str;
+
+  codes[0] = zebra_route_char (rib->type);
+  codes[1] = CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELECTED) ? '>' : ' ';
+  codes[2] = (RIB_NEXTHOPS (rib)
+	      && CHECK_FLAG (RIB_NEXTHOPS (rib)->flags, NEXTHOP_FLAG_FIB))
+	     ? '*' : ' ';
+  codes[3] = ' ';
+  vty_out_buf (vty, codes, sizeof (codes));
+
+  str = inet_ntop (rn->p.family, &rn->p.u.prefix, buf, sizeof (buf));
+  vty_out_buf (vty, str, strlen (str));
+  vty_out_buf (vty, "/", 1);
+  vty_out_uint (vty, rn->p.prefixlen);
+  vty_out_buf (vty, " ", 1);
+  vty_out_uint (vty, rib->distance);
+  vty_out_buf (vty, " ", 1);
+  vty_out_uint (vty, rib->metric);
+
+  for (nexthop = RIB_NEXTHOPS (rib); nexthop; nexthop = nexthop->next)
+    {
+      vty_out_buf (vty, " ", 1);
+      switch (nexthop->type)
+	{
+	case NEXTHOP_TYPE_IPV4:
+	case NEXTHOP_TYPE_IPV4_IFINDEX:
+	case NEXTHOP_TYPE_IPV4_IFNAME:
+	  str = inet_ntop (AF_INET, &nexthop->gate.ipv4, buf, sizeof (buf));
+	  vty_out_buf (vty, str, strlen (str));
+	  break;
+#ifdef HAVE_IPV6
+	case NEXTHOP_TYPE_IPV6:
+	case NEXTHOP_TYPE_IPV6_IFINDEX:
+	case NEXTHOP_TYPE_IPV6_IFNAME:
+	  str = inet_ntop (AF_INET6, &nexthop->gate.ipv6, buf, sizeof (buf));
+	  vty_out_buf (vty, str, strlen (str));
+	  break;
+#endif /* HAVE_IPV6 */
+	case NEXTHOP_TYPE_BLACKHOLE:
+	  vty_out_buf (vty, "Null0", 5);
+	  continue;
+	default:
+	  break;
+	}
+
+      if (nexthop->type == NEXTHOP_TYPE_IFNAME
+	  || nexthop->type == NEXTHOP_TYPE_IPV4_IFNAME
+	  || nexthop->type == NEXTHOP_TYPE_IPV6_IFNAME)
+	str = nexthop->ifname;
+      else if (nexthop->ifindex)
+	str = ifindex2ifname (nexthop->ifindex);
+      else
+	continue;
+      vty_out_buf (vty, "@", 1);
+      vty_out_buf (vty, str, strlen (str));
+    }
+
+  vty_out_buf (vty, VTY_NEWLINE, strlen (VTY_NEWLINE));
+}
+
+static int
+vty_show_route_match (struct zebra_show_state *state, struct route_node *rn,
+		      struct rib *rib)
+{
+  u_int32_t addr;
+
+  switch (state->type)
+    {
+    case zebra_show_type_longer:
+      return prefix_match (&state->p, &rn->p);
+    case zebra_show_type_supernets:
+      addr = ntohl (rn->p.u.prefix4.s_addr);
+      return ((IN_CLASSC (addr) && rn->p.prefixlen < 24)
+	      || (IN_CLASSB (addr) && rn->p.prefixlen < 16)
+	      || (IN_CLASSA (addr) && rn->p.prefixlen < 8));
+    case zebra_show_type_protocol:
+      return rib->type == state->route_type;
+    default:
+      return 1;
+    }
+}
+
+/* Display up to ZEBRA_SHOW_CHUNK nodes of the table walk. */
+static int
+vty_show_route_chunk (struct vty *vty, void *arg)
+{
+  struct zebra_show_state *state = arg;
   struct route_node *rn;
   struct rib *rib;
-  int first = 1;
+  int count = 0;
 
-  table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
-  if (! table)
-    return CMD_SUCCESS;
-
-  /* Show all IPv4 routes. */
-  for (rn = route_top (table); rn; rn = route_next (rn))
+  while (count++ < ZEBRA_SHOW_CHUNK
+	 && (rn = route_table_iter_next (&state->iter)) != NULL)
     RNODE_FOREACH_RIB (rn, rib)
       {
-	if (first)
+	if (! vty_show_route_match (state, rn, rib))
+	  continue;
+
+	if (state->compact)
 	  {
-	    vty_out (vty, SHOW_ROUTE_V4_HEADER);
-	    first = 0;
+	    vty_show_route_compact (vty, rn, rib);
+	    continue;
 	  }
-	vty_show_ip_route (vty, rn, rib);
+
+	if (state->first)
+	  {
+	    if (state->afi == AFI_IP)
+	      vty_out (vty, SHOW_ROUTE_V4_HEADER);
+	    else
+	      vty_out (vty, SHOW_ROUTE_V6_HEADER);
+	    state->first = 0;
+	  }
+	state->show (vty, rn, rib);
       }
+
+  if (route_table_iter_is_done (&state->iter))
+    return VTY_OUTPUT_DONE;
+
+  route_table_iter_pause (&state->iter);
+  return VTY_OUTPUT_MORE;
+}
+
+static void
+vty_show_route_clean (struct vty *vty, void *arg)
+{
+  struct zebra_show_state *state = arg;
+
+  route_table_iter_cleanup (&state->iter);
+  XFREE (MTYPE_RIB_SHOW_STATE, state);
+}
+
+/* Start a walk of the unicast table of the given family, whose output
+   is deferred and produced a chunk at a time. */
+static int
+vty_show_route_table (struct vty *vty, afi_t afi, enum zebra_show_type type,
+		      struct prefix *p, int route_type, int compact)
+{
+  struct route_table *table;
+  struct zebra_show_state *state;
+
+  table = vrf_table (afi, SAFI_UNICAST, 0);
+  if (! table)
+    return CMD_SUCCESS;
+
+  state = XCALLOC (MTYPE_RIB_SHOW_STATE, sizeof (struct zebra_show_state));
+  route_table_iter_init (&state->iter, table);
+  state->afi = afi;
+  state->type = type;
+  if (p)
+    prefix_copy (&state->p, p);
+  state->route_type = route_type;
+  state->compact = compact;
+  state->first = 1;
+#ifdef HAVE_IPV6
+  if (afi == AFI_IP6)
+    state->show = vty_show_ipv6_route;
+  else
+#endif /* HAVE_IPV6 */
+    state->show = vty_show_ip_route;
+
+  vty_out_defer (vty, vty_show_route_chunk, vty_show_route_clean, state);
   return CMD_SUCCESS;
 }
 
+DEFUN (show_ip_route,
+       show_ip_route_cmd,
+       "show ip route",
+       SHOW_STR
+       IP_STR
+       "IP routing table\n")
+{
+  return vty_show_route_table (vty, AFI_IP, zebra_show_type_all, NULL, 0, 0);
+}
+
+DEFUN (show_ip_route_compact,
+       show_ip_route_compact_cmd,
+       "show ip route compact",
+       SHOW_STR
+       IP_STR
+       "IP routing table\n"
+       "Compact machine-readable output, one route per line\n")
+{
+  return vty_show_route_table (vty, AFI_IP, zebra_show_type_all, NULL, 0, 1);
+}
+
 DEFUN (show_ip_route_prefix_longer,
        show_ip_route_prefix_longer_cmd,
        "show ip route A.B.C.D/M longer-prefixes",
@@ -820,12 +1017,8 @@ DEFUN (show_ip_route_prefix_longer,
        "IP prefix <network>/<length>, e.g., 35.0.0.0/8\n"
        "Show route matching the specified Network/Mask pair only\n")
 {
-  struct route_table *table;
-  struct route_node *rn;
-  struct rib *rib;
   struct prefix p;
   int ret;
-  int first = 1;
 
   ret = str2prefix (argv[0], &p);
   if (! ret)
@@ -833,24 +1026,8 @@ DEFUN (show_ip_route_prefix_longer,
       vty_out (vty, "%% Malformed Prefix%s", VTY_NEWLINE);
       return CMD_WARNING;
     }
-  
-  table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
-  if (! table)
-    return CMD_SUCCESS;
 
-  /* Show matched type IPv4 routes. */
-  for (rn = route_top (table); rn; rn = route_next (rn))
-    RNODE_FOREACH_RIB (rn, rib)
-      if (prefix_match (&p, &rn->p))
-	{
-	  if (first)
-	    {
-	      vty_out (vty, SHOW_ROUTE_V4_HEADER);
-	      first = 0;
-	    }
-	  vty_show_ip_route (vty, rn, rib);
-	}
-  return CMD_SUCCESS;
+  return vty_show_route_table (vty, AFI_IP, zebra_show_type_longer, &p, 0, 0);
 }
 
 DEFUN (show_ip_route_supernets,
@@ -861,35 +1038,8 @@ DEFUN (show_ip_route_supernets,
        "IP routing table\n"
        "Show supernet entries only\n")
 {
-  struct route_table *table;
-  struct route_node *rn;
-  struct rib *rib;
-  u_int32_t addr; 
-  int first = 1;
-
-  table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
-  if (! table)
-    return CMD_SUCCESS;
-
-  /* Show matched type IPv4 routes. */
-  for (rn = route_top (table); rn; rn = route_next (rn))
-    RNODE_FOREACH_RIB (rn, rib)
-      {
-	addr = ntohl (rn->p.u.prefix4.s_addr);
-
-	if ((IN_CLASSC (addr) && rn->p.prefixlen < 24)
-	   || (IN_CLASSB (addr) && rn->p.prefixlen < 16)
-	   || (IN_CLASSA (addr) && rn->p.prefixlen < 8)) 
-	  {
-	    if (first)
-	      {
-		vty_out (vty, SHOW_ROUTE_V4_HEADER);
-		first = 0;
-	      }
-	    vty_show_ip_route (vty, rn, rib);
-	  }
-      }
-  return CMD_SUCCESS;
+  return vty_show_route_table (vty, AFI_IP, zebra_show_type_supernets,
+			       NULL, 0, 0);
 }
 
 DEFUN (show_ip_route_protocol,
@@ -901,10 +1051,6 @@ DEFUN (show_ip_route_protocol,
        QUAGGA_IP_REDIST_HELP_STR_ZEBRA)
 {
   int type;
-  struct route_table *table;
-  struct route_node *rn;
-  struct rib *rib;
-  int first = 1;
 
   type = proto_redistnum (AFI_IP, argv[0]);
   if (type < 0)
@@ -912,24 +1058,9 @@ DEFUN (show_ip_route_protocol,
       vty_out (vty, "Unknown route type%s", VTY_NEWLINE);
       return CMD_WARNING;
     }
-  
-  table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
-  if (! table)
-    return CMD_SUCCESS;
 
-  /* Show matched type IPv4 routes. */
-  for (rn = route_top (table); rn; rn = route_next (rn))
-    RNODE_FOREACH_RIB (rn, rib)
-      if (rib->type == type)
-	{
-	  if (first)
-	    {
-	      vty_out (vty, SHOW_ROUTE_V4_HEADER);
-	      first = 0;
-	    }
-	  vty_show_ip_route (vty, rn, rib);
-	}
-  return CMD_SUCCESS;
+  return vty_show_route_table (vty, AFI_IP, zebra_show_type_protocol,
+			       NULL, type, 0);
 }
 
 DEFUN (show_ip_route_addr,
@@ -1024,7 +1155,7 @@ vty_show_ip_route_summary (struct vty *vty, struct route_table *table)
   memset (&fib_cnt, 0, sizeof(fib_cnt));
   for (rn = route_top (table); rn; rn = route_next (rn))
     RNODE_FOREACH_RIB (rn, rib)
-      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+      for (nexthop = RIB_NEXTHOPS (rib); nexthop; nexthop = nexthop->next)
         {
 	  rib_cnt[ZEBRA_ROUTE_TOTAL]++;
 	  rib_cnt[rib->type]++;
@@ -1574,7 +1705,7 @@ vty_show_ipv6_route_detail (struct vty *vty, struct route_node *rn)
 	  vty_out (vty, " ago%s", VTY_NEWLINE);
 	}
 
-      for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+      for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (rib), nexthop, tnexthop, recursing))
 	{
 	  vty_out (vty, "  %c%s",
 		   CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB) ? '*' : ' ',
@@ -1628,9 +1759,9 @@ vty_show_ipv6_route (struct vty *vty, struct route_node *rn,
   char buf[BUFSIZ];
 
   /* Nexthop information. */
-  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+  for (ALL_NEXTHOPS_RO(RIB_NEXTHOPS (rib), nexthop, tnexthop, recursing))
     {
-      if (nexthop == rib->nexthop)
+      if (nexthop == RIB_NEXTHOPS (rib))
 	{
 	  /* Prefix information. */
 	  len = vty_out (vty, "%c%c%c %s/%d",
@@ -1726,27 +1857,18 @@ DEFUN (show_ipv6_route,
        IP_STR
        "IPv6 routing table\n")
 {
-  struct route_table *table;
-  struct route_node *rn;
-  struct rib *rib;
-  int first = 1;
-
-  table = vrf_table (AFI_IP6, SAFI_UNICAST, 0);
-  if (! table)
-    return CMD_SUCCESS;
+  return vty_show_route_table (vty, AFI_IP6, zebra_show_type_all, NULL, 0, 0);
+}
 
-  /* Show all IPv6 route. */
-  for (rn = route_top (table); rn; rn = route_next (rn))
-    RNODE_FOREACH_RIB (rn, rib)
-      {
-	if (first)
-	  {
-	    vty_out (vty, SHOW_ROUTE_V6_HEADER);
-	    first = 0;
-	  }
-	vty_show_ipv6_route (vty, rn, rib);
-      }
-  return CMD_SUCCESS;
+DEFUN (show_ipv6_route_compact,
+       show_ipv6_route_compact_cmd,
+       "show ipv6 route compact",
+       SHOW_STR
+       IP_STR
+       "IPv6 routing table\n"
+       "Compact machine-readable output, one route per line\n")
+{
+  return vty_show_route_table (vty, AFI_IP6, zebra_show_type_all, NULL, 0, 1);
 }
 
 DEFUN (show_ipv6_route_prefix_longer,
@@ -1758,16 +1880,8 @@ DEFUN (show_ipv6_route_prefix_longer,
        "IPv6 prefix\n"
        "Show route matching the specified Network/Mask pair only\n")
 {
-  struct route_table *table;
-  struct route_node *rn;
-  struct rib *rib;
   struct prefix p;
   int ret;
-  int first = 1;
-
-  table = vrf_table (AFI_IP6, SAFI_UNICAST, 0);
-  if (! table)
-    return CMD_SUCCESS;
 
   ret = str2prefix (argv[0], &p);
   if (! ret)
@@ -1776,19 +1890,7 @@ DEFUN (show_ipv6_route_prefix_longer,
       return CMD_WARNING;
     }
 
-  /* Show matched type IPv6 routes. */
-  for (rn = route_top (table); rn; rn = route_next (rn))
-    RNODE_FOREACH_RIB (rn, rib)
-      if (prefix_match (&p, &rn->p))
-	{
-	  if (first)
-	    {
-	      vty_out (vty, SHOW_ROUTE_V6_HEADER);
-	      first = 0;
-	    }
-	  vty_show_ipv6_route (vty, rn, rib);
-	}
-  return CMD_SUCCESS;
+  return vty_show_route_table (vty, AFI_IP6, zebra_show_type_longer, &p, 0, 0);
 }
 
 DEFUN (show_ipv6_route_protocol,
@@ -1800,10 +1902,6 @@ DEFUN (show_ipv6_route_protocol,
 	QUAGGA_IP6_REDIST_HELP_STR_ZEBRA)
 {
   int type;
-  struct route_table *table;
-  struct route_node *rn;
-  struct rib *rib;
-  int first = 1;
 
   type = proto_redistnum (AFI_IP6, argv[0]);
   if (type < 0)
@@ -1811,24 +1909,9 @@ DEFUN (show_ipv6_route_protocol,
       vty_out (vty, "Unknown route type%s", VTY_NEWLINE);
       return CMD_WARNING;
     }
-  
-  table = vrf_table (AFI_IP6, SAFI_UNICAST, 0);
-  if (! table)
-    return CMD_SUCCESS;
 
-  /* Show matched type IPv6 routes. */
-  for (rn = route_top (table); rn; rn = route_next (rn))
-    RNODE_FOREACH_RIB (rn, rib)
-      if (rib->type == type)
-	{
-	  if (first)
-	    {
-	      vty_out (vty, SHOW_ROUTE_V6_HEADER);
-	      first = 0;
-	    }
-	  vty_show_ipv6_route (vty, rn, rib);
-	}
-  return CMD_SUCCESS;
+  return vty_show_route_table (vty, AFI_IP6, zebra_show_type_protocol,
+			       NULL, type, 0);
 }
 
 DEFUN (show_ipv6_route_addr,
@@ -2090,6 +2173,7 @@ zebra_vty_init (void)
   install_element (CONFIG_NODE, &no_ip_route_mask_flags_distance2_cmd);
 
   install_element (VIEW_NODE, &show_ip_route_cmd);
+  install_element (VIEW_NODE, &show_ip_route_compact_cmd);
   install_element (VIEW_NODE, &show_ip_route_addr_cmd);
   install_element (VIEW_NODE, &show_ip_route_prefix_cmd);
   install_element (VIEW_NODE, &show_ip_route_prefix_longer_cmd);
@@ -2097,6 +2181,7 @@ zebra_vty_init (void)
   install_element (VIEW_NODE, &show_ip_route_supernets_cmd);
   install_element (VIEW_NODE, &show_ip_route_summary_cmd);
   install_element (ENABLE_NODE, &show_ip_route_cmd);
+  install_element (ENABLE_NODE, &show_ip_route_compact_cmd);
   install_element (ENABLE_NODE, &show_ip_route_addr_cmd);
   install_element (ENABLE_NODE, &show_ip_route_prefix_cmd);
   install_element (ENABLE_NODE, &show_ip_route_prefix_longer_cmd);
@@ -2126,12 +2211,14 @@ zebra_vty_init (void)
   install_element (CONFIG_NODE, &no_ipv6_route_ifname_pref_cmd);
   install_element (CONFIG_NODE, &no_ipv6_route_ifname_flags_pref_cmd);
   install_element (VIEW_NODE, &show_ipv6_route_cmd);
+  install_element (VIEW_NODE, &show_ipv6_route_compact_cmd);
   install_element (VIEW_NODE, &show_ipv6_route_summary_cmd);
   install_element (VIEW_NODE, &show_ipv6_route_protocol_cmd);
   install_element (VIEW_NODE, &show_ipv6_route_addr_cmd);
   install_element (VIEW_NODE, &show_ipv6_route_prefix_cmd);
   install_element (VIEW_NODE, &show_ipv6_route_prefix_longer_cmd);
   install_element (ENABLE_NODE, &show_ipv6_route_cmd);
+  install_element (ENABLE_NODE, &show_ipv6_route_compact_cmd);
   install_element (ENABLE_NODE, &show_ipv6_route_protocol_cmd);
   install_element (ENABLE_NODE, &show_ipv6_route_addr_cmd);
   install_element (ENABLE_NODE, &show_ipv6_route_prefix_cmd);
@@ -94,8 +94,10 @@ zserv_flush_data(struct thread *thread)
     case BUFFER_PENDING:
       client->t_write = thread_add_write(zebrad.master, zserv_flush_data,
       					 client, client->sock);
+      zebra_redistribute_dump_resume (client);
       break;
     case BUFFER_EMPTY:
+      zebra_redistribute_dump_resume (client);
       break;
     }
   return 0;
@@ -387,7 +389,7 @@ zsend_route_multipath (int cmd, struct zserv *client, struct prefix *p,
    */
   /* Nexthop */
   
-  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+  for (nexthop = RIB_NEXTHOPS (rib); nexthop; nexthop = nexthop->next)
     {
       if (CHECK_FLAG(nexthop->flags, NEXTHOP_FLAG_FIB)
           || nexthop_has_fib_child(nexthop))
@@ -492,7 +494,7 @@ zsend_ipv6_nexthop_lookup (struct zserv *client, struct in6_addr *addr)
       /* Only non-recursive routes are elegible to resolve nexthop we
        * are looking up. Therefore, we will just iterate over the top
        * chain of nexthops. */
-      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+      for (nexthop = RIB_NEXTHOPS (rib); nexthop; nexthop = nexthop->next)
 	if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
 	  {
 	    stream_putc (s, nexthop->type);
@@ -561,7 +563,7 @@ zsend_ipv4_nexthop_lookup (struct zserv *client, struct in_addr addr)
       /* Only non-recursive routes are elegible to resolve the nexthop we
        * are looking up. Therefore, we will just iterate over the top
        * chain of nexthops. */
-      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+      for (nexthop = RIB_NEXTHOPS (rib); nexthop; nexthop = nexthop->next)
 	if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
 	  {
 	    stream_putc (s, nexthop->type);
@@ -625,7 +627,7 @@ zsend_ipv4_import_lookup (struct zserv *client, struct prefix_ipv4 *p)
       num = 0;
       nump = stream_get_endp(s);
       stream_putc (s, 0);
-      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+      for (nexthop = RIB_NEXTHOPS (rib); nexthop; nexthop = nexthop->next)
 	if (CHECK_FLAG(nexthop->flags, NEXTHOP_FLAG_FIB)
             || nexthop_has_fib_child(nexthop))
 	  {
@@ -1158,6 +1160,8 @@ zebra_client_close (struct zserv *client)
       client->sock = -1;
     }
 
+  zebra_redistribute_dump_stop (client);
+
   /* Free stream buffers. */
   if (client->ibuf)
     stream_free (client->ibuf);
@@ -1580,6 +1584,39 @@ DEFUN (config_table,
   return CMD_SUCCESS;
 }
 
+DEFUN (rib_queue_batch,
+       rib_queue_batch_cmd,
+       "rib queue batch <1-100000>",
+       "Routing Information Base\n"
+       "RIB update queue\n"
+       "Number of route nodes processed per queue run\n"
+       "Route nodes\n")
+{
+  VTY_GET_INTEGER_RANGE ("batch", rib_process_batch, argv[0], 1, 100000);
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_rib_queue_batch,
+       no_rib_queue_batch_cmd,
+       "no rib queue batch",
+       NO_STR
+       "Routing Information Base\n"
+       "RIB update queue\n"
+       "Number of route nodes processed per queue run\n")
+{
+  rib_process_batch = RIB_PROCESS_BATCH_DEFAULT;
+  return CMD_SUCCESS;
+}
+
+ALIAS (no_rib_queue_batch,
+       no_rib_queue_batch_val_cmd,
+       "no rib queue batch <1-100000>",
+       NO_STR
+       "Routing Information Base\n"
+       "RIB update queue\n"
+       "Number of route nodes processed per queue run\n"
+       "Route nodes\n")
+
 DEFUN (ip_forwarding,
        ip_forwarding_cmd,
        "ip forwarding",
@@ -1635,7 +1672,12 @@ DEFUN (show_zebra_client,
   struct zserv *client;
 
   for (ALL_LIST_ELEMENTS_RO (zebrad.client_list, node, client))
-    vty_out (vty, "Client fd %d%s", client->sock, VTY_NEWLINE);
+    {
+      vty_out (vty, "Client fd %d%s", client->sock, VTY_NEWLINE);
+      vty_out (vty, "  Output buffer: %lu bytes%s",
+               (unsigned long) buffer_pending (client->wb), VTY_NEWLINE);
+      zebra_redistribute_dump_show (vty, client);
+    }
   
   return CMD_SUCCESS;
 }
@@ -1647,6 +1689,8 @@ config_write_table (struct vty *vty)
   if (zebrad.rtm_table_default)
     vty_out (vty, "table %d%s", zebrad.rtm_table_default,
 	     VTY_NEWLINE);
+  if (rib_process_batch != RIB_PROCESS_BATCH_DEFAULT)
+    vty_out (vty, "rib queue batch %d%s", rib_process_batch, VTY_NEWLINE);
   return 0;
 }
 
@@ -1802,6 +1846,10 @@ zebra_init (void)
   install_element (CONFIG_NODE, &config_table_cmd);
 #endif /* HAVE_NETLINK */
 
+  install_element (CONFIG_NODE, &rib_queue_batch_cmd);
+  install_element (CONFIG_NODE, &no_rib_queue_batch_cmd);
+  install_element (CONFIG_NODE, &no_rib_queue_batch_val_cmd);
+
 #ifdef HAVE_IPV6
   install_element (VIEW_NODE, &show_ipv6_forwarding_cmd);
   install_element (ENABLE_NODE, &show_ipv6_forwarding_cmd);
@@ -61,6 +61,19 @@ struct zserv
   /* Redistribute default route flag. */
   u_char redist_default;
 
+  /* Redistribution dump in progress: route types being sent in this
+     pass, types requested since it started, and where the walk is. */
+  u_char redist_dump[ZEBRA_ROUTE_MAX];
+  u_char redist_dump_queued[ZEBRA_ROUTE_MAX];
+  afi_t redist_dump_afi;
+  route_table_iter_t redist_dump_iter;
+  struct thread *t_redist_dump;
+
+  /* Redistribution dump statistics. */
+  unsigned long redist_dump_nodes;
+  unsigned long redist_dump_routes;
+  unsigned long redist_dump_passes;
+
   /* Interface information. */
   u_char ifinfo;
 